@@ -26,6 +26,8 @@
         'allocators_impl.h',
         'block.cc',
         'block.h',
+        'block_checksum.cc',
+        'block_checksum.h',
         'block_impl.h',
         'block_utils.cc',
         'block_utils.h',
@@ -47,6 +49,8 @@
         'heap_managers/block_heap_manager.h',
         'heap_managers/deferred_free_thread.cc',
         'heap_managers/deferred_free_thread.h',
+        'heap_managers/thread_block_cache.cc',
+        'heap_managers/thread_block_cache.h',
         'heaps/internal_heap.cc',
         'heaps/internal_heap.h',
         'heaps/large_block_heap.cc',
@@ -101,6 +105,8 @@
         'shadow_impl.h',
         'shadow_marker.cc',
         'shadow_marker.h',
+        'shadow_scan.cc',
+        'shadow_scan.h',
         'stack_capture_cache.cc',
         'stack_capture_cache.h',
         'system_interceptors.cc',
@@ -170,6 +176,7 @@
       'sources': [
         'allocators_unittest.cc',
         'crt_interceptors_unittest.cc',
+        'block_checksum_unittest.cc',
         'block_unittest.cc',
         'block_utils_unittest.cc',
         'circular_queue_unittest.cc',
@@ -188,6 +195,7 @@
         'runtime_unittest.cc',
         'scoped_page_protections_unittest.cc',
         'shadow_marker_unittest.cc',
+        'shadow_scan_unittest.cc',
         'shadow_unittest.cc',
         'stack_capture_cache_unittest.cc',
         'static_shadow.cc',
@@ -201,6 +209,7 @@
         'heaps/zebra_block_heap_unittest.cc',
         'heap_managers/block_heap_manager_unittest.cc',
         'heap_managers/deferred_free_thread_unittest.cc',
+        'heap_managers/thread_block_cache_unittest.cc',
         'memory_notifiers/shadow_memory_notifier_unittest.cc',
         'quarantines/sharded_quarantine_unittest.cc',
         'quarantines/size_limited_quarantine_unittest.cc',
@@ -16,8 +16,8 @@
 
 #include <algorithm>
 
-#include "base/hash.h"
 #include "base/logging.h"
+#include "syzygy/agent/asan/block_checksum.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/shadow.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
@@ -430,29 +430,26 @@ bool BlockChecksumIsValid(const BlockInfo& block_info) {
 void BlockSetChecksum(const BlockInfo& block_info) {
   block_info.header->checksum = 0;
 
-  uint32_t checksum = 0;
+  uint32_t checksum = BlockChecksumHash(block_info.header,
+                                        block_info.TotalHeaderSize(), 0);
   switch (static_cast<BlockState>(block_info.header->state)) {
     case ALLOCATED_BLOCK:
     case QUARANTINED_FLOODED_BLOCK: {
       // Only checksum the header and trailer regions.
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.header),
-          block_info.TotalHeaderSize());
-      checksum ^= base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.trailer_padding),
-          block_info.TotalTrailerSize());
       break;
     }
 
-    // The checksum is the calculated in the same way in these two cases.
+    // The checksum is the calculated in the same way in these two cases. Large
+    // bodies may only be sampled, see BlockChecksumHashBody.
     case QUARANTINED_BLOCK:
     case FREED_BLOCK: {
-      checksum = base::SuperFastHash(
-          reinterpret_cast<const char*>(block_info.header),
-          block_info.block_size);
+      checksum = BlockChecksumHashBody(block_info.body, block_info.body_size,
+                                       checksum);
       break;
     }
   }
+  checksum = BlockChecksumHash(block_info.trailer_padding,
+                               block_info.TotalTrailerSize(), checksum);
 
   checksum = CombineUInt32IntoBlockChecksum(checksum);
   DCHECK_EQ(0u, checksum >> kBlockHeaderChecksumBits);
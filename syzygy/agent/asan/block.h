@@ -426,6 +426,8 @@ bool BlockChecksumIsValid(const BlockInfo& block_info);
 // Calculates and sets the block checksum in place.
 // @param block_info The block to be checksummed.
 // @note The pages containing the block must be writable and readable.
+// @note The checksum of a quarantined or freed block covers its body, which
+//     may only be sampled if it is large. See block_checksum.h.
 void BlockSetChecksum(const BlockInfo& block_info);
 // @}
 
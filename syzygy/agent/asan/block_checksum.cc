@@ -0,0 +1,195 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/block_checksum.h"
+
+#include <nmmintrin.h>
+#include <stdlib.h>
+
+#include "base/cpu.h"
+#include "base/hash.h"
+#include "base/logging.h"
+#include "base/macros.h"
+#include "syzygy/common/align.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+// A hash function backing the checksums.
+typedef uint32_t (*HashFunction)(const uint8_t* data,
+                                 size_t length,
+                                 uint32_t seed);
+
+uint32_t SuperFastHashFunction(const uint8_t* data,
+                               size_t length,
+                               uint32_t seed) {
+  // SuperFastHash can't be seeded, so fold the seed in afterwards. Rotating
+  // the seed makes the result depend on the order of the ranges.
+  return ::_rotl(seed, 5) ^
+      base::SuperFastHash(reinterpret_cast<const char*>(data),
+                          static_cast<int>(length));
+}
+
+uint32_t Crc32cFunction(const uint8_t* data, size_t length, uint32_t seed) {
+  // The crc32 instruction has a latency of 3 cycles but a throughput of 1 per
+  // cycle. Long buffers are thus hashed as 3 interleaved streams of words,
+  // which are folded together at the end. This isn't the CRC32C of the buffer
+  // but it is just as good a checksum.
+  static const size_t kStreamCount = 3;
+  static const size_t kMinLengthForStreams = 256;
+
+  uint32_t crc = ~seed;
+
+  // Process the unaligned head a byte at a time.
+  for (; length != 0 && !::common::IsAligned(data, sizeof(uint32_t));
+       ++data, --length) {
+    crc = _mm_crc32_u8(crc, *data);
+  }
+
+  const uint32_t* words = reinterpret_cast<const uint32_t*>(data);
+  if (length >= kMinLengthForStreams) {
+    size_t groups = length / (kStreamCount * sizeof(uint32_t));
+    uint32_t crc1 = 0;
+    uint32_t crc2 = 0;
+    for (size_t i = 0; i < groups; ++i, words += kStreamCount) {
+      crc = _mm_crc32_u32(crc, words[0]);
+      crc1 = _mm_crc32_u32(crc1, words[1]);
+      crc2 = _mm_crc32_u32(crc2, words[2]);
+    }
+    crc = _mm_crc32_u32(crc, crc1);
+    crc = _mm_crc32_u32(crc, crc2);
+    length -= groups * kStreamCount * sizeof(uint32_t);
+  }
+
+  // Process the remaining words, then the tail.
+  for (; length >= sizeof(uint32_t); ++words, length -= sizeof(uint32_t))
+    crc = _mm_crc32_u32(crc, *words);
+  data = reinterpret_cast<const uint8_t*>(words);
+  for (; length != 0; ++data, --length)
+    crc = _mm_crc32_u8(crc, *data);
+
+  return ~crc;
+}
+
+const HashFunction kHashFunctions[] = {
+  &SuperFastHashFunction,
+  &Crc32cFunction,
+};
+static_assert(arraysize(kHashFunctions) == kBlockChecksumEngineCount,
+              "Missing block checksum hash functions.");
+
+const char* const kEngineNames[] = { "SuperFastHash", "CRC32C" };
+static_assert(arraysize(kEngineNames) == kBlockChecksumEngineCount,
+              "Missing block checksum engine names.");
+
+// The hash function in use. This is lazily initialized on first use rather
+// than at static initialization time, as blocks may be checksummed before
+// this module's initializers have run. Concurrent initializations all store
+// the same value, so this doesn't need to be synchronized.
+const HashFunction* selected_hash_function = nullptr;
+
+// The body size above which block bodies are sampled. 0 means never.
+uint32_t sampling_threshold = 0;
+
+inline HashFunction GetSelectedHashFunction() {
+  const HashFunction* function = selected_hash_function;
+  if (function == nullptr) {
+    function = &kHashFunctions[GetBestBlockChecksumEngine()];
+    selected_hash_function = function;
+  }
+  return *function;
+}
+
+}  // namespace
+
+bool IsBlockChecksumEngineSupported(BlockChecksumEngine engine) {
+  switch (engine) {
+    case kSuperFastHashBlockChecksumEngine:
+      return true;
+    case kCrc32cBlockChecksumEngine:
+      return base::CPU().has_sse42();
+    default:
+      NOTREACHED();
+      return false;
+  }
+}
+
+BlockChecksumEngine GetBestBlockChecksumEngine() {
+  if (IsBlockChecksumEngineSupported(kCrc32cBlockChecksumEngine))
+    return kCrc32cBlockChecksumEngine;
+  return kSuperFastHashBlockChecksumEngine;
+}
+
+const char* GetBlockChecksumEngineName(BlockChecksumEngine engine) {
+  DCHECK_GT(kBlockChecksumEngineCount, engine);
+  return kEngineNames[engine];
+}
+
+BlockChecksumEngine GetBlockChecksumEngine() {
+  GetSelectedHashFunction();
+  return static_cast<BlockChecksumEngine>(
+      selected_hash_function - kHashFunctions);
+}
+
+void SetBlockChecksumEngine(BlockChecksumEngine engine) {
+  DCHECK_GT(kBlockChecksumEngineCount, engine);
+  DCHECK(IsBlockChecksumEngineSupported(engine));
+  selected_hash_function = &kHashFunctions[engine];
+}
+
+uint32_t GetBlockChecksumSamplingThreshold() {
+  return sampling_threshold;
+}
+
+void SetBlockChecksumSamplingThreshold(uint32_t threshold) {
+  sampling_threshold = threshold;
+}
+
+uint32_t BlockChecksumHash(const void* data, size_t length, uint32_t seed) {
+  DCHECK(data != nullptr || length == 0);
+  return GetSelectedHashFunction()(reinterpret_cast<const uint8_t*>(data),
+                                   length, seed);
+}
+
+uint32_t BlockChecksumHashBody(const void* body,
+                               size_t body_size,
+                               uint32_t seed) {
+  static const size_t kSampledSize =
+      kBlockChecksumSampleCount * kBlockChecksumSampleSize;
+
+  // Sampling only pays off if it skips part of the body.
+  if (sampling_threshold == 0 || body_size <= sampling_threshold ||
+      body_size <= kSampledSize) {
+    return BlockChecksumHash(body, body_size, seed);
+  }
+
+  // Hash evenly spaced samples, the first one starting at the beginning of the
+  // body and the last one ending at its end.
+  HashFunction hash = GetSelectedHashFunction();
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(body);
+  size_t last_offset = body_size - kBlockChecksumSampleSize;
+  uint32_t checksum = seed;
+  for (size_t i = 0; i < kBlockChecksumSampleCount; ++i) {
+    size_t offset = static_cast<size_t>(
+        static_cast<uint64_t>(last_offset) * i /
+        (kBlockChecksumSampleCount - 1));
+    checksum = hash(data + offset, kBlockChecksumSampleSize, checksum);
+  }
+  return checksum;
+}
+
+}  // namespace asan
+}  // namespace agent
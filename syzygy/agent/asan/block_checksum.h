@@ -0,0 +1,94 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the hash functions backing the block checksums. The fastest hash
+// function supported by the CPU is selected at runtime, on first use. The
+// checksums of large block bodies can optionally be computed over a sample of
+// the body rather than over the entire body.
+//
+// The configuration must not change while checksummed blocks exist, as their
+// checksums would become invalid. It is set once by the runtime at startup.
+
+#ifndef SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
+#define SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
+
+#include <stdint.h>
+
+namespace agent {
+namespace asan {
+
+// The hash functions that may back the block checksums, from slowest to
+// fastest.
+enum BlockChecksumEngine {
+  // base::SuperFastHash, supported everywhere.
+  kSuperFastHashBlockChecksumEngine,
+  // CRC32C computed with the SSE4.2 crc32 instruction, on 3 interleaved
+  // streams to hide the latency of the instruction.
+  kCrc32cBlockChecksumEngine,
+  kBlockChecksumEngineCount,
+};
+
+// The number of samples, and the size of each sample, used when checksumming
+// a block body by sampling.
+static const size_t kBlockChecksumSampleCount = 64;
+static const size_t kBlockChecksumSampleSize = 64;
+
+// @param engine A checksum engine.
+// @returns true if the CPU supports @p engine.
+bool IsBlockChecksumEngineSupported(BlockChecksumEngine engine);
+
+// @returns the fastest checksum engine supported by the CPU.
+BlockChecksumEngine GetBestBlockChecksumEngine();
+
+// @param engine A checksum engine.
+// @returns the name of @p engine, for use in logs and metrics.
+const char* GetBlockChecksumEngineName(BlockChecksumEngine engine);
+
+// @name Accessors for the checksum engine in use. This defaults to
+//     GetBestBlockChecksumEngine(). Setting it is intended for testing and
+//     benchmarking.
+// @{
+BlockChecksumEngine GetBlockChecksumEngine();
+void SetBlockChecksumEngine(BlockChecksumEngine engine);
+// @}
+
+// @name Accessors for the body size above which block bodies are checksummed
+//     by sampling. A value of 0 disables sampling, which is the default.
+// @{
+uint32_t GetBlockChecksumSamplingThreshold();
+void SetBlockChecksumSamplingThreshold(uint32_t threshold);
+// @}
+
+// Hashes a range of memory with the checksum engine in use.
+// @param data The range to hash.
+// @param length The length of the range.
+// @param seed The hash of the preceding ranges, or 0 for the first range.
+// @returns the hash of the range, combined with @p seed.
+uint32_t BlockChecksumHash(const void* data, size_t length, uint32_t seed);
+
+// Hashes a block body with the checksum engine in use. If the body is larger
+// than the sampling threshold then only kBlockChecksumSampleCount evenly
+// spaced samples of the body are hashed, including its first and last bytes.
+// @param body The block body.
+// @param body_size The size of the block body.
+// @param seed The hash of the preceding ranges, or 0 for the first range.
+// @returns the hash of the body, combined with @p seed.
+uint32_t BlockChecksumHashBody(const void* body,
+                               size_t body_size,
+                               uint32_t seed);
+
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_BLOCK_CHECKSUM_H_
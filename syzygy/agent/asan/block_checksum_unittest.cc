@@ -0,0 +1,176 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/block_checksum.h"
+
+#include <vector>
+
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/rand_util.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+
+namespace {
+
+class BlockChecksumTest : public testing::TestWithParam<BlockChecksumEngine> {
+ public:
+  void SetUp() override {
+    original_engine_ = GetBlockChecksumEngine();
+    supported_ = IsBlockChecksumEngineSupported(GetParam());
+    if (!supported_) {
+      LOG(INFO) << "Skipping the unsupported "
+                << GetBlockChecksumEngineName(GetParam()) << " engine.";
+      return;
+    }
+    SetBlockChecksumEngine(GetParam());
+  }
+
+  void TearDown() override {
+    SetBlockChecksumEngine(original_engine_);
+    SetBlockChecksumSamplingThreshold(0);
+  }
+
+ protected:
+  BlockChecksumEngine original_engine_;
+  bool supported_;
+};
+
+}  // namespace
+
+TEST(BlockChecksumEngineTest, Selection) {
+  EXPECT_TRUE(IsBlockChecksumEngineSupported(
+      kSuperFastHashBlockChecksumEngine));
+  BlockChecksumEngine best = GetBestBlockChecksumEngine();
+  EXPECT_TRUE(IsBlockChecksumEngineSupported(best));
+  EXPECT_EQ(best, GetBlockChecksumEngine());
+  for (int i = 0; i < kBlockChecksumEngineCount; ++i) {
+    BlockChecksumEngine engine = static_cast<BlockChecksumEngine>(i);
+    EXPECT_EQ(engine <= best, IsBlockChecksumEngineSupported(engine));
+    EXPECT_NE(static_cast<const char*>(nullptr),
+              GetBlockChecksumEngineName(engine));
+  }
+  EXPECT_EQ(0u, GetBlockChecksumSamplingThreshold());
+}
+
+TEST_P(BlockChecksumTest, HashDependsOnDataAndSeed) {
+  if (!supported_)
+    return;
+
+  std::vector<uint8_t> data(4096);
+  base::RandBytes(data.data(), data.size());
+
+  uint32_t hash = BlockChecksumHash(data.data(), data.size(), 0);
+  EXPECT_EQ(hash, BlockChecksumHash(data.data(), data.size(), 0));
+  EXPECT_NE(hash, BlockChecksumHash(data.data(), data.size(), 1));
+  EXPECT_NE(hash, BlockChecksumHash(data.data(), data.size() - 1, 0));
+
+  // Hashing ranges in a different order yields a different result.
+  uint8_t* middle = data.data() + data.size() / 2;
+  uint32_t forward = BlockChecksumHash(
+      middle, data.size() / 2, BlockChecksumHash(data.data(),
+                                                 data.size() / 2, 0));
+  uint32_t backward = BlockChecksumHash(
+      data.data(), data.size() / 2, BlockChecksumHash(middle,
+                                                      data.size() / 2, 0));
+  EXPECT_NE(forward, backward);
+}
+
+TEST_P(BlockChecksumTest, HashDetectsBitFlips) {
+  if (!supported_)
+    return;
+
+  // Flip every bit of buffers of various sizes and alignments. This covers
+  // the short and the long paths of the hash functions.
+  static const size_t kSizes[] = {1, 3, 17, 255, 256, 1000};
+  std::vector<uint8_t> buffer(1024 + 4);
+  base::RandBytes(buffer.data(), buffer.size());
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    for (size_t offset = 0; offset < 4; ++offset) {
+      uint8_t* data = buffer.data() + offset;
+      uint32_t hash = BlockChecksumHash(data, kSizes[i], 0);
+      for (size_t j = 0; j < kSizes[i] * 8; ++j) {
+        data[j / 8] ^= 1 << (j % 8);
+        EXPECT_NE(hash, BlockChecksumHash(data, kSizes[i], 0));
+        data[j / 8] ^= 1 << (j % 8);
+      }
+    }
+  }
+}
+
+TEST_P(BlockChecksumTest, HashBodySampling) {
+  if (!supported_)
+    return;
+
+  static const size_t kBodySize = 1024 * 1024;
+  std::vector<uint8_t> body(kBodySize);
+  base::RandBytes(body.data(), body.size());
+
+  // Without sampling the body is hashed entirely.
+  EXPECT_EQ(0u, GetBlockChecksumSamplingThreshold());
+  EXPECT_EQ(BlockChecksumHash(body.data(), body.size(), 42),
+            BlockChecksumHashBody(body.data(), body.size(), 42));
+
+  // Bodies below the threshold are still hashed entirely.
+  SetBlockChecksumSamplingThreshold(kBodySize);
+  EXPECT_EQ(kBodySize, GetBlockChecksumSamplingThreshold());
+  EXPECT_EQ(BlockChecksumHash(body.data(), body.size(), 42),
+            BlockChecksumHashBody(body.data(), body.size(), 42));
+
+  // Bodies above it are sampled. The first and last bytes are always part of
+  // the samples, but a byte halfway between two samples isn't.
+  SetBlockChecksumSamplingThreshold(64 * 1024);
+  uint32_t hash = BlockChecksumHashBody(body.data(), body.size(), 42);
+  EXPECT_NE(BlockChecksumHash(body.data(), body.size(), 42), hash);
+
+  const size_t kUnsampledOffsets[] = {
+      kBlockChecksumSampleSize + (kBodySize / kBlockChecksumSampleCount) / 2,
+      kBodySize / 2 + kBlockChecksumSampleSize * 2,
+  };
+  const size_t kSampledOffsets[] = {0, kBlockChecksumSampleSize - 1,
+                                    kBodySize - 1};
+  for (size_t i = 0; i < arraysize(kUnsampledOffsets); ++i) {
+    body[kUnsampledOffsets[i]] ^= 0xFF;
+    EXPECT_EQ(hash, BlockChecksumHashBody(body.data(), body.size(), 42));
+    body[kUnsampledOffsets[i]] ^= 0xFF;
+  }
+  for (size_t i = 0; i < arraysize(kSampledOffsets); ++i) {
+    body[kSampledOffsets[i]] ^= 0xFF;
+    EXPECT_NE(hash, BlockChecksumHashBody(body.data(), body.size(), 42));
+    body[kSampledOffsets[i]] ^= 0xFF;
+  }
+}
+
+TEST(BlockChecksumCrc32cTest, MatchesCrc32c) {
+  if (!IsBlockChecksumEngineSupported(kCrc32cBlockChecksumEngine))
+    return;
+
+  // Short buffers are hashed with a plain CRC32C.
+  BlockChecksumEngine original_engine = GetBlockChecksumEngine();
+  SetBlockChecksumEngine(kCrc32cBlockChecksumEngine);
+  static const char kCheckInput[] = "123456789";
+  EXPECT_EQ(0xE3069283u,
+            BlockChecksumHash(kCheckInput, sizeof(kCheckInput) - 1, 0));
+  SetBlockChecksumEngine(original_engine);
+}
+
+INSTANTIATE_TEST_CASE_P(BlockChecksumEngines,
+                        BlockChecksumTest,
+                        testing::Values(kSuperFastHashBlockChecksumEngine,
+                                        kCrc32cBlockChecksumEngine));
+
+}  // namespace asan
+}  // namespace agent
@@ -660,7 +660,7 @@ void PopulateAsanParameters(const AsanErrorInfo& error_info,
 
   // Any new parameter added to the parameters structure should also be added
   // here.
-  static_assert(14 == ::common::kAsanParametersVersion,
+  static_assert(15 == ::common::kAsanParametersVersion,
                 "Pointers in the params must be linked up here.");
   crashdata::Dictionary* param_dict = crashdata::DictAddDict("asan-parameters",
                                                              dict);
@@ -700,6 +700,9 @@ void PopulateAsanParameters(const AsanErrorInfo& error_info,
   crashdata::LeafSetReal(
       error_info.asan_parameters.quarantine_flood_fill_rate,
       crashdata::DictAddLeaf("quarantine-flood-fill-rate", param_dict));
+  crashdata::LeafSetUInt(error_info.asan_parameters.checksum_sampling_threshold,
+                         crashdata::DictAddLeaf("checksum-sampling-threshold",
+                                                param_dict));
 }
 
 }  // namespace
@@ -81,6 +81,8 @@ BlockHeapManager::BlockHeapManager(Shadow* shadow,
       zebra_block_heap_(nullptr),
       zebra_block_heap_id_(0),
       large_block_heap_id_(0),
+      thread_block_caches_enabled_(false),
+      thread_block_caches_(nullptr),
       locked_heaps_(nullptr),
       enable_page_protections_(true),
       corrupt_block_registry_cache_(L"SyzyAsanCorruptBlocks") {
@@ -94,6 +96,10 @@ BlockHeapManager::BlockHeapManager(Shadow* shadow,
   CHECK_NE(TLS_OUT_OF_INDEXES, allocation_filter_flag_tls_);
   // And disable it by default.
   set_allocation_filter_flag(false);
+
+  // Allocate the TLS slot of the thread block caches.
+  thread_block_cache_tls_ = ::TlsAlloc();
+  CHECK_NE(TLS_OUT_OF_INDEXES, thread_block_cache_tls_);
 }
 
 BlockHeapManager::~BlockHeapManager() {
@@ -204,10 +210,18 @@ void* BlockHeapManager::Allocate(HeapId heap_id, uint32_t bytes) {
     heaps[heap_count++] = zebra_block_heap_id_;
   }
 
-  // Use the selected heaps to try to satisfy the allocation.
+  // Small allocations that can only be served by the process heap are taken
+  // from the thread block cache if possible.
   void* alloc = nullptr;
   BlockLayout block_layout = {};
-  for (int i = static_cast<int>(heap_count) - 1; i >= 0; --i) {
+  if (thread_block_caches_enabled_ && heap_count == 1 &&
+      heap_id == process_heap_id_) {
+    alloc = AllocateFromThreadBlockCache(bytes, &block_layout);
+  }
+
+  // Use the selected heaps to try to satisfy the allocation.
+  for (int i = static_cast<int>(heap_count) - 1;
+       alloc == nullptr && i >= 0; --i) {
     BlockHeapInterface* heap = GetHeapFromId(heaps[i]);
     alloc = heap->AllocateBlock(
         bytes,
@@ -314,6 +328,13 @@ bool BlockHeapManager::Free(HeapId heap_id, void* alloc) {
   // Update the block checksum.
   BlockSetChecksum(block_info);
 
+  // Blocks of the process heap enter the quarantine in batches when the thread
+  // block caches are enabled.
+  if (thread_block_caches_enabled_ && heap_id == process_heap_id_ &&
+      QuarantineInThreadBlockCache(block_info)) {
+    return true;
+  }
+
   CompactBlockInfo compact = {};
   ConvertBlockInfo(block_info, &compact);
 
@@ -425,6 +446,11 @@ void BlockHeapManager::set_parameters(
 }
 
 void BlockHeapManager::TearDownHeapManager() {
+  // Empty the thread block caches while the process heap is still alive. This
+  // can trim the quarantine, so it must be done before acquiring lock_.
+  thread_block_caches_enabled_ = false;
+  FlushThreadBlockCaches();
+
   base::AutoLock lock(lock_);
 
   // This would indicate that we have outstanding heap locks being
@@ -458,6 +484,20 @@ void BlockHeapManager::TearDownHeapManager() {
     ::TlsFree(allocation_filter_flag_tls_);
     allocation_filter_flag_tls_ = TLS_OUT_OF_INDEXES;
   }
+
+  // Delete the thread block caches, which are now empty, and their TLS slot.
+  {
+    base::AutoLock caches_lock(thread_block_caches_lock_);
+    while (thread_block_caches_ != nullptr) {
+      ThreadBlockCache* cache = thread_block_caches_;
+      thread_block_caches_ = cache->next();
+      delete cache;
+    }
+  }
+  if (thread_block_cache_tls_ != TLS_OUT_OF_INDEXES) {
+    ::TlsFree(thread_block_cache_tls_);
+    thread_block_cache_tls_ = TLS_OUT_OF_INDEXES;
+  }
 }
 
 HeapId BlockHeapManager::GetHeapId(
@@ -647,6 +687,19 @@ bool BlockHeapManager::IsDeferredFreeThreadRunning() {
   return deferred_free_thread_ != nullptr;
 }
 
+void BlockHeapManager::EnableThreadBlockCaches() {
+  DCHECK(initialized_);
+  thread_block_caches_enabled_ = true;
+}
+
+void BlockHeapManager::DisableThreadBlockCaches() {
+  DCHECK(initialized_);
+  // Threads that are still using their cache may put a few blocks in it after
+  // it has been flushed. These are returned when the manager is torn down.
+  thread_block_caches_enabled_ = false;
+  FlushThreadBlockCaches();
+}
+
 HeapType BlockHeapManager::GetHeapTypeUnlocked(HeapId heap_id) {
   DCHECK(initialized_);
   DCHECK(IsValidHeapIdUnlocked(heap_id, true));
@@ -818,6 +871,12 @@ bool BlockHeapManager::FreePristineBlock(BlockInfo* block_info) {
 
   block_info->header->state = FREED_BLOCK;
 
+  // Small blocks of the process heap are kept in the thread block caches.
+  if (thread_block_caches_enabled_ && heap == process_heap_ &&
+      FreeToThreadBlockCache(*block_info)) {
+    return true;
+  }
+
   if ((heap->GetHeapFeatures() &
        HeapInterface::kHeapReportsReservations) != 0) {
     shadow_->Poison(block_info->header,
@@ -1015,6 +1074,243 @@ void BlockHeapManager::EnableDeferredFreeThreadWithCallback(
   deferred_free_thread_->Start();
 }
 
+ThreadBlockCache* BlockHeapManager::GetThreadBlockCache() {
+  ThreadBlockCache* cache = reinterpret_cast<ThreadBlockCache*>(
+      ::TlsGetValue(thread_block_cache_tls_));
+  if (cache != nullptr)
+    return cache;
+
+  // The cache keeps a handle to its thread to know when it can be adopted.
+  HANDLE thread = nullptr;
+  if (!::DuplicateHandle(::GetCurrentProcess(), ::GetCurrentThread(),
+                         ::GetCurrentProcess(), &thread, SYNCHRONIZE, FALSE,
+                         0)) {
+    return nullptr;
+  }
+
+  {
+    base::AutoLock lock(thread_block_caches_lock_);
+
+    // Reuse the cache of an exited thread, contents included, rather than
+    // leaving it idle.
+    for (cache = thread_block_caches_; cache != nullptr;
+         cache = cache->next()) {
+      base::AutoLock cache_lock(cache->lock());
+      if (cache->AdoptIfOrphaned(thread))
+        break;
+    }
+
+    if (cache == nullptr) {
+      cache = new ThreadBlockCache(thread);
+      cache->set_next(thread_block_caches_);
+      thread_block_caches_ = cache;
+    }
+  }
+
+  ::TlsSetValue(thread_block_cache_tls_, cache);
+  return cache;
+}
+
+void* BlockHeapManager::AllocateFromThreadBlockCache(uint32_t bytes,
+                                                     BlockLayout* layout) {
+  DCHECK(initialized_);
+  DCHECK_NE(static_cast<BlockLayout*>(nullptr), layout);
+
+  if (!BlockPlanLayout(kShadowRatio, kShadowRatio, bytes, 0,
+                       parameters_.trailer_padding_size + sizeof(BlockTrailer),
+                       layout)) {
+    return nullptr;
+  }
+  size_t size_class = 0;
+  if (!ThreadBlockCache::GetSizeClass(layout->block_size, &size_class))
+    return nullptr;
+  ThreadBlockCache* cache = GetThreadBlockCache();
+  if (cache == nullptr)
+    return nullptr;
+
+  // Round the block up to its size class. This only widens the right redzone.
+  uint32_t block_size = ThreadBlockCache::GetSizeClassBlockSize(size_class);
+  layout->trailer_padding_size += block_size - layout->block_size;
+  layout->block_size = block_size;
+
+  {
+    base::AutoLock lock(cache->lock());
+    void* alloc = cache->Pop(size_class);
+    if (alloc != nullptr)
+      return alloc;
+  }
+
+  // The size class is empty, refill it with a batch of allocations taken
+  // under a single heap lock. The first one serves this allocation.
+  void* allocs[ThreadBlockCache::kMaxBlocksPerSizeClass] = {};
+  size_t batch_size = ThreadBlockCache::GetBatchSize(size_class);
+  size_t count = 0;
+  process_heap_->Lock();
+  for (; count < batch_size; ++count) {
+    allocs[count] = process_heap_->Allocate(block_size);
+    if (allocs[count] == nullptr)
+      break;
+  }
+  process_heap_->Unlock();
+  if (count == 0)
+    return nullptr;
+
+  // Cached allocations stay poisoned until they are handed out.
+  for (size_t i = 1; i < count; ++i)
+    shadow_->Poison(allocs[i], block_size, kAsanReservedMarker);
+  {
+    base::AutoLock lock(cache->lock());
+    // Only the owning thread fills the cache, so there's room for the batch.
+    for (size_t i = 1; i < count; ++i)
+      CHECK(cache->Push(size_class, allocs[i]));
+  }
+
+  return allocs[0];
+}
+
+bool BlockHeapManager::FreeToThreadBlockCache(const BlockInfo& block_info) {
+  DCHECK(initialized_);
+
+  // Only allocations that exactly fill a size class are cached. This is the
+  // case of all of those that were served by the caches.
+  size_t size_class = 0;
+  if (!ThreadBlockCache::GetSizeClass(block_info.block_size, &size_class) ||
+      ThreadBlockCache::GetSizeClassBlockSize(size_class) !=
+          block_info.block_size) {
+    return false;
+  }
+  ThreadBlockCache* cache = GetThreadBlockCache();
+  if (cache == nullptr)
+    return false;
+
+  // The whole allocation is poisoned while cached, so any access to it is
+  // still reported.
+  shadow_->Poison(block_info.header, block_info.block_size,
+                  kAsanReservedMarker);
+
+  // If the size class is full then its oldest allocations are returned to the
+  // heap to make room.
+  void* allocs[ThreadBlockCache::kMaxBlocksPerSizeClass] = {};
+  size_t count = 0;
+  {
+    base::AutoLock lock(cache->lock());
+    if (!cache->Push(size_class, block_info.header)) {
+      count = cache->Drain(size_class,
+                           ThreadBlockCache::GetBatchSize(size_class),
+                           allocs);
+      CHECK(cache->Push(size_class, block_info.header));
+    }
+  }
+  ReturnAllocsToProcessHeap(allocs, count, block_info.block_size);
+
+  return true;
+}
+
+bool BlockHeapManager::QuarantineInThreadBlockCache(
+    const BlockInfo& block_info) {
+  DCHECK(initialized_);
+  ThreadBlockCache* cache = GetThreadBlockCache();
+  if (cache == nullptr)
+    return false;
+
+  // Protect the block before it becomes visible to the threads that may flush
+  // this cache.
+  if (enable_page_protections_)
+    BlockProtectAll(block_info, shadow_);
+
+  CompactBlockInfo compact = {};
+  ConvertBlockInfo(block_info, &compact);
+
+  CompactBlockInfo batch[ThreadBlockCache::kQuarantineBatchSize] = {};
+  size_t count = 0;
+  {
+    base::AutoLock lock(cache->lock());
+    if (cache->PushQuarantined(compact))
+      count = cache->TakeQuarantined(batch);
+  }
+  if (count != 0)
+    PushQuarantineBatch(batch, count);
+
+  return true;
+}
+
+void BlockHeapManager::PushQuarantineBatch(const CompactBlockInfo* blocks,
+                                           size_t count) {
+  DCHECK(initialized_);
+  DCHECK_NE(static_cast<const CompactBlockInfo*>(nullptr), blocks);
+
+  // The blocks are already protected, so unlike in Free they can be pushed
+  // without further work under the quarantine lock.
+  TrimStatus trim_status = TRIM_NOT_REQUIRED;
+  for (size_t i = 0; i < count; ++i) {
+    PushResult push_result = {};
+    {
+      BlockQuarantineInterface::AutoQuarantineLock quarantine_lock(
+          &shared_quarantine_, blocks[i]);
+      push_result = shared_quarantine_.Push(blocks[i]);
+    }
+    trim_status |= push_result.trim_status;
+
+    if (!push_result.push_successful) {
+      BlockInfo expanded = {};
+      ConvertBlockInfo(blocks[i], &expanded);
+      FreePristineBlock(&expanded);
+    }
+  }
+
+  // Trim once for the whole batch.
+  TrimOrScheduleIfNecessary(trim_status, &shared_quarantine_);
+}
+
+void BlockHeapManager::ReturnAllocsToProcessHeap(void** allocs,
+                                                 size_t count,
+                                                 uint32_t block_size) {
+  DCHECK_NE(static_cast<void**>(nullptr), allocs);
+  if (count == 0)
+    return;
+  DCHECK_EQ(0u, process_heap_->GetHeapFeatures() &
+                HeapInterface::kHeapReportsReservations);
+
+  for (size_t i = 0; i < count; ++i)
+    shadow_->Unpoison(allocs[i], block_size);
+
+  process_heap_->Lock();
+  for (size_t i = 0; i < count; ++i)
+    CHECK(process_heap_->Free(allocs[i]));
+  process_heap_->Unlock();
+}
+
+void BlockHeapManager::FlushThreadBlockCaches() {
+  // Caches are never removed from the list and their next pointers don't
+  // change, so it can be walked without holding thread_block_caches_lock_.
+  ThreadBlockCache* cache = nullptr;
+  {
+    base::AutoLock lock(thread_block_caches_lock_);
+    cache = thread_block_caches_;
+  }
+
+  for (; cache != nullptr; cache = cache->next()) {
+    CompactBlockInfo batch[ThreadBlockCache::kQuarantineBatchSize] = {};
+    size_t count = 0;
+    {
+      base::AutoLock lock(cache->lock());
+      count = cache->TakeQuarantined(batch);
+    }
+    if (count != 0)
+      PushQuarantineBatch(batch, count);
+
+    for (size_t i = 0; i < ThreadBlockCache::kSizeClassCount; ++i) {
+      void* allocs[ThreadBlockCache::kMaxBlocksPerSizeClass] = {};
+      {
+        base::AutoLock lock(cache->lock());
+        count = cache->Drain(i, arraysize(allocs), allocs);
+      }
+      ReturnAllocsToProcessHeap(allocs, count,
+                                ThreadBlockCache::GetSizeClassBlockSize(i));
+    }
+  }
+}
+
 }  // namespace heap_managers
 }  // namespace asan
 }  // namespace agent
@@ -32,6 +32,7 @@
 #include "syzygy/agent/asan/registry_cache.h"
 #include "syzygy/agent/asan/stack_capture_cache.h"
 #include "syzygy/agent/asan/heap_managers/deferred_free_thread.h"
+#include "syzygy/agent/asan/heap_managers/thread_block_cache.h"
 #include "syzygy/agent/asan/memory_notifiers/shadow_memory_notifier.h"
 #include "syzygy/agent/asan/quarantines/sharded_quarantine.h"
 #include "syzygy/agent/common/stack_capture.h"
@@ -140,6 +141,22 @@ class BlockHeapManager : public HeapManagerInterface {
   // @returns true if the deferred thread is currently running.
   bool IsDeferredFreeThreadRunning();
 
+  // Enables the per-thread block caches. Small guarded allocations from the
+  // process heap are then served from a cache owned by the calling thread,
+  // which is refilled from and drained to the heap in batches. Freed blocks of
+  // the process heap also enter the quarantine in batches. Blocks held in the
+  // caches are poisoned, so detection is unaffected.
+  void EnableThreadBlockCaches();
+
+  // Disables the per-thread block caches. This returns their contents to the
+  // process heap and pushes their pending blocks into the quarantine.
+  void DisableThreadBlockCaches();
+
+  // @returns true if the per-thread block caches are enabled.
+  bool thread_block_caches_enabled() const {
+    return thread_block_caches_enabled_;
+  }
+
  protected:
   // This allows the runtime access to our internals, necessary for crash
   // processing.
@@ -362,6 +379,53 @@ class BlockHeapManager : public HeapManagerInterface {
   // @returns the thread ID.
   base::PlatformThreadId GetDeferredFreeThreadId();
 
+  // @name Per-thread block cache functions.
+  // @{
+  // Returns the block cache of the calling thread, creating it or adopting
+  // the cache of an exited thread if necessary.
+  // @returns the cache, or nullptr if it can't be created.
+  ThreadBlockCache* GetThreadBlockCache();
+
+  // Tries to serve an allocation from the block cache of the calling thread.
+  // The block is rounded up to its size class by growing its trailer padding.
+  // @param bytes The allocation size.
+  // @param layout Receives the layout of the block.
+  // @returns the block allocation, or nullptr if the allocation can't be
+  //     cached or the process heap is out of memory.
+  void* AllocateFromThreadBlockCache(uint32_t bytes, BlockLayout* layout);
+
+  // Tries to put the memory of a freed block of the process heap in the block
+  // cache of the calling thread. The memory is poisoned while cached.
+  // @param block_info The freed block.
+  // @returns true if the block has been cached, false if it must be returned
+  //     to the heap.
+  bool FreeToThreadBlockCache(const BlockInfo& block_info);
+
+  // Adds a freed block of the process heap to the quarantine batch of the
+  // calling thread, pushing the batch when it's full. This takes care of
+  // protecting the block.
+  // @param block_info The freed block, ready to enter the quarantine.
+  // @returns true on success, false if the block must be pushed directly.
+  bool QuarantineInThreadBlockCache(const BlockInfo& block_info);
+
+  // Pushes a batch of freed blocks into the shared quarantine, and trims it
+  // once if necessary.
+  // @param blocks The blocks.
+  // @param count The number of blocks.
+  void PushQuarantineBatch(const CompactBlockInfo* blocks, size_t count);
+
+  // Returns allocations of the process heap that were cached.
+  // @param allocs The allocations.
+  // @param count The number of allocations.
+  // @param block_size The size of each allocation.
+  void ReturnAllocsToProcessHeap(void** allocs,
+                                 size_t count,
+                                 uint32_t block_size);
+
+  // Empties all the thread block caches.
+  void FlushThreadBlockCaches();
+  // @}
+
   // The shadow memory that is notified by all activity in this heap manager.
   Shadow* shadow_;
 
@@ -421,6 +485,18 @@ class BlockHeapManager : public HeapManagerInterface {
   // Stores the AllocationFilterFlag TLS slot.
   DWORD allocation_filter_flag_tls_;
 
+  // Indicates if the per-thread block caches are used.
+  bool thread_block_caches_enabled_;
+
+  // Stores the ThreadBlockCache TLS slot.
+  DWORD thread_block_cache_tls_;
+
+  // The list of all the thread block caches, linked through their next
+  // pointers. Caches are only ever added to this list, and live as long as
+  // the heap manager. Under thread_block_caches_lock_.
+  base::Lock thread_block_caches_lock_;
+  ThreadBlockCache* thread_block_caches_;
+
   // A list of all heaps whose locks were acquired by the last call to
   // BestEffortLockAll. This uses the internal heap, otherwise the default
   // allocator makes use of the process heap. The process heap may itself
@@ -14,6 +14,7 @@
 
 #include "syzygy/agent/asan/heap_managers/block_heap_manager.h"
 
+#include <memory>
 #include <vector>
 
 #include "base/bind.h"
@@ -21,14 +22,17 @@
 #include "base/rand_util.h"
 #include "base/sha1.h"
 #include "base/debug/alias.h"
+#include "base/strings/stringprintf.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
 #include "base/synchronization/waitable_event.h"
 #include "base/test/test_reg_util_win.h"
 #include "base/threading/simple_thread.h"
+#include "base/time/time.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/block.h"
+#include "syzygy/agent/asan/block_checksum.h"
 #include "syzygy/agent/asan/heap.h"
 #include "syzygy/agent/asan/page_protection_helpers.h"
 #include "syzygy/agent/asan/rtl_impl.h"
@@ -293,6 +297,112 @@ class TestBlockHeapManager : public BlockHeapManager {
   }
 };
 
+// Allocates and frees blocks of random small sizes, holding on to a few of
+// them at any time. If a shadow is provided then the accessibility of each
+// allocation is verified.
+class AllocationStressRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kMaxAllocSize = 512;
+  static const size_t kMaxHeldAllocs = 64;
+
+  AllocationStressRunner(BlockHeapManager* heap_manager,
+                         HeapId heap_id,
+                         Shadow* shadow,
+                         size_t iterations,
+                         uint32_t seed)
+      : heap_manager_(heap_manager),
+        heap_id_(heap_id),
+        shadow_(shadow),
+        iterations_(iterations),
+        seed_(seed),
+        errors_(0) {
+  }
+
+  void Run() override {
+    std::vector<void*> held_allocs;
+    for (size_t i = 0; i < iterations_; ++i) {
+      size_t size = 1 + NextRandom() % kMaxAllocSize;
+      uint8_t* alloc = reinterpret_cast<uint8_t*>(
+          heap_manager_->Allocate(heap_id_, size));
+      if (alloc == nullptr) {
+        ++errors_;
+        continue;
+      }
+      if (shadow_ != nullptr &&
+          (!shadow_->IsAccessible(alloc) ||
+           !shadow_->IsAccessible(alloc + size - 1) ||
+           shadow_->IsAccessible(alloc + size))) {
+        ++errors_;
+      }
+      held_allocs.push_back(alloc);
+
+      if (held_allocs.size() == kMaxHeldAllocs || (NextRandom() & 1) != 0) {
+        size_t released = NextRandom() % held_allocs.size();
+        if (!heap_manager_->Free(heap_id_, held_allocs[released]))
+          ++errors_;
+        held_allocs[released] = held_allocs.back();
+        held_allocs.pop_back();
+      }
+    }
+
+    for (size_t i = 0; i < held_allocs.size(); ++i) {
+      if (!heap_manager_->Free(heap_id_, held_allocs[i]))
+        ++errors_;
+    }
+  }
+
+  size_t errors() const { return errors_; }
+
+ private:
+  uint32_t NextRandom() {
+    seed_ = seed_ * 1103515245 + 12345;
+    return seed_ >> 8;
+  }
+
+  BlockHeapManager* heap_manager_;
+  HeapId heap_id_;
+  Shadow* shadow_;
+  size_t iterations_;
+  uint32_t seed_;
+  size_t errors_;
+
+  DISALLOW_COPY_AND_ASSIGN(AllocationStressRunner);
+};
+
+// Runs AllocationStressRunners on a number of threads.
+// @returns the time it took all of the threads to finish.
+base::TimeDelta RunAllocationStressThreads(BlockHeapManager* heap_manager,
+                                           HeapId heap_id,
+                                           Shadow* shadow,
+                                           size_t thread_count,
+                                           size_t iterations,
+                                           size_t* errors) {
+  std::vector<std::unique_ptr<AllocationStressRunner>> runners;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < thread_count; ++i) {
+    runners.push_back(std::unique_ptr<AllocationStressRunner>(
+        new AllocationStressRunner(heap_manager, heap_id, shadow, iterations,
+                                   static_cast<uint32_t>(i + 1))));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(
+            runners.back().get(),
+            base::StringPrintf("AllocationStressRunner%d",
+                               static_cast<int>(i)))));
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < thread_count; ++i)
+    threads[i]->Start();
+  for (size_t i = 0; i < thread_count; ++i)
+    threads[i]->Join();
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+  *errors = 0;
+  for (size_t i = 0; i < thread_count; ++i)
+    *errors += runners[i]->errors();
+  return elapsed;
+}
+
 // A derived class to expose protected members for unit-testing.
 class TestAsanRuntime : public agent::asan::AsanRuntime {
  public:
@@ -1759,6 +1869,182 @@ TEST_F(BlockHeapManagerTest, DeferredFreeThreadTest) {
   EXPECT_FALSE(heap_manager_->IsDeferredFreeThreadRunning());
 }
 
+TEST_F(BlockHeapManagerTest, ThreadBlockCachesPreserveDetection) {
+  const size_t kAllocSize = 13;
+  HeapId heap_id = heap_manager_->process_heap();
+  heap_manager_->EnableThreadBlockCaches();
+  ASSERT_TRUE(heap_manager_->thread_block_caches_enabled());
+
+  void* alloc = heap_manager_->Allocate(heap_id, kAllocSize);
+  ASSERT_NE(static_cast<void*>(nullptr), alloc);
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(alloc, kAllocSize));
+
+  // The block has been rounded up to its size class.
+  BlockInfo block_info = {};
+  EXPECT_TRUE(runtime_->shadow()->BlockInfoFromShadow(alloc, &block_info));
+  size_t size_class = 0;
+  EXPECT_TRUE(
+      ThreadBlockCache::GetSizeClass(block_info.block_size, &size_class));
+  EXPECT_EQ(ThreadBlockCache::GetSizeClassBlockSize(size_class),
+            block_info.block_size);
+  EXPECT_EQ(kAllocSize, block_info.body_size);
+
+  // The block is poisoned and a double free is detected before its batch
+  // reaches the quarantine.
+  size_t quarantine_count =
+      heap_manager_->shared_quarantine_.GetCountForTesting();
+  EXPECT_TRUE(heap_manager_->Free(heap_id, alloc));
+  ASSERT_NO_FATAL_FAILURE(VerifyFreedAccess(alloc, kAllocSize));
+  EXPECT_EQ(quarantine_count,
+            heap_manager_->shared_quarantine_.GetCountForTesting());
+  EXPECT_FALSE(heap_manager_->Free(heap_id, alloc));
+  ASSERT_EQ(1u, errors_.size());
+  EXPECT_EQ(DOUBLE_FREE, errors_[0].error_type);
+  EXPECT_EQ(alloc, errors_[0].location);
+
+  // Disabling the caches pushes the batch into the quarantine.
+  heap_manager_->DisableThreadBlockCaches();
+  EXPECT_FALSE(heap_manager_->thread_block_caches_enabled());
+  EXPECT_EQ(quarantine_count + 1,
+            heap_manager_->shared_quarantine_.GetCountForTesting());
+  ASSERT_NO_FATAL_FAILURE(VerifyFreedAccess(alloc, kAllocSize));
+}
+
+TEST_F(BlockHeapManagerTest, ThreadBlockCachesReuseFreedBlocks) {
+  const size_t kAllocSize = 40;
+  HeapId heap_id = heap_manager_->process_heap();
+
+  // Keep the blocks out of the quarantine, so they are freed as soon as their
+  // batch is pushed.
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_block_size = 1;
+  heap_manager_->set_parameters(parameters);
+  heap_manager_->EnableThreadBlockCaches();
+
+  void* allocs[ThreadBlockCache::kQuarantineBatchSize] = {};
+  for (size_t i = 0; i < arraysize(allocs); ++i) {
+    allocs[i] = heap_manager_->Allocate(heap_id, kAllocSize);
+    ASSERT_NE(static_cast<void*>(nullptr), allocs[i]);
+  }
+  for (size_t i = 0; i < arraysize(allocs); ++i)
+    EXPECT_TRUE(heap_manager_->Free(heap_id, allocs[i]));
+
+  // The freed blocks are cached, and remain poisoned.
+  for (size_t i = 0; i < arraysize(allocs); ++i) {
+    EXPECT_EQ(kAsanReservedMarker,
+              runtime_->shadow()->GetShadowMarkerForAddress(allocs[i]));
+  }
+
+  // The most recently cached block is reused first.
+  void* alloc = heap_manager_->Allocate(heap_id, kAllocSize);
+  EXPECT_EQ(allocs[arraysize(allocs) - 1], alloc);
+  ASSERT_NO_FATAL_FAILURE(VerifyAllocAccess(alloc, kAllocSize));
+  EXPECT_TRUE(heap_manager_->Free(heap_id, alloc));
+
+  // Disabling the caches returns their contents to the heap.
+  heap_manager_->DisableThreadBlockCaches();
+  for (size_t i = 0; i < arraysize(allocs); ++i)
+    EXPECT_TRUE(runtime_->shadow()->IsAccessible(allocs[i]));
+  EXPECT_TRUE(errors_.empty());
+}
+
+TEST_F(BlockHeapManagerTest, ThreadBlockCachesConcurrentAllocAndFree) {
+  heap_manager_->EnableThreadBlockCaches();
+  size_t errors = 0;
+  RunAllocationStressThreads(heap_manager_, heap_manager_->process_heap(),
+                             runtime_->shadow(), 4, 10000, &errors);
+  EXPECT_EQ(0u, errors);
+  heap_manager_->DisableThreadBlockCaches();
+  EXPECT_TRUE(errors_.empty());
+}
+
+// Measures the throughput of allocations and frees on the process heap on a
+// varying number of threads, with and without the thread block caches. This
+// is disabled by default; run with --gtest_also_run_disabled_tests.
+TEST_F(BlockHeapManagerTest, DISABLED_BenchmarkMultithreadedAllocations) {
+  static const size_t kIterations = 200000;
+  static const size_t kThreadCounts[] = {1, 2, 4, 8};
+
+  for (size_t caches = 0; caches < 2; ++caches) {
+    if (caches != 0)
+      heap_manager_->EnableThreadBlockCaches();
+
+    for (size_t i = 0; i < arraysize(kThreadCounts); ++i) {
+      size_t errors = 0;
+      base::TimeDelta elapsed = RunAllocationStressThreads(
+          heap_manager_, heap_manager_->process_heap(), nullptr,
+          kThreadCounts[i], kIterations, &errors);
+      EXPECT_EQ(0u, errors);
+
+      // Each iteration allocates and frees a block.
+      double operations =
+          static_cast<double>(2 * kThreadCounts[i] * kIterations);
+      LOG(INFO) << kThreadCounts[i] << " threads, thread block caches "
+                << (caches != 0 ? "enabled" : "disabled") << ": "
+                << operations / elapsed.InSecondsF()
+                << " operations per second.";
+    }
+
+    if (caches != 0)
+      heap_manager_->DisableThreadBlockCaches();
+  }
+}
+
+// Measures the latency of frees across block sizes, for each block checksum
+// engine and with and without checksum sampling. Frees put the blocks into
+// the quarantine, which checksums them. This is disabled by default; run with
+// --gtest_also_run_disabled_tests.
+TEST_F(BlockHeapManagerTest, DISABLED_BenchmarkFreeLatency) {
+  static const size_t kMinBlockSize = 64;
+  static const size_t kMaxBlockSize = 4 * 1024 * 1024;
+  static const size_t kBytesPerMeasurement = 16 * 1024 * 1024;
+  static const uint32_t kSamplingThresholds[] = {0, 64 * 1024};
+
+  // Keep every freed block in the quarantine, without flood-filling it, so
+  // that its whole body gets checksummed.
+  ::common::AsanParameters parameters = heap_manager_->parameters();
+  parameters.quarantine_size = 2 * kBytesPerMeasurement;
+  parameters.quarantine_block_size = 2 * kMaxBlockSize;
+  parameters.quarantine_flood_fill_rate = 0.0f;
+  heap_manager_->set_parameters(parameters);
+
+  BlockChecksumEngine original_engine = GetBlockChecksumEngine();
+  for (int e = 0; e < kBlockChecksumEngineCount; ++e) {
+    BlockChecksumEngine engine = static_cast<BlockChecksumEngine>(e);
+    if (!IsBlockChecksumEngineSupported(engine))
+      continue;
+
+    for (size_t t = 0; t < arraysize(kSamplingThresholds); ++t) {
+      // The configuration may only change while no block is checksummed.
+      SetBlockChecksumEngine(engine);
+      SetBlockChecksumSamplingThreshold(kSamplingThresholds[t]);
+
+      for (size_t size = kMinBlockSize; size <= kMaxBlockSize; size *= 4) {
+        ScopedHeap heap(heap_manager_);
+        std::vector<void*> allocs(kBytesPerMeasurement / size);
+        for (size_t i = 0; i < allocs.size(); ++i) {
+          allocs[i] = heap.Allocate(size);
+          ASSERT_NE(static_cast<void*>(nullptr), allocs[i]);
+        }
+
+        base::TimeTicks start = base::TimeTicks::Now();
+        for (size_t i = 0; i < allocs.size(); ++i)
+          ASSERT_TRUE(heap.Free(allocs[i]));
+        base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+        LOG(INFO) << GetBlockChecksumEngineName(engine) << " checksums, "
+                  << "sampling threshold " << kSamplingThresholds[t] << ", "
+                  << size << " byte blocks: "
+                  << elapsed.InMicrosecondsF() / allocs.size()
+                  << " microseconds per free.";
+      }
+    }
+  }
+
+  SetBlockChecksumEngine(original_engine);
+  SetBlockChecksumSamplingThreshold(0);
+}
+
 namespace {
 
 bool ShadowIsConsistentPostAlloc(
@@ -0,0 +1,138 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/thread_block_cache.h"
+
+#include <algorithm>
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+const uint32_t ThreadBlockCache::kSizeClassGranularity;
+const uint32_t ThreadBlockCache::kMaxBlockSize;
+const size_t ThreadBlockCache::kSizeClassCount;
+const size_t ThreadBlockCache::kMaxBlocksPerSizeClass;
+const size_t ThreadBlockCache::kMaxBytesPerSizeClass;
+const size_t ThreadBlockCache::kQuarantineBatchSize;
+
+ThreadBlockCache::ThreadBlockCache(HANDLE owner)
+    : owner_(owner), quarantined_count_(0), next_(nullptr) {
+  DCHECK_NE(static_cast<HANDLE>(nullptr), owner);
+  ::memset(allocs_, 0, sizeof(allocs_));
+  ::memset(counts_, 0, sizeof(counts_));
+  ::memset(quarantined_, 0, sizeof(quarantined_));
+}
+
+ThreadBlockCache::~ThreadBlockCache() {
+  for (size_t i = 0; i < kSizeClassCount; ++i)
+    DCHECK_EQ(0u, counts_[i]);
+  DCHECK_EQ(0u, quarantined_count_);
+  ::CloseHandle(owner_);
+}
+
+// static
+bool ThreadBlockCache::GetSizeClass(uint32_t block_size, size_t* size_class) {
+  DCHECK_NE(static_cast<size_t*>(nullptr), size_class);
+  if (block_size == 0 || block_size > kMaxBlockSize)
+    return false;
+  *size_class = (block_size - 1) / kSizeClassGranularity;
+  return true;
+}
+
+// static
+uint32_t ThreadBlockCache::GetSizeClassBlockSize(size_t size_class) {
+  DCHECK_LT(size_class, kSizeClassCount);
+  return static_cast<uint32_t>((size_class + 1) * kSizeClassGranularity);
+}
+
+// static
+size_t ThreadBlockCache::GetMaxBlockCount(size_t size_class) {
+  return std::min(kMaxBlocksPerSizeClass,
+                  kMaxBytesPerSizeClass / GetSizeClassBlockSize(size_class));
+}
+
+// static
+size_t ThreadBlockCache::GetBatchSize(size_t size_class) {
+  return (GetMaxBlockCount(size_class) + 1) / 2;
+}
+
+void* ThreadBlockCache::Pop(size_t size_class) {
+  DCHECK_LT(size_class, kSizeClassCount);
+  lock_.AssertAcquired();
+  if (counts_[size_class] == 0)
+    return nullptr;
+  return allocs_[size_class][--counts_[size_class]];
+}
+
+bool ThreadBlockCache::Push(size_t size_class, void* alloc) {
+  DCHECK_LT(size_class, kSizeClassCount);
+  DCHECK_NE(static_cast<void*>(nullptr), alloc);
+  lock_.AssertAcquired();
+  if (counts_[size_class] == GetMaxBlockCount(size_class))
+    return false;
+  allocs_[size_class][counts_[size_class]++] = alloc;
+  return true;
+}
+
+size_t ThreadBlockCache::Drain(size_t size_class,
+                               size_t max_count,
+                               void** allocs) {
+  DCHECK_LT(size_class, kSizeClassCount);
+  DCHECK_NE(static_cast<void**>(nullptr), allocs);
+  lock_.AssertAcquired();
+
+  // The oldest allocations are at the bottom of the stack.
+  size_t count = std::min(max_count, counts_[size_class]);
+  void** bin = allocs_[size_class];
+  ::memcpy(allocs, bin, count * sizeof(*bin));
+  ::memmove(bin, bin + count, (counts_[size_class] - count) * sizeof(*bin));
+  counts_[size_class] -= count;
+  return count;
+}
+
+size_t ThreadBlockCache::Count(size_t size_class) const {
+  DCHECK_LT(size_class, kSizeClassCount);
+  return counts_[size_class];
+}
+
+bool ThreadBlockCache::PushQuarantined(const CompactBlockInfo& block) {
+  lock_.AssertAcquired();
+  DCHECK_LT(quarantined_count_, kQuarantineBatchSize);
+  quarantined_[quarantined_count_++] = block;
+  return quarantined_count_ == kQuarantineBatchSize;
+}
+
+size_t ThreadBlockCache::TakeQuarantined(CompactBlockInfo* blocks) {
+  DCHECK_NE(static_cast<CompactBlockInfo*>(nullptr), blocks);
+  lock_.AssertAcquired();
+  size_t count = quarantined_count_;
+  ::memcpy(blocks, quarantined_, count * sizeof(*blocks));
+  quarantined_count_ = 0;
+  return count;
+}
+
+bool ThreadBlockCache::AdoptIfOrphaned(HANDLE thread) {
+  DCHECK_NE(static_cast<HANDLE>(nullptr), thread);
+  lock_.AssertAcquired();
+  if (::WaitForSingleObject(owner_, 0) != WAIT_OBJECT_0)
+    return false;
+  ::CloseHandle(owner_);
+  owner_ = thread;
+  return true;
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
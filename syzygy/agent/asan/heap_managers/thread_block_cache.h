@@ -0,0 +1,175 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a per-thread cache of free blocks, used by the block heap manager
+// as a front-end to the heap it manages.
+
+#ifndef SYZYGY_AGENT_ASAN_HEAP_MANAGERS_THREAD_BLOCK_CACHE_H_
+#define SYZYGY_AGENT_ASAN_HEAP_MANAGERS_THREAD_BLOCK_CACHE_H_
+
+#include <windows.h>
+
+#include "base/logging.h"
+#include "base/synchronization/lock.h"
+#include "syzygy/agent/asan/block.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+// A cache owned by a single thread. It holds two things:
+//
+// - Free allocations of the underlying heap, binned by size class. These are
+//   handed out to satisfy new allocations without going to the heap, and are
+//   refilled from and drained to the heap in batches.
+// - Freed blocks that are waiting to be pushed into the quarantine. These are
+//   pushed in batches.
+//
+// The cache only stores pointers and block descriptions, it is up to the user
+// to maintain the shadow memory and the state of the blocks. A cache is only
+// ever used by its owning thread, except when it is being flushed or adopted
+// by another thread. Its lock is thus almost never contended.
+class ThreadBlockCache {
+ public:
+  // The granularity of the size classes, in bytes.
+  static const uint32_t kSizeClassGranularity = 16;
+
+  // The size of the largest block that can be cached.
+  static const uint32_t kMaxBlockSize = 1024;
+
+  // The number of size classes. Class |i| holds allocations of
+  // (i + 1) * kSizeClassGranularity bytes.
+  static const size_t kSizeClassCount = kMaxBlockSize / kSizeClassGranularity;
+
+  // The maximum number of allocations held by a size class, and the maximum
+  // number of bytes. Whichever is reached first bounds the size class.
+  static const size_t kMaxBlocksPerSizeClass = 64;
+  static const size_t kMaxBytesPerSizeClass = 16 * 1024;
+
+  // The number of freed blocks that are pushed into the quarantine at once.
+  static const size_t kQuarantineBatchSize = 16;
+
+  // Constructor.
+  // @param owner A handle to the owning thread. Ownership of the handle is
+  //     passed to this object.
+  explicit ThreadBlockCache(HANDLE owner);
+
+  // Destructor. The cache must be empty.
+  ~ThreadBlockCache();
+
+  // @name Size class utilities.
+  // @{
+  // Gets the size class that fits a block.
+  // @param block_size The size of the block.
+  // @param size_class Receives the smallest size class whose allocations are
+  //     at least |block_size| bytes.
+  // @returns true on success, false if the block is too big to be cached.
+  static bool GetSizeClass(uint32_t block_size, size_t* size_class);
+  // @param size_class A size class.
+  // @returns the size of the allocations in |size_class|.
+  static uint32_t GetSizeClassBlockSize(size_t size_class);
+  // @param size_class A size class.
+  // @returns the maximum number of allocations held in |size_class|.
+  static size_t GetMaxBlockCount(size_t size_class);
+  // @param size_class A size class.
+  // @returns the number of allocations moved at once between the heap and
+  //     |size_class|.
+  static size_t GetBatchSize(size_t size_class);
+  // @}
+
+  // @name Free allocations. These must be called under lock().
+  // @{
+  // Takes an allocation from a size class.
+  // @param size_class The size class.
+  // @returns the most recently cached allocation of |size_class|, or nullptr
+  //     if there's none.
+  void* Pop(size_t size_class);
+  // Adds an allocation to a size class.
+  // @param size_class The size class.
+  // @param alloc The allocation. It must be GetSizeClassBlockSize(size_class)
+  //     bytes.
+  // @returns true on success, false if |size_class| is full.
+  bool Push(size_t size_class, void* alloc);
+  // Removes the least recently cached allocations from a size class.
+  // @param size_class The size class.
+  // @param max_count The maximum number of allocations to remove.
+  // @param allocs Receives the removed allocations. Must have room for
+  //     |max_count| entries.
+  // @returns the number of removed allocations.
+  size_t Drain(size_t size_class, size_t max_count, void** allocs);
+  // @param size_class The size class.
+  // @returns the number of allocations in |size_class|.
+  size_t Count(size_t size_class) const;
+  // @}
+
+  // @name Blocks awaiting the quarantine. These must be called under lock().
+  // @{
+  // Adds a block to the batch of blocks awaiting the quarantine.
+  // @param block The block.
+  // @returns true if the batch is full after adding the block.
+  bool PushQuarantined(const CompactBlockInfo& block);
+  // Removes all the blocks awaiting the quarantine.
+  // @param blocks Receives the blocks. Must have room for kQuarantineBatchSize
+  //     entries.
+  // @returns the number of blocks.
+  size_t TakeQuarantined(CompactBlockInfo* blocks);
+  // @returns the number of blocks awaiting the quarantine.
+  size_t quarantined_count() const { return quarantined_count_; }
+  // @}
+
+  // Transfers ownership of this cache to a new thread if its owner has exited.
+  // Must be called under lock().
+  // @param thread A handle to the new owner. Ownership of the handle is passed
+  //     to this object on success.
+  // @returns true if the cache has been adopted, false if its owner is still
+  //     running.
+  bool AdoptIfOrphaned(HANDLE thread);
+
+  // @returns the lock protecting this cache.
+  base::Lock& lock() { return lock_; }
+
+  // @name Accessors for the intrusive list of caches maintained by the heap
+  //     manager.
+  // @{
+  ThreadBlockCache* next() const { return next_; }
+  void set_next(ThreadBlockCache* next) { next_ = next; }
+  // @}
+
+ private:
+  // Protects the contents of this cache.
+  base::Lock lock_;
+
+  // A handle to the thread owning this cache. Under lock_.
+  HANDLE owner_;
+
+  // The cached allocations, stored as a stack per size class. Under lock_.
+  void* allocs_[kSizeClassCount][kMaxBlocksPerSizeClass];
+  size_t counts_[kSizeClassCount];
+
+  // The blocks waiting to be pushed into the quarantine. Under lock_.
+  CompactBlockInfo quarantined_[kQuarantineBatchSize];
+  size_t quarantined_count_;
+
+  // The next cache in the heap manager's list. This is set before the cache
+  // is published and never changes afterwards.
+  ThreadBlockCache* next_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadBlockCache);
+};
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_HEAP_MANAGERS_THREAD_BLOCK_CACHE_H_
@@ -0,0 +1,172 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/heap_managers/thread_block_cache.h"
+
+#include "base/threading/simple_thread.h"
+#include "gtest/gtest.h"
+
+namespace agent {
+namespace asan {
+namespace heap_managers {
+
+namespace {
+
+// Returns a duplicated handle to the current thread.
+HANDLE GetCurrentThreadHandle() {
+  HANDLE thread = nullptr;
+  EXPECT_TRUE(::DuplicateHandle(::GetCurrentProcess(), ::GetCurrentThread(),
+                                ::GetCurrentProcess(), &thread, SYNCHRONIZE,
+                                FALSE, 0));
+  return thread;
+}
+
+// Grabs a handle to the thread it runs on, then exits.
+class GrabThreadHandleRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  GrabThreadHandleRunner() : thread_(nullptr) {}
+
+  void Run() override { thread_ = GetCurrentThreadHandle(); }
+
+  HANDLE thread() const { return thread_; }
+
+ private:
+  HANDLE thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(GrabThreadHandleRunner);
+};
+
+// Returns a fake, suitably aligned allocation pointer.
+void* FakeAlloc(size_t i) {
+  return reinterpret_cast<void*>((i + 1) * ThreadBlockCache::kMaxBlockSize);
+}
+
+}  // namespace
+
+TEST(ThreadBlockCacheTest, SizeClasses) {
+  size_t size_class = 0;
+  EXPECT_FALSE(ThreadBlockCache::GetSizeClass(0, &size_class));
+  EXPECT_FALSE(ThreadBlockCache::GetSizeClass(
+      ThreadBlockCache::kMaxBlockSize + 1, &size_class));
+
+  EXPECT_TRUE(ThreadBlockCache::GetSizeClass(1, &size_class));
+  EXPECT_EQ(0u, size_class);
+  EXPECT_TRUE(ThreadBlockCache::GetSizeClass(
+      ThreadBlockCache::kSizeClassGranularity, &size_class));
+  EXPECT_EQ(0u, size_class);
+  EXPECT_TRUE(ThreadBlockCache::GetSizeClass(
+      ThreadBlockCache::kSizeClassGranularity + 8, &size_class));
+  EXPECT_EQ(1u, size_class);
+  EXPECT_TRUE(ThreadBlockCache::GetSizeClass(ThreadBlockCache::kMaxBlockSize,
+                                             &size_class));
+  EXPECT_EQ(ThreadBlockCache::kSizeClassCount - 1, size_class);
+
+  for (size_t i = 0; i < ThreadBlockCache::kSizeClassCount; ++i) {
+    uint32_t block_size = ThreadBlockCache::GetSizeClassBlockSize(i);
+    EXPECT_TRUE(ThreadBlockCache::GetSizeClass(block_size, &size_class));
+    EXPECT_EQ(i, size_class);
+
+    size_t max_count = ThreadBlockCache::GetMaxBlockCount(i);
+    EXPECT_LT(0u, max_count);
+    EXPECT_GE(ThreadBlockCache::kMaxBlocksPerSizeClass, max_count);
+    EXPECT_GE(ThreadBlockCache::kMaxBytesPerSizeClass, max_count * block_size);
+    EXPECT_LT(0u, ThreadBlockCache::GetBatchSize(i));
+    EXPECT_GE(max_count, ThreadBlockCache::GetBatchSize(i));
+  }
+}
+
+TEST(ThreadBlockCacheTest, PushPopAndDrain) {
+  ThreadBlockCache cache(GetCurrentThreadHandle());
+  base::AutoLock lock(cache.lock());
+
+  const size_t kSizeClass = 3;
+  size_t max_count = ThreadBlockCache::GetMaxBlockCount(kSizeClass);
+  EXPECT_EQ(static_cast<void*>(nullptr), cache.Pop(kSizeClass));
+
+  for (size_t i = 0; i < max_count; ++i)
+    EXPECT_TRUE(cache.Push(kSizeClass, FakeAlloc(i)));
+  EXPECT_FALSE(cache.Push(kSizeClass, FakeAlloc(max_count)));
+  EXPECT_EQ(max_count, cache.Count(kSizeClass));
+  EXPECT_EQ(0u, cache.Count(kSizeClass + 1));
+
+  // The most recently cached allocation is handed out first.
+  EXPECT_EQ(FakeAlloc(max_count - 1), cache.Pop(kSizeClass));
+
+  // The least recently cached allocations are drained first.
+  void* allocs[ThreadBlockCache::kMaxBlocksPerSizeClass] = {};
+  EXPECT_EQ(2u, cache.Drain(kSizeClass, 2, allocs));
+  EXPECT_EQ(FakeAlloc(0), allocs[0]);
+  EXPECT_EQ(FakeAlloc(1), allocs[1]);
+  EXPECT_EQ(max_count - 3, cache.Count(kSizeClass));
+  EXPECT_EQ(FakeAlloc(max_count - 2), cache.Pop(kSizeClass));
+
+  size_t remaining = cache.Count(kSizeClass);
+  EXPECT_EQ(remaining,
+            cache.Drain(kSizeClass, arraysize(allocs), allocs));
+  EXPECT_EQ(FakeAlloc(2), allocs[0]);
+  EXPECT_EQ(0u, cache.Count(kSizeClass));
+  EXPECT_EQ(static_cast<void*>(nullptr), cache.Pop(kSizeClass));
+}
+
+TEST(ThreadBlockCacheTest, QuarantineBatch) {
+  ThreadBlockCache cache(GetCurrentThreadHandle());
+  base::AutoLock lock(cache.lock());
+
+  CompactBlockInfo block = {};
+  for (size_t i = 0; i < ThreadBlockCache::kQuarantineBatchSize - 1; ++i) {
+    block.header = reinterpret_cast<BlockHeader*>(FakeAlloc(i));
+    EXPECT_FALSE(cache.PushQuarantined(block));
+  }
+  block.header = reinterpret_cast<BlockHeader*>(
+      FakeAlloc(ThreadBlockCache::kQuarantineBatchSize - 1));
+  EXPECT_TRUE(cache.PushQuarantined(block));
+  EXPECT_EQ(ThreadBlockCache::kQuarantineBatchSize, cache.quarantined_count());
+
+  CompactBlockInfo blocks[ThreadBlockCache::kQuarantineBatchSize] = {};
+  EXPECT_EQ(ThreadBlockCache::kQuarantineBatchSize,
+            cache.TakeQuarantined(blocks));
+  for (size_t i = 0; i < ThreadBlockCache::kQuarantineBatchSize; ++i)
+    EXPECT_EQ(FakeAlloc(i), static_cast<void*>(blocks[i].header));
+  EXPECT_EQ(0u, cache.quarantined_count());
+  EXPECT_EQ(0u, cache.TakeQuarantined(blocks));
+}
+
+TEST(ThreadBlockCacheTest, AdoptIfOrphaned) {
+  // A cache owned by a running thread can't be adopted.
+  ThreadBlockCache cache(GetCurrentThreadHandle());
+  HANDLE new_owner = GetCurrentThreadHandle();
+  {
+    base::AutoLock lock(cache.lock());
+    EXPECT_FALSE(cache.AdoptIfOrphaned(new_owner));
+  }
+  ::CloseHandle(new_owner);
+
+  // A cache owned by an exited thread can.
+  GrabThreadHandleRunner runner;
+  base::DelegateSimpleThread thread(&runner, "GrabThreadHandleRunner");
+  thread.Start();
+  thread.Join();
+  ASSERT_NE(static_cast<HANDLE>(nullptr), runner.thread());
+
+  ThreadBlockCache orphan(runner.thread());
+  base::AutoLock lock(orphan.lock());
+  EXPECT_TRUE(orphan.AdoptIfOrphaned(GetCurrentThreadHandle()));
+  new_owner = GetCurrentThreadHandle();
+  EXPECT_FALSE(orphan.AdoptIfOrphaned(new_owner));
+  ::CloseHandle(new_owner);
+}
+
+}  // namespace heap_managers
+}  // namespace asan
+}  // namespace agent
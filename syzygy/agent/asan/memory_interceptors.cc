@@ -96,6 +96,37 @@ void CheckMemoryAccess(void* location,
   }
 }
 
+namespace {
+
+// Checks in bulk if all the memory accesses done by a string instruction on
+// one of its operands are valid.
+// @param base The address of the first access.
+// @param access_mode The mode of the accesses.
+// @param length The number of memory accesses.
+// @param access_size The size of each the access in byte.
+// @param increment The increment to move the address after each access.
+// @returns true if every access is valid, false if at least one may not be.
+bool IsStringAccessRangeAccessible(const uint8_t* base,
+                                   AccessMode access_mode,
+                                   uint32_t length,
+                                   size_t access_size,
+                                   int32_t increment) {
+  if (memory_interceptor_shadow_ == nullptr ||
+      access_mode == agent::asan::ASAN_UNKNOWN_ACCESS || length == 0) {
+    return true;
+  }
+
+  // The accesses span a contiguous range, which starts at the first access
+  // when moving forward and at the last one when moving backward.
+  size_t stride = static_cast<size_t>(increment < 0 ? -increment : increment);
+  size_t size = (length - 1) * stride + access_size;
+  if (increment < 0)
+    base -= (length - 1) * stride;
+  return memory_interceptor_shadow_->IsRangeAccessible(base, size);
+}
+
+}  // namespace
+
 // The slow path relies on the fact that the shadow memory non accessible byte
 // mask has its upper bit set to 1.
 static_assert((kHeapNonAccessibleMarkerMask & (1 << 7)) != 0,
@@ -122,6 +153,16 @@ void asan_check_strings_memory_accesses(uint8_t* dst,
                                         int32_t increment,
                                         bool compare,
                                         const AsanContext& context) {
+  // If the whole ranges spanned by the instruction are accessible then so is
+  // each individual access. Otherwise walk the accesses one at a time to find
+  // the first bad one, which is the one that gets reported.
+  if (IsStringAccessRangeAccessible(src, src_access_mode, length, access_size,
+                                    increment) &&
+      IsStringAccessRangeAccessible(dst, dst_access_mode, length, access_size,
+                                    increment)) {
+    return;
+  }
+
   int32_t offset = 0;
 
   for (uint32_t i = 0; i < length; ++i) {
@@ -172,12 +172,10 @@ void TestMemoryRange(Shadow* shadow,
   if (!shadow || size == 0U)
     return;
 
-  // TODO(sebmarchand): This approach is pretty limited because it only checks
-  //     if the first and the last elements are accessible. Once we have the
-  //     plumbing in place we should benchmark a check that looks at each
-  //     address to be touched (via the shadow memory, 8 bytes at a time).
-  if (!shadow->IsAccessible(memory) ||
-      !shadow->IsAccessible(memory + size - 1)) {
+  // Check every address to be touched. The shadow is scanned in bulk by
+  // vectorized kernels, so this is barely more expensive than checking the
+  // first and the last elements.
+  if (!shadow->IsRangeAccessible(memory, size)) {
     const void* location = shadow->FindFirstPoisonedByte(memory, size);
     // If this check hits, either you've lucked on a time-of-check race, and
     // there's a genuine bug in the call stack above, or else there's a bug
@@ -33,6 +33,7 @@
 #include "base/win/pe_image.h"
 #include "base/win/wrapped_window_proc.h"
 #include "syzygy/agent/asan/block.h"
+#include "syzygy/agent/asan/block_checksum.h"
 #include "syzygy/agent/asan/crt_interceptors.h"
 #include "syzygy/agent/asan/heap_checker.h"
 #include "syzygy/agent/asan/logger.h"
@@ -852,13 +853,13 @@ void AsanRuntime::PropagateParams() {
   // This function has to be kept in sync with the AsanParameters struct. These
   // checks will ensure that this is the case.
 #ifdef _WIN64
-  static_assert(sizeof(::common::AsanParameters) == 64,
+  static_assert(sizeof(::common::AsanParameters) == 68,
                 "Must propagate parameters.");
 #else
-  static_assert(sizeof(::common::AsanParameters) == 60,
+  static_assert(sizeof(::common::AsanParameters) == 64,
                 "Must propagate parameters.");
 #endif
-  static_assert(::common::kAsanParametersVersion == 14,
+  static_assert(::common::kAsanParametersVersion == 15,
                 "Must update parameters version.");
 
   // Push the configured parameter values to the appropriate endpoints.
@@ -871,6 +872,7 @@ void AsanRuntime::PropagateParams() {
   logger_->set_log_as_text(params_.log_as_text);
   // exit_on_failure is used locally by AsanRuntime.
   logger_->set_minidump_on_failure(params_.minidump_on_failure);
+  SetBlockChecksumSamplingThreshold(params_.checksum_sampling_threshold);
 }
 
 size_t AsanRuntime::CalculateCorruptHeapInfoSize(
@@ -1251,6 +1253,16 @@ void AsanRuntime::DisableDeferredFreeThread() {
   heap_manager_->DisableDeferredFreeThread();
 }
 
+void AsanRuntime::EnableThreadBlockCaches() {
+  DCHECK(heap_manager_);
+  heap_manager_->EnableThreadBlockCaches();
+}
+
+void AsanRuntime::DisableThreadBlockCaches() {
+  DCHECK(heap_manager_);
+  heap_manager_->DisableThreadBlockCaches();
+}
+
 AsanFeatureSet AsanRuntime::GetEnabledFeatureSet() {
   AsanFeatureSet enabled_features = static_cast<AsanFeatureSet>(0U);
   if (heap_manager_->enable_page_protections_)
@@ -191,6 +191,12 @@ class AsanRuntime {
   // Disables the deferred free thread.
   void DisableDeferredFreeThread();
 
+  // Enables the per-thread block caches of the heap manager.
+  void EnableThreadBlockCaches();
+
+  // Disables the per-thread block caches of the heap manager.
+  void DisableThreadBlockCaches();
+
   // @returns the list of enabled features.
   AsanFeatureSet GetEnabledFeatureSet();
 
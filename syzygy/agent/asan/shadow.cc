@@ -19,6 +19,7 @@
 
 #include "base/strings/stringprintf.h"
 #include "base/win/pe_image.h"
+#include "syzygy/agent/asan/shadow_scan.h"
 #include "syzygy/common/align.h"
 
 namespace agent {
@@ -257,66 +258,6 @@ void Shadow::Unpoison(const void* addr, size_t size) {
     shadow_[index + size] = remainder;
 }
 
-namespace {
-
-static const uint8_t kFreedMarker8 = kHeapFreedMarker;
-static const uint16_t kFreedMarker16 =
-    (static_cast<const uint16_t>(kFreedMarker8) << 8) | kFreedMarker8;
-static const uint32_t kFreedMarker32 =
-    (static_cast<const uint32_t>(kFreedMarker16) << 16) | kFreedMarker16;
-static const uint64_t kFreedMarker64 =
-    (static_cast<const uint64_t>(kFreedMarker32) << 32) | kFreedMarker32;
-
-// Marks the given range of shadow bytes as freed, preserving left and right
-// redzone bytes.
-inline void MarkAsFreedImpl8(uint8_t* cursor, uint8_t* cursor_end) {
-  for (; cursor != cursor_end; ++cursor) {
-    // Preserve block beginnings/ends/redzones as they were originally.
-    // This is necessary to preserve information about nested blocks.
-    if (ShadowMarkerHelper::IsActiveLeftRedzone(*cursor) ||
-        ShadowMarkerHelper::IsActiveRightRedzone(*cursor)) {
-      continue;
-    }
-
-    // Anything else gets marked as freed.
-    *cursor = kHeapFreedMarker;
-  }
-}
-
-// Marks the given range of shadow bytes as freed, preserving left and right
-// redzone bytes. |cursor| and |cursor_end| must be 8-byte aligned.
-inline void MarkAsFreedImplAligned64(uint64_t* cursor, uint64_t* cursor_end) {
-  DCHECK(::common::IsAligned(cursor, sizeof(uint64_t)));
-  DCHECK(::common::IsAligned(cursor_end, sizeof(uint64_t)));
-
-  for (; cursor != cursor_end; ++cursor) {
-    // If the block of shadow memory is entirely green then mark as freed.
-    // Otherwise go check its contents byte by byte.
-    if (*cursor == 0) {
-      *cursor = kFreedMarker64;
-    } else {
-      MarkAsFreedImpl8(reinterpret_cast<uint8_t*>(cursor),
-                       reinterpret_cast<uint8_t*>(cursor + 1));
-    }
-  }
-}
-
-inline void MarkAsFreedImpl64(uint8_t* cursor, uint8_t* cursor_end) {
-  if (cursor_end - cursor >= 2 * sizeof(uint64_t)) {
-    uint8_t* cursor_aligned = ::common::AlignUp(cursor, sizeof(uint64_t));
-    uint8_t* cursor_end_aligned =
-        ::common::AlignDown(cursor_end, sizeof(uint64_t));
-    MarkAsFreedImpl8(cursor, cursor_aligned);
-    MarkAsFreedImplAligned64(reinterpret_cast<uint64_t*>(cursor_aligned),
-                             reinterpret_cast<uint64_t*>(cursor_end_aligned));
-    MarkAsFreedImpl8(cursor_end_aligned, cursor_end);
-  } else {
-    MarkAsFreedImpl8(cursor, cursor_end);
-  }
-}
-
-}  // namespace
-
 void Shadow::MarkAsFreed(const void* addr, size_t size) {
   DCHECK_LE(kAddressLowerBound, reinterpret_cast<uintptr_t>(addr));
   DCHECK(::common::IsAligned(addr, kShadowRatio));
@@ -333,7 +274,7 @@ void Shadow::MarkAsFreed(const void* addr, size_t size) {
 
   // This isn't as simple as a memset because we need to preserve left and
   // right redzone padding bytes that may be found in the range.
-  MarkAsFreedImpl64(cursor, cursor_end);
+  internal::MarkAsFreed(cursor, cursor_end);
 }
 
 bool Shadow::IsAccessible(const void* addr) const {
@@ -392,8 +333,10 @@ bool Shadow::IsRangeAccessible(const void* addr, size_t size) const {
 
   // Now run over the shadow bytes from start to end, which all need to be
   // zero.
-  if (!internal::IsZeroBufferImpl<uint64_t>(&shadow_[start], &shadow_[end]))
-      return false;
+  if (internal::FindFirstNonZeroByte(&shadow_[start], &shadow_[end]) !=
+      &shadow_[end]) {
+    return false;
+  }
 
   // Finally test the end point if there's a tail offset.
   if (end_offs == 0U)
@@ -448,12 +391,16 @@ const void* Shadow::FindFirstPoisonedByte(const void* addr, size_t size) const {
   if (end > length_)
     return out_addr;
 
-  for (size_t curr = start; curr < end; ++curr, out_addr += kShadowRatio) {
-    shadow = shadow_[curr];
+  // Skip over the accessible shadow bytes in bulk, then look at the first
+  // poisoned one.
+  const uint8_t* curr =
+      internal::FindFirstNonZeroByte(&shadow_[start], &shadow_[end]);
+  out_addr += (curr - &shadow_[start]) * kShadowRatio;
+  if (curr != &shadow_[end]) {
+    shadow = *curr;
     if (ShadowMarkerHelper::IsRedzone(shadow))
       return out_addr;
-    if (shadow != 0)
-      return out_addr + shadow;
+    return out_addr + shadow;
   }
 
   // Finally test the end point if there's a tail offset.
@@ -814,6 +761,14 @@ bool Shadow::ScanLeftForBracketingBlockStart(
 
 namespace {
 
+static const uint8_t kFreedMarker8 = kHeapFreedMarker;
+static const uint16_t kFreedMarker16 =
+    (static_cast<const uint16_t>(kFreedMarker8) << 8) | kFreedMarker8;
+static const uint32_t kFreedMarker32 =
+    (static_cast<const uint32_t>(kFreedMarker16) << 16) | kFreedMarker16;
+static const uint64_t kFreedMarker64 =
+    (static_cast<const uint64_t>(kFreedMarker32) << 32) | kFreedMarker32;
+
 // This handles an unaligned input cursor. It can potentially read up to 7
 // bytes past the end of the cursor, but only up to an 8 byte boundary. Thus
 // this out of bounds access is safe.
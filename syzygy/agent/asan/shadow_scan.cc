@@ -0,0 +1,408 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/shadow_scan.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <intrin.h>
+
+#include "base/cpu.h"
+#include "base/logging.h"
+#include "base/macros.h"
+#include "syzygy/agent/asan/shadow_marker.h"
+#include "syzygy/common/align.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+static const uint8_t kFreedMarker8 = kHeapFreedMarker;
+static const uint16_t kFreedMarker16 =
+    (static_cast<const uint16_t>(kFreedMarker8) << 8) | kFreedMarker8;
+static const uint32_t kFreedMarker32 =
+    (static_cast<const uint32_t>(kFreedMarker16) << 16) | kFreedMarker16;
+static const uint64_t kFreedMarker64 =
+    (static_cast<const uint64_t>(kFreedMarker32) << 32) | kFreedMarker32;
+
+// Returns the index of the lowest bit set in |mask|, which must be non-zero.
+inline size_t LowestBitIndex(uint32_t mask) {
+  DCHECK_NE(0u, mask);
+  unsigned long index = 0;
+  ::_BitScanForward(&index, mask);
+  return index;
+}
+
+// Returns the offset of |cursor| within its |alignment| sized vector.
+inline size_t VectorOffset(const uint8_t* cursor, size_t alignment) {
+  return reinterpret_cast<uintptr_t>(cursor) & (alignment - 1);
+}
+
+// Scalar kernels.
+
+const uint8_t* FindFirstNonZeroByteScalar(const uint8_t* start,
+                                          const uint8_t* end) {
+  const uint8_t* cursor = start;
+
+  // Test the unaligned head a byte at a time.
+  for (; cursor != end && !::common::IsAligned(cursor, sizeof(uint64_t));
+       ++cursor) {
+    if (*cursor != 0)
+      return cursor;
+  }
+
+  // Skip over the zero words.
+  for (; static_cast<size_t>(end - cursor) >= sizeof(uint64_t);
+       cursor += sizeof(uint64_t)) {
+    if (*reinterpret_cast<const uint64_t*>(cursor) != 0)
+      break;
+  }
+
+  // Locate the non-zero byte within the word, or test the tail.
+  for (; cursor != end; ++cursor) {
+    if (*cursor != 0)
+      return cursor;
+  }
+  return end;
+}
+
+// Marks the given range of shadow bytes as freed, preserving left and right
+// redzone bytes.
+inline void MarkAsFreedImpl8(uint8_t* cursor, uint8_t* cursor_end) {
+  for (; cursor != cursor_end; ++cursor) {
+    // Preserve block beginnings/ends/redzones as they were originally.
+    // This is necessary to preserve information about nested blocks.
+    if (ShadowMarkerHelper::IsActiveLeftRedzone(*cursor) ||
+        ShadowMarkerHelper::IsActiveRightRedzone(*cursor)) {
+      continue;
+    }
+
+    // Anything else gets marked as freed.
+    *cursor = kHeapFreedMarker;
+  }
+}
+
+// Marks the given range of shadow bytes as freed, preserving left and right
+// redzone bytes. |cursor| and |cursor_end| must be 8-byte aligned.
+inline void MarkAsFreedImplAligned64(uint64_t* cursor, uint64_t* cursor_end) {
+  DCHECK(::common::IsAligned(cursor, sizeof(uint64_t)));
+  DCHECK(::common::IsAligned(cursor_end, sizeof(uint64_t)));
+
+  for (; cursor != cursor_end; ++cursor) {
+    // If the block of shadow memory is entirely green then mark as freed.
+    // Otherwise go check its contents byte by byte.
+    if (*cursor == 0) {
+      *cursor = kFreedMarker64;
+    } else {
+      MarkAsFreedImpl8(reinterpret_cast<uint8_t*>(cursor),
+                       reinterpret_cast<uint8_t*>(cursor + 1));
+    }
+  }
+}
+
+void MarkAsFreedScalar(uint8_t* cursor, uint8_t* cursor_end) {
+  if (static_cast<size_t>(cursor_end - cursor) >= 2 * sizeof(uint64_t)) {
+    uint8_t* cursor_aligned = ::common::AlignUp(cursor, sizeof(uint64_t));
+    uint8_t* cursor_end_aligned =
+        ::common::AlignDown(cursor_end, sizeof(uint64_t));
+    MarkAsFreedImpl8(cursor, cursor_aligned);
+    MarkAsFreedImplAligned64(reinterpret_cast<uint64_t*>(cursor_aligned),
+                             reinterpret_cast<uint64_t*>(cursor_end_aligned));
+    MarkAsFreedImpl8(cursor_end_aligned, cursor_end);
+  } else {
+    MarkAsFreedImpl8(cursor, cursor_end);
+  }
+}
+
+// SSE2 kernels.
+
+// Returns a mask with a bit set for each non-zero byte of the aligned vector
+// at |cursor|.
+inline uint32_t NonZeroMaskSse2(const uint8_t* cursor) {
+  __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(cursor));
+  uint32_t zero_mask =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+  return ~zero_mask & 0xFFFF;
+}
+
+// Returns true if the 4 aligned vectors starting at |cursor| are all zero.
+inline bool IsZero64Sse2(const uint8_t* cursor) {
+  const __m128i* v = reinterpret_cast<const __m128i*>(cursor);
+  __m128i acc = _mm_or_si128(_mm_or_si128(_mm_load_si128(v),
+                                          _mm_load_si128(v + 1)),
+                             _mm_or_si128(_mm_load_si128(v + 2),
+                                          _mm_load_si128(v + 3)));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) == 0xFFFF;
+}
+
+const uint8_t* FindFirstNonZeroByteSse2(const uint8_t* start,
+                                        const uint8_t* end) {
+  static const size_t kVectorSize = sizeof(__m128i);
+  if (start == end)
+    return end;
+
+  // Start with the aligned vector containing |start|, ignoring the bytes that
+  // precede it.
+  const uint8_t* cursor = ::common::AlignDown(start, kVectorSize);
+  uint32_t mask = NonZeroMaskSse2(cursor) &
+      (0xFFFFu << VectorOffset(start, kVectorSize));
+  while (mask == 0) {
+    cursor += kVectorSize;
+    if (cursor >= end)
+      return end;
+    // Skip over long runs of zeros 4 vectors at a time.
+    while (static_cast<size_t>(end - cursor) >= 4 * kVectorSize &&
+           IsZero64Sse2(cursor)) {
+      cursor += 4 * kVectorSize;
+    }
+    if (cursor >= end)
+      return end;
+    mask = NonZeroMaskSse2(cursor);
+  }
+
+  // The non-zero byte may lie past the end of the range.
+  const uint8_t* found = cursor + LowestBitIndex(mask);
+  return found < end ? found : end;
+}
+
+// Returns a copy of the shadow bytes in |v| where every byte that isn't an
+// active left or right redzone marker is replaced by the freed marker. This
+// is the vectorized equivalent of MarkAsFreedImpl8.
+inline __m128i MarkAsFreedVectorSse2(__m128i v) {
+  // Active left redzones are kHeapLeftPaddingMarker and the active block start
+  // markers (0xE0-0xEF). Active right redzones are kHeapRightPaddingMarker and
+  // the active block end markers. The padding markers only differ by their
+  // lowest bit, as do the block end markers.
+  const __m128i kLowBitMask = _mm_set1_epi8(static_cast<char>(0xFE));
+  const __m128i kFirstNibbleMask = _mm_set1_epi8(static_cast<char>(0xF0));
+  __m128i low_bit_cleared = _mm_and_si128(v, kLowBitMask);
+  __m128i preserve = _mm_or_si128(
+      _mm_or_si128(
+          _mm_cmpeq_epi8(low_bit_cleared,
+                         _mm_set1_epi8(static_cast<char>(
+                             kHeapLeftPaddingMarker))),
+          _mm_cmpeq_epi8(low_bit_cleared,
+                         _mm_set1_epi8(static_cast<char>(
+                             kHeapBlockEndMarker)))),
+      _mm_cmpeq_epi8(_mm_and_si128(v, kFirstNibbleMask),
+                     _mm_set1_epi8(static_cast<char>(
+                         kHeapBlockStartMarker0))));
+  return _mm_or_si128(
+      _mm_and_si128(preserve, v),
+      _mm_andnot_si128(preserve,
+                       _mm_set1_epi8(static_cast<char>(kFreedMarker8))));
+}
+
+void MarkAsFreedSse2(uint8_t* cursor, uint8_t* cursor_end) {
+  static const size_t kVectorSize = sizeof(__m128i);
+  uint8_t* cursor_aligned = ::common::AlignUp(cursor, kVectorSize);
+  uint8_t* cursor_end_aligned = ::common::AlignDown(cursor_end, kVectorSize);
+  if (cursor_aligned >= cursor_end_aligned) {
+    MarkAsFreedScalar(cursor, cursor_end);
+    return;
+  }
+
+  MarkAsFreedScalar(cursor, cursor_aligned);
+  const __m128i kFreed = _mm_set1_epi8(static_cast<char>(kFreedMarker8));
+  for (__m128i* v = reinterpret_cast<__m128i*>(cursor_aligned);
+       v != reinterpret_cast<__m128i*>(cursor_end_aligned); ++v) {
+    __m128i shadow = _mm_load_si128(v);
+    // Entirely green vectors are the common case.
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(shadow, _mm_setzero_si128())) ==
+        0xFFFF) {
+      _mm_store_si128(v, kFreed);
+    } else {
+      _mm_store_si128(v, MarkAsFreedVectorSse2(shadow));
+    }
+  }
+  MarkAsFreedScalar(cursor_end_aligned, cursor_end);
+}
+
+// AVX2 kernels. The compiler emits a vzeroupper on exit of the functions
+// using 256-bit registers, avoiding the SSE transition penalty in callers.
+
+// Returns a mask with a bit set for each non-zero byte of the aligned vector
+// at |cursor|.
+inline uint32_t NonZeroMaskAvx2(const uint8_t* cursor) {
+  __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(cursor));
+  return ~static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+}
+
+// Returns true if the 4 aligned vectors starting at |cursor| are all zero.
+inline bool IsZero128Avx2(const uint8_t* cursor) {
+  const __m256i* v = reinterpret_cast<const __m256i*>(cursor);
+  __m256i acc = _mm256_or_si256(_mm256_or_si256(_mm256_load_si256(v),
+                                                _mm256_load_si256(v + 1)),
+                                _mm256_or_si256(_mm256_load_si256(v + 2),
+                                                _mm256_load_si256(v + 3)));
+  return _mm256_testz_si256(acc, acc) != 0;
+}
+
+const uint8_t* FindFirstNonZeroByteAvx2(const uint8_t* start,
+                                        const uint8_t* end) {
+  static const size_t kVectorSize = sizeof(__m256i);
+  if (start == end)
+    return end;
+
+  // Start with the aligned vector containing |start|, ignoring the bytes that
+  // precede it.
+  const uint8_t* cursor = ::common::AlignDown(start, kVectorSize);
+  uint32_t mask = NonZeroMaskAvx2(cursor) &
+      (0xFFFFFFFFu << VectorOffset(start, kVectorSize));
+  while (mask == 0) {
+    cursor += kVectorSize;
+    if (cursor >= end)
+      return end;
+    // Skip over long runs of zeros 4 vectors at a time.
+    while (static_cast<size_t>(end - cursor) >= 4 * kVectorSize &&
+           IsZero128Avx2(cursor)) {
+      cursor += 4 * kVectorSize;
+    }
+    if (cursor >= end)
+      return end;
+    mask = NonZeroMaskAvx2(cursor);
+  }
+
+  // The non-zero byte may lie past the end of the range.
+  const uint8_t* found = cursor + LowestBitIndex(mask);
+  return found < end ? found : end;
+}
+
+// The AVX2 equivalent of MarkAsFreedVectorSse2.
+inline __m256i MarkAsFreedVectorAvx2(__m256i v) {
+  const __m256i kLowBitMask = _mm256_set1_epi8(static_cast<char>(0xFE));
+  const __m256i kFirstNibbleMask = _mm256_set1_epi8(static_cast<char>(0xF0));
+  __m256i low_bit_cleared = _mm256_and_si256(v, kLowBitMask);
+  __m256i preserve = _mm256_or_si256(
+      _mm256_or_si256(
+          _mm256_cmpeq_epi8(low_bit_cleared,
+                            _mm256_set1_epi8(static_cast<char>(
+                                kHeapLeftPaddingMarker))),
+          _mm256_cmpeq_epi8(low_bit_cleared,
+                            _mm256_set1_epi8(static_cast<char>(
+                                kHeapBlockEndMarker)))),
+      _mm256_cmpeq_epi8(_mm256_and_si256(v, kFirstNibbleMask),
+                        _mm256_set1_epi8(static_cast<char>(
+                            kHeapBlockStartMarker0))));
+  return _mm256_blendv_epi8(
+      _mm256_set1_epi8(static_cast<char>(kFreedMarker8)), v, preserve);
+}
+
+void MarkAsFreedAvx2(uint8_t* cursor, uint8_t* cursor_end) {
+  static const size_t kVectorSize = sizeof(__m256i);
+  uint8_t* cursor_aligned = ::common::AlignUp(cursor, kVectorSize);
+  uint8_t* cursor_end_aligned = ::common::AlignDown(cursor_end, kVectorSize);
+  if (cursor_aligned >= cursor_end_aligned) {
+    MarkAsFreedSse2(cursor, cursor_end);
+    return;
+  }
+
+  MarkAsFreedSse2(cursor, cursor_aligned);
+  const __m256i kFreed = _mm256_set1_epi8(static_cast<char>(kFreedMarker8));
+  for (__m256i* v = reinterpret_cast<__m256i*>(cursor_aligned);
+       v != reinterpret_cast<__m256i*>(cursor_end_aligned); ++v) {
+    __m256i shadow = _mm256_load_si256(v);
+    // Entirely green vectors are the common case.
+    if (_mm256_testz_si256(shadow, shadow)) {
+      _mm256_store_si256(v, kFreed);
+    } else {
+      _mm256_store_si256(v, MarkAsFreedVectorAvx2(shadow));
+    }
+  }
+  MarkAsFreedSse2(cursor_end_aligned, cursor_end);
+}
+
+const ShadowScanFunctions kShadowScanFunctions[] = {
+  { &FindFirstNonZeroByteScalar, &MarkAsFreedScalar },
+  { &FindFirstNonZeroByteSse2, &MarkAsFreedSse2 },
+  { &FindFirstNonZeroByteAvx2, &MarkAsFreedAvx2 },
+};
+static_assert(arraysize(kShadowScanFunctions) == kShadowScanKernelCount,
+              "Missing shadow scan functions.");
+
+const char* const kShadowScanKernelNames[] = { "Scalar", "SSE2", "AVX2" };
+static_assert(arraysize(kShadowScanKernelNames) == kShadowScanKernelCount,
+              "Missing shadow scan kernel names.");
+
+// The functions used by the dispatchers. This is lazily initialized on first
+// use rather than at static initialization time, as the shadow may be used
+// before this module's initializers have run. Concurrent initializations all
+// store the same value, so this doesn't need to be synchronized.
+const ShadowScanFunctions* selected_functions = nullptr;
+
+inline const ShadowScanFunctions* GetSelectedFunctions() {
+  const ShadowScanFunctions* functions = selected_functions;
+  if (functions == nullptr) {
+    functions = &GetShadowScanFunctions(GetBestShadowScanKernel());
+    selected_functions = functions;
+  }
+  return functions;
+}
+
+}  // namespace
+
+bool IsShadowScanKernelSupported(ShadowScanKernel kernel) {
+  switch (kernel) {
+    case kScalarShadowScanKernel:
+      return true;
+    case kSse2ShadowScanKernel:
+      return base::CPU().has_sse2();
+    case kAvx2ShadowScanKernel:
+      // This also checks that the OS saves the YMM registers.
+      return base::CPU().has_avx2();
+    default:
+      NOTREACHED();
+      return false;
+  }
+}
+
+ShadowScanKernel GetBestShadowScanKernel() {
+  if (IsShadowScanKernelSupported(kAvx2ShadowScanKernel))
+    return kAvx2ShadowScanKernel;
+  if (IsShadowScanKernelSupported(kSse2ShadowScanKernel))
+    return kSse2ShadowScanKernel;
+  return kScalarShadowScanKernel;
+}
+
+const char* GetShadowScanKernelName(ShadowScanKernel kernel) {
+  DCHECK_GT(kShadowScanKernelCount, kernel);
+  return kShadowScanKernelNames[kernel];
+}
+
+const ShadowScanFunctions& GetShadowScanFunctions(ShadowScanKernel kernel) {
+  DCHECK_GT(kShadowScanKernelCount, kernel);
+  DCHECK(IsShadowScanKernelSupported(kernel));
+  return kShadowScanFunctions[kernel];
+}
+
+void SetShadowScanKernel(ShadowScanKernel kernel) {
+  selected_functions = &GetShadowScanFunctions(kernel);
+}
+
+const uint8_t* FindFirstNonZeroByte(const uint8_t* start, const uint8_t* end) {
+  DCHECK_LE(start, end);
+  return GetSelectedFunctions()->find_first_non_zero_byte(start, end);
+}
+
+void MarkAsFreed(uint8_t* start, uint8_t* end) {
+  DCHECK_LE(start, end);
+  GetSelectedFunctions()->mark_as_freed(start, end);
+}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
@@ -0,0 +1,92 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the kernels used to scan and update long runs of shadow bytes.
+// Each kernel comes in a scalar flavour and in SSE2 and AVX2 flavours that
+// process 16 and 32 shadow bytes at a time. The fastest flavour supported by
+// the CPU is selected at runtime, on first use.
+
+#ifndef SYZYGY_AGENT_ASAN_SHADOW_SCAN_H_
+#define SYZYGY_AGENT_ASAN_SHADOW_SCAN_H_
+
+#include <stdint.h>
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+// The flavours of shadow scanning kernels, from slowest to fastest.
+enum ShadowScanKernel {
+  kScalarShadowScanKernel,
+  kSse2ShadowScanKernel,
+  kAvx2ShadowScanKernel,
+  kShadowScanKernelCount,
+};
+
+// Finds the first non-zero byte in a range of shadow bytes.
+// @param start The first byte to test.
+// @param end The byte after the last byte to test.
+// @returns a pointer to the first non-zero byte in [@p start, @p end), or
+//     @p end if they are all zero.
+// @note The vectorized flavours read whole naturally aligned vectors, so they
+//     may read up to 31 bytes before and after the range. These reads never
+//     cross a vector boundary, and thus never touch a page that isn't spanned
+//     by the range.
+typedef const uint8_t* (*FindFirstNonZeroByteFunction)(const uint8_t* start,
+                                                       const uint8_t* end);
+
+// Marks a range of shadow bytes as freed, preserving the active left and
+// right redzone bytes it contains.
+// @param start The first byte to mark.
+// @param end The byte after the last byte to mark.
+typedef void (*MarkAsFreedFunction)(uint8_t* start, uint8_t* end);
+
+// The implementation of the shadow scanning kernels for a given flavour.
+struct ShadowScanFunctions {
+  FindFirstNonZeroByteFunction find_first_non_zero_byte;
+  MarkAsFreedFunction mark_as_freed;
+};
+
+// @param kernel A kernel flavour.
+// @returns true if the CPU supports @p kernel.
+bool IsShadowScanKernelSupported(ShadowScanKernel kernel);
+
+// @returns the fastest kernel flavour supported by the CPU.
+ShadowScanKernel GetBestShadowScanKernel();
+
+// @param kernel A kernel flavour.
+// @returns the name of @p kernel, for use in logs and metrics.
+const char* GetShadowScanKernelName(ShadowScanKernel kernel);
+
+// @param kernel A kernel flavour. It must be supported by the CPU.
+// @returns the functions implementing @p kernel.
+const ShadowScanFunctions& GetShadowScanFunctions(ShadowScanKernel kernel);
+
+// Overrides the kernel flavour used by the dispatching functions below. This
+// is intended for testing and benchmarking.
+// @param kernel A kernel flavour. It must be supported by the CPU.
+void SetShadowScanKernel(ShadowScanKernel kernel);
+
+// @name Dispatching functions. These forward to the selected kernel flavour,
+//     which defaults to GetBestShadowScanKernel().
+// @{
+const uint8_t* FindFirstNonZeroByte(const uint8_t* start, const uint8_t* end);
+void MarkAsFreed(uint8_t* start, uint8_t* end);
+// @}
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
+
+#endif  // SYZYGY_AGENT_ASAN_SHADOW_SCAN_H_
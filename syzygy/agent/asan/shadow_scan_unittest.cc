@@ -0,0 +1,198 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/agent/asan/shadow_scan.h"
+
+#include <vector>
+
+#include "base/rand_util.h"
+#include "gtest/gtest.h"
+#include "syzygy/agent/asan/shadow_marker.h"
+#include "syzygy/common/align.h"
+
+namespace agent {
+namespace asan {
+namespace internal {
+
+namespace {
+
+// The largest vector processed by the kernels.
+const size_t kMaxVectorSize = 32;
+
+// A buffer with some slack around the range under test, aligned such that
+// every head and tail alignment can be tested.
+const size_t kBufferSize = 8 * kMaxVectorSize;
+struct ALIGNAS(32) AlignedBuffer {
+  uint8_t data[kBufferSize];
+};
+
+// The reference implementation of FindFirstNonZeroByte.
+const uint8_t* ReferenceFindFirstNonZeroByte(const uint8_t* start,
+                                             const uint8_t* end) {
+  for (; start != end; ++start) {
+    if (*start != 0)
+      return start;
+  }
+  return end;
+}
+
+// The reference implementation of MarkAsFreed.
+void ReferenceMarkAsFreed(uint8_t* start, uint8_t* end) {
+  for (; start != end; ++start) {
+    if (!ShadowMarkerHelper::IsActiveLeftRedzone(*start) &&
+        !ShadowMarkerHelper::IsActiveRightRedzone(*start)) {
+      *start = kHeapFreedMarker;
+    }
+  }
+}
+
+class ShadowScanTest : public testing::TestWithParam<ShadowScanKernel> {
+ public:
+  void SetUp() override {
+    if (!IsShadowScanKernelSupported(GetParam())) {
+      LOG(INFO) << "Skipping the unsupported "
+                << GetShadowScanKernelName(GetParam()) << " kernel.";
+      functions_ = nullptr;
+      return;
+    }
+    functions_ = &GetShadowScanFunctions(GetParam());
+  }
+
+ protected:
+  const ShadowScanFunctions* functions_;
+};
+
+}  // namespace
+
+TEST(ShadowScanKernelTest, Selection) {
+  EXPECT_TRUE(IsShadowScanKernelSupported(kScalarShadowScanKernel));
+  ShadowScanKernel best = GetBestShadowScanKernel();
+  EXPECT_TRUE(IsShadowScanKernelSupported(best));
+  for (int i = 0; i < kShadowScanKernelCount; ++i) {
+    ShadowScanKernel kernel = static_cast<ShadowScanKernel>(i);
+    // The kernels are ordered by instruction set, and each instruction set is
+    // a superset of the previous ones.
+    EXPECT_EQ(kernel <= best, IsShadowScanKernelSupported(kernel));
+    EXPECT_NE(static_cast<const char*>(nullptr),
+              GetShadowScanKernelName(kernel));
+  }
+}
+
+TEST_P(ShadowScanTest, FindFirstNonZeroByte) {
+  if (functions_ == nullptr)
+    return;
+
+  AlignedBuffer buffer = {};
+  uint8_t* data = buffer.data;
+
+  // Test all head and tail alignments, with and without a non-zero byte
+  // outside of the range.
+  for (size_t i = kMaxVectorSize; i < 2 * kMaxVectorSize; ++i) {
+    for (size_t j = kBufferSize - 2 * kMaxVectorSize;
+         j < kBufferSize - kMaxVectorSize; ++j) {
+      ::memset(data, 0, kBufferSize);
+      EXPECT_EQ(data + j,
+                functions_->find_first_non_zero_byte(data + i, data + j));
+      EXPECT_EQ(data + i,
+                functions_->find_first_non_zero_byte(data + i, data + i));
+
+      ::memset(data, 0xCC, i);
+      ::memset(data + j, 0xCC, kBufferSize - j);
+      EXPECT_EQ(data + j,
+                functions_->find_first_non_zero_byte(data + i, data + j));
+
+      // A non-zero byte anywhere in the range is found.
+      for (size_t k = i; k < j; ++k) {
+        data[k] = static_cast<uint8_t>(k | 1);
+        ASSERT_EQ(data + k,
+                  functions_->find_first_non_zero_byte(data + i, data + j));
+        // Only the first one is reported.
+        if (k + 1 < j) {
+          data[k + 1] = 1;
+          ASSERT_EQ(data + k,
+                    functions_->find_first_non_zero_byte(data + i, data + j));
+          data[k + 1] = 0;
+        }
+        data[k] = 0;
+      }
+    }
+  }
+}
+
+TEST_P(ShadowScanTest, FindFirstNonZeroByteLongRanges) {
+  if (functions_ == nullptr)
+    return;
+
+  // Exercise the unrolled loops of the vectorized kernels.
+  const size_t kSize = 64 * 1024;
+  std::vector<uint8_t> buffer(kSize + kMaxVectorSize, 0);
+  uint8_t* data = ::common::AlignUp(buffer.data(), kMaxVectorSize);
+  EXPECT_EQ(data + kSize,
+            functions_->find_first_non_zero_byte(data, data + kSize));
+  for (size_t i = 0; i < 1000; ++i) {
+    size_t start = base::RandInt(0, static_cast<int>(kSize) - 1);
+    size_t k =
+        base::RandInt(static_cast<int>(start), static_cast<int>(kSize) - 1);
+    data[k] = 1;
+    ASSERT_EQ(ReferenceFindFirstNonZeroByte(data + start, data + kSize),
+              functions_->find_first_non_zero_byte(data + start, data + kSize));
+    // Leave some of the non-zero bytes behind.
+    if (i % 8 != 0)
+      data[k] = 0;
+  }
+}
+
+TEST_P(ShadowScanTest, MarkAsFreed) {
+  if (functions_ == nullptr)
+    return;
+
+  // Generate some shadow memory containing every marker value, and long runs
+  // of accessible bytes.
+  AlignedBuffer source = {};
+  for (size_t i = 0; i < kBufferSize; ++i) {
+    if (i % 64 < 32)
+      source.data[i] = static_cast<uint8_t>(i * 7);
+  }
+
+  AlignedBuffer expected = {};
+  AlignedBuffer actual = {};
+  for (size_t i = 0; i < 2 * kMaxVectorSize; ++i) {
+    for (size_t j = kBufferSize - 2 * kMaxVectorSize; j <= kBufferSize; ++j) {
+      expected = source;
+      actual = source;
+      ReferenceMarkAsFreed(expected.data + i, expected.data + j);
+      functions_->mark_as_freed(actual.data + i, actual.data + j);
+      ASSERT_EQ(0, ::memcmp(expected.data, actual.data, kBufferSize));
+    }
+  }
+
+  // Every marker value is handled the same way as the reference.
+  for (size_t i = 0; i < 256; ++i) {
+    ::memset(expected.data, static_cast<int>(i), kBufferSize);
+    ::memset(actual.data, static_cast<int>(i), kBufferSize);
+    ReferenceMarkAsFreed(expected.data, expected.data + kBufferSize);
+    functions_->mark_as_freed(actual.data, actual.data + kBufferSize);
+    ASSERT_EQ(0, ::memcmp(expected.data, actual.data, kBufferSize));
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(ShadowScanKernels,
+                        ShadowScanTest,
+                        testing::Values(kScalarShadowScanKernel,
+                                        kSse2ShadowScanKernel,
+                                        kAvx2ShadowScanKernel));
+
+}  // namespace internal
+}  // namespace asan
+}  // namespace agent
@@ -15,10 +15,12 @@
 #include "syzygy/agent/asan/shadow.h"
 
 #include <memory>
+#include <vector>
 
 #include "base/rand_util.h"
 #include "base/strings/stringprintf.h"
 #include "gtest/gtest.h"
+#include "syzygy/agent/asan/shadow_scan.h"
 #include "syzygy/common/align.h"
 #include "syzygy/testing/metrics.h"
 
@@ -690,6 +692,71 @@ TEST_F(ShadowTest, MarkAsFreedPerfTest) {
   testing::EmitMetric("Syzygy.Asan.Shadow.MarkAsFreed", tnet);
 }
 
+TEST_F(ShadowTest, ShadowScanKernelsPerfTest) {
+  // Times the range checks and MarkAsFreed with each of the shadow scanning
+  // kernels, over ranges from 8 bytes to 2MB. The number of iterations is
+  // chosen so that each measurement covers the same amount of memory.
+  const size_t kMaxRangeSize = 2 * 1024 * 1024;
+  const size_t kBytesPerMeasurement = 64 * 1024 * 1024;
+  std::vector<uint8_t> buf(kMaxRangeSize + kShadowRatio, 0);
+  uint8_t* data = ::common::AlignUp(buf.data(), kShadowRatio);
+
+  for (int k = 0; k < internal::kShadowScanKernelCount; ++k) {
+    internal::ShadowScanKernel kernel =
+        static_cast<internal::ShadowScanKernel>(k);
+    if (!internal::IsShadowScanKernelSupported(kernel))
+      continue;
+    internal::SetShadowScanKernel(kernel);
+
+    for (size_t size = kShadowRatio; size <= kMaxRangeSize; size *= 8) {
+      size_t iterations = kBytesPerMeasurement / size;
+      uint64_t t_accessible = 0;
+      uint64_t t_poisoned = 0;
+      uint64_t t_freed = 0;
+
+      test_shadow.Unpoison(data, size);
+      uint64_t t0 = ::__rdtsc();
+      for (size_t i = 0; i < iterations; ++i)
+        ASSERT_TRUE(test_shadow.IsRangeAccessible(data, size));
+      t_accessible += ::__rdtsc() - t0;
+
+      // Poison the last byte of the range so that it is scanned entirely.
+      test_shadow.Poison(data + size - kShadowRatio, kShadowRatio,
+                         kUserRedzoneMarker);
+      t0 = ::__rdtsc();
+      for (size_t i = 0; i < iterations; ++i) {
+        ASSERT_EQ(data + size - kShadowRatio,
+                  test_shadow.FindFirstPoisonedByte(data, size));
+      }
+      t_poisoned += ::__rdtsc() - t0;
+
+      for (size_t i = 0; i < iterations; ++i) {
+        test_shadow.Unpoison(data, size);
+        t0 = ::__rdtsc();
+        test_shadow.MarkAsFreed(data, size);
+        t_freed += ::__rdtsc() - t0;
+      }
+      test_shadow.Unpoison(data, size);
+
+      const char* name = internal::GetShadowScanKernelName(kernel);
+      testing::EmitMetric(
+          base::StringPrintf("Syzygy.Asan.Shadow.IsRangeAccessible.%s.%i",
+                             name, size),
+          t_accessible);
+      testing::EmitMetric(
+          base::StringPrintf("Syzygy.Asan.Shadow.FindFirstPoisonedByte.%s.%i",
+                             name, size),
+          t_poisoned);
+      testing::EmitMetric(
+          base::StringPrintf("Syzygy.Asan.Shadow.MarkAsFreed.%s.%i",
+                             name, size),
+          t_freed);
+    }
+  }
+
+  internal::SetShadowScanKernel(internal::GetBestShadowScanKernel());
+}
+
 TEST_F(ShadowTest, PageBits) {
   // Set an individual page.
   const uint8_t* addr = reinterpret_cast<const uint8_t*>(16 * 4096);
@@ -15,12 +15,14 @@
 #include "syzygy/agent/asan/stack_capture_cache.h"
 
 #include <algorithm>
+#include <vector>
 
 #include "base/lazy_instance.h"
 #include "base/logging.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/agent/asan/logger.h"
 #include "syzygy/agent/asan/memory_notifier.h"
+#include "syzygy/agent/common/scoped_last_error_keeper.h"
 #include "syzygy/agent/common/stack_capture.h"
 #include "syzygy/common/align.h"
 
@@ -32,6 +34,109 @@ namespace {
 static base::LazyInstance<common::StackCapture> g_empty_stack_capture =
     LAZY_INSTANCE_INITIALIZER;
 
+// The initial number of slots of a known stacks table.
+const size_t kInitialKnownStacksCapacity = 256;
+
+// The value of a known stacks slot whose stack capture has been removed. Stack
+// captures are pointer aligned, so this is never a valid stack capture.
+const base::subtle::AtomicWord kTombstone = 1;
+
+// Gives access to the reference count of a stack capture, which the cache
+// updates atomically.
+class RefCountedStackCapture : public common::StackCapture {
+ public:
+  using common::StackCapture::ref_count_;
+};
+
+volatile SHORT* GetRefCount(common::StackCapture* stack_capture) {
+  static_assert(sizeof(common::StackCapture::RefCount) == sizeof(SHORT),
+                "The reference count must be 16 bits.");
+  return reinterpret_cast<volatile SHORT*>(
+      &reinterpret_cast<RefCountedStackCapture*>(stack_capture)->ref_count_);
+}
+
+// Atomically increments the reference count of a stack capture, unless it is
+// zero. This uses saturation arithmetic, like StackCapture::AddRef.
+// @param stack_capture The stack capture to reference.
+// @param newly_saturated Will be set to true if this saturated the reference
+//     count.
+// @returns false if the reference count was zero, true otherwise.
+bool TryAddRef(common::StackCapture* stack_capture, bool* newly_saturated) {
+  volatile SHORT* ref_count = GetRefCount(stack_capture);
+  *newly_saturated = false;
+  while (true) {
+    common::StackCapture::RefCount count =
+        static_cast<common::StackCapture::RefCount>(*ref_count);
+    if (count == 0)
+      return false;
+    if (count == common::StackCapture::kMaxRefCount)
+      return true;
+    common::StackCapture::RefCount new_count = count + 1;
+    if (::InterlockedCompareExchange16(ref_count,
+                                       static_cast<SHORT>(new_count),
+                                       static_cast<SHORT>(count)) ==
+        static_cast<SHORT>(count)) {
+      *newly_saturated = new_count == common::StackCapture::kMaxRefCount;
+      return true;
+    }
+  }
+}
+
+// Atomically decrements the reference count of a stack capture. This uses
+// saturation arithmetic, like StackCapture::RemoveRef.
+// @param stack_capture The stack capture to release.
+// @returns true if this released the last reference, false otherwise.
+bool RemoveRef(common::StackCapture* stack_capture) {
+  volatile SHORT* ref_count = GetRefCount(stack_capture);
+  while (true) {
+    common::StackCapture::RefCount count =
+        static_cast<common::StackCapture::RefCount>(*ref_count);
+    DCHECK_LT(0u, count);
+    if (count == common::StackCapture::kMaxRefCount)
+      return false;
+    common::StackCapture::RefCount new_count = count - 1;
+    if (::InterlockedCompareExchange16(ref_count,
+                                       static_cast<SHORT>(new_count),
+                                       static_cast<SHORT>(count)) ==
+        static_cast<SHORT>(count)) {
+      return new_count == 0;
+    }
+  }
+}
+
+// Gives the first reference to a stack capture that is about to be published
+// in a known stacks table. Stale lock-free lookups may still be looking at a
+// reused stack capture, so the reference count is published atomically, after
+// the rest of the stack capture.
+void SetFirstRef(common::StackCapture* stack_capture) {
+  DCHECK(stack_capture->HasNoRefs());
+  ::InterlockedExchange16(GetRefCount(stack_capture), 1);
+}
+
+common::StackCapture* GetSlot(const base::subtle::AtomicWord* slot) {
+  return reinterpret_cast<common::StackCapture*>(
+      base::subtle::Acquire_Load(slot));
+}
+
+void SetSlot(base::subtle::AtomicWord* slot, base::subtle::AtomicWord value) {
+  base::subtle::Release_Store(slot, value);
+}
+
+// @returns true if @p value is a stack capture, false if it is empty or a
+//     tombstone.
+bool IsStackCapture(base::subtle::AtomicWord value) {
+  return value != 0 && value != kTombstone;
+}
+
+// @returns the index of the first slot to probe for a stack ID.
+size_t GetFirstSlot(const StackCaptureCache::StackId absolute_stack_id,
+                    size_t shard_count,
+                    size_t capacity) {
+  // The low bits of the ID select the shard, so the probe starts at the
+  // higher ones.
+  return (absolute_stack_id / shard_count) & (capacity - 1);
+}
+
 // Gives us access to the first frame of a stack capture as link-list pointer.
 common::StackCapture** GetFirstFrameAsLink(
     common::StackCapture* stack_capture) {
@@ -82,6 +187,16 @@ common::StackCapture* StackCaptureCache::CachePage::GetNextStackCapture(
   return GetNextStackCapture(max_num_frames, 0);
 }
 
+uint8_t* StackCaptureCache::CachePage::GetNextChunk(size_t size) {
+  DCHECK(::common::IsAligned(size, sizeof(void*)));
+  if (bytes_used_ + size > kDataSize)
+    return nullptr;
+
+  uint8_t* chunk = data_ + bytes_used_;
+  bytes_used_ += size;
+  return chunk;
+}
+
 bool StackCaptureCache::CachePage::ReturnStackCapture(
     common::StackCapture* stack_capture, size_t metadata_size) {
   DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
@@ -110,10 +225,19 @@ StackCaptureCache::StackCaptureCache(
     : logger_(logger),
       memory_notifier_(memory_notifier),
       max_num_frames_(common::StackCapture::kMaxNumFrames),
-      current_page_(nullptr) {
+      thread_chunk_tls_(TLS_OUT_OF_INDEXES),
+      current_page_(nullptr),
+      thread_chunks_(nullptr) {
   DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
 
+  for (size_t i = 0; i < kKnownStacksSharding; ++i) {
+    known_stacks_[i] = reinterpret_cast<base::subtle::AtomicWord>(
+        AllocateKnownStacksTable(kInitialKnownStacksCapacity, nullptr));
+  }
+  thread_chunk_tls_ = ::TlsAlloc();
+  CHECK_NE(TLS_OUT_OF_INDEXES, thread_chunk_tls_);
+
   AllocateCachePage();
 
   ::memset(&statistics_, 0, sizeof(statistics_));
@@ -127,13 +251,22 @@ StackCaptureCache::StackCaptureCache(
     : logger_(logger),
       memory_notifier_(memory_notifier),
       max_num_frames_(0),
-      current_page_(nullptr) {
+      thread_chunk_tls_(TLS_OUT_OF_INDEXES),
+      current_page_(nullptr),
+      thread_chunks_(nullptr) {
   DCHECK_NE(static_cast<AsanLogger*>(nullptr), logger);
   DCHECK_NE(static_cast<MemoryNotifierInterface*>(nullptr), memory_notifier);
   DCHECK_LT(0u, max_num_frames);
   max_num_frames_ = static_cast<uint8_t>(
       std::min(max_num_frames, common::StackCapture::kMaxNumFrames));
 
+  for (size_t i = 0; i < kKnownStacksSharding; ++i) {
+    known_stacks_[i] = reinterpret_cast<base::subtle::AtomicWord>(
+        AllocateKnownStacksTable(kInitialKnownStacksCapacity, nullptr));
+  }
+  thread_chunk_tls_ = ::TlsAlloc();
+  CHECK_NE(TLS_OUT_OF_INDEXES, thread_chunk_tls_);
+
   AllocateCachePage();
   ::memset(&statistics_, 0, sizeof(statistics_));
   ::memset(reclaimed_, 0, sizeof(reclaimed_));
@@ -141,6 +274,10 @@ StackCaptureCache::StackCaptureCache(
 }
 
 StackCaptureCache::~StackCaptureCache() {
+  for (size_t i = 0; i < kKnownStacksSharding; ++i)
+    FreeKnownStacksTables(GetKnownStacksTable(i));
+  ::TlsFree(thread_chunk_tls_);
+
   // Clean up the linked list of cache pages.
   while (current_page_ != nullptr) {
     CachePage* page = current_page_;
@@ -173,40 +310,50 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
   if (!num_frames)
     return &g_empty_stack_capture.Get();
 
-  bool already_cached = false;
-  common::StackCapture* stack_trace = nullptr;
-  bool saturated = false;
+  size_t known_stack_shard = absolute_stack_id % kKnownStacksSharding;
+  bool already_cached = true;
+  bool newly_saturated = false;
 
-  {
-    size_t known_stack_shard = absolute_stack_id % kKnownStacksSharding;
+  // Most stacks are already cached, in which case this is all it takes.
+  common::StackCapture* stack_trace = LookupAndAddRef(
+      GetKnownStacksTable(known_stack_shard), absolute_stack_id,
+      &newly_saturated);
+
+  if (stack_trace == nullptr) {
     // Get or insert the current stack trace while under the lock for this
-    // bucket.
+    // shard.
     base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
-
-    // Check if the stack capture is already in the cache map.
-    StackMap::iterator result =
-        known_stacks_[known_stack_shard].find(absolute_stack_id);
+    KnownStacksTable* table = GetKnownStacksTable(known_stack_shard);
+
+    // Check if the stack capture was cached concurrently.
+    size_t slot = 0;
+    bool found =
+        FindKnownStackSlotUnlocked(table, absolute_stack_id, &slot);
+    if (found) {
+      stack_trace = GetSlot(&table->slots[slot]);
+      if (!TryAddRef(stack_trace, &newly_saturated)) {
+        // The stack capture is being released, and will be reclaimed by the
+        // thread that released it. It is replaced by a new one.
+        stack_trace = nullptr;
+      }
+    }
 
     // If this capture has not already been cached then we have to initialize
     // the data.
-    if (result == known_stacks_[known_stack_shard].end()) {
+    if (stack_trace == nullptr) {
+      already_cached = false;
       stack_trace = GetStackCapture(num_frames);
       DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
       stack_trace->InitFromExistingStack(stack_capture);
-      auto result = known_stacks_[known_stack_shard].insert(
-          std::make_pair(absolute_stack_id, stack_trace));
-      DCHECK(result.second);
-      DCHECK(stack_trace->HasNoRefs());
+      DCHECK_EQ(absolute_stack_id, stack_trace->absolute_stack_id());
+      SetFirstRef(stack_trace);
+      if (found) {
+        SetSlot(&table->slots[slot],
+                reinterpret_cast<base::subtle::AtomicWord>(stack_trace));
+      } else {
+        InsertKnownStackUnlocked(known_stack_shard, slot, stack_trace);
+      }
       FOR_EACH_OBSERVER(Observer, observer_list_, OnNewStack(stack_trace));
-    } else {
-      already_cached = true;
-      stack_trace = result->second;
-    }
-    // Increment the reference count for this stack trace.
-    if (!stack_trace->RefCountIsSaturated()) {
-      stack_trace->AddRef();
-    } else {
-      saturated = true;
     }
   }
   DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_trace);
@@ -216,22 +363,13 @@ const common::StackCapture* StackCaptureCache::SaveStackTrace(
   // Update the statistics.
   if (compression_reporting_period_ != 0) {
     base::AutoLock stats_lock(stats_lock_);
-    if (already_cached) {
-      // If the existing stack capture is previously unreferenced and becoming
-      // referenced again, then decrement the unreferenced counter.
-      if (stack_trace->HasNoRefs()) {
-        DCHECK_LT(0u, statistics_.unreferenced);
-        --statistics_.unreferenced;
-      }
-    } else {
+    if (!already_cached) {
       ++statistics_.cached;
       statistics_.frames_alive += num_frames;
       ++statistics_.allocated;
     }
-    if (!saturated && stack_trace->RefCountIsSaturated()) {
-      saturated = true;
+    if (newly_saturated)
       ++statistics_.saturated;
-    }
     ++statistics_.requested;
     ++statistics_.references;
     statistics_.frames_stored += num_frames;
@@ -257,48 +395,9 @@ void StackCaptureCache::ReleaseStackTrace(
     return;
   }
 
-  size_t known_stack_shard =
-      stack_capture->absolute_stack_id() % kKnownStacksSharding;
-  bool add_to_reclaimed_list = false;
-  common::StackCapture* stack = nullptr;
-  {
-    base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
-
-    // We own the stack so its fine to remove the const. We double check this
-    // is the case in debug builds with the DCHECK.
-    stack = const_cast<common::StackCapture*>(stack_capture);
-
-    stack->RemoveRef();
-
-    if (stack->HasNoRefs()) {
-      add_to_reclaimed_list = true;
-      // Remove this from the known stacks as we're going to reclaim it and
-      // overwrite part of its data as we insert into the reclaimed_ list.
-      size_t num_erased = known_stacks_[known_stack_shard].erase(
-          stack_capture->absolute_stack_id());
-      DCHECK_EQ(num_erased, 1u);
-    }
-  }
-
-  // Update the statistics.
-  if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    DCHECK_LT(0u, statistics_.references);
-    --statistics_.references;
-    statistics_.frames_stored -= stack->num_frames();
-    if (add_to_reclaimed_list) {
-      --statistics_.cached;
-      ++statistics_.unreferenced;
-      // The frames in this stack capture are no longer alive.
-      statistics_.frames_alive -= stack->num_frames();
-    }
-  }
-
-  // Link this stack capture into the list of reclaimed stacks. This
-  // must come after the statistics updating, as we modify the |num_frames|
-  // parameter in place.
-  if (add_to_reclaimed_list)
-    AddStackCaptureToReclaimedList(stack);
+  // We own the stack so its fine to remove the const.
+  ReleaseStackTraceImpl(const_cast<common::StackCapture*>(stack_capture),
+                        true);
 }
 
 bool StackCaptureCache::StackCapturePointerIsValid(
@@ -310,27 +409,54 @@ bool StackCaptureCache::StackCapturePointerIsValid(
   const uint8_t* stack_capture_addr =
       reinterpret_cast<const uint8_t*>(stack_capture);
 
-  // Walk over the allocated pages and see if it lands within any of them.
   base::AutoLock lock(current_page_lock_);
-  CachePage* page = current_page_;
-  while (page != nullptr) {
-    const uint8_t* page_end = page->data() + page->bytes_used();
 
-    // If the proposed stack capture lands within a page we then check to
-    // ensure that it is also internally consistent. This can still fail
-    // but is somewhat unlikely.
-    static const size_t kMinSize = common::StackCapture::GetSize(1);
-    if (stack_capture_addr >= page->data() &&
-        stack_capture_addr + kMinSize <= page_end &&
-        stack_capture_addr + stack_capture->Size() <= page_end &&
-        stack_capture->num_frames() <= stack_capture->max_num_frames() &&
-        stack_capture->max_num_frames() <=
-            common::StackCapture::kMaxNumFrames) {
-      return true;
+  // Find the end of the handed out bytes that the proposed stack capture
+  // lands in. If it lands within a thread chunk then only the part of the
+  // chunk that its thread has used is valid.
+  const uint8_t* end = nullptr;
+  for (const ThreadChunk* chunk = thread_chunks_; chunk != nullptr;
+       chunk = chunk->next) {
+    if (stack_capture_addr < reinterpret_cast<const uint8_t*>(chunk) ||
+        stack_capture_addr >= chunk->end) {
+      continue;
     }
+    if (stack_capture_addr < chunk->begin)
+      return false;
+    end = reinterpret_cast<const uint8_t*>(
+        base::subtle::Acquire_Load(&chunk->cursor));
+    break;
+  }
+
+  // Otherwise it must land within the used part of a page, where it was
+  // allocated directly.
+  CachePage* page = current_page_;
+  while (end == nullptr && page != nullptr) {
+    const uint8_t* page_end = page->data() + page->bytes_used();
+    if (stack_capture_addr >= page->data() && stack_capture_addr < page_end)
+      end = page_end;
     page = page->next_page_;
   }
-  return false;
+  if (end == nullptr)
+    return false;
+
+  // Ensure that the stack capture is also internally consistent. This can
+  // still fail but is somewhat unlikely.
+  static const size_t kMinSize = common::StackCapture::GetSize(1);
+  return stack_capture_addr + kMinSize <= end &&
+         stack_capture_addr + stack_capture->Size() <= end &&
+         stack_capture->num_frames() <= stack_capture->max_num_frames() &&
+         stack_capture->max_num_frames() <=
+             common::StackCapture::kMaxNumFrames;
+}
+
+void StackCaptureCache::OnThreadExit() {
+  ThreadChunk* chunk = GetThreadChunk();
+  if (chunk == nullptr)
+    return;
+
+  ReclaimThreadChunkTail(chunk);
+  ::TlsSetValue(thread_chunk_tls_, nullptr);
 }
 
 void StackCaptureCache::AddObserver(Observer* obs) {
@@ -366,6 +492,258 @@ void StackCaptureCache::AllocateCachePage() {
   memory_notifier_->NotifyInternalUse(new_page, sizeof(CachePage));
 }
 
+// static
+StackCaptureCache::KnownStacksTable*
+StackCaptureCache::AllocateKnownStacksTable(size_t capacity,
+                                            KnownStacksTable* previous) {
+  DCHECK(::common::IsPowerOfTwo(capacity));
+  KnownStacksTable* table = new KnownStacksTable();
+  table->previous = previous;
+  table->capacity = capacity;
+  table->size = 0;
+  table->used = 0;
+  table->slots = new base::subtle::AtomicWord[capacity]();
+  return table;
+}
+
+// static
+void StackCaptureCache::FreeKnownStacksTables(KnownStacksTable* table) {
+  while (table != nullptr) {
+    KnownStacksTable* previous = table->previous;
+    delete [] table->slots;
+    delete table;
+    table = previous;
+  }
+}
+
+StackCaptureCache::KnownStacksTable* StackCaptureCache::GetKnownStacksTable(
+    size_t shard) const {
+  DCHECK_GT(kKnownStacksSharding, shard);
+  return reinterpret_cast<KnownStacksTable*>(
+      base::subtle::Acquire_Load(&known_stacks_[shard]));
+}
+
+common::StackCapture* StackCaptureCache::LookupAndAddRef(
+    const KnownStacksTable* table,
+    StackId absolute_stack_id,
+    bool* newly_saturated) {
+  DCHECK_NE(static_cast<KnownStacksTable*>(nullptr), table);
+  DCHECK_NE(static_cast<bool*>(nullptr), newly_saturated);
+
+  // The table may be modified concurrently, but it always contains empty
+  // slots so probing terminates.
+  size_t mask = table->capacity - 1;
+  size_t slot =
+      GetFirstSlot(absolute_stack_id, kKnownStacksSharding, table->capacity);
+  for (size_t i = 0; i < table->capacity; ++i, slot = (slot + 1) & mask) {
+    base::subtle::AtomicWord value =
+        base::subtle::Acquire_Load(&table->slots[slot]);
+    if (value == 0)
+      return nullptr;
+    if (value == kTombstone)
+      continue;
+
+    common::StackCapture* stack_capture =
+        reinterpret_cast<common::StackCapture*>(value);
+    if (stack_capture->absolute_stack_id() != absolute_stack_id)
+      continue;
+
+    // A stack capture that is no longer referenced is being removed, and the
+    // caller needs to replace it under lock.
+    if (!TryAddRef(stack_capture, newly_saturated))
+      return nullptr;
+
+    // The slot may have been stale, in which case the stack capture may have
+    // been reclaimed and reused for another stack since its ID was checked.
+    // Now that it is referenced it can't change anymore.
+    if (stack_capture->absolute_stack_id() == absolute_stack_id)
+      return stack_capture;
+    ReleaseStackTraceImpl(stack_capture, false);
+    *newly_saturated = false;
+    return nullptr;
+  }
+
+  return nullptr;
+}
+
+bool StackCaptureCache::FindKnownStackSlotUnlocked(
+    const KnownStacksTable* table,
+    StackId absolute_stack_id,
+    size_t* slot) const {
+  DCHECK_NE(static_cast<KnownStacksTable*>(nullptr), table);
+  DCHECK_NE(static_cast<size_t*>(nullptr), slot);
+
+  // Insertions reuse the first tombstone on the probe sequence.
+  size_t mask = table->capacity - 1;
+  size_t index =
+      GetFirstSlot(absolute_stack_id, kKnownStacksSharding, table->capacity);
+  bool found_tombstone = false;
+  for (size_t i = 0; i < table->capacity; ++i, index = (index + 1) & mask) {
+    base::subtle::AtomicWord value =
+        base::subtle::NoBarrier_Load(&table->slots[index]);
+    if (value == 0) {
+      if (!found_tombstone)
+        *slot = index;
+      return false;
+    }
+    if (value == kTombstone) {
+      if (!found_tombstone) {
+        found_tombstone = true;
+        *slot = index;
+      }
+      continue;
+    }
+    if (reinterpret_cast<common::StackCapture*>(value)->absolute_stack_id() ==
+            absolute_stack_id) {
+      *slot = index;
+      return true;
+    }
+  }
+
+  // Tables are never full.
+  NOTREACHED();
+  return false;
+}
+
+void StackCaptureCache::InsertKnownStackUnlocked(
+    size_t shard,
+    size_t slot,
+    common::StackCapture* stack_capture) {
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
+#ifndef NDEBUG
+  known_stacks_locks_[shard].AssertAcquired();
+#endif
+
+  KnownStacksTable* table = GetKnownStacksTable(shard);
+  DCHECK_GT(table->capacity, slot);
+  base::subtle::AtomicWord value =
+      base::subtle::NoBarrier_Load(&table->slots[slot]);
+  DCHECK(!IsStackCapture(value));
+
+  SetSlot(&table->slots[slot],
+          reinterpret_cast<base::subtle::AtomicWord>(stack_capture));
+  ++table->size;
+  if (value == 0)
+    ++table->used;
+
+  // Keep at least half of the slots empty so that probe sequences are short.
+  if (2 * table->used >= table->capacity)
+    RehashKnownStacksUnlocked(shard);
+}
+
+void StackCaptureCache::RemoveKnownStackUnlocked(
+    size_t shard,
+    const common::StackCapture* stack_capture) {
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
+#ifndef NDEBUG
+  known_stacks_locks_[shard].AssertAcquired();
+#endif
+
+  // The stack capture may already have been replaced by a new stack capture
+  // with the same ID.
+  KnownStacksTable* table = GetKnownStacksTable(shard);
+  size_t slot = 0;
+  if (!FindKnownStackSlotUnlocked(table, stack_capture->absolute_stack_id(),
+                                  &slot) ||
+      GetSlot(&table->slots[slot]) != stack_capture) {
+    return;
+  }
+
+  SetSlot(&table->slots[slot], kTombstone);
+  DCHECK_LT(0u, table->size);
+  --table->size;
+}
+
+void StackCaptureCache::RehashKnownStacksUnlocked(size_t shard) {
+#ifndef NDEBUG
+  known_stacks_locks_[shard].AssertAcquired();
+#endif
+
+  KnownStacksTable* table = GetKnownStacksTable(shard);
+  std::vector<base::subtle::AtomicWord> values;
+  values.reserve(table->size);
+  for (size_t i = 0; i < table->capacity; ++i) {
+    base::subtle::AtomicWord value =
+        base::subtle::NoBarrier_Load(&table->slots[i]);
+    if (IsStackCapture(value))
+      values.push_back(value);
+  }
+  DCHECK_EQ(table->size, values.size());
+
+  // A table that is mostly tombstones is compacted in place. Lock-free
+  // lookups probing it meanwhile may miss, in which case they fall back to a
+  // locked lookup. Otherwise the table is replaced by one twice as large, and
+  // is kept alive for lock-free lookups that are still probing it.
+  KnownStacksTable* new_table = table;
+  if (4 * values.size() >= table->capacity) {
+    new_table = AllocateKnownStacksTable(2 * table->capacity, table);
+  } else {
+    for (size_t i = 0; i < table->capacity; ++i)
+      SetSlot(&table->slots[i], 0);
+  }
+
+  new_table->size = 0;
+  new_table->used = 0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    size_t slot = 0;
+    bool found = FindKnownStackSlotUnlocked(
+        new_table,
+        reinterpret_cast<common::StackCapture*>(values[i])->absolute_stack_id(),
+        &slot);
+    DCHECK(!found);
+    SetSlot(&new_table->slots[slot], values[i]);
+    ++new_table->size;
+    ++new_table->used;
+  }
+
+  if (new_table != table) {
+    base::subtle::Release_Store(
+        &known_stacks_[shard],
+        reinterpret_cast<base::subtle::AtomicWord>(new_table));
+  }
+}
+
+void StackCaptureCache::ReleaseStackTraceImpl(
+    common::StackCapture* stack_capture, bool count_reference) {
+  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
+
+  // Once the reference is dropped the stack capture may be reclaimed by
+  // another thread, so this is read beforehand.
+  size_t num_frames = stack_capture->num_frames();
+  bool add_to_reclaimed_list = RemoveRef(stack_capture);
+  if (add_to_reclaimed_list) {
+    // Nobody can reference this stack capture anymore. Remove it from the
+    // known stacks as we're going to reclaim it and overwrite part of its
+    // data as we insert into the reclaimed_ list.
+    size_t known_stack_shard =
+        stack_capture->absolute_stack_id() % kKnownStacksSharding;
+    base::AutoLock auto_lock(known_stacks_locks_[known_stack_shard]);
+    RemoveKnownStackUnlocked(known_stack_shard, stack_capture);
+  }
+
+  // Update the statistics.
+  if (compression_reporting_period_ != 0) {
+    base::AutoLock stats_lock(stats_lock_);
+    if (count_reference) {
+      DCHECK_LT(0u, statistics_.references);
+      --statistics_.references;
+      statistics_.frames_stored -= num_frames;
+    }
+    if (add_to_reclaimed_list) {
+      --statistics_.cached;
+      ++statistics_.unreferenced;
+      // The frames in this stack capture are no longer alive.
+      statistics_.frames_alive -= num_frames;
+    }
+  }
+
+  // Link this stack capture into the list of reclaimed stacks. This
+  // must come after the statistics updating, as we modify the |num_frames|
+  // parameter in place.
+  if (add_to_reclaimed_list)
+    AddStackCaptureToReclaimedList(stack_capture);
+}
+
 void StackCaptureCache::GetStatisticsUnlocked(Statistics* statistics) const {
 #ifndef NDEBUG
   stats_lock_.AssertAcquired();
@@ -436,53 +814,130 @@ common::StackCapture* StackCaptureCache::GetStackCapture(size_t num_frames) {
     return stack_capture;
   }
 
+  return AllocateFromThreadChunk(num_frames);
+}
+
+common::StackCapture* StackCaptureCache::AllocateFromThreadChunk(
+    size_t num_frames) {
+  size_t size = common::StackCapture::GetSize(num_frames);
+  ThreadChunk* chunk = GetThreadChunk();
+
+  uint8_t* cursor = nullptr;
+  if (chunk != nullptr) {
+    cursor = reinterpret_cast<uint8_t*>(
+        base::subtle::NoBarrier_Load(&chunk->cursor));
+  }
+  if (chunk == nullptr || static_cast<size_t>(chunk->end - cursor) < size) {
+    // Use the remaining bytes to create more stack captures, for later use.
+    if (chunk != nullptr)
+      ReclaimThreadChunkTail(chunk);
+
+    chunk = AllocateThreadChunk();
+    ::TlsSetValue(thread_chunk_tls_, chunk);
+    cursor = chunk->begin;
+  }
+
+  DCHECK_LE(size, static_cast<size_t>(chunk->end - cursor));
+  common::StackCapture* stack_capture =
+      new(cursor) common::StackCapture(num_frames);
+  base::subtle::Release_Store(
+      &chunk->cursor,
+      reinterpret_cast<base::subtle::AtomicWord>(cursor + size));
+  return stack_capture;
+}
+
+StackCaptureCache::ThreadChunk* StackCaptureCache::AllocateThreadChunk() {
   common::StackCapture* unused_stack_capture = nullptr;
+  ThreadChunk* chunk = nullptr;
   {
     base::AutoLock current_page_lock(current_page_lock_);
 
-    // We didn't find a reusable stack capture. Go to the cache page.
-    stack_capture = current_page_->GetNextStackCapture(num_frames);
-
-    if (stack_capture != nullptr)
-      return stack_capture;
+    uint8_t* data = current_page_->GetNextChunk(kThreadChunkSize);
+    if (data == nullptr) {
+      // If the allocation failed we don't have enough room on the current
+      // page. Use the remaining bytes to create one more maximally sized
+      // stack capture, for later use.
+      size_t bytes_left = current_page_->bytes_left();
+      size_t max_num_frames = std::min(
+          common::StackCapture::GetMaxNumFrames(bytes_left),
+          common::StackCapture::kMaxNumFrames);
+      if (max_num_frames > 0) {
+        DCHECK_LE(common::StackCapture::GetSize(max_num_frames), bytes_left);
+        unused_stack_capture =
+            current_page_->GetNextStackCapture(max_num_frames);
+        DCHECK_NE(static_cast<common::StackCapture*>(nullptr),
+                  unused_stack_capture);
+      }
 
-    // If the allocation failed we don't have enough room on the current page.
-
-    // Use the remaining bytes to create one more maximally sized stack
-    // capture. We will stuff this into the reclaimed_ structure for later
-    // use.
-    size_t bytes_left = current_page_->bytes_left();
-    size_t max_num_frames = common::StackCapture::GetMaxNumFrames(bytes_left);
-    if (max_num_frames > 0) {
-      DCHECK_LT(max_num_frames, num_frames);
-      DCHECK_LE(common::StackCapture::GetSize(max_num_frames), bytes_left);
-      unused_stack_capture =
-          current_page_->GetNextStackCapture(max_num_frames);
-      DCHECK_NE(static_cast<common::StackCapture*>(nullptr),
-                unused_stack_capture);
+      // Allocate a new page (that links to the current page) and use it to
+      // allocate the chunk.
+      AllocateCachePage();
+      CHECK_NE(static_cast<CachePage*>(nullptr), current_page_);
+      statistics_.size += sizeof(CachePage);
+      data = current_page_->GetNextChunk(kThreadChunkSize);
     }
-
-    // Allocate a new page (that links to the current page) and use it to
-    // allocate a new stack capture.
-    AllocateCachePage();
-    CHECK_NE(static_cast<CachePage*>(nullptr), current_page_);
-    statistics_.size += sizeof(CachePage);
-    stack_capture = current_page_->GetNextStackCapture(num_frames);
+    DCHECK_NE(static_cast<uint8_t*>(nullptr), data);
+
+    // The chunk houses its own bump allocator, and is registered so that
+    // StackCapturePointerIsValid knows which of its bytes are handed out.
+    chunk = reinterpret_cast<ThreadChunk*>(data);
+    chunk->next = thread_chunks_;
+    chunk->begin =
+        data + ::common::AlignUp(sizeof(ThreadChunk), sizeof(void*));
+    chunk->cursor = reinterpret_cast<base::subtle::AtomicWord>(chunk->begin);
+    chunk->end = data + kThreadChunkSize;
+    thread_chunks_ = chunk;
   }
 
   if (unused_stack_capture != nullptr) {
+    // Update the statistics.
+    if (compression_reporting_period_ != 0) {
+      base::AutoLock stats_lock(stats_lock_);
+      ++statistics_.unreferenced;
+    }
+
     // We're creating an unreferenced stack capture.
     AddStackCaptureToReclaimedList(unused_stack_capture);
   }
 
-  // Update the statistics.
-  if (compression_reporting_period_ != 0) {
-    base::AutoLock stats_lock(stats_lock_);
-    ++statistics_.unreferenced;
-  }
+  return chunk;
+}
 
-  DCHECK_NE(static_cast<common::StackCapture*>(nullptr), stack_capture);
-  return stack_capture;
+StackCaptureCache::ThreadChunk* StackCaptureCache::GetThreadChunk() const {
+  // TlsGetValue resets the last error, which belongs to the instrumented code.
+  agent::common::ScopedLastErrorKeeper scoped_last_error_keeper;
+  return reinterpret_cast<ThreadChunk*>(::TlsGetValue(thread_chunk_tls_));
+}
+
+void StackCaptureCache::ReclaimThreadChunkTail(ThreadChunk* chunk) {
+  DCHECK_NE(static_cast<ThreadChunk*>(nullptr), chunk);
+
+  uint8_t* cursor =
+      reinterpret_cast<uint8_t*>(base::subtle::NoBarrier_Load(&chunk->cursor));
+  while (true) {
+    // These are only reused if they are no larger than max_num_frames_.
+    size_t bytes_left = chunk->end - cursor;
+    size_t max_num_frames = std::min(
+        common::StackCapture::GetMaxNumFrames(bytes_left), max_num_frames_);
+    if (max_num_frames == 0)
+      break;
+
+    common::StackCapture* unused_stack_capture =
+        new(cursor) common::StackCapture(max_num_frames);
+    cursor += common::StackCapture::GetSize(max_num_frames);
+    // The stack capture must be seen as handed out before it can be reused.
+    base::subtle::Release_Store(
+        &chunk->cursor, reinterpret_cast<base::subtle::AtomicWord>(cursor));
+
+    // Update the statistics.
+    if (compression_reporting_period_ != 0) {
+      base::AutoLock stats_lock(stats_lock_);
+      ++statistics_.unreferenced;
+    }
+
+    // We're creating an unreferenced stack capture.
+    AddStackCaptureToReclaimedList(unused_stack_capture);
+  }
 }
 
 namespace {
@@ -15,8 +15,9 @@
 #ifndef SYZYGY_AGENT_ASAN_STACK_CAPTURE_CACHE_H_
 #define SYZYGY_AGENT_ASAN_STACK_CAPTURE_CACHE_H_
 
-#include <unordered_map>
+#include <windows.h>
 
+#include "base/atomicops.h"
 #include "base/observer_list.h"
 #include "base/synchronization/lock.h"
 #include "syzygy/agent/asan/shadow.h"
@@ -31,6 +32,11 @@ class AsanLogger;
 class MemoryNotifierInterface;
 
 // A class which manages a thread-safe cache of unique stack traces, by ID.
+//
+// Looking up a stack that is already cached, and referencing and releasing a
+// cached stack, are lock-free. Locks are only taken when a stack is added to
+// or removed from the cache, and new stack captures are carved out of a
+// per-thread chunk of the current cache page.
 class StackCaptureCache {
  public:
   // The size of a page of stack captures, in bytes. This should be in the
@@ -39,6 +45,9 @@ class StackCaptureCache {
   // incremental growth is not too large.
   static const size_t kCachePageSize = 1024 * 1024;
 
+  // The size of the chunks of cache pages handed out to each thread, in bytes.
+  static const size_t kThreadChunkSize = 16 * 1024;
+
   // The type used to uniquely identify a stack.
   typedef common::StackCapture::StackId StackId;
 
@@ -110,8 +119,13 @@ class StackCaptureCache {
   // safe.
   void LogStatistics();
 
-  // Checks if a StackCapture pointer seems to be valid. This only ensure that
-  // it point into a CachePage.
+  // Returns the unused part of the chunk of the calling thread to the cache,
+  // as reclaimed stack captures. This is meant to be called when a thread
+  // exits, as the remainder of its chunk would otherwise never be used.
+  void OnThreadExit();
+
+  // Checks if a StackCapture pointer seems to be valid. This only ensures that
+  // it points into the part of a CachePage that was handed out.
   // @param stack_capture The pointer that we want to check.
   // @returns true if the pointer is valid, false otherwise.
   bool StackCapturePointerIsValid(const common::StackCapture* stack_capture);
@@ -130,9 +144,46 @@ class StackCaptureCache {
   void RemoveObserver(Observer* obs);
 
  protected:
-  // The container type in which we store the cached stacks. This enforces
-  // uniqueness based on their hash value, nothing more.
-  typedef std::unordered_map<StackId, common::StackCapture*> StackMap;
+  // An open addressing hash table of cached stacks, keyed by their absolute
+  // stack ID and using linear probing. This enforces uniqueness based on their
+  // hash value, nothing more. Each slot is empty (zero), a tombstone or a
+  // pointer to a stack capture.
+  //
+  // Lookups are lock-free, and insertions and removals are made under the
+  // lock of the shard owning the table. A lock-free lookup may thus see a
+  // stale slot: it only uses a stack capture once it has successfully
+  // referenced it and checked its ID, and falls back to a locked lookup
+  // otherwise. Stack captures are never returned to the OS while the cache
+  // lives, so a stale slot always points to a StackCapture. A table that is
+  // outgrown is replaced by a larger one, but is kept alive until the cache
+  // is destroyed as lock-free lookups may still be probing it.
+  struct KnownStacksTable {
+    // The table replaced by this one, if any.
+    KnownStacksTable* previous;
+    // The number of slots. This is a power of two.
+    size_t capacity;
+    // The number of slots holding a stack capture.
+    size_t size;
+    // The number of slots that are not empty, including tombstones.
+    size_t used;
+    // The slots.
+    base::subtle::AtomicWord* slots;
+  };
+
+  // The bump allocator of a thread, housed at the beginning of its chunk.
+  struct ThreadChunk {
+    // The chunk that was handed out before this one, if any. Chunks are never
+    // released while the cache lives.
+    ThreadChunk* next;
+    // The first byte that can be handed out, right after this header.
+    uint8_t* begin;
+    // The next byte to be handed out, as a uint8_t*. This is only modified by
+    // the thread owning the chunk, but is read by StackCapturePointerIsValid
+    // from any thread.
+    base::subtle::AtomicWord cursor;
+    // The end of the chunk.
+    uint8_t* end;
+  };
 
   // Used for shuttling around statistics about this cache.
   struct Statistics {
@@ -181,6 +232,98 @@ class StackCaptureCache {
   // Allocates a CachePage.
   void AllocateCachePage();
 
+  // @name Known stacks tables.
+  // @{
+  // Allocates an empty known stacks table.
+  // @param capacity The number of slots. This must be a power of two.
+  // @param previous The table replaced by the new one, if any.
+  // @returns the new table.
+  static KnownStacksTable* AllocateKnownStacksTable(
+      size_t capacity, KnownStacksTable* previous);
+
+  // Frees a known stacks table, and all of the tables it replaced.
+  // @param table The table to free.
+  static void FreeKnownStacksTables(KnownStacksTable* table);
+
+  // @param shard The shard owning the table.
+  // @returns the current table of @p shard.
+  KnownStacksTable* GetKnownStacksTable(size_t shard) const;
+
+  // Looks up a cached stack capture and references it. This is lock-free, and
+  // may miss a stack capture that is concurrently being inserted.
+  // @param table The table to search.
+  // @param absolute_stack_id The ID of the stack capture to look up.
+  // @param newly_saturated Will be set to true if this reference saturated the
+  //     reference count of the stack capture.
+  // @returns the referenced stack capture, or nullptr if none was found.
+  common::StackCapture* LookupAndAddRef(const KnownStacksTable* table,
+                                        StackId absolute_stack_id,
+                                        bool* newly_saturated);
+
+  // Finds the slot of a cached stack capture. Must be called under the lock
+  // of the shard owning @p table.
+  // @param table The table to search.
+  // @param absolute_stack_id The ID of the stack capture to look up.
+  // @param slot Will receive the index of the slot holding the stack capture,
+  //     or of the slot where it should be inserted.
+  // @returns true if a slot holding the stack capture was found.
+  bool FindKnownStackSlotUnlocked(const KnownStacksTable* table,
+                                  StackId absolute_stack_id,
+                                  size_t* slot) const;
+
+  // Inserts a new stack capture in the table of a shard, growing or
+  // compacting the table as required. Must be called under the lock of
+  // @p shard.
+  // @param shard The shard owning the table.
+  // @param slot The slot returned by FindKnownStackSlotUnlocked.
+  // @param stack_capture The stack capture to insert.
+  void InsertKnownStackUnlocked(size_t shard,
+                                size_t slot,
+                                common::StackCapture* stack_capture);
+
+  // Removes a stack capture from the table of a shard, if it is there. Must
+  // be called under the lock of @p shard.
+  // @param shard The shard owning the table.
+  // @param stack_capture The stack capture to remove.
+  void RemoveKnownStackUnlocked(size_t shard,
+                                const common::StackCapture* stack_capture);
+
+  // Rebuilds the table of a shard without its tombstones, into a larger
+  // table if it is getting full. Must be called under the lock of @p shard.
+  // @param shard The shard owning the table.
+  void RehashKnownStacksUnlocked(size_t shard);
+  // @}
+
+  // Drops a reference to a stack capture, removing it from the cache if it
+  // was the last one.
+  // @param stack_capture The stack capture to be released.
+  // @param count_reference True if the reference was counted in the
+  //     statistics, false if it was a transient reference taken by a
+  //     lock-free lookup.
+  void ReleaseStackTraceImpl(common::StackCapture* stack_capture,
+                             bool count_reference);
+
+  // Allocates a new stack capture from the chunk of the calling thread,
+  // getting it a new chunk if required.
+  // @param num_frames The number of frames that are required.
+  // @returns the new stack capture.
+  common::StackCapture* AllocateFromThreadChunk(size_t num_frames);
+
+  // Allocates a chunk from the current cache page, allocating a new page if
+  // required.
+  // @returns the new chunk.
+  ThreadChunk* AllocateThreadChunk();
+
+  // @returns the chunk of the calling thread, or nullptr if it has none. This
+  //     preserves the last error of the thread.
+  ThreadChunk* GetThreadChunk() const;
+
+  // Carves the remaining bytes of a chunk into stack captures of up to
+  // max_num_frames_ frames and adds them to the reclaimed_ list. Fewer bytes
+  // than the smallest stack capture may be left over.
+  // @param chunk The chunk of the calling thread.
+  void ReclaimThreadChunkTail(ThreadChunk* chunk);
+
   // Gets the current cache statistics. This must be called under lock_.
   // @param statistics Will be populated with current cache statistics.
   void GetStatisticsUnlocked(Statistics* statistics) const;
@@ -189,8 +332,8 @@ class StackCaptureCache {
   // @param report The statistics to be reported.
   void LogStatisticsImpl(const Statistics& statistics) const;
 
-  // Grabs a temporary StackCapture from reclaimed_ or the current CachePage.
-  // Must be called under lock_. Takes care of updating frames_dead.
+  // Grabs a temporary StackCapture from reclaimed_ or the chunk of the calling
+  // thread. Takes care of updating frames_dead.
   // @param num_frames The minimum number of frames that are required.
   common::StackCapture* GetStackCapture(size_t num_frames);
 
@@ -214,23 +357,31 @@ class StackCaptureCache {
   // The memory notifier that is informed of allocations made by the cache.
   MemoryNotifierInterface* memory_notifier_;
 
-  // Locks to protect the known stacks sets from concurrent access.
+  // Locks serializing the modifications of the known stacks tables.
   mutable base::Lock known_stacks_locks_[kKnownStacksSharding];
 
   // The max depth of the stack traces to allocate. This can change, but it
   // doesn't really make sense to do so.
   size_t max_num_frames_;
 
-  // The maps of known stacks. Accessed under known_stacks_locks_.
-  StackMap known_stacks_[kKnownStacksSharding];
+  // The tables of known stacks, each a KnownStacksTable*. These are read
+  // without locking, and replaced under known_stacks_locks_.
+  base::subtle::AtomicWord known_stacks_[kKnownStacksSharding];
+
+  // The TLS slot holding the ThreadChunk of each thread.
+  DWORD thread_chunk_tls_;
 
   // A lock protecting access to current_page_.
   base::Lock current_page_lock_;
 
-  // The current page from which new stack captures are allocated.
+  // The current page from which thread chunks are allocated.
   // Accessed under current_page_lock_.
   CachePage* current_page_;
 
+  // The most recently handed out thread chunk, linking to the previous ones.
+  // Accessed under current_page_lock_.
+  ThreadChunk* thread_chunks_;
+
   // A lock protecting access to statistics_.
   mutable base::Lock stats_lock_;
 
@@ -273,6 +424,12 @@ class StackCaptureCache::CachePage {
                                             size_t metadata_size);
   common::StackCapture* GetNextStackCapture(size_t max_num_frames);
 
+  // Allocates raw bytes from this cache page if possible.
+  // @param size The number of bytes to allocate. This must be a multiple of
+  //     the pointer size.
+  // @returns the allocation, or nullptr if the page is full.
+  uint8_t* GetNextChunk(size_t size);
+
   // Returns the most recently allocated stack capture back to the page.
   // @param stack_capture The stack capture to return.
   // @param metadata_size The number of bytes of metadata that was also
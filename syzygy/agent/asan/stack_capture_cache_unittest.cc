@@ -15,6 +15,11 @@
 #include "syzygy/agent/asan/stack_capture_cache.h"
 
 #include <memory>
+#include <vector>
+
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/agent/asan/logger.h"
 #include "syzygy/agent/asan/memory_notifiers/null_memory_notifier.h"
@@ -44,6 +49,7 @@ class TestStackCaptureCache : public StackCaptureCache {
   }
 
   using StackCaptureCache::Statistics;
+  using StackCaptureCache::ThreadChunk;
 
   void GetStatistics(Statistics* s) {
     DCHECK(s != NULL);
@@ -52,9 +58,17 @@ class TestStackCaptureCache : public StackCaptureCache {
   }
 
   CachePage* current_page() { return current_page_; }
+  ThreadChunk* thread_chunks() { return thread_chunks_; }
+
+  // @returns the next byte to be handed out from @p chunk.
+  static const uint8_t* GetCursor(const ThreadChunk* chunk) {
+    return reinterpret_cast<const uint8_t*>(
+        base::subtle::NoBarrier_Load(&chunk->cursor));
+  }
 
  private:
   using StackCaptureCache::current_page_;
+  using StackCaptureCache::thread_chunks_;
 };
 
 class StackCaptureCacheTest : public testing::Test {
@@ -73,6 +87,111 @@ class TestStackCaptureCacheObserver : public StackCaptureCache::Observer {
   MOCK_METHOD1(OnNewStack, void(common::StackCapture* new_stack));
 };
 
+// Saves and releases stacks drawn from a fixed set of distinct stacks,
+// holding on to a few of them at any time, as a heap does with the stacks of
+// its allocations.
+class StackCaptureCacheStressRunner
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  static const size_t kMaxFrames = 16;
+  static const size_t kMaxHeldStacks = 64;
+
+  StackCaptureCacheStressRunner(StackCaptureCache* cache,
+                                size_t distinct_stacks,
+                                size_t iterations,
+                                uint32_t seed)
+      : cache_(cache),
+        distinct_stacks_(distinct_stacks),
+        iterations_(iterations),
+        seed_(seed),
+        errors_(0) {
+  }
+
+  void Run() override {
+    std::vector<const StackCapture*> held_stacks;
+    for (size_t i = 0; i < iterations_; ++i) {
+      size_t index = NextRandom() % distinct_stacks_;
+      StackCapture stack;
+      InitStack(index, &stack);
+      const StackCapture* saved_stack = cache_->SaveStackTrace(stack);
+      if (saved_stack->absolute_stack_id() != stack.absolute_stack_id() ||
+          saved_stack->num_frames() != stack.num_frames() ||
+          ::memcmp(saved_stack->frames(), stack.frames(),
+                   stack.num_frames() * sizeof(void*)) != 0) {
+        ++errors_;
+      }
+      held_stacks.push_back(saved_stack);
+
+      if (held_stacks.size() == kMaxHeldStacks || (NextRandom() & 1) != 0) {
+        size_t released = NextRandom() % held_stacks.size();
+        cache_->ReleaseStackTrace(held_stacks[released]);
+        held_stacks[released] = held_stacks.back();
+        held_stacks.pop_back();
+      }
+    }
+
+    for (size_t i = 0; i < held_stacks.size(); ++i)
+      cache_->ReleaseStackTrace(held_stacks[i]);
+  }
+
+  // Initializes the stack of a given index. Stacks have varying depths.
+  static void InitStack(size_t index, StackCapture* stack) {
+    void* frames[kMaxFrames] = {};
+    for (size_t i = 0; i < kMaxFrames; ++i)
+      frames[i] = reinterpret_cast<void*>(index * kMaxFrames + i + 1);
+    stack->InitFromBuffer(frames, 1 + index % kMaxFrames);
+  }
+
+  size_t errors() const { return errors_; }
+
+ private:
+  uint32_t NextRandom() {
+    seed_ = seed_ * 1103515245 + 12345;
+    return seed_ >> 8;
+  }
+
+  StackCaptureCache* cache_;
+  size_t distinct_stacks_;
+  size_t iterations_;
+  uint32_t seed_;
+  size_t errors_;
+
+  DISALLOW_COPY_AND_ASSIGN(StackCaptureCacheStressRunner);
+};
+
+// Runs StackCaptureCacheStressRunners on a number of threads.
+// @returns the time it took all of the threads to finish.
+base::TimeDelta RunStressThreads(StackCaptureCache* cache,
+                                 size_t thread_count,
+                                 size_t distinct_stacks,
+                                 size_t iterations,
+                                 size_t* errors) {
+  std::vector<std::unique_ptr<StackCaptureCacheStressRunner>> runners;
+  std::vector<std::unique_ptr<base::DelegateSimpleThread>> threads;
+  for (size_t i = 0; i < thread_count; ++i) {
+    runners.push_back(std::unique_ptr<StackCaptureCacheStressRunner>(
+        new StackCaptureCacheStressRunner(cache, distinct_stacks, iterations,
+                                          static_cast<uint32_t>(i + 1))));
+    threads.push_back(std::unique_ptr<base::DelegateSimpleThread>(
+        new base::DelegateSimpleThread(
+            runners.back().get(),
+            base::StringPrintf("StackCaptureCacheStressRunner%d",
+                               static_cast<int>(i)))));
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < thread_count; ++i)
+    threads[i]->Start();
+  for (size_t i = 0; i < thread_count; ++i)
+    threads[i]->Join();
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+  *errors = 0;
+  for (size_t i = 0; i < thread_count; ++i)
+    *errors += runners[i]->errors();
+  return elapsed;
+}
+
 }  // namespace
 
 TEST_F(StackCaptureCacheTest, CachePageTest) {
@@ -366,6 +485,65 @@ TEST_F(StackCaptureCacheTest, StackCapturePointerIsValid) {
   // A null pointer should be invalid.
   EXPECT_FALSE(cache.StackCapturePointerIsValid(
       reinterpret_cast<const StackCapture*>(NULL)));
+
+  // The stack capture was carved out of the chunk of this thread. Its header
+  // and the bytes that have yet to be handed out should be invalid.
+  TestStackCaptureCache::ThreadChunk* chunk = cache.thread_chunks();
+  ASSERT_TRUE(chunk != NULL);
+  EXPECT_LE(chunk->begin, reinterpret_cast<const uint8_t*>(s1));
+  const uint8_t* cursor = TestStackCaptureCache::GetCursor(chunk);
+  EXPECT_LT(reinterpret_cast<const uint8_t*>(s1), cursor);
+  EXPECT_FALSE(cache.StackCapturePointerIsValid(
+      reinterpret_cast<const StackCapture*>(chunk)));
+  EXPECT_FALSE(cache.StackCapturePointerIsValid(
+      reinterpret_cast<const StackCapture*>(cursor)));
+  EXPECT_FALSE(cache.StackCapturePointerIsValid(
+      reinterpret_cast<const StackCapture*>(chunk->end -
+                                            StackCapture::GetSize(1))));
+}
+
+TEST_F(StackCaptureCacheTest, OnThreadExit) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  cache.set_compression_reporting_period(1U);
+
+  // Saving a stack trace should preserve the last error of the thread.
+  StackCapture stack_capture;
+  stack_capture.InitFromStack();
+  ::SetLastError(ERROR_INVALID_PARAMETER);
+  const StackCapture* s1 = cache.SaveStackTrace(stack_capture);
+  ASSERT_TRUE(s1 != NULL);
+  EXPECT_EQ(ERROR_INVALID_PARAMETER, ::GetLastError());
+
+  TestStackCaptureCache::ThreadChunk* chunk = cache.thread_chunks();
+  ASSERT_TRUE(chunk != NULL);
+  TestStackCaptureCache::Statistics s = {};
+  cache.GetStatistics(&s);
+  EXPECT_EQ(0u, s.unreferenced);
+
+  // The unused part of the chunk should be turned into reclaimed stack
+  // captures, leaving too few bytes for another one.
+  cache.OnThreadExit();
+  EXPECT_GT(StackCapture::GetSize(1),
+            static_cast<size_t>(chunk->end -
+                                TestStackCaptureCache::GetCursor(chunk)));
+  cache.GetStatistics(&s);
+  EXPECT_LT(0u, s.unreferenced);
+
+  // A new stack capture should reuse one of them rather than allocate a new
+  // chunk.
+  void* frames[] = { reinterpret_cast<void*>(1), reinterpret_cast<void*>(2) };
+  stack_capture.InitFromBuffer(frames, arraysize(frames));
+  const StackCapture* s2 = cache.SaveStackTrace(stack_capture);
+  ASSERT_TRUE(s2 != NULL);
+  EXPECT_EQ(chunk, cache.thread_chunks());
+  EXPECT_LT(reinterpret_cast<const uint8_t*>(s1),
+            reinterpret_cast<const uint8_t*>(s2));
+  EXPECT_GT(chunk->end, reinterpret_cast<const uint8_t*>(s2));
+  EXPECT_TRUE(cache.StackCapturePointerIsValid(s2));
+
+  // This is harmless on a thread without a chunk.
+  cache.OnThreadExit();
 }
 
 TEST_F(StackCaptureCacheTest, StackCaptureObserver) {
@@ -421,6 +599,50 @@ TEST_F(StackCaptureCacheTest, AllocateMultiplePages) {
   EXPECT_NE(page, cache.current_page());
 }
 
+TEST_F(StackCaptureCacheTest, ConcurrentSaveAndRelease) {
+  AsanLogger logger;
+  TestStackCaptureCache cache(&logger);
+  cache.set_compression_reporting_period(1U);
+
+  // Few enough distinct stacks that threads share them, and enough that
+  // stacks come and go and tables get rehashed.
+  size_t errors = 0;
+  RunStressThreads(&cache, 4, 5000, 50000, &errors);
+  EXPECT_EQ(0u, errors);
+
+  // Everything was released.
+  TestStackCaptureCache::Statistics s = {};
+  cache.GetStatistics(&s);
+  EXPECT_EQ(0u, s.cached);
+  EXPECT_EQ(0u, s.references);
+  EXPECT_EQ(0u, s.frames_stored);
+  EXPECT_EQ(0u, s.frames_alive);
+}
+
+// Measures the throughput of SaveStackTrace and ReleaseStackTrace pairs on a
+// varying number of threads. This only uses the public interface of the cache
+// so that it can be run against earlier implementations. This is disabled by
+// default; run with --gtest_also_run_disabled_tests.
+TEST_F(StackCaptureCacheTest, DISABLED_BenchmarkConcurrentSaveAndRelease) {
+  static const size_t kIterations = 1000000;
+  static const size_t kDistinctStacks = 10000;
+  static const size_t kThreadCounts[] = {1, 2, 4, 8};
+
+  for (size_t i = 0; i < arraysize(kThreadCounts); ++i) {
+    AsanLogger logger;
+    StackCaptureCache cache(&logger, &null_memory_notifier);
+    size_t errors = 0;
+    base::TimeDelta elapsed = RunStressThreads(
+        &cache, kThreadCounts[i], kDistinctStacks, kIterations, &errors);
+    EXPECT_EQ(0u, errors);
+
+    double operations = static_cast<double>(kThreadCounts[i] * kIterations);
+    LOG(INFO) << kThreadCounts[i] << " threads: "
+              << operations / elapsed.InSecondsF()
+              << " allocations per second.";
+  }
+}
+
 TEST_F(StackCaptureCacheTest, EmptyStackCapture) {
   AsanLogger logger;
   TestStackCaptureCache cache(&logger);
@@ -24,6 +24,7 @@
 #include "syzygy/agent/asan/rtl_impl.h"
 #include "syzygy/agent/asan/runtime.h"
 #include "syzygy/agent/asan/runtime_util.h"
+#include "syzygy/agent/asan/stack_capture_cache.h"
 #include "syzygy/agent/common/agent.h"
 #include "syzygy/common/logging.h"
 
@@ -184,9 +185,14 @@ BOOL WINAPI DllMain(HMODULE instance, DWORD reason, LPVOID reserved) {
       break;
     }
 
-    case DLL_THREAD_DETACH:
-      // Nothing to do here.
+    case DLL_THREAD_DETACH: {
+      // Give the unused part of the stack capture chunk of the thread back
+      // to the cache.
+      agent::asan::AsanRuntime* runtime = agent::asan::AsanRuntime::runtime();
+      if (runtime != nullptr && runtime->stack_cache() != nullptr)
+        runtime->stack_cache()->OnThreadExit();
       break;
+    }
 
     case DLL_PROCESS_DETACH: {
       base::CommandLine::Reset();
@@ -218,6 +224,17 @@ VOID WINAPI asan_DisableDeferredFreeThread() {
   asan_runtime->DisableDeferredFreeThread();
 }
 
+// Enables the per-thread block caches, which speed up small allocations from
+// the process heap.
+VOID WINAPI asan_EnableThreadBlockCaches() {
+  asan_runtime->EnableThreadBlockCaches();
+}
+
+// Disables the per-thread block caches and empties them.
+VOID WINAPI asan_DisableThreadBlockCaches() {
+  asan_runtime->DisableThreadBlockCaches();
+}
+
 void WINAPI asan_EnumExperiments(AsanExperimentCallback callback) {
   DCHECK(callback != nullptr);
 
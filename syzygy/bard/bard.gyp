@@ -23,6 +23,8 @@
       'sources': [
         'event.cc',
         'event.h',
+        'packed_story.cc',
+        'packed_story.h',
         'raw_argument_converter.cc',
         'raw_argument_converter.h',
         'story.cc',
@@ -74,6 +76,7 @@
       'type': 'executable',
       'sources': [
         'event_unittest.cc',
+        'packed_story_unittest.cc',
         'raw_argument_converter_unittest.cc',
         'story_unittest.cc',
         'trace_live_map_unittest.cc',
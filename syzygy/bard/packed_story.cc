@@ -0,0 +1,707 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/packed_story.h"
+
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "base/logging.h"
+#include "base/synchronization/condition_variable.h"
+#include "syzygy/bard/events/heap_alloc_event.h"
+#include "syzygy/bard/events/heap_create_event.h"
+#include "syzygy/bard/events/heap_destroy_event.h"
+#include "syzygy/bard/events/heap_free_event.h"
+#include "syzygy/bard/events/heap_realloc_event.h"
+#include "syzygy/bard/events/heap_set_information_event.h"
+#include "syzygy/bard/events/heap_size_event.h"
+#include "syzygy/bard/events/linked_event.h"
+
+namespace bard {
+
+namespace {
+
+using events::HeapAllocEvent;
+using events::HeapCreateEvent;
+using events::HeapDestroyEvent;
+using events::HeapFreeEvent;
+using events::HeapReAllocEvent;
+using events::HeapSetInformationEvent;
+using events::HeapSizeEvent;
+using events::LinkedEvent;
+
+// The number of event records buffered before being written out.
+const size_t kEventsPerWrite = 1024;
+
+uint64_t PointerToArg(const void* pointer) {
+  return reinterpret_cast<uintptr_t>(pointer);
+}
+
+template <typename PointerType>
+PointerType ArgToPointer(uint64_t arg) {
+  return reinterpret_cast<PointerType>(static_cast<uintptr_t>(arg));
+}
+
+bool IsAligned(const void* pointer) {
+  return reinterpret_cast<uintptr_t>(pointer) % sizeof(uint64_t) == 0;
+}
+
+template <typename T>
+bool WriteArray(const T* values, size_t count, core::OutStream* out_stream) {
+  DCHECK_NE(static_cast<core::OutStream*>(nullptr), out_stream);
+  if (count == 0)
+    return true;
+  return out_stream->Write(count * sizeof(T),
+                           reinterpret_cast<const core::Byte*>(values));
+}
+
+template <typename T>
+bool WriteValue(const T& value, core::OutStream* out_stream) {
+  return WriteArray(&value, 1, out_stream);
+}
+
+}  // namespace
+
+bool PackEvent(const EventInterface* event, PackedEvent* packed_event) {
+  DCHECK_NE(static_cast<const EventInterface*>(nullptr), event);
+  DCHECK_NE(static_cast<PackedEvent*>(nullptr), packed_event);
+
+  packed_event->type = static_cast<uint8_t>(event->type());
+  packed_event->reserved = 0;
+  for (size_t i = 0; i < PackedEvent::kMaxArgs; ++i)
+    packed_event->args[i] = 0;
+
+  uint64_t* args = packed_event->args;
+  switch (event->type()) {
+    case EventInterface::kHeapAllocEvent: {
+      const auto* e = reinterpret_cast<const HeapAllocEvent*>(event);
+      packed_event->stack_trace_id = e->stack_trace_id();
+      args[0] = PointerToArg(e->trace_heap());
+      args[1] = e->flags();
+      args[2] = e->bytes();
+      args[3] = PointerToArg(e->trace_alloc());
+      return true;
+    }
+    case EventInterface::kHeapCreateEvent: {
+      const auto* e = reinterpret_cast<const HeapCreateEvent*>(event);
+      packed_event->stack_trace_id = e->stack_trace_id();
+      args[0] = e->options();
+      args[1] = e->initial_size();
+      args[2] = e->maximum_size();
+      args[3] = PointerToArg(e->trace_heap());
+      return true;
+    }
+    case EventInterface::kHeapDestroyEvent: {
+      const auto* e = reinterpret_cast<const HeapDestroyEvent*>(event);
+      packed_event->stack_trace_id = e->stack_trace_id();
+      args[0] = PointerToArg(e->trace_heap());
+      args[1] = e->trace_succeeded();
+      return true;
+    }
+    case EventInterface::kHeapFreeEvent: {
+      const auto* e = reinterpret_cast<const HeapFreeEvent*>(event);
+      packed_event->stack_trace_id = e->stack_trace_id();
+      args[0] = PointerToArg(e->trace_heap());
+      args[1] = e->flags();
+      args[2] = PointerToArg(e->trace_alloc());
+      args[3] = e->trace_succeeded();
+      return true;
+    }
+    case EventInterface::kHeapReAllocEvent: {
+      const auto* e = reinterpret_cast<const HeapReAllocEvent*>(event);
+      packed_event->stack_trace_id = e->stack_trace_id();
+      args[0] = PointerToArg(e->trace_heap());
+      args[1] = e->flags();
+      args[2] = PointerToArg(e->trace_alloc());
+      args[3] = e->bytes();
+      args[4] = PointerToArg(e->trace_realloc());
+      return true;
+    }
+    case EventInterface::kHeapSetInformationEvent: {
+      const auto* e = reinterpret_cast<const HeapSetInformationEvent*>(event);
+      packed_event->stack_trace_id = e->stack_trace_id();
+      args[0] = PointerToArg(e->trace_heap());
+      args[1] = e->info_class();
+      args[2] = PointerToArg(e->info());
+      args[3] = e->info_length();
+      args[4] = e->trace_succeeded();
+      return true;
+    }
+    case EventInterface::kHeapSizeEvent: {
+      const auto* e = reinterpret_cast<const HeapSizeEvent*>(event);
+      packed_event->stack_trace_id = e->stack_trace_id();
+      args[0] = PointerToArg(e->trace_heap());
+      args[1] = e->flags();
+      args[2] = PointerToArg(e->trace_alloc());
+      args[3] = e->trace_size();
+      return true;
+    }
+    default:
+      LOG(ERROR) << "Unable to pack event of type " << event->type() << ".";
+      return false;
+  }
+}
+
+std::unique_ptr<EventInterface> UnpackEvent(const PackedEvent& packed_event) {
+  const uint64_t* args = packed_event.args;
+  uint32_t stack_trace_id = packed_event.stack_trace_id;
+  switch (packed_event.type) {
+    case EventInterface::kHeapAllocEvent:
+      return std::unique_ptr<EventInterface>(new HeapAllocEvent(
+          stack_trace_id, ArgToPointer<HANDLE>(args[0]),
+          static_cast<DWORD>(args[1]), static_cast<SIZE_T>(args[2]),
+          ArgToPointer<LPVOID>(args[3])));
+    case EventInterface::kHeapCreateEvent:
+      return std::unique_ptr<EventInterface>(new HeapCreateEvent(
+          stack_trace_id, static_cast<DWORD>(args[0]),
+          static_cast<SIZE_T>(args[1]), static_cast<SIZE_T>(args[2]),
+          ArgToPointer<HANDLE>(args[3])));
+    case EventInterface::kHeapDestroyEvent:
+      return std::unique_ptr<EventInterface>(new HeapDestroyEvent(
+          stack_trace_id, ArgToPointer<HANDLE>(args[0]),
+          static_cast<BOOL>(args[1])));
+    case EventInterface::kHeapFreeEvent:
+      return std::unique_ptr<EventInterface>(new HeapFreeEvent(
+          stack_trace_id, ArgToPointer<HANDLE>(args[0]),
+          static_cast<DWORD>(args[1]), ArgToPointer<LPVOID>(args[2]),
+          static_cast<BOOL>(args[3])));
+    case EventInterface::kHeapReAllocEvent:
+      return std::unique_ptr<EventInterface>(new HeapReAllocEvent(
+          stack_trace_id, ArgToPointer<HANDLE>(args[0]),
+          static_cast<DWORD>(args[1]), ArgToPointer<LPVOID>(args[2]),
+          static_cast<SIZE_T>(args[3]), ArgToPointer<LPVOID>(args[4])));
+    case EventInterface::kHeapSetInformationEvent:
+      return std::unique_ptr<EventInterface>(new HeapSetInformationEvent(
+          stack_trace_id, ArgToPointer<HANDLE>(args[0]),
+          static_cast<HEAP_INFORMATION_CLASS>(args[1]),
+          ArgToPointer<PVOID>(args[2]), static_cast<SIZE_T>(args[3]),
+          static_cast<BOOL>(args[4])));
+    case EventInterface::kHeapSizeEvent:
+      return std::unique_ptr<EventInterface>(new HeapSizeEvent(
+          stack_trace_id, ArgToPointer<HANDLE>(args[0]),
+          static_cast<DWORD>(args[1]), ArgToPointer<LPCVOID>(args[2]),
+          static_cast<SIZE_T>(args[3])));
+    default:
+      LOG(ERROR) << "Invalid packed event type "
+                 << static_cast<int>(packed_event.type) << ".";
+      return nullptr;
+  }
+}
+
+void PackedStoryWriter::AddStory(const Story* story,
+                                 const std::vector<uint64_t>& existing_heaps) {
+  DCHECK_NE(static_cast<const Story*>(nullptr), story);
+  StoryInfo info = {story, existing_heaps, 0, 0};
+  stories_.push_back(info);
+}
+
+bool PackedStoryWriter::Write(core::OutStream* out_stream) {
+  DCHECK_NE(static_cast<core::OutStream*>(nullptr), out_stream);
+
+  // The stories are laid out back to back after the header and the directory.
+  // All the structures are multiples of 8 bytes in size, so this keeps all of
+  // them naturally aligned.
+  std::vector<PackedStoryEntry> entries;
+  uint64_t offset = sizeof(PackedStoryFileHeader) +
+                    stories_.size() * sizeof(PackedStoryEntry);
+  for (auto& info : stories_) {
+    if (!LayOutStory(&info))
+      return false;
+    PackedStoryEntry entry = {offset, info.size};
+    entries.push_back(entry);
+    offset += info.size;
+  }
+
+  PackedStoryFileHeader header = {};
+  header.magic = kPackedStoryMagic;
+  header.version = kPackedStoryVersion;
+  header.story_count = static_cast<uint32_t>(stories_.size());
+  if (!WriteValue(header, out_stream) ||
+      !WriteArray(entries.data(), entries.size(), out_stream)) {
+    return false;
+  }
+
+  for (const auto& info : stories_) {
+    if (!WriteStory(info, out_stream))
+      return false;
+  }
+
+  return true;
+}
+
+bool PackedStoryWriter::LayOutStory(StoryInfo* info) {
+  DCHECK_NE(static_cast<StoryInfo*>(nullptr), info);
+
+  const size_t kMaxCount = std::numeric_limits<uint32_t>::max();
+  const auto& plot_lines = info->story->plot_lines();
+  if (plot_lines.size() > kMaxCount || info->existing_heaps.size() > kMaxCount)
+    return false;
+
+  uint64_t event_count = 0;
+  uint64_t dep_count = 0;
+  for (const Story::PlotLine* plot_line : plot_lines) {
+    if (plot_line->size() > kMaxCount) {
+      LOG(ERROR) << "Plot line too long to be packed.";
+      return false;
+    }
+    event_count += plot_line->size();
+
+    for (const EventInterface* event : *plot_line) {
+      if (event->type() != EventInterface::kLinkedEvent)
+        continue;
+      dep_count += reinterpret_cast<const LinkedEvent*>(event)->deps().size();
+    }
+  }
+  if (dep_count > kMaxCount) {
+    LOG(ERROR) << "Too many dependencies to be packed.";
+    return false;
+  }
+
+  info->dep_count = static_cast<size_t>(dep_count);
+  info->size = sizeof(PackedStoryHeader) +
+               info->existing_heaps.size() * sizeof(uint64_t) +
+               plot_lines.size() * sizeof(PackedPlotLine) +
+               dep_count * sizeof(PackedDep) +
+               event_count * sizeof(PackedEvent);
+  return true;
+}
+
+bool PackedStoryWriter::WriteStory(const StoryInfo& info,
+                                   core::OutStream* out_stream) {
+  DCHECK_NE(static_cast<core::OutStream*>(nullptr), out_stream);
+  const auto& plot_lines = info.story->plot_lines();
+
+  // Locate the linked events, which dependencies refer to, and find those that
+  // are input dependencies of others.
+  std::unordered_map<const LinkedEvent*, PackedDep> locations;
+  std::unordered_set<const LinkedEvent*> dependencies;
+  for (size_t i = 0; i < plot_lines.size(); ++i) {
+    const Story::PlotLine& plot_line = *plot_lines[i];
+    for (size_t j = 0; j < plot_line.size(); ++j) {
+      if (plot_line[j]->type() != EventInterface::kLinkedEvent)
+        continue;
+      const auto* linked_event =
+          reinterpret_cast<const LinkedEvent*>(plot_line[j]);
+      PackedDep location = {static_cast<uint32_t>(i),
+                            static_cast<uint32_t>(j)};
+      locations.insert(std::make_pair(linked_event, location));
+      dependencies.insert(linked_event->deps().begin(),
+                          linked_event->deps().end());
+    }
+  }
+
+  PackedStoryHeader header = {};
+  header.plot_line_count = static_cast<uint32_t>(plot_lines.size());
+  header.heap_count = static_cast<uint32_t>(info.existing_heaps.size());
+  header.dep_count = static_cast<uint32_t>(info.dep_count);
+  if (!WriteValue(header, out_stream) ||
+      !WriteArray(info.existing_heaps.data(), info.existing_heaps.size(),
+                  out_stream)) {
+    return false;
+  }
+
+  // Write the plot lines, their events following the dependency table.
+  uint64_t events_offset = sizeof(PackedStoryHeader) +
+                           info.existing_heaps.size() * sizeof(uint64_t) +
+                           plot_lines.size() * sizeof(PackedPlotLine) +
+                           info.dep_count * sizeof(PackedDep);
+  for (const Story::PlotLine* plot_line : plot_lines) {
+    PackedPlotLine packed_plot_line = {};
+    packed_plot_line.events_offset = events_offset;
+    packed_plot_line.event_count = static_cast<uint32_t>(plot_line->size());
+    if (!WriteValue(packed_plot_line, out_stream))
+      return false;
+    events_offset += plot_line->size() * sizeof(PackedEvent);
+  }
+
+  // Write the dependency table.
+  for (const Story::PlotLine* plot_line : plot_lines) {
+    for (const EventInterface* event : *plot_line) {
+      if (event->type() != EventInterface::kLinkedEvent)
+        continue;
+      for (const LinkedEvent* dep :
+           reinterpret_cast<const LinkedEvent*>(event)->deps()) {
+        auto it = locations.find(dep);
+        if (it == locations.end()) {
+          LOG(ERROR) << "Dependency on an event outside of the story.";
+          return false;
+        }
+        if (!WriteValue(it->second, out_stream))
+          return false;
+      }
+    }
+  }
+
+  // Write the events, in batches.
+  std::vector<PackedEvent> packed_events;
+  packed_events.reserve(kEventsPerWrite);
+  uint32_t first_dep = 0;
+  for (const Story::PlotLine* plot_line : plot_lines) {
+    for (const EventInterface* event : *plot_line) {
+      PackedEvent packed_event = {};
+      if (event->type() == EventInterface::kLinkedEvent) {
+        const auto* linked_event = reinterpret_cast<const LinkedEvent*>(event);
+        event = linked_event->event();
+        packed_event.dep_count =
+            static_cast<uint32_t>(linked_event->deps().size());
+        if (dependencies.count(linked_event))
+          packed_event.flags |= PackedEvent::kIsDependency;
+      }
+      packed_event.first_dep = first_dep;
+      first_dep += packed_event.dep_count;
+      if (!PackEvent(event, &packed_event))
+        return false;
+
+      packed_events.push_back(packed_event);
+      if (packed_events.size() == kEventsPerWrite) {
+        if (!WriteArray(packed_events.data(), packed_events.size(),
+                        out_stream)) {
+          return false;
+        }
+        packed_events.clear();
+      }
+    }
+  }
+  DCHECK_EQ(info.dep_count, first_dep);
+
+  return WriteArray(packed_events.data(), packed_events.size(), out_stream);
+}
+
+PackedStory::PackedStory()
+    : data_(nullptr),
+      size_(0),
+      heap_count_(0),
+      heaps_(nullptr),
+      plot_line_count_(0),
+      plot_lines_(nullptr),
+      dep_count_(0),
+      deps_(nullptr) {
+}
+
+bool PackedStory::Init(const uint8_t* data, size_t size) {
+  DCHECK(data != nullptr || size == 0);
+  DCHECK_EQ(static_cast<const uint8_t*>(nullptr), data_);
+
+  if (!IsAligned(data) || size < sizeof(PackedStoryHeader))
+    return false;
+  const PackedStoryHeader* header =
+      reinterpret_cast<const PackedStoryHeader*>(data);
+
+  // Locate the tables, which follow the header. The counts are 32-bit, and
+  // the sizes are computed in 64 bits so that they can't wrap on 32-bit
+  // builds.
+  uint64_t offset = sizeof(PackedStoryHeader);
+  uint64_t heaps_offset = offset;
+  offset += static_cast<uint64_t>(header->heap_count) * sizeof(uint64_t);
+  uint64_t plot_lines_offset = offset;
+  offset +=
+      static_cast<uint64_t>(header->plot_line_count) * sizeof(PackedPlotLine);
+  uint64_t deps_offset = offset;
+  offset += static_cast<uint64_t>(header->dep_count) * sizeof(PackedDep);
+  if (offset > size)
+    return false;
+
+  // Check that the events of each plot line are in bounds. They are validated
+  // as they are played.
+  const PackedPlotLine* plot_lines =
+      reinterpret_cast<const PackedPlotLine*>(data + plot_lines_offset);
+  for (size_t i = 0; i < header->plot_line_count; ++i) {
+    uint64_t events_offset = plot_lines[i].events_offset;
+    if (events_offset < offset || events_offset > size ||
+        events_offset % sizeof(uint64_t) != 0 ||
+        (size - events_offset) / sizeof(PackedEvent) <
+            plot_lines[i].event_count) {
+      return false;
+    }
+  }
+
+  data_ = data;
+  size_ = size;
+  heap_count_ = header->heap_count;
+  heaps_ = reinterpret_cast<const uint64_t*>(data + heaps_offset);
+  plot_line_count_ = header->plot_line_count;
+  plot_lines_ = plot_lines;
+  dep_count_ = header->dep_count;
+  deps_ = reinterpret_cast<const PackedDep*>(data + deps_offset);
+  return true;
+}
+
+const PackedEvent* PackedStory::GetEvents(size_t plot_line,
+                                          size_t* event_count) const {
+  DCHECK_GT(plot_line_count_, plot_line);
+  DCHECK_NE(static_cast<size_t*>(nullptr), event_count);
+  *event_count = plot_lines_[plot_line].event_count;
+  return reinterpret_cast<const PackedEvent*>(
+      data_ + plot_lines_[plot_line].events_offset);
+}
+
+const PackedDep* PackedStory::GetDeps(const PackedEvent& packed_event,
+                                      size_t* dep_count) const {
+  DCHECK_NE(static_cast<size_t*>(nullptr), dep_count);
+  if (static_cast<uint64_t>(packed_event.first_dep) + packed_event.dep_count >
+      dep_count_) {
+    return nullptr;
+  }
+  *dep_count = packed_event.dep_count;
+  return deps_ + packed_event.first_dep;
+}
+
+bool PackedStory::Unpack(Story* story) const {
+  DCHECK_NE(static_cast<Story*>(nullptr), story);
+  DCHECK(story->plot_lines().empty());
+
+  // Unpack the events, wrapping those with dependencies in linked events.
+  for (size_t i = 0; i < plot_line_count_; ++i) {
+    Story::PlotLine* plot_line = story->CreatePlotLine();
+    size_t event_count = 0;
+    const PackedEvent* packed_events = GetEvents(i, &event_count);
+    for (size_t j = 0; j < event_count; ++j) {
+      const PackedEvent& packed_event = packed_events[j];
+      std::unique_ptr<EventInterface> event = UnpackEvent(packed_event);
+      if (!event)
+        return false;
+      if ((packed_event.flags & PackedEvent::kIsDependency) != 0 ||
+          packed_event.dep_count != 0) {
+        event.reset(new LinkedEvent(std::move(event)));
+      }
+      plot_line->push_back(event.release());
+    }
+  }
+
+  // Connect the linked events.
+  for (size_t i = 0; i < plot_line_count_; ++i) {
+    Story::PlotLine* plot_line = story->plot_lines()[i];
+    size_t event_count = 0;
+    const PackedEvent* packed_events = GetEvents(i, &event_count);
+    for (size_t j = 0; j < event_count; ++j) {
+      size_t dep_count = 0;
+      const PackedDep* deps = GetDeps(packed_events[j], &dep_count);
+      if (deps == nullptr)
+        return false;
+      for (size_t k = 0; k < dep_count; ++k) {
+        if (!IsValidDep(deps[k], i, j))
+          return false;
+        auto linked_event = reinterpret_cast<LinkedEvent*>((*plot_line)[j]);
+        if (!linked_event->AddDep(
+                (*story->plot_lines()[deps[k].plot_line])[deps[k].event_index]))
+          return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool PackedStory::Play(void* backdrop) const {
+  PlotLineRunner::Progress progress(plot_line_count_);
+
+  ScopedVector<PlotLineRunner> runners;
+  for (size_t i = 0; i < plot_line_count_; ++i)
+    runners.push_back(new PlotLineRunner(backdrop, this, i, &progress));
+
+  // Start the threads. As a failure aborts all the runners, they can all be
+  // joined.
+  for (auto runner : runners)
+    runner->Start();
+  bool success = true;
+  for (auto runner : runners) {
+    runner->Join();
+    if (runner->Failed())
+      success = false;
+  }
+
+  return success;
+}
+
+bool PackedStory::IsValidDep(const PackedDep& dep,
+                             size_t plot_line,
+                             size_t event_index) const {
+  if (dep.plot_line >= plot_line_count_)
+    return false;
+  size_t event_count = 0;
+  const PackedEvent* packed_events = GetEvents(dep.plot_line, &event_count);
+  if (dep.event_index >= event_count)
+    return false;
+  if (dep.plot_line == plot_line && dep.event_index >= event_index)
+    return false;
+
+  // The progress of plot lines is only published after playing dependencies,
+  // so waiting on any other event would never complete.
+  return (packed_events[dep.event_index].flags & PackedEvent::kIsDependency) !=
+         0;
+}
+
+bool PackedStoryFile::Open(const base::FilePath& path) {
+  DCHECK(!file_.IsValid());
+  if (!file_.Initialize(path)) {
+    LOG(ERROR) << "Unable to map " << path.value() << ".";
+    return false;
+  }
+  return Init(file_.data(), file_.length());
+}
+
+bool PackedStoryFile::Init(const uint8_t* data, size_t size) {
+  DCHECK(data != nullptr || size == 0);
+  DCHECK(stories_.empty());
+
+  if (!IsAligned(data) || size < sizeof(PackedStoryFileHeader))
+    return false;
+  const PackedStoryFileHeader* header =
+      reinterpret_cast<const PackedStoryFileHeader*>(data);
+  if (header->magic != PackedStoryWriter::kPackedStoryMagic ||
+      header->version != PackedStoryWriter::kPackedStoryVersion) {
+    LOG(ERROR) << "Not a packed story file, or of an unsupported version.";
+    return false;
+  }
+  if ((size - sizeof(PackedStoryFileHeader)) / sizeof(PackedStoryEntry) <
+      header->story_count) {
+    return false;
+  }
+
+  const PackedStoryEntry* entries =
+      reinterpret_cast<const PackedStoryEntry*>(header + 1);
+  for (size_t i = 0; i < header->story_count; ++i) {
+    if (entries[i].offset > size || entries[i].size > size - entries[i].offset)
+      return false;
+    std::unique_ptr<PackedStory> story(new PackedStory());
+    if (!story->Init(data + entries[i].offset,
+                     static_cast<size_t>(entries[i].size))) {
+      LOG(ERROR) << "Invalid packed story " << i << ".";
+      stories_.clear();
+      return false;
+    }
+    stories_.push_back(story.release());
+  }
+
+  return true;
+}
+
+PackedStory::PlotLineRunner::PlotLineRunner(void* backdrop,
+                                            const PackedStory* story,
+                                            size_t plot_line,
+                                            Progress* progress)
+    : backdrop_(backdrop),
+      story_(story),
+      plot_line_(plot_line),
+      progress_(progress),
+      failed_event_(nullptr) {
+  DCHECK_NE(static_cast<const PackedStory*>(nullptr), story);
+  DCHECK_GT(story->plot_line_count(), plot_line);
+  DCHECK_NE(static_cast<Progress*>(nullptr), progress);
+}
+
+void PackedStory::PlotLineRunner::ThreadMain() {
+  base::PlatformThread::SetName("PackedPlotLineRunner");
+  RunImpl();
+}
+
+void PackedStory::PlotLineRunner::Start() {
+  DCHECK(handle_.is_null());
+  CHECK(base::PlatformThread::Create(0, this, &handle_));
+}
+
+void PackedStory::PlotLineRunner::Join() {
+  DCHECK(!handle_.is_null());
+  base::PlatformThread::Join(handle_);
+}
+
+void PackedStory::PlotLineRunner::RunImpl() {
+  size_t event_count = 0;
+  const PackedEvent* packed_events = story_->GetEvents(plot_line_,
+                                                       &event_count);
+  for (size_t i = 0; i < event_count; ++i) {
+    // Stop early if another plot line failed.
+    if (progress_->IsAborted())
+      return;
+
+    // Wait for the input dependencies to have been played.
+    const PackedEvent& packed_event = packed_events[i];
+    size_t dep_count = 0;
+    const PackedDep* deps = story_->GetDeps(packed_event, &dep_count);
+    bool valid = deps != nullptr;
+    for (size_t j = 0; valid && j < dep_count; ++j) {
+      valid = story_->IsValidDep(deps[j], plot_line_, i);
+      if (valid && !progress_->WaitForPlayed(deps[j]))
+        return;
+    }
+
+    // Materialize the event only for as long as it's being played.
+    std::unique_ptr<EventInterface> event;
+    if (valid)
+      event = UnpackEvent(packed_event);
+    if (!event || !event->Play(backdrop_)) {
+      failed_event_ = &packed_event;
+      progress_->Abort();
+      return;
+    }
+
+    if ((packed_event.flags & PackedEvent::kIsDependency) != 0)
+      progress_->SetPlayed(plot_line_, i + 1);
+  }
+}
+
+struct PackedStory::PlotLineRunner::Progress::PlotLineProgress {
+  explicit PlotLineProgress(base::Lock* lock) : played(0), cv(lock) {}
+
+  // The number of events of the plot line known to have been played.
+  size_t played;
+  // Signaled when |played| is updated.
+  base::ConditionVariable cv;
+};
+
+PackedStory::PlotLineRunner::Progress::Progress(size_t plot_line_count)
+    : aborted_(0) {
+  for (size_t i = 0; i < plot_line_count; ++i)
+    plot_lines_.push_back(new PlotLineProgress(&lock_));
+}
+
+PackedStory::PlotLineRunner::Progress::~Progress() {
+}
+
+void PackedStory::PlotLineRunner::Progress::SetPlayed(size_t plot_line,
+                                                      size_t event_count) {
+  DCHECK_GT(plot_lines_.size(), plot_line);
+  base::AutoLock auto_lock(lock_);
+  PlotLineProgress* progress = plot_lines_[plot_line];
+  DCHECK_LE(progress->played, event_count);
+  progress->played = event_count;
+  progress->cv.Broadcast();
+}
+
+bool PackedStory::PlotLineRunner::Progress::WaitForPlayed(
+    const PackedDep& dep) {
+  DCHECK_GT(plot_lines_.size(), dep.plot_line);
+  base::AutoLock auto_lock(lock_);
+  PlotLineProgress* progress = plot_lines_[dep.plot_line];
+  while (progress->played <= dep.event_index) {
+    if (IsAborted())
+      return false;
+    progress->cv.Wait();
+  }
+  return true;
+}
+
+void PackedStory::PlotLineRunner::Progress::Abort() {
+  base::AutoLock auto_lock(lock_);
+  base::subtle::Release_Store(&aborted_, 1);
+  for (auto progress : plot_lines_)
+    progress->cv.Broadcast();
+}
+
+bool PackedStory::PlotLineRunner::Progress::IsAborted() const {
+  return base::subtle::Acquire_Load(&aborted_) != 0;
+}
+
+}  // namespace bard
@@ -0,0 +1,373 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a packed, memory mappable representation of stories. Unlike the
+// archive format of Story, which needs to be entirely materialized as a graph
+// of heap allocated events before playback can start, a packed story is played
+// straight out of the file, each event being decoded just before it's played.
+//
+// The file is organized as follows, with all fields in native byte order:
+//
+// - PackedStoryFileHeader
+// - PackedStoryEntry for each story, locating the story in the file
+// - for each story, with offsets relative to the start of the story:
+//   - PackedStoryHeader
+//   - the trace addresses of the heaps existing at the start of playback, as
+//     uint64_t, the first one being the process heap
+//   - PackedPlotLine for each plot line, locating its events
+//   - the dependency table: PackedDep for each input dependency of each
+//     event, the dependencies of an event being contiguous
+//   - for each plot line, its events as a contiguous array of fixed size
+//     PackedEvent records
+//
+// Dependencies refer to events by plot line and position. As the events of a
+// plot line are played in order, a dependency is satisfied as soon as its plot
+// line has played past it, which allows dependencies to be expressed without
+// per-event synchronization objects.
+
+#ifndef SYZYGY_BARD_PACKED_STORY_H_
+#define SYZYGY_BARD_PACKED_STORY_H_
+
+#include <memory>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/memory/scoped_vector.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
+#include "syzygy/bard/event.h"
+#include "syzygy/bard/story.h"
+#include "syzygy/core/serialization.h"
+
+namespace bard {
+
+// @name On-disk structures of the packed story format.
+// @{
+struct PackedStoryFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t story_count;
+  uint32_t reserved;
+};
+
+struct PackedStoryEntry {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct PackedStoryHeader {
+  uint32_t plot_line_count;
+  uint32_t heap_count;
+  uint32_t dep_count;
+  uint32_t reserved;
+};
+
+struct PackedPlotLine {
+  uint64_t events_offset;
+  uint32_t event_count;
+  uint32_t reserved;
+};
+
+struct PackedDep {
+  uint32_t plot_line;
+  uint32_t event_index;
+};
+
+struct PackedEvent {
+  // The maximum number of arguments of an event.
+  static const size_t kMaxArgs = 5;
+
+  // @name Flags.
+  // @{
+  // Set on events that are an input dependency of another event.
+  static const uint8_t kIsDependency = 1 << 0;
+  // @}
+
+  // The EventType of this event. This is never kLinkedEvent, as dependencies
+  // are stored in the dependency table.
+  uint8_t type;
+  uint8_t flags;
+  uint16_t reserved;
+  uint32_t stack_trace_id;
+  // The range of the input dependencies of this event in the dependency
+  // table.
+  uint32_t first_dep;
+  uint32_t dep_count;
+  // The arguments and the recorded return value of the event, in the order of
+  // the arguments of its constructor, widened to 64 bits.
+  uint64_t args[kMaxArgs];
+};
+// @}
+
+static_assert(sizeof(PackedStoryFileHeader) == 16, "Unexpected size.");
+static_assert(sizeof(PackedStoryEntry) == 16, "Unexpected size.");
+static_assert(sizeof(PackedStoryHeader) == 16, "Unexpected size.");
+static_assert(sizeof(PackedPlotLine) == 16, "Unexpected size.");
+static_assert(sizeof(PackedDep) == 8, "Unexpected size.");
+static_assert(sizeof(PackedEvent) == 56, "Unexpected size.");
+
+// Packs an event into a fixed size record. The flags and the dependency fields
+// of the record are left untouched.
+// @param event the event to pack. This may not be a LinkedEvent.
+// @param packed_event the record to populate.
+// @returns true on success, false if the event is of an unknown type.
+bool PackEvent(const EventInterface* event, PackedEvent* packed_event);
+
+// Unpacks an event from its fixed size record, ignoring its dependencies.
+// @param packed_event the record to unpack.
+// @returns the unpacked event, or nullptr if the record is invalid.
+std::unique_ptr<EventInterface> UnpackEvent(const PackedEvent& packed_event);
+
+// Writes stories in the packed format. The stories are streamed to the output
+// as they are, without building an intermediate representation of them.
+class PackedStoryWriter {
+ public:
+  // Some constants used in serialization.
+  static const uint32_t kPackedStoryMagic = 0xBA4D5053;
+  static const uint32_t kPackedStoryVersion = 1;
+
+  PackedStoryWriter() {}
+
+  // Adds a story to be written.
+  // @param story the story to add. This must outlive the writer.
+  // @param existing_heaps the trace addresses of the heaps that exist at the
+  //     start of playback. The first one is the process heap.
+  void AddStory(const Story* story,
+                const std::vector<uint64_t>& existing_heaps);
+
+  // Writes the added stories.
+  // @param out_stream the stream to write to.
+  // @returns true on success, false on failure.
+  bool Write(core::OutStream* out_stream);
+
+ private:
+  struct StoryInfo {
+    const Story* story;
+    std::vector<uint64_t> existing_heaps;
+    size_t dep_count;
+    uint64_t size;
+  };
+
+  // Computes the size of a story once packed.
+  // @param info the story whose size to compute.
+  // @returns true on success, false if the story is too large to be packed.
+  bool LayOutStory(StoryInfo* info);
+
+  // Writes a story, which must have been laid out.
+  // @param info the story to write.
+  // @param out_stream the stream to write to.
+  // @returns true on success, false on failure.
+  bool WriteStory(const StoryInfo& info, core::OutStream* out_stream);
+
+  std::vector<StoryInfo> stories_;
+
+  DISALLOW_COPY_AND_ASSIGN(PackedStoryWriter);
+};
+
+// A read-only view of a story in the packed format. This doesn't own the
+// underlying data.
+class PackedStory {
+ public:
+  // PlotLine playback thread runner.
+  class PlotLineRunner;
+
+  PackedStory();
+
+  // Initializes this view over a story's data.
+  // @param data the data of the story. This must be 8-byte aligned.
+  // @param size the size of @p data.
+  // @returns true on success, false if the data is malformed.
+  bool Init(const uint8_t* data, size_t size);
+
+  // @name Accessors.
+  // @{
+  size_t plot_line_count() const { return plot_line_count_; }
+  size_t existing_heap_count() const { return heap_count_; }
+  const uint64_t* existing_heaps() const { return heaps_; }
+  // @}
+
+  // Gets the events of a plot line.
+  // @param plot_line the index of the plot line.
+  // @param event_count returns the number of events of the plot line.
+  // @returns the events of the plot line.
+  const PackedEvent* GetEvents(size_t plot_line, size_t* event_count) const;
+
+  // Gets the input dependencies of an event.
+  // @param packed_event the event. This must belong to this story.
+  // @param dep_count returns the number of dependencies of the event.
+  // @returns the dependencies of the event, or nullptr if they lie outside of
+  //     the dependency table.
+  const PackedDep* GetDeps(const PackedEvent& packed_event,
+                           size_t* dep_count) const;
+
+  // Unpacks this story, materializing all of its events and dependencies.
+  // @param story the story to populate, which must be empty.
+  // @returns true on success, false if the data is malformed.
+  bool Unpack(Story* story) const;
+
+  // Plays this story against the provided backdrop. Spins up a thread per
+  // plot line which decodes and plays back the events as fast as possible,
+  // only materializing a single event at a time.
+  // @param backdrop the backdrop to play the events against.
+  // @returns true if all events were played successfully, false otherwise.
+  bool Play(void* backdrop) const;
+
+ private:
+  // Checks that a dependency refers to an event that is played before
+  // another.
+  // @param dep the dependency to check.
+  // @param plot_line the plot line of the dependent event.
+  // @param event_index the index of the dependent event.
+  // @returns true if the dependency is valid, false otherwise.
+  bool IsValidDep(const PackedDep& dep,
+                  size_t plot_line,
+                  size_t event_index) const;
+
+  const uint8_t* data_;
+  size_t size_;
+
+  size_t heap_count_;
+  const uint64_t* heaps_;
+  size_t plot_line_count_;
+  const PackedPlotLine* plot_lines_;
+  size_t dep_count_;
+  const PackedDep* deps_;
+
+  DISALLOW_COPY_AND_ASSIGN(PackedStory);
+};
+
+// A file of packed stories. The file is memory mapped, and stays mapped for
+// the lifetime of this object.
+class PackedStoryFile {
+ public:
+  PackedStoryFile() {}
+
+  // Opens and maps a file of packed stories.
+  // @param path the file to open.
+  // @returns true on success, false if the file can't be mapped or is
+  //     malformed.
+  bool Open(const base::FilePath& path);
+
+  // Initializes from a buffer of packed stories rather than a file.
+  // @param data the data. This must be 8-byte aligned and outlive this
+  //     object.
+  // @param size the size of @p data.
+  // @returns true on success, false if the data is malformed.
+  bool Init(const uint8_t* data, size_t size);
+
+  // @name Accessors.
+  // @{
+  size_t story_count() const { return stories_.size(); }
+  const PackedStory* story(size_t index) const { return stories_[index]; }
+  // @}
+
+ private:
+  base::MemoryMappedFile file_;
+  ScopedVector<PackedStory> stories_;
+
+  DISALLOW_COPY_AND_ASSIGN(PackedStoryFile);
+};
+
+// Thread main body for playing back the events of a packed plot line. Events
+// are decoded one at a time as they are played. Unlike with
+// Story::PlotLineRunner, a failure aborts the playback of the other plot lines,
+// including those waiting on a dependency, so that all the runners of a story
+// are always joinable.
+class PackedStory::PlotLineRunner : public base::PlatformThread::Delegate {
+ public:
+  // Playback state shared between the runners of a story.
+  class Progress;
+
+  // Constructor.
+  // @param backdrop the backdrop to play the events against.
+  // @param story the story being played.
+  // @param plot_line the index of the plot line to play.
+  // @param progress the playback state shared by the runners of @p story.
+  PlotLineRunner(void* backdrop,
+                 const PackedStory* story,
+                 size_t plot_line,
+                 Progress* progress);
+  ~PlotLineRunner() override {}
+
+  // @returns true if the playback failed.
+  bool Failed() const { return failed_event_ != nullptr; }
+
+  // @returns the record of the event that failed during playback, if an event
+  //     failed.
+  const PackedEvent* failed_event() const { return failed_event_; }
+
+  // Implementation of PlatformThread::Delegate.
+  void ThreadMain() override;
+
+  // For starting and stopping the thread.
+  void Start();
+  void Join();
+
+ private:
+  void RunImpl();
+
+  void* backdrop_;
+  const PackedStory* story_;
+  size_t plot_line_;
+  Progress* progress_;
+
+  // If an error occurs, this is left pointing at the event that failed.
+  // Useful for debugging.
+  const PackedEvent* failed_event_;
+
+  base::PlatformThreadHandle handle_;
+
+  DISALLOW_COPY_AND_ASSIGN(PlotLineRunner);
+};
+
+// Keeps track of how far each plot line of a story has been played.
+class PackedStory::PlotLineRunner::Progress {
+ public:
+  // @param plot_line_count the number of plot lines of the story.
+  explicit Progress(size_t plot_line_count);
+  ~Progress();
+
+  // Records that the events of a plot line before @p event_count have been
+  // played, waking up the runners waiting on them.
+  // @param plot_line the plot line.
+  // @param event_count the number of events played.
+  void SetPlayed(size_t plot_line, size_t event_count);
+
+  // Waits for an event to have been played.
+  // @param dep the event to wait for.
+  // @returns true once the event has been played, false if playback was
+  //     aborted first.
+  bool WaitForPlayed(const PackedDep& dep);
+
+  // Aborts playback, waking up all waiting runners.
+  void Abort();
+
+  // @returns true if playback was aborted.
+  bool IsAborted() const;
+
+ private:
+  struct PlotLineProgress;
+
+  base::Lock lock_;
+  base::subtle::Atomic32 aborted_;
+  ScopedVector<PlotLineProgress> plot_lines_;
+
+  DISALLOW_COPY_AND_ASSIGN(Progress);
+};
+
+}  // namespace bard
+
+#endif  // SYZYGY_BARD_PACKED_STORY_H_
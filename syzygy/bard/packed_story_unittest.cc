@@ -0,0 +1,357 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/bard/packed_story.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_file.h"
+#include "base/files/scoped_temp_dir.h"
+#include "gtest/gtest.h"
+#include "syzygy/bard/backdrops/heap_backdrop.h"
+#include "syzygy/bard/events/heap_alloc_event.h"
+#include "syzygy/bard/events/heap_create_event.h"
+#include "syzygy/bard/events/heap_destroy_event.h"
+#include "syzygy/bard/events/heap_free_event.h"
+#include "syzygy/bard/events/heap_realloc_event.h"
+#include "syzygy/bard/events/heap_set_information_event.h"
+#include "syzygy/bard/events/heap_size_event.h"
+#include "syzygy/bard/events/linked_event.h"
+
+namespace bard {
+
+namespace {
+
+using backdrops::HeapBackdrop;
+using events::HeapAllocEvent;
+using events::HeapCreateEvent;
+using events::HeapDestroyEvent;
+using events::HeapFreeEvent;
+using events::HeapReAllocEvent;
+using events::HeapSetInformationEvent;
+using events::HeapSizeEvent;
+using events::LinkedEvent;
+
+const HANDLE kTraceHeap = reinterpret_cast<HANDLE>(0xAB12CD34);
+const LPVOID kTraceAlloc = reinterpret_cast<LPVOID>(0xF1D97AE4);
+const LPVOID kTraceAlloc2 = reinterpret_cast<LPVOID>(0xF1D97AF0);
+const LPVOID kTraceRealloc = reinterpret_cast<LPVOID>(0xF1D97B00);
+const DWORD kFlags = 0;
+const DWORD kOptions = 0;
+const SIZE_T kBytes = 100;
+const SIZE_T kReallocBytes = 200;
+const SIZE_T kInitialSize = 0;
+const SIZE_T kMaximumSize = 0;
+
+// Forwarders to the heap API, to be bound to the backdrop.
+LPVOID HeapAllocForwarder(HANDLE heap, DWORD flags, SIZE_T bytes) {
+  return ::HeapAlloc(heap, flags, bytes);
+}
+HANDLE HeapCreateForwarder(DWORD options,
+                           SIZE_T initial_size,
+                           SIZE_T maximum_size) {
+  return ::HeapCreate(options, initial_size, maximum_size);
+}
+BOOL HeapDestroyForwarder(HANDLE heap) {
+  return ::HeapDestroy(heap);
+}
+BOOL HeapFreeForwarder(HANDLE heap, DWORD flags, LPVOID mem) {
+  return ::HeapFree(heap, flags, mem);
+}
+LPVOID HeapReAllocForwarder(HANDLE heap,
+                            DWORD flags,
+                            LPVOID mem,
+                            SIZE_T bytes) {
+  return ::HeapReAlloc(heap, flags, mem, bytes);
+}
+SIZE_T HeapSizeForwarder(HANDLE heap, DWORD flags, LPCVOID mem) {
+  return ::HeapSize(heap, flags, mem);
+}
+
+class PackedStoryTest : public testing::Test {
+ public:
+  void SetUp() override {
+    backdrop_.set_heap_alloc(base::Bind(&HeapAllocForwarder));
+    backdrop_.set_heap_create(base::Bind(&HeapCreateForwarder));
+    backdrop_.set_heap_destroy(base::Bind(&HeapDestroyForwarder));
+    backdrop_.set_heap_free(base::Bind(&HeapFreeForwarder));
+    backdrop_.set_heap_realloc(base::Bind(&HeapReAllocForwarder));
+    backdrop_.set_heap_size(base::Bind(&HeapSizeForwarder));
+  }
+
+  void TearDown() override { EXPECT_TRUE(backdrop_.TearDown()); }
+
+  // Builds a story where one plot line creates and destroys a heap, and
+  // another one uses it.
+  // @param free_succeeded the recorded outcome of the free of the
+  //     allocation. If this is false the playback fails.
+  void BuildStory(bool free_succeeded) {
+    std::unique_ptr<LinkedEvent> create(new LinkedEvent(
+        std::unique_ptr<EventInterface>(new HeapCreateEvent(
+            0, kOptions, kInitialSize, kMaximumSize, kTraceHeap))));
+    std::unique_ptr<LinkedEvent> alloc(
+        new LinkedEvent(std::unique_ptr<EventInterface>(
+            new HeapAllocEvent(0, kTraceHeap, kFlags, kBytes, kTraceAlloc))));
+    std::unique_ptr<LinkedEvent> free(
+        new LinkedEvent(std::unique_ptr<EventInterface>(new HeapFreeEvent(
+            0, kTraceHeap, kFlags, kTraceRealloc, free_succeeded))));
+    std::unique_ptr<LinkedEvent> destroy(
+        new LinkedEvent(std::unique_ptr<EventInterface>(
+            new HeapDestroyEvent(0, kTraceHeap, true))));
+    alloc->AddDep(create.get());
+    destroy->AddDep(free.get());
+
+    Story::PlotLine* plot_line1 = story_.CreatePlotLine();
+    plot_line1->push_back(create.release());
+    plot_line1->push_back(
+        new HeapAllocEvent(0, kTraceHeap, kFlags, kBytes, kTraceAlloc2));
+    plot_line1->push_back(
+        new HeapFreeEvent(0, kTraceHeap, kFlags, kTraceAlloc2, true));
+    plot_line1->push_back(destroy.release());
+
+    Story::PlotLine* plot_line2 = story_.CreatePlotLine();
+    plot_line2->push_back(alloc.release());
+    plot_line2->push_back(
+        new HeapSizeEvent(0, kTraceHeap, kFlags, kTraceAlloc, kBytes));
+    plot_line2->push_back(new HeapReAllocEvent(
+        0, kTraceHeap, kFlags, kTraceAlloc, kReallocBytes, kTraceRealloc));
+    plot_line2->push_back(free.release());
+  }
+
+  // Packs story_ to data_.
+  void PackStory() {
+    std::vector<uint64_t> existing_heaps;
+    existing_heaps.push_back(0x1000);
+    existing_heaps.push_back(0x2000);
+
+    PackedStoryWriter writer;
+    writer.AddStory(&story_, existing_heaps);
+    core::ScopedOutStreamPtr out_stream(
+        core::CreateByteOutStream(std::back_inserter(data_)));
+    ASSERT_TRUE(writer.Write(out_stream.get()));
+  }
+
+ protected:
+  HeapBackdrop backdrop_;
+  Story story_;
+  core::ByteVector data_;
+};
+
+// An event that can't be packed.
+class UnpackableEvent : public EventInterface {
+ public:
+  EventType type() const override { return EventType::kMaxEventType; }
+  bool Play(void* backdrop) override { return true; }
+  bool Equals(const EventInterface*) const override { return false; }
+};
+
+}  // namespace
+
+TEST_F(PackedStoryTest, PackUnpackEvents) {
+  std::vector<std::unique_ptr<EventInterface>> events;
+  events.push_back(std::unique_ptr<EventInterface>(
+      new HeapAllocEvent(1, kTraceHeap, kFlags, kBytes, kTraceAlloc)));
+  events.push_back(std::unique_ptr<EventInterface>(new HeapCreateEvent(
+      2, kOptions, kInitialSize, kMaximumSize, kTraceHeap)));
+  events.push_back(
+      std::unique_ptr<EventInterface>(new HeapDestroyEvent(3, kTraceHeap, 1)));
+  events.push_back(std::unique_ptr<EventInterface>(
+      new HeapFreeEvent(4, kTraceHeap, kFlags, kTraceAlloc, 1)));
+  events.push_back(std::unique_ptr<EventInterface>(new HeapReAllocEvent(
+      5, kTraceHeap, kFlags, kTraceAlloc, kBytes, kTraceRealloc)));
+  events.push_back(std::unique_ptr<EventInterface>(new HeapSetInformationEvent(
+      6, kTraceHeap, HeapCompatibilityInformation, kTraceAlloc, kBytes, 1)));
+  events.push_back(std::unique_ptr<EventInterface>(
+      new HeapSizeEvent(7, kTraceHeap, kFlags, kTraceAlloc, kBytes)));
+
+  for (const auto& event : events) {
+    PackedEvent packed_event = {};
+    ASSERT_TRUE(PackEvent(event.get(), &packed_event));
+    EXPECT_EQ(event->type(), packed_event.type);
+    std::unique_ptr<EventInterface> unpacked_event = UnpackEvent(packed_event);
+    ASSERT_TRUE(unpacked_event.get());
+    EXPECT_TRUE(event->Equals(unpacked_event.get()));
+  }
+
+  UnpackableEvent unpackable_event;
+  PackedEvent packed_event = {};
+  EXPECT_FALSE(PackEvent(&unpackable_event, &packed_event));
+  packed_event.type = EventInterface::kLinkedEvent;
+  EXPECT_FALSE(UnpackEvent(packed_event).get());
+}
+
+TEST_F(PackedStoryTest, RoundTrip) {
+  ASSERT_NO_FATAL_FAILURE(BuildStory(true));
+  ASSERT_NO_FATAL_FAILURE(PackStory());
+
+  PackedStoryFile file;
+  ASSERT_TRUE(file.Init(data_.data(), data_.size()));
+  ASSERT_EQ(1u, file.story_count());
+  const PackedStory* packed_story = file.story(0);
+  ASSERT_EQ(2u, packed_story->existing_heap_count());
+  EXPECT_EQ(0x1000u, packed_story->existing_heaps()[0]);
+  EXPECT_EQ(0x2000u, packed_story->existing_heaps()[1]);
+  ASSERT_EQ(2u, packed_story->plot_line_count());
+
+  // The dependencies of the heap destruction are in the side table.
+  size_t event_count = 0;
+  const PackedEvent* events = packed_story->GetEvents(0, &event_count);
+  ASSERT_EQ(4u, event_count);
+  EXPECT_EQ(PackedEvent::kIsDependency, events[0].flags);
+  EXPECT_EQ(0u, events[1].flags);
+  EXPECT_EQ(0u, events[1].dep_count);
+  size_t dep_count = 0;
+  const PackedDep* deps = packed_story->GetDeps(events[3], &dep_count);
+  ASSERT_TRUE(deps);
+  ASSERT_EQ(1u, dep_count);
+  EXPECT_EQ(1u, deps[0].plot_line);
+  EXPECT_EQ(3u, deps[0].event_index);
+
+  Story unpacked_story;
+  ASSERT_TRUE(packed_story->Unpack(&unpacked_story));
+  EXPECT_TRUE(story_ == unpacked_story);
+}
+
+TEST_F(PackedStoryTest, MappedFile) {
+  ASSERT_NO_FATAL_FAILURE(BuildStory(true));
+
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().AppendASCII("story.bin");
+  {
+    base::ScopedFILE file(base::OpenFile(path, "wb"));
+    ASSERT_TRUE(file.get());
+    core::FileOutStream out_stream(file.get());
+    PackedStoryWriter writer;
+    writer.AddStory(&story_, std::vector<uint64_t>());
+    writer.AddStory(&story_, std::vector<uint64_t>());
+    ASSERT_TRUE(writer.Write(&out_stream));
+    ASSERT_TRUE(out_stream.Flush());
+  }
+
+  PackedStoryFile file;
+  ASSERT_TRUE(file.Open(path));
+  ASSERT_EQ(2u, file.story_count());
+  for (size_t i = 0; i < file.story_count(); ++i) {
+    EXPECT_EQ(0u, file.story(i)->existing_heap_count());
+    Story unpacked_story;
+    ASSERT_TRUE(file.story(i)->Unpack(&unpacked_story));
+    EXPECT_TRUE(story_ == unpacked_story);
+  }
+}
+
+TEST_F(PackedStoryTest, RejectsUnpackableStories) {
+  story_.CreatePlotLine()->push_back(new UnpackableEvent());
+  PackedStoryWriter writer;
+  writer.AddStory(&story_, std::vector<uint64_t>());
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(data_)));
+  EXPECT_FALSE(writer.Write(out_stream.get()));
+}
+
+TEST_F(PackedStoryTest, RejectsInvalidData) {
+  ASSERT_NO_FATAL_FAILURE(BuildStory(true));
+  ASSERT_NO_FATAL_FAILURE(PackStory());
+
+  // Truncated data is rejected.
+  for (size_t size = 0; size < data_.size(); size += sizeof(uint64_t)) {
+    PackedStoryFile file;
+    EXPECT_FALSE(file.Init(data_.data(), size));
+  }
+
+  // So is data with a bad header.
+  data_[0] ^= 0xFF;
+  PackedStoryFile file;
+  EXPECT_FALSE(file.Init(data_.data(), data_.size()));
+}
+
+TEST_F(PackedStoryTest, RejectsOversizedHeaders) {
+  ASSERT_NO_FATAL_FAILURE(BuildStory(true));
+  ASSERT_NO_FATAL_FAILURE(PackStory());
+
+  // Locate the header of the single story.
+  ASSERT_LE(sizeof(PackedStoryFileHeader) + sizeof(PackedStoryEntry),
+            data_.size());
+  PackedStoryEntry entry = {};
+  ::memcpy(&entry, data_.data() + sizeof(PackedStoryFileHeader),
+           sizeof(entry));
+  ASSERT_LE(entry.offset + sizeof(PackedStoryHeader), data_.size());
+  size_t header_offset = static_cast<size_t>(entry.offset);
+  PackedStoryHeader header = {};
+  ::memcpy(&header, data_.data() + header_offset, sizeof(header));
+
+  // Counts whose table sizes are multiples of 2^32, which wrap to zero when
+  // computed with a 32-bit size_t.
+  PackedStoryHeader oversized_headers[] = {header, header, header};
+  oversized_headers[0].plot_line_count = 0x10000000;
+  oversized_headers[1].heap_count = 0x20000000;
+  oversized_headers[2].dep_count = 0x20000000;
+
+  for (const PackedStoryHeader& oversized_header : oversized_headers) {
+    core::ByteVector data(data_);
+    ::memcpy(data.data() + header_offset, &oversized_header,
+             sizeof(oversized_header));
+    PackedStoryFile file;
+    EXPECT_FALSE(file.Init(data.data(), data.size()));
+  }
+}
+
+TEST_F(PackedStoryTest, PlaybackSucceeds) {
+  ASSERT_NO_FATAL_FAILURE(BuildStory(true));
+  ASSERT_NO_FATAL_FAILURE(PackStory());
+
+  PackedStoryFile file;
+  ASSERT_TRUE(file.Init(data_.data(), data_.size()));
+
+  // The plot lines only succeed if the dependencies are honored. Play the
+  // story repeatedly to give races a chance to show up.
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_TRUE(file.story(0)->Play(&backdrop_));
+    EXPECT_TRUE(backdrop_.heap_map().trace_live().empty());
+    EXPECT_TRUE(backdrop_.alloc_map().trace_live().empty());
+  }
+}
+
+TEST_F(PackedStoryTest, PlaybackStopsAndFails) {
+  // The free fails to play, which aborts the plot line waiting on it.
+  ASSERT_NO_FATAL_FAILURE(BuildStory(false));
+  ASSERT_NO_FATAL_FAILURE(PackStory());
+
+  PackedStoryFile file;
+  ASSERT_TRUE(file.Init(data_.data(), data_.size()));
+  EXPECT_FALSE(file.story(0)->Play(&backdrop_));
+}
+
+TEST_F(PackedStoryTest, RunnerStopsWhenAborted) {
+  ASSERT_NO_FATAL_FAILURE(BuildStory(true));
+  ASSERT_NO_FATAL_FAILURE(PackStory());
+
+  PackedStoryFile file;
+  ASSERT_TRUE(file.Init(data_.data(), data_.size()));
+
+  // A runner of an aborted playback stops without failing.
+  PackedStory::PlotLineRunner::Progress progress(2);
+  progress.Abort();
+  EXPECT_TRUE(progress.IsAborted());
+  PackedStory::PlotLineRunner runner(&backdrop_, file.story(0), 0, &progress);
+  runner.Start();
+  runner.Join();
+  EXPECT_FALSE(runner.Failed());
+  EXPECT_EQ(nullptr, runner.failed_event());
+  EXPECT_TRUE(backdrop_.heap_map().trace_live().empty());
+}
+
+}  // namespace bard
@@ -18,7 +18,10 @@
 #define SYZYGY_BARD_TRACE_LIVE_MAP_H_
 
 #include <map>
+#include <memory>
+#include <unordered_map>
 
+#include "base/macros.h"
 #include "base/synchronization/lock.h"
 
 namespace bard {
@@ -27,12 +30,24 @@ namespace bard {
 // from trace file pointers to live pointers, since the addresses for the
 // live ones are not the same.
 // This class is thread safe for simultaneous access accross multiple threads.
+// To limit contention between the threads replaying a story, the mappings are
+// spread over a number of shards, each with its own lock and hash maps. A
+// trace pointer and a live pointer are each kept in the shard they hash to, so
+// lookups only lock a single shard, and adding or removing a mapping locks at
+// most two.
 // @tparam T The type of object that the class is mapping.
 template <typename T>
 class TraceLiveMap {
  public:
   using Map = std::map<T, T>;
 
+  // The default number of shards.
+  static const size_t kDefaultShardCount = 64;
+
+  // @param shard_count the number of shards to spread the mappings over. A
+  //     single shard serializes all accesses.
+  explicit TraceLiveMap(size_t shard_count = kDefaultShardCount);
+
   bool AddMapping(T trace, T live);
   bool RemoveMapping(T trace, T live);
 
@@ -43,19 +58,42 @@ class TraceLiveMap {
   void Clear();
 
   // @returns true iff this map is empty.
-  bool Empty() const { return trace_live_.empty() && live_trace_.empty(); }
+  bool Empty() const;
 
-  // @name Simple accessors.
+  // @name Snapshot accessors.
+  // These lock every shard, so they're meant for tests and teardown rather
+  // than for use while replaying.
   // @{
-  const Map& trace_live() const { return trace_live_; }
-  const Map& live_trace() const { return live_trace_; }
+  Map trace_live() const;
+  Map live_trace() const;
   // @}
 
+  // @returns the number of shards.
+  size_t shard_count() const { return shard_count_; }
+
  private:
-  Map trace_live_;
-  Map live_trace_;
+  using HashMap = std::unordered_map<T, T>;
+
+  // A shard of the map. It holds the trace to live mappings of the trace
+  // pointers that hash to it, and the live to trace mappings of the live
+  // pointers that hash to it.
+  struct Shard {
+    mutable base::Lock lock;
+    HashMap trace_live;
+    HashMap live_trace;
+  };
+
+  // Holds the locks of the shards of a trace pointer and a live pointer,
+  // acquiring them in a consistent order.
+  class AutoShardLocks;
+
+  // @returns the index of the shard @p value hashes to.
+  size_t GetShardIndex(T value) const;
+
+  size_t shard_count_;
+  std::unique_ptr<Shard[]> shards_;
 
-  base::Lock lock_;
+  DISALLOW_COPY_AND_ASSIGN(TraceLiveMap);
 };
 
 }  // namespace bard
@@ -15,30 +15,74 @@
 #ifndef SYZYGY_BARD_TRACE_LIVE_MAP_IMPL_H_
 #define SYZYGY_BARD_TRACE_LIVE_MAP_IMPL_H_
 
+#include <stdint.h>
+
+#include <functional>
+#include <utility>
+
 #include "base/logging.h"
 
 namespace bard {
 
+template <typename T>
+class TraceLiveMap<T>::AutoShardLocks {
+ public:
+  AutoShardLocks(const Shard* trace_shard, const Shard* live_shard)
+      : first_(trace_shard), second_(live_shard) {
+    DCHECK(trace_shard);
+    DCHECK(live_shard);
+
+    // The shards are locked in address order to avoid lock inversions.
+    if (second_ < first_)
+      std::swap(first_, second_);
+    first_->lock.Acquire();
+    if (second_ != first_)
+      second_->lock.Acquire();
+  }
+
+  ~AutoShardLocks() {
+    if (second_ != first_)
+      second_->lock.Release();
+    first_->lock.Release();
+  }
+
+ private:
+  const Shard* first_;
+  const Shard* second_;
+
+  DISALLOW_COPY_AND_ASSIGN(AutoShardLocks);
+};
+
+template <typename T>
+TraceLiveMap<T>::TraceLiveMap(size_t shard_count)
+    : shard_count_(shard_count), shards_(new Shard[shard_count]) {
+  DCHECK_LT(0U, shard_count);
+}
+
 template <typename T>
 bool TraceLiveMap<T>::AddMapping(T trace, T live) {
   DCHECK((trace == nullptr) == (live == nullptr));
   if (trace == nullptr && live == nullptr)
     return true;
 
-  base::AutoLock auto_lock(lock_);
+  Shard& trace_shard = shards_[GetShardIndex(trace)];
+  Shard& live_shard = shards_[GetShardIndex(live)];
+  AutoShardLocks auto_locks(&trace_shard, &live_shard);
 
-  auto insert_trace_live = trace_live_.insert(std::make_pair(trace, live));
+  auto insert_trace_live =
+      trace_shard.trace_live.insert(std::make_pair(trace, live));
 
   if (!insert_trace_live.second) {
     LOG(ERROR) << "Trace argument was previously added: " << trace;
     return false;
   }
 
-  auto insert_live_trace = live_trace_.insert(std::make_pair(live, trace));
+  auto insert_live_trace =
+      live_shard.live_trace.insert(std::make_pair(live, trace));
 
   if (!insert_live_trace.second) {
     LOG(ERROR) << "Live argument was previously added: " << live;
-    trace_live_.erase(insert_trace_live.first);
+    trace_shard.trace_live.erase(insert_trace_live.first);
     return false;
   }
 
@@ -51,23 +95,25 @@ bool TraceLiveMap<T>::RemoveMapping(T trace, T live) {
   if (trace == nullptr && live == nullptr)
     return true;
 
-  base::AutoLock auto_lock(lock_);
+  Shard& trace_shard = shards_[GetShardIndex(trace)];
+  Shard& live_shard = shards_[GetShardIndex(live)];
+  AutoShardLocks auto_locks(&trace_shard, &live_shard);
 
-  auto find_trace_live = trace_live_.find(trace);
-  auto find_live_trace = live_trace_.find(live);
+  auto find_trace_live = trace_shard.trace_live.find(trace);
+  auto find_live_trace = live_shard.live_trace.find(live);
 
-  if (find_trace_live == trace_live_.end()) {
+  if (find_trace_live == trace_shard.trace_live.end()) {
     LOG(ERROR) << "Trace was not previously added:" << trace;
     return false;
   }
 
-  if (find_live_trace == live_trace_.end()) {
+  if (find_live_trace == live_shard.live_trace.end()) {
     LOG(ERROR) << "Live was not previously added: " << live;
     return false;
   }
 
-  trace_live_.erase(find_trace_live);
-  live_trace_.erase(find_live_trace);
+  trace_shard.trace_live.erase(find_trace_live);
+  live_shard.live_trace.erase(find_live_trace);
   return true;
 }
 
@@ -79,10 +125,11 @@ bool TraceLiveMap<T>::GetLiveFromTrace(T trace, T* live) {
     return true;
   }
 
-  base::AutoLock auto_lock(lock_);
+  Shard& shard = shards_[GetShardIndex(trace)];
+  base::AutoLock auto_lock(shard.lock);
 
-  auto live_it = trace_live_.find(trace);
-  if (live_it == trace_live_.end()) {
+  auto live_it = shard.trace_live.find(trace);
+  if (live_it == shard.trace_live.end()) {
     LOG(ERROR) << "Trace argument was not previously added: " << trace;
     return false;
   }
@@ -99,10 +146,11 @@ bool TraceLiveMap<T>::GetTraceFromLive(T live, T* trace) {
     return true;
   }
 
-  base::AutoLock auto_lock(lock_);
+  Shard& shard = shards_[GetShardIndex(live)];
+  base::AutoLock auto_lock(shard.lock);
 
-  auto trace_it = live_trace_.find(live);
-  if (trace_it == live_trace_.end()) {
+  auto trace_it = shard.live_trace.find(live);
+  if (trace_it == shard.live_trace.end()) {
     LOG(ERROR) << "Live argument was not previously added: " << live;
     return false;
   }
@@ -113,8 +161,54 @@ bool TraceLiveMap<T>::GetTraceFromLive(T live, T* trace) {
 
 template <typename T>
 void TraceLiveMap<T>::Clear() {
-  trace_live_.clear();
-  live_trace_.clear();
+  for (size_t i = 0; i < shard_count_; ++i) {
+    base::AutoLock auto_lock(shards_[i].lock);
+    shards_[i].trace_live.clear();
+    shards_[i].live_trace.clear();
+  }
+}
+
+template <typename T>
+bool TraceLiveMap<T>::Empty() const {
+  for (size_t i = 0; i < shard_count_; ++i) {
+    base::AutoLock auto_lock(shards_[i].lock);
+    if (!shards_[i].trace_live.empty() || !shards_[i].live_trace.empty())
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+typename TraceLiveMap<T>::Map TraceLiveMap<T>::trace_live() const {
+  Map trace_live;
+  for (size_t i = 0; i < shard_count_; ++i) {
+    base::AutoLock auto_lock(shards_[i].lock);
+    trace_live.insert(shards_[i].trace_live.begin(),
+                      shards_[i].trace_live.end());
+  }
+  return trace_live;
+}
+
+template <typename T>
+typename TraceLiveMap<T>::Map TraceLiveMap<T>::live_trace() const {
+  Map live_trace;
+  for (size_t i = 0; i < shard_count_; ++i) {
+    base::AutoLock auto_lock(shards_[i].lock);
+    live_trace.insert(shards_[i].live_trace.begin(),
+                      shards_[i].live_trace.end());
+  }
+  return live_trace;
+}
+
+template <typename T>
+size_t TraceLiveMap<T>::GetShardIndex(T value) const {
+  // The low bits of heap pointers and handles are mostly constant, so mix the
+  // hash before picking a shard with it.
+  uint32_t hash = static_cast<uint32_t>(std::hash<T>()(value));
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6BU;
+  hash ^= hash >> 13;
+  return hash % shard_count_;
 }
 
 }  // namespace bard
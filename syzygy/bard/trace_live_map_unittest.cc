@@ -14,14 +14,112 @@
 
 #include "syzygy/bard/trace_live_map.h"
 
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/logging.h"
+#include "base/macros.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/bard/unittest_util.h"
 
 namespace bard {
 
+namespace {
+
+// Replays the pointer mappings made by the allocations, reallocations and
+// frees of a plot line. Each plot line maps distinct pointers.
+class PlotLineSimulator : public base::DelegateSimpleThread::Delegate {
+ public:
+  PlotLineSimulator(TraceLiveMap<void*>* trace_live_map,
+                    size_t plot_line,
+                    size_t allocation_count)
+      : trace_live_map_(trace_live_map),
+        plot_line_(plot_line),
+        allocation_count_(allocation_count),
+        succeeded_(true) {}
+
+  void Run() override {
+    for (size_t i = 0; i < allocation_count_; ++i) {
+      // HeapAlloc.
+      void* trace = MakePointer(0x10000000, i);
+      void* live = MakePointer(0x20000000, i);
+      if (!trace_live_map_->AddMapping(trace, live))
+        succeeded_ = false;
+
+      // HeapReAlloc.
+      void* mapped_live = nullptr;
+      if (!trace_live_map_->GetLiveFromTrace(trace, &mapped_live) ||
+          mapped_live != live ||
+          !trace_live_map_->RemoveMapping(trace, live)) {
+        succeeded_ = false;
+      }
+      void* new_trace = MakePointer(0x30000000, i);
+      void* new_live = MakePointer(0x40000000, i);
+      if (!trace_live_map_->AddMapping(new_trace, new_live))
+        succeeded_ = false;
+
+      // HeapFree.
+      if (!trace_live_map_->GetLiveFromTrace(new_trace, &mapped_live) ||
+          mapped_live != new_live ||
+          !trace_live_map_->RemoveMapping(new_trace, new_live)) {
+        succeeded_ = false;
+      }
+    }
+  }
+
+  bool succeeded() const { return succeeded_; }
+
+ private:
+  // @returns a heap-like pointer that is unique to this plot line.
+  void* MakePointer(uintptr_t base, size_t index) const {
+    return reinterpret_cast<void*>(base + (plot_line_ << 20) + index * 16);
+  }
+
+  TraceLiveMap<void*>* trace_live_map_;
+  size_t plot_line_;
+  size_t allocation_count_;
+  bool succeeded_;
+
+  DISALLOW_COPY_AND_ASSIGN(PlotLineSimulator);
+};
+
+// Runs @p thread_count plot line simulators concurrently on @p trace_live_map.
+// @returns the time taken.
+base::TimeDelta SimulatePlotLines(TraceLiveMap<void*>* trace_live_map,
+                                  size_t thread_count,
+                                  size_t allocation_count) {
+  ScopedVector<PlotLineSimulator> simulators;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (size_t i = 0; i < thread_count; ++i) {
+    simulators.push_back(
+        new PlotLineSimulator(trace_live_map, i, allocation_count));
+    threads.push_back(
+        new base::DelegateSimpleThread(simulators.back(), "PlotLine"));
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (auto thread : threads)
+    thread->Start();
+  for (auto thread : threads)
+    thread->Join();
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+  for (auto simulator : simulators)
+    EXPECT_TRUE(simulator->succeeded());
+  return elapsed;
+}
+
+}  // namespace
+
 TEST(TraceLiveMapTest, TestMapping) {
   TraceLiveMap<void*> trace_live_map;
   EXPECT_TRUE(trace_live_map.Empty());
+  EXPECT_EQ(TraceLiveMap<void*>::kDefaultShardCount,
+            trace_live_map.shard_count());
 
   void* trace = reinterpret_cast<void*>(0xAB11CD22);
   void* extra_trace = reinterpret_cast<void*>(0x13213221);
@@ -45,4 +143,71 @@ TEST(TraceLiveMapTest, TestMapping) {
   testing::CheckTraceLiveMapNotContain(trace_live_map, trace, live);
 }
 
+TEST(TraceLiveMapTest, TestSnapshots) {
+  TraceLiveMap<void*> trace_live_map;
+
+  // Add enough mappings to cover several shards.
+  const size_t kMappingCount = 1000;
+  for (size_t i = 1; i <= kMappingCount; ++i) {
+    ASSERT_TRUE(trace_live_map.AddMapping(reinterpret_cast<void*>(i * 16),
+                                          reinterpret_cast<void*>(i * 32)));
+  }
+
+  TraceLiveMap<void*>::Map trace_live = trace_live_map.trace_live();
+  TraceLiveMap<void*>::Map live_trace = trace_live_map.live_trace();
+  ASSERT_EQ(kMappingCount, trace_live.size());
+  ASSERT_EQ(kMappingCount, live_trace.size());
+  for (size_t i = 1; i <= kMappingCount; ++i) {
+    EXPECT_EQ(reinterpret_cast<void*>(i * 32),
+              trace_live[reinterpret_cast<void*>(i * 16)]);
+    EXPECT_EQ(reinterpret_cast<void*>(i * 16),
+              live_trace[reinterpret_cast<void*>(i * 32)]);
+  }
+
+  trace_live_map.Clear();
+  EXPECT_TRUE(trace_live_map.Empty());
+  EXPECT_TRUE(trace_live_map.trace_live().empty());
+  EXPECT_TRUE(trace_live_map.live_trace().empty());
+}
+
+TEST(TraceLiveMapTest, TestSingleShard) {
+  TraceLiveMap<void*> trace_live_map(1);
+  EXPECT_EQ(1U, trace_live_map.shard_count());
+
+  void* trace = reinterpret_cast<void*>(0xAB11CD22);
+  void* live = reinterpret_cast<void*>(0xCC9437A2);
+  EXPECT_TRUE(trace_live_map.AddMapping(trace, live));
+  testing::CheckTraceLiveMapContains(trace_live_map, trace, live);
+  EXPECT_TRUE(trace_live_map.RemoveMapping(trace, live));
+  EXPECT_TRUE(trace_live_map.Empty());
+}
+
+TEST(TraceLiveMapTest, TestConcurrentMappings) {
+  TraceLiveMap<void*> trace_live_map;
+  SimulatePlotLines(&trace_live_map, 4, 1000);
+  EXPECT_TRUE(trace_live_map.Empty());
+}
+
+// Compares the throughput of replaying the mappings of several plot lines at
+// once with a single shard, which serializes all accesses, and with the
+// default number of shards.
+TEST(TraceLiveMapTest, DISABLED_ReplayThroughputBenchmark) {
+  const size_t kThreadCounts[] = {1, 2, 4, 8};
+  const size_t kShardCounts[] = {1, TraceLiveMap<void*>::kDefaultShardCount};
+  const size_t kAllocationCount = 100000;
+  for (size_t i = 0; i < arraysize(kShardCounts); ++i) {
+    for (size_t j = 0; j < arraysize(kThreadCounts); ++j) {
+      TraceLiveMap<void*> trace_live_map(kShardCounts[i]);
+      base::TimeDelta elapsed = SimulatePlotLines(
+          &trace_live_map, kThreadCounts[j], kAllocationCount);
+
+      // Each allocation replays 3 events.
+      double events = 3.0 * kThreadCounts[j] * kAllocationCount;
+      LOG(INFO) << kShardCounts[i] << " shards, " << kThreadCounts[j]
+                << " threads: " << elapsed.InMillisecondsF() << " ms, "
+                << events / elapsed.InSecondsF() << " events/s.";
+    }
+  }
+}
+
 }  // namespace bard
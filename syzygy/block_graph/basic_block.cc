@@ -68,6 +68,7 @@
 
 #include "base/strings/stringprintf.h"
 #include "syzygy/assm/assembler.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/core/disassembler_util.h"
 
 #include "mnemonics.h"  // NOLINT
@@ -714,7 +715,9 @@ void BasicBlock::MarkAsPadding() {
 BasicCodeBlock::BasicCodeBlock(BasicBlockSubGraph* subgraph,
                                const base::StringPiece& name,
                                BlockId id)
-    : BasicBlock(subgraph, name, id, BASIC_CODE_BLOCK) {
+    : BasicBlock(subgraph, name, id, BASIC_CODE_BLOCK),
+      instructions_(Instructions::allocator_type(subgraph->arena())),
+      successors_(Successors::allocator_type(subgraph->arena())) {
 }
 
 BasicCodeBlock* BasicCodeBlock::Cast(BasicBlock* basic_block) {
@@ -30,6 +30,8 @@
 #include "syzygy/block_graph/tags.h"
 #include "syzygy/common/align.h"
 #include "syzygy/core/disassembler_util.h"
+#include "syzygy/core/slab_arena.h"
+#include "syzygy/core/small_flat_map.h"
 
 #include "distorm.h"  // NOLINT
 
@@ -146,8 +148,8 @@ class BasicBlockReference {
   }
 
   // @returns the tags associated with this object.
-  TagSet& tags() { return tags_; }
-  const TagSet& tags() const { return tags_; }
+  TagSet& tags() { return tags_.Get(); }
+  const TagSet& tags() const { return tags_.Get(); }
 
  protected:
   // Denotes whether this reference is to a block or basic block.
@@ -177,7 +179,7 @@ class BasicBlockReference {
   Offset base_;
 
   // The tags that are applied to this object.
-  TagSet tags_;
+  LazyTagSet tags_;
 };
 
 // This class keeps track of a reference from an external block to a basic
@@ -243,7 +245,12 @@ class Instruction {
   typedef BlockGraph::Offset Offset;
   typedef BlockGraph::Block::SourceRange SourceRange;
   typedef _DInst Representation;
-  typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
+
+  // The references made by an instruction, keyed by their offset in it.
+  // Instructions rarely make more than one reference, so one is stored
+  // inline and only the others are heap allocated.
+  typedef core::SmallFlatMap<Offset, BasicBlockReference, 1>
+      BasicBlockReferenceMap;
 
   // The maximum size (in bytes) of an x86 instruction, per specs.
   static const size_t kMaxSize = assm::kMaxInstructionLength;
@@ -341,8 +348,8 @@ class Instruction {
                                            Offset offset);
 
   // @returns the tags associated with this object.
-  TagSet& tags() { return tags_; }
-  const TagSet& tags() const { return tags_; }
+  TagSet& tags() { return tags_.Get(); }
+  const TagSet& tags() const { return tags_.Get(); }
 
  protected:
   // Construct an instruction from its parsed representation and underlying
@@ -366,7 +373,7 @@ class Instruction {
   uint8_t data_[kMaxSize];
 
   // The tags that are applied to this object.
-  TagSet tags_;
+  LazyTagSet tags_;
 };
 
 // This class represents a control flow transfer to a basic block, which
@@ -378,7 +385,7 @@ class Successor {
   typedef BlockGraph::Offset Offset;
   typedef BlockGraph::Size Size;
   typedef BlockGraph::Block::SourceRange SourceRange;
-  typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
+  typedef Instruction::BasicBlockReferenceMap BasicBlockReferenceMap;
 
   // The op-code of an binary instruction.
   typedef uint16_t OpCode;
@@ -485,8 +492,8 @@ class Successor {
   std::string ToString() const;
 
   // @returns the tags associated with this object.
-  TagSet& tags() { return tags_; }
-  const TagSet& tags() const { return tags_; }
+  TagSet& tags() { return tags_.Get(); }
+  const TagSet& tags() const { return tags_.Get(); }
 
  protected:
   // The type of branch represented by this successor.
@@ -506,7 +513,7 @@ class Successor {
   Size instruction_size_;
 
   // The tags that are applied to this object.
-  TagSet tags_;
+  LazyTagSet tags_;
 };
 
 // An indivisible portion of code or data within a code block.
@@ -527,14 +534,15 @@ class BasicBlock {
   };
 
   typedef BlockGraph::BlockId BlockId;
-  typedef std::list<Instruction> Instructions;
+  typedef std::list<Instruction, core::SlabAllocator<Instruction>>
+      Instructions;
   typedef BlockGraph::Size Size;
-  typedef std::list<Successor> Successors;
+  typedef std::list<Successor, core::SlabAllocator<Successor>> Successors;
   typedef BlockGraph::Offset Offset;
 
   // The collection of references this basic block makes to other basic
   // blocks, keyed by the references offset relative to the start of this
-  // basic block.
+  // basic block. Iterators into it are invalidated by insertions.
   typedef Instruction::BasicBlockReferenceMap BasicBlockReferenceMap;
 
   // The set of the blocks that have a reference to this basic block.
@@ -648,7 +656,9 @@ class BasicCodeBlock : public BasicBlock {
   static BasicCodeBlock* Cast(BasicBlock* basic_block);
   static const BasicCodeBlock* Cast(const BasicBlock* basic_block);
 
-  // Accessors.
+  // Accessors. The instructions and successors are allocated from the arena
+  // of the subgraph, so lists of them may only be spliced into one another
+  // if they share its allocator. Copies of the lists use the heap.
   // @{
   const Instructions& instructions() const { return instructions_; }
   Instructions& instructions() { return instructions_; }
@@ -144,6 +144,13 @@ BasicBlockDecomposer::BasicBlockDecomposer(const BlockGraph::Block* block,
     scratch_subgraph_.reset(new BasicBlockSubGraph());
     subgraph_ = scratch_subgraph_.get();
   }
+
+  BasicBlock::Instructions(
+      BasicBlock::Instructions::allocator_type(subgraph_->arena()))
+      .swap(current_instructions_);
+  BasicBlock::Successors(
+      BasicBlock::Successors::allocator_type(subgraph_->arena()))
+      .swap(current_successors_);
 }
 
 bool BasicBlockDecomposer::Decompose() {
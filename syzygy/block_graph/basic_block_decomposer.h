@@ -102,7 +102,7 @@ class BasicBlockDecomposer {
   }
 
  protected:
-  typedef std::map<Offset, BasicBlockReference> BasicBlockReferenceMap;
+  typedef BasicBlock::BasicBlockReferenceMap BasicBlockReferenceMap;
   typedef core::AddressSpace<Offset, size_t, BasicBlock*> BBAddressSpace;
   typedef BlockGraph::Block::SourceRange SourceRange;
   typedef BlockGraph::Size Size;
@@ -240,6 +240,11 @@ class BasicBlockDecomposer {
   // The basic-block sub-graph to which the block will be decomposed.
   BasicBlockSubGraph* subgraph_;
 
+  // If no explicit subgraph was provided then we need to use one as scratch
+  // space in order to do some work. This must outlive the instruction and
+  // successor lists below, which allocate from its arena.
+  std::unique_ptr<BasicBlockSubGraph> scratch_subgraph_;
+
   // The layout of the original block into basic blocks in subgraph_.
   BBAddressSpace original_address_space_;
 
@@ -250,7 +255,9 @@ class BasicBlockDecomposer {
   // The start offset of the current basic block during a walk.
   Offset current_block_start_;
 
-  // The list of instructions in the current basic block.
+  // The list of instructions in the current basic block. This and
+  // current_successors_ allocate from the arena of subgraph_, so that they
+  // can be swapped and spliced with the lists of its basic code blocks.
   BasicBlock::Instructions current_instructions_;
 
   // The set of successors for the current basic block.
@@ -260,10 +267,6 @@ class BasicBlockDecomposer {
   // CHECKed.
   bool check_decomposition_results_;
 
-  // If no explicit subgraph was provided then we need to use one as scratch
-  // space in order to do some work.
-  std::unique_ptr<BasicBlockSubGraph> scratch_subgraph_;
-
   // Decomposition failure flags.
   bool contains_unsupported_instructions_;
 };
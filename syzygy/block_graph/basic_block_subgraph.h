@@ -24,6 +24,7 @@
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/basic_block.h"
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/core/slab_arena.h"
 
 namespace block_graph {
 
@@ -34,7 +35,9 @@ namespace block_graph {
 //
 // In manipulating the basic block sub-graph, note that the sub-graph
 // acts as a basic-block factory and retains ownership of all basic-blocks
-// that participate in the composition.
+// that participate in the composition. The instructions and successors of its
+// basic code blocks are allocated from a slab arena owned by the sub-graph, as
+// they are numerous and die with it.
 class BasicBlockSubGraph {
  public:
   typedef block_graph::BasicBlock BasicBlock;
@@ -87,6 +90,10 @@ class BasicBlockSubGraph {
     return block_descriptions_;
   }
   BlockDescriptionList& block_descriptions() { return block_descriptions_; }
+
+  // @returns the arena from which the instructions and successors of the
+  //     basic code blocks are allocated.
+  core::SlabArena* arena() { return &arena_; }
   // @}
 
   // Initializes and returns a new block description.
@@ -162,6 +169,10 @@ class BasicBlockSubGraph {
   bool HasValidReferrers() const;
   // @}
 
+  // The arena backing the instruction and successor lists of the basic code
+  // blocks. This must outlive them, so it is declared first.
+  core::SlabArena arena_;
+
   // The original block corresponding from which this sub-graph derives. This
   // is optional, and may be NULL.
   const Block* original_block_;
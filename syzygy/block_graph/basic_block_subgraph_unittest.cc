@@ -123,6 +123,24 @@ TEST(BasicBlockSubGraphTest, AddBasicBlock) {
   }
 }
 
+TEST(BasicBlockSubGraphTest, CodeBlocksAllocateFromArena) {
+  BasicBlockSubGraph subgraph;
+  BasicCodeBlock* bb = subgraph.AddBasicCodeBlock("bb");
+  ASSERT_FALSE(bb == NULL);
+  EXPECT_EQ(subgraph.arena(), bb->instructions().get_allocator().arena());
+  EXPECT_EQ(subgraph.arena(), bb->successors().get_allocator().arena());
+
+  uint64_t allocations = subgraph.arena()->stats().allocations;
+  bb->instructions().push_back(Instruction());
+  bb->successors().push_back(Successor());
+  EXPECT_EQ(allocations + 2, subgraph.arena()->stats().allocations);
+
+  // Copies of the lists use the heap.
+  BasicBlock::Instructions copy(bb->instructions());
+  EXPECT_TRUE(copy.get_allocator().arena() == NULL);
+  EXPECT_EQ(1u, copy.size());
+}
+
 TEST(BasicBlockSubGraphTest, AddBlockDescription) {
   TestBasicBlockSubGraph subgraph;
   BlockDescription* b1 = subgraph.AddBlockDescription(
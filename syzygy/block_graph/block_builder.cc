@@ -403,9 +403,9 @@ bool MergeContext::AssembleSuccessors(const BasicBlockLayoutInfo& info) {
       // Update the tag-info map for the successor.
       UpdateTagInfoMap(successor.successor->tags(), kSuccessorTag, info.block,
                        successor_start, 0, tag_info_map_);
-      UpdateTagInfoMap(successor.successor->reference().tags(),
-                       kReferenceTag, info.block, successor_start, 0,
-                       tag_info_map_);
+      const BasicBlockReference& reference = successor.successor->reference();
+      UpdateTagInfoMap(reference.tags(), kReferenceTag, info.block,
+                       successor_start, 0, tag_info_map_);
       continue;
     }
 
@@ -465,9 +465,12 @@ bool MergeContext::AssembleSuccessors(const BasicBlockLayoutInfo& info) {
 
     // Copy the tags that are associated with the successor reference to the
     // appropriately sized instruction reference. CopyInstructions will then
-    // take care of updating the tag info map.
-    instructions.back().references().begin()->second.tags() =
-        successor.reference.tags();
+    // take care of updating the tag info map. Tag sets are only allocated
+    // when written, so untagged references are left alone.
+    if (!successor.reference.tags().empty()) {
+      instructions.back().references().begin()->second.tags() =
+          successor.reference.tags();
+    }
 
     // Update the tag-info map for the successor.
     UpdateTagInfoMap(successor.successor->tags(), kSuccessorTag, info.block,
@@ -16,10 +16,12 @@
 
 #include "syzygy/block_graph/block_builder.h"
 
+#include "base/time/time.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/assm/unittest_util.h"
 #include "syzygy/block_graph/basic_block.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/basic_block_test_util.h"
 #include "syzygy/block_graph/block_graph.h"
@@ -628,4 +630,59 @@ TEST_F(BlockBuilderTest, LabelsPastEndAreNotDropped) {
             label_it->second.attributes());
 }
 
+// Measures the throughput of decomposing a block to basic blocks and merging
+// it back, which is what every basic-block transform pays for. Each iteration
+// decomposes the block produced by the previous one, as merging replaces the
+// original block. This is disabled by default; run with
+// --gtest_also_run_disabled_tests.
+TEST_F(BlockBuilderTest, DISABLED_BenchmarkDecomposeAndMerge) {
+  ASSERT_NO_FATAL_FAILURE(InitBlockGraph());
+
+  const size_t kIterations = 10000;
+  Block* block = assembly_func_;
+  size_t instruction_count = 0;
+  core::SlabArena::Stats arena_stats = {};
+  base::TimeDelta decompose_time;
+  base::TimeDelta merge_time;
+  for (size_t i = 0; i < kIterations; ++i) {
+    BasicBlockSubGraph subgraph;
+    base::TimeTicks start = base::TimeTicks::Now();
+    BasicBlockDecomposer decomposer(block, &subgraph);
+    ASSERT_TRUE(decomposer.Decompose());
+    base::TimeTicks decomposed = base::TimeTicks::Now();
+
+    // Snapshot the arena before the builder adds anything to the subgraph.
+    if (i == 0) {
+      arena_stats = subgraph.arena()->stats();
+      for (BasicBlock* bb : subgraph.basic_blocks()) {
+        BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+        if (code_bb != NULL)
+          instruction_count += code_bb->instructions().size();
+      }
+    }
+
+    BlockBuilder builder(&block_graph_);
+    ASSERT_TRUE(builder.Merge(&subgraph));
+    ASSERT_EQ(1u, builder.new_blocks().size());
+    block = builder.new_blocks()[0];
+
+    decompose_time += decomposed - start;
+    merge_time += base::TimeTicks::Now() - decomposed;
+  }
+
+  double seconds = (decompose_time + merge_time).InSecondsF();
+  LOG(INFO) << "Decomposed and merged a block of " << instruction_count
+            << " instructions " << kIterations << " times in "
+            << decompose_time.InMillisecondsF() << " + "
+            << merge_time.InMillisecondsF() << " ms ("
+            << kIterations * instruction_count / seconds
+            << " instructions/s).";
+  LOG(INFO) << "sizeof(Instruction) = " << sizeof(Instruction)
+            << ", sizeof(Successor) = " << sizeof(Successor) << ".";
+  LOG(INFO) << "Subgraph arena: " << arena_stats.allocations
+            << " allocations from " << arena_stats.heap_allocations
+            << " heap allocations, " << arena_stats.peak_bytes_in_use
+            << " bytes in use.";
+}
+
 }  // namespace block_graph
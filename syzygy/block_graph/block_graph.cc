@@ -255,6 +255,7 @@ const BlockGraph::SectionId BlockGraph::kInvalidSectionId = SIZE_MAX;
 
 BlockGraph::BlockGraph()
     : next_section_id_(0),
+      blocks_(BlockMap::allocator_type(&arena_)),
       next_block_id_(0),
       image_format_(UNKNOWN_IMAGE_FORMAT) {
 }
@@ -329,6 +330,7 @@ BlockGraph::Block* BlockGraph::AddBlock(BlockType type,
   BlockId id = ++next_block_id_;
   BlockMap::iterator it = blocks_.insert(
       std::make_pair(id, Block(id, type, size, name, this))).first;
+  it->second.UseBlockGraphArena();
 
   return &it->second;
 }
@@ -915,6 +917,18 @@ BlockGraph::Block::~Block() {
     delete [] data_;
 }
 
+void BlockGraph::Block::UseBlockGraphArena() {
+  DCHECK(block_graph_ != NULL);
+  DCHECK(references_.empty());
+  DCHECK(referrers_.empty());
+  DCHECK(labels_.empty());
+
+  core::SlabArena* arena = &block_graph_->arena_;
+  references_ = ReferenceMap(ReferenceMap::allocator_type(arena));
+  referrers_ = ReferrerSet(ReferrerSet::allocator_type(arena));
+  labels_ = LabelMap(LabelMap::allocator_type(arena));
+}
+
 void BlockGraph::Block::set_name(const base::StringPiece& name) {
   DCHECK(block_graph_ != NULL);
   const std::string& interned_name =
@@ -51,9 +51,14 @@
         'ordered_block_graph_internal.h',
         'orderer.cc',
         'orderer.h',
+        'parallel_transform.cc',
+        'parallel_transform.h',
+        'tags.cc',
         'tags.h',
         'transform.cc',
         'transform.h',
+        'transform_cache.cc',
+        'transform_cache.h',
         'transform_policy.h',
         'typed_block.h',
         'typed_block_internal.h',
@@ -101,6 +106,8 @@
         'iterate_unittest.cc',
         'ordered_block_graph_unittest.cc',
         'orderer_unittest.cc',
+        'parallel_transform_unittest.cc',
+        'transform_cache_unittest.cc',
         'transform_unittest.cc',
         'typed_block_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
@@ -20,6 +20,11 @@
 // The BlockGraph also stores minimum knowledge of sections (names and
 // characteristics), and each block belongs to at most one section. In this
 // sense, a BlockGraph acts as top-level division of blocks.
+//
+// The blocks, and the references, referrers and labels of each block, are
+// allocated from a slab arena owned by the BlockGraph. This avoids making
+// several heap allocations per block and reference when decomposing large
+// images. Copies of these containers made by clients use the heap as usual.
 
 #ifndef SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_H_
 #define SYZYGY_BLOCK_GRAPH_BLOCK_GRAPH_H_
@@ -35,6 +40,7 @@
 #include "syzygy/common/align.h"
 #include "syzygy/core/address.h"
 #include "syzygy/core/address_space.h"
+#include "syzygy/core/slab_arena.h"
 #include "syzygy/core/string_table.h"
 
 namespace block_graph {
@@ -242,7 +248,11 @@ class BlockGraph {
   struct BlockIdLess;
 
   // The block map contains all blocks, indexed by id.
-  typedef std::map<BlockId, Block> BlockMap;
+  typedef std::map<BlockId,
+                   Block,
+                   std::less<BlockId>,
+                   core::SlabAllocator<std::pair<const BlockId, Block>>>
+      BlockMap;
 
   BlockGraph();
   ~BlockGraph();
@@ -346,6 +356,10 @@ class BlockGraph {
   // @returns the string table of this BlockGraph.
   core::StringTable& string_table() { return string_table_; }
 
+  // @returns the arena from which the blocks and their references, referrers
+  //     and labels are allocated.
+  const core::SlabArena& arena() const { return arena_; }
+
   // Sets the image format.
   // @param image_format The format of the image.
   void set_image_format(ImageFormat image_format) {
@@ -361,6 +375,10 @@ class BlockGraph {
   // Removes a block by the iterator to it. The iterator must be valid.
   bool RemoveBlockByIterator(BlockMap::iterator it);
 
+  // The arena backing the block map and the containers of the blocks. This
+  // must outlive them, so it is declared first.
+  core::SlabArena arena_;
+
   // All sections we contain.
   SectionMap sections_;
 
@@ -559,10 +577,16 @@ class BlockGraph::Block {
   // to allow one to easily locate and remove the backreferences on change or
   // deletion.
   typedef std::pair<Block*, Offset> Referrer;
-  typedef std::set<Referrer> ReferrerSet;
+  typedef std::set<Referrer,
+                   std::less<Referrer>,
+                   core::SlabAllocator<Referrer>> ReferrerSet;
 
   // Map of references that this block makes to other blocks.
-  typedef std::map<Offset, Reference> ReferenceMap;
+  typedef std::map<Offset,
+                   Reference,
+                   std::less<Offset>,
+                   core::SlabAllocator<std::pair<const Offset, Reference>>>
+      ReferenceMap;
 
   // Represents a range of data in this block.
   typedef core::AddressRange<Offset, Size> DataRange;
@@ -585,7 +609,11 @@ class BlockGraph::Block {
   // within the block. Note that, while possible, it is NOT guaranteed that
   // all basic blocks are marked with a label. Basic block decomposition should
   // disassemble from the code labels to discover all basic blocks.
-  typedef std::map<Offset, Label> LabelMap;
+  typedef std::map<Offset,
+                   Label,
+                   std::less<Offset>,
+                   core::SlabAllocator<std::pair<const Offset, Label>>>
+      LabelMap;
 
   ~Block();
 
@@ -855,6 +883,12 @@ class BlockGraph::Block {
   // data buffer will not have been initialized in any way.
   uint8_t* AllocateRawData(size_t size);
 
+  // Makes the references, referrers and labels of this block allocate from
+  // the arena of its block graph. Blocks are copied into the block map, and
+  // container copies do not share the arena, so this is called once the block
+  // has been inserted. The containers must be empty.
+  void UseBlockGraphArena();
+
   BlockId id_;
   BlockType type_;
   Size size_;
@@ -283,6 +283,7 @@ bool BlockGraphSerializer::LoadBlocks(uint32_t version,
     }
     BlockGraph::Block* block = &result.first->second;
     block->id_ = id;
+    block->UseBlockGraphArena();
 
     if (!LoadBlockProperties(version, block, in_archive) ||
         !LoadBlockLabels(block, in_archive) ||
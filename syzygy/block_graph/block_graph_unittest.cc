@@ -1257,6 +1257,45 @@ TEST(BlockGraphTest, StringTable) {
   EXPECT_NE(&interned_str3, &interned_str4);
 }
 
+TEST(BlockGraphTest, ContainersUseArena) {
+  BlockGraph block_graph;
+  const core::SlabArena* arena = &block_graph.arena();
+
+  // Some standard library implementations allocate a sentinel node for empty
+  // containers, so the arena may already be in use.
+  size_t initial_bytes_in_use = arena->stats().bytes_in_use;
+
+  BlockGraph::Block* block1 =
+      block_graph.AddBlock(BlockGraph::CODE_BLOCK, 10, "Block1");
+  BlockGraph::Block* block2 =
+      block_graph.AddBlock(BlockGraph::DATA_BLOCK, 10, "Block2");
+  ASSERT_TRUE(block1 != NULL);
+  ASSERT_TRUE(block2 != NULL);
+
+  EXPECT_EQ(arena, block1->references().get_allocator().arena());
+  EXPECT_EQ(arena, block1->referrers().get_allocator().arena());
+  EXPECT_EQ(arena, block1->labels().get_allocator().arena());
+  EXPECT_EQ(arena, block_graph.blocks().get_allocator().arena());
+
+  // Adding a reference and a label allocates from the arena.
+  uint64_t allocations = arena->stats().allocations;
+  BlockGraph::Reference ref(BlockGraph::ABSOLUTE_REF, 4, block2, 0, 0);
+  ASSERT_TRUE(block1->SetReference(0, ref));
+  ASSERT_TRUE(block1->SetLabel(0, "Label", BlockGraph::CODE_LABEL));
+  EXPECT_LT(allocations, arena->stats().allocations);
+
+  // Copies of the containers use the heap.
+  BlockGraph::Block::ReferrerSet referrers = block2->referrers();
+  EXPECT_TRUE(referrers.get_allocator().arena() == NULL);
+  EXPECT_EQ(1u, referrers.size());
+
+  // Removing the blocks returns their memory to the arena.
+  ASSERT_TRUE(block1->RemoveReference(0));
+  ASSERT_TRUE(block_graph.RemoveBlock(block1));
+  ASSERT_TRUE(block_graph.RemoveBlock(block2));
+  EXPECT_EQ(initial_bytes_in_use, arena->stats().bytes_in_use);
+}
+
 namespace {
 
 class BlockGraphSerializationTest : public testing::Test {
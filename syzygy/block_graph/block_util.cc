@@ -18,6 +18,7 @@
 #include <vector>
 
 #include "mnemonics.h" // NOLINT
+#include "syzygy/common/process_utils.h"
 
 namespace block_graph {
 
@@ -189,4 +190,24 @@ bool GetJumpTableSize(const BlockGraph::Block* block,
   return true;
 }
 
+void LogBlockGraphMemoryUsage(const char* phase,
+                              const BlockGraph& block_graph) {
+  DCHECK(phase != NULL);
+
+  const core::SlabArena::Stats& stats = block_graph.arena().stats();
+  LOG(INFO) << phase << ": block-graph containers made " << stats.allocations
+            << " allocations (" << stats.frees << " freed) using "
+            << stats.heap_allocations << " heap allocations; peak "
+            << stats.peak_bytes_in_use << " bytes in use, "
+            << stats.slab_bytes << " bytes in slabs.";
+
+  size_t peak_working_set = 0;
+  size_t peak_commit = 0;
+  if (common::GetCurrentProcessPeakMemoryUsage(&peak_working_set,
+                                               &peak_commit)) {
+    LOG(INFO) << phase << ": peak working set " << peak_working_set
+              << " bytes, peak commit " << peak_commit << " bytes.";
+  }
+}
+
 }  // namespace block_graph
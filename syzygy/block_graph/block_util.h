@@ -67,6 +67,13 @@ bool GetJumpTableSize(const block_graph::BlockGraph::Block* block,
     block_graph::BlockGraph::Block::LabelMap::const_iterator jump_table_label,
     size_t* table_size);
 
+// Logs the allocation statistics of the arena of @p block_graph, and the peak
+// memory usage of the process.
+// @param phase a description of the work done so far, used as a prefix.
+// @param block_graph the block-graph whose memory use is to be logged.
+void LogBlockGraphMemoryUsage(const char* phase,
+                              const BlockGraph& block_graph);
+
 }  // namespace block_graph
 
 #endif  // SYZYGY_BLOCK_GRAPH_BLOCK_UTIL_H_
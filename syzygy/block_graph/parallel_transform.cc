@@ -0,0 +1,353 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/parallel_transform.h"
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/block_builder.h"
+#include "syzygy/block_graph/block_util.h"
+#include "syzygy/block_graph/transform_cache.h"
+
+namespace block_graph {
+
+namespace {
+
+// The maximum number of blocks in a batch. This bounds the number of
+// subgraphs that are alive at any given time.
+const size_t kMaxBatchSize = 256;
+
+// Counts down the outstanding work items of a batch.
+class BatchCompletion {
+ public:
+  BatchCompletion() : outstanding_(0), done_(&lock_) {}
+
+  void Reset(size_t outstanding) {
+    base::AutoLock auto_lock(lock_);
+    outstanding_ = outstanding;
+  }
+
+  void OnItemDone() {
+    base::AutoLock auto_lock(lock_);
+    DCHECK_LT(0u, outstanding_);
+    if (--outstanding_ == 0)
+      done_.Signal();
+  }
+
+  void Wait() {
+    base::AutoLock auto_lock(lock_);
+    while (outstanding_ > 0)
+      done_.Wait();
+  }
+
+ private:
+  base::Lock lock_;
+  size_t outstanding_;  // Under lock_.
+  base::ConditionVariable done_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchCompletion);
+};
+
+// The decomposition and transformation of a single block. This is the unit of
+// work handed to the worker pool.
+class BlockWorkItem : public base::DelegateSimpleThread::Delegate {
+ public:
+  enum Status {
+    kPending,
+    kTransformed,
+    kUnsupportedInstructions,
+    kFailed,
+  };
+
+  BlockWorkItem(const TransformPolicyInterface* policy,
+                BlockGraph* block_graph,
+                BlockGraph::Block* block,
+                BasicBlockSubGraphTransformInterface* transform,
+                TransformCache* cache,
+                BatchCompletion* completion)
+      : policy_(policy),
+        block_graph_(block_graph),
+        block_(block),
+        transform_(transform),
+        cache_(cache),
+        completion_(completion),
+        status_(kPending) {
+    DCHECK(policy != NULL);
+    DCHECK(block_graph != NULL);
+    DCHECK(block != NULL);
+    DCHECK(transform != NULL);
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    DCHECK_EQ(kPending, status_);
+    status_ = DecomposeAndTransform();
+    if (completion_ != NULL)
+      completion_->OnItemDone();
+  }
+  // @}
+
+  // @name Accessors.
+  // @{
+  BlockGraph::Block* block() const { return block_; }
+  BasicBlockSubGraphTransformInterface* transform() const {
+    return transform_.get();
+  }
+  BasicBlockSubGraph* subgraph() { return subgraph_.get(); }
+  Status status() const { return status_; }
+  // @}
+
+ private:
+  Status DecomposeAndTransform() {
+    if (cache_ != NULL) {
+      switch (cache_->DecomposeAndTransform(transform_.get(), policy_,
+                                            block_graph_, block_, &subgraph_,
+                                            &data_buffers_)) {
+        case TransformCache::kTransformed:
+          return kTransformed;
+        case TransformCache::kUnsupportedInstructions:
+          return kUnsupportedInstructions;
+        default:
+          return kFailed;
+      }
+    }
+
+    subgraph_.reset(new BasicBlockSubGraph());
+    BasicBlockDecomposer bb_decomposer(block_, subgraph_.get());
+    if (!bb_decomposer.Decompose()) {
+      if (bb_decomposer.contains_unsupported_instructions())
+        return kUnsupportedInstructions;
+      return kFailed;
+    }
+
+    if (!transform_->TransformBasicBlockSubGraph(policy_, block_graph_,
+                                                 subgraph_.get())) {
+      return kFailed;
+    }
+
+    return kTransformed;
+  }
+
+  const TransformPolicyInterface* policy_;
+  BlockGraph* block_graph_;
+  BlockGraph::Block* block_;
+  std::unique_ptr<BasicBlockSubGraphTransformInterface> transform_;
+  TransformCache* cache_;
+  BatchCompletion* completion_;
+  std::unique_ptr<BasicBlockSubGraph> subgraph_;
+  // Backs the basic data blocks of a subgraph read from the cache.
+  TransformCache::DataBuffers data_buffers_;
+  Status status_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockWorkItem);
+};
+
+// Accumulates work items into batches of mutually unconnected blocks, and
+// runs and commits them.
+class BatchRunner {
+ public:
+  BatchRunner(size_t num_threads,
+              BlockGraph* block_graph,
+              TransformCache* cache,
+              BlockVector* new_blocks)
+      : block_graph_(block_graph), cache_(cache), new_blocks_(new_blocks) {
+    DCHECK_LT(0u, num_threads);
+    DCHECK(block_graph != NULL);
+    if (num_threads > 1) {
+      pool_.reset(new base::DelegateSimpleThreadPool("BasicBlockTransform",
+                                                     num_threads));
+      pool_->Start();
+    }
+  }
+
+  ~BatchRunner() {
+    // Make sure no worker is still referring to the batch before it is
+    // destroyed.
+    if (pool_.get() != NULL)
+      pool_->JoinAll();
+  }
+
+  // @returns true if @p block must not be added to the pending batch, either
+  //     because the batch is full or because the block refers to or is
+  //     referred to by a block in the batch. Such a block would see the
+  //     effects of merging the batch.
+  bool MustFlushBefore(const BlockGraph::Block* block) const {
+    DCHECK(block != NULL);
+
+    if (batch_.size() == kMaxBatchSize)
+      return true;
+    if (batch_.empty())
+      return false;
+
+    BlockGraph::Block::ReferenceMap::const_iterator ref_it =
+        block->references().begin();
+    for (; ref_it != block->references().end(); ++ref_it) {
+      if (batch_blocks_.count(ref_it->second.referenced()))
+        return true;
+    }
+
+    BlockGraph::Block::ReferrerSet::const_iterator referrer_it =
+        block->referrers().begin();
+    for (; referrer_it != block->referrers().end(); ++referrer_it) {
+      if (batch_blocks_.count(referrer_it->first))
+        return true;
+    }
+
+    return false;
+  }
+
+  // Adds a block to the pending batch.
+  // @param policy the policy to pass to the transform.
+  // @param block the block to transform.
+  // @param transform the transform to apply. Ownership is transferred.
+  void Add(const TransformPolicyInterface* policy,
+           BlockGraph::Block* block,
+           BasicBlockSubGraphTransformInterface* transform) {
+    DCHECK(!MustFlushBefore(block));
+    batch_.push_back(std::unique_ptr<BlockWorkItem>(new BlockWorkItem(
+        policy, block_graph_, block, transform, cache_,
+        pool_.get() != NULL ? &completion_ : NULL)));
+    batch_blocks_.insert(block);
+  }
+
+  // Decomposes and transforms the blocks of the pending batch, then merges
+  // them into the block-graph in the order they were added.
+  // @returns true on success, false otherwise.
+  bool Flush() {
+    if (batch_.empty())
+      return true;
+
+    if (pool_.get() != NULL) {
+      completion_.Reset(batch_.size());
+      for (size_t i = 0; i < batch_.size(); ++i)
+        pool_->AddWork(batch_[i].get());
+      completion_.Wait();
+    } else {
+      for (size_t i = 0; i < batch_.size(); ++i)
+        batch_[i]->Run();
+    }
+
+    for (size_t i = 0; i < batch_.size(); ++i) {
+      if (!Commit(batch_[i].get()))
+        return false;
+    }
+
+    batch_.clear();
+    batch_blocks_.clear();
+    return true;
+  }
+
+ private:
+  // Merges the result of a single work item into the block-graph.
+  bool Commit(BlockWorkItem* item) {
+    DCHECK(item != NULL);
+
+    switch (item->status()) {
+      case BlockWorkItem::kTransformed: {
+        BlockBuilder builder(block_graph_);
+        if (!builder.Merge(item->subgraph())) {
+          LOG(ERROR) << "Failed to merge transformed block: "
+                     << BlockInfo(item->block());
+          return false;
+        }
+        if (new_blocks_ != NULL) {
+          new_blocks_->insert(new_blocks_->end(),
+                              builder.new_blocks().begin(),
+                              builder.new_blocks().end());
+        }
+        return true;
+      }
+
+      case BlockWorkItem::kUnsupportedInstructions: {
+        // Mark the block as undecomposable so it won't be processed again.
+        // This mirrors ApplyBasicBlockSubGraphTransform.
+        VLOG(1) << "Block contains unsupported instruction(s): "
+                << BlockInfo(item->block());
+        item->block()->set_attribute(BlockGraph::UNSUPPORTED_INSTRUCTIONS);
+        return true;
+      }
+
+      default: {
+        LOG(ERROR) << "Transform \"" << item->transform()->name()
+                   << "\" failed for block: " << BlockInfo(item->block());
+        return false;
+      }
+    }
+  }
+
+  BlockGraph* block_graph_;
+  TransformCache* cache_;
+  BlockVector* new_blocks_;
+  std::unique_ptr<base::DelegateSimpleThreadPool> pool_;
+  BatchCompletion completion_;
+
+  // The pending batch, and the set of its blocks.
+  std::vector<std::unique_ptr<BlockWorkItem>> batch_;
+  std::set<const BlockGraph::Block*> batch_blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchRunner);
+};
+
+}  // namespace
+
+bool ApplyBasicBlockSubGraphTransformsInParallel(
+    const BasicBlockSubGraphTransformFactory& factory,
+    const TransformPolicyInterface* policy,
+    size_t num_threads,
+    BlockGraph* block_graph,
+    TransformCache* cache,
+    BlockVector* new_blocks) {
+  DCHECK(!factory.is_null());
+  DCHECK(policy != NULL);
+  DCHECK_LT(0u, num_threads);
+  DCHECK(block_graph != NULL);
+
+  // Snapshot the IDs of the pre-existing blocks. Blocks created by merging
+  // subgraphs are never visited, as with IterateBlockGraph.
+  std::vector<BlockGraph::BlockId> block_ids;
+  block_ids.reserve(block_graph->blocks().size());
+  BlockGraph::BlockMap::const_iterator block_it =
+      block_graph->blocks().begin();
+  for (; block_it != block_graph->blocks().end(); ++block_it)
+    block_ids.push_back(block_it->first);
+
+  BatchRunner runner(num_threads, block_graph, cache, new_blocks);
+  for (size_t i = 0; i < block_ids.size(); ++i) {
+    BlockGraph::Block* block = block_graph->GetBlockById(block_ids[i]);
+    DCHECK(block != NULL);
+
+    if (runner.MustFlushBefore(block) && !runner.Flush())
+      return false;
+
+    BasicBlockSubGraphTransformInterface* transform =
+        factory.Run(block_graph, block);
+    if (transform == NULL)
+      continue;
+
+    DCHECK_EQ(BlockGraph::CODE_BLOCK, block->type());
+    DCHECK(policy->BlockIsSafeToBasicBlockDecompose(block));
+    runner.Add(policy, block, transform);
+  }
+
+  return runner.Flush();
+}
+
+}  // namespace block_graph
@@ -0,0 +1,83 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares a driver that applies basic-block transforms to all of the code
+// blocks of a block-graph using a pool of worker threads.
+//
+// The expensive part of a basic-block transform is decomposing each block and
+// running the transform over the resulting subgraph. Neither of these touch
+// the block-graph, so they can safely run concurrently as long as nothing is
+// mutating it at the same time. Merging a subgraph back into the block-graph
+// with a BlockBuilder does mutate it: the original block is replaced, and the
+// references of its referrers and the referrers of its referenced blocks are
+// updated.
+//
+// The driver walks the pre-existing blocks in the same order as
+// IterateBlockGraph and groups consecutive blocks into batches of blocks that
+// neither refer to nor are referred to by one another. Each batch is
+// decomposed and transformed on the worker pool, and the subgraphs are then
+// merged on the calling thread in block order. As merging a block only
+// affects its own neighbours, no merge in a batch invalidates the subgraph of
+// another block of that batch, and the result is identical to applying the
+// transforms serially.
+
+#ifndef SYZYGY_BLOCK_GRAPH_PARALLEL_TRANSFORM_H_
+#define SYZYGY_BLOCK_GRAPH_PARALLEL_TRANSFORM_H_
+
+#include "base/callback.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/transform.h"
+#include "syzygy/block_graph/transform_policy.h"
+
+namespace block_graph {
+
+// The type of callback used to create the basic-block transform to be applied
+// to a block. It is invoked on the calling thread, in block order, and must
+// return a heap allocated transform, ownership of which is passed to the
+// driver. It returns NULL if the block is to be left untouched. A block for
+// which a transform is returned must be a code block that is safe to basic
+// block decompose.
+//
+// The returned transform is invoked on a worker thread. It may read, but must
+// not modify, the block-graph, and it must not share mutable state with the
+// transforms created for other blocks.
+typedef base::Callback<BasicBlockSubGraphTransformInterface*(
+    BlockGraph* block_graph,
+    BlockGraph::Block* block)> BasicBlockSubGraphTransformFactory;
+
+// Applies basic-block transforms to every pre-existing block of a block-graph,
+// decomposing and transforming independent blocks concurrently.
+//
+// @param factory the callback creating the transform for each block.
+// @param policy The policy object restricting how the transform is applied.
+//     This is only ever consulted on the calling thread.
+// @param num_threads the number of worker threads to use. If this is 1 then
+//     all of the work is done on the calling thread.
+// @param block_graph the block graph to transform.
+// @param cache the cache of transform results to go through, or NULL. It is
+//     used concurrently by the worker threads.
+// @param new_blocks On success, the blocks created by merging the transformed
+//     subgraphs are appended here in creation order. This may be NULL.
+// @returns true on success, false otherwise.
+bool ApplyBasicBlockSubGraphTransformsInParallel(
+    const BasicBlockSubGraphTransformFactory& factory,
+    const TransformPolicyInterface* policy,
+    size_t num_threads,
+    BlockGraph* block_graph,
+    TransformCache* cache,
+    BlockVector* new_blocks);
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_PARALLEL_TRANSFORM_H_
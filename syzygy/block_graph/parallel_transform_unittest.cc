@@ -0,0 +1,253 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/parallel_transform.h"
+
+#include <cstring>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/strings/stringprintf.h"
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/block_graph/unittest_util.h"
+
+namespace block_graph {
+
+namespace {
+
+using testing::DummyTransformPolicy;
+
+// The code of each function in the test graph:
+//
+//     call <next function>
+//     mov eax, dword ptr [<datum>]
+//     ret
+const uint8_t kCodeBytes[] = {
+    0xE8, 0x00, 0x00, 0x00, 0x00,  // call <next function>
+    0xA1, 0x00, 0x00, 0x00, 0x00,  // mov eax, dword ptr [<datum>]
+    0xC3,                          // ret
+};
+const BlockGraph::Offset kOffsetOfCallTarget = 1;
+const BlockGraph::Offset kOffsetOfDatum = 6;
+
+// A transform that inserts a NOP at the start of every basic code block.
+class NopInsertingTransform : public BasicBlockSubGraphTransformInterface {
+ public:
+  NopInsertingTransform() {}
+
+  const char* name() const override { return "NopInsertingTransform"; }
+
+  bool TransformBasicBlockSubGraph(const TransformPolicyInterface* policy,
+                                   BlockGraph* block_graph,
+                                   BasicBlockSubGraph* subgraph) override {
+    BasicBlockSubGraph::BBCollection::iterator it =
+        subgraph->basic_blocks().begin();
+    for (; it != subgraph->basic_blocks().end(); ++it) {
+      BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+      if (bb == NULL)
+        continue;
+      BasicBlockAssembler assm(bb->instructions().begin(),
+                               &bb->instructions());
+      assm.nop(1);
+    }
+    return true;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NopInsertingTransform);
+};
+
+// A transform that always fails.
+class FailingTransform : public BasicBlockSubGraphTransformInterface {
+ public:
+  FailingTransform() {}
+
+  const char* name() const override { return "FailingTransform"; }
+
+  bool TransformBasicBlockSubGraph(const TransformPolicyInterface* policy,
+                                   BlockGraph* block_graph,
+                                   BasicBlockSubGraph* subgraph) override {
+    return false;
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(FailingTransform);
+};
+
+BasicBlockSubGraphTransformInterface* CreateNopTransform(
+    BlockGraph* block_graph, BlockGraph::Block* block) {
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return NULL;
+  return new NopInsertingTransform();
+}
+
+BasicBlockSubGraphTransformInterface* CreateFailingTransform(
+    BlockGraph* block_graph, BlockGraph::Block* block) {
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return NULL;
+  return new FailingTransform();
+}
+
+class ParallelTransformTest : public testing::Test {
+ public:
+  // Builds a graph of @p num_functions functions. Function i calls function
+  // i + 1 when i is even, or itself when i is odd, so that the graph has
+  // runs of both connected and unconnected blocks. All functions read the
+  // same datum.
+  static void BuildGraph(size_t num_functions, BlockGraph* block_graph) {
+    BlockGraph::Section* text = block_graph->AddSection(".text", 0);
+    BlockGraph::Section* data = block_graph->AddSection(".data", 0);
+
+    BlockGraph::Block* datum =
+        block_graph->AddBlock(BlockGraph::DATA_BLOCK, 4, "Datum");
+    datum->set_section(data->id());
+    datum->AllocateData(4);
+
+    std::vector<BlockGraph::Block*> functions;
+    for (size_t i = 0; i < num_functions; ++i) {
+      BlockGraph::Block* function = block_graph->AddBlock(
+          BlockGraph::CODE_BLOCK, sizeof(kCodeBytes),
+          base::StringPrintf("Function%d", static_cast<int>(i)));
+      function->set_section(text->id());
+      function->SetData(kCodeBytes, sizeof(kCodeBytes));
+      ASSERT_TRUE(function->SetLabel(
+          0, BlockGraph::Label(function->name(), BlockGraph::CODE_LABEL)));
+      functions.push_back(function);
+    }
+
+    for (size_t i = 0; i < num_functions; ++i) {
+      BlockGraph::Block* callee = functions[i];
+      if (i % 2 == 0)
+        callee = functions[(i + 1) % num_functions];
+      ASSERT_TRUE(functions[i]->SetReference(
+          kOffsetOfCallTarget,
+          BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF,
+                                BlockGraph::Reference::kMaximumSize, callee,
+                                0, 0)));
+      ASSERT_TRUE(functions[i]->SetReference(
+          kOffsetOfDatum,
+          BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                                BlockGraph::Reference::kMaximumSize, datum,
+                                0, 0)));
+    }
+  }
+
+  // Applies the NOP inserting transform serially, one block at a time.
+  bool ApplySerially(BlockGraph* block_graph) {
+    std::vector<BlockGraph::BlockId> ids;
+    BlockGraph::BlockMap::const_iterator it = block_graph->blocks().begin();
+    for (; it != block_graph->blocks().end(); ++it)
+      ids.push_back(it->first);
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+      BlockGraph::Block* block = block_graph->GetBlockById(ids[i]);
+      if (block->type() != BlockGraph::CODE_BLOCK)
+        continue;
+      NopInsertingTransform transform;
+      if (!ApplyBasicBlockSubGraphTransform(&transform, &policy_, block_graph,
+                                            block, NULL)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Expects two block-graphs to be identical, down to block IDs.
+  static void ExpectIdenticalGraphs(const BlockGraph& expected,
+                                    const BlockGraph& actual) {
+    ASSERT_EQ(expected.blocks().size(), actual.blocks().size());
+    BlockGraph::BlockMap::const_iterator expected_it =
+        expected.blocks().begin();
+    BlockGraph::BlockMap::const_iterator actual_it = actual.blocks().begin();
+    for (; expected_it != expected.blocks().end();
+         ++expected_it, ++actual_it) {
+      const BlockGraph::Block& e = expected_it->second;
+      const BlockGraph::Block& a = actual_it->second;
+      EXPECT_EQ(e.id(), a.id());
+      EXPECT_EQ(e.type(), a.type());
+      EXPECT_EQ(e.name(), a.name());
+      EXPECT_EQ(e.section(), a.section());
+      ASSERT_EQ(e.size(), a.size());
+      ASSERT_EQ(e.data_size(), a.data_size());
+      if (e.data_size() > 0)
+        EXPECT_EQ(0, ::memcmp(e.data(), a.data(), e.data_size()));
+
+      ASSERT_EQ(e.references().size(), a.references().size());
+      BlockGraph::Block::ReferenceMap::const_iterator e_ref =
+          e.references().begin();
+      BlockGraph::Block::ReferenceMap::const_iterator a_ref =
+          a.references().begin();
+      for (; e_ref != e.references().end(); ++e_ref, ++a_ref) {
+        EXPECT_EQ(e_ref->first, a_ref->first);
+        EXPECT_EQ(e_ref->second.type(), a_ref->second.type());
+        EXPECT_EQ(e_ref->second.referenced()->id(),
+                  a_ref->second.referenced()->id());
+        EXPECT_EQ(e_ref->second.offset(), a_ref->second.offset());
+        EXPECT_EQ(e_ref->second.base(), a_ref->second.base());
+      }
+
+      EXPECT_EQ(e.referrers().size(), a.referrers().size());
+    }
+  }
+
+ protected:
+  DummyTransformPolicy policy_;
+};
+
+}  // namespace
+
+TEST_F(ParallelTransformTest, SingleThreadMatchesSerial) {
+  BlockGraph serial_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(10, &serial_graph));
+  ASSERT_TRUE(ApplySerially(&serial_graph));
+
+  BlockGraph parallel_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(10, &parallel_graph));
+  BlockVector new_blocks;
+  ASSERT_TRUE(ApplyBasicBlockSubGraphTransformsInParallel(
+      base::Bind(&CreateNopTransform), &policy_, 1, &parallel_graph, NULL,
+      &new_blocks));
+  EXPECT_EQ(10u, new_blocks.size());
+
+  ExpectIdenticalGraphs(serial_graph, parallel_graph);
+}
+
+TEST_F(ParallelTransformTest, MultipleThreadsMatchSerial) {
+  const size_t kNumFunctions = 1000;
+
+  BlockGraph serial_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &serial_graph));
+  ASSERT_TRUE(ApplySerially(&serial_graph));
+
+  BlockGraph parallel_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &parallel_graph));
+  BlockVector new_blocks;
+  ASSERT_TRUE(ApplyBasicBlockSubGraphTransformsInParallel(
+      base::Bind(&CreateNopTransform), &policy_, 4, &parallel_graph, NULL,
+      &new_blocks));
+  EXPECT_EQ(kNumFunctions, new_blocks.size());
+
+  ExpectIdenticalGraphs(serial_graph, parallel_graph);
+}
+
+TEST_F(ParallelTransformTest, TransformFailurePropagates) {
+  BlockGraph block_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(10, &block_graph));
+  EXPECT_FALSE(ApplyBasicBlockSubGraphTransformsInParallel(
+      base::Bind(&CreateFailingTransform), &policy_, 4, &block_graph, NULL,
+      NULL));
+}
+
+}  // namespace block_graph
@@ -0,0 +1,45 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/tags.h"
+
+#include "base/lazy_instance.h"
+
+namespace block_graph {
+
+namespace {
+
+base::LazyInstance<TagSet>::Leaky g_empty_tag_set = LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+LazyTagSet& LazyTagSet::operator=(const LazyTagSet& other) {
+  // Empty sets are not worth holding on to.
+  if (!other.tags_ || other.tags_->empty()) {
+    tags_.reset();
+  } else if (tags_) {
+    *tags_ = *other.tags_;
+  } else {
+    tags_.reset(new TagSet(*other.tags_));
+  }
+  return *this;
+}
+
+const TagSet& LazyTagSet::Get() const {
+  if (tags_)
+    return *tags_;
+  return g_empty_tag_set.Get();
+}
+
+}  // namespace block_graph
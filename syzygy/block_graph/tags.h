@@ -22,6 +22,7 @@
 #define SYZYGY_BLOCK_GRAPH_TAGS_H_
 
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -35,6 +36,30 @@ namespace block_graph {
 typedef const void* Tag;
 typedef std::set<Tag> TagSet;
 
+// Holds a TagSet that is only allocated once it is accessed mutably. Few of
+// the instructions, successors and references of a subgraph are ever tagged,
+// but there are many of them, so this keeps them small and spares a heap
+// allocation each time one is created or copied.
+class LazyTagSet {
+ public:
+  LazyTagSet() {}
+  LazyTagSet(const LazyTagSet& other) { *this = other; }
+  LazyTagSet& operator=(const LazyTagSet& other);
+
+  // @returns the tags, allocating them if need be.
+  TagSet& Get() {
+    if (!tags_)
+      tags_.reset(new TagSet());
+    return *tags_;
+  }
+
+  // @returns the tags, or an empty set if none were ever set.
+  const TagSet& Get() const;
+
+ private:
+  std::unique_ptr<TagSet> tags_;
+};
+
 // This is an enumeration of the types of objects that may be tagged. The object
 // type will be available in the metadata associated with the user data.
 enum TaggedObjectType {
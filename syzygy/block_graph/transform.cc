@@ -14,9 +14,12 @@
 
 #include "syzygy/block_graph/transform.h"
 
+#include <memory>
+
 #include "syzygy/block_graph/basic_block_decomposer.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
+#include "syzygy/block_graph/transform_cache.h"
 
 namespace block_graph {
 
@@ -151,6 +154,17 @@ bool ApplyBasicBlockSubGraphTransform(
     BlockGraph* block_graph,
     BlockGraph::Block* block,
     BlockVector* new_blocks) {
+  return ApplyBasicBlockSubGraphTransform(transform, policy, block_graph, block,
+                                          new_blocks, NULL);
+}
+
+bool ApplyBasicBlockSubGraphTransform(
+    BasicBlockSubGraphTransformInterface* transform,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block,
+    BlockVector* new_blocks,
+    TransformCache* cache) {
   DCHECK(transform != NULL);
   DCHECK(policy != NULL);
   DCHECK(block_graph != NULL);
@@ -158,29 +172,43 @@ bool ApplyBasicBlockSubGraphTransform(
   DCHECK_EQ(BlockGraph::CODE_BLOCK, block->type());
   DCHECK(policy->BlockIsSafeToBasicBlockDecompose(block));
 
-  // Decompose block to basic blocks.
-  BasicBlockSubGraph subgraph;
-  BasicBlockDecomposer bb_decomposer(block, &subgraph);
-  if (!bb_decomposer.Decompose()) {
-    // If the failure is due to unsupported instructions then simply mark the
-    // block as undecomposable so it won't be processed again.
-    if (bb_decomposer.contains_unsupported_instructions()) {
-      VLOG(1) << "Block contains unsupported instruction(s): "
-              << BlockInfo(block);
-      block->set_attribute(BlockGraph::UNSUPPORTED_INSTRUCTIONS);
-      return true;
+  // Decompose block to basic blocks and call the transform, or read the
+  // transformed subgraph from the cache.
+  std::unique_ptr<BasicBlockSubGraph> subgraph;
+  TransformCache::DataBuffers data_buffers;
+  bool unsupported_instructions = false;
+  if (cache != NULL) {
+    TransformCache::Outcome outcome = cache->DecomposeAndTransform(
+        transform, policy, block_graph, block, &subgraph, &data_buffers);
+    if (outcome == TransformCache::kFailed)
+      return false;
+    unsupported_instructions =
+        outcome == TransformCache::kUnsupportedInstructions;
+  } else {
+    subgraph.reset(new BasicBlockSubGraph());
+    BasicBlockDecomposer bb_decomposer(block, subgraph.get());
+    if (!bb_decomposer.Decompose()) {
+      if (!bb_decomposer.contains_unsupported_instructions())
+        return false;
+      unsupported_instructions = true;
+    } else if (!transform->TransformBasicBlockSubGraph(policy, block_graph,
+                                                       subgraph.get())) {
+      return false;
     }
-
-    return false;
   }
 
-  // Call the transform.
-  if (!transform->TransformBasicBlockSubGraph(policy, block_graph, &subgraph))
-    return false;
+  // If the block contains unsupported instructions then simply mark it as
+  // undecomposable so it won't be processed again.
+  if (unsupported_instructions) {
+    VLOG(1) << "Block contains unsupported instruction(s): "
+            << BlockInfo(block);
+    block->set_attribute(BlockGraph::UNSUPPORTED_INSTRUCTIONS);
+    return true;
+  }
 
   // Update the block-graph post transform.
   BlockBuilder builder(block_graph);
-  if (!builder.Merge(&subgraph))
+  if (!builder.Merge(subgraph.get()))
     return false;
 
   if (new_blocks != NULL) {
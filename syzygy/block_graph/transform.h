@@ -17,6 +17,9 @@
 #ifndef SYZYGY_BLOCK_GRAPH_TRANSFORM_H_
 #define SYZYGY_BLOCK_GRAPH_TRANSFORM_H_
 
+#include <string>
+#include <vector>
+
 #include "syzygy/block_graph/basic_block_subgraph.h"
 #include "syzygy/block_graph/block_graph.h"
 #include "syzygy/block_graph/ordered_block_graph.h"
@@ -25,6 +28,9 @@
 
 namespace block_graph {
 
+// Forward declaration.
+class TransformCache;
+
 // A BlockGraphTransform is a pure virtual base class defining the transform
 // API.
 class BlockGraphTransformInterface {
@@ -98,6 +104,32 @@ class BasicBlockSubGraphTransformInterface {
       const TransformPolicyInterface* policy,
       BlockGraph* block_graph,
       BasicBlockSubGraph* basic_block_subgraph) = 0;
+
+  // @name Result caching.
+  // A TransformCache can store the output of this transform on disk and
+  // replay it on later runs, skipping both the decomposition and the
+  // transform. This is only sound if the output depends on nothing but the
+  // block and the parameters of the transform, and if the transform has no
+  // side effects beyond modifying the subgraph. Transforms satisfying this
+  // opt in by overriding these.
+  // @{
+  // Gets the parameters that affect the output of this transform.
+  // @param parameters receives a description of the parameters. This is
+  //     part of the cache key, so it must be stable across runs.
+  // @returns true if the output of this transform may be cached, false
+  //     otherwise.
+  virtual bool GetCacheParameters(std::string* parameters) const {
+    return false;
+  }
+
+  // Gets the references this transform may introduce to blocks that aren't
+  // referenced by the block being transformed.
+  // @param references receives the references, in an order that is stable
+  //     across runs.
+  virtual void GetCacheExternalReferences(
+      std::vector<BlockGraph::Reference>* references) const {
+  }
+  // @}
 };
 
 // Applies the provided BasicBlockSubGraphTransform to a single block. Takes
@@ -120,6 +152,29 @@ bool ApplyBasicBlockSubGraphTransform(
     BlockGraph::Block* block,
     BlockVector* new_blocks);
 
+// Applies the provided BasicBlockSubGraphTransform to a single block, going
+// through a cache of transform results. If the transformed block is found in
+// the cache it is merged without being decomposed or transformed. The result
+// is the same as that of the overload above.
+//
+// @param transform the transform to apply.
+// @param policy The policy object restricting how the transform is applied.
+// @param block_graph the block containing the block to be transformed.
+// @param block the block to be transformed.
+// @param new_blocks On success, any newly created blocks will be returned
+//     here. This may be NULL.
+// @param cache the cache to go through. If this is NULL, this is equivalent
+//     to the overload above.
+// @pre block must be a code block.
+// @returns true on success, false otherwise.
+bool ApplyBasicBlockSubGraphTransform(
+    BasicBlockSubGraphTransformInterface* transform,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block,
+    BlockVector* new_blocks,
+    TransformCache* cache);
+
 // Applies a series of BasicBlockSubGraphTransform to a single block. Takes
 // care of basic-block decomposing the block, passes it to the transform, and
 // recomposes the block.
@@ -0,0 +1,1286 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/transform_cache.h"
+
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <set>
+
+#include "base/logging.h"
+#include "base/md5.h"
+#include "base/files/file_util.h"
+#include "base/strings/string_piece.h"
+#include "base/strings/stringprintf.h"
+#include "syzygy/block_graph/basic_block_decomposer.h"
+#include "syzygy/block_graph/block_hash.h"
+#include "syzygy/common/align.h"
+#include "syzygy/core/serialization.h"
+
+namespace block_graph {
+
+namespace {
+
+typedef BlockGraph::Block Block;
+typedef BlockGraph::Offset Offset;
+typedef BlockGraph::Size Size;
+typedef Block::SourceRange SourceRange;
+typedef BasicBlock::BasicBlockReferenceMap BasicBlockReferenceMap;
+
+// This must be bumped whenever the format of the entries, or what the key
+// covers, changes.
+const uint32_t kFormatVersion = 1;
+
+const char kEntryExtension[] = ".bbcache";
+
+// The outcomes, as stored in the entries.
+enum StoredOutcome : uint8_t {
+  kStoredTransformed = 0,
+  kStoredUnsupportedInstructions = 1,
+};
+
+// The ways the bytes of instructions and basic data blocks are stored.
+enum DataKind : uint8_t {
+  // The bytes are those of the original block at a given offset.
+  kOriginalData = 0,
+  // The bytes are stored in the entry.
+  kStoredData = 1,
+};
+
+// The kinds of targets of the stored references.
+enum TargetKind : uint8_t {
+  // A basic block of the subgraph, by index.
+  kBasicBlockTarget = 0,
+  // The original block itself.
+  kOriginalBlockTarget = 1,
+  // The block referred to by the reference of the original block at a given
+  // source offset.
+  kOriginalReferenceTarget = 2,
+  // The block of a reference declared by the transform, by index. The offset
+  // is relative to that of the declared reference.
+  kExternalReferenceTarget = 3,
+};
+
+// Denotes the absence of a source range.
+const uint32_t kNoSourceRange = 0xFFFFFFFF;
+
+// The instructions decomposed from the original block are tagged with the
+// address of their bytes in that block. This identifies them even once the
+// transform has moved or copied them, so that their bytes are read back from
+// the original block. This matters as the BlockHash doesn't cover the bytes
+// of references, which may differ from one image to the next.
+void TagOrigins(const Block* block, BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(static_cast<const Block*>(nullptr), block);
+  DCHECK_NE(static_cast<BasicBlockSubGraph*>(nullptr), subgraph);
+
+  for (BasicBlock* bb : subgraph->basic_blocks()) {
+    BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+    if (code_bb == nullptr || code_bb->offset() == BasicBlock::kNoOffset)
+      continue;
+
+    Offset offset = code_bb->offset();
+    for (Instruction& instruction : code_bb->instructions()) {
+      instruction.tags().insert(block->data() + offset);
+      offset += instruction.size();
+    }
+  }
+}
+
+// Removes the tags added by TagOrigins, so that they don't make their way to
+// the BlockBuilder.
+void UntagOrigins(const Block* block, BasicBlockSubGraph* subgraph) {
+  DCHECK_NE(static_cast<const Block*>(nullptr), block);
+  DCHECK_NE(static_cast<BasicBlockSubGraph*>(nullptr), subgraph);
+
+  const uint8_t* begin = block->data();
+  const uint8_t* end = begin + block->data_size();
+  for (BasicBlock* bb : subgraph->basic_blocks()) {
+    BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+    if (code_bb == nullptr)
+      continue;
+    for (Instruction& instruction : code_bb->instructions()) {
+      TagSet& tags = instruction.tags();
+      tags.erase(tags.lower_bound(begin), tags.lower_bound(end));
+    }
+  }
+}
+
+// Gets the offset in the original block an instruction was decomposed from.
+// @returns true if the instruction was decomposed from the original block,
+//     false otherwise.
+bool GetOrigin(const Block* block, const Instruction& instruction,
+               Offset* origin) {
+  DCHECK_NE(static_cast<const Block*>(nullptr), block);
+  DCHECK_NE(static_cast<Offset*>(nullptr), origin);
+
+  const uint8_t* begin = block->data();
+  const uint8_t* end = begin + block->data_size();
+  TagSet::const_iterator it = instruction.tags().lower_bound(begin);
+  if (it == instruction.tags().end() || *it >= end)
+    return false;
+
+  *origin = static_cast<Offset>(static_cast<const uint8_t*>(*it) - begin);
+  return true;
+}
+
+// Accumulates the digest of the parts of a block its decomposition depends
+// on.
+class KeyDigest {
+ public:
+  KeyDigest() { base::MD5Init(&context_); }
+
+  template <typename Scalar>
+  void Update(Scalar value) {
+    base::MD5Update(&context_,
+                    base::StringPiece(reinterpret_cast<const char*>(&value),
+                                      sizeof(value)));
+  }
+
+  void Update(const std::string& value) {
+    Update(value.size());
+    base::MD5Update(&context_, value);
+  }
+
+  std::string Finish() {
+    base::MD5Digest digest = {};
+    base::MD5Final(&digest, &context_);
+    return base::MD5DigestToBase16(digest);
+  }
+
+ private:
+  base::MD5Context context_;
+
+  DISALLOW_COPY_AND_ASSIGN(KeyDigest);
+};
+
+// Serializes a transformed subgraph into a cache entry.
+class EntryWriter {
+ public:
+  EntryWriter(const Block* block,
+              const std::vector<BlockGraph::Reference>& external_references,
+              core::OutArchive* out_archive)
+      : block_(block),
+        external_references_(external_references),
+        out_archive_(out_archive) {
+    DCHECK_NE(static_cast<const Block*>(nullptr), block);
+    DCHECK_NE(static_cast<core::OutArchive*>(nullptr), out_archive);
+  }
+
+  // @returns true on success, false if the subgraph can't be cached.
+  bool Write(const BasicBlockSubGraph& subgraph) {
+    DCHECK_EQ(block_, subgraph.original_block());
+
+    for (const BasicBlock* bb : subgraph.basic_blocks()) {
+      uint32_t index = static_cast<uint32_t>(basic_block_indices_.size());
+      basic_block_indices_.insert(std::make_pair(bb, index));
+    }
+    for (const auto& entry : block_->references()) {
+      if (entry.second.referenced() != block_) {
+        original_targets_.insert(
+            std::make_pair(entry.second.referenced(), entry.first));
+      }
+    }
+
+    // The basic blocks are written in two passes, such that they all exist
+    // by the time references to them are read back.
+    if (!out_archive_->Save(
+            static_cast<uint32_t>(subgraph.basic_blocks().size()))) {
+      return false;
+    }
+    for (const BasicBlock* bb : subgraph.basic_blocks()) {
+      if (!WriteBasicBlockHeader(bb))
+        return false;
+    }
+    for (const BasicBlock* bb : subgraph.basic_blocks()) {
+      if (!WriteBasicBlockContents(bb))
+        return false;
+    }
+
+    if (!out_archive_->Save(
+            static_cast<uint32_t>(subgraph.block_descriptions().size()))) {
+      return false;
+    }
+    for (const auto& description : subgraph.block_descriptions()) {
+      if (!out_archive_->Save(description.name) ||
+          !out_archive_->Save(description.compiland_name) ||
+          !out_archive_->Save(static_cast<uint8_t>(description.type)) ||
+          !out_archive_->Save(static_cast<uint32_t>(description.section)) ||
+          !out_archive_->Save(description.alignment) ||
+          !out_archive_->Save(description.padding_before) ||
+          !out_archive_->Save(description.attributes) ||
+          !out_archive_->Save(
+              static_cast<uint32_t>(description.basic_block_order.size()))) {
+        return false;
+      }
+      for (const BasicBlock* bb : description.basic_block_order) {
+        auto it = basic_block_indices_.find(bb);
+        if (it == basic_block_indices_.end() || !out_archive_->Save(it->second))
+          return false;
+      }
+    }
+
+    return true;
+  }
+
+ private:
+  bool WriteBasicBlockHeader(const BasicBlock* bb) {
+    if (!out_archive_->Save(static_cast<uint8_t>(bb->type())) ||
+        !out_archive_->Save(bb->name()) ||
+        !out_archive_->Save(static_cast<uint32_t>(bb->alignment())) ||
+        !out_archive_->Save(bb->offset()) ||
+        !out_archive_->Save(bb->is_padding()) ||
+        !WriteReferrers(bb)) {
+      return false;
+    }
+
+    const BasicDataBlock* data_bb = BasicDataBlock::Cast(bb);
+    if (data_bb == nullptr)
+      return true;
+    if (data_bb->data() == nullptr || data_bb->size() == 0)
+      return false;
+
+    // Data originating from the block is read back from it.
+    const uint8_t* begin = block_->data();
+    const uint8_t* end = begin + block_->data_size();
+    if (data_bb->data() >= begin && data_bb->data() + data_bb->size() <= end) {
+      return out_archive_->Save(static_cast<uint8_t>(kOriginalData)) &&
+             out_archive_->Save(static_cast<Offset>(data_bb->data() - begin)) &&
+             out_archive_->Save(data_bb->size());
+    }
+
+    return out_archive_->Save(static_cast<uint8_t>(kStoredData)) &&
+           WriteData(data_bb->data(), data_bb->size());
+  }
+
+  bool WriteBasicBlockContents(const BasicBlock* bb) {
+    switch (bb->type()) {
+      case BasicBlock::BASIC_CODE_BLOCK: {
+        const BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+        if (!out_archive_->Save(
+                static_cast<uint32_t>(code_bb->instructions().size()))) {
+          return false;
+        }
+        for (const Instruction& instruction : code_bb->instructions()) {
+          if (!WriteInstruction(instruction))
+            return false;
+        }
+        if (!out_archive_->Save(
+                static_cast<uint32_t>(code_bb->successors().size()))) {
+          return false;
+        }
+        for (const Successor& successor : code_bb->successors()) {
+          if (!WriteSuccessor(successor))
+            return false;
+        }
+        return true;
+      }
+
+      case BasicBlock::BASIC_DATA_BLOCK: {
+        const BasicDataBlock* data_bb = BasicDataBlock::Cast(bb);
+        return WriteLabel(data_bb->has_label(), data_bb->label()) &&
+               WriteSourceRange(data_bb->source_range()) &&
+               WriteReferences(data_bb->references());
+      }
+
+      case BasicBlock::BASIC_END_BLOCK: {
+        const BasicEndBlock* end_bb = BasicEndBlock::Cast(bb);
+        return WriteLabel(end_bb->has_label(), end_bb->label()) &&
+               WriteReferences(end_bb->references());
+      }
+
+      default:
+        return false;
+    }
+  }
+
+  // The referrers of a basic block are stored as the offsets they refer to
+  // in the original block. These are part of the key, so the referrers can
+  // be recovered from the referrers of the original block.
+  bool WriteReferrers(const BasicBlock* bb) {
+    std::set<Offset> bases;
+    for (const BasicBlockReferrer& referrer : bb->referrers()) {
+      BlockGraph::Reference reference;
+      if (!referrer.block()->GetReference(referrer.offset(), &reference) ||
+          reference.referenced() != block_) {
+        return false;
+      }
+      bases.insert(reference.base());
+    }
+
+    if (!out_archive_->Save(static_cast<uint32_t>(bases.size())))
+      return false;
+    for (Offset base : bases) {
+      // The offsets must map to a single basic block.
+      if (!referrer_bases_.insert(std::make_pair(base, bb)).second)
+        return false;
+      if (!out_archive_->Save(base))
+        return false;
+    }
+
+    return true;
+  }
+
+  bool WriteInstruction(const Instruction& instruction) {
+    Offset origin = 0;
+    if (GetOrigin(block_, instruction, &origin)) {
+      // Instructions modified in place by the transform can't be cached, as
+      // their bytes may depend on bytes the key doesn't cover.
+      if (origin + instruction.size() > block_->data_size() ||
+          ::memcmp(block_->data() + origin, instruction.data(),
+                   instruction.size()) != 0) {
+        return false;
+      }
+      if (!out_archive_->Save(static_cast<uint8_t>(kOriginalData)) ||
+          !out_archive_->Save(origin) ||
+          !out_archive_->Save(instruction.size())) {
+        return false;
+      }
+    } else if (!out_archive_->Save(static_cast<uint8_t>(kStoredData)) ||
+               !WriteData(instruction.data(), instruction.size())) {
+      return false;
+    }
+
+    return WriteLabel(instruction.has_label(), instruction.label()) &&
+           WriteSourceRange(instruction.source_range()) &&
+           WriteReferences(instruction.references());
+  }
+
+  bool WriteSuccessor(const Successor& successor) {
+    if (successor.condition() == Successor::kInvalidCondition ||
+        !successor.reference().IsValid()) {
+      return false;
+    }
+
+    return out_archive_->Save(static_cast<int32_t>(successor.condition())) &&
+           out_archive_->Save(successor.instruction_size()) &&
+           WriteLabel(successor.has_label(), successor.label()) &&
+           WriteSourceRange(successor.source_range()) &&
+           WriteReference(successor.reference());
+  }
+
+  bool WriteReferences(const BasicBlockReferenceMap& references) {
+    if (!out_archive_->Save(static_cast<uint32_t>(references.size())))
+      return false;
+    for (const auto& entry : references) {
+      if (!out_archive_->Save(entry.first) || !WriteReference(entry.second))
+        return false;
+    }
+    return true;
+  }
+
+  bool WriteReference(const BasicBlockReference& reference) {
+    if (!out_archive_->Save(static_cast<uint8_t>(reference.reference_type())) ||
+        !out_archive_->Save(static_cast<uint8_t>(reference.size()))) {
+      return false;
+    }
+
+    if (reference.referred_type() ==
+        BasicBlockReference::REFERRED_TYPE_BASIC_BLOCK) {
+      auto it = basic_block_indices_.find(reference.basic_block());
+      return it != basic_block_indices_.end() &&
+             out_archive_->Save(static_cast<uint8_t>(kBasicBlockTarget)) &&
+             out_archive_->Save(it->second);
+    }
+
+    const Block* target = reference.block();
+    if (target == nullptr)
+      return false;
+
+    if (target == block_) {
+      return out_archive_->Save(static_cast<uint8_t>(kOriginalBlockTarget)) &&
+             out_archive_->Save(reference.offset()) &&
+             out_archive_->Save(reference.base());
+    }
+
+    // Look for the target among the references declared by the transform.
+    size_t external_index = external_references_.size();
+    for (size_t i = 0; i < external_references_.size(); ++i) {
+      if (external_references_[i].referenced() == target &&
+          external_references_[i].base() == reference.base()) {
+        external_index = i;
+        break;
+      }
+    }
+
+    // And among the references of the original block. A target that is
+    // found in both can't be told apart from one run to the next.
+    auto original_it = original_targets_.find(target);
+    bool is_external = external_index != external_references_.size();
+    bool is_original = original_it != original_targets_.end();
+    if (is_external == is_original)
+      return false;
+
+    if (is_external) {
+      const BlockGraph::Reference& external =
+          external_references_[external_index];
+      uint8_t kind = kExternalReferenceTarget;
+      return out_archive_->Save(kind) &&
+             out_archive_->Save(static_cast<uint32_t>(external_index)) &&
+             out_archive_->Save(reference.offset() - external.offset());
+    }
+
+    return out_archive_->Save(static_cast<uint8_t>(kOriginalReferenceTarget)) &&
+           out_archive_->Save(original_it->second) &&
+           out_archive_->Save(reference.offset()) &&
+           out_archive_->Save(reference.base());
+  }
+
+  bool WriteLabel(bool has_label, const BlockGraph::Label& label) {
+    if (!out_archive_->Save(has_label))
+      return false;
+    if (!has_label)
+      return true;
+    return out_archive_->Save(label.name()) &&
+           out_archive_->Save(label.attributes());
+  }
+
+  // Source ranges are stored relative to the source range of the original
+  // block they fall in. The key covers the layout of these, but not their
+  // addresses.
+  bool WriteSourceRange(const SourceRange& source_range) {
+    if (source_range.size() == 0)
+      return out_archive_->Save(kNoSourceRange);
+
+    const Block::SourceRanges::RangePairs& range_pairs =
+        block_->source_ranges().range_pairs();
+    size_t index = range_pairs.size();
+    for (size_t i = 0; i < range_pairs.size(); ++i) {
+      if (!range_pairs[i].second.Contains(source_range))
+        continue;
+      // The range must fall in a single source range.
+      if (index != range_pairs.size())
+        return false;
+      index = i;
+    }
+    if (index == range_pairs.size())
+      return false;
+
+    return out_archive_->Save(static_cast<uint32_t>(index)) &&
+           out_archive_->Save(static_cast<uint32_t>(
+               source_range.start() - range_pairs[index].second.start())) &&
+           out_archive_->Save(source_range.size());
+  }
+
+  bool WriteData(const uint8_t* data, Size size) {
+    return out_archive_->Save(size) &&
+           out_archive_->out_stream()->Write(size, data);
+  }
+
+  const Block* block_;
+  const std::vector<BlockGraph::Reference>& external_references_;
+  core::OutArchive* out_archive_;
+
+  std::map<const BasicBlock*, uint32_t> basic_block_indices_;
+  // The source offset of the first reference of the original block to each
+  // block it refers to.
+  std::map<const Block*, Offset> original_targets_;
+  // The basic block the referrers referring to each offset were found in.
+  std::map<Offset, const BasicBlock*> referrer_bases_;
+
+  DISALLOW_COPY_AND_ASSIGN(EntryWriter);
+};
+
+// Deserializes a transformed subgraph from a cache entry. This validates the
+// entry as it goes, as it may be corrupt.
+class EntryReader {
+ public:
+  EntryReader(const Block* block,
+              const std::vector<BlockGraph::Reference>& external_references,
+              core::InArchive* in_archive,
+              TransformCache::DataBuffers* data_buffers)
+      : block_(block),
+        external_references_(external_references),
+        in_archive_(in_archive),
+        data_buffers_(data_buffers) {
+    DCHECK_NE(static_cast<const Block*>(nullptr), block);
+    DCHECK_NE(static_cast<core::InArchive*>(nullptr), in_archive);
+    DCHECK_NE(static_cast<TransformCache::DataBuffers*>(nullptr),
+              data_buffers);
+  }
+
+  // @returns true on success, false if the entry is invalid.
+  bool Read(BasicBlockSubGraph* subgraph) {
+    DCHECK_NE(static_cast<BasicBlockSubGraph*>(nullptr), subgraph);
+    DCHECK(subgraph->basic_blocks().empty());
+
+    subgraph->set_original_block(block_);
+
+    uint32_t basic_block_count = 0;
+    if (!in_archive_->Load(&basic_block_count))
+      return false;
+    for (uint32_t i = 0; i < basic_block_count; ++i) {
+      if (!ReadBasicBlockHeader(subgraph))
+        return false;
+    }
+    for (BasicBlock* bb : basic_blocks_) {
+      if (!ReadBasicBlockContents(bb))
+        return false;
+    }
+    if (!ReadReferrers())
+      return false;
+
+    uint32_t description_count = 0;
+    if (!in_archive_->Load(&description_count))
+      return false;
+    for (uint32_t i = 0; i < description_count; ++i) {
+      std::string name;
+      std::string compiland_name;
+      uint8_t type = 0;
+      uint32_t section = 0;
+      Size alignment = 0;
+      Size padding_before = 0;
+      BlockGraph::BlockAttributes attributes = 0;
+      uint32_t basic_block_order_size = 0;
+      if (!in_archive_->Load(&name) || !in_archive_->Load(&compiland_name) ||
+          !in_archive_->Load(&type) || type >= BlockGraph::BLOCK_TYPE_MAX ||
+          !in_archive_->Load(&section) || !in_archive_->Load(&alignment) ||
+          !in_archive_->Load(&padding_before) ||
+          !in_archive_->Load(&attributes) ||
+          !in_archive_->Load(&basic_block_order_size)) {
+        return false;
+      }
+
+      BasicBlockSubGraph::BlockDescription* description =
+          subgraph->AddBlockDescription(
+              name, compiland_name, static_cast<BlockGraph::BlockType>(type),
+              section, alignment, attributes);
+      description->padding_before = padding_before;
+      for (uint32_t j = 0; j < basic_block_order_size; ++j) {
+        BasicBlock* bb = nullptr;
+        if (!ReadBasicBlockIndex(&bb))
+          return false;
+        description->basic_block_order.push_back(bb);
+      }
+    }
+
+    return true;
+  }
+
+ private:
+  bool ReadBasicBlockHeader(BasicBlockSubGraph* subgraph) {
+    uint8_t type = 0;
+    std::string name;
+    uint32_t alignment = 0;
+    Offset offset = 0;
+    bool is_padding = false;
+    if (!in_archive_->Load(&type) || !in_archive_->Load(&name) ||
+        !in_archive_->Load(&alignment) ||
+        !common::IsPowerOfTwo(alignment) || !in_archive_->Load(&offset) ||
+        !in_archive_->Load(&is_padding)) {
+      return false;
+    }
+
+    // Read the referrer offsets, which are resolved once the basic block
+    // exists.
+    uint32_t base_count = 0;
+    if (!in_archive_->Load(&base_count))
+      return false;
+    std::vector<Offset> bases(base_count);
+    for (Offset& base : bases) {
+      if (!in_archive_->Load(&base))
+        return false;
+    }
+
+    BasicBlock* bb = nullptr;
+    switch (type) {
+      case BasicBlock::BASIC_CODE_BLOCK: {
+        if (name.empty())
+          return false;
+        bb = subgraph->AddBasicCodeBlock(name);
+        break;
+      }
+
+      case BasicBlock::BASIC_DATA_BLOCK: {
+        const uint8_t* data = nullptr;
+        Size size = 0;
+        if (name.empty() || !ReadDataOfKind(&data, &size))
+          return false;
+        bb = subgraph->AddBasicDataBlock(name, size, data);
+        break;
+      }
+
+      case BasicBlock::BASIC_END_BLOCK: {
+        bb = subgraph->AddBasicEndBlock();
+        break;
+      }
+
+      default:
+        return false;
+    }
+    DCHECK_NE(static_cast<BasicBlock*>(nullptr), bb);
+
+    bb->set_alignment(alignment);
+    bb->set_offset(offset);
+    if (is_padding)
+      bb->MarkAsPadding();
+    for (Offset base : bases) {
+      if (!referrer_targets_.insert(std::make_pair(base, bb)).second)
+        return false;
+    }
+
+    basic_blocks_.push_back(bb);
+    return true;
+  }
+
+  bool ReadBasicBlockContents(BasicBlock* bb) {
+    switch (bb->type()) {
+      case BasicBlock::BASIC_CODE_BLOCK: {
+        BasicCodeBlock* code_bb = BasicCodeBlock::Cast(bb);
+        uint32_t instruction_count = 0;
+        if (!in_archive_->Load(&instruction_count))
+          return false;
+        for (uint32_t i = 0; i < instruction_count; ++i) {
+          if (!ReadInstruction(code_bb))
+            return false;
+        }
+
+        uint32_t successor_count = 0;
+        if (!in_archive_->Load(&successor_count) || successor_count > 2)
+          return false;
+        for (uint32_t i = 0; i < successor_count; ++i) {
+          if (!ReadSuccessor(code_bb))
+            return false;
+        }
+        return true;
+      }
+
+      case BasicBlock::BASIC_DATA_BLOCK: {
+        BasicDataBlock* data_bb = BasicDataBlock::Cast(bb);
+        bool has_label = false;
+        BlockGraph::Label label;
+        SourceRange source_range;
+        if (!ReadLabel(&has_label, &label) ||
+            !ReadSourceRange(&source_range)) {
+          return false;
+        }
+        if (has_label)
+          data_bb->set_label(label);
+        data_bb->set_source_range(source_range);
+        return ReadReferences(data_bb->size(), &data_bb->references());
+      }
+
+      case BasicBlock::BASIC_END_BLOCK: {
+        BasicEndBlock* end_bb = BasicEndBlock::Cast(bb);
+        bool has_label = false;
+        BlockGraph::Label label;
+        if (!ReadLabel(&has_label, &label))
+          return false;
+        if (has_label)
+          end_bb->set_label(label);
+        return ReadReferences(0, &end_bb->references());
+      }
+
+      default:
+        NOTREACHED();
+        return false;
+    }
+  }
+
+  bool ReadInstruction(BasicCodeBlock* code_bb) {
+    const uint8_t* data = nullptr;
+    Size size = 0;
+    if (!ReadDataOfKind(&data, &size))
+      return false;
+
+    Instruction instruction;
+    if (size == 0 || size > Instruction::kMaxSize ||
+        !Instruction::FromBuffer(data, size, &instruction) ||
+        instruction.size() != size) {
+      return false;
+    }
+
+    bool has_label = false;
+    BlockGraph::Label label;
+    SourceRange source_range;
+    if (!ReadLabel(&has_label, &label) || !ReadSourceRange(&source_range))
+      return false;
+    if (has_label)
+      instruction.set_label(label);
+    instruction.set_source_range(source_range);
+    if (!ReadReferences(instruction.size(), &instruction.references()))
+      return false;
+
+    code_bb->instructions().push_back(instruction);
+    return true;
+  }
+
+  bool ReadSuccessor(BasicCodeBlock* code_bb) {
+    int32_t condition = 0;
+    Size instruction_size = 0;
+    bool has_label = false;
+    BlockGraph::Label label;
+    SourceRange source_range;
+    BasicBlockReference reference;
+    if (!in_archive_->Load(&condition) ||
+        condition < Successor::kMinConditionalBranch ||
+        condition >= Successor::kMaxCondition ||
+        !in_archive_->Load(&instruction_size) ||
+        !ReadLabel(&has_label, &label) || !ReadSourceRange(&source_range) ||
+        !ReadReference(&reference)) {
+      return false;
+    }
+
+    Successor successor(static_cast<Successor::Condition>(condition),
+                        reference, instruction_size);
+    if (has_label)
+      successor.set_label(label);
+    successor.set_source_range(source_range);
+    code_bb->successors().push_back(successor);
+    return true;
+  }
+
+  // Reads the references of an object of a given size. They are set
+  // directly in the reference map, as the setters of the objects expect
+  // them to be valid.
+  bool ReadReferences(Size object_size, BasicBlockReferenceMap* references) {
+    DCHECK_NE(static_cast<BasicBlockReferenceMap*>(nullptr), references);
+
+    uint32_t count = 0;
+    if (!in_archive_->Load(&count))
+      return false;
+    for (uint32_t i = 0; i < count; ++i) {
+      Offset offset = 0;
+      BasicBlockReference reference;
+      if (!in_archive_->Load(&offset) || !ReadReference(&reference))
+        return false;
+      // End blocks carry references with no size of their own.
+      if (offset < 0 || (object_size != 0 &&
+                         offset + reference.size() > object_size)) {
+        return false;
+      }
+      if (!references->insert(std::make_pair(offset, reference)).second)
+        return false;
+    }
+
+    return true;
+  }
+
+  bool ReadReference(BasicBlockReference* reference) {
+    DCHECK_NE(static_cast<BasicBlockReference*>(nullptr), reference);
+
+    uint8_t type = 0;
+    uint8_t size = 0;
+    uint8_t kind = 0;
+    if (!in_archive_->Load(&type) || type >= BlockGraph::REFERENCE_TYPE_MAX ||
+        !in_archive_->Load(&size) || size == 0 ||
+        size > BlockGraph::Reference::kMaximumSize ||
+        !in_archive_->Load(&kind)) {
+      return false;
+    }
+    BlockGraph::ReferenceType reference_type =
+        static_cast<BlockGraph::ReferenceType>(type);
+
+    switch (kind) {
+      case kBasicBlockTarget: {
+        BasicBlock* bb = nullptr;
+        if (!ReadBasicBlockIndex(&bb))
+          return false;
+        *reference = BasicBlockReference(reference_type, size, bb);
+        return true;
+      }
+
+      case kOriginalBlockTarget: {
+        Offset offset = 0;
+        Offset base = 0;
+        if (!in_archive_->Load(&offset) || !in_archive_->Load(&base))
+          return false;
+        *reference = BasicBlockReference(
+            reference_type, size, const_cast<Block*>(block_), offset, base);
+        return true;
+      }
+
+      case kOriginalReferenceTarget: {
+        Offset source_offset = 0;
+        Offset offset = 0;
+        Offset base = 0;
+        BlockGraph::Reference original;
+        if (!in_archive_->Load(&source_offset) ||
+            !in_archive_->Load(&offset) || !in_archive_->Load(&base) ||
+            !block_->GetReference(source_offset, &original)) {
+          return false;
+        }
+        *reference = BasicBlockReference(reference_type, size,
+                                         original.referenced(), offset, base);
+        return true;
+      }
+
+      case kExternalReferenceTarget: {
+        uint32_t index = 0;
+        Offset offset = 0;
+        if (!in_archive_->Load(&index) ||
+            index >= external_references_.size() ||
+            !in_archive_->Load(&offset)) {
+          return false;
+        }
+        const BlockGraph::Reference& external = external_references_[index];
+        *reference = BasicBlockReference(
+            reference_type, size, external.referenced(),
+            external.offset() + offset, external.base());
+        return true;
+      }
+
+      default:
+        return false;
+    }
+  }
+
+  // Attaches the referrers of the original block to the basic blocks they
+  // refer to, as the decomposer does.
+  bool ReadReferrers() {
+    for (const auto& referrer : block_->referrers()) {
+      if (referrer.first == block_)
+        continue;
+
+      BlockGraph::Reference reference;
+      bool found = referrer.first->GetReference(referrer.second, &reference);
+      DCHECK(found);
+      auto it = referrer_targets_.find(reference.base());
+      if (it == referrer_targets_.end())
+        return false;
+      it->second->referrers().insert(
+          BasicBlockReferrer(referrer.first, referrer.second));
+    }
+
+    return true;
+  }
+
+  bool ReadLabel(bool* has_label, BlockGraph::Label* label) {
+    DCHECK_NE(static_cast<bool*>(nullptr), has_label);
+    DCHECK_NE(static_cast<BlockGraph::Label*>(nullptr), label);
+
+    if (!in_archive_->Load(has_label))
+      return false;
+    if (!*has_label)
+      return true;
+
+    std::string name;
+    BlockGraph::LabelAttributes attributes = 0;
+    if (!in_archive_->Load(&name) || !in_archive_->Load(&attributes))
+      return false;
+    *label = BlockGraph::Label(name, attributes);
+    return true;
+  }
+
+  bool ReadSourceRange(SourceRange* source_range) {
+    DCHECK_NE(static_cast<SourceRange*>(nullptr), source_range);
+
+    uint32_t index = 0;
+    if (!in_archive_->Load(&index))
+      return false;
+    if (index == kNoSourceRange) {
+      *source_range = SourceRange();
+      return true;
+    }
+
+    const Block::SourceRanges::RangePairs& range_pairs =
+        block_->source_ranges().range_pairs();
+    uint32_t delta = 0;
+    Size size = 0;
+    if (index >= range_pairs.size() || !in_archive_->Load(&delta) ||
+        !in_archive_->Load(&size)) {
+      return false;
+    }
+    const SourceRange& containing_range = range_pairs[index].second;
+    if (size == 0 || delta + size > containing_range.size())
+      return false;
+
+    *source_range = SourceRange(containing_range.start() + delta, size);
+    return true;
+  }
+
+  bool ReadBasicBlockIndex(BasicBlock** bb) {
+    DCHECK_NE(static_cast<BasicBlock**>(nullptr), bb);
+
+    uint32_t index = 0;
+    if (!in_archive_->Load(&index) || index >= basic_blocks_.size())
+      return false;
+    *bb = basic_blocks_[index];
+    return true;
+  }
+
+  // Reads data written along with its DataKind: either a range of the
+  // original block, or bytes stored in the entry.
+  bool ReadDataOfKind(const uint8_t** data, Size* size) {
+    DCHECK_NE(static_cast<const uint8_t**>(nullptr), data);
+    DCHECK_NE(static_cast<Size*>(nullptr), size);
+
+    uint8_t data_kind = 0;
+    if (!in_archive_->Load(&data_kind))
+      return false;
+    if (data_kind == kStoredData)
+      return ReadData(data, size);
+    if (data_kind != kOriginalData)
+      return false;
+
+    Offset origin = 0;
+    if (!in_archive_->Load(&origin) || !in_archive_->Load(size) ||
+        *size == 0 || origin < 0 ||
+        static_cast<Size>(origin) > block_->data_size() ||
+        *size > block_->data_size() - origin) {
+      return false;
+    }
+    *data = block_->data() + origin;
+    return true;
+  }
+
+  bool ReadData(const uint8_t** data, Size* size) {
+    DCHECK_NE(static_cast<const uint8_t**>(nullptr), data);
+    DCHECK_NE(static_cast<Size*>(nullptr), size);
+
+    if (!in_archive_->Load(size) || *size == 0)
+      return false;
+    data_buffers_->push_back(std::vector<uint8_t>(*size));
+    std::vector<uint8_t>& buffer = data_buffers_->back();
+    if (!in_archive_->in_stream()->Read(*size, buffer.data()))
+      return false;
+    *data = buffer.data();
+    return true;
+  }
+
+  const Block* block_;
+  const std::vector<BlockGraph::Reference>& external_references_;
+  core::InArchive* in_archive_;
+  TransformCache::DataBuffers* data_buffers_;
+
+  // The basic blocks read so far, by index.
+  std::vector<BasicBlock*> basic_blocks_;
+  // The basic block the referrers referring to each offset belong to.
+  std::map<Offset, BasicBlock*> referrer_targets_;
+
+  DISALLOW_COPY_AND_ASSIGN(EntryReader);
+};
+
+}  // namespace
+
+TransformCache::TransformCache() {
+}
+
+TransformCache::~TransformCache() {
+}
+
+bool TransformCache::Init(const base::FilePath& directory) {
+  DCHECK(!directory.empty());
+
+  if (!base::CreateDirectory(directory)) {
+    LOG(ERROR) << "Unable to create transform cache directory: "
+               << directory.value();
+    return false;
+  }
+
+  directory_ = directory;
+  return true;
+}
+
+TransformCache::Outcome TransformCache::DecomposeAndTransform(
+    BasicBlockSubGraphTransformInterface* transform,
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    const BlockGraph::Block* block,
+    std::unique_ptr<BasicBlockSubGraph>* subgraph,
+    DataBuffers* data_buffers) {
+  DCHECK_NE(static_cast<BasicBlockSubGraphTransformInterface*>(nullptr),
+            transform);
+  DCHECK_NE(static_cast<TransformPolicyInterface*>(nullptr), policy);
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+  DCHECK_NE(static_cast<const Block*>(nullptr), block);
+  DCHECK_NE(static_cast<std::unique_ptr<BasicBlockSubGraph>*>(nullptr),
+            subgraph);
+  DCHECK_NE(static_cast<DataBuffers*>(nullptr), data_buffers);
+  DCHECK(!directory_.empty());
+
+  std::string key;
+  bool cacheable = GetKey(transform, block_graph, block, &key);
+  std::vector<BlockGraph::Reference> external_references;
+  base::TimeTicks start = base::TimeTicks::Now();
+
+  if (cacheable) {
+    transform->GetCacheExternalReferences(&external_references);
+
+    Outcome outcome = kFailed;
+    base::TimeDelta time;
+    bool hit = Lookup(key, external_references, block, &outcome, &time,
+                      subgraph, data_buffers);
+    base::TimeTicks end = base::TimeTicks::Now();
+
+    base::AutoLock auto_lock(lock_);
+    ++stats_.lookups;
+    if (hit) {
+      ++stats_.hits;
+      stats_.time_saved += time - (end - start);
+      return outcome;
+    }
+    start = end;
+  }
+
+  // Decompose and transform the block.
+  subgraph->reset(new BasicBlockSubGraph());
+  Outcome outcome = kTransformed;
+  BasicBlockDecomposer bb_decomposer(block, subgraph->get());
+  if (!bb_decomposer.Decompose()) {
+    if (!bb_decomposer.contains_unsupported_instructions())
+      return kFailed;
+    outcome = kUnsupportedInstructions;
+  } else {
+    if (cacheable)
+      TagOrigins(block, subgraph->get());
+    if (!transform->TransformBasicBlockSubGraph(policy, block_graph,
+                                                subgraph->get())) {
+      return kFailed;
+    }
+  }
+
+  bool stored = false;
+  if (cacheable) {
+    stored = Store(key, external_references, block, outcome,
+                   base::TimeTicks::Now() - start, subgraph->get());
+    if (outcome == kTransformed)
+      UntagOrigins(block, subgraph->get());
+  }
+
+  base::AutoLock auto_lock(lock_);
+  if (stored)
+    ++stats_.stores;
+  else
+    ++stats_.uncacheable;
+
+  return outcome;
+}
+
+TransformCache::Stats TransformCache::stats() const {
+  base::AutoLock auto_lock(lock_);
+  return stats_;
+}
+
+void TransformCache::LogStats() const {
+  Stats stats = this->stats();
+  double hit_rate = 0.0;
+  if (stats.lookups != 0)
+    hit_rate = 100.0 * stats.hits / stats.lookups;
+
+  LOG(INFO) << "Transform cache hits: " << stats.hits << " of "
+            << stats.lookups << " lookups ("
+            << base::StringPrintf("%.1f", hit_rate) << "%), saving "
+            << base::StringPrintf("%.1f", stats.time_saved.InMillisecondsF())
+            << " ms.";
+  LOG(INFO) << "Transform cache stores: " << stats.stores << ", uncacheable "
+            << "blocks: " << stats.uncacheable << ".";
+}
+
+bool TransformCache::GetKey(
+    const BasicBlockSubGraphTransformInterface* transform,
+    const BlockGraph* block_graph,
+    const BlockGraph::Block* block,
+    std::string* key) const {
+  DCHECK_NE(static_cast<BasicBlockSubGraphTransformInterface*>(nullptr),
+            transform);
+  DCHECK_NE(static_cast<BlockGraph*>(nullptr), block_graph);
+  DCHECK_NE(static_cast<const Block*>(nullptr), block);
+  DCHECK_NE(static_cast<std::string*>(nullptr), key);
+
+  std::string parameters;
+  if (!transform->GetCacheParameters(&parameters))
+    return false;
+
+  KeyDigest digest;
+
+  // The content of the block.
+  BlockHash hash(block);
+  for (size_t i = 0; i < arraysize(hash.md5_digest.a); ++i)
+    digest.Update(hash.md5_digest.a[i]);
+
+  // The properties the decomposer copies to the block description.
+  digest.Update(block->name());
+  digest.Update(block->compiland_name());
+  digest.Update(block->section());
+  digest.Update(block->alignment());
+  digest.Update(block->alignment_offset());
+  digest.Update(block->padding_before());
+  digest.Update(block->attributes());
+
+  // The labels.
+  digest.Update(block->labels().size());
+  for (const auto& entry : block->labels()) {
+    digest.Update(entry.first);
+    digest.Update(entry.second.name());
+    digest.Update(entry.second.attributes());
+  }
+
+  // The layout of the source ranges.
+  const Block::SourceRanges::RangePairs& range_pairs =
+      block->source_ranges().range_pairs();
+  digest.Update(range_pairs.size());
+  for (const auto& range_pair : range_pairs) {
+    digest.Update(range_pair.first.start());
+    digest.Update(range_pair.first.size());
+    digest.Update(range_pair.second.size());
+  }
+
+  // The targets of the references. Rather than the identity of the blocks
+  // referred to, this covers which references refer to the same blocks.
+  std::map<const Block*, size_t> first_references;
+  for (const auto& entry : block->references()) {
+    const BlockGraph::Reference& reference = entry.second;
+    digest.Update(entry.first);
+    digest.Update(reference.offset());
+    digest.Update(reference.base());
+    if (reference.referenced() == block) {
+      digest.Update(static_cast<size_t>(-1));
+      continue;
+    }
+    size_t index = first_references.size();
+    index = first_references.insert(
+        std::make_pair(reference.referenced(), index)).first->second;
+    digest.Update(index);
+    digest.Update(reference.referenced()->type());
+    digest.Update(reference.referenced()->attributes());
+  }
+
+  // The offsets referred to by other blocks.
+  std::set<Offset> bases;
+  for (const auto& referrer : block->referrers()) {
+    if (referrer.first == block)
+      continue;
+    BlockGraph::Reference reference;
+    bool found = referrer.first->GetReference(referrer.second, &reference);
+    DCHECK(found);
+    bases.insert(reference.base());
+  }
+  digest.Update(bases.size());
+  for (Offset base : bases)
+    digest.Update(base);
+
+  *key = base::StringPrintf("%u:%s:%d:%s:%s", kFormatVersion,
+                            transform->name(), block_graph->image_format(),
+                            parameters.c_str(), digest.Finish().c_str());
+  return true;
+}
+
+base::FilePath TransformCache::GetEntryPath(const std::string& key) const {
+  return directory_.AppendASCII(base::MD5String(key) + kEntryExtension);
+}
+
+bool TransformCache::Lookup(
+    const std::string& key,
+    const std::vector<BlockGraph::Reference>& external_references,
+    const BlockGraph::Block* block,
+    Outcome* outcome,
+    base::TimeDelta* time,
+    std::unique_ptr<BasicBlockSubGraph>* subgraph,
+    DataBuffers* data_buffers) const {
+  DCHECK_NE(static_cast<const Block*>(nullptr), block);
+  DCHECK_NE(static_cast<Outcome*>(nullptr), outcome);
+  DCHECK_NE(static_cast<base::TimeDelta*>(nullptr), time);
+  DCHECK_NE(static_cast<std::unique_ptr<BasicBlockSubGraph>*>(nullptr),
+            subgraph);
+  DCHECK_NE(static_cast<DataBuffers*>(nullptr), data_buffers);
+
+  base::FilePath path = GetEntryPath(key);
+  std::string contents;
+  if (!base::ReadFileToString(path, &contents))
+    return false;
+
+  core::ScopedInStreamPtr in_stream(
+      core::CreateByteInStream(contents.begin(), contents.end()));
+  core::NativeBinaryInArchive in_archive(in_stream.get());
+
+  // The file name is a digest of the key, so make sure this is the right
+  // entry.
+  std::string entry_key;
+  uint8_t stored_outcome = 0;
+  int64_t microseconds = 0;
+  if (!in_archive.Load(&entry_key) || entry_key != key ||
+      !in_archive.Load(&stored_outcome) || !in_archive.Load(&microseconds)) {
+    return false;
+  }
+
+  if (stored_outcome == kStoredUnsupportedInstructions) {
+    *outcome = kUnsupportedInstructions;
+    *time = base::TimeDelta::FromMicroseconds(microseconds);
+    return true;
+  }
+  if (stored_outcome != kStoredTransformed)
+    return false;
+
+  std::unique_ptr<BasicBlockSubGraph> new_subgraph(new BasicBlockSubGraph());
+  DataBuffers new_data_buffers;
+  EntryReader reader(block, external_references, &in_archive,
+                     &new_data_buffers);
+  if (!reader.Read(new_subgraph.get())) {
+    LOG(WARNING) << "Ignoring invalid transform cache entry: "
+                 << path.value();
+    return false;
+  }
+
+  *outcome = kTransformed;
+  *time = base::TimeDelta::FromMicroseconds(microseconds);
+  *subgraph = std::move(new_subgraph);
+  data_buffers->splice(data_buffers->end(), new_data_buffers);
+  return true;
+}
+
+bool TransformCache::Store(
+    const std::string& key,
+    const std::vector<BlockGraph::Reference>& external_references,
+    const BlockGraph::Block* block,
+    Outcome outcome,
+    base::TimeDelta time,
+    const BasicBlockSubGraph* subgraph) const {
+  DCHECK_NE(static_cast<const Block*>(nullptr), block);
+  DCHECK_NE(kFailed, outcome);
+  DCHECK_NE(static_cast<const BasicBlockSubGraph*>(nullptr), subgraph);
+
+  std::vector<uint8_t> data;
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(data)));
+  core::NativeBinaryOutArchive out_archive(out_stream.get());
+
+  uint8_t stored_outcome = outcome == kTransformed ?
+      kStoredTransformed : kStoredUnsupportedInstructions;
+  if (!out_archive.Save(key) || !out_archive.Save(stored_outcome) ||
+      !out_archive.Save(time.InMicroseconds())) {
+    return false;
+  }
+  if (outcome == kTransformed) {
+    EntryWriter writer(block, external_references, &out_archive);
+    if (!writer.Write(*subgraph)) {
+      VLOG(1) << "Unable to cache the transformed block: " << block->name();
+      return false;
+    }
+  }
+  if (!out_archive.Flush())
+    return false;
+
+  // Write to a temporary file that then replaces the entry, such that
+  // concurrent readers never see a partial entry.
+  base::FilePath path = GetEntryPath(key);
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(directory_, &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in "
+               << directory_.value() << ".";
+    return false;
+  }
+  int size = static_cast<int>(data.size());
+  if (base::WriteFile(temp_path, reinterpret_cast<const char*>(data.data()),
+                      size) != size ||
+      !base::ReplaceFile(temp_path, path, nullptr)) {
+    LOG(ERROR) << "Unable to write " << path.value() << ".";
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace block_graph
@@ -0,0 +1,182 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares TransformCache, an on-disk cache of the results of basic-block
+// transforms. It allows instrumenting nearly identical images repeatedly
+// without decomposing and transforming the code blocks that didn't change.
+//
+// An entry is keyed by the name and parameters of the transform, and by a
+// digest of everything the decomposition and the transform of a block depend
+// on: its BlockHash, its properties and labels, the structure of its source
+// ranges, the offsets and attributes of its references, and the offsets its
+// referrers refer to. The identity of the referenced blocks isn't part of the
+// key. Instead, the references of the transformed subgraph are stored
+// relative to the references of the original block, or to the references the
+// transform declares it may introduce. Likewise, instructions copied from the
+// original block and source ranges are stored relative to the original
+// block. This way, the entry of a block still applies when the blocks it
+// refers to have moved, and the subgraph read back from it is the one the
+// transform would have produced.
+//
+// Only transforms that opt in through
+// BasicBlockSubGraphTransformInterface::GetCacheParameters are cached, and
+// transformed subgraphs that can't be expressed this way aren't stored.
+
+#ifndef SYZYGY_BLOCK_GRAPH_TRANSFORM_CACHE_H_
+#define SYZYGY_BLOCK_GRAPH_TRANSFORM_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
+#include "base/time/time.h"
+#include "syzygy/block_graph/basic_block_subgraph.h"
+#include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/transform.h"
+#include "syzygy/block_graph/transform_policy.h"
+
+namespace block_graph {
+
+class TransformCache {
+ public:
+  // The outcome of decomposing and transforming a block.
+  enum Outcome {
+    kTransformed,
+    kUnsupportedInstructions,
+    kFailed,
+  };
+
+  // Holds the data of the basic data blocks of subgraphs read from the cache.
+  // This must outlive these subgraphs.
+  typedef std::list<std::vector<uint8_t>> DataBuffers;
+
+  // Statistics about the use of the cache.
+  struct Stats {
+    Stats() : lookups(0), hits(0), stores(0), uncacheable(0) {}
+
+    // The number of blocks looked up, and found, in the cache.
+    size_t lookups;
+    size_t hits;
+    // The number of entries added to the cache.
+    size_t stores;
+    // The number of blocks whose transform or result couldn't be cached.
+    size_t uncacheable;
+    // The time the blocks found in the cache took to decompose and transform
+    // when they were stored, minus the time it took to read them back.
+    base::TimeDelta time_saved;
+  };
+
+  TransformCache();
+  ~TransformCache();
+
+  // Initializes the cache.
+  // @param directory the directory holding the cache entries. It is created
+  //     if it doesn't exist.
+  // @returns true on success, false otherwise.
+  bool Init(const base::FilePath& directory);
+
+  // Decomposes and transforms a block, or reads the result from the cache.
+  // A result that isn't in the cache is stored in it. This may be called
+  // concurrently.
+  // @param transform the transform to apply.
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph the block-graph containing @p block. This isn't
+  //     modified.
+  // @param block the block to transform.
+  // @param subgraph receives the transformed subgraph, when the outcome is
+  //     kTransformed.
+  // @param data_buffers receives data referred to by @p subgraph.
+  // @returns the outcome of decomposing and transforming @p block.
+  Outcome DecomposeAndTransform(BasicBlockSubGraphTransformInterface* transform,
+                                const TransformPolicyInterface* policy,
+                                BlockGraph* block_graph,
+                                const BlockGraph::Block* block,
+                                std::unique_ptr<BasicBlockSubGraph>* subgraph,
+                                DataBuffers* data_buffers);
+
+  // @returns the statistics gathered so far.
+  Stats stats() const;
+
+  // Logs the statistics gathered so far.
+  void LogStats() const;
+
+  // @returns the directory holding the cache entries.
+  const base::FilePath& directory() const { return directory_; }
+
+ protected:
+  // Computes the key of the entry of a transformed block.
+  // @param transform the transform.
+  // @param block_graph the block-graph containing @p block.
+  // @param block the block.
+  // @param key receives the key.
+  // @returns true if the output of @p transform may be cached, false
+  //     otherwise.
+  bool GetKey(const BasicBlockSubGraphTransformInterface* transform,
+              const BlockGraph* block_graph,
+              const BlockGraph::Block* block,
+              std::string* key) const;
+
+  // @returns the path of the file holding the entry of @p key.
+  base::FilePath GetEntryPath(const std::string& key) const;
+
+  // Reads an entry from the cache.
+  // @param key the key of the entry.
+  // @param external_references the references declared by the transform.
+  // @param block the block being transformed.
+  // @param outcome receives the outcome stored in the entry.
+  // @param time receives the time the result took to produce.
+  // @param subgraph receives the transformed subgraph.
+  // @param data_buffers receives data referred to by @p subgraph.
+  // @returns true on a hit, false otherwise.
+  bool Lookup(const std::string& key,
+              const std::vector<BlockGraph::Reference>& external_references,
+              const BlockGraph::Block* block,
+              Outcome* outcome,
+              base::TimeDelta* time,
+              std::unique_ptr<BasicBlockSubGraph>* subgraph,
+              DataBuffers* data_buffers) const;
+
+  // Writes an entry to the cache.
+  // @param key the key of the entry.
+  // @param external_references the references declared by the transform.
+  // @param block the block being transformed.
+  // @param outcome the outcome of decomposing and transforming @p block.
+  // @param time the time the result took to produce.
+  // @param subgraph the transformed subgraph, if @p outcome is kTransformed.
+  // @returns true if the entry was written, false if the result can't be
+  //     cached or on error.
+  bool Store(const std::string& key,
+             const std::vector<BlockGraph::Reference>& external_references,
+             const BlockGraph::Block* block,
+             Outcome outcome,
+             base::TimeDelta time,
+             const BasicBlockSubGraph* subgraph) const;
+
+  base::FilePath directory_;
+
+  mutable base::Lock lock_;
+  Stats stats_;  // Under lock_.
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TransformCache);
+};
+
+}  // namespace block_graph
+
+#endif  // SYZYGY_BLOCK_GRAPH_TRANSFORM_CACHE_H_
@@ -0,0 +1,441 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/block_graph/transform_cache.h"
+
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/files/file_enumerator.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/stringprintf.h"
+#include "gtest/gtest.h"
+#include "syzygy/block_graph/basic_block_assembler.h"
+#include "syzygy/block_graph/block_graph_serializer.h"
+#include "syzygy/block_graph/parallel_transform.h"
+#include "syzygy/block_graph/unittest_util.h"
+
+namespace block_graph {
+
+namespace {
+
+using testing::DummyTransformPolicy;
+
+// The code of each function in the test graph:
+//
+//     call <next function>
+//     mov eax, dword ptr [<datum>]
+//     ret
+const uint8_t kCodeBytes[] = {
+    0xE8, 0x00, 0x00, 0x00, 0x00,  // call <next function>
+    0xA1, 0x00, 0x00, 0x00, 0x00,  // mov eax, dword ptr [<datum>]
+    0xC3,                          // ret
+};
+const BlockGraph::Offset kOffsetOfCallTarget = 1;
+const BlockGraph::Offset kOffsetOfDatum = 6;
+
+// The code of the functions that dispatch through a jump table, which
+// decompose to basic data blocks as well as code blocks:
+//
+//     mov eax, dword ptr [<datum>]
+//     jmp dword ptr [eax * 4 + <jump table>]
+//   case_0:
+//     ret
+//   case_1:
+//     xor eax, eax
+//     ret
+//   jump_table:
+//     dd case_0, case_1
+const uint8_t kSwitchBytes[] = {
+    0xA1, 0x00, 0x00, 0x00, 0x00,              // mov eax, dword ptr [<datum>]
+    0xFF, 0x24, 0x85, 0x00, 0x00, 0x00, 0x00,  // jmp [eax * 4 + <table>]
+    0xC3,                                      // case_0: ret
+    0x33, 0xC0,                                // case_1: xor eax, eax
+    0xC3,                                      // ret
+    0x00, 0x00, 0x00, 0x00,                    // jump_table: dd case_0
+    0x00, 0x00, 0x00, 0x00,                    // dd case_1
+};
+const BlockGraph::Offset kSwitchOffsetOfDatum = 1;
+const BlockGraph::Offset kSwitchOffsetOfJumpTableRef = 8;
+const BlockGraph::Offset kSwitchOffsetOfCase0 = 12;
+const BlockGraph::Offset kSwitchOffsetOfCase1 = 13;
+const BlockGraph::Offset kSwitchOffsetOfJumpTable = 16;
+
+const char kHookName[] = "Hook";
+
+// A transform that inserts a call to a hook at the start of every basic code
+// block.
+class HookInsertingTransform : public BasicBlockSubGraphTransformInterface {
+ public:
+  // @param hook the hook to call.
+  // @param parameters the cache parameters, or NULL if the transform isn't
+  //     cacheable.
+  HookInsertingTransform(BlockGraph::Block* hook, const char* parameters)
+      : hook_(hook), parameters_(parameters) {}
+
+  const char* name() const override { return "HookInsertingTransform"; }
+
+  bool TransformBasicBlockSubGraph(const TransformPolicyInterface* policy,
+                                   BlockGraph* block_graph,
+                                   BasicBlockSubGraph* subgraph) override {
+    BasicBlockSubGraph::BBCollection::iterator it =
+        subgraph->basic_blocks().begin();
+    for (; it != subgraph->basic_blocks().end(); ++it) {
+      BasicCodeBlock* bb = BasicCodeBlock::Cast(*it);
+      if (bb == NULL)
+        continue;
+      BasicBlockAssembler assm(bb->instructions().begin(),
+                               &bb->instructions());
+      assm.call(Operand(Displacement(hook_, 0)));
+    }
+    return true;
+  }
+
+  bool GetCacheParameters(std::string* parameters) const override {
+    if (parameters_ == NULL)
+      return false;
+    *parameters = parameters_;
+    return true;
+  }
+
+  void GetCacheExternalReferences(
+      std::vector<BlockGraph::Reference>* references) const override {
+    references->push_back(
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                              BlockGraph::Reference::kMaximumSize, hook_, 0,
+                              0));
+  }
+
+ private:
+  BlockGraph::Block* hook_;
+  const char* parameters_;
+
+  DISALLOW_COPY_AND_ASSIGN(HookInsertingTransform);
+};
+
+class TransformCacheTest : public testing::Test {
+ public:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    cache_dir_ = temp_dir_.path().AppendASCII("cache");
+  }
+
+  // Builds a graph of @p num_functions functions. Every third function
+  // dispatches through a jump table. The others call function i + 1 when i
+  // is even, or themselves when i is odd. All functions read the same datum.
+  // The graph also contains the hook called by the transform.
+  static void BuildGraph(size_t num_functions, BlockGraph* block_graph) {
+    BlockGraph::Section* text = block_graph->AddSection(".text", 0);
+    BlockGraph::Section* data = block_graph->AddSection(".data", 0);
+
+    BlockGraph::Block* datum =
+        block_graph->AddBlock(BlockGraph::DATA_BLOCK, 4, "Datum");
+    datum->set_section(data->id());
+    datum->AllocateData(4);
+
+    BlockGraph::Block* hook =
+        block_graph->AddBlock(BlockGraph::DATA_BLOCK, 4, kHookName);
+    hook->set_section(data->id());
+    hook->AllocateData(4);
+
+    std::vector<BlockGraph::Block*> functions;
+    for (size_t i = 0; i < num_functions; ++i) {
+      std::string name = base::StringPrintf("Function%d", static_cast<int>(i));
+      if (IsSwitchFunction(i)) {
+        ASSERT_NO_FATAL_FAILURE(
+            AddSwitchFunction(name, text, datum, block_graph, &functions));
+        continue;
+      }
+      BlockGraph::Block* function = block_graph->AddBlock(
+          BlockGraph::CODE_BLOCK, sizeof(kCodeBytes), name);
+      function->set_section(text->id());
+      function->SetData(kCodeBytes, sizeof(kCodeBytes));
+      ASSERT_TRUE(function->SetLabel(
+          0, BlockGraph::Label(function->name(), BlockGraph::CODE_LABEL)));
+      functions.push_back(function);
+    }
+
+    for (size_t i = 0; i < num_functions; ++i) {
+      if (IsSwitchFunction(i))
+        continue;
+      BlockGraph::Block* callee = functions[i];
+      if (i % 2 == 0)
+        callee = functions[(i + 1) % num_functions];
+      ASSERT_TRUE(functions[i]->SetReference(
+          kOffsetOfCallTarget,
+          BlockGraph::Reference(BlockGraph::PC_RELATIVE_REF,
+                                BlockGraph::Reference::kMaximumSize, callee,
+                                0, 0)));
+      ASSERT_TRUE(functions[i]->SetReference(
+          kOffsetOfDatum,
+          BlockGraph::Reference(BlockGraph::ABSOLUTE_REF,
+                                BlockGraph::Reference::kMaximumSize, datum,
+                                0, 0)));
+    }
+  }
+
+  static bool IsSwitchFunction(size_t index) { return index % 3 == 2; }
+
+  // Adds a function that dispatches through a jump table to @p block_graph,
+  // and appends it to @p functions.
+  static void AddSwitchFunction(const std::string& name,
+                                BlockGraph::Section* text,
+                                BlockGraph::Block* datum,
+                                BlockGraph* block_graph,
+                                std::vector<BlockGraph::Block*>* functions) {
+    BlockGraph::Block* function = block_graph->AddBlock(
+        BlockGraph::CODE_BLOCK, sizeof(kSwitchBytes), name);
+    function->set_section(text->id());
+    function->set_alignment(4);
+    function->SetData(kSwitchBytes, sizeof(kSwitchBytes));
+    ASSERT_TRUE(function->SetLabel(
+        0, BlockGraph::Label(name, BlockGraph::CODE_LABEL)));
+    ASSERT_TRUE(function->SetLabel(
+        kSwitchOffsetOfJumpTable,
+        BlockGraph::Label("jump_table", BlockGraph::DATA_LABEL |
+                                            BlockGraph::JUMP_TABLE_LABEL)));
+
+    const BlockGraph::Size kSize = BlockGraph::Reference::kMaximumSize;
+    ASSERT_TRUE(function->SetReference(
+        kSwitchOffsetOfDatum,
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, kSize, datum, 0, 0)));
+    ASSERT_TRUE(function->SetReference(
+        kSwitchOffsetOfJumpTableRef,
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, kSize, function,
+                              kSwitchOffsetOfJumpTable,
+                              kSwitchOffsetOfJumpTable)));
+    ASSERT_TRUE(function->SetReference(
+        kSwitchOffsetOfJumpTable,
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, kSize, function,
+                              kSwitchOffsetOfCase0, kSwitchOffsetOfCase0)));
+    ASSERT_TRUE(function->SetReference(
+        kSwitchOffsetOfJumpTable + kSize,
+        BlockGraph::Reference(BlockGraph::ABSOLUTE_REF, kSize, function,
+                              kSwitchOffsetOfCase1, kSwitchOffsetOfCase1)));
+    functions->push_back(function);
+  }
+
+  // Applies the transform to the code blocks of @p block_graph, one block at
+  // a time.
+  bool ApplySerially(const char* parameters,
+                     TransformCache* cache,
+                     BlockGraph* block_graph) {
+    BlockGraph::Block* hook = FindHook(block_graph);
+    std::vector<BlockGraph::BlockId> ids;
+    for (const auto& entry : block_graph->blocks()) {
+      if (entry.second.type() == BlockGraph::CODE_BLOCK)
+        ids.push_back(entry.first);
+    }
+
+    for (BlockGraph::BlockId id : ids) {
+      HookInsertingTransform transform(hook, parameters);
+      if (!ApplyBasicBlockSubGraphTransform(&transform, &policy_, block_graph,
+                                            block_graph->GetBlockById(id),
+                                            NULL, cache)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static BlockGraph::Block* FindHook(BlockGraph* block_graph) {
+    for (auto& entry : block_graph->blocks_mutable()) {
+      if (entry.second.name() == kHookName)
+        return &entry.second;
+    }
+    return NULL;
+  }
+
+  // @returns the number of entries in the cache directory.
+  size_t CountEntries() {
+    base::FileEnumerator enumerator(cache_dir_, false,
+                                    base::FileEnumerator::FILES);
+    size_t count = 0;
+    while (!enumerator.Next().empty())
+      ++count;
+    return count;
+  }
+
+  static bool GraphsEqual(const BlockGraph& expected,
+                          const BlockGraph& actual) {
+    BlockGraphSerializer serializer;
+    return testing::BlockGraphsEqual(expected, actual, serializer);
+  }
+
+ protected:
+  DummyTransformPolicy policy_;
+  base::ScopedTempDir temp_dir_;
+  base::FilePath cache_dir_;
+};
+
+// Creates the transform applied by the parallel tests.
+BasicBlockSubGraphTransformInterface* CreateHookTransform(
+    BlockGraph* block_graph, BlockGraph::Block* block) {
+  if (block->type() != BlockGraph::CODE_BLOCK)
+    return NULL;
+  return new HookInsertingTransform(TransformCacheTest::FindHook(block_graph),
+                                    "parameters");
+}
+
+}  // namespace
+
+TEST_F(TransformCacheTest, WarmRunMatchesColdRun) {
+  const size_t kNumFunctions = 10;
+
+  BlockGraph uncached_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &uncached_graph));
+  ASSERT_TRUE(ApplySerially("parameters", NULL, &uncached_graph));
+
+  // A cold run stores every block.
+  BlockGraph cold_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &cold_graph));
+  {
+    TransformCache cache;
+    ASSERT_TRUE(cache.Init(cache_dir_));
+    ASSERT_TRUE(ApplySerially("parameters", &cache, &cold_graph));
+
+    TransformCache::Stats stats = cache.stats();
+    EXPECT_EQ(kNumFunctions, stats.lookups);
+    EXPECT_EQ(0u, stats.hits);
+    EXPECT_EQ(kNumFunctions, stats.stores);
+    EXPECT_EQ(0u, stats.uncacheable);
+  }
+  EXPECT_EQ(kNumFunctions, CountEntries());
+  EXPECT_TRUE(GraphsEqual(uncached_graph, cold_graph));
+
+  // A warm run finds every block, and produces the same graph.
+  BlockGraph warm_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &warm_graph));
+  {
+    TransformCache cache;
+    ASSERT_TRUE(cache.Init(cache_dir_));
+    ASSERT_TRUE(ApplySerially("parameters", &cache, &warm_graph));
+
+    TransformCache::Stats stats = cache.stats();
+    EXPECT_EQ(kNumFunctions, stats.lookups);
+    EXPECT_EQ(kNumFunctions, stats.hits);
+    EXPECT_EQ(0u, stats.stores);
+    EXPECT_EQ(0u, stats.uncacheable);
+  }
+  EXPECT_TRUE(GraphsEqual(uncached_graph, warm_graph));
+}
+
+TEST_F(TransformCacheTest, ParametersArePartOfTheKey) {
+  const size_t kNumFunctions = 4;
+
+  BlockGraph cold_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &cold_graph));
+  TransformCache cache;
+  ASSERT_TRUE(cache.Init(cache_dir_));
+  ASSERT_TRUE(ApplySerially("parameters", &cache, &cold_graph));
+
+  BlockGraph other_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &other_graph));
+  ASSERT_TRUE(ApplySerially("other parameters", &cache, &other_graph));
+
+  TransformCache::Stats stats = cache.stats();
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(2 * kNumFunctions, stats.stores);
+  EXPECT_EQ(2 * kNumFunctions, CountEntries());
+}
+
+TEST_F(TransformCacheTest, UncacheableTransformIsNotCached) {
+  const size_t kNumFunctions = 4;
+
+  BlockGraph uncached_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &uncached_graph));
+  ASSERT_TRUE(ApplySerially(NULL, NULL, &uncached_graph));
+
+  BlockGraph block_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &block_graph));
+  TransformCache cache;
+  ASSERT_TRUE(cache.Init(cache_dir_));
+  ASSERT_TRUE(ApplySerially(NULL, &cache, &block_graph));
+
+  TransformCache::Stats stats = cache.stats();
+  EXPECT_EQ(0u, stats.lookups);
+  EXPECT_EQ(0u, stats.stores);
+  EXPECT_EQ(kNumFunctions, stats.uncacheable);
+  EXPECT_EQ(0u, CountEntries());
+  EXPECT_TRUE(GraphsEqual(uncached_graph, block_graph));
+}
+
+TEST_F(TransformCacheTest, TruncatedEntriesAreMisses) {
+  const size_t kNumFunctions = 4;
+
+  BlockGraph cold_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &cold_graph));
+  {
+    TransformCache cache;
+    ASSERT_TRUE(cache.Init(cache_dir_));
+    ASSERT_TRUE(ApplySerially("parameters", &cache, &cold_graph));
+  }
+
+  // Truncate the entries after their key.
+  base::FileEnumerator enumerator(cache_dir_, false,
+                                  base::FileEnumerator::FILES);
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    std::string contents;
+    ASSERT_TRUE(base::ReadFileToString(path, &contents));
+    contents.resize(contents.size() - 8);
+    ASSERT_EQ(static_cast<int>(contents.size()),
+              base::WriteFile(path, contents.data(),
+                              static_cast<int>(contents.size())));
+  }
+
+  BlockGraph warm_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &warm_graph));
+  TransformCache cache;
+  ASSERT_TRUE(cache.Init(cache_dir_));
+  ASSERT_TRUE(ApplySerially("parameters", &cache, &warm_graph));
+
+  // The entries are rewritten.
+  TransformCache::Stats stats = cache.stats();
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(kNumFunctions, stats.stores);
+  EXPECT_TRUE(GraphsEqual(cold_graph, warm_graph));
+}
+
+TEST_F(TransformCacheTest, ParallelWarmRunMatchesColdRun) {
+  const size_t kNumFunctions = 100;
+
+  BlockGraph cold_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &cold_graph));
+  {
+    TransformCache cache;
+    ASSERT_TRUE(cache.Init(cache_dir_));
+    ASSERT_TRUE(ApplyBasicBlockSubGraphTransformsInParallel(
+        base::Bind(&CreateHookTransform), &policy_, 4, &cold_graph, &cache,
+        NULL));
+    EXPECT_EQ(kNumFunctions, cache.stats().stores);
+  }
+
+  BlockGraph warm_graph;
+  ASSERT_NO_FATAL_FAILURE(BuildGraph(kNumFunctions, &warm_graph));
+  {
+    TransformCache cache;
+    ASSERT_TRUE(cache.Init(cache_dir_));
+    ASSERT_TRUE(ApplyBasicBlockSubGraphTransformsInParallel(
+        base::Bind(&CreateHookTransform), &policy_, 4, &warm_graph, &cache,
+        NULL));
+    EXPECT_EQ(kNumFunctions, cache.stats().hits);
+  }
+
+  EXPECT_TRUE(GraphsEqual(cold_graph, warm_graph));
+}
+
+}  // namespace block_graph
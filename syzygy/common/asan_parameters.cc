@@ -169,6 +169,7 @@ const bool kDefaultEnableZebraBlockHeap = false;
 const bool kDefaultEnableAllocationFilter = false;
 const float kDefaultQuarantineFloodFillRate = 0.5f;
 const bool kDefaultPreventDuplicateCorruptionCrashes = false;
+const uint32_t kDefaultChecksumSamplingThreshold = 0;
 
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap = true;
@@ -216,6 +217,7 @@ const char kParamEnableAllocationFilter[] = "enable_allocation_filter";
 const char kParamQuarantineFloodFillRate[] = "quarantine_flood_fill_rate";
 const char kParamPreventDuplicateCorruptionCrashes[] =
     "prevent_duplicate_corruption_crashes";
+const char kParamChecksumSamplingThreshold[] = "checksum_sampling_threshold";
 
 // String names of LargeBlockHeap parameters.
 const char kParamDisableLargeBlockHeap[] = "disable_large_block_heap";
@@ -303,13 +305,15 @@ void SetDefaultAsanParameters(AsanParameters* asan_parameters) {
   asan_parameters->prevent_duplicate_corruption_crashes =
       kDefaultPreventDuplicateCorruptionCrashes;
   asan_parameters->report_invalid_accesses = kDefaultReportInvalidAccesses;
+  asan_parameters->checksum_sampling_threshold =
+      kDefaultChecksumSamplingThreshold;
 }
 
 bool InflateAsanParameters(const AsanParameters* pod_params,
                            InflatedAsanParameters* inflated_params) {
   // This must be kept up to date with AsanParameters as it evolves.
   static const size_t kSizeOfAsanParametersByVersion[] = {
-      40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 60, 60, 60, 60, 60};
+      40, 44, 48, 52, 52, 52, 56, 56, 56, 56, 60, 60, 60, 60, 60, 64};
   static_assert(
       arraysize(kSizeOfAsanParametersByVersion) == kAsanParametersVersion + 1,
       "Size of parameters version out of date.");
@@ -489,6 +493,13 @@ bool ParseAsanParameters(const base::StringPiece16& param_string,
     return false;
   }
 
+  // Parse the checksum sampling threshold.
+  if (UpdateUint32FromCommandLine::Do(cmd_line,
+          kParamChecksumSamplingThreshold,
+          &asan_parameters->checksum_sampling_threshold) == kFlagError) {
+    return false;
+  }
+
   // Parse the other (boolean) flags.
   // TODO(chrisha): Transition these all to new style flags.
   if (cmd_line.HasSwitch(kParamMiniDumpOnFailure))
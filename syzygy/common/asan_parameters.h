@@ -145,27 +145,34 @@ struct AsanParameters {
   // 0.0 corresponds to this being disabled entirely.
   float quarantine_flood_fill_rate;
 
+  // The body size above which the checksums of quarantined and freed blocks
+  // only cover a sample of the block body, rather than the entire body. This
+  // bounds the cost of moving large blocks in and out of the quarantine, at
+  // the expense of missing some write-after-frees to them. A value of 0
+  // disables sampling.
+  uint32_t checksum_sampling_threshold;
+
   // Add new parameters here!
 
   // When laid out in memory the ignored_stack_ids are present here as a NULL
   // terminated vector.
 };
 #ifndef _WIN64
-COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 60);
-#else
 COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 64);
+#else
+COMPILE_ASSERT_IS_POD_OF_SIZE(AsanParameters, 68);
 #endif
 
 // The current version of the Asan parameters structure. This must be updated
 // if any changes are made to the above structure! This is defined in the header
 // file to allow compile time assertions against this version number.
-const uint32_t kAsanParametersVersion = 14;
+const uint32_t kAsanParametersVersion = 15;
 
 // If the number of free bits in the parameters struct changes, then the
 // version has to change as well. This is simply here to make sure that
 // everything changes in lockstep.
 static_assert(kAsanParametersReserved1Bits == 20 &&
-                  kAsanParametersVersion == 14,
+                  kAsanParametersVersion == 15,
               "Version must change if reserved bits changes.");
 
 // The name of the section that will be injected into an instrumented image,
@@ -248,6 +255,7 @@ extern const bool kDefaultEnableZebraBlockHeap;
 extern const bool kDefaultEnableAllocationFilter;
 extern const float kDefaultQuarantineFloodFillRate;
 extern const bool kDefaultPreventDuplicateCorruptionCrashes;
+extern const uint32_t kDefaultChecksumSamplingThreshold;
 // Default values of LargeBlockHeap parameters.
 extern const bool kDefaultEnableLargeBlockHeap;
 extern const size_t kDefaultLargeAllocationThreshold;
@@ -284,6 +292,7 @@ extern const char kParamEnableZebraBlockHeap[];
 extern const char kParamEnableAllocationFilter[];
 extern const char kParamQuarantineFloodFillRate[];
 extern const char kParamPreventDuplicateCorruptionCrashes[];
+extern const char kParamChecksumSamplingThreshold[];
 // String names of LargeBlockHeap parameters.
 extern const char kParamDisableLargeBlockHeap[];
 extern const char kParamLargeAllocationThreshold[];
@@ -90,6 +90,8 @@ TEST(AsanParametersTest, SetDefaultAsanParameters) {
             aparams.large_allocation_threshold);
   EXPECT_EQ(kDefaultQuarantineFloodFillRate,
             aparams.quarantine_flood_fill_rate);
+  EXPECT_EQ(kDefaultChecksumSamplingThreshold,
+            aparams.checksum_sampling_threshold);
   EXPECT_EQ(kDefaultFeatureRandomization,
             static_cast<bool>(aparams.feature_randomization));
   EXPECT_EQ(kDefaultPreventDuplicateCorruptionCrashes,
@@ -245,6 +247,8 @@ TEST(AsanParametersTest, ParseAsanParametersMinimal) {
             iparams.large_allocation_threshold);
   EXPECT_EQ(kDefaultQuarantineFloodFillRate,
             iparams.quarantine_flood_fill_rate);
+  EXPECT_EQ(kDefaultChecksumSamplingThreshold,
+            iparams.checksum_sampling_threshold);
   EXPECT_EQ(kDefaultFeatureRandomization,
             static_cast<bool>(iparams.feature_randomization));
   EXPECT_EQ(kDefaultPreventDuplicateCorruptionCrashes,
@@ -276,6 +280,7 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
       L"--enable_allocation_filter "
       L"--large_allocation_threshold=4096 "
       L"--quarantine_flood_fill_rate=0.25 "
+      L"--checksum_sampling_threshold=65536 "
       L"--enable_feature_randomization "
       L"--prevent_duplicate_corruption_crashes "
       L"--report_invalid_accesses";
@@ -309,6 +314,7 @@ TEST(AsanParametersTest, ParseAsanParametersMaximal) {
   EXPECT_TRUE(static_cast<bool>(iparams.enable_allocation_filter));
   EXPECT_EQ(4096, iparams.large_allocation_threshold);
   EXPECT_EQ(0.25f, iparams.quarantine_flood_fill_rate);
+  EXPECT_EQ(65536, iparams.checksum_sampling_threshold);
   EXPECT_EQ(true, static_cast<bool>(iparams.feature_randomization));
   EXPECT_EQ(true, static_cast<bool>(
       iparams.prevent_duplicate_corruption_crashes));
@@ -64,4 +64,23 @@ bool GetProcessModules(HANDLE process, ModuleVector* modules) {
   }
 }
 
+bool GetCurrentProcessPeakMemoryUsage(size_t* peak_working_set,
+                                      size_t* peak_commit) {
+  DCHECK(peak_working_set != NULL);
+  DCHECK(peak_commit != NULL);
+
+  PROCESS_MEMORY_COUNTERS counters = {};
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "GetProcessMemoryInfo failed: " << ::common::LogWe(error)
+               << ".";
+    return false;
+  }
+
+  *peak_working_set = counters.PeakWorkingSetSize;
+  *peak_commit = counters.PeakPagefileUsage;
+  return true;
+}
+
 }  // namespace common
@@ -43,6 +43,14 @@ bool GetCurrentProcessModules(ModuleVector* modules);
 //     this function is therefore inherently racy.
 bool GetProcessModules(HANDLE process, ModuleVector* modules);
 
+// Retrieves the peak memory usage of the current process.
+// @param peak_working_set returns the peak working set size, in bytes.
+// @param peak_commit returns the peak amount of private memory committed, in
+//     bytes.
+// @returns true on success, false otherwise.
+bool GetCurrentProcessPeakMemoryUsage(size_t* peak_working_set,
+                                      size_t* peak_commit);
+
 }  // namespace common
 
 #endif  // SYZYGY_COMMON_PROCESS_UTILS_H_
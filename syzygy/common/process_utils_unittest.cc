@@ -35,4 +35,13 @@ TEST(ProcessUtilsTest, GetCurrentProcessModules) {
   EXPECT_LT(1U, modules.size());
 }
 
+TEST(ProcessUtilsTest, GetCurrentProcessPeakMemoryUsage) {
+  size_t peak_working_set = 0;
+  size_t peak_commit = 0;
+  ASSERT_TRUE(
+      GetCurrentProcessPeakMemoryUsage(&peak_working_set, &peak_commit));
+  EXPECT_LT(0U, peak_working_set);
+  EXPECT_LT(0U, peak_commit);
+}
+
 }  // namespace common
@@ -32,20 +32,31 @@
 #include "base/logging.h"
 #include "syzygy/core/address_range.h"
 #include "syzygy/core/address_space_internal.h"
+#include "syzygy/core/flat_range_map.h"
 #include "syzygy/core/serialization.h"
 
 namespace core {
 
 // An address space is a mapping from a set of non-overlapping address ranges
 // (AddressSpace::Range), each of non-zero size, to an ItemType.
-template <typename AddressType, typename SizeType, typename ItemType>
+//
+// The ranges are stored in a RangeMapType, which defaults to a std::map. A
+// FlatRangeMap may be used instead (see FlatAddressSpace below) for address
+// spaces that are mostly read once built. It is much more cache friendly, but
+// insertions and removals invalidate iterators and are linear in the size of
+// the address space unless done in address order, or through BulkInsert.
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType =
+              std::map<AddressRange<AddressType, SizeType>, ItemType>>
 class AddressSpace {
  public:
   // Typedef we use for convenience throughout.
   typedef AddressRange<AddressType, SizeType> Range;
-  typedef std::map<Range, ItemType> RangeMap;
-  typedef typename std::map<Range, ItemType>::iterator RangeMapIter;
-  typedef typename std::map<Range, ItemType>::const_iterator RangeMapConstIter;
+  typedef RangeMapType RangeMap;
+  typedef typename RangeMap::iterator RangeMapIter;
+  typedef typename RangeMap::const_iterator RangeMapConstIter;
   typedef std::pair<RangeMapConstIter, RangeMapConstIter> RangeMapConstIterPair;
   typedef std::pair<RangeMapIter, RangeMapIter> RangeMapIterPair;
 
@@ -69,6 +80,15 @@ class AddressSpace {
               const ItemType& item,
               typename RangeMap::iterator* ret_it = NULL);
 
+  // Inserts a collection of ranges at once. This is much faster than
+  // individual insertions for flat range maps. The insertion is all or
+  // nothing: it fails if any range is empty, or intersects another range of
+  // @p items or an existing range.
+  // @param items the ranges to insert, and their associated items. This is
+  //     sorted in place.
+  // @returns true iff all of @p items were inserted.
+  bool BulkInsert(std::vector<std::pair<Range, ItemType>>* items);
+
   // Insert @p range mapping to @p item or return the existing item exactly
   // matching @p range.
   //
@@ -139,6 +159,11 @@ class AddressSpace {
   // Remove all items from the address space.
   void Clear() { ranges_.clear(); }
 
+  // Builds a read-optimized search index over the ranges. This is only
+  // available when RangeMapType is a FlatRangeMap. The index is discarded by
+  // the next insertion or removal.
+  void Freeze() { ranges_.Freeze(); }
+
   const RangeMap& ranges() const { return ranges_; }
   const bool empty() const { return ranges_.empty(); }
   const size_t size() const { return ranges_.size(); }
@@ -191,6 +216,16 @@ class AddressSpace {
   RangeMap ranges_;
 };
 
+// An address space whose ranges are stored in a sorted vector. It is best
+// suited to address spaces that are built in address order, or in bulk, and
+// are then mostly searched.
+template <typename AddressType, typename SizeType, typename ItemType>
+using FlatAddressSpace =
+    AddressSpace<AddressType,
+                 SizeType,
+                 ItemType,
+                 FlatRangeMap<AddressRange<AddressType, SizeType>, ItemType>>;
+
 // An AddressRangeMap is used for keeping track of data in one address space
 // that has some relationship with data in another address space. Mappings are
 // stored as pairs of addresses, one from the 'source' address-space and one
@@ -385,12 +420,18 @@ class AddressRangeMap {
   RangePairs range_pairs_;
 };
 
-template <typename AddressType, typename SizeType, typename ItemType>
-AddressSpace<AddressType, SizeType, ItemType>::AddressSpace() {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::AddressSpace() {
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Insert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -412,8 +453,37 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Insert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::BulkInsert(
+    std::vector<std::pair<Range, ItemType>>* items) {
+  DCHECK(items != NULL);
+
+  std::sort(items->begin(), items->end(),
+            internal::RangeItemPairLess<Range, ItemType>());
+
+  // Validate everything up front so that the insertion is all or nothing.
+  for (size_t i = 0; i < items->size(); ++i) {
+    const Range& range = (*items)[i].first;
+    if (range.IsEmpty())
+      return false;
+    if (i > 0 && (*items)[i - 1].first.Intersects(range))
+      return false;
+    if (FindFirstIntersection(range) != ranges_.end())
+      return false;
+  }
+
+  ranges_.insert(items->begin(), items->end());
+  return true;
+}
+
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindOrInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -439,8 +509,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::FindOrInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::SubsumeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -495,8 +568,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::SubsumeInsert(
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+void AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::MergeInsert(
     const Range& range,
     const ItemType& item,
     typename RangeMap::iterator* ret_it) {
@@ -540,8 +616,12 @@ void AddressSpace<AddressType, SizeType, ItemType>::MergeInsert(
   return;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Remove(
+    const Range& range) {
   // We can't remove empty ranges.
   if (range.IsEmpty())
     return false;
@@ -554,17 +634,25 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Remove(const Range& range) {
   return true;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
-    const Range& range) const {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    RangeMapConstIter
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    FindFirstIntersection(const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindFirstIntersection(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
-    const Range& range) {
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    RangeMapIter
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    FindFirstIntersection(const Range& range) {
   // Empty items do not exist in the address-space.
   if (range.IsEmpty())
     return ranges_.end();
@@ -593,16 +681,24 @@ AddressSpace<AddressType, SizeType, ItemType>::FindFirstIntersection(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapConstIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    RangeMapConstIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) const {
   return const_cast<AddressSpace*>(this)->FindIntersecting(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMapIterPair
-AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    RangeMapIterPair
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindIntersecting(
     const Range& range) {
   // Empty ranges find nothing.
   if (range.IsEmpty())
@@ -630,15 +726,22 @@ AddressSpace<AddressType, SizeType, ItemType>::FindIntersecting(
   return std::make_pair(begin, end);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Intersects(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Intersects(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   return (its.first != its.second);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::ContainsExactly(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -646,8 +749,11 @@ bool AddressSpace<AddressType, SizeType, ItemType>::ContainsExactly(
   return its.first->first == range;
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+bool AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::Contains(
     const Range& range) const {
   RangeMapConstIterPair its = FindIntersecting(range);
   if (its.first == its.second)
@@ -655,9 +761,13 @@ bool AddressSpace<AddressType, SizeType, ItemType>::Contains(
   return its.first->first.Contains(range);
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::const_iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    RangeMapConstIter
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) const {
   // If there is a containing range, it must be the first intersection.
   RangeMap::const_iterator it(FindFirstIntersection(range));
@@ -667,9 +777,13 @@ AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
   return ranges_.end();
 }
 
-template <typename AddressType, typename SizeType, typename ItemType>
-typename AddressSpace<AddressType, SizeType, ItemType>::RangeMap::iterator
-AddressSpace<AddressType, SizeType, ItemType>::FindContaining(
+template <typename AddressType,
+          typename SizeType,
+          typename ItemType,
+          typename RangeMapType>
+typename AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::
+    RangeMapIter
+AddressSpace<AddressType, SizeType, ItemType, RangeMapType>::FindContaining(
     const Range& range) {
   // If there is a containing range, it must be the first intersection.
   RangeMap::iterator it(FindFirstIntersection(range));
@@ -67,6 +67,17 @@ struct CompleteAddressRangePairLess {
   }
 };
 
+// A comparison functor for std::pair<AddressRange, ItemType> that only
+// compares the ranges. This is used to sort the items passed to
+// AddressSpace::BulkInsert.
+template <typename AddressRangeType, typename ItemType>
+struct RangeItemPairLess {
+  bool operator()(const std::pair<AddressRangeType, ItemType>& pair1,
+                  const std::pair<AddressRangeType, ItemType>& pair2) const {
+    return pair1.first < pair2.first;
+  }
+};
+
 }  // namespace internal
 
 }  // namespace core
@@ -15,6 +15,8 @@
 #include "syzygy/core/address_space.h"
 
 #include <limits>
+#include <vector>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -40,6 +42,7 @@ std::ostream& operator<<(std::ostream& os,
 
 typedef AddressSpace<const uint8_t*, size_t, void*> PointerAddressSpace;
 typedef AddressSpace<size_t, size_t, void*> IntegerAddressSpace;
+typedef FlatAddressSpace<size_t, size_t, void*> FlatIntegerAddressSpace;
 
 TEST(AddressSpaceTest, Create) {
   PointerAddressSpace pointer_space;
@@ -396,6 +399,153 @@ TEST(AddressSpaceTest, FindIntersecting) {
   EXPECT_TRUE(it_pair.first == address_space.ranges().end());
 }
 
+TEST(AddressSpaceTest, BulkInsert) {
+  IntegerAddressSpace address_space;
+  void* item = "Something to point at";
+
+  EXPECT_TRUE(address_space.Insert(IntegerAddressSpace::Range(100, 10), item));
+
+  std::vector<std::pair<IntegerAddressSpace::Range, void*>> items;
+  items.push_back(std::make_pair(IntegerAddressSpace::Range(120, 10), item));
+  items.push_back(std::make_pair(IntegerAddressSpace::Range(110, 5), item));
+  items.push_back(std::make_pair(IntegerAddressSpace::Range(90, 10), item));
+  EXPECT_TRUE(address_space.BulkInsert(&items));
+  EXPECT_EQ(4u, address_space.size());
+  EXPECT_TRUE(address_space.ContainsExactly(90, 10));
+  EXPECT_TRUE(address_space.ContainsExactly(110, 5));
+  EXPECT_TRUE(address_space.ContainsExactly(120, 10));
+
+  // Ranges intersecting existing ranges should be rejected.
+  items.clear();
+  items.push_back(std::make_pair(IntegerAddressSpace::Range(200, 10), item));
+  items.push_back(std::make_pair(IntegerAddressSpace::Range(125, 10), item));
+  EXPECT_FALSE(address_space.BulkInsert(&items));
+  EXPECT_EQ(4u, address_space.size());
+
+  // Ranges intersecting one another should be rejected.
+  items.clear();
+  items.push_back(std::make_pair(IntegerAddressSpace::Range(200, 10), item));
+  items.push_back(std::make_pair(IntegerAddressSpace::Range(205, 10), item));
+  EXPECT_FALSE(address_space.BulkInsert(&items));
+  EXPECT_EQ(4u, address_space.size());
+
+  // Empty ranges should be rejected.
+  items.clear();
+  items.push_back(std::make_pair(IntegerAddressSpace::Range(200, 0), item));
+  EXPECT_FALSE(address_space.BulkInsert(&items));
+  EXPECT_EQ(4u, address_space.size());
+}
+
+TEST(FlatAddressSpaceTest, Insert) {
+  FlatIntegerAddressSpace address_space;
+  void* item = "Something to point at";
+
+  // Insertions in and out of order should work.
+  EXPECT_TRUE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(110, 5), item));
+  EXPECT_TRUE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(120, 10), item));
+  EXPECT_TRUE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(100, 10), item));
+
+  // Overlapping insertions should be rejected.
+  EXPECT_FALSE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(100, 10), item));
+  EXPECT_FALSE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(95, 10), item));
+  EXPECT_FALSE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(125, 10), item));
+
+  // The ranges should be sorted.
+  ASSERT_EQ(3u, address_space.size());
+  FlatIntegerAddressSpace::RangeMapConstIter it = address_space.begin();
+  EXPECT_EQ(100, it->first.start());
+  ++it;
+  EXPECT_EQ(110, it->first.start());
+  ++it;
+  EXPECT_EQ(120, it->first.start());
+}
+
+TEST(FlatAddressSpaceTest, SubsumeAndMergeInsert) {
+  FlatIntegerAddressSpace address_space;
+  void* item = "Something to point at";
+
+  EXPECT_TRUE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(100, 10), item));
+  EXPECT_TRUE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(120, 10), item));
+
+  EXPECT_TRUE(address_space.SubsumeInsert(
+      FlatIntegerAddressSpace::Range(100, 30), item));
+  EXPECT_EQ(1u, address_space.size());
+  EXPECT_TRUE(address_space.ContainsExactly(100, 30));
+
+  address_space.MergeInsert(FlatIntegerAddressSpace::Range(90, 20), item);
+  EXPECT_EQ(1u, address_space.size());
+  EXPECT_TRUE(address_space.ContainsExactly(90, 40));
+
+  EXPECT_TRUE(address_space.Remove(FlatIntegerAddressSpace::Range(90, 40)));
+  EXPECT_TRUE(address_space.empty());
+}
+
+TEST(FlatAddressSpaceTest, Lookups) {
+  FlatIntegerAddressSpace address_space;
+  void* item = "Something to point at";
+
+  std::vector<std::pair<FlatIntegerAddressSpace::Range, void*>> items;
+  items.push_back(
+      std::make_pair(FlatIntegerAddressSpace::Range(120, 10), item));
+  items.push_back(std::make_pair(FlatIntegerAddressSpace::Range(110, 5), item));
+  items.push_back(
+      std::make_pair(FlatIntegerAddressSpace::Range(100, 10), item));
+  ASSERT_TRUE(address_space.BulkInsert(&items));
+
+  // Lookups must give the same results with and without the search index.
+  for (size_t i = 0; i < 2; ++i) {
+    if (i == 1)
+      address_space.Freeze();
+
+    FlatIntegerAddressSpace::RangeMapConstIter it =
+        address_space.FindFirstIntersection(
+            FlatIntegerAddressSpace::Range(0, 100));
+    EXPECT_TRUE(it == address_space.end());
+
+    it = address_space.FindFirstIntersection(
+        FlatIntegerAddressSpace::Range(105, 30));
+    ASSERT_TRUE(it != address_space.end());
+    EXPECT_EQ(100, it->first.start());
+
+    it = address_space.FindFirstIntersection(
+        FlatIntegerAddressSpace::Range(115, 5));
+    EXPECT_TRUE(it == address_space.end());
+
+    it = address_space.FindContaining(FlatIntegerAddressSpace::Range(113, 2));
+    ASSERT_TRUE(it != address_space.end());
+    EXPECT_EQ(110, it->first.start());
+
+    it = address_space.FindContaining(FlatIntegerAddressSpace::Range(109, 5));
+    EXPECT_TRUE(it == address_space.end());
+
+    it = address_space.FindContaining(FlatIntegerAddressSpace::Range(129, 1));
+    ASSERT_TRUE(it != address_space.end());
+    EXPECT_EQ(120, it->first.start());
+
+    FlatIntegerAddressSpace::RangeMapConstIterPair it_pair =
+        address_space.FindIntersecting(FlatIntegerAddressSpace::Range(100, 15));
+    ASSERT_TRUE(it_pair.first != address_space.end());
+    ASSERT_TRUE(it_pair.second != address_space.end());
+    EXPECT_EQ(100, it_pair.first->first.start());
+    EXPECT_EQ(120, it_pair.second->first.start());
+  }
+
+  // Mutating the address space discards the search index.
+  EXPECT_TRUE(address_space.ranges().frozen());
+  EXPECT_TRUE(
+      address_space.Insert(FlatIntegerAddressSpace::Range(140, 10), item));
+  EXPECT_FALSE(address_space.ranges().frozen());
+  EXPECT_TRUE(address_space.Contains(145));
+}
+
 TEST(AddressRangeMapTest, IsSimple) {
   IntegerRangeMap map;
   EXPECT_FALSE(map.IsSimple());
@@ -0,0 +1,319 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/chunked_compression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#include "base/bind.h"
+#include "base/callback.h"
+#include "base/logging.h"
+#include "base/sys_info.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
+#include "third_party/zlib/zlib.h"
+
+namespace core {
+
+namespace {
+
+typedef base::Callback<bool(size_t)> ChunkCallback;
+
+// Processes chunks. This is run concurrently by a pool of threads, each of
+// them claiming chunks until all of them are processed or a chunk fails.
+class ChunkRunner : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param chunk_count the number of chunks to process.
+  // @param callback the callback processing a chunk, given its index.
+  ChunkRunner(size_t chunk_count, const ChunkCallback& callback)
+      : chunk_count_(chunk_count),
+        callback_(callback),
+        next_chunk_(0),
+        failed_(false) {}
+
+  // Processes chunks until all of them are claimed or a chunk fails.
+  void Run() override {
+    size_t index = 0;
+    while (ClaimChunk(&index)) {
+      if (!callback_.Run(index)) {
+        base::AutoLock auto_lock(lock_);
+        failed_ = true;
+      }
+    }
+  }
+
+  // @returns true if all the chunks were processed successfully. This may only
+  //     be called once all the threads are done.
+  bool Succeeded() {
+    base::AutoLock auto_lock(lock_);
+    return !failed_;
+  }
+
+ private:
+  bool ClaimChunk(size_t* index) {
+    DCHECK_NE(static_cast<size_t*>(nullptr), index);
+
+    base::AutoLock auto_lock(lock_);
+    if (failed_ || next_chunk_ == chunk_count_)
+      return false;
+    *index = next_chunk_++;
+    return true;
+  }
+
+  const size_t chunk_count_;
+  ChunkCallback callback_;
+
+  base::Lock lock_;
+  // Under lock_.
+  size_t next_chunk_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkRunner);
+};
+
+// Runs a callback over chunks, using up to @p thread_count threads including
+// the calling one.
+bool RunOnChunks(size_t chunk_count,
+                 size_t thread_count,
+                 const ChunkCallback& callback) {
+  DCHECK_LT(0U, thread_count);
+
+  ChunkRunner runner(chunk_count, callback);
+  size_t worker_count = std::min(thread_count - 1, chunk_count);
+  std::unique_ptr<base::DelegateSimpleThreadPool> pool;
+  if (worker_count != 0) {
+    pool.reset(new base::DelegateSimpleThreadPool(
+        "ChunkedCompression", static_cast<int>(worker_count)));
+    pool->Start();
+    pool->AddWork(&runner, static_cast<int>(worker_count));
+  }
+
+  runner.Run();
+  if (pool.get() != nullptr)
+    pool->JoinAll();
+
+  return runner.Succeeded();
+}
+
+// The state shared by the threads compressing chunks.
+struct CompressionState {
+  const uint8_t* data;
+  size_t size;
+  const ChunkedCompressionOptions* options;
+  std::vector<std::vector<uint8_t>> chunks;
+};
+
+bool CompressChunk(CompressionState* state, size_t index) {
+  DCHECK_NE(static_cast<CompressionState*>(nullptr), state);
+
+  size_t offset = index * state->options->chunk_size;
+  size_t size = std::min(state->options->chunk_size, state->size - offset);
+  const uint8_t* data = state->data + offset;
+  std::vector<uint8_t>* chunk = &state->chunks[index];
+
+  if (state->options->codec == kStoreCodec) {
+    chunk->assign(data, data + size);
+    return true;
+  }
+
+  DCHECK_EQ(kZlibCodec, state->options->codec);
+  uLongf compressed_size = ::compressBound(static_cast<uLong>(size));
+  chunk->resize(compressed_size);
+  int ret = ::compress2(chunk->data(), &compressed_size, data,
+                        static_cast<uLong>(size), state->options->level);
+  if (ret != Z_OK) {
+    LOG(ERROR) << "compress2 returned " << ret << " for chunk " << index
+               << ".";
+    return false;
+  }
+  chunk->resize(compressed_size);
+
+  return true;
+}
+
+// The state shared by the threads decompressing chunks.
+struct DecompressionState {
+  ChunkedCompressionCodec codec;
+  const ChunkedCompressionChunk* chunks;
+  // The offsets of the chunks in the compressed data and in the output.
+  std::vector<const uint8_t*> compressed_data;
+  std::vector<size_t> offsets;
+  std::vector<uint8_t>* output;
+};
+
+bool DecompressChunk(DecompressionState* state, size_t index) {
+  DCHECK_NE(static_cast<DecompressionState*>(nullptr), state);
+
+  const ChunkedCompressionChunk& chunk = state->chunks[index];
+  const uint8_t* compressed_data = state->compressed_data[index];
+  uint8_t* data = state->output->data() + state->offsets[index];
+
+  if (state->codec == kStoreCodec) {
+    if (chunk.compressed_size != chunk.size) {
+      LOG(ERROR) << "Stored chunk " << index << " has an invalid size.";
+      return false;
+    }
+    ::memcpy(data, compressed_data, chunk.size);
+    return true;
+  }
+
+  DCHECK_EQ(kZlibCodec, state->codec);
+  uLongf size = chunk.size;
+  int ret = ::uncompress(data, &size, compressed_data, chunk.compressed_size);
+  if (ret != Z_OK || size != chunk.size) {
+    LOG(ERROR) << "Unable to decompress chunk " << index << ".";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+ChunkedCompressionOptions::ChunkedCompressionOptions()
+    : codec(kZlibCodec),
+      level(Z_DEFAULT_COMPRESSION),
+      chunk_size(kDefaultChunkSize),
+      thread_count(base::SysInfo::NumberOfProcessors()) {
+}
+
+bool CompressChunks(const uint8_t* data,
+                    size_t size,
+                    const ChunkedCompressionOptions& options,
+                    std::vector<uint8_t>* output) {
+  DCHECK(data != nullptr || size == 0);
+  DCHECK_NE(static_cast<std::vector<uint8_t>*>(nullptr), output);
+  DCHECK(options.codec == kStoreCodec || options.codec == kZlibCodec);
+  DCHECK(options.level == Z_DEFAULT_COMPRESSION ||
+         (options.level >= 0 && options.level <= 9));
+  DCHECK_LT(0U, options.chunk_size);
+  DCHECK_LT(0U, options.thread_count);
+
+  if (options.chunk_size > std::numeric_limits<uint32_t>::max() / 2) {
+    LOG(ERROR) << "Chunk size too large: " << options.chunk_size << ".";
+    return false;
+  }
+
+  CompressionState state = {};
+  state.data = data;
+  state.size = size;
+  state.options = &options;
+  state.chunks.resize((size + options.chunk_size - 1) / options.chunk_size);
+  if (!RunOnChunks(state.chunks.size(), options.thread_count,
+                   base::Bind(&CompressChunk, &state))) {
+    return false;
+  }
+
+  // Assemble the header, the chunk table and the chunks.
+  ChunkedCompressionHeader header = {};
+  header.codec = options.codec;
+  header.chunk_count = static_cast<uint32_t>(state.chunks.size());
+  header.size = size;
+
+  size_t output_size =
+      sizeof(header) + state.chunks.size() * sizeof(ChunkedCompressionChunk);
+  for (const auto& chunk : state.chunks)
+    output_size += chunk.size();
+  output->resize(output_size);
+
+  uint8_t* cursor = output->data();
+  ::memcpy(cursor, &header, sizeof(header));
+  cursor += sizeof(header);
+  for (size_t i = 0; i < state.chunks.size(); ++i) {
+    ChunkedCompressionChunk chunk = {};
+    chunk.size = static_cast<uint32_t>(
+        std::min(options.chunk_size, size - i * options.chunk_size));
+    chunk.compressed_size = static_cast<uint32_t>(state.chunks[i].size());
+    ::memcpy(cursor, &chunk, sizeof(chunk));
+    cursor += sizeof(chunk);
+  }
+  for (const auto& chunk : state.chunks) {
+    if (!chunk.empty())
+      ::memcpy(cursor, chunk.data(), chunk.size());
+    cursor += chunk.size();
+  }
+  DCHECK_EQ(output->data() + output->size(), cursor);
+
+  return true;
+}
+
+bool DecompressChunks(const uint8_t* data,
+                      size_t size,
+                      size_t thread_count,
+                      std::vector<uint8_t>* output) {
+  DCHECK(data != nullptr || size == 0);
+  DCHECK_LT(0U, thread_count);
+  DCHECK_NE(static_cast<std::vector<uint8_t>*>(nullptr), output);
+
+  ChunkedCompressionHeader header = {};
+  if (size < sizeof(header)) {
+    LOG(ERROR) << "Compressed data too short for its header.";
+    return false;
+  }
+  ::memcpy(&header, data, sizeof(header));
+  if (header.codec != kStoreCodec && header.codec != kZlibCodec) {
+    LOG(ERROR) << "Unknown compression codec: "
+               << static_cast<int>(header.codec) << ".";
+    return false;
+  }
+
+  size_t table_size = (size - sizeof(header)) / sizeof(ChunkedCompressionChunk);
+  if (header.chunk_count > table_size) {
+    LOG(ERROR) << "Compressed data too short for its chunk table.";
+    return false;
+  }
+
+  // The chunk table isn't necessarily aligned, so make a copy of it.
+  std::vector<ChunkedCompressionChunk> chunks(header.chunk_count);
+  if (!chunks.empty()) {
+    ::memcpy(chunks.data(), data + sizeof(header),
+             chunks.size() * sizeof(chunks[0]));
+  }
+
+  // Locate the chunks, and make sure they lie within the data and add up to
+  // the expected size.
+  DecompressionState state = {};
+  state.codec = static_cast<ChunkedCompressionCodec>(header.codec);
+  state.chunks = chunks.data();
+  state.compressed_data.resize(chunks.size());
+  state.offsets.resize(chunks.size());
+  state.output = output;
+
+  size_t compressed_offset = sizeof(header) + chunks.size() * sizeof(chunks[0]);
+  uint64_t offset = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (chunks[i].compressed_size > size - compressed_offset) {
+      LOG(ERROR) << "Chunk " << i << " lies beyond the compressed data.";
+      return false;
+    }
+    state.compressed_data[i] = data + compressed_offset;
+    state.offsets[i] = static_cast<size_t>(offset);
+    compressed_offset += chunks[i].compressed_size;
+    offset += chunks[i].size;
+  }
+  if (offset != header.size ||
+      header.size > std::numeric_limits<size_t>::max()) {
+    LOG(ERROR) << "Chunks don't add up to the size of the data.";
+    return false;
+  }
+
+  output->resize(static_cast<size_t>(header.size));
+  return RunOnChunks(chunks.size(), thread_count,
+                     base::Bind(&DecompressChunk, &state));
+}
+
+}  // namespace core
@@ -0,0 +1,109 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares functions compressing a buffer as a sequence of independently
+// compressed chunks. Unlike a single ZOutStream, this allows the chunks to be
+// compressed and decompressed concurrently.
+//
+// The compressed data is organized as follows, with all fields in native byte
+// order:
+//
+// - ChunkedCompressionHeader
+// - ChunkedCompressionChunk for each chunk, in order
+// - the compressed data of each chunk, in order
+
+#ifndef SYZYGY_CORE_CHUNKED_COMPRESSION_H_
+#define SYZYGY_CORE_CHUNKED_COMPRESSION_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace core {
+
+// The codecs the chunks can be compressed with. These values are persisted.
+enum ChunkedCompressionCodec : uint8_t {
+  // The chunks are stored as they are.
+  kStoreCodec = 0,
+  // The chunks are compressed with zlib.
+  kZlibCodec = 1,
+};
+
+// @name On-disk structures of chunked compressed data.
+// @{
+struct ChunkedCompressionHeader {
+  // A ChunkedCompressionCodec value.
+  uint8_t codec;
+  uint8_t reserved[3];
+  uint32_t chunk_count;
+  // The size of the uncompressed data.
+  uint64_t size;
+};
+
+struct ChunkedCompressionChunk {
+  uint32_t size;
+  uint32_t compressed_size;
+};
+// @}
+
+static_assert(sizeof(ChunkedCompressionHeader) == 16, "Unexpected size.");
+static_assert(sizeof(ChunkedCompressionChunk) == 8, "Unexpected size.");
+
+// The options used to compress data.
+struct ChunkedCompressionOptions {
+  // The default size of the chunks. This is large enough for zlib to reach
+  // about the same compression ratio as it does on a single stream.
+  static const size_t kDefaultChunkSize = 1024 * 1024;
+
+  // Initializes the options to compress with zlib at its default level, using
+  // as many threads as there are processors.
+  ChunkedCompressionOptions();
+
+  ChunkedCompressionCodec codec;
+  // The compression level. For zlib this is Z_DEFAULT_COMPRESSION (-1), or an
+  // integer in the range 0..9, inclusive. Ignored by kStoreCodec.
+  int level;
+  // The size of the chunks, except for the last one which may be shorter.
+  size_t chunk_size;
+  // The number of threads used to process the chunks, including the calling
+  // thread.
+  size_t thread_count;
+};
+
+// Compresses a buffer as independently compressed chunks.
+// @param data the data to compress.
+// @param size the size of @p data.
+// @param options the options to compress with.
+// @param output on success, receives the compressed data.
+// @returns true on success, false otherwise.
+bool CompressChunks(const uint8_t* data,
+                    size_t size,
+                    const ChunkedCompressionOptions& options,
+                    std::vector<uint8_t>* output);
+
+// Decompresses data produced by CompressChunks.
+// @param data the compressed data.
+// @param size the size of @p data.
+// @param thread_count the number of threads used to decompress the chunks,
+//     including the calling thread.
+// @param output on success, receives the decompressed data.
+// @returns true on success, false if the data is malformed.
+bool DecompressChunks(const uint8_t* data,
+                      size_t size,
+                      size_t thread_count,
+                      std::vector<uint8_t>* output);
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_CHUNKED_COMPRESSION_H_
@@ -0,0 +1,203 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/chunked_compression.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/zstream.h"
+
+namespace core {
+
+namespace {
+
+class ChunkedCompressionTest : public testing::Test {
+ public:
+  void SetUp() override {
+    // Somewhat compressible data, which isn't a multiple of the chunk sizes
+    // used by the tests.
+    data_.resize(10 * 1000 + 7);
+    for (size_t i = 0; i < data_.size(); ++i)
+      data_[i] = static_cast<uint8_t>((i * i) % 61);
+  }
+
+  // Compresses data_, decompresses it and expects to get it back.
+  void RoundTrip(const ChunkedCompressionOptions& options,
+                 size_t decompression_thread_count) {
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(
+        CompressChunks(data_.data(), data_.size(), options, &compressed));
+
+    std::vector<uint8_t> decompressed;
+    ASSERT_TRUE(DecompressChunks(compressed.data(), compressed.size(),
+                                 decompression_thread_count, &decompressed));
+    EXPECT_THAT(decompressed, testing::ContainerEq(data_));
+  }
+
+  std::vector<uint8_t> data_;
+};
+
+}  // namespace
+
+TEST_F(ChunkedCompressionTest, DefaultOptions) {
+  ChunkedCompressionOptions options;
+  EXPECT_EQ(kZlibCodec, options.codec);
+  EXPECT_EQ(ZOutStream::kZDefaultCompression, options.level);
+  EXPECT_EQ(ChunkedCompressionOptions::kDefaultChunkSize, options.chunk_size);
+  EXPECT_LT(0U, options.thread_count);
+}
+
+TEST_F(ChunkedCompressionTest, RoundTrip) {
+  ChunkedCompressionOptions options;
+  options.chunk_size = 1000;
+
+  for (ChunkedCompressionCodec codec : {kStoreCodec, kZlibCodec}) {
+    options.codec = codec;
+    for (size_t thread_count : {1, 2, 7}) {
+      options.thread_count = thread_count;
+      ASSERT_NO_FATAL_FAILURE(RoundTrip(options, thread_count));
+    }
+  }
+
+  options.codec = kZlibCodec;
+  options.thread_count = 4;
+  for (int level : {ZOutStream::kZNoCompression, ZOutStream::kZBestSpeed,
+                    ZOutStream::kZBestCompression}) {
+    options.level = level;
+    ASSERT_NO_FATAL_FAILURE(RoundTrip(options, 4));
+  }
+
+  // A single chunk.
+  options.chunk_size = ChunkedCompressionOptions::kDefaultChunkSize;
+  ASSERT_NO_FATAL_FAILURE(RoundTrip(options, 4));
+}
+
+TEST_F(ChunkedCompressionTest, EmptyData) {
+  ChunkedCompressionOptions options;
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(CompressChunks(nullptr, 0, options, &compressed));
+  EXPECT_EQ(sizeof(ChunkedCompressionHeader), compressed.size());
+
+  std::vector<uint8_t> decompressed(1);
+  ASSERT_TRUE(DecompressChunks(compressed.data(), compressed.size(), 2,
+                               &decompressed));
+  EXPECT_TRUE(decompressed.empty());
+}
+
+TEST_F(ChunkedCompressionTest, OutputDoesNotDependOnThreadCount) {
+  ChunkedCompressionOptions options;
+  options.chunk_size = 1000;
+
+  options.thread_count = 1;
+  std::vector<uint8_t> serial;
+  ASSERT_TRUE(CompressChunks(data_.data(), data_.size(), options, &serial));
+
+  options.thread_count = 5;
+  std::vector<uint8_t> parallel;
+  ASSERT_TRUE(CompressChunks(data_.data(), data_.size(), options, &parallel));
+
+  EXPECT_THAT(parallel, testing::ContainerEq(serial));
+}
+
+TEST_F(ChunkedCompressionTest, Layout) {
+  ChunkedCompressionOptions options;
+  options.codec = kStoreCodec;
+  options.chunk_size = 4096;
+
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(
+      CompressChunks(data_.data(), data_.size(), options, &compressed));
+
+  const size_t kChunkCount = 3;
+  size_t expected_size = sizeof(ChunkedCompressionHeader) +
+                         kChunkCount * sizeof(ChunkedCompressionChunk) +
+                         data_.size();
+  ASSERT_EQ(expected_size, compressed.size());
+
+  const ChunkedCompressionHeader* header =
+      reinterpret_cast<const ChunkedCompressionHeader*>(compressed.data());
+  EXPECT_EQ(kStoreCodec, header->codec);
+  EXPECT_EQ(kChunkCount, header->chunk_count);
+  EXPECT_EQ(data_.size(), header->size);
+
+  const ChunkedCompressionChunk* chunks =
+      reinterpret_cast<const ChunkedCompressionChunk*>(header + 1);
+  EXPECT_EQ(4096U, chunks[0].size);
+  EXPECT_EQ(4096U, chunks[1].size);
+  EXPECT_EQ(data_.size() - 2 * 4096, chunks[2].size);
+  for (size_t i = 0; i < kChunkCount; ++i)
+    EXPECT_EQ(chunks[i].size, chunks[i].compressed_size);
+
+  // The stored data follows the chunk table.
+  EXPECT_EQ(0, ::memcmp(chunks + kChunkCount, data_.data(), data_.size()));
+}
+
+TEST_F(ChunkedCompressionTest, CompressionShrinksData) {
+  ChunkedCompressionOptions options;
+  options.chunk_size = 1000;
+  options.level = ZOutStream::kZBestCompression;
+
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(
+      CompressChunks(data_.data(), data_.size(), options, &compressed));
+  EXPECT_GT(data_.size(), compressed.size());
+}
+
+TEST_F(ChunkedCompressionTest, DecompressFailsOnMalformedData) {
+  ChunkedCompressionOptions options;
+  options.chunk_size = 1000;
+
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(
+      CompressChunks(data_.data(), data_.size(), options, &compressed));
+  std::vector<uint8_t> decompressed;
+
+  // Too short for the header.
+  EXPECT_FALSE(DecompressChunks(compressed.data(),
+                                sizeof(ChunkedCompressionHeader) - 1, 1,
+                                &decompressed));
+
+  // Too short for the chunk table.
+  EXPECT_FALSE(DecompressChunks(compressed.data(),
+                                sizeof(ChunkedCompressionHeader) + 1, 1,
+                                &decompressed));
+
+  // Truncated chunks.
+  EXPECT_FALSE(DecompressChunks(compressed.data(), compressed.size() - 1, 2,
+                                &decompressed));
+
+  // An unknown codec.
+  std::vector<uint8_t> corrupt(compressed);
+  ChunkedCompressionHeader* header =
+      reinterpret_cast<ChunkedCompressionHeader*>(corrupt.data());
+  header->codec = 0xFF;
+  EXPECT_FALSE(DecompressChunks(corrupt.data(), corrupt.size(), 2,
+                                &decompressed));
+
+  // A size that doesn't match the chunks.
+  corrupt = compressed;
+  header = reinterpret_cast<ChunkedCompressionHeader*>(corrupt.data());
+  header->size += 1;
+  EXPECT_FALSE(DecompressChunks(corrupt.data(), corrupt.size(), 2,
+                                &decompressed));
+
+  // A corrupt chunk.
+  corrupt = compressed;
+  corrupt.back() ^= 0xFF;
+  corrupt[corrupt.size() - 2] ^= 0xFF;
+  EXPECT_FALSE(DecompressChunks(corrupt.data(), corrupt.size(), 2,
+                                &decompressed));
+}
+
+}  // namespace core
@@ -30,12 +30,15 @@
         'address_space.cc',
         'address_space.h',
         'address_space_internal.h',
+        'chunked_compression.cc',
+        'chunked_compression.h',
         'disassembler.cc',
         'disassembler.h',
         'disassembler_util.cc',
         'disassembler_util.h',
         'file_util.cc',
         'file_util.h',
+        'flat_range_map.h',
         'json_file_writer.cc',
         'json_file_writer.h',
         'random_number_generator.cc',
@@ -45,6 +48,9 @@
         'serialization.cc',
         'serialization.h',
         'serialization_impl.h',
+        'slab_arena.cc',
+        'slab_arena.h',
+        'small_flat_map.h',
         'string_table.cc',
         'string_table.h',
         'zstream.cc',
@@ -80,13 +86,17 @@
         'address_filter_unittest.cc',
         'address_space_unittest.cc',
         'address_range_unittest.cc',
+        'chunked_compression_unittest.cc',
         'disassembler_test_code.asm',
         'disassembler_unittest.cc',
         'disassembler_util_unittest.cc',
         'file_util_unittest.cc',
+        'flat_range_map_unittest.cc',
         'json_file_writer_unittest.cc',
         'section_offset_address_unittest.cc',
         'serialization_unittest.cc',
+        'slab_arena_unittest.cc',
+        'small_flat_map_unittest.cc',
         'string_table_unittest.cc',
         'unittest_util_unittest.cc',
         'zstream_unittest.cc',
@@ -0,0 +1,298 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares FlatRangeMap, a sorted associative container backed by a single
+// vector. It implements the subset of the std::map interface that is used by
+// core::AddressSpace, so that it can be used as its RangeMapType.
+//
+// Lookups are binary searches over contiguous memory rather than walks down a
+// red-black tree, and iteration is a linear scan. The cost is that insertions
+// and removals are linear in the size of the map, unless elements are
+// appended in key order or inserted in bulk, and that they invalidate all
+// iterators.
+//
+// For read-mostly phases the map may additionally be frozen. This builds a
+// copy of the keys laid out in Eytzinger (breadth-first binary tree) order,
+// so that the top levels of every search share the same few cache lines and
+// the next levels can be prefetched. The index is discarded by any mutation.
+
+#ifndef SYZYGY_CORE_FLAT_RANGE_MAP_H_
+#define SYZYGY_CORE_FLAT_RANGE_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace core {
+
+template <typename KeyType,
+          typename ValueType,
+          typename Compare = std::less<KeyType>>
+class FlatRangeMap {
+ public:
+  // STL-like type definitions
+  // @{
+  typedef KeyType key_type;
+  typedef ValueType mapped_type;
+  typedef std::pair<KeyType, ValueType> value_type;
+  typedef Compare key_compare;
+  typedef std::vector<value_type> Storage;
+  typedef typename Storage::iterator iterator;
+  typedef typename Storage::const_iterator const_iterator;
+  typedef typename Storage::reverse_iterator reverse_iterator;
+  typedef typename Storage::const_reverse_iterator const_reverse_iterator;
+  typedef typename Storage::size_type size_type;
+  // @}
+
+  FlatRangeMap() {}
+
+  // @name Iteration.
+  // @{
+  iterator begin() { return storage_.begin(); }
+  const_iterator begin() const { return storage_.begin(); }
+  iterator end() { return storage_.end(); }
+  const_iterator end() const { return storage_.end(); }
+  reverse_iterator rbegin() { return storage_.rbegin(); }
+  const_reverse_iterator rbegin() const { return storage_.rbegin(); }
+  reverse_iterator rend() { return storage_.rend(); }
+  const_reverse_iterator rend() const { return storage_.rend(); }
+  // @}
+
+  bool empty() const { return storage_.empty(); }
+  size_type size() const { return storage_.size(); }
+
+  // Reserves room for @p size elements.
+  void reserve(size_type size) { storage_.reserve(size); }
+
+  // @returns an iterator to the first element whose key is not less than
+  //     @p key, or end() if there is none.
+  iterator lower_bound(const KeyType& key) {
+    return begin() + LowerBoundIndex(key);
+  }
+  const_iterator lower_bound(const KeyType& key) const {
+    return begin() + LowerBoundIndex(key);
+  }
+
+  // @returns an iterator to the element with key @p key, or end() if there is
+  //     none.
+  iterator find(const KeyType& key) {
+    iterator it = lower_bound(key);
+    if (it != end() && !compare_(key, it->first))
+      return it;
+    return end();
+  }
+  const_iterator find(const KeyType& key) const {
+    const_iterator it = lower_bound(key);
+    if (it != end() && !compare_(key, it->first))
+      return it;
+    return end();
+  }
+
+  // @returns 1 if an element with key @p key exists, 0 otherwise.
+  size_type count(const KeyType& key) const {
+    return find(key) == end() ? 0 : 1;
+  }
+
+  // Inserts @p value unless an element with the same key already exists.
+  // Appending in key order takes constant amortized time.
+  // @returns an iterator to the inserted or existing element, and true iff
+  //     @p value was inserted.
+  std::pair<iterator, bool> insert(const value_type& value) {
+    if (storage_.empty() || compare_(storage_.back().first, value.first)) {
+      Thaw();
+      storage_.push_back(value);
+      return std::make_pair(end() - 1, true);
+    }
+
+    iterator it = lower_bound(value.first);
+    if (it != end() && !compare_(value.first, it->first))
+      return std::make_pair(it, false);
+
+    Thaw();
+    return std::make_pair(storage_.insert(it, value), true);
+  }
+
+  // Inserts the elements of [@p first, @p last) whose keys are not already
+  // present. The new elements are sorted and merged into the existing ones,
+  // which takes O(n + m log m) time rather than O(n * m).
+  template <typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    Thaw();
+    size_type old_size = storage_.size();
+    storage_.insert(storage_.end(), first, last);
+    iterator middle = storage_.begin() + old_size;
+    std::stable_sort(middle, storage_.end(), ValueCompare(compare_));
+    std::inplace_merge(storage_.begin(), middle, storage_.end(),
+                       ValueCompare(compare_));
+    // The merge is stable, so of several equivalent keys the pre-existing one
+    // comes first, and is the one that is kept.
+    storage_.erase(
+        std::unique(storage_.begin(), storage_.end(), ValueEquals(compare_)),
+        storage_.end());
+  }
+
+  // Removes the element at @p it.
+  // @returns an iterator to the element following the removed one.
+  iterator erase(iterator it) {
+    Thaw();
+    return storage_.erase(it);
+  }
+
+  // Removes the elements in [@p first, @p last).
+  // @returns an iterator to the element following the removed ones.
+  iterator erase(iterator first, iterator last) {
+    Thaw();
+    return storage_.erase(first, last);
+  }
+
+  // Removes all elements.
+  void clear() {
+    Thaw();
+    storage_.clear();
+  }
+
+  void swap(FlatRangeMap& other) {
+    storage_.swap(other.storage_);
+    index_keys_.swap(other.index_keys_);
+    index_positions_.swap(other.index_positions_);
+    std::swap(compare_, other.compare_);
+  }
+
+  // Builds the Eytzinger search index. Lookups performed until the next
+  // mutation use it. Freezing a frozen map is a no-op.
+  void Freeze();
+
+  // @returns true if the map currently has a search index.
+  bool frozen() const { return !index_positions_.empty(); }
+
+  bool operator==(const FlatRangeMap& other) const {
+    return storage_ == other.storage_;
+  }
+  bool operator!=(const FlatRangeMap& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  // Compares elements by key.
+  struct ValueCompare {
+    explicit ValueCompare(const Compare& compare) : compare(compare) {}
+    bool operator()(const value_type& value1, const value_type& value2) const {
+      return compare(value1.first, value2.first);
+    }
+    Compare compare;
+  };
+
+  // Compares an element's key to a key.
+  struct ValueKeyCompare {
+    explicit ValueKeyCompare(const Compare& compare) : compare(compare) {}
+    bool operator()(const value_type& value, const KeyType& key) const {
+      return compare(value.first, key);
+    }
+    Compare compare;
+  };
+
+  // Tests elements for key equivalence.
+  struct ValueEquals {
+    explicit ValueEquals(const Compare& compare) : compare(compare) {}
+    bool operator()(const value_type& value1, const value_type& value2) const {
+      return !compare(value1.first, value2.first) &&
+             !compare(value2.first, value1.first);
+    }
+    Compare compare;
+  };
+
+  // Discards the search index.
+  void Thaw() {
+    index_keys_.clear();
+    index_positions_.clear();
+  }
+
+  // Fills the subtree of the search index rooted at @p node with the elements
+  // starting at @p position, in order.
+  // @returns the position of the first element not in the subtree.
+  size_type BuildIndex(size_type node, size_type position);
+
+  // @returns the position of the first element whose key is not less than
+  //     @p key, or size() if there is none.
+  size_type LowerBoundIndex(const KeyType& key) const;
+
+  Storage storage_;
+  Compare compare_;
+
+  // The search index. Node i has children 2i and 2i + 1, and node 0 is
+  // unused. index_keys_[i] is a copy of the key of the element at position
+  // index_positions_[i]. Both are empty when the map is not frozen.
+  std::vector<KeyType> index_keys_;
+  std::vector<size_type> index_positions_;
+};
+
+template <typename KeyType, typename ValueType, typename Compare>
+void FlatRangeMap<KeyType, ValueType, Compare>::Freeze() {
+  if (frozen() || storage_.empty())
+    return;
+
+  index_keys_.resize(storage_.size() + 1, storage_.front().first);
+  index_positions_.resize(storage_.size() + 1, storage_.size());
+  size_type position = BuildIndex(1, 0);
+  DCHECK_EQ(storage_.size(), position);
+}
+
+template <typename KeyType, typename ValueType, typename Compare>
+typename FlatRangeMap<KeyType, ValueType, Compare>::size_type
+FlatRangeMap<KeyType, ValueType, Compare>::BuildIndex(size_type node,
+                                                      size_type position) {
+  if (node > storage_.size())
+    return position;
+
+  position = BuildIndex(2 * node, position);
+  index_keys_[node] = storage_[position].first;
+  index_positions_[node] = position;
+  ++position;
+  return BuildIndex(2 * node + 1, position);
+}
+
+template <typename KeyType, typename ValueType, typename Compare>
+typename FlatRangeMap<KeyType, ValueType, Compare>::size_type
+FlatRangeMap<KeyType, ValueType, Compare>::LowerBoundIndex(
+    const KeyType& key) const {
+  if (!frozen()) {
+    return std::lower_bound(storage_.begin(), storage_.end(), key,
+                            ValueKeyCompare(compare_)) -
+           storage_.begin();
+  }
+
+  // Walk down the implicit tree, going right whenever the node is less than
+  // the key. The answer is the last node at which we went left.
+  size_type size = storage_.size();
+  size_type node = 1;
+  while (node <= size)
+    node = 2 * node + (compare_(index_keys_[node], key) ? 1 : 0);
+
+  // Strip the trailing right turns, and the final left turn.
+  while (node & 1)
+    node >>= 1;
+  node >>= 1;
+
+  // Node 0 means we never went left: all keys are less than @p key.
+  if (node == 0)
+    return size;
+  return index_positions_[node];
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_FLAT_RANGE_MAP_H_
@@ -0,0 +1,159 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/flat_range_map.h"
+
+#include <stdlib.h>
+#include <map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+typedef FlatRangeMap<int, int> IntegerMap;
+typedef std::map<int, int> ReferenceMap;
+
+// Expects @p map and @p reference to hold the same elements.
+void ExpectSameElements(const ReferenceMap& reference, const IntegerMap& map) {
+  ASSERT_EQ(reference.size(), map.size());
+  ReferenceMap::const_iterator reference_it = reference.begin();
+  IntegerMap::const_iterator it = map.begin();
+  for (; it != map.end(); ++it, ++reference_it) {
+    EXPECT_EQ(reference_it->first, it->first);
+    EXPECT_EQ(reference_it->second, it->second);
+  }
+}
+
+// Expects lower_bound to return the same element in @p map and @p reference
+// for all keys in [@p min_key, @p max_key].
+void ExpectSameLowerBounds(const ReferenceMap& reference,
+                           const IntegerMap& map,
+                           int min_key,
+                           int max_key) {
+  for (int key = min_key; key <= max_key; ++key) {
+    ReferenceMap::const_iterator reference_it = reference.lower_bound(key);
+    IntegerMap::const_iterator it = map.lower_bound(key);
+    if (reference_it == reference.end()) {
+      EXPECT_TRUE(it == map.end());
+    } else {
+      ASSERT_TRUE(it != map.end());
+      EXPECT_EQ(reference_it->first, it->first);
+    }
+  }
+}
+
+}  // namespace
+
+TEST(FlatRangeMapTest, InsertAndFind) {
+  IntegerMap map;
+  EXPECT_TRUE(map.empty());
+
+  // In order.
+  EXPECT_TRUE(map.insert(std::make_pair(10, 1)).second);
+  EXPECT_TRUE(map.insert(std::make_pair(20, 2)).second);
+  // Out of order.
+  std::pair<IntegerMap::iterator, bool> inserted =
+      map.insert(std::make_pair(15, 3));
+  EXPECT_TRUE(inserted.second);
+  EXPECT_EQ(15, inserted.first->first);
+  // Duplicate.
+  inserted = map.insert(std::make_pair(20, 4));
+  EXPECT_FALSE(inserted.second);
+  EXPECT_EQ(2, inserted.first->second);
+
+  EXPECT_EQ(3u, map.size());
+  EXPECT_TRUE(map.find(5) == map.end());
+  ASSERT_TRUE(map.find(15) != map.end());
+  EXPECT_EQ(3, map.find(15)->second);
+  EXPECT_EQ(1u, map.count(10));
+  EXPECT_EQ(0u, map.count(11));
+
+  EXPECT_EQ(10, map.begin()->first);
+  EXPECT_EQ(20, map.rbegin()->first);
+}
+
+TEST(FlatRangeMapTest, Erase) {
+  IntegerMap map;
+  for (int i = 0; i < 10; ++i)
+    map.insert(std::make_pair(i, i));
+
+  IntegerMap::iterator it = map.erase(map.find(3));
+  EXPECT_EQ(4, it->first);
+  it = map.erase(map.find(5), map.find(8));
+  EXPECT_EQ(8, it->first);
+  EXPECT_EQ(6u, map.size());
+  EXPECT_TRUE(map.find(6) == map.end());
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(FlatRangeMapTest, BulkInsert) {
+  IntegerMap map;
+  ReferenceMap reference;
+  for (int i = 0; i < 100; i += 3) {
+    map.insert(std::make_pair(i, i));
+    reference.insert(std::make_pair(i, i));
+  }
+
+  // Unsorted, with keys already present and duplicated keys.
+  std::vector<std::pair<int, int>> values;
+  for (int i = 0; i < 200; ++i)
+    values.push_back(std::make_pair(::rand() % 150, -i));
+  map.insert(values.begin(), values.end());
+  reference.insert(values.begin(), values.end());
+
+  ASSERT_NO_FATAL_FAILURE(ExpectSameElements(reference, map));
+}
+
+TEST(FlatRangeMapTest, FrozenLowerBound) {
+  // Try all small sizes to cover complete and incomplete search trees.
+  for (int size = 0; size < 64; ++size) {
+    IntegerMap map;
+    ReferenceMap reference;
+    for (int i = 0; i < size; ++i) {
+      map.insert(std::make_pair(2 * i, i));
+      reference.insert(std::make_pair(2 * i, i));
+    }
+
+    map.Freeze();
+    EXPECT_EQ(size > 0, map.frozen());
+    ASSERT_NO_FATAL_FAILURE(
+        ExpectSameLowerBounds(reference, map, -1, 2 * size + 1));
+  }
+}
+
+TEST(FlatRangeMapTest, MutationThaws) {
+  IntegerMap map;
+  for (int i = 0; i < 10; ++i)
+    map.insert(std::make_pair(i, i));
+
+  map.Freeze();
+  EXPECT_TRUE(map.frozen());
+  map.insert(std::make_pair(20, 20));
+  EXPECT_FALSE(map.frozen());
+
+  map.Freeze();
+  map.erase(map.begin());
+  EXPECT_FALSE(map.frozen());
+
+  map.Freeze();
+  map.clear();
+  EXPECT_FALSE(map.frozen());
+}
+
+}  // namespace core
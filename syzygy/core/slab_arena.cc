@@ -0,0 +1,97 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/slab_arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace core {
+
+const size_t SlabArena::kGranularity;
+const size_t SlabArena::kMaxSlabAllocationSize;
+const size_t SlabArena::kSlabSize;
+
+SlabArena::SlabArena() : slab_cursor_(NULL), slab_end_(NULL) {
+  ::memset(free_lists_, 0, sizeof(free_lists_));
+  ::memset(&stats_, 0, sizeof(stats_));
+}
+
+SlabArena::~SlabArena() {
+  for (size_t i = 0; i < slabs_.size(); ++i)
+    delete [] slabs_[i];
+}
+
+void* SlabArena::Allocate(size_t size) {
+  ++stats_.allocations;
+  stats_.bytes_in_use += size;
+  stats_.peak_bytes_in_use =
+      std::max(stats_.peak_bytes_in_use, stats_.bytes_in_use);
+
+  if (size == 0)
+    size = 1;
+
+  if (size > kMaxSlabAllocationSize) {
+    ++stats_.heap_allocations;
+    return ::operator new(size);
+  }
+
+  // Reuse a freed allocation if possible.
+  size_t size_class = GetSizeClass(size);
+  FreeNode* node = free_lists_[size_class];
+  if (node != NULL) {
+    free_lists_[size_class] = node->next;
+    return node;
+  }
+
+  // Otherwise carve it out of the current slab, starting a new one if needed.
+  // The unused tail of the previous slab is abandoned; it is at most
+  // kMaxSlabAllocationSize bytes.
+  size_t rounded_size = (size_class + 1) * kGranularity;
+  if (static_cast<size_t>(slab_end_ - slab_cursor_) < rounded_size) {
+    slab_cursor_ = new uint8_t[kSlabSize];
+    slab_end_ = slab_cursor_ + kSlabSize;
+    slabs_.push_back(slab_cursor_);
+    ++stats_.heap_allocations;
+    stats_.slab_bytes += kSlabSize;
+  }
+
+  void* alloc = slab_cursor_;
+  slab_cursor_ += rounded_size;
+  return alloc;
+}
+
+void SlabArena::Free(void* alloc, size_t size) {
+  if (alloc == NULL)
+    return;
+
+  ++stats_.frees;
+  DCHECK_LE(size, stats_.bytes_in_use);
+  stats_.bytes_in_use -= size;
+
+  if (size == 0)
+    size = 1;
+
+  if (size > kMaxSlabAllocationSize) {
+    ::operator delete(alloc);
+    return;
+  }
+
+  size_t size_class = GetSizeClass(size);
+  FreeNode* node = reinterpret_cast<FreeNode*>(alloc);
+  node->next = free_lists_[size_class];
+  free_lists_[size_class] = node;
+}
+
+}  // namespace core
@@ -0,0 +1,204 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A SlabArena serves small allocations out of large slabs, which are only
+// returned to the heap when the arena is destroyed. Small allocations are
+// rounded up to a size class, and freed allocations are kept on a free list
+// per size class for reuse. This is meant for data structures made of many
+// small nodes that die together, such as the containers of a block graph: it
+// replaces millions of heap allocations by a few thousand, and keeps the
+// nodes of a data structure close together.
+//
+// SlabAllocator is an STL allocator drawing from a SlabArena. A
+// default-constructed SlabAllocator uses the heap, so containers using it
+// behave as usual unless they are explicitly given an arena. Copies of a
+// container always use the heap, so that they may outlive the arena and be
+// made on any thread.
+//
+// Example use is as follows:
+//
+// SlabArena arena;
+// typedef std::map<int, int, std::less<int>,
+//                  SlabAllocator<std::pair<const int, int>>> Map;
+// Map map((Map::allocator_type(&arena)));
+//
+// A SlabArena is not thread-safe, and must outlive all the containers using
+// it.
+
+#ifndef SYZYGY_CORE_SLAB_ARENA_H_
+#define SYZYGY_CORE_SLAB_ARENA_H_
+
+#include <stdint.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/macros.h"
+
+namespace core {
+
+class SlabArena {
+ public:
+  // Allocations are rounded up to a multiple of this size.
+  static const size_t kGranularity = 16;
+  // Allocations larger than this are passed through to the heap.
+  static const size_t kMaxSlabAllocationSize = 512;
+  // The size of the slabs allocated from the heap.
+  static const size_t kSlabSize = 64 * 1024;
+
+  // Statistics about the use of an arena.
+  struct Stats {
+    // The number of calls to Allocate.
+    uint64_t allocations;
+    // The number of calls to Free.
+    uint64_t frees;
+    // The number of allocations made from the heap. This is the number of
+    // slabs, plus the number of allocations too large to be slab allocated.
+    uint64_t heap_allocations;
+    // The number of bytes currently held in slabs.
+    size_t slab_bytes;
+    // The number of bytes currently requested by live allocations.
+    size_t bytes_in_use;
+    // The peak value of bytes_in_use.
+    size_t peak_bytes_in_use;
+  };
+
+  SlabArena();
+  ~SlabArena();
+
+  // Allocates @p size bytes, aligned to kGranularity if served from a slab.
+  // @param size the size of the allocation.
+  // @returns the allocation. This never returns NULL.
+  void* Allocate(size_t size);
+
+  // Frees an allocation made by this arena.
+  // @param alloc the allocation to free.
+  // @param size the size that was passed to Allocate.
+  void Free(void* alloc, size_t size);
+
+  // @returns the current statistics of this arena.
+  const Stats& stats() const { return stats_; }
+
+ private:
+  // A freed allocation, linked into the free list of its size class.
+  struct FreeNode {
+    FreeNode* next;
+  };
+
+  static const size_t kSizeClassCount = kMaxSlabAllocationSize / kGranularity;
+
+  // @returns the size class of allocations of @p size bytes.
+  static size_t GetSizeClass(size_t size) {
+    DCHECK_LT(0u, size);
+    DCHECK_GE(kMaxSlabAllocationSize, size);
+    return (size - 1) / kGranularity;
+  }
+
+  // The free list of each size class.
+  FreeNode* free_lists_[kSizeClassCount];
+
+  // The slabs, and the unused tail of the most recent one.
+  std::vector<uint8_t*> slabs_;
+  uint8_t* slab_cursor_;
+  uint8_t* slab_end_;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlabArena);
+};
+
+template <typename T>
+class SlabAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  // Containers that are moved or swapped take their allocator with them.
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+  typedef std::false_type propagate_on_container_copy_assignment;
+
+  template <typename U>
+  struct rebind {
+    typedef SlabAllocator<U> other;
+  };
+
+  // Creates an allocator using the heap.
+  SlabAllocator() : arena_(NULL) {}
+
+  // Creates an allocator using @p arena. If this is NULL the heap is used.
+  explicit SlabAllocator(SlabArena* arena) : arena_(arena) {}
+
+  template <typename U>
+  SlabAllocator(const SlabAllocator<U>& other)  // NOLINT
+      : arena_(other.arena()) {}
+
+  pointer allocate(size_type count) {
+    size_t size = count * sizeof(T);
+    if (arena_ == NULL)
+      return static_cast<pointer>(::operator new(size));
+    return static_cast<pointer>(arena_->Allocate(size));
+  }
+
+  void deallocate(pointer alloc, size_type count) {
+    if (arena_ == NULL) {
+      ::operator delete(alloc);
+      return;
+    }
+    arena_->Free(alloc, count * sizeof(T));
+  }
+
+  // Copies of a container do not share its arena.
+  SlabAllocator select_on_container_copy_construction() const {
+    return SlabAllocator();
+  }
+
+  size_type max_size() const { return static_cast<size_type>(-1) / sizeof(T); }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  void destroy(U* p) {
+    p->~U();
+  }
+
+  SlabArena* arena() const { return arena_; }
+
+ private:
+  SlabArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const SlabAllocator<T>& a, const SlabAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const SlabAllocator<T>& a, const SlabAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_SLAB_ARENA_H_
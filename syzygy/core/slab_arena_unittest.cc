@@ -0,0 +1,116 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/slab_arena.h"
+
+#include <map>
+#include <set>
+
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+typedef std::map<int, int, std::less<int>,
+                 SlabAllocator<std::pair<const int, int>>> IntegerMap;
+typedef std::set<int, std::less<int>, SlabAllocator<int>> IntegerSet;
+
+}  // namespace
+
+TEST(SlabArenaTest, AllocateAndFree) {
+  SlabArena arena;
+
+  void* alloc1 = arena.Allocate(8);
+  void* alloc2 = arena.Allocate(24);
+  ASSERT_TRUE(alloc1 != NULL);
+  ASSERT_TRUE(alloc2 != NULL);
+  EXPECT_NE(alloc1, alloc2);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(alloc1) %
+                SlabArena::kGranularity);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(alloc2) %
+                SlabArena::kGranularity);
+
+  // Both allocations come from the same slab.
+  EXPECT_EQ(2u, arena.stats().allocations);
+  EXPECT_EQ(1u, arena.stats().heap_allocations);
+  EXPECT_EQ(32u, arena.stats().bytes_in_use);
+
+  // A freed allocation is reused by the next allocation of its size class.
+  arena.Free(alloc1, 8);
+  EXPECT_EQ(1u, arena.stats().frees);
+  EXPECT_EQ(24u, arena.stats().bytes_in_use);
+  EXPECT_EQ(alloc1, arena.Allocate(16));
+  EXPECT_EQ(40u, arena.stats().peak_bytes_in_use);
+
+  arena.Free(alloc1, 16);
+  arena.Free(alloc2, 24);
+  EXPECT_EQ(0u, arena.stats().bytes_in_use);
+}
+
+TEST(SlabArenaTest, LargeAllocationsUseTheHeap) {
+  SlabArena arena;
+
+  void* alloc = arena.Allocate(SlabArena::kMaxSlabAllocationSize + 1);
+  ASSERT_TRUE(alloc != NULL);
+  EXPECT_EQ(1u, arena.stats().heap_allocations);
+  EXPECT_EQ(0u, arena.stats().slab_bytes);
+  arena.Free(alloc, SlabArena::kMaxSlabAllocationSize + 1);
+}
+
+TEST(SlabArenaTest, ContainersUseArena) {
+  const int kCount = 10000;
+  SlabArena arena;
+
+  {
+    // Some standard library implementations allocate a sentinel node for
+    // empty containers, so only count the allocations made after this.
+    IntegerMap map((IntegerMap::allocator_type(&arena)));
+    uint64_t initial_allocations = arena.stats().allocations;
+    for (int i = 0; i < kCount; ++i)
+      map[i] = i;
+    EXPECT_EQ(initial_allocations + kCount, arena.stats().allocations);
+    EXPECT_GT(static_cast<uint64_t>(kCount / 10),
+              arena.stats().heap_allocations);
+
+    // Copies do not use the arena.
+    uint64_t allocations = arena.stats().allocations;
+    IntegerMap copy(map);
+    EXPECT_TRUE(copy.get_allocator().arena() == NULL);
+    EXPECT_EQ(allocations, arena.stats().allocations);
+    EXPECT_TRUE(map == copy);
+
+    // Moving a container moves its allocator.
+    IntegerSet set((IntegerSet::allocator_type(&arena)));
+    IntegerSet heap_set;
+    heap_set.insert(1);
+    heap_set = std::move(set);
+    EXPECT_EQ(&arena, heap_set.get_allocator().arena());
+    allocations = arena.stats().allocations;
+    heap_set.insert(2);
+    EXPECT_EQ(allocations + 1, arena.stats().allocations);
+  }
+
+  EXPECT_EQ(arena.stats().allocations, arena.stats().frees);
+  EXPECT_EQ(0u, arena.stats().bytes_in_use);
+}
+
+TEST(SlabAllocatorTest, DefaultUsesHeap) {
+  IntegerMap map;
+  EXPECT_TRUE(map.get_allocator().arena() == NULL);
+  map[0] = 1;
+  EXPECT_EQ(1, map[0]);
+}
+
+}  // namespace core
@@ -0,0 +1,343 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares SmallFlatMap, a sorted associative container for maps that almost
+// always hold a handful of elements. Up to kInlineCapacity elements are stored
+// within the map itself, so that creating, filling and copying such a map
+// makes no heap allocation at all. Larger maps move their elements to a
+// vector. It implements the subset of the std::map interface that is used by
+// the maps of references of the basic-block representation.
+//
+// Iterators are plain pointers. Unlike those of std::map, they are invalidated
+// by any insertion or removal.
+
+#ifndef SYZYGY_CORE_SMALL_FLAT_MAP_H_
+#define SYZYGY_CORE_SMALL_FLAT_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace core {
+
+template <typename KeyType,
+          typename ValueType,
+          size_t kInlineCapacity,
+          typename Compare = std::less<KeyType>>
+class SmallFlatMap {
+ public:
+  static_assert(kInlineCapacity > 0, "Inline capacity must be positive.");
+
+  // STL-like type definitions
+  // @{
+  typedef KeyType key_type;
+  typedef ValueType mapped_type;
+  typedef std::pair<KeyType, ValueType> value_type;
+  typedef Compare key_compare;
+  typedef value_type* iterator;
+  typedef const value_type* const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+  typedef size_t size_type;
+  // @}
+
+  SmallFlatMap() : inline_size_(0) {}
+  SmallFlatMap(const SmallFlatMap& other) : inline_size_(0) {
+    CopyFrom(other);
+  }
+  SmallFlatMap(SmallFlatMap&& other) : inline_size_(0) {
+    MoveFrom(&other);
+  }
+  ~SmallFlatMap() { clear(); }
+
+  SmallFlatMap& operator=(const SmallFlatMap& other) {
+    if (this != &other) {
+      clear();
+      CopyFrom(other);
+    }
+    return *this;
+  }
+  SmallFlatMap& operator=(SmallFlatMap&& other) {
+    if (this != &other) {
+      clear();
+      MoveFrom(&other);
+    }
+    return *this;
+  }
+
+  // @name Iteration.
+  // @{
+  iterator begin() { return data(); }
+  const_iterator begin() const { return data(); }
+  iterator end() { return data() + size(); }
+  const_iterator end() const { return data() + size(); }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+  // @}
+
+  bool empty() const { return size() == 0; }
+  size_type size() const { return spilled() ? heap_.size() : inline_size_; }
+
+  // @returns true if the elements have outgrown the inline storage.
+  bool spilled() const { return !heap_.empty(); }
+
+  // @returns an iterator to the first element whose key is not less than
+  //     @p key, or end() if there is none.
+  iterator lower_bound(const KeyType& key) {
+    return std::lower_bound(begin(), end(), key, ValueKeyCompare(compare_));
+  }
+  const_iterator lower_bound(const KeyType& key) const {
+    return std::lower_bound(begin(), end(), key, ValueKeyCompare(compare_));
+  }
+
+  // @returns an iterator to the first element whose key is greater than
+  //     @p key, or end() if there is none.
+  iterator upper_bound(const KeyType& key) {
+    return std::upper_bound(begin(), end(), key, KeyValueCompare(compare_));
+  }
+  const_iterator upper_bound(const KeyType& key) const {
+    return std::upper_bound(begin(), end(), key, KeyValueCompare(compare_));
+  }
+
+  // @returns an iterator to the element with key @p key, or end() if there is
+  //     none.
+  iterator find(const KeyType& key) {
+    iterator it = lower_bound(key);
+    if (it != end() && !compare_(key, it->first))
+      return it;
+    return end();
+  }
+  const_iterator find(const KeyType& key) const {
+    const_iterator it = lower_bound(key);
+    if (it != end() && !compare_(key, it->first))
+      return it;
+    return end();
+  }
+
+  // @returns 1 if an element with key @p key exists, 0 otherwise.
+  size_type count(const KeyType& key) const {
+    return find(key) == end() ? 0 : 1;
+  }
+
+  // Inserts @p value unless an element with the same key already exists.
+  // @returns an iterator to the inserted or existing element, and true iff
+  //     @p value was inserted.
+  std::pair<iterator, bool> insert(const value_type& value);
+
+  // Inserts the elements of [@p first, @p last) whose keys are not already
+  // present.
+  template <typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    for (; first != last; ++first)
+      insert(*first);
+  }
+
+  // Removes the element at @p it.
+  // @returns an iterator to the element following the removed one.
+  iterator erase(iterator it) { return erase(it, it + 1); }
+
+  // Removes the elements in [@p first, @p last).
+  // @returns an iterator to the element following the removed ones.
+  iterator erase(iterator first, iterator last);
+
+  // Removes the element with key @p key, if any.
+  // @returns the number of removed elements.
+  size_type erase(const KeyType& key) {
+    iterator it = find(key);
+    if (it == end())
+      return 0;
+    erase(it);
+    return 1;
+  }
+
+  // Removes all elements.
+  void clear() {
+    heap_.clear();
+    DestroyInline(0);
+  }
+
+  void swap(SmallFlatMap& other) {
+    SmallFlatMap tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  bool operator==(const SmallFlatMap& other) const {
+    return size() == other.size() && std::equal(begin(), end(), other.begin());
+  }
+  bool operator!=(const SmallFlatMap& other) const {
+    return !(*this == other);
+  }
+
+ private:
+  // Compares an element's key to a key.
+  struct ValueKeyCompare {
+    explicit ValueKeyCompare(const Compare& compare) : compare(compare) {}
+    bool operator()(const value_type& value, const KeyType& key) const {
+      return compare(value.first, key);
+    }
+    Compare compare;
+  };
+
+  // Compares a key to an element's key.
+  struct KeyValueCompare {
+    explicit KeyValueCompare(const Compare& compare) : compare(compare) {}
+    bool operator()(const KeyType& key, const value_type& value) const {
+      return compare(key, value.first);
+    }
+    Compare compare;
+  };
+
+  value_type* inline_data() {
+    return reinterpret_cast<value_type*>(&inline_storage_);
+  }
+  const value_type* inline_data() const {
+    return reinterpret_cast<const value_type*>(&inline_storage_);
+  }
+  value_type* data() { return spilled() ? heap_.data() : inline_data(); }
+  const value_type* data() const {
+    return spilled() ? heap_.data() : inline_data();
+  }
+
+  // Destroys the inline elements from position @p new_size onwards.
+  void DestroyInline(size_type new_size) {
+    DCHECK_GE(inline_size_, new_size);
+    value_type* elements = inline_data();
+    for (size_type i = new_size; i < inline_size_; ++i)
+      elements[i].~value_type();
+    inline_size_ = new_size;
+  }
+
+  // Moves the inline elements to the heap. The inline storage must be full.
+  void Spill() {
+    DCHECK(!spilled());
+    DCHECK_EQ(kInlineCapacity, inline_size_);
+    heap_.reserve(2 * kInlineCapacity);
+    heap_.assign(inline_data(), inline_data() + inline_size_);
+    DestroyInline(0);
+  }
+
+  // Copies the elements of @p other. This map must be empty.
+  void CopyFrom(const SmallFlatMap& other) {
+    DCHECK(empty());
+    if (other.spilled()) {
+      heap_ = other.heap_;
+      return;
+    }
+    const value_type* elements = other.inline_data();
+    for (; inline_size_ < other.inline_size_; ++inline_size_)
+      new (inline_data() + inline_size_) value_type(elements[inline_size_]);
+  }
+
+  // Takes the elements of @p other, leaving it empty. This map must be
+  // empty.
+  void MoveFrom(SmallFlatMap* other) {
+    DCHECK(empty());
+    if (other->spilled()) {
+      heap_.swap(other->heap_);
+      return;
+    }
+    value_type* elements = other->inline_data();
+    for (; inline_size_ < other->inline_size_; ++inline_size_) {
+      new (inline_data() + inline_size_)
+          value_type(std::move(elements[inline_size_]));
+    }
+    other->clear();
+  }
+
+  // The number of elements held in the inline storage. This is zero once the
+  // elements have spilled to the heap.
+  size_type inline_size_;
+  typename std::aligned_storage<sizeof(value_type) * kInlineCapacity,
+                                std::alignment_of<value_type>::value>::type
+      inline_storage_;
+
+  // The elements, when there are more than fit in the inline storage.
+  std::vector<value_type> heap_;
+
+  Compare compare_;
+};
+
+template <typename KeyType,
+          typename ValueType,
+          size_t kInlineCapacity,
+          typename Compare>
+std::pair<typename SmallFlatMap<KeyType, ValueType, kInlineCapacity,
+                                Compare>::iterator,
+          bool>
+SmallFlatMap<KeyType, ValueType, kInlineCapacity, Compare>::insert(
+    const value_type& value) {
+  iterator it = lower_bound(value.first);
+  if (it != end() && !compare_(value.first, it->first))
+    return std::make_pair(it, false);
+
+  size_type position = it - begin();
+  if (!spilled() && inline_size_ == kInlineCapacity)
+    Spill();
+
+  if (spilled()) {
+    heap_.insert(heap_.begin() + position, value);
+    return std::make_pair(heap_.data() + position, true);
+  }
+
+  // Shift the elements following the insertion point up by one.
+  value_type* elements = inline_data();
+  if (position == inline_size_) {
+    new (elements + position) value_type(value);
+  } else {
+    new (elements + inline_size_) value_type(elements[inline_size_ - 1]);
+    std::copy_backward(elements + position, elements + inline_size_ - 1,
+                       elements + inline_size_);
+    elements[position] = value;
+  }
+  ++inline_size_;
+  return std::make_pair(elements + position, true);
+}
+
+template <typename KeyType,
+          typename ValueType,
+          size_t kInlineCapacity,
+          typename Compare>
+typename SmallFlatMap<KeyType, ValueType, kInlineCapacity, Compare>::iterator
+SmallFlatMap<KeyType, ValueType, kInlineCapacity, Compare>::erase(
+    iterator first, iterator last) {
+  DCHECK(begin() <= first && first <= last && last <= end());
+  size_type position = first - begin();
+
+  if (spilled()) {
+    heap_.erase(heap_.begin() + position, heap_.begin() + (last - begin()));
+    // If this erased all elements, the map is back to its inline storage.
+    return begin() + position;
+  }
+
+  iterator new_end = std::copy(last, end(), first);
+  DestroyInline(new_end - begin());
+  return begin() + position;
+}
+
+}  // namespace core
+
+#endif  // SYZYGY_CORE_SMALL_FLAT_MAP_H_
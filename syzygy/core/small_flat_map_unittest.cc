@@ -0,0 +1,171 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/core/small_flat_map.h"
+
+#include <stdlib.h>
+#include <map>
+#include <string>
+
+#include "base/strings/string_number_conversions.h"
+#include "gtest/gtest.h"
+
+namespace core {
+
+namespace {
+
+// Strings have a non-trivial constructor and destructor, which exercises the
+// management of the inline storage.
+typedef SmallFlatMap<int, std::string, 2> StringMap;
+typedef std::map<int, std::string> ReferenceMap;
+
+// Expects @p map and @p reference to hold the same elements.
+void ExpectSameElements(const ReferenceMap& reference, const StringMap& map) {
+  ASSERT_EQ(reference.size(), map.size());
+  ReferenceMap::const_iterator reference_it = reference.begin();
+  StringMap::const_iterator it = map.begin();
+  for (; it != map.end(); ++it, ++reference_it) {
+    EXPECT_EQ(reference_it->first, it->first);
+    EXPECT_EQ(reference_it->second, it->second);
+  }
+}
+
+std::pair<int, std::string> MakeValue(int key) {
+  return std::make_pair(key, base::IntToString(key * 3));
+}
+
+}  // namespace
+
+TEST(SmallFlatMapTest, InsertAndFind) {
+  StringMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_FALSE(map.spilled());
+
+  // Out of order, within the inline storage.
+  EXPECT_TRUE(map.insert(MakeValue(20)).second);
+  std::pair<StringMap::iterator, bool> inserted = map.insert(MakeValue(10));
+  EXPECT_TRUE(inserted.second);
+  EXPECT_EQ(10, inserted.first->first);
+  EXPECT_FALSE(map.spilled());
+
+  // Duplicate.
+  inserted = map.insert(std::make_pair(20, std::string("dup")));
+  EXPECT_FALSE(inserted.second);
+  EXPECT_EQ("60", inserted.first->second);
+
+  // Past the inline storage.
+  inserted = map.insert(MakeValue(15));
+  EXPECT_TRUE(inserted.second);
+  EXPECT_EQ(15, inserted.first->first);
+  EXPECT_TRUE(map.spilled());
+
+  EXPECT_EQ(3u, map.size());
+  EXPECT_TRUE(map.find(5) == map.end());
+  ASSERT_TRUE(map.find(15) != map.end());
+  EXPECT_EQ("45", map.find(15)->second);
+  EXPECT_EQ(1u, map.count(10));
+  EXPECT_EQ(0u, map.count(11));
+
+  EXPECT_EQ(15, map.lower_bound(11)->first);
+  EXPECT_EQ(15, map.lower_bound(15)->first);
+  EXPECT_EQ(20, map.upper_bound(15)->first);
+  EXPECT_TRUE(map.upper_bound(20) == map.end());
+
+  EXPECT_EQ(20, map.rbegin()->first);
+  EXPECT_EQ(3, std::distance(map.rbegin(), map.rend()));
+}
+
+TEST(SmallFlatMapTest, Erase) {
+  StringMap map;
+  for (int key = 0; key < 5; ++key)
+    map.insert(MakeValue(key));
+  EXPECT_TRUE(map.spilled());
+
+  StringMap::iterator it = map.erase(map.find(2));
+  EXPECT_EQ(3, it->first);
+  EXPECT_EQ(1u, map.erase(4));
+  EXPECT_EQ(0u, map.erase(4));
+  it = map.erase(map.begin(), map.end());
+  EXPECT_TRUE(it == map.end());
+  EXPECT_TRUE(map.empty());
+
+  // Once empty, the map is back to its inline storage.
+  EXPECT_FALSE(map.spilled());
+  map.insert(MakeValue(7));
+  map.insert(MakeValue(3));
+  EXPECT_FALSE(map.spilled());
+  it = map.erase(map.begin());
+  EXPECT_EQ(7, it->first);
+  EXPECT_EQ(1u, map.size());
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(SmallFlatMapTest, CopyMoveAndSwap) {
+  StringMap small;
+  small.insert(MakeValue(1));
+  StringMap large;
+  for (int key = 0; key < 4; ++key)
+    large.insert(MakeValue(key));
+
+  StringMap copy(small);
+  EXPECT_TRUE(copy == small);
+  copy = large;
+  EXPECT_TRUE(copy == large);
+  EXPECT_TRUE(copy != small);
+
+  StringMap moved(std::move(copy));
+  EXPECT_TRUE(moved == large);
+  EXPECT_TRUE(copy.empty());
+  copy = small;
+  moved = std::move(copy);
+  EXPECT_TRUE(moved == small);
+  EXPECT_TRUE(copy.empty());
+
+  StringMap small_copy(small);
+  StringMap large_copy(large);
+  small_copy.swap(large_copy);
+  EXPECT_TRUE(small_copy == large);
+  EXPECT_TRUE(large_copy == small);
+}
+
+TEST(SmallFlatMapTest, BehavesLikeStdMap) {
+  ::srand(12345);
+  StringMap map;
+  ReferenceMap reference;
+  for (size_t i = 0; i < 2000; ++i) {
+    int key = ::rand() % 16;
+    switch (::rand() % 4) {
+      case 0:
+      case 1: {
+        std::pair<int, std::string> value = MakeValue(key);
+        EXPECT_EQ(reference.insert(value).second, map.insert(value).second);
+        break;
+      }
+      case 2: {
+        EXPECT_EQ(reference.erase(key), map.erase(key));
+        break;
+      }
+      case 3: {
+        StringMap copy(map);
+        map.clear();
+        map = copy;
+        break;
+      }
+    }
+    ASSERT_NO_FATAL_FAILURE(ExpectSameElements(reference, map));
+  }
+}
+
+}  // namespace core
@@ -46,7 +46,9 @@ const char kUsageFormatStr[] =
     "  --iterations=NUM     The number of times to decompose the image.\n"
     "\n"
     "Optional parameters:\n"
-    "  --csv=PATH           The path to which CVS output should be written.\n";
+    "  --csv=PATH           The path to which CVS output should be written.\n"
+    "  --native-pdb         Read the PDB file natively rather than through\n"
+    "                       DIA.\n";
 
 bool WriteCsvFile(const base::FilePath& path,
                   const std::vector<double>& samples) {
@@ -72,7 +74,8 @@ bool WriteCsvFile(const base::FilePath& path,
 
 TimedDecomposerApp::TimedDecomposerApp()
     : application::AppImplBase("Timed Image Decomposer"),
-      num_iterations_(0) {
+      num_iterations_(0),
+      native_pdb_(false) {
 }
 
 void TimedDecomposerApp::PrintUsage(const base::FilePath& program,
@@ -107,12 +110,15 @@ bool TimedDecomposerApp::ParseCommandLine(const base::CommandLine* cmd_line) {
   }
 
   csv_path_ = cmd_line->GetSwitchValuePath("csv");
+  native_pdb_ = cmd_line->HasSwitch("native-pdb");
 
   return true;
 }
 
 int TimedDecomposerApp::Run() {
   LOG(INFO) << "Processing \"" << image_path_.value() << "\".";
+  if (native_pdb_)
+    LOG(INFO) << "Reading the PDB file natively.";
 
   DCHECK(!image_path_.empty());
   DCHECK_GT(0, num_iterations_);
@@ -129,6 +135,7 @@ int TimedDecomposerApp::Run() {
     block_graph::BlockGraph block_graph;
     pe::ImageLayout image_layout(&block_graph);
     pe::Decomposer decomposer(pe_file);
+    decomposer.set_use_native_pdb(native_pdb_);
     base::Time start(base::Time::NowFromSystemTime());
     if (!decomposer.Decompose(&image_layout))
       return 1;
@@ -49,6 +49,7 @@ class TimedDecomposerApp : public application::AppImplBase {
   base::FilePath image_path_;
   base::FilePath csv_path_;
   int num_iterations_;
+  bool native_pdb_;
   // @}
 
  private:
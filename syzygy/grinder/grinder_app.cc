@@ -64,6 +64,11 @@ const char kUsageFormatStr[] =
     "  --output-format=<output format>\n"
     "    Output format must be one of 'lcov' or 'cachegrind'. Defaults to\n"
     "    'lcov' if not explicitly specified.\n"
+    "memreplay mode optional parameters\n"
+    "  --output-format=<output format>\n"
+    "    Output format must be one of 'packed' or 'archive'. Packed stories\n"
+    "    are played straight out of the file by the bard utility. Defaults\n"
+    "    to 'packed' if not explicitly specified.\n"
     "profile mode optional parameters\n"
     "  --thread-parts\n"
     "    Aggregate and output separate parts for each thread seen in the\n"
@@ -134,7 +139,7 @@ bool GrinderApp::ParseCommandLine(const base::CommandLine* command_line) {
     mode_ = kCoverage;
     grinder_.reset(new grinders::CoverageGrinder());
   } else if (base::LowerCaseEqualsASCII(mode, "memreplay")) {
-    mode = kMemReplay;
+    mode_ = kMemReplay;
     grinder_.reset(new grinders::MemReplayGrinder());
   } else if (base::LowerCaseEqualsASCII(mode, "profile")) {
     mode_ = kProfile;
@@ -184,7 +189,8 @@ int GrinderApp::Run() {
   FILE* output = out();
   base::ScopedFILE auto_close;
   if (!output_file_.empty()) {
-    output = base::OpenFile(output_file_, "w");
+    // The memreplay grinder outputs binary data.
+    output = base::OpenFile(output_file_, mode_ == kMemReplay ? "wb" : "w");
     if (output == NULL) {
       LOG(ERROR) << "Unable to create output file \'"
                  << output_file_.value() << "'";
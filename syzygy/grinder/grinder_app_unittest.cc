@@ -18,6 +18,7 @@
 #include "base/win/scoped_com_initializer.h"
 #include "gtest/gtest.h"
 #include "syzygy/application/application.h"
+#include "syzygy/bard/packed_story.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/sampler/unittest_util.h"
@@ -154,8 +155,12 @@ TEST_F(GrinderAppTest, MemReplayEndToEnd) {
 
   EXPECT_EQ(0, app_.Run());
 
-  // Verify that the output file was created.
+  // Verify that the output file was created, and holds the packed story of
+  // the single traced process.
   EXPECT_TRUE(base::PathExists(output_file));
+  bard::PackedStoryFile story_file;
+  ASSERT_TRUE(story_file.Open(output_file));
+  EXPECT_EQ(1u, story_file.story_count());
 }
 
 TEST_F(GrinderAppTest, ProfileEndToEnd) {
@@ -16,6 +16,8 @@
 
 #include <cstring>
 
+#include "base/strings/string_util.h"
+#include "syzygy/bard/packed_story.h"
 #include "syzygy/bard/raw_argument_converter.h"
 #include "syzygy/bard/events/heap_alloc_event.h"
 #include "syzygy/bard/events/heap_create_event.h"
@@ -192,7 +194,8 @@ class ArgumentParser {
 
 }  // namespace
 
-MemReplayGrinder::MemReplayGrinder() : parse_error_(false) {
+MemReplayGrinder::MemReplayGrinder()
+    : parse_error_(false), output_format_(kPackedFormat) {
 }
 
 bool MemReplayGrinder::ParseCommandLine(
@@ -200,6 +203,19 @@ bool MemReplayGrinder::ParseCommandLine(
   DCHECK_NE(static_cast<base::CommandLine*>(nullptr), command_line);
   LoadAsanFunctionNames();
 
+  const char kOutputFormat[] = "output-format";
+  if (!command_line->HasSwitch(kOutputFormat))
+    return true;
+
+  std::string format = command_line->GetSwitchValueASCII(kOutputFormat);
+  if (base::LowerCaseEqualsASCII(format, "packed")) {
+    output_format_ = kPackedFormat;
+  } else if (base::LowerCaseEqualsASCII(format, "archive")) {
+    output_format_ = kArchiveFormat;
+  } else {
+    LOG(ERROR) << "Unknown output format: " << format << ".";
+    return false;
+  }
   return true;
 }
 
@@ -302,6 +318,37 @@ bool MemReplayGrinder::OutputData(FILE* file) {
   if (process_data_map_.empty())
     return false;
 
+  if (output_format_ == kArchiveFormat)
+    return OutputArchive(file);
+  return OutputPackedStories(file);
+}
+
+bool MemReplayGrinder::OutputPackedStories(FILE* file) {
+  DCHECK_NE(static_cast<FILE*>(nullptr), file);
+
+  // The stories are packed straight out of the plot lines built during
+  // grinding, one story per process.
+  bard::PackedStoryWriter writer;
+  for (const auto& proc_data_pair : process_data_map_) {
+    // The first of the existing heaps is the process heap.
+    std::vector<uint64_t> existing_heaps;
+    for (const auto& heap : proc_data_pair.second.existing_heaps)
+      existing_heaps.push_back(reinterpret_cast<uintptr_t>(heap));
+    writer.AddStory(proc_data_pair.second.story, existing_heaps);
+  }
+
+  core::FileOutStream out_stream(file);
+  if (!writer.Write(&out_stream))
+    return false;
+  if (!out_stream.Flush())
+    return false;
+
+  return true;
+}
+
+bool MemReplayGrinder::OutputArchive(FILE* file) {
+  DCHECK_NE(static_cast<FILE*>(nullptr), file);
+
   // Set up the streams/archives for serialization. Using gzip compression
   // reduces the size of the archive by over 70%.
   core::FileOutStream out_stream(file);
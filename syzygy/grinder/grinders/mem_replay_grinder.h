@@ -44,6 +44,15 @@ class MemReplayGrinder : public GrinderInterface {
   MemReplayGrinder();
   ~MemReplayGrinder() override {}
 
+  enum OutputFormat {
+    // Packed stories, which can be memory mapped and streamed by the player.
+    kPackedFormat,
+    // Stories serialized with Story::Save to a compressed archive.
+    kArchiveFormat,
+  };
+
+  OutputFormat output_format() const { return output_format_; }
+
   // @name GrinderInterface implementation.
   // @{
   bool ParseCommandLine(const base::CommandLine* command_line) override;
@@ -105,6 +114,14 @@ class MemReplayGrinder : public GrinderInterface {
                                  ProcessData* proc_data);
   // Sets parse_error_ to true.
   void SetParseError();
+  // Outputs the stories in the packed format.
+  // @param file The file to write to.
+  // @returns true on success, false otherwise.
+  bool OutputPackedStories(FILE* file);
+  // Outputs the stories to a compressed archive.
+  // @param file The file to write to.
+  // @returns true on success, false otherwise.
+  bool OutputArchive(FILE* file);
   // Finds or creates the process data for a given process.
   // @param process_id The ID of the process.
   // @returns the associated ProcessData.
@@ -183,6 +200,9 @@ class MemReplayGrinder : public GrinderInterface {
   // Set to true if a parse error occurs.
   bool parse_error_;
 
+  // The output format to use.
+  OutputFormat output_format_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(MemReplayGrinder);
 };
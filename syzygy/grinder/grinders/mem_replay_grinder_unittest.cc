@@ -19,6 +19,7 @@
 #include "base/files/scoped_temp_dir.h"
 #include "base/strings/string_util.h"
 #include "gtest/gtest.h"
+#include "syzygy/bard/packed_story.h"
 #include "syzygy/bard/events/heap_alloc_event.h"
 #include "syzygy/bard/events/linked_event.h"
 #include "syzygy/core/unittest_util.h"
@@ -124,6 +125,26 @@ TEST_F(MemReplayGrinderTest, ParseCommandLine) {
   EXPECT_TRUE(grinder.function_enum_map_.empty());
   EXPECT_TRUE(grinder.ParseCommandLine(&cmd_line_));
   EXPECT_FALSE(grinder.function_enum_map_.empty());
+  EXPECT_EQ(MemReplayGrinder::kPackedFormat, grinder.output_format());
+}
+
+TEST_F(MemReplayGrinderTest, ParseOutputFormat) {
+  TestMemReplayGrinder grinder1;
+  base::CommandLine cmd_line1(cmd_line_);
+  cmd_line1.AppendSwitchASCII("output-format", "archive");
+  EXPECT_TRUE(grinder1.ParseCommandLine(&cmd_line1));
+  EXPECT_EQ(MemReplayGrinder::kArchiveFormat, grinder1.output_format());
+
+  TestMemReplayGrinder grinder2;
+  base::CommandLine cmd_line2(cmd_line_);
+  cmd_line2.AppendSwitchASCII("output-format", "packed");
+  EXPECT_TRUE(grinder2.ParseCommandLine(&cmd_line2));
+  EXPECT_EQ(MemReplayGrinder::kPackedFormat, grinder2.output_format());
+
+  TestMemReplayGrinder grinder3;
+  base::CommandLine cmd_line3(cmd_line_);
+  cmd_line3.AppendSwitchASCII("output-format", "foo");
+  EXPECT_FALSE(grinder3.ParseCommandLine(&cmd_line3));
 }
 
 TEST_F(MemReplayGrinderTest, RecognizedFunctionName) {
@@ -329,6 +350,16 @@ TEST_F(MemReplayGrinderTest, GrindHarnessTrace) {
   base::ScopedFILE output_file(base::OpenFile(output_path, "wb"));
   EXPECT_TRUE(grinder.OutputData(output_file.get()));
   output_file.reset();
+
+  // The packed output holds the same story.
+  bard::PackedStoryFile story_file;
+  ASSERT_TRUE(story_file.Open(output_path));
+  ASSERT_EQ(1u, story_file.story_count());
+  const bard::PackedStory* packed_story = story_file.story(0);
+  EXPECT_EQ(proc.existing_heaps.size(), packed_story->existing_heap_count());
+  bard::Story unpacked_story;
+  ASSERT_TRUE(packed_story->Unpack(&unpacked_story));
+  EXPECT_TRUE(*proc.story == unpacked_story);
 }
 
 }  // namespace grinders
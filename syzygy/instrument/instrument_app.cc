@@ -103,6 +103,16 @@ static const char kUsageFormatStr[] =
     "                            analysis.\n"
     "    --no-redundancy-analysis\n"
     "                            Disables redundant memory access analysis.\n"
+    "    --transform-cache-dir=<path>\n"
+    "                            A directory caching the instrumentation of\n"
+    "                            code blocks across runs. Blocks that did not\n"
+    "                            change since a previous run are not\n"
+    "                            decomposed again. The output does not\n"
+    "                            depend on this.\n"
+    "    --transform-threads=NUM\n"
+    "                            The number of threads used to decompose and\n"
+    "                            instrument code blocks. Defaults to 1. The\n"
+    "                            output does not depend on this value.\n"
     "  branch mode options:\n"
     "    --buffering             Enable per-thread buffering of events.\n"
     "    --fs-slot=<slot>        Specify which FS slot to use for thread\n"
@@ -18,6 +18,7 @@
 
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "syzygy/application/application.h"
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
 
@@ -33,6 +34,7 @@ AsanInstrumenter::AsanInstrumenter()
       remove_redundant_checks_(true),
       use_liveness_analysis_(true),
       instrumentation_rate_(1.0),
+      num_threads_(1),
       asan_rtl_options_(false),
       hot_patching_(false) {
 }
@@ -72,8 +74,17 @@ bool AsanInstrumenter::InstrumentImpl() {
   asan_transform_->set_use_liveness_analysis(use_liveness_analysis_);
   asan_transform_->set_remove_redundant_checks(remove_redundant_checks_);
   asan_transform_->set_instrumentation_rate(instrumentation_rate_);
+  asan_transform_->set_num_threads(num_threads_);
   asan_transform_->set_hot_patching(hot_patching_);
 
+  // Set up the transform cache if a directory was provided.
+  if (!transform_cache_dir_.empty()) {
+    transform_cache_.reset(new block_graph::TransformCache());
+    if (!transform_cache_->Init(transform_cache_dir_))
+      return false;
+    asan_transform_->set_transform_cache(transform_cache_.get());
+  }
+
   // Set up the filter if one was provided.
   if (filter.get()) {
     filter_.reset(filter.release());
@@ -126,6 +137,21 @@ bool AsanInstrumenter::DoCommandLineParse(
     instrumentation_rate_ = std::max(0.0, std::min(1.0, d));
   }
 
+  // Parse the number of instrumentation threads if one has been provided.
+  static const char kTransformThreads[] = "transform-threads";
+  if (command_line->HasSwitch(kTransformThreads)) {
+    std::string s = command_line->GetSwitchValueASCII(kTransformThreads);
+    unsigned num_threads = 0;
+    if (!base::StringToUint(s, &num_threads) || num_threads == 0) {
+      LOG(ERROR) << "Invalid number of transform threads: " << s;
+      return false;
+    }
+    num_threads_ = num_threads;
+  }
+
+  transform_cache_dir_ =
+      command_line->GetSwitchValuePath("transform-cache-dir");
+
   // Parse Asan RTL options if present.
   static const char kAsanRtlOptions[] = "asan-rtl-options";
   asan_rtl_options_ = command_line->HasSwitch(kAsanRtlOptions);
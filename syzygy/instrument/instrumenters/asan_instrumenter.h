@@ -19,6 +19,7 @@
 #include <string>
 
 #include "base/command_line.h"
+#include "syzygy/block_graph/transform_cache.h"
 #include "syzygy/common/asan_parameters.h"
 #include "syzygy/instrument/instrumenters/instrumenter_with_agent.h"
 #include "syzygy/instrument/transforms/allocation_filter_transform.h"
@@ -57,6 +58,8 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   bool remove_redundant_checks_;
   bool use_liveness_analysis_;
   double instrumentation_rate_;
+  size_t num_threads_;
+  base::FilePath transform_cache_dir_;
   bool asan_rtl_options_;
   bool hot_patching_;
   // @}
@@ -67,6 +70,9 @@ class AsanInstrumenter : public InstrumenterWithAgent {
   // The transform for this agent.
   std::unique_ptr<instrument::transforms::AsanTransform> asan_transform_;
 
+  // The cache of basic-block transform results (optional).
+  std::unique_ptr<block_graph::TransformCache> transform_cache_;
+
   // The image filter (optional).
   std::unique_ptr<pe::ImageFilter> filter_;
 
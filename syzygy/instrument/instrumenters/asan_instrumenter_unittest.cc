@@ -46,9 +46,11 @@ class TestAsanInstrumenter : public AsanInstrumenter {
   using AsanInstrumenter::instrumentation_rate_;
   using AsanInstrumenter::no_augment_pdb_;
   using AsanInstrumenter::no_strip_strings_;
+  using AsanInstrumenter::num_threads_;
   using AsanInstrumenter::output_image_path_;
   using AsanInstrumenter::output_pdb_path_;
   using AsanInstrumenter::remove_redundant_checks_;
+  using AsanInstrumenter::transform_cache_dir_;
   using AsanInstrumenter::use_interceptors_;
   using AsanInstrumenter::use_liveness_analysis_;
   using InstrumenterWithAgent::CreateRelinker;
@@ -158,11 +160,14 @@ TEST_F(AsanInstrumenterTest, ParseMinimalAsan) {
   EXPECT_TRUE(instrumenter_.use_liveness_analysis_);
   EXPECT_TRUE(instrumenter_.remove_redundant_checks_);
   EXPECT_EQ(1.0, instrumenter_.instrumentation_rate_);
+  EXPECT_EQ(1u, instrumenter_.num_threads_);
+  EXPECT_TRUE(instrumenter_.transform_cache_dir_.empty());
   EXPECT_FALSE(instrumenter_.asan_rtl_options_);
   EXPECT_FALSE(instrumenter_.hot_patching_);
 }
 
 TEST_F(AsanInstrumenterTest, ParseFullAsan) {
+  const base::FilePath transform_cache_dir(L"transform_cache");
   SetUpValidCommandLine();
   cmd_line_.AppendSwitchPath("filter", test_dll_filter_path_);
   cmd_line_.AppendSwitchASCII("agent", "foo.dll");
@@ -177,6 +182,8 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   cmd_line_.AppendSwitch("no-liveness-analysis");
   cmd_line_.AppendSwitch("no-redundancy-analysis");
   cmd_line_.AppendSwitchASCII("instrumentation-rate", "0.5");
+  cmd_line_.AppendSwitchASCII("transform-threads", "4");
+  cmd_line_.AppendSwitchPath("transform-cache-dir", transform_cache_dir);
   cmd_line_.AppendSwitchASCII("asan-rtl-options",
       "\"--quarantine_size=1024 --quarantine_block_size=512 --ignored\"");
 
@@ -196,6 +203,8 @@ TEST_F(AsanInstrumenterTest, ParseFullAsan) {
   EXPECT_FALSE(instrumenter_.use_liveness_analysis_);
   EXPECT_FALSE(instrumenter_.remove_redundant_checks_);
   EXPECT_EQ(0.5, instrumenter_.instrumentation_rate_);
+  EXPECT_EQ(4u, instrumenter_.num_threads_);
+  EXPECT_EQ(transform_cache_dir, instrumenter_.transform_cache_dir_);
   EXPECT_TRUE(instrumenter_.asan_rtl_options_);
   EXPECT_TRUE(instrumenter_.hot_patching_);
 
@@ -252,6 +261,14 @@ TEST_F(AsanInstrumenterTest, FailsWithInvalidInstrumentationRate) {
   EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
 }
 
+TEST_F(AsanInstrumenterTest, FailsWithInvalidTransformThreads) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("transform-threads", "0");
+
+  EXPECT_FALSE(instrumenter_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(AsanInstrumenterTest, FailsWithInvalidAsanRtlOptions) {
   cmd_line_.AppendSwitchPath("input-image", input_image_path_);
   cmd_line_.AppendSwitchPath("output-image", output_image_path_);
@@ -18,6 +18,7 @@
 #include <list>
 #include <vector>
 
+#include "base/bind.h"
 #include "base/logging.h"
 #include "base/rand_util.h"
 #include "base/memory/ref_counted.h"
@@ -28,6 +29,7 @@
 #include "syzygy/block_graph/basic_block_assembler.h"
 #include "syzygy/block_graph/block_builder.h"
 #include "syzygy/block_graph/block_util.h"
+#include "syzygy/block_graph/parallel_transform.h"
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/instrument/transforms/asan_intercepts.h"
@@ -1229,6 +1231,38 @@ void AsanBasicBlockTransform::set_instrumentation_rate(
   instrumentation_rate_ = std::max(0.0, std::min(1.0, instrumentation_rate));
 }
 
+bool AsanBasicBlockTransform::GetCacheParameters(
+    std::string* parameters) const {
+  DCHECK_NE(static_cast<std::string*>(nullptr), parameters);
+
+  // Sampled instrumentation isn't reproducible, and the dry run and filtered
+  // modes have side effects or inputs the cache doesn't capture.
+  if (dry_run_ || filter() != nullptr ||
+      (instrumentation_rate_ != 0.0 && instrumentation_rate_ != 1.0)) {
+    return false;
+  }
+
+  *parameters = base::StringPrintf(
+      "debug_friendly=%d,liveness=%d,redundant_checks=%d,rate=%d,hooks=",
+      debug_friendly_, use_liveness_analysis_, remove_redundant_checks_,
+      static_cast<int>(instrumentation_rate_));
+  for (const auto& entry : *check_access_hooks_) {
+    base::StringAppendF(parameters, "%d/%d/%d/%d;", entry.first.mode,
+                        entry.first.size, entry.first.opcode,
+                        entry.first.save_flags);
+  }
+  return true;
+}
+
+void AsanBasicBlockTransform::GetCacheExternalReferences(
+    std::vector<BlockGraph::Reference>* references) const {
+  DCHECK_NE(static_cast<std::vector<BlockGraph::Reference>*>(nullptr),
+            references);
+
+  for (const auto& entry : *check_access_hooks_)
+    references->push_back(entry.second);
+}
+
 bool AsanBasicBlockTransform::TransformBasicBlockSubGraph(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1314,6 +1348,8 @@ AsanTransform::AsanTransform()
       remove_redundant_checks_(false),
       use_interceptors_(false),
       instrumentation_rate_(1.0),
+      num_threads_(1),
+      transform_cache_(nullptr),
       asan_parameters_(nullptr),
       check_access_hooks_ref_(),
       asan_parameters_block_(nullptr),
@@ -1395,17 +1431,12 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   if (ShouldSkipBlock(policy, block))
     return true;
 
-  // Use the filter that was passed to us for our child transform.
   AsanBasicBlockTransform transform(&check_access_hooks_ref_);
-  transform.set_debug_friendly(debug_friendly());
-  transform.set_use_liveness_analysis(use_liveness_analysis());
-  transform.set_remove_redundant_checks(remove_redundant_checks());
-  transform.set_filter(filter());
-  transform.set_instrumentation_rate(instrumentation_rate_);
+  ConfigureBasicBlockTransform(&transform);
 
   if (!hot_patching_) {
-    if (!ApplyBasicBlockSubGraphTransform(
-            &transform, policy, block_graph, block, NULL)) {
+    if (!ApplyBasicBlockSubGraphTransform(&transform, policy, block_graph,
+                                          block, NULL, transform_cache_)) {
       return false;
     }
   } else {
@@ -1431,6 +1462,45 @@ bool AsanTransform::OnBlock(const TransformPolicyInterface* policy,
   return true;
 }
 
+bool AsanTransform::TransformBlockGraph(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* header_block) {
+  // Hot patching needs to collect the blocks it creates in order, so it goes
+  // through the serial iteration.
+  if (num_threads_ == 1 || hot_patching_) {
+    return block_graph::transforms::IterativeTransformImpl<
+        AsanTransform>::TransformBlockGraph(policy, block_graph, header_block);
+  }
+
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(header_block != NULL);
+
+  if (!PreBlockGraphIteration(policy, block_graph, header_block)) {
+    LOG(ERROR) << "PreBlockGraphIteration failed for \"" << name()
+               << "\" transform.";
+    return false;
+  }
+
+  if (!block_graph::ApplyBasicBlockSubGraphTransformsInParallel(
+          base::Bind(&AsanTransform::CreateBasicBlockTransform,
+                     base::Unretained(this), base::Unretained(policy)),
+          policy, num_threads_, block_graph, transform_cache_, NULL)) {
+    LOG(ERROR) << "Parallel instrumentation failed for \"" << name()
+               << "\" transform.";
+    return false;
+  }
+
+  if (!PostBlockGraphIteration(policy, block_graph, header_block)) {
+    LOG(ERROR) << "PostBlockGraphIteration failed for \"" << name()
+               << "\" transform.";
+    return false;
+  }
+
+  return true;
+}
+
 bool AsanTransform::PostBlockGraphIteration(
     const TransformPolicyInterface* policy,
     BlockGraph* block_graph,
@@ -1439,6 +1509,9 @@ bool AsanTransform::PostBlockGraphIteration(
   DCHECK(block_graph != NULL);
   DCHECK(header_block != NULL);
 
+  if (transform_cache_ != nullptr)
+    transform_cache_->LogStats();
+
   if (block_graph->image_format() == BlockGraph::PE_IMAGE) {
     if (!PeInterceptFunctions(kAsanIntercepts, policy, block_graph,
                               header_block)) {
@@ -1520,6 +1593,36 @@ void AsanTransform::FindHeapInitAndCrtHeapBlocks(BlockGraph* block_graph) {
   }
 }
 
+void AsanTransform::ConfigureBasicBlockTransform(
+    AsanBasicBlockTransform* transform) {
+  DCHECK_NE(reinterpret_cast<AsanBasicBlockTransform*>(NULL), transform);
+
+  // Use the filter that was passed to us for our child transform.
+  transform->set_debug_friendly(debug_friendly());
+  transform->set_use_liveness_analysis(use_liveness_analysis());
+  transform->set_remove_redundant_checks(remove_redundant_checks());
+  transform->set_filter(filter());
+  transform->set_instrumentation_rate(instrumentation_rate_);
+}
+
+block_graph::BasicBlockSubGraphTransformInterface*
+AsanTransform::CreateBasicBlockTransform(
+    const TransformPolicyInterface* policy,
+    BlockGraph* block_graph,
+    BlockGraph::Block* block) {
+  DCHECK(policy != NULL);
+  DCHECK(block_graph != NULL);
+  DCHECK(block != NULL);
+
+  if (ShouldSkipBlock(policy, block))
+    return NULL;
+
+  AsanBasicBlockTransform* transform =
+      new AsanBasicBlockTransform(&check_access_hooks_ref_);
+  ConfigureBasicBlockTransform(transform);
+  return transform;
+}
+
 bool AsanTransform::ShouldSkipBlock(const TransformPolicyInterface* policy,
                                     BlockGraph::Block* block) {
   // Heap initialization blocks and intercepted blocks must be skipped.
@@ -1677,7 +1780,7 @@ bool AsanTransform::PeInjectAsanParameters(
   params_block->CopyData(fparams.data().size(), fparams.data().data());
 
   // Wire up any references that are required.
-  static_assert(14 == common::kAsanParametersVersion,
+  static_assert(15 == common::kAsanParametersVersion,
                 "Pointers in the params must be linked up here.");
   block_graph::TypedBlock<common::AsanParameters> params;
   CHECK(params.Init(0, params_block));
@@ -26,6 +26,8 @@
 #include "base/strings/string_piece.h"
 #include "syzygy/block_graph/filterable.h"
 #include "syzygy/block_graph/iterate.h"
+#include "syzygy/block_graph/transform.h"
+#include "syzygy/block_graph/transform_cache.h"
 #include "syzygy/block_graph/analysis/liveness_analysis.h"
 #include "syzygy/block_graph/analysis/memory_access_analysis.h"
 #include "syzygy/block_graph/transforms/iterative_transform.h"
@@ -135,6 +137,14 @@ class AsanBasicBlockTransform
       BlockGraph* block_graph,
       BasicBlockSubGraph* basic_block_subgraph) override;
 
+  // @name Result caching. The results are cacheable unless they are sampled,
+  //     filtered or only computed as a dry run.
+  // @{
+  bool GetCacheParameters(std::string* parameters) const override;
+  void GetCacheExternalReferences(
+      std::vector<BlockGraph::Reference>* references) const override;
+  // @}
+
  protected:
   // Instruments the memory accesses in a basic block.
   // @param basic_block The basic block to be instrumented.
@@ -253,6 +263,16 @@ class AsanTransform
                                BlockGraph::Block* header_block);
   // @}
 
+  // @name BlockGraphTransformInterface implementation.
+  // @{
+  // Overridden to decompose and instrument the code blocks on a pool of
+  // worker threads when num_threads() is greater than 1. Hot patching mode is
+  // always applied serially.
+  bool TransformBlockGraph(const TransformPolicyInterface* policy,
+                           BlockGraph* block_graph,
+                           BlockGraph::Block* header_block) override;
+  // @}
+
   // @name Accessors and mutators.
   // @{
   void set_instrument_dll_name(const base::StringPiece& instrument_dll_name) {
@@ -287,6 +307,24 @@ class AsanTransform
   double instrumentation_rate() const { return instrumentation_rate_; }
   void set_instrumentation_rate(double instrumentation_rate);
 
+  // The number of threads used to decompose and instrument code blocks. The
+  // output is identical regardless of this value.
+  size_t num_threads() const { return num_threads_; }
+  void set_num_threads(size_t num_threads) {
+    DCHECK_LT(0u, num_threads);
+    num_threads_ = num_threads;
+  }
+
+  // The cache of basic-block transform results, or NULL if the code blocks
+  // are always decomposed and instrumented. This isn't owned by the
+  // transform, and isn't used in hot patching mode.
+  block_graph::TransformCache* transform_cache() const {
+    return transform_cache_;
+  }
+  void set_transform_cache(block_graph::TransformCache* transform_cache) {
+    transform_cache_ = transform_cache;
+  }
+
   // Asan RTL parameters.
   const common::InflatedAsanParameters* asan_parameters() const {
     return asan_parameters_;
@@ -346,6 +384,21 @@ class AsanTransform
   bool ShouldSkipBlock(const TransformPolicyInterface* policy,
                        BlockGraph::Block* block);
 
+  // Configures a basic-block transform with the options of this transform.
+  // @param transform The basic-block transform to configure.
+  void ConfigureBasicBlockTransform(AsanBasicBlockTransform* transform);
+
+  // Creates the basic-block transform to apply to a block when instrumenting
+  // in parallel. This is a BasicBlockSubGraphTransformFactory.
+  // @param policy The policy object restricting how the transform is applied.
+  // @param block_graph The block graph being transformed.
+  // @param block The block to be instrumented.
+  // @returns a heap allocated transform, or NULL if the block is skipped.
+  block_graph::BasicBlockSubGraphTransformInterface* CreateBasicBlockTransform(
+      const TransformPolicyInterface* policy,
+      BlockGraph* block_graph,
+      BlockGraph::Block* block);
+
   // @name PE-specific methods.
   // @{
   // Finds statically linked functions that need to be intercepted. Called in
@@ -404,6 +457,12 @@ class AsanTransform
   // implemented using random sampling.
   double instrumentation_rate_;
 
+  // The number of threads used to decompose and instrument code blocks.
+  size_t num_threads_;
+
+  // The cache of basic-block transform results. May be NULL.
+  block_graph::TransformCache* transform_cache_;
+
   // Asan RTL parameters that will be injected into the instrumented image.
   // These will be found by the RTL and used to control its behaviour. Allows
   // for setting parameters at instrumentation time that vary from the defaults.
@@ -61,6 +61,10 @@ Minidump::TypedThreadExList Minidump::GetThreadExList() const {
   return TypedThreadExList(*this, ThreadExListStream);
 }
 
+const uint8_t* Minidump::GetBytesView(size_t offset, size_t data_size) const {
+  return nullptr;
+}
+
 bool Minidump::ReadDirectory() {
   // Read the header and validate the signature.
   MINIDUMP_HEADER header = {};
@@ -119,6 +123,7 @@ bool FileMinidump::ReadBytes(size_t offset,
                              size_t data_size,
                              void* data) const {
   DCHECK_LE(offset, static_cast<size_t>(std::numeric_limits<long>::max()));
+  base::AutoLock lock(file_lock_);
   if (fseek(file_.get(), static_cast<long>(offset), SEEK_SET) != 0)
     return false;
 
@@ -128,6 +133,36 @@ bool FileMinidump::ReadBytes(size_t offset,
   return true;
 }
 
+bool MappedMinidump::Open(const base::FilePath& path) {
+  if (!file_.Initialize(path))
+    return false;
+
+  return ReadDirectory();
+}
+
+bool MappedMinidump::ReadBytes(size_t offset,
+                               size_t data_size,
+                               void* data) const {
+  const uint8_t* view = GetBytesView(offset, data_size);
+  if (view == nullptr)
+    return false;
+
+  ::memcpy(data, view, data_size);
+  return true;
+}
+
+const uint8_t* MappedMinidump::GetBytesView(size_t offset,
+                                            size_t data_size) const {
+  // Bounds check the request.
+  size_t length = file_.length();
+  if (offset >= length || offset + data_size > length ||
+      offset + data_size < offset) {  // Test for overflow.
+    return nullptr;
+  }
+
+  return file_.data() + offset;
+}
+
 BufferMinidump::BufferMinidump() : buf_(nullptr), buf_len_(0) {
 }
 
@@ -153,6 +188,17 @@ bool BufferMinidump::ReadBytes(size_t offset,
   return true;
 }
 
+const uint8_t* BufferMinidump::GetBytesView(size_t offset,
+                                            size_t data_size) const {
+  // Bounds check the request.
+  if (offset >= buf_len_ || offset + data_size > buf_len_ ||
+      offset + data_size < offset) {  // Test for overflow.
+    return nullptr;
+  }
+
+  return buf_ + offset;
+}
+
 Minidump::Stream::Stream()
     : minidump_(nullptr),
       current_offset_(0),
@@ -222,6 +268,15 @@ bool Minidump::Stream::ReadBytes(size_t data_len, void* data) {
   return true;
 }
 
+const void* Minidump::Stream::GetView(size_t data_len) const {
+  DCHECK(minidump_ != nullptr);
+
+  if (data_len > remaining_length_)
+    return nullptr;
+
+  return minidump_->GetBytesView(current_offset_, data_len);
+}
+
 bool Minidump::Stream::AdvanceBytes(size_t data_len) {
   if (data_len > remaining_length_)
     return false;
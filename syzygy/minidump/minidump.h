@@ -26,7 +26,9 @@
 
 #include "base/macros.h"
 #include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/files/scoped_file.h"
+#include "base/synchronization/lock.h"
 
 namespace minidump {
 
@@ -104,6 +106,7 @@ class Minidump {
   friend class Stream;
 
   // @name Data accessors.
+  // @{
   // Reads file contents.
   // @param offset the file offset to read from.
   // @param data_size the amount of data to read.
@@ -112,6 +115,17 @@ class Minidump {
   // @returns true on success, false on failure, including a short read.
   virtual bool ReadBytes(size_t offset, size_t data_size, void* data) const = 0;
 
+  // Retrieves a pointer to file contents, without copying them. The default
+  // implementation returns nullptr, for minidumps whose contents aren't held
+  // in memory.
+  // @param offset the file offset of the contents.
+  // @param data_size the size of the contents.
+  // @returns a pointer to the @p data_size bytes at @p offset, which is valid
+  //     for the lifetime of the minidump, or nullptr if the contents aren't
+  //     directly addressable or the range is out of bounds.
+  virtual const uint8_t* GetBytesView(size_t offset, size_t data_size) const;
+  // @}
+
   bool ReadDirectory();
 
   std::vector<MINIDUMP_DIRECTORY> directory_;
@@ -132,9 +146,30 @@ class FileMinidump : public Minidump {
   bool ReadBytes(size_t offset, size_t data_size, void* data) const override;
 
  private:
+  // Serializes the seek and read pairs of ReadBytes, which may be invoked
+  // from multiple threads.
+  mutable base::Lock file_lock_;
   base::ScopedFILE file_;
 };
 
+// Allows parsing a minidump from a memory mapped file. The contents of the file
+// are directly addressable, which allows the streams to be parsed without
+// copying them. Reads don't need to be serialized.
+class MappedMinidump : public Minidump {
+ public:
+  // Maps the minidump file at @p path and verifies its header structure.
+  // @param path the minidump file to map.
+  // @return true on success, false on failure.
+  bool Open(const base::FilePath& path);
+
+ protected:
+  bool ReadBytes(size_t offset, size_t data_size, void* data) const override;
+  const uint8_t* GetBytesView(size_t offset, size_t data_size) const override;
+
+ private:
+  base::MemoryMappedFile file_;
+};
+
 // Allows parsing a minidump from an in-memory buffer.
 class BufferMinidump : public Minidump {
  public:
@@ -150,6 +185,7 @@ class BufferMinidump : public Minidump {
 
  protected:
   bool ReadBytes(size_t offset, size_t data_size, void* data) const override;
+  const uint8_t* GetBytesView(size_t offset, size_t data_size) const override;
 
  private:
   // Not owned.
@@ -187,6 +223,14 @@ class Minidump::Stream {
   bool AdvanceBytes(size_t data_len);
   // @}
 
+  // Retrieves a pointer to the next @p data_len bytes of the stream, without
+  // copying them or advancing over them.
+  // @param data_len the number of bytes to retrieve.
+  // @returns a pointer to the bytes, valid for the lifetime of the minidump,
+  //     or nullptr if the stream has fewer than @p data_len bytes remaining or
+  //     if the minidump's contents aren't directly addressable.
+  const void* GetView(size_t data_len) const;
+
   // Accessors.
   size_t current_offset() const { return current_offset_; }
   size_t remaining_length() const { return remaining_length_; }
@@ -202,24 +246,26 @@ class Minidump::Stream {
 };
 
 // A forward only-iterator for Minidump Streams that yields elements of a
-// given, fixed type.
+// given, fixed type. When the minidump's contents are directly addressable,
+// the elements are yielded in place, otherwise they're read one at a time.
 template <typename ElementType>
 class TypedMinidumpStreamIterator {
  public:
   // Creates a new iterator on @p stream. This iterator will yield
   // @p stream.GetBytesRemaining() / sizeof(ElementType) elements.
   explicit TypedMinidumpStreamIterator(const minidump::Minidump::Stream& stream)
-      : stream_(stream) {
+      : stream_(stream), current_(nullptr) {
     // Make sure the stream contains a range that covers whole elements.
     DCHECK(!stream_.IsValid() ||
            (stream.remaining_length() % sizeof(ElementType) == 0));
-    if (stream.remaining_length() != 0) {
-      // It's fatal if we can't pre-read the element that should be there.
-      CHECK(stream_.ReadBytes(sizeof(element_), &element_));
-    }
+    if (stream.remaining_length() != 0)
+      LoadCurrentElement();
   }
   TypedMinidumpStreamIterator(const TypedMinidumpStreamIterator& o)
-      : stream_(o.stream), element_(o.element_) {}
+      : stream_(o.stream_), element_(o.element_), current_(o.current_) {
+    if (o.current_ == &o.element_)
+      current_ = &element_;
+  }
 
   void operator++() {
     // It's invalid to advance the end iterator.
@@ -229,8 +275,8 @@ class TypedMinidumpStreamIterator {
     CHECK(stream_.AdvanceBytes(sizeof(element_)));
 
     if (stream_.remaining_length()) {
-      // Not yet at end, read the current element. Fatal if this fails.
-      CHECK(stream_.ReadBytes(sizeof(element_), &element_));
+      // Not yet at end, load the current element.
+      LoadCurrentElement();
     }
   }
 
@@ -243,15 +289,35 @@ class TypedMinidumpStreamIterator {
 
   const ElementType& operator*() const {
     DCHECK_NE(0u, stream_.remaining_length());
-    return element_;
+    DCHECK(current_);
+    return *current_;
   }
 
  private:
   // Disallow default construction.
   TypedMinidumpStreamIterator() {}
 
+  // Points current_ to the element at the head of stream_, in place if
+  // possible. It's fatal if the element can't be read.
+  void LoadCurrentElement() {
+    const void* view = stream_.GetView(sizeof(ElementType));
+    if (view != nullptr &&
+        reinterpret_cast<uintptr_t>(view) % alignof(ElementType) == 0) {
+      current_ = reinterpret_cast<const ElementType*>(view);
+      return;
+    }
+
+    CHECK(stream_.ReadBytes(sizeof(element_), &element_));
+    current_ = &element_;
+  }
+
   minidump::Minidump::Stream stream_;
   ElementType element_;
+  // Points to the current element, either within the minidump or to
+  // element_.
+  const ElementType* current_;
+
+  DISALLOW_ASSIGN(TypedMinidumpStreamIterator);
 };
 
 // A typed minidump stream allows reading a stream header and iterating over
@@ -274,6 +340,18 @@ class TypedMinidumpStream {
     return *reinterpret_cast<const HeaderType*>(header_storage_);
   }
 
+  // @returns the number of elements in the stream.
+  size_t size() const {
+    return element_stream_.remaining_length() / sizeof(ElementType);
+  }
+
+  // Retrieves the elements of the stream in place.
+  // @returns a pointer to the size() elements of the stream, valid for the
+  //     lifetime of the minidump, or nullptr if the minidump's contents aren't
+  //     directly addressable, the elements aren't suitably aligned or the
+  //     stream is invalid or empty.
+  const ElementType* elements() const;
+
   Iterator begin() const { return Iterator(element_stream_); }
   Iterator end() const {
     return Iterator(Minidump::Stream(
@@ -337,6 +415,25 @@ bool TypedMinidumpStream<HeaderType, ElementType, ParseHeaderFunction>::
   return true;
 }
 
+template <typename HeaderType,
+          typename ElementType,
+          size_t (*ParseHeaderFunction)(const HeaderType& hdr)>
+const ElementType*
+TypedMinidumpStream<HeaderType, ElementType, ParseHeaderFunction>::elements()
+    const {
+  if (!IsValid() || element_stream_.remaining_length() == 0)
+    return nullptr;
+
+  const void* view = element_stream_.GetView(
+      element_stream_.remaining_length());
+  if (view == nullptr ||
+      reinterpret_cast<uintptr_t>(view) % alignof(ElementType) != 0) {
+    return nullptr;
+  }
+
+  return reinterpret_cast<const ElementType*>(view);
+}
+
 template <typename DataType>
 bool Minidump::Stream::ReadAndAdvanceElement(DataType* element) {
   return ReadAndAdvanceBytes(sizeof(DataType), element);
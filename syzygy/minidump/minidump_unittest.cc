@@ -177,6 +177,85 @@ TEST_F(FileMinidumpTest, GetThreadList) {
   ASSERT_LT(0u, thread_id_set.size());
 }
 
+TEST_F(FileMinidumpTest, MappedMinidumpOpenFailsForInvalidFile) {
+  MappedMinidump minidump;
+
+  // Try opening a non-existing file.
+  ASSERT_FALSE(minidump.Open(dump_file()));
+}
+
+TEST_F(FileMinidumpTest, MappedMinidumpMatchesFileMinidump) {
+  FileMinidump file_minidump;
+  ASSERT_TRUE(file_minidump.Open(testing::TestMinidumps::GetNotepad32Dump()));
+  MappedMinidump mapped_minidump;
+  ASSERT_TRUE(
+      mapped_minidump.Open(testing::TestMinidumps::GetNotepad32Dump()));
+  ASSERT_EQ(file_minidump.directory().size(),
+            mapped_minidump.directory().size());
+
+  // The file minidump can't serve its contents in place.
+  auto file_memory = file_minidump.GetMemoryList();
+  ASSERT_TRUE(file_memory.IsValid());
+  EXPECT_EQ(nullptr, file_memory.elements());
+
+  // The mapped minidump serves its lists in place, and they match the ones
+  // read from the file.
+  auto memory = mapped_minidump.GetMemoryList();
+  ASSERT_TRUE(memory.IsValid());
+  ASSERT_EQ(file_memory.size(), memory.size());
+  const MINIDUMP_MEMORY_DESCRIPTOR* descriptors = memory.elements();
+  ASSERT_NE(nullptr, descriptors);
+
+  size_t i = 0;
+  for (const auto& file_descriptor : file_memory) {
+    ASSERT_GT(memory.size(), i);
+    const MINIDUMP_MEMORY_DESCRIPTOR& descriptor = descriptors[i++];
+    EXPECT_EQ(file_descriptor.StartOfMemoryRange,
+              descriptor.StartOfMemoryRange);
+    ASSERT_EQ(file_descriptor.Memory.DataSize, descriptor.Memory.DataSize);
+
+    // The memory contents are served in place too.
+    Minidump::Stream file_bytes =
+        file_minidump.GetStreamFor(file_descriptor.Memory);
+    EXPECT_EQ(nullptr, file_bytes.GetView(file_bytes.remaining_length()));
+    std::string expected;
+    ASSERT_TRUE(file_bytes.ReadAndAdvanceBytes(file_bytes.remaining_length(),
+                                               &expected));
+
+    Minidump::Stream bytes = mapped_minidump.GetStreamFor(descriptor.Memory);
+    const void* view = bytes.GetView(bytes.remaining_length());
+    ASSERT_NE(nullptr, view);
+    EXPECT_EQ(0, ::memcmp(expected.data(), view, expected.size()));
+  }
+  EXPECT_EQ(memory.size(), i);
+
+  auto file_modules = file_minidump.GetModuleList();
+  auto modules = mapped_minidump.GetModuleList();
+  ASSERT_TRUE(modules.IsValid());
+  ASSERT_EQ(file_modules.size(), modules.size());
+  ASSERT_NE(nullptr, modules.elements());
+  i = 0;
+  for (const auto& file_module : file_modules) {
+    EXPECT_EQ(file_module.BaseOfImage, modules.elements()[i].BaseOfImage);
+    EXPECT_EQ(file_module.SizeOfImage, modules.elements()[i].SizeOfImage);
+    ++i;
+  }
+
+  auto file_threads = file_minidump.GetThreadList();
+  auto threads = mapped_minidump.GetThreadList();
+  ASSERT_TRUE(threads.IsValid());
+  ASSERT_EQ(file_threads.size(), threads.size());
+  ASSERT_NE(nullptr, threads.elements());
+
+  // Iterating yields the elements in place.
+  i = 0;
+  for (const auto& thread : threads) {
+    EXPECT_EQ(&threads.elements()[i], &thread);
+    ++i;
+  }
+  EXPECT_EQ(threads.size(), i);
+}
+
 #if 0
 // TODO(siggi): This is apparently itanium-specific :/.
 TEST_F(FileMinidumpTest, GetThreadExList) {
@@ -267,6 +346,11 @@ TEST(BufferMinidumpTest, StreamTest) {
 
   EXPECT_EQ(7U, test.remaining_length());
 
+  // The buffer is directly addressable, but views are bounded to the stream.
+  EXPECT_EQ(buf.data() + sizeof(MINIDUMP_HEADER), test.GetView(7));
+  EXPECT_EQ(nullptr, test.GetView(8));
+  EXPECT_EQ(7U, test.remaining_length());
+
   // Read the first integer.
   const uint32_t kSentinel = 0xCAFEBABE;
   uint32_t tmp = kSentinel;
@@ -295,6 +379,7 @@ TEST(BufferMinidumpTest, StreamTest) {
 
   // No moar data.
   EXPECT_FALSE(test.ReadBytes(1, &bytes));
+  EXPECT_EQ(nullptr, test.GetView(1));
 
   // Reset the stream to test reading via a string.
   test = minidump.GetStreamFor(loc);
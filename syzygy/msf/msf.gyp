@@ -31,6 +31,10 @@
         'msf_file_impl.h',
         'msf_file_stream.h',
         'msf_file_stream_impl.h',
+        'msf_mapped_file_stream.h',
+        'msf_mapped_file_stream_impl.h',
+        'msf_mapped_reader.h',
+        'msf_mapped_reader_impl.h',
         'msf_reader.h',
         'msf_reader_impl.h',
         'msf_stream.h',
@@ -58,6 +62,7 @@
         'msf_byte_stream_unittest.cc',
         'msf_file_stream_unittest.cc',
         'msf_file_unittest.cc',
+        'msf_mapped_reader_unittest.cc',
         'msf_reader_unittest.cc',
         'msf_stream_unittest.cc',
         'msf_writer_unittest.cc',
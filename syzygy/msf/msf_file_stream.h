@@ -17,6 +17,8 @@
 
 #include <stdio.h>
 
+#include <vector>
+
 #include "base/memory/ref_counted.h"
 #include "syzygy/msf/msf_decl.h"
 #include "syzygy/msf/msf_stream.h"
@@ -68,6 +70,14 @@ class MsfFileStreamImpl : public MsfStreamImpl<T> {
 
   // MsfStreamImpl implementation.
   bool ReadBytesAt(size_t pos, size_t count, void* dest) override;
+  MsfFileStreamImpl* AsMsfFileStream() override { return this; }
+
+  // @name Accessors.
+  // @{
+  RefCountedFILE* file() const { return file_.get(); }
+  const std::vector<uint32_t>& pages() const { return pages_; }
+  size_t page_size() const { return page_size_; }
+  // @}
 
  protected:
   // Protected to enforce reference counted pointers at compile time.
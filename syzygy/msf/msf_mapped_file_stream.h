@@ -0,0 +1,135 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares an MSF stream that is backed by a read-only memory mapping of the
+// whole MSF file. Unlike MsfFileStreamImpl, which seeks and reads through a
+// shared FILE pointer, reads from these streams are simple copies out of the
+// mapping. As they carry no cursor state they may be read concurrently from
+// multiple threads.
+
+#ifndef SYZYGY_MSF_MSF_MAPPED_FILE_STREAM_H_
+#define SYZYGY_MSF_MSF_MAPPED_FILE_STREAM_H_
+
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/msf/msf_decl.h"
+#include "syzygy/msf/msf_stream.h"
+
+namespace msf {
+
+// A reference counted read-only memory mapping of a file. This is shared by
+// all of the streams of a given MSF file, and the mapping is released when the
+// last of them goes away.
+class RefCountedMappedFile
+    : public base::RefCountedThreadSafe<RefCountedMappedFile> {
+ public:
+  RefCountedMappedFile() {}
+
+  // Maps the given file.
+  // @param path the path of the file to map.
+  // @returns true on success, false otherwise.
+  bool Initialize(const base::FilePath& path) {
+    return mapped_file_.Initialize(path);
+  }
+
+  // @returns a pointer to the start of the mapping, or NULL if the mapping
+  //     is not valid.
+  const uint8_t* data() const { return mapped_file_.data(); }
+
+  // @returns the length of the mapping, in bytes.
+  size_t length() const { return mapped_file_.length(); }
+
+ private:
+  friend base::RefCountedThreadSafe<RefCountedMappedFile>;
+
+  // We disallow access to the destructor to enforce the use of reference
+  // counting pointers.
+  ~RefCountedMappedFile() {}
+
+  base::MemoryMappedFile mapped_file_;
+
+  DISALLOW_COPY_AND_ASSIGN(RefCountedMappedFile);
+};
+
+namespace detail {
+
+// This class represents an MSF stream that lives in a memory mapped file.
+template <MsfFileType T>
+class MsfMappedFileStreamImpl : public MsfStreamImpl<T> {
+ public:
+  // Constructor.
+  // @param file the reference counted mapping housing this stream.
+  // @param length the length of this stream.
+  // @param pages the indices of the pages that make up this stream in the file.
+  //     A copy is made of the data so the pointer need not remain valid
+  //     beyond the constructor. The length of this array is implicit in the
+  //     stream length and the page size.
+  // @param page_size the size of the pages, in bytes.
+  MsfMappedFileStreamImpl(RefCountedMappedFile* file,
+                          size_t length,
+                          const uint32_t* pages,
+                          size_t page_size);
+
+  // MsfStreamImpl implementation.
+  bool ReadBytesAt(size_t pos, size_t count, void* dest) override;
+
+  // Returns a pointer directly into the mapping for a range of the stream,
+  // without copying. This is only possible when the range does not straddle
+  // a page boundary, as consecutive stream pages need not be contiguous in
+  // the file.
+  // @param pos the position in the stream of the first byte of the range.
+  // @param count the number of bytes in the range.
+  // @returns a pointer to the data, or NULL if the range is out of bounds or
+  //     spans more than one page.
+  const uint8_t* GetPageView(size_t pos, size_t count) const;
+
+  // @returns the size of the pages of the stream, in bytes.
+  size_t page_size() const { return page_size_; }
+
+ protected:
+  // Protected to enforce reference counted pointers at compile time.
+  virtual ~MsfMappedFileStreamImpl();
+
+  // @returns a pointer to @p offset bytes into page @p page_num, or NULL if
+  //     @p count bytes at that position lie outside of the mapping.
+  const uint8_t* GetPageData(uint32_t page_num,
+                             size_t offset,
+                             size_t count) const;
+
+ private:
+  // The mapping of the MSF file. This is reference counted so that the streams
+  // can outlive the reader that created them.
+  scoped_refptr<RefCountedMappedFile> file_;
+
+  // The list of pages in the MSF file that make up this stream.
+  std::vector<uint32_t> pages_;
+
+  // The size of pages within the stream.
+  size_t page_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(MsfMappedFileStreamImpl);
+};
+
+}  // namespace detail
+
+using MsfMappedFileStream = detail::MsfMappedFileStreamImpl<kGenericMsfFileType>;
+
+}  // namespace msf
+
+#include "syzygy/msf/msf_mapped_file_stream_impl.h"
+
+#endif  // SYZYGY_MSF_MSF_MAPPED_FILE_STREAM_H_
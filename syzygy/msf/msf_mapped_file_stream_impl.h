@@ -0,0 +1,110 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Internal implementation details for msf_mapped_file_stream.h. Not meant to
+// be included directly.
+
+#ifndef SYZYGY_MSF_MSF_MAPPED_FILE_STREAM_IMPL_H_
+#define SYZYGY_MSF_MSF_MAPPED_FILE_STREAM_IMPL_H_
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "syzygy/msf/msf_decl.h"
+
+namespace msf {
+namespace detail {
+
+template <MsfFileType T>
+MsfMappedFileStreamImpl<T>::MsfMappedFileStreamImpl(RefCountedMappedFile* file,
+                                                    size_t length,
+                                                    const uint32_t* pages,
+                                                    size_t page_size)
+    : MsfStreamImpl(length), file_(file), page_size_(page_size) {
+  DCHECK(file != NULL);
+  size_t num_pages = (length + page_size - 1) / page_size;
+  pages_.assign(pages, pages + num_pages);
+}
+
+template <MsfFileType T>
+MsfMappedFileStreamImpl<T>::~MsfMappedFileStreamImpl() {
+}
+
+template <MsfFileType T>
+bool MsfMappedFileStreamImpl<T>::ReadBytesAt(size_t pos,
+                                             size_t count,
+                                             void* dest) {
+  DCHECK(dest != NULL);
+
+  // Don't read beyond the end of the known stream length.
+  if (pos > length() || count > length() - pos)
+    return false;
+
+  // Copy the stream out of the mapping, one page-sized chunk at a time.
+  uint8_t* out = reinterpret_cast<uint8_t*>(dest);
+  while (count > 0) {
+    size_t page_index = pos / page_size_;
+    size_t offset = pos % page_size_;
+    size_t chunk_size = std::min(count, page_size_ - offset);
+    const uint8_t* data = GetPageData(pages_[page_index], offset, chunk_size);
+    if (data == NULL) {
+      LOG(ERROR) << "Page read beyond end of mapped file.";
+      return false;
+    }
+    ::memcpy(out, data, chunk_size);
+
+    count -= chunk_size;
+    pos += chunk_size;
+    out += chunk_size;
+  }
+
+  return true;
+}
+
+template <MsfFileType T>
+const uint8_t* MsfMappedFileStreamImpl<T>::GetPageView(size_t pos,
+                                                       size_t count) const {
+  if (pos > length() || count > length() - pos)
+    return NULL;
+
+  size_t offset = pos % page_size_;
+  if (count > page_size_ - offset)
+    return NULL;
+
+  // An empty range at the very end of the stream has no page to point into.
+  size_t page_index = pos / page_size_;
+  if (page_index >= pages_.size())
+    return NULL;
+
+  return GetPageData(pages_[page_index], offset, count);
+}
+
+template <MsfFileType T>
+const uint8_t* MsfMappedFileStreamImpl<T>::GetPageData(uint32_t page_num,
+                                                       size_t offset,
+                                                       size_t count) const {
+  DCHECK_LE(offset + count, page_size_);
+
+  size_t file_offset = page_size_ * page_num + offset;
+  if (file_offset > file_->length() || count > file_->length() - file_offset)
+    return NULL;
+
+  return file_->data() + file_offset;
+}
+
+}  // namespace detail
+}  // namespace msf
+
+#endif  // SYZYGY_MSF_MSF_MAPPED_FILE_STREAM_IMPL_H_
@@ -0,0 +1,134 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Internal implementation details for msf_mapped_reader.h. Not meant to be
+// included directly.
+
+#ifndef SYZYGY_MSF_MSF_MAPPED_READER_IMPL_H_
+#define SYZYGY_MSF_MSF_MAPPED_READER_IMPL_H_
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/msf/msf_data.h"
+#include "syzygy/msf/msf_mapped_file_stream.h"
+
+namespace msf {
+namespace detail {
+
+template <MsfFileType T>
+bool MsfMappedReaderImpl<T>::Read(const base::FilePath& msf_path,
+                                  MsfFileImpl<T>* msf_file) {
+  DCHECK(msf_file != NULL);
+
+  msf_file->Clear();
+
+  scoped_refptr<RefCountedMappedFile> file(new RefCountedMappedFile());
+  if (!file->Initialize(msf_path)) {
+    LOG(ERROR) << "Unable to map '" << msf_path.value() << "'.";
+    return false;
+  }
+
+  MsfHeader header = {0};
+  if (file->length() < sizeof(header)) {
+    LOG(ERROR) << "MSF file '" << msf_path.value() << "' is too small.";
+    return false;
+  }
+  ::memcpy(&header, file->data(), sizeof(header));
+
+  // Sanity checks.
+  if (header.page_size == 0 ||
+      static_cast<uint64_t>(header.num_pages) * header.page_size !=
+          file->length()) {
+    LOG(ERROR) << "Invalid MSF file size.";
+    return false;
+  }
+
+  if (memcmp(header.magic_string, kMsfHeaderMagicString,
+             sizeof(kMsfHeaderMagicString)) != 0) {
+    LOG(ERROR) << "Invalid MSF magic string.";
+    return false;
+  }
+
+  // Load the directory page list. See MsfReaderImpl::Read for details of the
+  // layout.
+  size_t num_dir_pages =
+      (header.directory_size + header.page_size - 1) / header.page_size;
+  if (num_dir_pages * sizeof(uint32_t) > header.page_size * kMsfMaxDirPages) {
+    LOG(ERROR) << "MSF directory is too large.";
+    return false;
+  }
+  scoped_refptr<MsfMappedFileStreamImpl<T>> dir_page_stream(
+      new MsfMappedFileStreamImpl<T>(file.get(),
+                                     num_dir_pages * sizeof(uint32_t),
+                                     header.root_pages, header.page_size));
+  std::vector<uint32_t> dir_pages(num_dir_pages);
+  if (num_dir_pages > 0 &&
+      !dir_page_stream->ReadBytesAt(0, num_dir_pages * sizeof(uint32_t),
+                                    &dir_pages[0])) {
+    LOG(ERROR) << "Failed to read directory page stream.";
+    return false;
+  }
+
+  // Load the actual directory.
+  size_t dir_size =
+      static_cast<size_t>(header.directory_size / sizeof(uint32_t));
+  if (dir_size == 0) {
+    LOG(ERROR) << "Empty MSF directory.";
+    return false;
+  }
+  scoped_refptr<MsfMappedFileStreamImpl<T>> dir_stream(
+      new MsfMappedFileStreamImpl<T>(file.get(), header.directory_size,
+                                     &dir_pages[0], header.page_size));
+  std::vector<uint32_t> directory(dir_size);
+  if (!dir_stream->ReadBytesAt(0, dir_size * sizeof(uint32_t), &directory[0])) {
+    LOG(ERROR) << "Failed to read directory stream.";
+    return false;
+  }
+
+  // Iterate through the streams and construct MsfStreams.
+  const uint32_t& num_streams = directory[0];
+  if (num_streams >= dir_size) {
+    LOG(ERROR) << "Invalid MSF stream count.";
+    return false;
+  }
+  const uint32_t* stream_lengths = &(directory[1]);
+  size_t page_index = 1 + num_streams;
+
+  for (uint32_t stream_index = 0; stream_index < num_streams; ++stream_index) {
+    uint32_t stream_length = stream_lengths[stream_index];
+    if (stream_length == kInvalidLength)
+      stream_length = 0;
+    size_t stream_pages =
+        (stream_length + header.page_size - 1) / header.page_size;
+    if (page_index + stream_pages > dir_size) {
+      LOG(ERROR) << "MSF directory is truncated.";
+      return false;
+    }
+    msf_file->AppendStream(new MsfMappedFileStreamImpl<T>(
+        file.get(), stream_length, &directory[0] + page_index,
+        header.page_size));
+    page_index += stream_pages;
+  }
+
+  return true;
+}
+
+}  // namespace detail
+}  // namespace msf
+
+#endif  // SYZYGY_MSF_MSF_MAPPED_READER_IMPL_H_
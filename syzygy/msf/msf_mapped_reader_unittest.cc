@@ -0,0 +1,218 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/msf/msf_mapped_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "base/files/file_util.h"
+#include "base/time/time.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/msf/msf_reader.h"
+#include "syzygy/msf/unittest_util.h"
+
+namespace msf {
+
+namespace {
+
+const wchar_t kOmappedTestPdbFilePath[] =
+    L"syzygy\\pdb\\test_data\\omapped_test_dll.pdb";
+
+// Reads every stream of @p msf_file in full, returning the total number of
+// bytes read.
+size_t ReadAllStreams(const MsfFile& msf_file) {
+  size_t total = 0;
+  std::vector<uint8_t> buffer;
+  for (size_t i = 0; i < msf_file.StreamCount(); ++i) {
+    scoped_refptr<MsfStream> stream = msf_file.GetStream(i);
+    if (stream.get() == NULL || stream->length() == 0)
+      continue;
+    buffer.resize(stream->length());
+    CHECK(stream->ReadBytesAt(0, buffer.size(), &buffer[0]));
+    total += buffer.size();
+  }
+  return total;
+}
+
+// Reads every stream of @p msf_file in small pieces, as the PDB parsers do when
+// walking records. Returns the total number of bytes read.
+size_t ReadAllStreamsInChunks(const MsfFile& msf_file, size_t chunk_size) {
+  size_t total = 0;
+  std::vector<uint8_t> buffer(chunk_size);
+  for (size_t i = 0; i < msf_file.StreamCount(); ++i) {
+    scoped_refptr<MsfStream> stream = msf_file.GetStream(i);
+    if (stream.get() == NULL)
+      continue;
+    for (size_t pos = 0; pos < stream->length(); pos += chunk_size) {
+      size_t count = std::min(chunk_size, stream->length() - pos);
+      CHECK(stream->ReadBytesAt(pos, count, &buffer[0]));
+      total += count;
+    }
+  }
+  return total;
+}
+
+template <typename ReaderType>
+void BenchmarkReader(const char* name, const base::FilePath& path) {
+  const int kIterations = 20;
+  const size_t kChunkSize = 16;
+
+  base::Time start = base::Time::NowFromSystemTime();
+  size_t bytes = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    ReaderType reader;
+    MsfFile msf_file;
+    ASSERT_TRUE(reader.Read(path, &msf_file));
+    bytes += ReadAllStreams(msf_file);
+    bytes += ReadAllStreamsInChunks(msf_file, kChunkSize);
+  }
+  base::TimeDelta duration = base::Time::NowFromSystemTime() - start;
+
+  LOG(INFO) << name << " read " << bytes << " bytes of '"
+            << path.BaseName().value() << "' in " << duration.InMillisecondsF()
+            << " ms.";
+}
+
+}  // namespace
+
+TEST(MsfMappedReaderTest, Read) {
+  base::FilePath test_dll_msf =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  MsfMappedReader reader;
+  MsfFile msf_file;
+  EXPECT_TRUE(reader.Read(test_dll_msf, &msf_file));
+  EXPECT_EQ(msf_file.StreamCount(), 168u);
+}
+
+TEST(MsfMappedReaderTest, ReadNonexistentFileFails) {
+  base::FilePath path = testing::GetSrcRelativePath(L"nonexistent.pdb");
+
+  MsfMappedReader reader;
+  MsfFile msf_file;
+  EXPECT_FALSE(reader.Read(path, &msf_file));
+}
+
+TEST(MsfMappedReaderTest, ContentsMatchFileReader) {
+  base::FilePath test_dll_msf =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  MsfReader file_reader;
+  MsfFile msf_file;
+  ASSERT_TRUE(file_reader.Read(test_dll_msf, &msf_file));
+
+  MsfMappedReader mapped_reader;
+  MsfFile mapped_msf_file;
+  ASSERT_TRUE(mapped_reader.Read(test_dll_msf, &mapped_msf_file));
+
+  testing::EnsureMsfContentsAreIdentical(msf_file, mapped_msf_file);
+}
+
+TEST(MsfMappedReaderTest, StreamsOutliveReader) {
+  base::FilePath test_dll_msf =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  MsfFile msf_file;
+  {
+    MsfMappedReader reader;
+    ASSERT_TRUE(reader.Read(test_dll_msf, &msf_file));
+  }
+
+  scoped_refptr<MsfStream> stream = msf_file.GetStream(1);
+  ASSERT_TRUE(stream.get() != NULL);
+  ASSERT_LT(0u, stream->length());
+  std::vector<uint8_t> data(stream->length());
+  EXPECT_TRUE(stream->ReadBytesAt(0, data.size(), &data[0]));
+}
+
+TEST(MsfMappedReaderTest, ReadBeyondEndFails) {
+  base::FilePath test_dll_msf =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  MsfMappedReader reader;
+  MsfFile msf_file;
+  ASSERT_TRUE(reader.Read(test_dll_msf, &msf_file));
+
+  scoped_refptr<MsfStream> stream = msf_file.GetStream(1);
+  ASSERT_TRUE(stream.get() != NULL);
+  uint8_t byte = 0;
+  EXPECT_TRUE(stream->ReadBytesAt(stream->length() - 1, 1, &byte));
+  EXPECT_FALSE(stream->ReadBytesAt(stream->length(), 1, &byte));
+  EXPECT_FALSE(stream->ReadBytesAt(stream->length() + 1, 0, &byte));
+}
+
+TEST(MsfMappedReaderTest, GetPageView) {
+  base::FilePath test_dll_msf =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+
+  MsfMappedReader reader;
+  MsfFile msf_file;
+  ASSERT_TRUE(reader.Read(test_dll_msf, &msf_file));
+
+  // Find a stream that spans at least three pages. The page size is that of
+  // the file, which needn't be kMsfPageSize.
+  MsfMappedFileStream* stream = NULL;
+  for (size_t i = 0; i < msf_file.StreamCount(); ++i) {
+    scoped_refptr<MsfStream> s = msf_file.GetStream(i);
+    if (s.get() == NULL)
+      continue;
+    MsfMappedFileStream* mapped = static_cast<MsfMappedFileStream*>(s.get());
+    if (s->length() > 2 * mapped->page_size()) {
+      stream = mapped;
+      break;
+    }
+  }
+  ASSERT_TRUE(stream != NULL);
+  const size_t page_size = stream->page_size();
+  ASSERT_LT(0u, page_size);
+
+  // A view within a single page matches the copied data.
+  uint8_t expected[16] = {};
+  ASSERT_TRUE(stream->ReadBytesAt(8, sizeof(expected), expected));
+  const uint8_t* view = stream->GetPageView(8, sizeof(expected));
+  ASSERT_TRUE(view != NULL);
+  EXPECT_EQ(0, ::memcmp(expected, view, sizeof(expected)));
+
+  // Views may cover whole pages, and end or start at a page boundary.
+  EXPECT_TRUE(stream->GetPageView(0, page_size) != NULL);
+  EXPECT_TRUE(stream->GetPageView(page_size - 4, 4) != NULL);
+  std::vector<uint8_t> second_page(page_size);
+  ASSERT_TRUE(stream->ReadBytesAt(page_size, page_size, &second_page[0]));
+  view = stream->GetPageView(page_size, page_size);
+  ASSERT_TRUE(view != NULL);
+  EXPECT_EQ(0, ::memcmp(&second_page[0], view, page_size));
+
+  // Views can't straddle pages or run off the end of the stream.
+  EXPECT_TRUE(stream->GetPageView(0, page_size + 1) == NULL);
+  EXPECT_TRUE(stream->GetPageView(page_size - 4, 8) == NULL);
+  EXPECT_TRUE(stream->GetPageView(2 * page_size - 1, 2) == NULL);
+  EXPECT_TRUE(stream->GetPageView(stream->length(), 1) == NULL);
+}
+
+// Compares the FILE-based reader against the memory mapped one. This is
+// disabled by default; run with --gtest_also_run_disabled_tests.
+TEST(MsfMappedReaderTest, DISABLED_BenchmarkReaders) {
+  const wchar_t* kPaths[] = {testing::kTestPdbFilePath,
+                             kOmappedTestPdbFilePath};
+  for (size_t i = 0; i < arraysize(kPaths); ++i) {
+    base::FilePath path = testing::GetSrcRelativePath(kPaths[i]);
+    BenchmarkReader<MsfReader>("MsfReader", path);
+    BenchmarkReader<MsfMappedReader>("MsfMappedReader", path);
+  }
+}
+
+}  // namespace msf
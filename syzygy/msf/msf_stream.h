@@ -23,7 +23,9 @@
 namespace msf {
 namespace detail {
 
-// Forward declaration.
+// Forward declarations.
+template <MsfFileType T>
+class MsfFileStreamImpl;
 template <MsfFileType T>
 class WritableMsfStreamImpl;
 
@@ -68,6 +70,13 @@ class MsfStreamImpl : public base::RefCounted<MsfStreamImpl<T>> {
     return scoped_refptr<WritableMsfStreamImpl<T>>();
   }
 
+  // Returns a pointer to a MsfFileStreamImpl if this stream is read directly
+  // from the pages of an MSF file on disk. This allows the pages of such a
+  // stream to be carried over when rewriting that file, rather than reading
+  // and writing them back.
+  // @returns a pointer to a MsfFileStreamImpl, or NULL.
+  virtual MsfFileStreamImpl<T>* AsMsfFileStream() { return NULL; }
+
   // Gets the stream's length.
   // @returns the total number of bytes in the stream.
   size_t length() const { return length_; }
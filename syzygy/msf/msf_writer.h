@@ -42,6 +42,26 @@ class MsfWriterImpl {
   // @returns true on success, false otherwise.
   bool Write(const base::FilePath& msf_path, const MsfFileImpl<T>& msf_file);
 
+  // Writes the given MsfFileImpl to disk, reusing the pages of the MSF file it
+  // was read from. The whole source file is first copied by the OS, after
+  // which only the streams that are no longer backed by its pages are
+  // appended to the copy. The streams left untouched keep their pages, and
+  // the pages of the streams that were replaced are marked as free. This
+  // saves serializing the untouched streams, but the copy still reads and
+  // writes every byte of the source file.
+  // @param source_msf_path the path of the MSF file the on-disk streams of
+  //     @p msf_file were read from. This must differ from @p msf_path.
+  // @param msf_path the path of the MSF file to write.
+  // @param msf_file the MSF file to be written.
+  // @returns true on success, false otherwise.
+  // @note Falls back to Write if no stream of @p msf_file can be reused.
+  // @note Free pages are never reclaimed, so the output is larger than the
+  //     source by the size of the replaced streams. Writing incrementally
+  //     from a previous output thus grows the file on every run.
+  bool WriteIncremental(const base::FilePath& source_msf_path,
+                        const base::FilePath& msf_path,
+                        const MsfFileImpl<T>& msf_file);
+
  protected:
   // Append the contents of the stream onto the file handle at the offset. The
   // contents of the file are padded to reach the next page boundary in the
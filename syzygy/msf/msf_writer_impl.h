@@ -17,11 +17,13 @@
 
 #include <cstdio>
 #include <cstring>
+#include <limits>
 #include <vector>
 
 #include "base/logging.h"
 #include "syzygy/msf/msf_constants.h"
 #include "syzygy/msf/msf_data.h"
+#include "syzygy/msf/msf_file_stream.h"
 
 namespace msf {
 namespace detail {
@@ -318,6 +320,190 @@ bool MsfWriterImpl<T>::Write(const base::FilePath& msf_path,
   return true;
 }
 
+template <MsfFileType T>
+bool MsfWriterImpl<T>::WriteIncremental(const base::FilePath& source_msf_path,
+                                        const base::FilePath& msf_path,
+                                        const MsfFileImpl<T>& msf_file) {
+  if (source_msf_path == msf_path) {
+    LOG(ERROR) << "Can't incrementally write '" << msf_path.value()
+               << "' over itself.";
+    return false;
+  }
+
+  // Find the streams whose pages can be carried over. These are the streams
+  // that are still read from the pages of the source file, which is taken to
+  // be the file housing the first such stream. Streams housed by any other
+  // file are written out like modified streams.
+  RefCountedFILE* source_file = NULL;
+  std::vector<const std::vector<uint32_t>*> source_pages(msf_file.StreamCount(),
+                                                         NULL);
+  size_t reused_stream_count = 0;
+  for (size_t i = 0; i < msf_file.StreamCount(); ++i) {
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream == NULL || stream->length() == 0)
+      continue;
+
+    MsfFileStreamImpl<T>* file_stream = stream->AsMsfFileStream();
+    if (file_stream == NULL || file_stream->page_size() != kMsfPageSize)
+      continue;
+    if (source_file == NULL)
+      source_file = file_stream->file();
+    if (file_stream->file() != source_file)
+      continue;
+
+    source_pages[i] = &file_stream->pages();
+    ++reused_stream_count;
+  }
+
+  if (reused_stream_count == 0) {
+    VLOG(1) << "No stream to reuse, writing '" << msf_path.value()
+            << "' from scratch.";
+    return Write(msf_path, msf_file);
+  }
+
+  // Copy the whole source file in bulk, leaving it to the OS. On NTFS this
+  // reads and writes every byte of the file.
+  if (!base::CopyFile(source_msf_path, msf_path)) {
+    LOG(ERROR) << "Failed to copy '" << source_msf_path.value() << "' to '"
+               << msf_path.value() << "'.";
+    return false;
+  }
+
+  int64_t file_size = 0;
+  if (!base::GetFileSize(msf_path, &file_size) ||
+      file_size % kMsfPageSize != 0 ||
+      file_size / kMsfPageSize > std::numeric_limits<uint32_t>::max()) {
+    LOG(ERROR) << "Invalid MSF file size for '" << source_msf_path.value()
+               << "'.";
+    return false;
+  }
+  uint32_t source_page_count = static_cast<uint32_t>(file_size / kMsfPageSize);
+  if (source_page_count < 4) {
+    LOG(ERROR) << "MSF file '" << source_msf_path.value() << "' is too short.";
+    return false;
+  }
+
+  file_.reset(base::OpenFile(msf_path, "r+b"));
+  if (!file_.get()) {
+    LOG(ERROR) << "Failed to open '" << msf_path.value() << "'.";
+    return false;
+  }
+  if (::fseek(file_.get(), 0, SEEK_END) != 0) {
+    LOG(ERROR) << "Failed to seek to the end of '" << msf_path.value() << "'.";
+    return false;
+  }
+
+  // The modified streams are appended after the pages of the source file. If
+  // that ends in the middle of a pair of free page map pages then complete the
+  // pair, as AppendPage only reserves whole pairs.
+  uint32_t page_count = source_page_count;
+  if ((page_count % kMsfPageSize) == 2) {
+    if (::fwrite(kZeroBuffer, 1, kMsfPageSize, file_.get()) != kMsfPageSize) {
+      LOG(ERROR) << "Failed to allocate free page map page.";
+      return false;
+    }
+    ++page_count;
+  }
+
+  // Initialize the directory with stream count and lengths.
+  std::vector<uint32_t> directory;
+  directory.push_back(msf_file.StreamCount());
+  for (size_t i = 0; i < msf_file.StreamCount(); ++i) {
+    // Null streams have an implicit zero length.
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream == NULL)
+      directory.push_back(0);
+    else
+      directory.push_back(stream->length());
+  }
+
+  // Build the directory, reusing the pages of the unmodified streams and
+  // appending the others. We keep track of which pages host stream 0 for the
+  // free page map, like Write.
+  size_t stream0_start = directory.size();
+  size_t stream0_end = stream0_start;
+  for (size_t i = 0; i < msf_file.StreamCount(); ++i) {
+    MsfStreamImpl<T>* stream = msf_file.GetStream(i).get();
+    if (stream != NULL && stream->length() != 0) {
+      if (source_pages[i] != NULL) {
+        const std::vector<uint32_t>& pages = *source_pages[i];
+        for (uint32_t page : pages) {
+          if (page >= source_page_count) {
+            LOG(ERROR) << "Stream " << i << " lies beyond the end of '"
+                       << source_msf_path.value() << "'.";
+            return false;
+          }
+        }
+        directory.insert(directory.end(), pages.begin(), pages.end());
+      } else if (!AppendStream(stream, &directory, &page_count)) {
+        LOG(ERROR) << "Failed to write stream " << i << ".";
+        return false;
+      }
+    }
+
+    if (i == 0)
+      stream0_end = directory.size();
+  }
+
+  // Write the directory and the root directory.
+  std::vector<uint32_t> directory_pages;
+  scoped_refptr<MsfStreamImpl<T>> directory_stream(new ReadOnlyMsfStream<T>(
+      directory.data(), sizeof(directory[0]) * directory.size()));
+  if (!AppendStream(directory_stream.get(), &directory_pages, &page_count)) {
+    LOG(ERROR) << "Failed to write directory.";
+    return false;
+  }
+
+  std::vector<uint32_t> root_directory_pages;
+  scoped_refptr<MsfStreamImpl<T>> root_directory_stream(
+      new ReadOnlyMsfStream<T>(
+          directory_pages.data(),
+          sizeof(directory_pages[0]) * directory_pages.size()));
+  if (!AppendStream(root_directory_stream.get(), &root_directory_pages,
+                    &page_count)) {
+    LOG(ERROR) << "Failed to write root directory.";
+    return false;
+  }
+
+  if (!WriteHeader(root_directory_pages,
+                   sizeof(directory[0]) * directory.size(), page_count)) {
+    LOG(ERROR) << "Failed to write MSF header.";
+    return false;
+  }
+
+  // Unlike with Write, the file now contains pages that belong to no stream:
+  // those of the streams that were replaced and of the old directory. Only
+  // mark as used the header, the free page map and the pages referred to by
+  // the new directory, with the exception of stream 0.
+  FreePageBitMap free_page;
+  free_page.SetPageCount(page_count);
+  for (uint32_t i = 0; i < page_count; ++i)
+    free_page.SetFree(i);
+  free_page.SetUsed(0);
+  for (uint32_t i = 1; i < page_count; i += kMsfPageSize) {
+    free_page.SetUsed(i);
+    if (i + 1 < page_count)
+      free_page.SetUsed(i + 1);
+  }
+  for (size_t i = stream0_end; i < directory.size(); ++i)
+    free_page.SetUsed(directory[i]);
+  for (uint32_t page : directory_pages)
+    free_page.SetUsed(page);
+  for (uint32_t page : root_directory_pages)
+    free_page.SetUsed(page);
+  free_page.Finalize();
+
+  if (!WriteFreePageBitMap(free_page, file_.get())) {
+    LOG(ERROR) << "Failed to write free page bitmap.";
+    return false;
+  }
+
+  // On success we want the file to be closed right away.
+  file_.reset();
+
+  return true;
+}
+
 template <MsfFileType T>
 bool MsfWriterImpl<T>::AppendStream(MsfStreamImpl<T>* stream,
                                     std::vector<uint32_t>* pages_written,
@@ -22,6 +22,7 @@
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/msf/msf_constants.h"
 #include "syzygy/msf/msf_data.h"
+#include "syzygy/msf/msf_file_stream.h"
 #include "syzygy/msf/msf_reader.h"
 #include "syzygy/msf/unittest_util.h"
 
@@ -111,6 +112,28 @@ void EnsureMsfContentsAreIdentical(const MsfFile& msf_file,
   }
 }
 
+// @returns true if @p page is marked as free in the free page map of the MSF
+//     file at @p path.
+bool IsPageFree(const base::FilePath& path, uint32_t page) {
+  // The bits of the free page map are spread over its pages, which are found
+  // every kMsfPageSize pages.
+  uint32_t byte = page / 8;
+  uint32_t fpm_page = 1 + (byte / kMsfPageSize) * kMsfPageSize;
+  base::ScopedFILE file(base::OpenFile(path, "rb"));
+  uint32_t offset = fpm_page * kMsfPageSize + byte % kMsfPageSize;
+  uint8_t data = 0;
+  EXPECT_EQ(0, ::fseek(file.get(), offset, SEEK_SET));
+  EXPECT_EQ(1u, ::fread(&data, 1, 1, file.get()));
+  return (data & (1 << (page % 8))) != 0;
+}
+
+// @returns the pages of a stream read from an MSF file.
+const std::vector<uint32_t>& GetPages(const MsfFile& msf_file, size_t index) {
+  MsfFileStream* file_stream = msf_file.GetStream(index)->AsMsfFileStream();
+  CHECK(file_stream != NULL);
+  return file_stream->pages();
+}
+
 }  // namespace
 
 using msf::kMsfHeaderMagicString;
@@ -216,4 +239,79 @@ TEST(MsfWriterTest, WriteMsfFile) {
       testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_read));
 }
 
+TEST(MsfWriterTest, WriteIncremental) {
+  MsfFile msf_file;
+  for (uint32_t i = 0; i < 4; ++i)
+    msf_file.AppendStream(new TestMsfStream(1 << (12 + i), (i << 24)));
+
+  testing::ScopedTempFile source_file;
+  {
+    TestMsfWriter writer;
+    ASSERT_TRUE(writer.Write(source_file.path(), msf_file));
+  }
+
+  MsfFile source_msf_file;
+  MsfReader reader;
+  ASSERT_TRUE(reader.Read(source_file.path(), &source_msf_file));
+
+  // Replace a stream and add another, leaving the others backed by the source
+  // file.
+  MsfFile msf_file_modified;
+  for (uint32_t i = 0; i < 4; ++i)
+    msf_file_modified.AppendStream(source_msf_file.GetStream(i).get());
+  msf_file_modified.ReplaceStream(2, new TestMsfStream(3 * kMsfPageSize, 0x55));
+  msf_file_modified.AppendStream(new TestMsfStream(kMsfPageSize / 2, 0x66));
+
+  // Writing over the source file isn't supported.
+  testing::ScopedTempFile file;
+  {
+    TestMsfWriter writer;
+    EXPECT_FALSE(writer.WriteIncremental(source_file.path(), source_file.path(),
+                                         msf_file_modified));
+    EXPECT_TRUE(writer.WriteIncremental(source_file.path(), file.path(),
+                                        msf_file_modified));
+  }
+
+  MsfFile msf_file_read;
+  ASSERT_TRUE(reader.Read(file.path(), &msf_file_read));
+  ASSERT_NO_FATAL_FAILURE(
+      testing::EnsureMsfContentsAreIdentical(msf_file_modified, msf_file_read));
+
+  // The pages of the unmodified streams should have been reused, while the
+  // pages of the replaced stream should be free. Stream 0 is always free.
+  for (uint32_t i : {1, 3}) {
+    EXPECT_EQ(GetPages(source_msf_file, i), GetPages(msf_file_read, i));
+    for (uint32_t page : GetPages(msf_file_read, i))
+      EXPECT_FALSE(IsPageFree(file.path(), page));
+  }
+  for (uint32_t page : GetPages(source_msf_file, 0))
+    EXPECT_TRUE(IsPageFree(file.path(), page));
+  for (uint32_t page : GetPages(source_msf_file, 2))
+    EXPECT_TRUE(IsPageFree(file.path(), page));
+  for (uint32_t i : {2, 4}) {
+    for (uint32_t page : GetPages(msf_file_read, i))
+      EXPECT_FALSE(IsPageFree(file.path(), page));
+  }
+}
+
+TEST(MsfWriterTest, WriteIncrementalWithoutReusableStreams) {
+  MsfFile msf_file;
+  for (uint32_t i = 0; i < 4; ++i)
+    msf_file.AppendStream(new TestMsfStream(1 << (8 + i), (i << 24)));
+
+  // None of the streams come from the source file, so it's not even read.
+  testing::ScopedTempFile file;
+  {
+    TestMsfWriter writer;
+    EXPECT_TRUE(writer.WriteIncremental(base::FilePath(L"nonexistent.msf"),
+                                        file.path(), msf_file));
+  }
+
+  MsfFile msf_file_read;
+  MsfReader reader;
+  ASSERT_TRUE(reader.Read(file.path(), &msf_file_read));
+  ASSERT_NO_FATAL_FAILURE(
+      testing::EnsureMsfContentsAreIdentical(msf_file, msf_file_read));
+}
+
 }  // namespace msf
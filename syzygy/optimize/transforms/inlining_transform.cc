@@ -406,7 +406,8 @@ bool InlineTrivialBody(MatchKind kind,
                        Instructions* instructions) {
   DCHECK_NE(reinterpret_cast<Instructions*>(NULL), instructions);
 
-  Instructions new_body;
+  // The new body is spliced into the caller, so it must share its allocator.
+  Instructions new_body(instructions->get_allocator());
 
   // Iterates through each instruction.
   Instructions::const_iterator inst_iter = body->instructions().begin();
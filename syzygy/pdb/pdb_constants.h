@@ -79,7 +79,12 @@ extern const char kSyzygyBlockGraphStreamName[];
 
 // The version of the Syzygy BlockGraph data stream. This needs to be
 // incremented whenever the format of the stream has changed.
-const uint32_t kSyzygyBlockGraphStreamVersion = 1;
+const uint32_t kSyzygyBlockGraphStreamVersion = 2;
+
+// The previous version of the Syzygy BlockGraph data stream, in which the
+// serialized data is optionally compressed as a single zlib stream. This can
+// still be read.
+const uint32_t kSyzygyBlockGraphStreamVersion1 = 1;
 
 }  // namespace pdb
 
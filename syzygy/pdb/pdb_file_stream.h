@@ -17,10 +17,13 @@
 
 #include "syzygy/msf/msf_decl.h"
 #include "syzygy/msf/msf_file_stream.h"
+#include "syzygy/msf/msf_mapped_file_stream.h"
 
 namespace pdb {
 
 using PdbFileStream = msf::detail::MsfFileStreamImpl<msf::kPdbMsfFileType>;
+using PdbMappedFileStream =
+    msf::detail::MsfMappedFileStreamImpl<msf::kPdbMsfFileType>;
 
 }  // namespace pdb
 
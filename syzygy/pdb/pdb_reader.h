@@ -16,12 +16,17 @@
 #define SYZYGY_PDB_PDB_READER_H_
 
 #include "syzygy/msf/msf_decl.h"
+#include "syzygy/msf/msf_mapped_reader.h"
 #include "syzygy/msf/msf_reader.h"
 
 namespace pdb {
 
 using PdbReader = msf::detail::MsfReaderImpl<msf::kPdbMsfFileType>;
 
+// A PDB reader that serves all stream reads out of a read-only memory mapping
+// of the PDB file. The streams it produces may be read from several threads.
+using PdbMappedReader = msf::detail::MsfMappedReaderImpl<msf::kPdbMsfFileType>;
+
 }  // namespace pdb
 
 #endif  // SYZYGY_PDB_PDB_READER_H_
@@ -14,21 +14,42 @@
 
 #include "syzygy/pdb/pdb_type_info_stream_enum.h"
 
+#include <algorithm>
+
 #include "base/strings/stringprintf.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_util.h"
 
 namespace pdb {
 
+namespace {
+
+// The number of bytes read at once when scanning for records.
+const size_t kScanBufferSize = 64 * 1024;
+
+// The smallest type record, made up of its length and its type.
+const size_t kMinRecordSize = 2 * sizeof(uint16_t);
+
+// An entry of the type index offsets of the type info hash stream. The offset
+// is relative to the beginning of the type records.
+struct TypeIndexOffset {
+  uint32_t type_id;
+  uint32_t offset;
+};
+
+}  // namespace
+
+const uint32_t TypeInfoEnumerator::kUnlocatedRecord;
+
 TypeInfoEnumerator::TypeInfoEnumerator(PdbStream* stream)
     : stream_(stream),
       reader_(stream),
+      scan_buffer_start_(0),
       data_end_(0),
       current_record_{},
       type_id_(0),
       type_id_max_(0),
-      type_id_min_(0),
-      largest_located_id_(0) {
+      type_id_min_(0) {
   memset(&type_info_header_, 0, sizeof(type_info_header_));
 }
 
@@ -69,10 +90,127 @@ bool TypeInfoEnumerator::Init() {
   type_id_min_ = type_info_header_.type_min;
   type_id_max_ = type_info_header_.type_max;
 
-  largest_located_id_ = type_id_min_ - 1;
-  // Locate the first type info record - note that this may fail if the
-  // stream is invalid or empty.
-  return EnsureTypeLocated(type_id_min_);
+  // Each record takes up at least its length and type, which bounds the size
+  // of the record index.
+  if (type_id_max_ <= type_id_min_ ||
+      type_id_max_ - type_id_min_ >
+          type_info_header_.type_info_data_size / kMinRecordSize) {
+    LOG(ERROR) << "Invalid type ID range in the type info stream.";
+    return false;
+  }
+
+  record_offsets_.assign(type_id_max_ - type_id_min_, kUnlocatedRecord);
+  record_offsets_[0] = type_info_header_.len;
+
+  // Check the first type info record - note that this may fail if the
+  // stream is invalid.
+  TypeRecordInfo info = {};
+  return ReadRecordInfo(type_id_min_, &info);
+}
+
+bool TypeInfoEnumerator::LoadTypeIndexOffsets(PdbStream* hash_stream) {
+  DCHECK(hash_stream != nullptr);
+  DCHECK(!record_offsets_.empty());
+
+  const OffsetCb& location =
+      type_info_header_.type_info_hash.offset_cb_type_info_offset;
+  if (location.cb % sizeof(TypeIndexOffset) != 0 ||
+      location.offset > hash_stream->length() ||
+      location.cb > hash_stream->length() - location.offset) {
+    LOG(ERROR) << "Invalid type index offsets location in the type info "
+               << "hash stream.";
+    return false;
+  }
+
+  std::vector<TypeIndexOffset> entries(location.cb / sizeof(TypeIndexOffset));
+  if (!entries.empty() &&
+      !hash_stream->ReadBytesAt(location.offset, location.cb,
+                                entries.data())) {
+    LOG(ERROR) << "Unable to read the type index offsets.";
+    return false;
+  }
+
+  // Validate all the entries before using any of them. Each record takes up at
+  // least kMinRecordSize bytes, so consecutive entries must be at least that
+  // far apart for each record in between.
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const TypeIndexOffset& entry = entries[i];
+    size_t position = type_info_header_.len + entry.offset;
+    if (entry.type_id < type_id_min_ || entry.type_id >= type_id_max_ ||
+        entry.offset > type_info_header_.type_info_data_size - kMinRecordSize) {
+      LOG(ERROR) << "Type index offset out of bounds.";
+      return false;
+    }
+    if (i > 0 && (entry.type_id <= entries[i - 1].type_id ||
+                  entry.offset <= entries[i - 1].offset ||
+                  entry.offset - entries[i - 1].offset <
+                      (entry.type_id - entries[i - 1].type_id) *
+                          kMinRecordSize)) {
+      LOG(ERROR) << "Type index offsets are not in order.";
+      return false;
+    }
+    uint32_t located = record_offsets_[entry.type_id - type_id_min_];
+    if (located != kUnlocatedRecord && located != position) {
+      LOG(ERROR) << "Type index offset inconsistent with the type records.";
+      return false;
+    }
+  }
+
+  for (const TypeIndexOffset& entry : entries) {
+    record_offsets_[entry.type_id - type_id_min_] =
+        type_info_header_.len + entry.offset;
+  }
+
+  return true;
+}
+
+bool TypeInfoEnumerator::BuildRecordIndex() {
+  DCHECK(!record_offsets_.empty());
+
+  if (std::find(record_offsets_.begin(), record_offsets_.end(),
+                kUnlocatedRecord) != record_offsets_.end()) {
+    if (!ScanRecords(0, record_offsets_.size() - 1))
+      return false;
+  }
+
+  // Make sure the last record is within the stream.
+  TypeRecordInfo info = {};
+  return ReadRecordInfo(type_id_max_ - 1, &info);
+}
+
+bool TypeInfoEnumerator::GetRecordIndex(std::vector<uint32_t>* offsets) {
+  DCHECK(offsets != nullptr);
+
+  if (!BuildRecordIndex())
+    return false;
+
+  *offsets = record_offsets_;
+  return true;
+}
+
+bool TypeInfoEnumerator::SetRecordIndex(const std::vector<uint32_t>& offsets) {
+  DCHECK(!record_offsets_.empty());
+
+  if (offsets.size() != record_offsets_.size() ||
+      offsets[0] != type_info_header_.len) {
+    LOG(ERROR) << "Record index doesn't match the type info stream.";
+    return false;
+  }
+  for (size_t i = 0; i < offsets.size(); ++i) {
+    if (offsets[i] > data_end_ - kMinRecordSize ||
+        (i > 0 && offsets[i] < offsets[i - 1] + kMinRecordSize)) {
+      LOG(ERROR) << "Invalid record index.";
+      return false;
+    }
+    if (record_offsets_[i] != kUnlocatedRecord &&
+        record_offsets_[i] != offsets[i]) {
+      LOG(ERROR) << "Record index inconsistent with the type records.";
+      return false;
+    }
+  }
+
+  record_offsets_ = offsets;
+  return true;
 }
 
 bool TypeInfoEnumerator::NextTypeInfoRecord() {
@@ -81,11 +219,8 @@ bool TypeInfoEnumerator::NextTypeInfoRecord() {
   if (!EnsureTypeLocated(type_id_ + 1))
     return false;
   TypeRecordInfo info = {};
-  bool found = FindRecordInfo(type_id_ + 1, &info);
-  if (!found) {
-    LOG(ERROR) << "Can't locate record " << type_id_ + 1;
+  if (!ReadRecordInfo(type_id_ + 1, &info))
     return false;
-  }
 
   ++type_id_;
   current_record_ = info;
@@ -119,67 +254,111 @@ bool TypeInfoEnumerator::EnsureTypeLocated(uint32_t type_id) {
 
   if (type_id >= type_id_max_ || type_id < type_id_min_)
     return false;
-  if (type_id <= largest_located_id_)
+  size_t index = type_id - type_id_min_;
+  if (record_offsets_[index] != kUnlocatedRecord)
     return true;
 
-#ifndef NDEBUG
-  if (type_id > type_id_min_) {
-    TypeRecordInfo info = {};
-    bool found = FindRecordInfo(largest_located_id_, &info);
-    DCHECK(found);
-    DCHECK_EQ(info.start + info.length + sizeof(info.length),
-              reader_.Position());
+  // Scan forward from the closest located record. The first record is always
+  // located.
+  size_t from_index = index;
+  while (record_offsets_[from_index] == kUnlocatedRecord) {
+    DCHECK_LT(0U, from_index);
+    --from_index;
   }
-#endif
 
-  uint32_t current_type_id = largest_located_id_;
-  common::BinaryStreamParser parser(&reader_);
-  while (current_type_id < type_id) {
-    TypeRecordInfo next_info = {};
-    next_info.start = reader_.Position();
-    if (!parser.Read(&next_info.length)) {
+  return ScanRecords(from_index, index);
+}
+
+bool TypeInfoEnumerator::ScanRecords(size_t from_index, size_t to_index) {
+  DCHECK_LT(from_index, to_index);
+  DCHECK_GT(record_offsets_.size(), to_index);
+  DCHECK_NE(kUnlocatedRecord, record_offsets_[from_index]);
+
+  size_t position = record_offsets_[from_index];
+  for (size_t index = from_index; index < to_index; ++index) {
+    uint16_t length = 0;
+    if (!ReadAt(position, sizeof(length), true, &length)) {
       LOG(ERROR) << "Unable to read a type info record length.";
       return false;
     }
-    if (!parser.Read(&next_info.type)) {
-      LOG(ERROR) << "Unable to read a type info record type.";
+    if (length < sizeof(uint16_t)) {
+      LOG(ERROR) << "Invalid type info record length.";
       return false;
     }
-    if (!reader_.Consume(next_info.length - sizeof(next_info.type))) {
-      LOG(ERROR) << "Unable to consume type body.";
+
+    position += sizeof(length) + length;
+    if (position > data_end_ - kMinRecordSize) {
+      LOG(ERROR) << "Type info record extends past the end of the stream.";
       return false;
     }
 
-    ++current_type_id;
-    bool added = AddRecordInfo(current_type_id, next_info);
-    DCHECK(added);
+    uint32_t& offset = record_offsets_[index + 1];
+    if (offset == kUnlocatedRecord) {
+      offset = static_cast<uint32_t>(position);
+    } else if (offset != position) {
+      LOG(ERROR) << "Type info record location inconsistent with the type "
+                 << "index offsets.";
+      return false;
+    }
   }
 
-  return type_id == current_type_id;
+  return true;
 }
 
-bool TypeInfoEnumerator::AddRecordInfo(uint32_t type_id,
-                                       const TypeRecordInfo& info) {
+bool TypeInfoEnumerator::ReadRecordInfo(uint32_t type_id,
+                                        TypeRecordInfo* info) {
+  DCHECK(info);
   if (type_id >= type_id_max_ || type_id < type_id_min_)
     return false;
 
-  DCHECK_EQ(largest_located_id_ + 1, type_id);
-  DCHECK_EQ(located_records_.size(), largest_located_id_ - type_id_min_ + 1);
+  uint32_t position = record_offsets_[type_id - type_id_min_];
+  DCHECK_NE(kUnlocatedRecord, position);
 
-  located_records_.push_back(info);
-  largest_located_id_ = type_id;
+  // The record starts with its length followed by its type.
+  uint16_t header[2] = {};
+  if (!ReadAt(position, sizeof(header), false, header)) {
+    LOG(ERROR) << "Unable to read the header of type info record " << type_id
+               << ".";
+    return false;
+  }
+  TypeRecordInfo record = {};
+  record.start = position;
+  record.length = header[0];
+  record.type = header[1];
+  if (record.length < sizeof(record.type) ||
+      position + sizeof(record.length) + record.length > data_end_) {
+    LOG(ERROR) << "Invalid type info record " << type_id << ".";
+    return false;
+  }
 
+  *info = record;
   return true;
 }
 
-bool TypeInfoEnumerator::FindRecordInfo(uint32_t type_id,
-                                        TypeRecordInfo* info) {
-  DCHECK(info);
-  if (type_id >= type_id_max_ || type_id < type_id_min_)
+bool TypeInfoEnumerator::ReadAt(size_t position,
+                                size_t count,
+                                bool fill_buffer,
+                                void* dest) {
+  DCHECK(dest != nullptr);
+
+  if (position > data_end_ || count > data_end_ - position)
     return false;
 
-  DCHECK_GT(located_records_.size(), type_id - type_id_min_);
-  *info = located_records_[type_id - type_id_min_];
+  if (position < scan_buffer_start_ ||
+      position + count > scan_buffer_start_ + scan_buffer_.size()) {
+    if (!fill_buffer)
+      return stream_->ReadBytesAt(position, count, dest);
+
+    scan_buffer_.resize(std::min(kScanBufferSize, data_end_ - position));
+    scan_buffer_start_ = position;
+    if (!stream_->ReadBytesAt(position, scan_buffer_.size(),
+                              scan_buffer_.data())) {
+      scan_buffer_.clear();
+      return false;
+    }
+  }
+
+  ::memcpy(dest, scan_buffer_.data() + position - scan_buffer_start_, count);
   return true;
 }
 
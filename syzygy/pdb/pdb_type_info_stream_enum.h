@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "base/callback.h"
 #include "base/memory/ref_counted.h"
@@ -32,6 +33,12 @@
 namespace pdb {
 
 // Simple type info stream enumerator which crawls through a type info stream.
+// The enumerator keeps an index of the stream positions of the records it has
+// located, such that any record can be sought to in constant time once it is
+// located. Records are located lazily, by scanning forward from the closest
+// preceding located record. The index can be seeded from the type index
+// offsets of the type info hash stream, which bounds the length of the scans,
+// or it can be built in a single pass and persisted.
 class TypeInfoEnumerator {
  public:
   class BinaryTypeRecordReader;
@@ -45,6 +52,34 @@ class TypeInfoEnumerator {
   // @returns true on success, false means bad header format.
   bool Init();
 
+  // Seeds the record index with the type index offsets of the type info hash
+  // stream. These locate about one record every 8KB of type records.
+  // @param hash_stream the type info hash stream, whose number is found in the
+  //     type info header.
+  // @returns true on success, false if the offsets are invalid. The index is
+  //     unchanged on failure.
+  // @pre Init has been called successfully.
+  bool LoadTypeIndexOffsets(PdbStream* hash_stream);
+
+  // Locates all the records in a single pass over the stream.
+  // @returns true on success, false if the stream is invalid.
+  // @pre Init has been called successfully.
+  bool BuildRecordIndex();
+
+  // @name Accessors for the full record index, for persisting it.
+  // @{
+  // Retrieves the stream positions of all the records, indexed by type id
+  // less the smallest type id. This builds the record index if required.
+  // @param offsets on success, returns the stream positions of the records.
+  // @returns true on success, false if the stream is invalid.
+  bool GetRecordIndex(std::vector<uint32_t>* offsets);
+  // Replaces the record index with one retrieved by GetRecordIndex.
+  // @param offsets the stream positions of the records.
+  // @returns true on success, false if @p offsets isn't a valid index for the
+  //     stream. The index is unchanged on failure.
+  bool SetRecordIndex(const std::vector<uint32_t>& offsets);
+  // @}
+
   // Moves to the next record in the type info stream. Expects stream position
   // at the beginning of a type info record.
   // @returns true on success, false on failure.
@@ -107,13 +142,23 @@ class TypeInfoEnumerator {
     uint16_t length;
   };
 
+  // The index value of records that haven't been located yet.
+  static const uint32_t kUnlocatedRecord = static_cast<uint32_t>(-1);
+
   // Ensure that the type with ID @p type_id has been located and stored
-  // in @p located_records_.
+  // in @p record_offsets_.
   bool EnsureTypeLocated(uint32_t type_id);
-  // Adds the start position @p position for @p type_id, which must be a valid
-  // type id, and must be one larger than the last added start position.
-  bool AddRecordInfo(uint32_t type_id, const TypeRecordInfo& record);
-  bool FindRecordInfo(uint32_t type_id, TypeRecordInfo* record);
+  // Locates the records following the record at @p from_index, up to and
+  // including the record at @p to_index, by scanning the stream.
+  // @pre the record at @p from_index has been located.
+  bool ScanRecords(size_t from_index, size_t to_index);
+  // Reads the information about the located record of @p type_id.
+  bool ReadRecordInfo(uint32_t type_id, TypeRecordInfo* record);
+  // Reads @p count bytes at @p position of the stream, through the scan
+  // buffer if they are in it.
+  // @param fill_buffer whether to refill the scan buffer from @p position if
+  //     the bytes aren't in it.
+  bool ReadAt(size_t position, size_t count, bool fill_buffer, void* dest);
 
   // Pointer to the PDB type info stream.
   scoped_refptr<PdbStream> stream_;
@@ -124,11 +169,14 @@ class TypeInfoEnumerator {
   // Header of the type info stream.
   TypeInfoHeader type_info_header_;
 
-  // A vector with the positions of located records.
-  std::vector<TypeRecordInfo> located_records_;
+  // The stream positions of the records, indexed by type id less
+  // type_id_min_, or kUnlocatedRecord for the records not yet located.
+  std::vector<uint32_t> record_offsets_;
 
-  // The largest type index we already saved in @p located_records_.
-  uint32_t largest_located_id_;
+  // A buffer with the stream data at scan_buffer_start_, which saves reading
+  // the stream for each record when scanning.
+  std::vector<uint8_t> scan_buffer_;
+  size_t scan_buffer_start_;
 
   // Position of the end of data in the stream.
   size_t data_end_;
@@ -14,13 +14,80 @@
 
 #include "syzygy/pdb/pdb_type_info_stream_enum.h"
 
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_file.h"
+#include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/unittest_util.h"
 
 namespace pdb {
 
+namespace {
+
+// Reads the type info stream and the type info hash stream of @p pdb_path.
+void ReadTypeInfoStreams(const base::FilePath& pdb_path,
+                         scoped_refptr<PdbStream>* type_info_stream,
+                         scoped_refptr<PdbStream>* hash_stream) {
+  PdbReader reader;
+  PdbFile pdb_file;
+  ASSERT_TRUE(reader.Read(pdb_path, &pdb_file));
+
+  *type_info_stream = pdb_file.GetStream(kTpiStream);
+  ASSERT_TRUE(type_info_stream->get() != nullptr);
+
+  TypeInfoEnumerator enumerator(type_info_stream->get());
+  ASSERT_TRUE(enumerator.Init());
+  *hash_stream = pdb_file.GetStream(
+      enumerator.type_info_header().type_info_hash.stream_number);
+  ASSERT_TRUE(hash_stream->get() != nullptr);
+}
+
+// Retrieves the start position and type of every record of @p stream by
+// enumerating it sequentially.
+void GetRecordsSequentially(PdbStream* stream,
+                            std::vector<size_t>* positions,
+                            std::vector<uint16_t>* types) {
+  TypeInfoEnumerator enumerator(stream);
+  ASSERT_TRUE(enumerator.Init());
+  while (!enumerator.EndOfStream()) {
+    ASSERT_TRUE(enumerator.NextTypeInfoRecord());
+    positions->push_back(enumerator.start_position());
+    types->push_back(enumerator.type());
+  }
+}
+
+// Seeks to the records of @p enumerator in random order, and checks they
+// match @p positions and @p types.
+void ExpectRecordsInRandomOrder(const std::vector<size_t>& positions,
+                                const std::vector<uint16_t>& types,
+                                TypeInfoEnumerator* enumerator) {
+  const uint32_t type_min = enumerator->type_info_header().type_min;
+  std::vector<uint32_t> type_ids(positions.size());
+  for (size_t i = 0; i < type_ids.size(); ++i)
+    type_ids[i] = type_min + static_cast<uint32_t>(i);
+  std::random_shuffle(type_ids.begin(), type_ids.end());
+
+  for (uint32_t type_id : type_ids) {
+    ASSERT_TRUE(enumerator->SeekRecord(type_id));
+    EXPECT_EQ(type_id, enumerator->type_id());
+    EXPECT_EQ(positions[type_id - type_min], enumerator->start_position());
+    EXPECT_EQ(types[type_id - type_min], enumerator->type());
+  }
+}
+
+}  // namespace
+
 TEST(PdbTypeInfoStreamEnumTest, EnumValidHeaderTypeInfoStream) {
   base::FilePath valid_type_info_path =
       testing::GetSrcRelativePath(testing::kValidPdbTypeInfoStreamPath);
@@ -199,4 +266,193 @@ TEST(PdbTypeInfoStreamEnumTest, EnumInvalidHeaderTypeInfoStream) {
   EXPECT_FALSE(enumerator.Init());
 }
 
+TEST(PdbTypeInfoStreamEnumTest, LoadTypeIndexOffsets) {
+  scoped_refptr<PdbStream> type_info_stream;
+  scoped_refptr<PdbStream> hash_stream;
+  ASSERT_NO_FATAL_FAILURE(ReadTypeInfoStreams(
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath),
+      &type_info_stream, &hash_stream));
+
+  std::vector<size_t> positions;
+  std::vector<uint16_t> types;
+  ASSERT_NO_FATAL_FAILURE(
+      GetRecordsSequentially(type_info_stream.get(), &positions, &types));
+
+  TypeInfoEnumerator enumerator(type_info_stream.get());
+  ASSERT_TRUE(enumerator.Init());
+  EXPECT_TRUE(enumerator.LoadTypeIndexOffsets(hash_stream.get()));
+  ExpectRecordsInRandomOrder(positions, types, &enumerator);
+
+  // Loading the offsets once the records are located is consistent.
+  EXPECT_TRUE(enumerator.LoadTypeIndexOffsets(hash_stream.get()));
+  EXPECT_TRUE(enumerator.ResetStream());
+  while (!enumerator.EndOfStream())
+    EXPECT_TRUE(enumerator.NextTypeInfoRecord());
+}
+
+TEST(PdbTypeInfoStreamEnumTest, LoadInvalidTypeIndexOffsets) {
+  scoped_refptr<PdbStream> type_info_stream;
+  scoped_refptr<PdbStream> hash_stream;
+  ASSERT_NO_FATAL_FAILURE(ReadTypeInfoStreams(
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath),
+      &type_info_stream, &hash_stream));
+
+  TypeInfoEnumerator enumerator(type_info_stream.get());
+  ASSERT_TRUE(enumerator.Init());
+
+  const OffsetCb& location = enumerator.type_info_header()
+                                 .type_info_hash.offset_cb_type_info_offset;
+  ASSERT_LE(2 * sizeof(uint32_t), location.cb);
+  std::vector<uint8_t> hash_data(hash_stream->length());
+  ASSERT_TRUE(
+      hash_stream->ReadBytesAt(0, hash_data.size(), hash_data.data()));
+
+  // An offset past the end of the type records.
+  std::vector<uint8_t> invalid_data(hash_data);
+  uint32_t* offsets =
+      reinterpret_cast<uint32_t*>(&invalid_data[location.offset]);
+  offsets[1] = enumerator.type_info_header().type_info_data_size;
+  scoped_refptr<PdbByteStream> invalid_stream(new PdbByteStream());
+  ASSERT_TRUE(invalid_stream->Init(invalid_data.data(), invalid_data.size()));
+  EXPECT_FALSE(enumerator.LoadTypeIndexOffsets(invalid_stream.get()));
+
+  // A type id out of range.
+  invalid_data = hash_data;
+  offsets = reinterpret_cast<uint32_t*>(&invalid_data[location.offset]);
+  offsets[0] = enumerator.type_info_header().type_max;
+  invalid_stream = new PdbByteStream();
+  ASSERT_TRUE(invalid_stream->Init(invalid_data.data(), invalid_data.size()));
+  EXPECT_FALSE(enumerator.LoadTypeIndexOffsets(invalid_stream.get()));
+
+  // Offsets that are out of order.
+  if (location.cb >= 4 * sizeof(uint32_t)) {
+    invalid_data = hash_data;
+    offsets = reinterpret_cast<uint32_t*>(&invalid_data[location.offset]);
+    std::swap(offsets[1], offsets[3]);
+    invalid_stream = new PdbByteStream();
+    ASSERT_TRUE(
+        invalid_stream->Init(invalid_data.data(), invalid_data.size()));
+    EXPECT_FALSE(enumerator.LoadTypeIndexOffsets(invalid_stream.get()));
+  }
+
+  // A truncated hash stream.
+  invalid_stream = new PdbByteStream();
+  ASSERT_TRUE(invalid_stream->Init(hash_data.data(),
+                                   location.offset + location.cb - 1));
+  EXPECT_FALSE(enumerator.LoadTypeIndexOffsets(invalid_stream.get()));
+
+  // The enumerator still works after failed loads.
+  while (!enumerator.EndOfStream())
+    EXPECT_TRUE(enumerator.NextTypeInfoRecord());
+}
+
+TEST(PdbTypeInfoStreamEnumTest, RecordIndex) {
+  base::FilePath valid_type_info_path =
+      testing::GetSrcRelativePath(testing::kValidPdbTypeInfoStreamPath);
+  scoped_refptr<pdb::PdbFileStream> valid_type_info_stream =
+      testing::GetStreamFromFile(valid_type_info_path);
+
+  std::vector<size_t> positions;
+  std::vector<uint16_t> types;
+  ASSERT_NO_FATAL_FAILURE(GetRecordsSequentially(valid_type_info_stream.get(),
+                                                 &positions, &types));
+
+  std::vector<uint32_t> record_index;
+  {
+    TypeInfoEnumerator enumerator(valid_type_info_stream.get());
+    ASSERT_TRUE(enumerator.Init());
+    ASSERT_TRUE(enumerator.GetRecordIndex(&record_index));
+    ASSERT_EQ(positions.size(), record_index.size());
+    ExpectRecordsInRandomOrder(positions, types, &enumerator);
+  }
+
+  // A fresh enumerator can use the record index.
+  TypeInfoEnumerator enumerator(valid_type_info_stream.get());
+  ASSERT_TRUE(enumerator.Init());
+  ASSERT_TRUE(enumerator.SetRecordIndex(record_index));
+  ExpectRecordsInRandomOrder(positions, types, &enumerator);
+
+  // Invalid record indices are rejected.
+  std::vector<uint32_t> invalid_index(record_index.begin(),
+                                      record_index.end() - 1);
+  EXPECT_FALSE(enumerator.SetRecordIndex(invalid_index));
+  invalid_index = record_index;
+  std::swap(invalid_index[1], invalid_index[2]);
+  EXPECT_FALSE(enumerator.SetRecordIndex(invalid_index));
+  invalid_index = record_index;
+  invalid_index.back() = static_cast<uint32_t>(-1);
+  EXPECT_FALSE(enumerator.SetRecordIndex(invalid_index));
+}
+
+TEST(PdbTypeInfoStreamEnumTest, RecordIndexInvalidData) {
+  base::FilePath invalid_type_info_path =
+      testing::GetSrcRelativePath(testing::kInvalidDataPdbTypeInfoStreamPath);
+  scoped_refptr<pdb::PdbFileStream> invalid_type_info_stream =
+      testing::GetStreamFromFile(invalid_type_info_path);
+
+  TypeInfoEnumerator enumerator(invalid_type_info_stream.get());
+  ASSERT_TRUE(enumerator.Init());
+  std::vector<uint32_t> record_index;
+  EXPECT_FALSE(enumerator.GetRecordIndex(&record_index));
+  EXPECT_FALSE(enumerator.SeekRecord(
+      enumerator.type_info_header().type_max - 1));
+}
+
+// Compares seeking to every record in random order with records located by
+// scanning on demand, with the type index offsets of the hash stream, and with
+// a full record index. Run manually with a large PDB by setting the
+// PDB_BENCHMARK_PDB environment variable.
+TEST(PdbTypeInfoStreamEnumTest, DISABLED_RandomLookupBenchmark) {
+  base::FilePath pdb_path =
+      testing::GetSrcRelativePath(testing::kTestPdbFilePath);
+  char* benchmark_pdb = getenv("PDB_BENCHMARK_PDB");
+  if (benchmark_pdb != nullptr)
+    pdb_path = base::FilePath(base::ASCIIToUTF16(benchmark_pdb));
+
+  scoped_refptr<PdbStream> type_info_stream;
+  scoped_refptr<PdbStream> hash_stream;
+  ASSERT_NO_FATAL_FAILURE(
+      ReadTypeInfoStreams(pdb_path, &type_info_stream, &hash_stream));
+
+  std::vector<uint32_t> type_ids;
+  {
+    TypeInfoEnumerator enumerator(type_info_stream.get());
+    ASSERT_TRUE(enumerator.Init());
+    for (uint32_t type_id = enumerator.type_info_header().type_min;
+         type_id < enumerator.type_info_header().type_max; ++type_id) {
+      type_ids.push_back(type_id);
+    }
+  }
+  std::random_shuffle(type_ids.begin(), type_ids.end());
+
+  enum Mode { SCAN, HASH_OFFSETS, FULL_INDEX };
+  static const char* const kModeNames[] = {
+      "Scanning on demand", "Hash stream offsets", "Full record index"};
+  for (int mode = SCAN; mode <= FULL_INDEX; ++mode) {
+    base::TimeTicks start = base::TimeTicks::Now();
+    TypeInfoEnumerator enumerator(type_info_stream.get());
+    ASSERT_TRUE(enumerator.Init());
+    if (mode == HASH_OFFSETS)
+      ASSERT_TRUE(enumerator.LoadTypeIndexOffsets(hash_stream.get()));
+    if (mode == FULL_INDEX)
+      ASSERT_TRUE(enumerator.BuildRecordIndex());
+    base::TimeDelta setup = base::TimeTicks::Now() - start;
+
+    // The first lookup after setup has the worst latency.
+    start = base::TimeTicks::Now();
+    ASSERT_TRUE(enumerator.SeekRecord(type_ids.front()));
+    base::TimeDelta first = base::TimeTicks::Now() - start;
+
+    start = base::TimeTicks::Now();
+    for (uint32_t type_id : type_ids)
+      ASSERT_TRUE(enumerator.SeekRecord(type_id));
+    base::TimeDelta lookups = base::TimeTicks::Now() - start;
+
+    LOG(INFO) << kModeNames[mode] << ": setup " << setup.InMillisecondsF()
+              << " ms, first lookup " << first.InMillisecondsF() << " ms, "
+              << type_ids.size() << " random lookups "
+              << lookups.InMillisecondsF() << " ms.";
+  }
+}
+
 }  // namespace pdb
@@ -54,6 +54,9 @@ const uint16_t S_LOCAL_VS2013 = 0x113E;  // Defines a local symbol in optimized
 const uint16_t S_LPROC32_VS2013 = 0x1146;
 const uint16_t S_GPROC32_VS2013 = 0x1147;
 
+// Ends the scope of a S_LPROC32_ID or S_GPROC32_ID function symbol.
+const uint16_t S_PROC_ID_END = 0x114F;
+
 }  // namespace Microsoft_Cci_Pdb
 
 // This macro enables the easy construction of switch statements over the
@@ -23,6 +23,7 @@
 #include "base/strings/string_util.h"
 #include "base/time/time.h"
 #include "syzygy/block_graph/block_graph.h"
+#include "syzygy/block_graph/block_util.h"
 #include "syzygy/pe/decomposer.h"
 #include "syzygy/pe/pe_file.h"
 #include "syzygy/pe/serialization.h"
@@ -121,6 +122,7 @@ int DecomposeApp::Run() {
     if (!decomposer.Decompose(&image_layout))
       return 1;
   }
+  block_graph::LogBlockGraphMemoryUsage("Decomposed image", block_graph);
 
   // Save the decomposition do the output path.
   {
@@ -19,8 +19,10 @@
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
 #include "base/win/scoped_bstr.h"
 #include "base/win/scoped_comptr.h"
+#include "syzygy/core/chunked_compression.h"
 #include "syzygy/core/zstream.h"
 #include "syzygy/pdb/omap.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
@@ -185,6 +187,22 @@ KnownCompilerInfo kKnownCompilerInfos[] = {
   { L"Microsoft (R) LINK", false }
 };
 
+// Determines whether a compiler is one of those that we whitelist.
+bool IsSupportedCompiler(const wchar_t* compiler_name) {
+  DCHECK_NE(static_cast<const wchar_t*>(nullptr), compiler_name);
+
+  // Check the compiler name against the list of known compilers.
+  for (size_t i = 0; i < arraysize(kKnownCompilerInfos); ++i) {
+    if (::wcscmp(kKnownCompilerInfos[i].compiler_name, compiler_name) == 0) {
+      return kKnownCompilerInfos[i].supported;
+    }
+  }
+
+  // Anything we don't explicitly know about is not supported.
+  VLOG(1) << "Encountered unknown compiler: " << compiler_name;
+  return false;
+}
+
 // Given a compiland, determines whether the compiler used is one of those that
 // we whitelist.
 bool IsBuiltBySupportedCompiler(IDiaSymbol* compiland) {
@@ -210,16 +228,20 @@ bool IsBuiltBySupportedCompiler(IDiaSymbol* compiland) {
   HRESULT hr = compiland_details->get_compilerName(compiler_name.Receive());
   DCHECK_EQ(S_OK, hr);
 
-  // Check the compiler name against the list of known compilers.
-  for (size_t i = 0; i < arraysize(kKnownCompilerInfos); ++i) {
-    if (::wcscmp(kKnownCompilerInfos[i].compiler_name, compiler_name) == 0) {
-      return kKnownCompilerInfos[i].supported;
-    }
+  return IsSupportedCompiler(compiler_name);
+}
+
+// Given a module read by a NativePdbReader, determines whether the compiler
+// used is one of those that we whitelist.
+bool IsBuiltBySupportedCompiler(const NativePdbReader::Module& module) {
+  // Modules without a compile symbol are those that have no compiland details
+  // in DIA, and we assume their compiler is not supported.
+  if (module.compiler_name.empty()) {
+    VLOG(1) << "Compiland has no compiland details: " << module.name;
+    return false;
   }
 
-  // Anything we don't explicitly know about is not supported.
-  VLOG(1) << "Encountered unknown compiler: " << compiler_name;
-  return false;
+  return IsSupportedCompiler(base::UTF8ToWide(module.compiler_name).c_str());
 }
 
 // Adds an intermediate reference to the provided vector. The vector is
@@ -811,8 +833,8 @@ struct Decomposer::VisitLinkerSymbolContext {
 };
 
 Decomposer::Decomposer(const PEFile& image_file)
-    : image_file_(image_file), image_layout_(NULL), image_(NULL),
-      current_block_(NULL), current_scope_count_(0) {
+    : image_file_(image_file), use_native_pdb_(false), image_layout_(NULL),
+      image_(NULL), current_block_(NULL), current_scope_count_(0) {
 }
 
 bool Decomposer::Decompose(ImageLayout* image_layout) {
@@ -896,35 +918,54 @@ bool Decomposer::LoadBlockGraphFromPdbStream(
   pdb_in_stream.reset(core::CreateByteInStream(
       byte_stream->data(), byte_stream->data() + byte_stream->length()));
 
-  // Read the header.
+  // Read the version.
   uint32_t stream_version = 0;
-  unsigned char compressed = 0;
   if (!pdb_in_stream->Read(sizeof(stream_version),
-                           reinterpret_cast<core::Byte*>(&stream_version)) ||
-      !pdb_in_stream->Read(sizeof(compressed),
-                           reinterpret_cast<core::Byte*>(&compressed))) {
+                           reinterpret_cast<core::Byte*>(&stream_version))) {
     LOG(ERROR) << "Failed to read existing Syzygy block-graph stream header.";
     return false;
   }
 
-  // Check the stream version.
-  if (stream_version != pdb::kSyzygyBlockGraphStreamVersion) {
-    LOG(ERROR) << "PDB contains an unsupported Syzygy block-graph stream"
-               << " version (got " << stream_version << ", expected "
-               << pdb::kSyzygyBlockGraphStreamVersion << ").";
-    return false;
-  }
-
-  // If the stream is compressed insert the decompression filter.
   core::InStream* in_stream = pdb_in_stream.get();
   std::unique_ptr<core::ZInStream> zip_in_stream;
-  if (compressed != 0) {
-    zip_in_stream.reset(new core::ZInStream(in_stream));
-    if (!zip_in_stream->Init()) {
-      LOG(ERROR) << "Unable to initialize ZInStream.";
+  std::vector<uint8_t> decompressed;
+  core::ScopedInStreamPtr decompressed_in_stream;
+  if (stream_version == pdb::kSyzygyBlockGraphStreamVersion) {
+    // The rest of the stream is compressed in chunks, which are decompressed
+    // concurrently.
+    const uint8_t* data = byte_stream->data() + sizeof(stream_version);
+    size_t size = byte_stream->length() - sizeof(stream_version);
+    if (!core::DecompressChunks(data, size,
+                                base::SysInfo::NumberOfProcessors(),
+                                &decompressed)) {
+      LOG(ERROR) << "Failed to decompress Syzygy block-graph stream.";
+      return false;
+    }
+    decompressed_in_stream.reset(core::CreateByteInStream(
+        decompressed.data(), decompressed.data() + decompressed.size()));
+    in_stream = decompressed_in_stream.get();
+  } else if (stream_version == pdb::kSyzygyBlockGraphStreamVersion1) {
+    unsigned char compressed = 0;
+    if (!pdb_in_stream->Read(sizeof(compressed),
+                             reinterpret_cast<core::Byte*>(&compressed))) {
+      LOG(ERROR) << "Failed to read existing Syzygy block-graph stream header.";
       return false;
     }
-    in_stream = zip_in_stream.get();
+
+    // If the stream is compressed insert the decompression filter.
+    if (compressed != 0) {
+      zip_in_stream.reset(new core::ZInStream(in_stream));
+      if (!zip_in_stream->Init()) {
+        LOG(ERROR) << "Unable to initialize ZInStream.";
+        return false;
+      }
+      in_stream = zip_in_stream.get();
+    }
+  } else {
+    LOG(ERROR) << "PDB contains an unsupported Syzygy block-graph stream"
+               << " version (got " << stream_version << ", expected "
+               << pdb::kSyzygyBlockGraphStreamVersion << ").";
+    return false;
   }
 
   // Deserialize the image-layout.
@@ -981,13 +1022,18 @@ bool Decomposer::LoadBlockGraphFromPdb(const base::FilePath& pdb_path,
 }
 
 bool Decomposer::DecomposeImpl() {
-  // Instantiate and initialize our Debug Interface Access session. This logs
-  // verbosely for us.
+  // Instantiate and initialize our Debug Interface Access session, or read the
+  // PDB file natively. This logs verbosely for us.
   ScopedComPtr<IDiaDataSource> dia_source;
   ScopedComPtr<IDiaSession> dia_session;
   ScopedComPtr<IDiaSymbol> global;
-  if (!InitializeDia(image_file_, pdb_path_, dia_source.Receive(),
-                     dia_session.Receive(), global.Receive())) {
+  NativePdbReader native_reader;
+  if (use_native_pdb_) {
+    VLOG(1) << "Reading PDB file natively.";
+    if (!native_reader.Read(pdb_path_))
+      return false;
+  } else if (!InitializeDia(image_file_, pdb_path_, dia_source.Receive(),
+                            dia_session.Receive(), global.Receive())) {
     return false;
   }
 
@@ -1022,12 +1068,16 @@ bool Decomposer::DecomposeImpl() {
     // existing PE parsed blocks, but when they do we expect them to be exact
     // collisions.
     VLOG(1) << "Parsing section contributions.";
-    if (!CreateBlocksFromSectionContribs(dia_session.get()))
+    if (use_native_pdb_ ? !CreateBlocksFromSectionContribs(native_reader)
+                        : !CreateBlocksFromSectionContribs(dia_session.get())) {
       return false;
+    }
 
     VLOG(1) << "Finding cold blocks.";
-    if (!FindColdBlocksFromCompilands(dia_session.get()))
+    if (use_native_pdb_ ? !FindColdBlocksFromCompilands(native_reader)
+                        : !FindColdBlocksFromCompilands(dia_session.get())) {
       return false;
+    }
 
     // Flesh out the rest of the image with gap blocks.
     VLOG(1) << "Creating gap blocks.";
@@ -1042,13 +1092,17 @@ bool Decomposer::DecomposeImpl() {
 
   // Parse the fixups and use them to create references.
   VLOG(1) << "Parsing fixups.";
-  if (!CreateReferencesFromFixups(dia_session.get()))
+  if (use_native_pdb_ ? !CreateReferencesFromFixups(native_reader)
+                      : !CreateReferencesFromFixups(dia_session.get())) {
     return false;
+  }
 
   // Annotate the block-graph with symbol information.
   VLOG(1) << "Parsing symbols.";
-  if (!ProcessSymbols(global.get()))
+  if (use_native_pdb_ ? !ProcessSymbols(native_reader)
+                      : !ProcessSymbols(global.get())) {
     return false;
+  }
 
   // Now, find and label any padding blocks.
   VLOG(1) << "Labeling padding blocks.";
@@ -1127,8 +1181,6 @@ bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
     return false;
   }
 
-  size_t rsrc_id = image_file_.GetSectionIndex(kResourceSectionName);
-
   LONG count = 0;
   if (section_contribs->get_Count(&count) != S_OK) {
     LOG(ERROR) << "Failed to get section contributions enumeration length.";
@@ -1179,10 +1231,6 @@ bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
     DCHECK_LT(0u, section_id);
     --section_id;
 
-    // We don't parse the resource section, as it is parsed by the PEFileParser.
-    if (section_id == rsrc_id)
-      continue;
-
     std::string compiland_name;
     if (!base::WideToUTF8(bstr_compiland_name, bstr_compiland_name.Length(),
                           &compiland_name)) {
@@ -1190,45 +1238,35 @@ bool Decomposer::CreateBlocksFromSectionContribs(IDiaSession* session) {
       return false;
     }
 
-    // Give a name to the block based on the basename of the object file. This
-    // will eventually be replaced by the full symbol name, if one exists for
-    // the block.
-    size_t last_component = compiland_name.find_last_of('\\');
-    size_t extension = compiland_name.find_last_of('.');
-    if (last_component == std::string::npos) {
-      last_component = 0;
-    } else {
-      // We don't want to include the last slash.
-      ++last_component;
-    }
-    if (extension < last_component)
-      extension = compiland_name.size();
-    std::string name = compiland_name.substr(last_component,
-                                             extension - last_component);
-
-    // TODO(chrisha): We see special section contributions with the name
-    //     "* CIL *". These are concatenations of data symbols and can very
-    //     likely be chunked using symbols directly. A cursory visual inspection
-    //     of symbol names hints that these might be related to WPO.
-
-    // Create the block.
-    BlockType block_type =
-        code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
-    Block* block = CreateBlockOrFindCoveringPeBlock(
-        block_type, RelativeAddress(rva), length, name);
-    if (block == NULL) {
-      LOG(ERROR) << "Unable to create block for compiland \""
-                 << compiland_name << "\".";
+    if (!OnSectionContrib(RelativeAddress(rva), length, section_id,
+                          code != FALSE, compiland_name,
+                          is_built_by_supported_compiler)) {
       return false;
     }
+  }
 
-    // Set the block compiland name.
-    block->set_compiland_name(compiland_name);
+  return true;
+}
 
-    // Set the block attributes.
-    block->set_attribute(BlockGraph::SECTION_CONTRIB);
-    if (!is_built_by_supported_compiler)
-      block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
+bool Decomposer::CreateBlocksFromSectionContribs(
+    const NativePdbReader& reader) {
+  const NativePdbReader::Modules& modules = reader.modules();
+
+  // The supported compiler check is done once per module, as most modules
+  // contribute several times.
+  std::vector<bool> is_built_by_supported_compiler(modules.size());
+  for (size_t i = 0; i < modules.size(); ++i)
+    is_built_by_supported_compiler[i] = IsBuiltBySupportedCompiler(modules[i]);
+
+  for (const auto& section_contrib : reader.section_contribs()) {
+    DCHECK_LT(section_contrib.module, modules.size());
+    if (!OnSectionContrib(section_contrib.addr, section_contrib.size,
+                          section_contrib.section, section_contrib.code,
+                          modules[section_contrib.module].name,
+                          is_built_by_supported_compiler[
+                              section_contrib.module])) {
+      return false;
+    }
   }
 
   return true;
@@ -1319,36 +1357,49 @@ bool Decomposer::FindColdBlocksFromCompilands(IDiaSession* session) {
         return false;
       }
 
-      // Retrieve the function block.
-      Block* func_block = image_->GetBlockByAddress(RelativeAddress(func_rva));
-      if (func_block == NULL) {
-        LOG(ERROR) << "Cannot retrieve parent block.";
+      if (!OnFunctionBlock(RelativeAddress(func_rva),
+                           static_cast<size_t>(func_length),
+                           RelativeAddress(block_rva))) {
         return false;
       }
+    }
+  }
 
-      // Skip blocks within the range of its parent.
-      if (block_rva >= func_rva && block_rva <= func_rva + func_length)
-        continue;
+  return true;
+}
 
-      // A cold block is detected and needs special handling.
-      Block* cold_block = image_->GetBlockByAddress(RelativeAddress(block_rva));
-      if (cold_block == NULL) {
-        LOG(ERROR) << "Cannot retrieve parent block.";
-        return false;
-      }
+bool Decomposer::FindColdBlocksFromCompilands(const NativePdbReader& reader) {
+  typedef NativePdbReader::Symbol Symbol;
+
+  // The lexical blocks that are immediate children of a function follow its
+  // symbol in the module.
+  for (const auto& module : reader.modules()) {
+    const Symbol* function = nullptr;
+    for (const auto& symbol : module.symbols) {
+      switch (symbol.kind) {
+        case Symbol::kFunction:
+          function = &symbol;
+          break;
 
-      RelativeAddress cold_block_addr;
-      if (!image_->GetAddressOf(cold_block, &cold_block_addr)) {
-        LOG(ERROR) << "Cannot retrieve cold block address.";
-        return false;
-      }
+        case Symbol::kThunk:
+        case Symbol::kFunctionEnd:
+          function = nullptr;
+          break;
 
-      // Add cold_block as a child of the function block.
-      cold_blocks_[func_block][cold_block_addr] = cold_block;
+        case Symbol::kBlock:
+          if (function == nullptr ||
+              (symbol.flags & Symbol::kIsFunctionChild) == 0) {
+            break;
+          }
+          if (!OnFunctionBlock(function->addr, function->length,
+                               symbol.addr)) {
+            return false;
+          }
+          break;
 
-      // Set the parent relation for blocks belonging to the function block.
-      cold_blocks_parent_[func_block] = func_block;
-      cold_blocks_parent_[cold_block] = func_block;
+        default:
+          break;
+      }
     }
   }
 
@@ -1409,15 +1460,24 @@ bool Decomposer::FinalizeIntermediateReferences(
 bool Decomposer::CreateReferencesFromFixups(IDiaSession* session) {
   DCHECK_NE(reinterpret_cast<IDiaSession*>(NULL), session);
 
-  PEFile::RelocSet reloc_set;
-  if (!image_file_.DecodeRelocs(&reloc_set))
-    return false;
-
   OMAPs omap_from;
   PdbFixups fixups;
   if (!LoadDebugStreams(session, &fixups, &omap_from))
     return false;
 
+  return CreateReferencesFromPdbFixups(fixups, omap_from);
+}
+
+bool Decomposer::CreateReferencesFromFixups(const NativePdbReader& reader) {
+  return CreateReferencesFromPdbFixups(reader.fixups(), reader.omap_from());
+}
+
+bool Decomposer::CreateReferencesFromPdbFixups(const PdbFixups& fixups,
+                                               const OMAPs& omap_from) {
+  PEFile::RelocSet reloc_set;
+  if (!image_file_.DecodeRelocs(&reloc_set))
+    return false;
+
   // While creating references from the fixups this removes the
   // corresponding reference data from the relocs. We use this as a kind of
   // double-entry bookkeeping to ensure all is well and right in the world.
@@ -1490,6 +1550,88 @@ bool Decomposer::ProcessSymbols(IDiaSymbol* root) {
   return dia_browser.Browse(root);
 }
 
+bool Decomposer::ProcessSymbols(const NativePdbReader& reader) {
+  typedef NativePdbReader::Symbol Symbol;
+
+  // The symbols are processed in the same order as DIA reports them, the
+  // symbols of the modules first followed by the global data and the public
+  // symbols. This ensures that blocks get the same names.
+  for (const auto& module : reader.modules()) {
+    for (const auto& symbol : module.symbols) {
+      bool success = true;
+      switch (symbol.kind) {
+        case Symbol::kFunction:
+        case Symbol::kThunk: {
+          BlockGraph::BlockAttributes attributes = 0;
+          if ((symbol.flags & Symbol::kNoReturn) != 0)
+            attributes |= BlockGraph::NON_RETURN_FUNCTION;
+          if ((symbol.flags & Symbol::kHasInlineAssembly) != 0)
+            attributes |= BlockGraph::HAS_INLINE_ASSEMBLY;
+          if ((symbol.flags & Symbol::kHasExceptionHandling) != 0)
+            attributes |= BlockGraph::HAS_EXCEPTION_HANDLING;
+          if (symbol.kind == Symbol::kThunk)
+            attributes |= BlockGraph::THUNK;
+          success = OnFunctionOrThunk(symbol.addr, symbol.length, symbol.name,
+                                      attributes);
+          break;
+        }
+
+        case Symbol::kFunctionEnd:
+          OnFunctionOrThunkEnd();
+          break;
+
+        case Symbol::kBlock:
+          success = OnScope(SymTagBlock, symbol.addr, symbol.length);
+          break;
+
+        case Symbol::kFuncDebugStart:
+          success = OnScope(SymTagFuncDebugStart, symbol.addr, 0);
+          break;
+
+        case Symbol::kFuncDebugEnd:
+          success = OnScope(SymTagFuncDebugEnd, symbol.addr, 0);
+          break;
+
+        case Symbol::kLabel:
+          success = OnLabel(symbol.addr, symbol.name);
+          break;
+
+        case Symbol::kData: {
+          size_t length = 0;
+          success = reader.GetTypeSize(symbol.type_id, &length) &&
+                    OnData(symbol.addr, length, symbol.name, false);
+          break;
+        }
+
+        case Symbol::kCallSite:
+          success = OnCallSite(symbol.addr);
+          break;
+
+        default:
+          NOTREACHED() << "Unexpected module symbol kind: " << symbol.kind;
+          break;
+      }
+      if (!success)
+        return false;
+    }
+  }
+
+  for (const auto& symbol : reader.global_symbols()) {
+    size_t length = 0;
+    if (!reader.GetTypeSize(symbol.type_id, &length) ||
+        !OnData(symbol.addr, length, symbol.name, true)) {
+      return false;
+    }
+  }
+
+  for (const auto& symbol : reader.public_symbols()) {
+    if (!OnPublic(symbol.addr, symbol.name))
+      return false;
+  }
+
+  return true;
+}
+
 bool Decomposer::VisitLinkerSymbol(VisitLinkerSymbolContext* context,
                                    uint16_t symbol_length,
                                    uint16_t symbol_type,
@@ -1580,10 +1722,6 @@ DiaBrowser::BrowserDirective Decomposer::OnPushFunctionOrThunkSymbol(
   DCHECK_EQ(sym_tags.size(), symbols.size());
   DiaBrowser::SymbolPtr symbol = symbols.back();
 
-  DCHECK_EQ(reinterpret_cast<Block*>(NULL), current_block_);
-  DCHECK_EQ(current_address_, RelativeAddress(0));
-  DCHECK_EQ(0u, current_scope_count_);
-
   HRESULT hr = E_FAIL;
   DWORD location_type = LocIsNull;
   DWORD rva = 0;
@@ -1603,38 +1741,12 @@ DiaBrowser::BrowserDirective Decomposer::OnPushFunctionOrThunkSymbol(
   if (location_type != LocIsStatic)
     return DiaBrowser::kBrowserTerminatePath;
 
-  RelativeAddress addr(rva);
-  Block* block = image_->GetBlockByAddress(addr);
-  CHECK(block != NULL);
-  RelativeAddress block_addr;
-  CHECK(image_->GetAddressOf(block, &block_addr));
-  DCHECK(InRange(addr, block_addr, block->size()));
-
   std::string name;
   if (!base::WideToUTF8(name_bstr, name_bstr.Length(), &name)) {
     LOG(ERROR) << "Failed to convert function/thunk name to UTF8.";
     return DiaBrowser::kBrowserAbort;
   }
 
-  // We know the function starts in this block but we need to make sure its
-  // end does not extend past the end of the block.
-  if (addr + length > block_addr + block->size()) {
-    LOG(ERROR) << "Got function/thunk \"" << name << "\" that is not contained "
-               << "by section contribution \"" << block->name() << "\".";
-    return DiaBrowser::kBrowserAbort;
-  }
-
-  Offset offset = addr - block_addr;
-  if (!AddLabelToBlock(offset, name, BlockGraph::CODE_LABEL, block))
-    return DiaBrowser::kBrowserAbort;
-
-  // Keep track of the generated block. We will use this when parsing symbols
-  // that belong to this function. This prevents us from having to do repeated
-  // lookups and also allows us to associate labels outside of the block to the
-  // correct block.
-  current_block_ = block;
-  current_address_ = block_addr;
-
   // Certain properties are not defined on all blocks, so the following calls
   // may return S_FALSE.
   BOOL no_return = FALSE;
@@ -1653,15 +1765,21 @@ DiaBrowser::BrowserDirective Decomposer::OnPushFunctionOrThunkSymbol(
   if (symbol->get_hasSEH(&has_seh) != S_OK)
     has_seh = FALSE;
 
-  // Set the block attributes.
+  // Determine the block attributes.
+  BlockGraph::BlockAttributes attributes = 0;
   if (no_return == TRUE)
-    block->set_attribute(BlockGraph::NON_RETURN_FUNCTION);
+    attributes |= BlockGraph::NON_RETURN_FUNCTION;
   if (has_inl_asm == TRUE)
-    block->set_attribute(BlockGraph::HAS_INLINE_ASSEMBLY);
+    attributes |= BlockGraph::HAS_INLINE_ASSEMBLY;
   if (has_eh || has_seh)
-    block->set_attribute(BlockGraph::HAS_EXCEPTION_HANDLING);
+    attributes |= BlockGraph::HAS_EXCEPTION_HANDLING;
   if (IsSymTag(symbol.get(), SymTagThunk))
-    block->set_attribute(BlockGraph::THUNK);
+    attributes |= BlockGraph::THUNK;
+
+  if (!OnFunctionOrThunk(RelativeAddress(rva), static_cast<size_t>(length),
+                         name, attributes)) {
+    return DiaBrowser::kBrowserAbort;
+  }
 
   return DiaBrowser::kBrowserContinue;
 }
@@ -1670,10 +1788,7 @@ DiaBrowser::BrowserDirective Decomposer::OnPopFunctionOrThunkSymbol(
     const DiaBrowser& dia_browser,
     const DiaBrowser::SymTagVector& sym_tags,
     const DiaBrowser::SymbolPtrVector& symbols) {
-  // Simply clean up the current function block and address.
-  current_block_ = NULL;
-  current_address_ = RelativeAddress(0);
-  current_scope_count_ = 0;
+  OnFunctionOrThunkEnd();
   return DiaBrowser::kBrowserContinue;
 }
 
@@ -1732,11 +1847,6 @@ DiaBrowser::BrowserDirective Decomposer::OnDataSymbol(
     return DiaBrowser::kBrowserAbort;
   }
 
-  // Symbols with an address of zero are essentially invalid. They appear to
-  // have been optimized away by the compiler, but they are still reported.
-  if (rva == 0)
-    return DiaBrowser::kBrowserTerminatePath;
-
   // We only care about functions with static storage. We can stop looking at
   // things below this node, as we won't be able to resolve them either.
   if (location_type != LocIsStatic)
@@ -1747,9 +1857,269 @@ DiaBrowser::BrowserDirective Decomposer::OnDataSymbol(
   if (!GetDataSymbolSize(symbol.get(), &length))
     return DiaBrowser::kBrowserAbort;
 
+  std::string name;
+  if (!base::WideToUTF8(name_bstr, name_bstr.Length(), &name)) {
+    LOG(ERROR) << "Failed to convert label name to UTF8.";
+    return DiaBrowser::kBrowserAbort;
+  }
+
+  if (!OnData(RelativeAddress(rva), length, name, sym_tags.size() == 1))
+    return DiaBrowser::kBrowserAbort;
+
+  return DiaBrowser::kBrowserContinue;
+}
+
+DiaBrowser::BrowserDirective Decomposer::OnPublicSymbol(
+    const DiaBrowser& dia_browser,
+    const DiaBrowser::SymTagVector& sym_tags,
+    const DiaBrowser::SymbolPtrVector& symbols) {
+  DCHECK(!symbols.empty());
+  DCHECK_EQ(sym_tags.size(), symbols.size());
+  DCHECK_EQ(reinterpret_cast<Block*>(NULL), current_block_);
+  DiaBrowser::SymbolPtr symbol = symbols.back();
+
+  HRESULT hr = E_FAIL;
+  DWORD rva = 0;
+  ScopedBstr name_bstr;
+  if (FAILED(hr = symbol->get_relativeVirtualAddress(&rva)) ||
+      FAILED(hr = symbol->get_name(name_bstr.Receive()))) {
+    LOG(ERROR) << "Failed to get public symbol properties: "
+               << common::LogHr(hr) << ".";
+    return DiaBrowser::kBrowserAbort;
+  }
+
+  std::string name;
+  base::WideToUTF8(name_bstr, name_bstr.Length(), &name);
+
+  if (!OnPublic(RelativeAddress(rva), name))
+    return DiaBrowser::kBrowserAbort;
+
+  return DiaBrowser::kBrowserContinue;
+}
+
+DiaBrowser::BrowserDirective Decomposer::OnLabelSymbol(
+    const DiaBrowser& dia_browser,
+    const DiaBrowser::SymTagVector& sym_tags,
+    const DiaBrowser::SymbolPtrVector& symbols) {
+  DCHECK(!symbols.empty());
+  DCHECK_EQ(sym_tags.size(), symbols.size());
+  DiaBrowser::SymbolPtr symbol = symbols.back();
+
+  HRESULT hr = E_FAIL;
+  DWORD rva = 0;
+  ScopedBstr name_bstr;
+  if (FAILED(hr = symbol->get_relativeVirtualAddress(&rva)) ||
+      FAILED(hr = symbol->get_name(name_bstr.Receive()))) {
+    LOG(ERROR) << "Failed to get label symbol properties: " << common::LogHr(hr)
+               << ".";
+    return DiaBrowser::kBrowserAbort;
+  }
+
+  std::string name;
+  base::WideToUTF8(name_bstr, name_bstr.Length(), &name);
+
+  if (!OnLabel(RelativeAddress(rva), name))
+    return DiaBrowser::kBrowserAbort;
+
+  return DiaBrowser::kBrowserContinue;
+}
+
+DiaBrowser::BrowserDirective Decomposer::OnScopeSymbol(
+    enum SymTagEnum type, DiaBrowser::SymbolPtr symbol) {
+  // We should only get here via the successful exploration of a SymTagFunction,
+  // so current_block_ should be set.
+  DCHECK_NE(reinterpret_cast<Block*>(NULL), current_block_);
+
+  HRESULT hr = E_FAIL;
+  DWORD rva = 0;
+  if (FAILED(hr = symbol->get_relativeVirtualAddress(&rva))) {
+    LOG(ERROR) << "Failed to get scope symbol properties: " << common::LogHr(hr)
+               << ".";
+    return DiaBrowser::kBrowserAbort;
+  }
+
+  // If this is a scope we extract the length, for the corresponding end label.
+  ULONGLONG length = 0;
+  if (type == SymTagBlock && symbol->get_length(&length) != S_OK) {
+    LOG(ERROR) << "Failed to extract code scope length for block \""
+               << current_block_->name() << "\".";
+    return DiaBrowser::kBrowserAbort;
+  }
+
+  if (!OnScope(type, RelativeAddress(rva), static_cast<size_t>(length)))
+    return DiaBrowser::kBrowserAbort;
+
+  return DiaBrowser::kBrowserContinue;
+}
+
+DiaBrowser::BrowserDirective Decomposer::OnCallSiteSymbol(
+    DiaBrowser::SymbolPtr symbol) {
+  // We should only get here via the successful exploration of a SymTagFunction,
+  // so current_block_ should be set.
+  DCHECK_NE(reinterpret_cast<Block*>(NULL), current_block_);
+
+  HRESULT hr = E_FAIL;
+  DWORD rva = 0;
+  if (FAILED(hr = symbol->get_relativeVirtualAddress(&rva))) {
+    LOG(ERROR) << "Failed to get call site symbol properties: "
+               << common::LogHr(hr) << ".";
+    return DiaBrowser::kBrowserAbort;
+  }
+
+  if (!OnCallSite(RelativeAddress(rva)))
+    return DiaBrowser::kBrowserAbort;
+
+  return DiaBrowser::kBrowserContinue;
+}
+
+bool Decomposer::OnSectionContrib(RelativeAddress addr,
+                                  size_t length,
+                                  size_t section_id,
+                                  bool code,
+                                  const std::string& compiland_name,
+                                  bool is_built_by_supported_compiler) {
+  // We don't parse the resource section, as it is parsed by the PEFileParser.
+  if (section_id == image_file_.GetSectionIndex(kResourceSectionName))
+    return true;
+
+  // Give a name to the block based on the basename of the object file. This
+  // will eventually be replaced by the full symbol name, if one exists for
+  // the block.
+  size_t last_component = compiland_name.find_last_of('\\');
+  size_t extension = compiland_name.find_last_of('.');
+  if (last_component == std::string::npos) {
+    last_component = 0;
+  } else {
+    // We don't want to include the last slash.
+    ++last_component;
+  }
+  if (extension < last_component)
+    extension = compiland_name.size();
+  std::string name = compiland_name.substr(last_component,
+                                           extension - last_component);
+
+  // TODO(chrisha): We see special section contributions with the name
+  //     "* CIL *". These are concatenations of data symbols and can very
+  //     likely be chunked using symbols directly. A cursory visual inspection
+  //     of symbol names hints that these might be related to WPO.
+
+  // Create the block.
+  BlockType block_type =
+      code ? BlockGraph::CODE_BLOCK : BlockGraph::DATA_BLOCK;
+  Block* block = CreateBlockOrFindCoveringPeBlock(
+      block_type, addr, length, name);
+  if (block == NULL) {
+    LOG(ERROR) << "Unable to create block for compiland \""
+               << compiland_name << "\".";
+    return false;
+  }
+
+  // Set the block compiland name.
+  block->set_compiland_name(compiland_name);
+
+  // Set the block attributes.
+  block->set_attribute(BlockGraph::SECTION_CONTRIB);
+  if (!is_built_by_supported_compiler)
+    block->set_attribute(BlockGraph::BUILT_BY_UNSUPPORTED_COMPILER);
+
+  return true;
+}
+
+bool Decomposer::OnFunctionBlock(RelativeAddress func_addr,
+                                 size_t func_length,
+                                 RelativeAddress block_addr) {
+  // Retrieve the function block.
+  Block* func_block = image_->GetBlockByAddress(func_addr);
+  if (func_block == NULL) {
+    LOG(ERROR) << "Cannot retrieve parent block.";
+    return false;
+  }
+
+  // Skip blocks within the range of its parent.
+  if (block_addr >= func_addr && block_addr <= func_addr + func_length)
+    return true;
+
+  // A cold block is detected and needs special handling.
+  Block* cold_block = image_->GetBlockByAddress(block_addr);
+  if (cold_block == NULL) {
+    LOG(ERROR) << "Cannot retrieve parent block.";
+    return false;
+  }
+
+  RelativeAddress cold_block_addr;
+  if (!image_->GetAddressOf(cold_block, &cold_block_addr)) {
+    LOG(ERROR) << "Cannot retrieve cold block address.";
+    return false;
+  }
+
+  // Add cold_block as a child of the function block.
+  cold_blocks_[func_block][cold_block_addr] = cold_block;
+
+  // Set the parent relation for blocks belonging to the function block.
+  cold_blocks_parent_[func_block] = func_block;
+  cold_blocks_parent_[cold_block] = func_block;
+
+  return true;
+}
+
+bool Decomposer::OnFunctionOrThunk(RelativeAddress addr,
+                                   size_t length,
+                                   const std::string& name,
+                                   BlockGraph::BlockAttributes attributes) {
+  DCHECK_EQ(reinterpret_cast<Block*>(NULL), current_block_);
+  DCHECK_EQ(current_address_, RelativeAddress(0));
+  DCHECK_EQ(0u, current_scope_count_);
+
+  Block* block = image_->GetBlockByAddress(addr);
+  CHECK(block != NULL);
+  RelativeAddress block_addr;
+  CHECK(image_->GetAddressOf(block, &block_addr));
+  DCHECK(InRange(addr, block_addr, block->size()));
+
+  // We know the function starts in this block but we need to make sure its
+  // end does not extend past the end of the block.
+  if (addr + length > block_addr + block->size()) {
+    LOG(ERROR) << "Got function/thunk \"" << name << "\" that is not contained "
+               << "by section contribution \"" << block->name() << "\".";
+    return false;
+  }
+
+  Offset offset = addr - block_addr;
+  if (!AddLabelToBlock(offset, name, BlockGraph::CODE_LABEL, block))
+    return false;
+
+  // Keep track of the generated block. We will use this when parsing symbols
+  // that belong to this function. This prevents us from having to do repeated
+  // lookups and also allows us to associate labels outside of the block to the
+  // correct block.
+  current_block_ = block;
+  current_address_ = block_addr;
+
+  // Set the block attributes.
+  if (attributes != 0)
+    block->set_attribute(attributes);
+
+  return true;
+}
+
+void Decomposer::OnFunctionOrThunkEnd() {
+  // Simply clean up the current function block and address.
+  current_block_ = NULL;
+  current_address_ = RelativeAddress(0);
+  current_scope_count_ = 0;
+}
+
+bool Decomposer::OnData(RelativeAddress addr,
+                        size_t length,
+                        const std::string& name,
+                        bool is_global) {
+  // Symbols with an address of zero are essentially invalid. They appear to
+  // have been optimized away by the compiler, but they are still reported.
+  if (addr == RelativeAddress(0))
+    return true;
+
   // Reuse the parent function block if we can. This acts as small lookup
   // cache.
-  RelativeAddress addr(rva);
   Block* block = current_block_;
   RelativeAddress block_addr(current_address_);
   if (block == NULL || !InRange(addr, block_addr, block->size())) {
@@ -1759,13 +2129,8 @@ DiaBrowser::BrowserDirective Decomposer::OnDataSymbol(
     DCHECK(InRange(addr, block_addr, block->size()));
   }
 
-  std::string name;
-  if (!base::WideToUTF8(name_bstr, name_bstr.Length(), &name)) {
-    LOG(ERROR) << "Failed to convert label name to UTF8.";
-    return DiaBrowser::kBrowserAbort;
-  }
-
   // Zero-length data symbols mark case/jump tables, or are forward declares.
+  std::string label_name(name);
   BlockGraph::LabelAttributes attr = BlockGraph::DATA_LABEL;
   Offset offset = addr - block_addr;
   if (length == 0) {
@@ -1775,17 +2140,17 @@ DiaBrowser::BrowserDirective Decomposer::OnDataSymbol(
     // indices into a jump table), thus do not coincide with a reference.
     if (name.empty() && block->type() == BlockGraph::CODE_BLOCK) {
       if (block->references().find(offset) != block->references().end()) {
-        name = kJumpTable;
+        label_name = kJumpTable;
         attr |= BlockGraph::JUMP_TABLE_LABEL;
       } else {
-        name = kCaseTable;
+        label_name = kCaseTable;
         attr |= BlockGraph::CASE_TABLE_LABEL;
       }
     } else {
       // Zero-length data symbols act as 'forward declares' in some sense. They
       // are always followed by a non-zero length data symbol with the same name
       // and location.
-      return DiaBrowser::kBrowserTerminatePath;
+      return true;
     }
   }
 
@@ -1800,85 +2165,45 @@ DiaBrowser::BrowserDirective Decomposer::OnDataSymbol(
     // which case a linker generated pseudo-import-entry block will be
     // generated. This won't be part of the IAT, so we can't even filter based
     // on that. Instead, we simply ignore global data symbols that exceed the
-    // block size.
+    // block size. Depending on how the PDB is read these have one or two
+    // leading underscores.
     base::StringPiece spname(name);
-    if (sym_tags.size() == 1 && spname.starts_with("_imp_")) {
+    if (is_global &&
+        (spname.starts_with("_imp_") || spname.starts_with("__imp_"))) {
       VLOG(1) << "Encountered an imported data symbol \"" << name << "\" that "
               << "extends past its parent block \"" << block->name() << "\".";
     } else {
       LOG(ERROR) << "Received data symbol \"" << name << "\" that extends past "
                  << "its parent block \"" << block->name() << "\".";
-      return DiaBrowser::kBrowserAbort;
+      return false;
     }
   }
 
-  if (!AddLabelToBlock(offset, name, attr, block))
-    return DiaBrowser::kBrowserAbort;
-
-  return DiaBrowser::kBrowserContinue;
+  return AddLabelToBlock(offset, label_name, attr, block);
 }
 
-DiaBrowser::BrowserDirective Decomposer::OnPublicSymbol(
-    const DiaBrowser& dia_browser,
-    const DiaBrowser::SymTagVector& sym_tags,
-    const DiaBrowser::SymbolPtrVector& symbols) {
-  DCHECK(!symbols.empty());
-  DCHECK_EQ(sym_tags.size(), symbols.size());
+bool Decomposer::OnPublic(RelativeAddress addr, const std::string& name) {
   DCHECK_EQ(reinterpret_cast<Block*>(NULL), current_block_);
-  DiaBrowser::SymbolPtr symbol = symbols.back();
-
-  HRESULT hr = E_FAIL;
-  DWORD rva = 0;
-  ScopedBstr name_bstr;
-  if (FAILED(hr = symbol->get_relativeVirtualAddress(&rva)) ||
-      FAILED(hr = symbol->get_name(name_bstr.Receive()))) {
-    LOG(ERROR) << "Failed to get public symbol properties: "
-               << common::LogHr(hr) << ".";
-    return DiaBrowser::kBrowserAbort;
-  }
 
-  RelativeAddress addr(rva);
   Block* block = image_->GetBlockByAddress(addr);
   CHECK(block != NULL);
   RelativeAddress block_addr;
   CHECK(image_->GetAddressOf(block, &block_addr));
   DCHECK(InRange(addr, block_addr, block->size()));
 
-  std::string name;
-  base::WideToUTF8(name_bstr, name_bstr.Length(), &name);
-
   // Public symbol names are mangled. Remove leading '_' as per
   // http://msdn.microsoft.com/en-us/library/00kh39zz(v=vs.80).aspx
-  if (name[0] == '_')
-    name = name.substr(1);
+  base::StringPiece label_name(name);
+  if (!label_name.empty() && label_name[0] == '_')
+    label_name.remove_prefix(1);
 
   Offset offset = addr - block_addr;
-  if (!AddLabelToBlock(offset, name, BlockGraph::PUBLIC_SYMBOL_LABEL, block))
-    return DiaBrowser::kBrowserAbort;
-
-  return DiaBrowser::kBrowserContinue;
+  return AddLabelToBlock(offset, label_name, BlockGraph::PUBLIC_SYMBOL_LABEL,
+                         block);
 }
 
-DiaBrowser::BrowserDirective Decomposer::OnLabelSymbol(
-    const DiaBrowser& dia_browser,
-    const DiaBrowser::SymTagVector& sym_tags,
-    const DiaBrowser::SymbolPtrVector& symbols) {
-  DCHECK(!symbols.empty());
-  DCHECK_EQ(sym_tags.size(), symbols.size());
-  DiaBrowser::SymbolPtr symbol = symbols.back();
-
-  HRESULT hr = E_FAIL;
-  DWORD rva = 0;
-  ScopedBstr name_bstr;
-  if (FAILED(hr = symbol->get_relativeVirtualAddress(&rva)) ||
-      FAILED(hr = symbol->get_name(name_bstr.Receive()))) {
-    LOG(ERROR) << "Failed to get label symbol properties: " << common::LogHr(hr)
-               << ".";
-    return DiaBrowser::kBrowserAbort;
-  }
-
+bool Decomposer::OnLabel(RelativeAddress addr, const std::string& name) {
   // If we have a current_block_ the label should lie within its scope.
-  RelativeAddress addr(rva);
   Block* block = current_block_;
   RelativeAddress block_addr(current_address_);
   if (block != NULL) {
@@ -1917,14 +2242,14 @@ DiaBrowser::BrowserDirective Decomposer::OnLabelSymbol(
       // Update the block address according to the cold block found.
       if (!image_->GetAddressOf(block, &block_addr)) {
         LOG(ERROR) << "Cannot retrieve cold block address.";
-        return DiaBrowser::kBrowserAbort;
+        return false;
       }
     }
 
     if (!InRangeIncl(addr, block_addr, block->size())) {
       LOG(ERROR) << "Label falls outside of current block \""
                  << block->name() << "\".";
-      return DiaBrowser::kBrowserAbort;
+      return false;
     }
   } else {
     // If there is no current block this is a compiland scope label.
@@ -1938,32 +2263,18 @@ DiaBrowser::BrowserDirective Decomposer::OnLabelSymbol(
     //     compiland.
   }
 
-  std::string name;
-  base::WideToUTF8(name_bstr, name_bstr.Length(), &name);
-
   Offset offset = addr - block_addr;
-  if (!AddLabelToBlock(offset, name, BlockGraph::CODE_LABEL, block))
-    return DiaBrowser::kBrowserAbort;
-
-  return DiaBrowser::kBrowserContinue;
+  return AddLabelToBlock(offset, name, BlockGraph::CODE_LABEL, block);
 }
 
-DiaBrowser::BrowserDirective Decomposer::OnScopeSymbol(
-    enum SymTagEnum type, DiaBrowser::SymbolPtr symbol) {
-  // We should only get here via the successful exploration of a SymTagFunction,
-  // so current_block_ should be set.
+bool Decomposer::OnScope(enum SymTagEnum type,
+                         RelativeAddress addr,
+                         size_t length) {
+  // We should only get here within the scope of a function, so current_block_
+  // should be set.
   DCHECK_NE(reinterpret_cast<Block*>(NULL), current_block_);
 
-  HRESULT hr = E_FAIL;
-  DWORD rva = 0;
-  if (FAILED(hr = symbol->get_relativeVirtualAddress(&rva))) {
-    LOG(ERROR) << "Failed to get scope symbol properties: " << common::LogHr(hr)
-               << ".";
-    return DiaBrowser::kBrowserAbort;
-  }
-
   // The label may potentially lay at the first byte past the function.
-  RelativeAddress addr(rva);
   DCHECK_LE(current_address_, addr);
   DCHECK_LE(addr, current_address_ + current_block_->size());
 
@@ -1975,60 +2286,39 @@ DiaBrowser::BrowserDirective Decomposer::OnScopeSymbol(
   // Add the label.
   Offset offset = addr - current_address_;
   if (!AddLabelToBlock(offset, name, attr, current_block_))
-    return DiaBrowser::kBrowserAbort;
+    return false;
 
-  // If this is a scope we extract the length and explicitly add a corresponding
-  // end label.
+  // If this is a scope we explicitly add a corresponding end label.
   if (type == SymTagBlock) {
-    ULONGLONG length = 0;
-    if (symbol->get_length(&length) != S_OK) {
-      LOG(ERROR) << "Failed to extract code scope length for block \""
-                  << current_block_->name() << "\".";
-      return DiaBrowser::kBrowserAbort;
-    }
     DCHECK_LE(static_cast<size_t>(offset + length), current_block_->size());
     name = base::StringPrintf("<scope-end-%d>", current_scope_count_);
     ++current_scope_count_;
     if (!AddLabelToBlock(offset + length, name,
                          BlockGraph::SCOPE_END_LABEL, current_block_)) {
-      return DiaBrowser::kBrowserAbort;
+      return false;
     }
   }
 
-  return DiaBrowser::kBrowserContinue;
+  return true;
 }
 
-DiaBrowser::BrowserDirective Decomposer::OnCallSiteSymbol(
-    DiaBrowser::SymbolPtr symbol) {
-  // We should only get here via the successful exploration of a SymTagFunction,
-  // so current_block_ should be set.
+bool Decomposer::OnCallSite(RelativeAddress addr) {
+  // We should only get here within the scope of a function, so current_block_
+  // should be set.
   DCHECK_NE(reinterpret_cast<Block*>(NULL), current_block_);
 
-  HRESULT hr = E_FAIL;
-  DWORD rva = 0;
-  if (FAILED(hr = symbol->get_relativeVirtualAddress(&rva))) {
-    LOG(ERROR) << "Failed to get call site symbol properties: "
-               << common::LogHr(hr) << ".";
-    return DiaBrowser::kBrowserAbort;
-  }
-
-  RelativeAddress addr(rva);
   if (!InRange(addr, current_address_, current_block_->size())) {
     // We see this happen under some build configurations (notably debug
     // component builds of Chrome). As long as the label falls entirely
     // outside of the block it is harmless and can be safely ignored.
     VLOG(1) << "Call site falls outside of current block \""
             << current_block_->name() << "\".";
-    return DiaBrowser::kBrowserContinue;
+    return true;
   }
 
   Offset offset = addr - current_address_;
-  if (!AddLabelToBlock(offset, "<call-site>", BlockGraph::CALL_SITE_LABEL,
-                       current_block_)) {
-    return DiaBrowser::kBrowserAbort;
-  }
-
-  return DiaBrowser::kBrowserContinue;
+  return AddLabelToBlock(offset, "<call-site>", BlockGraph::CALL_SITE_LABEL,
+                         current_block_);
 }
 
 Block* Decomposer::CreateBlock(BlockType type,
@@ -27,6 +27,7 @@
 #include "syzygy/pdb/pdb_stream.h"
 #include "syzygy/pe/dia_browser.h"
 #include "syzygy/pe/image_layout.h"
+#include "syzygy/pe/native_pdb_reader.h"
 #include "syzygy/pe/pe_file.h"
 
 namespace pe {
@@ -64,6 +65,15 @@ class Decomposer {
   // @param pdb_path the path to the PDB file to be used in decomposing the
   //     image.
   void set_pdb_path(const base::FilePath& pdb_path) { pdb_path_ = pdb_path; }
+  // Selects how the PDB file is read. By default the section contributions,
+  // symbols and fixups are retrieved through DIA. When this is set they are
+  // instead parsed directly out of the PDB streams by a NativePdbReader, which
+  // parses the symbols of the modules concurrently and doesn't require DIA.
+  // Both modes produce the same decomposition.
+  // @param use_native_pdb true to read the PDB file natively.
+  void set_use_native_pdb(bool use_native_pdb) {
+    use_native_pdb_ = use_native_pdb;
+  }
   // @}
 
   // @name Accessors
@@ -73,6 +83,8 @@ class Decomposer {
   // decomposition.
   // @returns the PDB path.
   const base::FilePath& pdb_path() const { return pdb_path_; }
+  // @returns true if the PDB file is read natively rather than through DIA.
+  bool use_native_pdb() const { return use_native_pdb_; }
   // @}
 
  protected:
@@ -95,7 +107,8 @@ class Decomposer {
                                     bool* stream_exists);
   // @}
 
-  // @name Decomposition steps, in order.
+  // @name Decomposition steps, in order. The steps that read the PDB file come
+  //     in two flavours, one using DIA and one using a NativePdbReader.
   // @{
   // Performs the actual decomposition.
   bool DecomposeImpl();
@@ -105,8 +118,10 @@ class Decomposer {
   bool CreateBlocksFromCoffGroups();
   // Processes the SectionContribution table, creating code/data blocks from it.
   bool CreateBlocksFromSectionContribs(IDiaSession* session);
- // Processes the Compiland table and finds cold blocks.
+  bool CreateBlocksFromSectionContribs(const NativePdbReader& reader);
+  // Processes the Compiland table and finds cold blocks.
   bool FindColdBlocksFromCompilands(IDiaSession* session);
+  bool FindColdBlocksFromCompilands(const NativePdbReader& reader);
   // Creates gap blocks to flesh out the image. After this has been run all
   // references should be resolvable.
   bool CreateGapBlocks();
@@ -114,13 +129,20 @@ class Decomposer {
   bool FinalizeIntermediateReferences(const IntermediateReferences& references);
   // Creates inter-block references from fixups.
   bool CreateReferencesFromFixups(IDiaSession* session);
+  bool CreateReferencesFromFixups(const NativePdbReader& reader);
   // Processes symbols from the PDB, setting block names and labels. This
   // step is purely optional and only necessary to provide debug information.
   // This adds names to blocks, adds code labels and their names, and adds
   // more informative names to data labels.
   bool ProcessSymbols(IDiaSymbol* root);
+  bool ProcessSymbols(const NativePdbReader& reader);
   // @}
 
+  // Creates references from the fixups of the PDB file, for both ways of
+  // reading it.
+  bool CreateReferencesFromPdbFixups(const std::vector<pdb::PdbFixup>& fixups,
+                                     const std::vector<OMAP>& omap_from);
+
   // @{
   // @name Callbacks and context structures used by the COFF group parsing
   //     mechanism.
@@ -168,6 +190,49 @@ class Decomposer {
   DiaBrowser::BrowserDirective OnCallSiteSymbol(DiaBrowser::SymbolPtr symbol);
   // @}
 
+  // @name Symbol handlers shared by both ways of reading the PDB file. These
+  //     receive the properties of the symbols, and return false on error.
+  // @{
+  // Creates or finds the block of a section contribution.
+  // @param addr the address of the section contribution.
+  // @param length the length of the section contribution.
+  // @param section_id the index of its section, starting at zero.
+  // @param code true if the section contribution is code.
+  // @param compiland_name the name of the contributing compiland.
+  // @param is_built_by_supported_compiler true if the compiland was built by
+  //     a supported compiler.
+  bool OnSectionContrib(RelativeAddress addr,
+                        size_t length,
+                        size_t section_id,
+                        bool code,
+                        const std::string& compiland_name,
+                        bool is_built_by_supported_compiler);
+  // Records a lexical block of a function if it lies outside of the function.
+  bool OnFunctionBlock(RelativeAddress func_addr,
+                       size_t func_length,
+                       RelativeAddress block_addr);
+  // Labels a function or thunk, and makes its block the current block.
+  // @param attributes the attributes to set on the block of the function.
+  bool OnFunctionOrThunk(RelativeAddress addr,
+                         size_t length,
+                         const std::string& name,
+                         BlockGraph::BlockAttributes attributes);
+  // Ends the scope of the current function or thunk.
+  void OnFunctionOrThunkEnd();
+  // Labels a datum.
+  // @param is_global true if the datum is in the global scope.
+  bool OnData(RelativeAddress addr,
+              size_t length,
+              const std::string& name,
+              bool is_global);
+  bool OnPublic(RelativeAddress addr, const std::string& name);
+  bool OnLabel(RelativeAddress addr, const std::string& name);
+  // Labels a scope, which may be a lexical block or the debug start or end of
+  // the current function. @p length is only used for lexical blocks.
+  bool OnScope(enum SymTagEnum type, RelativeAddress addr, size_t length);
+  bool OnCallSite(RelativeAddress addr);
+  // @}
+
   // @name Block creation members.
   // @{
   // Creates a new block with the given properties, and attaches the
@@ -198,6 +263,8 @@ class Decomposer {
   const PEFile& image_file_;
   // The path to corresponding PDB file.
   base::FilePath pdb_path_;
+  // Indicates whether the PDB file is read natively.
+  bool use_native_pdb_;
 
   // @name Temporaries that are only valid while inside DecomposeImpl.
   //     Prevents us from having to pass these around everywhere.
@@ -218,7 +285,7 @@ class Decomposer {
   ColdBlocksParent cold_blocks_parent_;
   // @}
 
-  // @name Temporaries that are only valid while in DiaBrowser.
+  // @name Temporaries that are only valid while processing symbols.
   // @{
   BlockGraph::Block* current_block_;
   RelativeAddress current_address_;
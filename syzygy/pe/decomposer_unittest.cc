@@ -14,15 +14,22 @@
 
 #include "syzygy/pe/decomposer.h"
 
+#include <iterator>
+#include <set>
+
 #include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
+#include "base/time/time.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/block_graph/block_graph_serializer.h"
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/block_graph/unittest_util.h"
+#include "syzygy/core/chunked_compression.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
+#include "syzygy/pdb/pdb_constants.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
@@ -67,6 +74,69 @@ class DecomposerTest : public testing::PELibUnitTest {
   base::FilePath temp_dir_;
 };
 
+// Splits the merged names of a label.
+std::set<std::string> GetLabelNames(const BlockGraph::Label& label) {
+  std::vector<std::string> names;
+  base::SplitStringUsingSubstr(label.name(), Decomposer::kLabelNameSep, &names);
+  return std::set<std::string>(names.begin(), names.end());
+}
+
+// Expects two decompositions of the same image to be identical. The names of
+// the blocks and the order of the names of the labels are not compared, as
+// they depend on the order in which the symbols are processed.
+void ExpectSameDecomposition(const ImageLayout& expected,
+                             const ImageLayout& actual) {
+  ASSERT_EQ(expected.blocks.size(), actual.blocks.size());
+
+  BlockGraph::AddressSpace::RangeMapConstIter expected_it =
+      expected.blocks.begin();
+  BlockGraph::AddressSpace::RangeMapConstIter actual_it =
+      actual.blocks.begin();
+  for (; expected_it != expected.blocks.end(); ++expected_it, ++actual_it) {
+    const BlockGraph::Block* expected_block = expected_it->second;
+    const BlockGraph::Block* actual_block = actual_it->second;
+    ASSERT_EQ(expected_it->first, actual_it->first);
+    EXPECT_EQ(expected_block->type(), actual_block->type());
+    EXPECT_EQ(expected_block->attributes(), actual_block->attributes());
+    EXPECT_EQ(expected_block->section(), actual_block->section());
+    EXPECT_EQ(expected_block->compiland_name(),
+              actual_block->compiland_name());
+
+    ASSERT_EQ(expected_block->labels().size(), actual_block->labels().size())
+        << "Labels differ in block \"" << expected_block->name() << "\".";
+    BlockGraph::Block::LabelMap::const_iterator expected_label =
+        expected_block->labels().begin();
+    BlockGraph::Block::LabelMap::const_iterator actual_label =
+        actual_block->labels().begin();
+    for (; expected_label != expected_block->labels().end();
+         ++expected_label, ++actual_label) {
+      EXPECT_EQ(expected_label->first, actual_label->first);
+      EXPECT_EQ(expected_label->second.attributes(),
+                actual_label->second.attributes());
+      EXPECT_THAT(GetLabelNames(actual_label->second),
+                  ContainerEq(GetLabelNames(expected_label->second)));
+    }
+
+    ASSERT_EQ(expected_block->references().size(),
+              actual_block->references().size())
+        << "References differ in block \"" << expected_block->name() << "\".";
+    BlockGraph::Block::ReferenceMap::const_iterator expected_ref =
+        expected_block->references().begin();
+    BlockGraph::Block::ReferenceMap::const_iterator actual_ref =
+        actual_block->references().begin();
+    for (; expected_ref != expected_block->references().end();
+         ++expected_ref, ++actual_ref) {
+      EXPECT_EQ(expected_ref->first, actual_ref->first);
+      EXPECT_EQ(expected_ref->second.type(), actual_ref->second.type());
+      EXPECT_EQ(expected_ref->second.size(), actual_ref->second.size());
+      EXPECT_EQ(expected_ref->second.offset(), actual_ref->second.offset());
+      EXPECT_EQ(expected_ref->second.base(), actual_ref->second.base());
+      EXPECT_EQ(expected_ref->second.referenced()->addr(),
+                actual_ref->second.referenced()->addr());
+    }
+  }
+}
+
 }  // namespace
 
 TEST_F(DecomposerTest, MutatorsAndAccessors) {
@@ -82,6 +152,10 @@ TEST_F(DecomposerTest, MutatorsAndAccessors) {
 
   decomposer.set_pdb_path(pdb_path);
   EXPECT_EQ(pdb_path, decomposer.pdb_path());
+
+  EXPECT_FALSE(decomposer.use_native_pdb());
+  decomposer.set_use_native_pdb(true);
+  EXPECT_TRUE(decomposer.use_native_pdb());
 }
 
 TEST_F(DecomposerTest, Decompose) {
@@ -513,6 +587,40 @@ TEST_F(DecomposerTest, LabelsAndAttributes) {
   EXPECT_EQ(1, label_attr_counts[BlockGraph::DEBUG_END_LABEL]);
 }
 
+TEST_F(DecomposerTest, NativePdbDecompositionMatchesDia) {
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer dia_decomposer(image_file);
+  BlockGraph dia_block_graph;
+  ImageLayout dia_image_layout(&dia_block_graph);
+  ASSERT_TRUE(dia_decomposer.Decompose(&dia_image_layout));
+
+  Decomposer native_decomposer(image_file);
+  native_decomposer.set_use_native_pdb(true);
+  BlockGraph native_block_graph;
+  ImageLayout native_image_layout(&native_block_graph);
+  ASSERT_TRUE(native_decomposer.Decompose(&native_image_layout));
+  EXPECT_EQ(dia_decomposer.pdb_path(), native_decomposer.pdb_path());
+
+  EXPECT_EQ(dia_block_graph.sections().size(),
+            native_block_graph.sections().size());
+  ASSERT_EQ(dia_image_layout.sections.size(),
+            native_image_layout.sections.size());
+  for (size_t i = 0; i < dia_image_layout.sections.size(); ++i) {
+    EXPECT_EQ(dia_image_layout.sections[i].name,
+              native_image_layout.sections[i].name);
+    EXPECT_EQ(dia_image_layout.sections[i].addr,
+              native_image_layout.sections[i].addr);
+    EXPECT_EQ(dia_image_layout.sections[i].size,
+              native_image_layout.sections[i].size);
+  }
+
+  ASSERT_NO_FATAL_FAILURE(
+      ExpectSameDecomposition(dia_image_layout, native_image_layout));
+}
+
 TEST_F(DecomposerTest, DecomposeTestDllMSVS2010) {
   base::FilePath dll_path = testing::GetSrcRelativePath(
       L"syzygy\\pe\\test_data\\test_dll_vs2010.dll");
@@ -659,6 +767,65 @@ class DecomposerAfterRelinkTest : public DecomposerTest {
                                             bgs));
   }
 
+  // Gets a copy of the block-graph stream of the relinked PDB, and the
+  // serialized data it contains.
+  void GetBlockGraphStream(scoped_refptr<pdb::PdbByteStream>* stream,
+                           std::vector<uint8_t>* serialized) {
+    DCHECK_NE(static_cast<scoped_refptr<pdb::PdbByteStream>*>(nullptr),
+              stream);
+    DCHECK_NE(static_cast<std::vector<uint8_t>*>(nullptr), serialized);
+
+    pdb::PdbFile pdb_file;
+    pdb::PdbReader pdb_reader;
+    ASSERT_TRUE(pdb_reader.Read(relinked_pdb_, &pdb_file));
+    scoped_refptr<pdb::PdbStream> block_graph_stream;
+    ASSERT_TRUE(pdb::LoadNamedStreamFromPdbFile(
+        pdb::kSyzygyBlockGraphStreamName, &pdb_file, &block_graph_stream));
+    ASSERT_TRUE(block_graph_stream.get() != nullptr);
+
+    *stream = new pdb::PdbByteStream();
+    ASSERT_TRUE((*stream)->Init(block_graph_stream.get()));
+
+    uint32_t stream_version = 0;
+    ASSERT_LE(sizeof(stream_version), (*stream)->length());
+    ::memcpy(&stream_version, (*stream)->data(), sizeof(stream_version));
+    ASSERT_EQ(pdb::kSyzygyBlockGraphStreamVersion, stream_version);
+    ASSERT_TRUE(core::DecompressChunks(
+        (*stream)->data() + sizeof(stream_version),
+        (*stream)->length() - sizeof(stream_version), 1, serialized));
+  }
+
+  // Creates a block-graph stream in the previous format, a single optionally
+  // zlib compressed stream.
+  void CreateVersion1Stream(const std::vector<uint8_t>& serialized,
+                            bool compressed,
+                            scoped_refptr<pdb::PdbByteStream>* stream) {
+    DCHECK_NE(static_cast<scoped_refptr<pdb::PdbByteStream>*>(nullptr),
+              stream);
+
+    std::vector<uint8_t> data;
+    core::ScopedOutStreamPtr out_stream(
+        core::CreateByteOutStream(std::back_inserter(data)));
+    ASSERT_TRUE(out_stream->Write(
+        sizeof(pdb::kSyzygyBlockGraphStreamVersion1),
+        reinterpret_cast<const core::Byte*>(
+            &pdb::kSyzygyBlockGraphStreamVersion1)));
+    unsigned char compressed_flag = compressed ? 1 : 0;
+    ASSERT_TRUE(out_stream->Write(sizeof(compressed_flag), &compressed_flag));
+
+    if (compressed) {
+      core::ZOutStream zip_stream(out_stream.get());
+      ASSERT_TRUE(zip_stream.Init(core::ZOutStream::kZBestCompression));
+      ASSERT_TRUE(zip_stream.Write(serialized.size(), serialized.data()));
+      ASSERT_TRUE(zip_stream.Flush());
+    } else {
+      ASSERT_TRUE(out_stream->Write(serialized.size(), serialized.data()));
+    }
+
+    *stream = new pdb::PdbByteStream();
+    ASSERT_TRUE((*stream)->Init(data.data(), data.size()));
+  }
+
   PETransformPolicy policy_;
   PERelinker relinker_;
   base::FilePath relinked_dll_;
@@ -675,6 +842,113 @@ TEST_F(DecomposerAfterRelinkTest, LoadRedecompositionDataCompressed) {
   ASSERT_NO_FATAL_FAILURE(LoadRedecompositionData(true));
 }
 
+TEST_F(DecomposerAfterRelinkTest, LoadBlockGraphFromVersion1Stream) {
+  ASSERT_NO_FATAL_FAILURE(Relink(true));
+
+  scoped_refptr<pdb::PdbByteStream> stream;
+  std::vector<uint8_t> serialized;
+  ASSERT_NO_FATAL_FAILURE(GetBlockGraphStream(&stream, &serialized));
+
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(relinked_dll_));
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(TestDecomposer::LoadBlockGraphFromPdbStream(
+      image_file, stream.get(), &image_layout));
+
+  // The streams in the previous format should still be readable, and yield
+  // the same block-graph.
+  for (bool compressed : {false, true}) {
+    scoped_refptr<pdb::PdbByteStream> version1_stream;
+    ASSERT_NO_FATAL_FAILURE(
+        CreateVersion1Stream(serialized, compressed, &version1_stream));
+
+    BlockGraph version1_block_graph;
+    ImageLayout version1_image_layout(&version1_block_graph);
+    ASSERT_TRUE(TestDecomposer::LoadBlockGraphFromPdbStream(
+        image_file, version1_stream.get(), &version1_image_layout));
+
+    block_graph::BlockGraphSerializer bgs;
+    EXPECT_TRUE(
+        ::testing::BlockGraphsEqual(block_graph, version1_block_graph, bgs));
+  }
+}
+
+// Measures the time it takes to compress and to load the block-graph stream,
+// and its size, in the previous format and with various chunked compression
+// settings. The serialization itself is the same in all cases, and isn't
+// included in the compression times. This is disabled by default; run with
+// --gtest_also_run_disabled_tests.
+TEST_F(DecomposerAfterRelinkTest, DISABLED_BenchmarkBlockGraphStream) {
+  ASSERT_NO_FATAL_FAILURE(Relink(true));
+
+  scoped_refptr<pdb::PdbByteStream> stream;
+  std::vector<uint8_t> serialized;
+  ASSERT_NO_FATAL_FAILURE(GetBlockGraphStream(&stream, &serialized));
+
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(relinked_dll_));
+
+  // Loads a stream and logs the results.
+  auto load_stream = [&image_file, &serialized](
+      const char* name, base::TimeDelta compression_time,
+      pdb::PdbByteStream* stream) {
+    BlockGraph block_graph;
+    ImageLayout image_layout(&block_graph);
+    base::TimeTicks start = base::TimeTicks::Now();
+    EXPECT_TRUE(TestDecomposer::LoadBlockGraphFromPdbStream(
+        image_file, stream, &image_layout));
+    base::TimeDelta load_time = base::TimeTicks::Now() - start;
+
+    LOG(INFO) << name << ": " << serialized.size() << " -> "
+              << stream->length() << " bytes, compressed in "
+              << compression_time.InMillisecondsF() << " ms, loaded in "
+              << load_time.InMillisecondsF() << " ms.";
+  };
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  scoped_refptr<pdb::PdbByteStream> version1_stream;
+  ASSERT_NO_FATAL_FAILURE(
+      CreateVersion1Stream(serialized, true, &version1_stream));
+  load_stream("Single zlib stream, level 9", base::TimeTicks::Now() - start,
+              version1_stream.get());
+
+  struct Settings {
+    const char* name;
+    core::ChunkedCompressionCodec codec;
+    int level;
+    bool parallel;
+  };
+  const Settings kSettings[] = {
+      {"Stored chunks", core::kStoreCodec, 0, true},
+      {"Serial zlib chunks, level 1", core::kZlibCodec, 1, false},
+      {"Parallel zlib chunks, level 1", core::kZlibCodec, 1, true},
+      {"Parallel zlib chunks, level 6", core::kZlibCodec, 6, true},
+      {"Serial zlib chunks, level 9", core::kZlibCodec, 9, false},
+      {"Parallel zlib chunks, level 9", core::kZlibCodec, 9, true},
+  };
+  for (const Settings& settings : kSettings) {
+    core::ChunkedCompressionOptions options;
+    options.codec = settings.codec;
+    options.level = settings.level;
+    if (!settings.parallel)
+      options.thread_count = 1;
+
+    start = base::TimeTicks::Now();
+    std::vector<uint8_t> data(sizeof(pdb::kSyzygyBlockGraphStreamVersion));
+    ::memcpy(data.data(), &pdb::kSyzygyBlockGraphStreamVersion, data.size());
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(core::CompressChunks(serialized.data(), serialized.size(),
+                                     options, &compressed));
+    data.insert(data.end(), compressed.begin(), compressed.end());
+    base::TimeDelta compression_time = base::TimeTicks::Now() - start;
+
+    scoped_refptr<pdb::PdbByteStream> chunked_stream = new pdb::PdbByteStream();
+    ASSERT_TRUE(chunked_stream->Init(data.data(), data.size()));
+    load_stream(settings.name, compression_time, chunked_stream.get());
+  }
+}
+
 TEST_F(DecomposerAfterRelinkTest, FailToLoadBlockGraphWithInvalidVersion) {
   ASSERT_NO_FATAL_FAILURE(Relink(true));
 
@@ -16,6 +16,9 @@
 
 #include "syzygy/pe/image_layout.h"
 
+#include <vector>
+
+#include "base/time/time.h"
 #include "gmock/gmock.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pe/decomposer.h"
@@ -39,6 +42,37 @@ bool SectionsAreEqual(const ImageLayout::SectionInfo& a,
       a.characteristics == b.characteristics;
 }
 
+// Looks up the block containing every byte of @p layout in @p address_space,
+// @p iterations times over, and logs the time this took.
+// @returns the number of successful lookups.
+template <typename AddressSpaceType>
+size_t BenchmarkLookups(const char* name,
+                        const BlockGraph::AddressSpace& layout,
+                        const AddressSpaceType& address_space,
+                        size_t iterations) {
+  typedef typename AddressSpaceType::Range Range;
+
+  size_t found = 0;
+  base::Time start = base::Time::NowFromSystemTime();
+  for (size_t i = 0; i < iterations; ++i) {
+    BlockGraph::AddressSpace::RangeMapConstIter it = layout.begin();
+    for (; it != layout.end(); ++it) {
+      RelativeAddress end = it->first.end();
+      for (RelativeAddress addr = it->first.start(); addr < end; addr += 1) {
+        if (address_space.FindContaining(Range(addr, 1)) !=
+            address_space.end()) {
+          ++found;
+        }
+      }
+    }
+  }
+  base::TimeDelta duration = base::Time::NowFromSystemTime() - start;
+
+  LOG(INFO) << name << " performed " << found << " lookups in "
+            << duration.InMillisecondsF() << " ms.";
+  return found;
+}
+
 }  // namespace
 
 TEST_F(ImageLayoutTest, BuildCanonicalImageLayout) {
@@ -112,4 +146,46 @@ TEST_F(ImageLayoutTest, CopyImageLayoutWithoutPadding) {
   }
 }
 
+// Compares lookups in the std::map and flat address space representations,
+// using the layout of a real decomposed image. This is disabled by default;
+// run with --gtest_also_run_disabled_tests.
+TEST_F(ImageLayoutTest, DISABLED_BenchmarkAddressSpaceLookups) {
+  const size_t kIterations = 10;
+
+  base::FilePath image_path(testing::GetExeRelativePath(testing::kTestDllName));
+  PEFile image_file;
+  ASSERT_TRUE(image_file.Init(image_path));
+
+  Decomposer decomposer(image_file);
+  BlockGraph block_graph;
+  ImageLayout image_layout(&block_graph);
+  ASSERT_TRUE(decomposer.Decompose(&image_layout));
+
+  typedef core::AddressSpace<RelativeAddress, BlockGraph::Size,
+                             BlockGraph::Block*> MapAddressSpace;
+  typedef core::FlatAddressSpace<RelativeAddress, BlockGraph::Size,
+                                 BlockGraph::Block*> FlatAddressSpace;
+
+  std::vector<std::pair<MapAddressSpace::Range, BlockGraph::Block*>> items;
+  BlockGraph::AddressSpace::RangeMapConstIter it = image_layout.blocks.begin();
+  for (; it != image_layout.blocks.end(); ++it)
+    items.push_back(std::make_pair(it->first, it->second));
+
+  MapAddressSpace map_address_space;
+  ASSERT_TRUE(map_address_space.BulkInsert(&items));
+  FlatAddressSpace flat_address_space;
+  ASSERT_TRUE(flat_address_space.BulkInsert(&items));
+
+  size_t map_found = BenchmarkLookups("std::map", image_layout.blocks,
+                                      map_address_space, kIterations);
+  size_t flat_found = BenchmarkLookups("Flat", image_layout.blocks,
+                                       flat_address_space, kIterations);
+  flat_address_space.Freeze();
+  size_t frozen_found = BenchmarkLookups("Frozen flat", image_layout.blocks,
+                                         flat_address_space, kIterations);
+
+  EXPECT_EQ(map_found, flat_found);
+  EXPECT_EQ(map_found, frozen_found);
+}
+
 }  // namespace pe
@@ -0,0 +1,966 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/native_pdb_reader.h"
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "base/bind.h"
+#include "base/containers/hash_tables.h"
+#include "base/strings/string16.h"
+#include "base/synchronization/lock.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "syzygy/common/binary_stream.h"
+#include "syzygy/pdb/pdb_constants.h"
+#include "syzygy/pdb/pdb_reader.h"
+#include "syzygy/pdb/pdb_symbol_record.h"
+#include "syzygy/pdb/pdb_type_info_stream_enum.h"
+#include "syzygy/pdb/gen/pdb_type_info_records.h"
+#include "syzygy/pe/cvinfo_ext.h"
+
+namespace pe {
+
+namespace {
+
+namespace cci = Microsoft_Cci_Pdb;
+
+typedef NativePdbReader::Symbol Symbol;
+
+// The maximum number of modifiers and enums that are looked through to get the
+// size of a type.
+const size_t kMaxTypeSizeRefs = 16;
+
+// Reads the fixed size part of a symbol, followed by its name.
+// @param reader the reader positioned at the start of the symbol.
+// @param symbol on success, returns the fixed size part of the symbol.
+// @param name on success, returns the name of the symbol.
+// @returns true on success, false otherwise.
+template <typename SymbolType>
+bool ReadNamedSymbol(common::BinaryStreamReader* reader,
+                     SymbolType* symbol,
+                     std::string* name) {
+  DCHECK_NE(static_cast<common::BinaryStreamReader*>(nullptr), reader);
+  DCHECK_NE(static_cast<SymbolType*>(nullptr), symbol);
+  DCHECK_NE(static_cast<std::string*>(nullptr), name);
+
+  common::BinaryStreamParser parser(reader);
+  if (!parser.ReadBytes(offsetof(SymbolType, name), symbol) ||
+      !parser.ReadString(name)) {
+    LOG(ERROR) << "Unable to read symbol.";
+    return false;
+  }
+  return true;
+}
+
+// Reads a symbol without a name.
+// @param reader the reader positioned at the start of the symbol.
+// @param symbol on success, returns the symbol.
+// @returns true on success, false otherwise.
+template <typename SymbolType>
+bool ReadSymbol(common::BinaryStreamReader* reader, SymbolType* symbol) {
+  DCHECK_NE(static_cast<common::BinaryStreamReader*>(nullptr), reader);
+  DCHECK_NE(static_cast<SymbolType*>(nullptr), symbol);
+
+  common::BinaryStreamParser parser(reader);
+  if (!parser.Read(symbol)) {
+    LOG(ERROR) << "Unable to read symbol.";
+    return false;
+  }
+  return true;
+}
+
+// Returns the size of a basic type, which includes pointers to basic types.
+size_t GetBasicTypeSize(uint32_t type_id) {
+  switch ((type_id & cci::CV_PRIMITIVE_TYPE::CV_MMASK) >>
+          cci::CV_PRIMITIVE_TYPE::CV_MSHIFT) {
+    case cci::CV_TM_NPTR32:
+      return 4;
+    case cci::CV_TM_NPTR64:
+      return 8;
+    case cci::CV_TM_NPTR128:
+      return 16;
+  }
+
+  switch (type_id) {
+#define SPECIAL_TYPE_SIZE(record_type, unused, size) \
+  case cci::record_type: return size;
+    SPECIAL_TYPE_NAME_CASE_TABLE(SPECIAL_TYPE_SIZE)
+#undef SPECIAL_TYPE_SIZE
+  }
+  return 0;
+}
+
+// Returns the size of a pointer type.
+size_t GetPointerSize(const pdb::LeafPointer& pointer) {
+  switch (pointer.attr().ptrtype) {
+    case cci::CV_PTR_NEAR32:
+      return 4;
+    case cci::CV_PTR_64:
+      return 8;
+  }
+  return 0;
+}
+
+// Returns the name that identifies a user defined type, for matching forward
+// declarations with their definition.
+template <typename LeafType>
+const base::string16& GetUserDefinedTypeKey(const LeafType& leaf) {
+  return leaf.has_decorated_name() ? leaf.decorated_name() : leaf.name();
+}
+
+}  // namespace
+
+// Parses the symbol streams of modules. This is run concurrently by a pool of
+// threads, each of them claiming modules until all of them are parsed.
+class NativePdbReader::ModuleParser
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param reader the reader whose modules to parse.
+  // @param infos the module infos of the DBI stream.
+  // @param streams the symbol streams of the modules, nullptr for the modules
+  //     without symbols.
+  ModuleParser(NativePdbReader* reader,
+               const pdb::DbiStream::DbiModuleVector& infos,
+               const std::vector<pdb::PdbStream*>& streams);
+
+  // Parses modules until all of them are claimed or a module fails to parse.
+  void Run() override;
+
+  // Stops the parsing.
+  void Abort();
+
+  // @returns true if all the modules were parsed successfully. This may only
+  //     be called once all the threads are done parsing.
+  bool Succeeded();
+
+ private:
+  // The kind of a symbol scope.
+  enum ScopeKind {
+    kFunctionScope,
+    kThunkScope,
+    kBlockScope,
+    // Scopes whose symbols DIA doesn't report to the decomposer, such as
+    // inline sites.
+    kOtherScope,
+  };
+
+  // The state of the parsing of a module.
+  struct ModuleState {
+    explicit ModuleState(Module* module)
+        : module(module), function_index(kNoFunction) {}
+
+    // The module being parsed.
+    Module* module;
+    // The scopes enclosing the current symbol, outermost first.
+    std::vector<ScopeKind> scopes;
+    // The index of the symbol of the current function in the symbols of
+    // the module, or kNoFunction.
+    size_t function_index;
+  };
+
+  static const size_t kNoFunction = static_cast<size_t>(-1);
+
+  // Claims the next module to parse.
+  // @param index on success, returns the index of the module.
+  // @returns false if there are no modules left to parse, or if the parsing
+  //     failed.
+  bool ClaimModule(size_t* index);
+
+  // Parses a module.
+  // @param index the index of the module.
+  // @returns true on success, false otherwise.
+  bool ParseModule(size_t index);
+
+  // Callback for VisitSymbols, parses a symbol of a module.
+  bool OnModuleSymbol(ModuleState* state,
+                      uint16_t symbol_length,
+                      uint16_t symbol_type,
+                      common::BinaryStreamReader* symbol_reader);
+
+  // @name Helpers for OnModuleSymbol.
+  // @{
+  // @returns true if the current symbol is in the scope of a function or
+  //     thunk, optionally nested in blocks.
+  static bool InFunction(const ModuleState& state);
+  // Appends a symbol to the module.
+  static Symbol* AddSymbol(ModuleState* state,
+                           Symbol::Kind kind,
+                           RelativeAddress addr);
+  // Handles a function or thunk symbol, and opens its scope.
+  bool OnFunctionOrThunk(ModuleState* state,
+                         Symbol::Kind kind,
+                         uint16_t section,
+                         uint32_t offset,
+                         size_t length,
+                         const std::string& name);
+  // Handles a block symbol, and opens its scope.
+  bool OnBlock(ModuleState* state,
+               uint16_t section,
+               uint32_t offset,
+               size_t length);
+  // Closes the innermost scope.
+  bool OnScopeEnd(ModuleState* state);
+  // @}
+
+  const NativePdbReader* reader_;
+  Modules* modules_;
+  const pdb::DbiStream::DbiModuleVector& infos_;
+  const std::vector<pdb::PdbStream*>& streams_;
+
+  // Protects the following members.
+  base::Lock lock_;
+  // The index of the first module not claimed yet.
+  size_t next_module_;
+  // Set when a module fails to parse, or when the parsing is aborted.
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ModuleParser);
+};
+
+NativePdbReader::ModuleParser::ModuleParser(
+    NativePdbReader* reader,
+    const pdb::DbiStream::DbiModuleVector& infos,
+    const std::vector<pdb::PdbStream*>& streams)
+    : reader_(reader),
+      modules_(&reader->modules_),
+      infos_(infos),
+      streams_(streams),
+      next_module_(0),
+      failed_(false) {
+  DCHECK_NE(static_cast<NativePdbReader*>(nullptr), reader);
+  DCHECK_EQ(infos.size(), modules_->size());
+  DCHECK_EQ(infos.size(), streams.size());
+}
+
+void NativePdbReader::ModuleParser::Run() {
+  size_t index = 0;
+  while (ClaimModule(&index)) {
+    if (!ParseModule(index)) {
+      LOG(ERROR) << "Unable to parse the symbols of module \""
+                 << infos_[index].module_name() << "\".";
+      Abort();
+    }
+  }
+}
+
+void NativePdbReader::ModuleParser::Abort() {
+  base::AutoLock auto_lock(lock_);
+  failed_ = true;
+}
+
+bool NativePdbReader::ModuleParser::Succeeded() {
+  base::AutoLock auto_lock(lock_);
+  return !failed_ && next_module_ == modules_->size();
+}
+
+bool NativePdbReader::ModuleParser::ClaimModule(size_t* index) {
+  DCHECK_NE(static_cast<size_t*>(nullptr), index);
+
+  base::AutoLock auto_lock(lock_);
+  if (failed_ || next_module_ == modules_->size())
+    return false;
+
+  *index = next_module_++;
+  return true;
+}
+
+bool NativePdbReader::ModuleParser::ParseModule(size_t index) {
+  pdb::PdbStream* stream = streams_[index];
+  if (stream == nullptr)
+    return true;
+
+  ModuleState state(&modules_->at(index));
+  pdb::VisitSymbolsCallback callback =
+      base::Bind(&ModuleParser::OnModuleSymbol, base::Unretained(this),
+                 base::Unretained(&state));
+  if (!pdb::VisitSymbols(callback, 0,
+                         infos_[index].module_info_base().symbol_bytes, true,
+                         stream)) {
+    return false;
+  }
+
+  if (!state.scopes.empty()) {
+    LOG(ERROR) << "Symbol stream ends within a scope.";
+    return false;
+  }
+
+  return true;
+}
+
+bool NativePdbReader::ModuleParser::OnModuleSymbol(
+    ModuleState* state,
+    uint16_t symbol_length,
+    uint16_t symbol_type,
+    common::BinaryStreamReader* symbol_reader) {
+  DCHECK_NE(static_cast<ModuleState*>(nullptr), state);
+  DCHECK_NE(static_cast<common::BinaryStreamReader*>(nullptr), symbol_reader);
+
+  switch (symbol_type) {
+    case cci::S_GPROC32:
+    case cci::S_LPROC32:
+    case cci::S_GPROC32_VS2013:
+    case cci::S_LPROC32_VS2013: {
+      cci::ProcSym32 proc = {};
+      std::string name;
+      if (!ReadNamedSymbol(symbol_reader, &proc, &name))
+        return false;
+      bool top_level = state->scopes.empty();
+      if (!OnFunctionOrThunk(state, Symbol::kFunction, proc.seg, proc.off,
+                             proc.len, name)) {
+        return false;
+      }
+      if (!top_level)
+        return true;
+
+      Symbol* function = &state->module->symbols[state->function_index];
+      if ((proc.flags & cci::CV_PFLAG_NEVER) != 0)
+        function->flags |= Symbol::kNoReturn;
+      RelativeAddress addr = function->addr;
+      AddSymbol(state, Symbol::kFuncDebugStart, addr + proc.dbgStart);
+      AddSymbol(state, Symbol::kFuncDebugEnd, addr + proc.dbgEnd);
+      return true;
+    }
+
+    case cci::S_THUNK32: {
+      cci::ThunkSym32 thunk = {};
+      std::string name;
+      if (!ReadNamedSymbol(symbol_reader, &thunk, &name))
+        return false;
+      return OnFunctionOrThunk(state, Symbol::kThunk, thunk.seg, thunk.off,
+                               thunk.len, name);
+    }
+
+    case cci::S_BLOCK32: {
+      cci::BlockSym32 block = {};
+      std::string name;
+      if (!ReadNamedSymbol(symbol_reader, &block, &name))
+        return false;
+      return OnBlock(state, block.seg, block.off, block.len);
+    }
+
+    case cci::S_SEPCODE: {
+      // Separated code blocks hold the parts of a function that were moved
+      // away from it, and are reported as blocks by DIA.
+      cci::SepCodSym sepcode = {};
+      if (!ReadSymbol(symbol_reader, &sepcode))
+        return false;
+      return OnBlock(state, sepcode.sec, sepcode.off, sepcode.length);
+    }
+
+    case cci::S_WITH32:
+    case cci::S_GMANPROC:
+    case cci::S_LMANPROC:
+    case cci::S_INLINESITE: {
+      state->scopes.push_back(kOtherScope);
+      return true;
+    }
+
+    case cci::S_END:
+    case cci::S_PROC_ID_END:
+    case cci::S_INLINESITE_END: {
+      return OnScopeEnd(state);
+    }
+
+    case cci::S_FRAMEPROC: {
+      if (state->scopes.size() != 1 || state->scopes[0] != kFunctionScope ||
+          state->function_index == kNoFunction) {
+        return true;
+      }
+      cci::FrameProcSym frame_proc = {};
+      if (!ReadSymbol(symbol_reader, &frame_proc))
+        return false;
+      Symbol* function = &state->module->symbols[state->function_index];
+      if ((frame_proc.flags & cci::fHasInlAsm) != 0)
+        function->flags |= Symbol::kHasInlineAssembly;
+      if ((frame_proc.flags & (cci::fHasEH | cci::fHasSEH)) != 0)
+        function->flags |= Symbol::kHasExceptionHandling;
+      return true;
+    }
+
+    case cci::S_LABEL32: {
+      if (!state->scopes.empty() && !InFunction(*state))
+        return true;
+      cci::LabelSym32 label = {};
+      std::string name;
+      if (!ReadNamedSymbol(symbol_reader, &label, &name))
+        return false;
+      RelativeAddress addr;
+      if (!reader_->GetAddress(label.seg, label.off, &addr))
+        return false;
+      AddSymbol(state, Symbol::kLabel, addr)->name = name;
+      return true;
+    }
+
+    case cci::S_LDATA32:
+    case cci::S_GDATA32: {
+      if (!state->scopes.empty() && !InFunction(*state))
+        return true;
+      cci::DatasSym32 data = {};
+      std::string name;
+      if (!ReadNamedSymbol(symbol_reader, &data, &name))
+        return false;
+      // Data that was optimized away has no address.
+      if (data.seg == 0)
+        return true;
+      RelativeAddress addr;
+      if (!reader_->GetAddress(data.seg, data.off, &addr))
+        return false;
+      Symbol* symbol = AddSymbol(state, Symbol::kData, addr);
+      symbol->type_id = data.typind;
+      symbol->name = name;
+      return true;
+    }
+
+    case cci::S_CALLSITEINFO: {
+      if (!InFunction(*state))
+        return true;
+      cci::CallsiteInfo call_site = {};
+      if (!ReadSymbol(symbol_reader, &call_site))
+        return false;
+      RelativeAddress addr;
+      if (!reader_->GetAddress(call_site.ect, call_site.off, &addr))
+        return false;
+      AddSymbol(state, Symbol::kCallSite, addr);
+      return true;
+    }
+
+    case cci::S_COMPILE2: {
+      // The first compile symbol of a module names its compiler.
+      if (!state->module->compiler_name.empty())
+        return true;
+      cci::CompileSym compile = {};
+      common::BinaryStreamParser parser(symbol_reader);
+      if (!parser.ReadBytes(offsetof(cci::CompileSym, verSt), &compile) ||
+          !parser.ReadString(&state->module->compiler_name)) {
+        LOG(ERROR) << "Unable to read compile symbol.";
+        return false;
+      }
+      return true;
+    }
+
+    case cci::S_COMPILE3: {
+      if (!state->module->compiler_name.empty())
+        return true;
+      CompileSym2 compile = {};
+      common::BinaryStreamParser parser(symbol_reader);
+      if (!parser.ReadBytes(offsetof(CompileSym2, verSt), &compile) ||
+          !parser.ReadString(&state->module->compiler_name)) {
+        LOG(ERROR) << "Unable to read compile symbol.";
+        return false;
+      }
+      return true;
+    }
+
+    default:
+      return true;
+  }
+}
+
+bool NativePdbReader::ModuleParser::InFunction(const ModuleState& state) {
+  if (state.scopes.empty())
+    return false;
+  if (state.scopes[0] != kFunctionScope && state.scopes[0] != kThunkScope)
+    return false;
+  for (size_t i = 1; i < state.scopes.size(); ++i) {
+    if (state.scopes[i] != kBlockScope)
+      return false;
+  }
+  return true;
+}
+
+Symbol* NativePdbReader::ModuleParser::AddSymbol(ModuleState* state,
+                                                 Symbol::Kind kind,
+                                                 RelativeAddress addr) {
+  DCHECK_NE(static_cast<ModuleState*>(nullptr), state);
+
+  state->module->symbols.push_back(Symbol());
+  Symbol* symbol = &state->module->symbols.back();
+  symbol->kind = kind;
+  symbol->flags = 0;
+  symbol->addr = addr;
+  symbol->length = 0;
+  symbol->type_id = 0;
+  return symbol;
+}
+
+bool NativePdbReader::ModuleParser::OnFunctionOrThunk(ModuleState* state,
+                                                      Symbol::Kind kind,
+                                                      uint16_t section,
+                                                      uint32_t offset,
+                                                      size_t length,
+                                                      const std::string& name) {
+  DCHECK_NE(static_cast<ModuleState*>(nullptr), state);
+  DCHECK(kind == Symbol::kFunction || kind == Symbol::kThunk);
+
+  // DIA only reports the functions at the top level of modules to the
+  // decomposer.
+  if (!state->scopes.empty()) {
+    state->scopes.push_back(kOtherScope);
+    return true;
+  }
+
+  RelativeAddress addr;
+  if (!reader_->GetAddress(section, offset, &addr))
+    return false;
+
+  state->function_index = state->module->symbols.size();
+  Symbol* symbol = AddSymbol(state, kind, addr);
+  symbol->length = length;
+  symbol->name = name;
+  state->scopes.push_back(kind == Symbol::kFunction ? kFunctionScope
+                                                    : kThunkScope);
+  return true;
+}
+
+bool NativePdbReader::ModuleParser::OnBlock(ModuleState* state,
+                                            uint16_t section,
+                                            uint32_t offset,
+                                            size_t length) {
+  DCHECK_NE(static_cast<ModuleState*>(nullptr), state);
+
+  if (!InFunction(*state)) {
+    state->scopes.push_back(kOtherScope);
+    return true;
+  }
+
+  RelativeAddress addr;
+  if (!reader_->GetAddress(section, offset, &addr))
+    return false;
+
+  Symbol* symbol = AddSymbol(state, Symbol::kBlock, addr);
+  symbol->length = length;
+  if (state->scopes.size() == 1 && state->scopes[0] == kFunctionScope)
+    symbol->flags |= Symbol::kIsFunctionChild;
+  state->scopes.push_back(kBlockScope);
+  return true;
+}
+
+bool NativePdbReader::ModuleParser::OnScopeEnd(ModuleState* state) {
+  DCHECK_NE(static_cast<ModuleState*>(nullptr), state);
+
+  if (state->scopes.empty()) {
+    LOG(ERROR) << "Encountered the end of a scope that wasn't opened.";
+    return false;
+  }
+
+  ScopeKind kind = state->scopes.back();
+  state->scopes.pop_back();
+  if (state->scopes.empty() &&
+      (kind == kFunctionScope || kind == kThunkScope)) {
+    AddSymbol(state, Symbol::kFunctionEnd, RelativeAddress(0));
+    state->function_index = kNoFunction;
+  }
+
+  return true;
+}
+
+NativePdbReader::NativePdbReader()
+    : type_id_min_(pdb::kTpiStreamFirstUserTypeIndex),
+      thread_count_(base::SysInfo::NumberOfProcessors()) {
+}
+
+bool NativePdbReader::Read(const base::FilePath& pdb_path) {
+  DCHECK(modules_.empty());
+
+  // The PDB is mapped, such that its streams can be read concurrently.
+  pdb::PdbMappedReader pdb_reader;
+  if (!pdb_reader.Read(pdb_path, &pdb_file_)) {
+    LOG(ERROR) << "Unable to read PDB file: " << pdb_path.value();
+    return false;
+  }
+
+  scoped_refptr<pdb::PdbStream> stream = pdb_file_.GetStream(pdb::kDbiStream);
+  if (stream.get() == nullptr) {
+    LOG(ERROR) << "PDB does not contain a DBI stream.";
+    return false;
+  }
+  pdb::DbiStream dbi_stream;
+  if (!dbi_stream.Read(stream.get())) {
+    LOG(ERROR) << "Unable to parse DBI stream.";
+    return false;
+  }
+
+  if (!ReadSectionHeaders(dbi_stream.dbg_header()) ||
+      !ReadSectionContribs(dbi_stream) ||
+      !ReadFixups(dbi_stream.dbg_header()) ||
+      !ReadGlobalSymbols(dbi_stream.header()) ||
+      !ReadModules(dbi_stream)) {
+    return false;
+  }
+
+  return true;
+}
+
+bool NativePdbReader::GetTypeSize(uint32_t type_id, size_t* size) const {
+  DCHECK_NE(static_cast<size_t*>(nullptr), size);
+
+  for (size_t i = 0; i < kMaxTypeSizeRefs; ++i) {
+    if (type_id < type_id_min_) {
+      *size = GetBasicTypeSize(type_id);
+      return true;
+    }
+
+    size_t index = type_id - type_id_min_;
+    if (index >= type_sizes_.size()) {
+      LOG(ERROR) << "Type " << type_id << " does not exist.";
+      return false;
+    }
+
+    const TypeSize& type_size = type_sizes_[index];
+    if (type_size.ref_type_id == 0) {
+      *size = static_cast<size_t>(type_size.size);
+      return true;
+    }
+    type_id = type_size.ref_type_id;
+  }
+
+  LOG(ERROR) << "Too many indirections in the size of type "
+             << type_id << ".";
+  return false;
+}
+
+bool NativePdbReader::ReadSectionHeaders(const pdb::DbiDbgHeader& dbg_header) {
+  // If the image was transformed, the symbols refer to the sections of the
+  // original image and their addresses are mapped through OMAP data.
+  int16_t stream_index = dbg_header.section_header;
+  if (dbg_header.omap_from_src >= 0) {
+    if (!pdb::ReadOmapsFromPdbFile(pdb_file_, nullptr, &omap_from_)) {
+      LOG(ERROR) << "Unable to read the OMAP data.";
+      return false;
+    }
+    stream_index = dbg_header.section_header_origin;
+  }
+
+  scoped_refptr<pdb::PdbStream> stream;
+  if (stream_index >= 0)
+    stream = pdb_file_.GetStream(stream_index);
+  if (stream.get() == nullptr) {
+    LOG(ERROR) << "PDB does not contain a section header stream.";
+    return false;
+  }
+
+  size_t count = stream->length() / sizeof(IMAGE_SECTION_HEADER);
+  section_headers_.resize(count);
+  if (count != 0 &&
+      !stream->ReadBytesAt(0, count * sizeof(IMAGE_SECTION_HEADER),
+                           section_headers_.data())) {
+    LOG(ERROR) << "Unable to read the section header stream.";
+    return false;
+  }
+
+  return true;
+}
+
+bool NativePdbReader::ReadSectionContribs(const pdb::DbiStream& dbi_stream) {
+  const pdb::DbiStream::DbiSectionContribVector& contribs =
+      dbi_stream.section_contribs();
+  section_contribs_.reserve(contribs.size());
+  for (const pdb::DbiSectionContrib& contrib : contribs) {
+    if (contrib.module < 0 ||
+        static_cast<size_t>(contrib.module) >= dbi_stream.modules().size()) {
+      LOG(ERROR) << "Section contribution has an invalid module.";
+      return false;
+    }
+
+    SectionContrib section_contrib = {};
+    if (contrib.section <= 0 ||
+        !GetAddress(contrib.section, contrib.offset, &section_contrib.addr)) {
+      LOG(ERROR) << "Section contribution has an invalid section.";
+      return false;
+    }
+    section_contrib.size = contrib.size;
+    section_contrib.section = contrib.section - 1;
+    section_contrib.code = (contrib.flags & IMAGE_SCN_CNT_CODE) != 0;
+    section_contrib.module = contrib.module;
+    section_contribs_.push_back(section_contrib);
+  }
+
+  return true;
+}
+
+bool NativePdbReader::ReadFixups(const pdb::DbiDbgHeader& dbg_header) {
+  scoped_refptr<pdb::PdbStream> stream;
+  if (dbg_header.fixup >= 0)
+    stream = pdb_file_.GetStream(dbg_header.fixup);
+  if (stream.get() == nullptr) {
+    LOG(ERROR) << "PDB file does not contain a FIXUP stream. Module must be "
+                  "linked with '/PROFILE' or '/DEBUGINFO:FIXUP' flag.";
+    return false;
+  }
+
+  if (stream->length() % sizeof(pdb::PdbFixup) != 0) {
+    LOG(ERROR) << "FIXUP stream has an invalid length.";
+    return false;
+  }
+  fixups_.resize(stream->length() / sizeof(pdb::PdbFixup));
+  if (!fixups_.empty() &&
+      !stream->ReadBytesAt(0, stream->length(), fixups_.data())) {
+    LOG(ERROR) << "Unable to read the FIXUP stream.";
+    return false;
+  }
+
+  return true;
+}
+
+bool NativePdbReader::ReadGlobalSymbols(const pdb::DbiHeader& dbi_header) {
+  // Not all PDBs have a symbol record stream.
+  if (dbi_header.symbol_record_stream < 0)
+    return true;
+  scoped_refptr<pdb::PdbStream> stream =
+      pdb_file_.GetStream(dbi_header.symbol_record_stream);
+  if (stream.get() == nullptr) {
+    LOG(ERROR) << "Unable to open the symbol record stream.";
+    return false;
+  }
+
+  pdb::VisitSymbolsCallback callback = base::Bind(
+      &NativePdbReader::OnGlobalSymbol, base::Unretained(this));
+  if (!pdb::VisitSymbols(callback, 0, stream->length(), false, stream.get())) {
+    LOG(ERROR) << "Unable to parse the symbol record stream.";
+    return false;
+  }
+
+  return true;
+}
+
+bool NativePdbReader::OnGlobalSymbol(
+    uint16_t symbol_length,
+    uint16_t symbol_type,
+    common::BinaryStreamReader* symbol_reader) {
+  DCHECK_NE(static_cast<common::BinaryStreamReader*>(nullptr), symbol_reader);
+
+  Symbols* symbols = nullptr;
+  Symbol symbol = {};
+  uint16_t section = 0;
+  uint32_t offset = 0;
+  switch (symbol_type) {
+    case cci::S_PUB32: {
+      cci::PubSym32 pub = {};
+      if (!ReadNamedSymbol(symbol_reader, &pub, &symbol.name))
+        return false;
+      symbols = &public_symbols_;
+      symbol.kind = Symbol::kPublic;
+      section = pub.seg;
+      offset = pub.off;
+      break;
+    }
+
+    case cci::S_LDATA32:
+    case cci::S_GDATA32: {
+      cci::DatasSym32 data = {};
+      if (!ReadNamedSymbol(symbol_reader, &data, &symbol.name))
+        return false;
+      symbols = &global_symbols_;
+      symbol.kind = Symbol::kData;
+      symbol.type_id = data.typind;
+      section = data.seg;
+      offset = data.off;
+      break;
+    }
+
+    default:
+      return true;
+  }
+
+  // Absolute symbols and data that was optimized away have no address.
+  if (section == 0)
+    return true;
+  if (!GetAddress(section, offset, &symbol.addr))
+    return false;
+  symbols->push_back(symbol);
+  return true;
+}
+
+bool NativePdbReader::ReadModules(const pdb::DbiStream& dbi_stream) {
+  const pdb::DbiStream::DbiModuleVector& infos = dbi_stream.modules();
+  modules_.resize(infos.size());
+
+  // The streams are retrieved up front, as their reference counts can't be
+  // manipulated concurrently.
+  std::vector<scoped_refptr<pdb::PdbStream>> stream_refs(infos.size());
+  std::vector<pdb::PdbStream*> streams(infos.size());
+  for (size_t i = 0; i < infos.size(); ++i) {
+    modules_[i].name = infos[i].module_name();
+
+    const pdb::DbiModuleInfoBase& info = infos[i].module_info_base();
+    if (info.stream < 0 || info.symbol_bytes == 0)
+      continue;
+    stream_refs[i] = pdb_file_.GetStream(info.stream);
+    if (stream_refs[i].get() == nullptr) {
+      LOG(ERROR) << "Unable to open the symbol stream of module \""
+                 << infos[i].module_name() << "\".";
+      return false;
+    }
+    streams[i] = stream_refs[i].get();
+  }
+
+  // The workers parse the modules while the calling thread reads the type
+  // sizes, after which it joins them.
+  ModuleParser parser(this, infos, streams);
+  size_t worker_count = std::min(thread_count_ - 1, modules_.size());
+  std::unique_ptr<base::DelegateSimpleThreadPool> pool;
+  if (worker_count != 0) {
+    pool.reset(new base::DelegateSimpleThreadPool(
+        "NativePdbReader", static_cast<int>(worker_count)));
+    pool->Start();
+    pool->AddWork(&parser, static_cast<int>(worker_count));
+  }
+
+  bool types_read = ReadTypeSizes();
+  if (!types_read)
+    parser.Abort();
+  parser.Run();
+  if (pool.get() != nullptr)
+    pool->JoinAll();
+
+  return types_read && parser.Succeeded();
+}
+
+bool NativePdbReader::ReadTypeSizes() {
+  scoped_refptr<pdb::PdbStream> stream = pdb_file_.GetStream(pdb::kTpiStream);
+  if (stream.get() == nullptr) {
+    LOG(ERROR) << "PDB does not contain a type info stream.";
+    return false;
+  }
+
+  pdb::TypeInfoEnumerator type_info_enum(stream.get());
+  if (!type_info_enum.Init()) {
+    LOG(ERROR) << "Unable to read the type info stream header.";
+    return false;
+  }
+  type_id_min_ = type_info_enum.type_info_header().type_min;
+
+  // The sizes of the defined user defined types, by name.
+  base::hash_map<base::string16, uint64_t> defined_sizes;
+  // The forward declarations, by index.
+  std::vector<std::pair<size_t, base::string16>> forward_declarations;
+
+  while (!type_info_enum.EndOfStream()) {
+    if (!type_info_enum.NextTypeInfoRecord()) {
+      LOG(ERROR) << "Unable to read type info record.";
+      return false;
+    }
+    DCHECK_EQ(type_id_min_ + type_sizes_.size(), type_info_enum.type_id());
+
+    pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
+        type_info_enum.CreateRecordReader());
+    common::BinaryStreamParser parser(&reader);
+    TypeSize type_size = {};
+    bool valid = true;
+    switch (type_info_enum.type()) {
+      case cci::LF_CLASS:
+      case cci::LF_STRUCTURE: {
+        pdb::LeafClass leaf;
+        valid = leaf.Initialize(&parser);
+        if (!valid)
+          break;
+        if (leaf.property().fwdref) {
+          forward_declarations.push_back(
+              std::make_pair(type_sizes_.size(), GetUserDefinedTypeKey(leaf)));
+        } else {
+          type_size.size = leaf.size();
+          defined_sizes[GetUserDefinedTypeKey(leaf)] = leaf.size();
+        }
+        break;
+      }
+
+      case cci::LF_UNION: {
+        pdb::LeafUnion leaf;
+        valid = leaf.Initialize(&parser);
+        if (!valid)
+          break;
+        if (leaf.property().fwdref) {
+          forward_declarations.push_back(
+              std::make_pair(type_sizes_.size(), GetUserDefinedTypeKey(leaf)));
+        } else {
+          type_size.size = leaf.size();
+          defined_sizes[GetUserDefinedTypeKey(leaf)] = leaf.size();
+        }
+        break;
+      }
+
+      case cci::LF_ENUM: {
+        pdb::LeafEnum leaf;
+        valid = leaf.Initialize(&parser);
+        type_size.ref_type_id = leaf.body().utype;
+        break;
+      }
+
+      case cci::LF_MODIFIER: {
+        pdb::LeafModifier leaf;
+        valid = leaf.Initialize(&parser);
+        type_size.ref_type_id = leaf.body().type;
+        break;
+      }
+
+      case cci::LF_POINTER: {
+        pdb::LeafPointer leaf;
+        valid = leaf.Initialize(&parser);
+        type_size.size = GetPointerSize(leaf);
+        break;
+      }
+
+      case cci::LF_ARRAY: {
+        pdb::LeafArray leaf;
+        valid = leaf.Initialize(&parser);
+        type_size.size = leaf.size();
+        break;
+      }
+
+      default:
+        // The other types either have no size, or are never the type of data.
+        break;
+    }
+
+    if (!valid) {
+      LOG(ERROR) << "Unable to parse type info record "
+                 << type_info_enum.type_id() << ".";
+      return false;
+    }
+    type_sizes_.push_back(type_size);
+  }
+
+  // Forward declarations have the size of the type they declare. They are left
+  // with a size of zero if it's not defined in the PDB.
+  for (const auto& forward_declaration : forward_declarations) {
+    auto it = defined_sizes.find(forward_declaration.second);
+    if (it != defined_sizes.end())
+      type_sizes_[forward_declaration.first].size = it->second;
+  }
+
+  return true;
+}
+
+bool NativePdbReader::GetAddress(uint16_t section,
+                                 uint32_t offset,
+                                 RelativeAddress* addr) const {
+  DCHECK_NE(static_cast<RelativeAddress*>(nullptr), addr);
+
+  if (section == 0 || section > section_headers_.size()) {
+    LOG(ERROR) << "Invalid section " << section << " in symbol address.";
+    return false;
+  }
+
+  *addr = RelativeAddress(section_headers_[section - 1].VirtualAddress +
+                          offset);
+  if (!omap_from_.empty())
+    *addr = pdb::TranslateAddressViaOmap(omap_from_, *addr);
+  return true;
+}
+
+}  // namespace pe
@@ -0,0 +1,219 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares NativePdbReader, which extracts what the decomposer needs from a
+// PDB file by parsing its streams directly rather than going through DIA. The
+// symbol streams of the modules are parsed concurrently, and the symbols are
+// reduced to the handful of kinds the decomposer turns into labels. These are
+// the symbols that DIA would report for the same PDB, with the addresses
+// already translated to relative addresses in the image.
+
+#ifndef SYZYGY_PE_NATIVE_PDB_READER_H_
+#define SYZYGY_PE_NATIVE_PDB_READER_H_
+
+#include <windows.h>  // NOLINT
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/logging.h"
+#include "syzygy/common/binary_stream.h"
+#include "syzygy/core/address.h"
+#include "syzygy/pdb/omap.h"
+#include "syzygy/pdb/pdb_data.h"
+#include "syzygy/pdb/pdb_dbi_stream.h"
+#include "syzygy/pdb/pdb_file.h"
+
+namespace pe {
+
+class NativePdbReader {
+ public:
+  typedef core::RelativeAddress RelativeAddress;
+
+  // A section contribution, the chunk of a section contributed by a module.
+  struct SectionContrib {
+    RelativeAddress addr;
+    size_t size;
+    // The index of the section, starting at zero.
+    size_t section;
+    // True if this is code.
+    bool code;
+    // The index of the contributing module.
+    size_t module;
+  };
+  typedef std::vector<SectionContrib> SectionContribs;
+
+  // A symbol, as it would be reported by DIA.
+  struct Symbol {
+    enum Kind {
+      // A function. Until the following kFunctionEnd, the symbols are those
+      // found in the scope of the function.
+      kFunction,
+      // A thunk. These are scoped like functions.
+      kThunk,
+      // Ends the scope of the last kFunction or kThunk.
+      kFunctionEnd,
+      // A lexical block or a separated code block within a function, possibly
+      // nested in other blocks.
+      kBlock,
+      // The debug start and end locations of a function.
+      kFuncDebugStart,
+      kFuncDebugEnd,
+      // A code label.
+      kLabel,
+      // A datum with static storage.
+      kData,
+      // An indirect call site.
+      kCallSite,
+      // A public symbol. These are only found in the global symbols.
+      kPublic,
+    };
+
+    // @name Flags.
+    // @{
+    // Set on functions that don't return.
+    static const uint32_t kNoReturn = 1 << 0;
+    // Set on functions containing inline assembly.
+    static const uint32_t kHasInlineAssembly = 1 << 1;
+    // Set on functions with C++ exception handling or SEH.
+    static const uint32_t kHasExceptionHandling = 1 << 2;
+    // Set on kBlock symbols that are immediately nested in a function.
+    static const uint32_t kIsFunctionChild = 1 << 3;
+    // @}
+
+    Kind kind;
+    uint32_t flags;
+    RelativeAddress addr;
+    // The length of functions, thunks and blocks.
+    size_t length;
+    // The type of data.
+    uint32_t type_id;
+    std::string name;
+  };
+  typedef std::vector<Symbol> Symbols;
+
+  // A module, also known as a compiland.
+  struct Module {
+    // The name of the module, usually the path of the object file.
+    std::string name;
+    // The name of the compiler that built the module, from its compile
+    // symbol. Empty if the module has no such symbol.
+    std::string compiler_name;
+    // The symbols of the module, in the order of its symbol stream.
+    Symbols symbols;
+  };
+  typedef std::vector<Module> Modules;
+
+  NativePdbReader();
+
+  // Reads a PDB file. This may only be called once.
+  // @param pdb_path the PDB file to read.
+  // @returns true on success, false otherwise.
+  bool Read(const base::FilePath& pdb_path);
+
+  // Gets the size of a type, as DIA would report it. Forward declarations are
+  // resolved to the type they declare, if it's defined in the PDB.
+  // @param type_id the type.
+  // @param size on success, returns the size of the type. This is zero for
+  //     types without a size, such as void or function types.
+  // @returns true on success, false if the type doesn't exist.
+  bool GetTypeSize(uint32_t type_id, size_t* size) const;
+
+  // @name Accessors.
+  // @{
+  const SectionContribs& section_contribs() const { return section_contribs_; }
+  const Modules& modules() const { return modules_; }
+  // The data symbols found in the global symbol stream. These are reported by
+  // DIA in the global scope rather than in the scope of a module.
+  const Symbols& global_symbols() const { return global_symbols_; }
+  // The public symbols.
+  const Symbols& public_symbols() const { return public_symbols_; }
+  const std::vector<pdb::PdbFixup>& fixups() const { return fixups_; }
+  // The OMAP data mapping the original image to the image, empty if the image
+  // wasn't transformed.
+  const std::vector<OMAP>& omap_from() const { return omap_from_; }
+  // @}
+
+  // @name Configuration. This must be set before calling Read.
+  // @{
+  // The number of threads used to parse the symbol streams of the modules,
+  // including the calling thread. Defaults to the number of processors.
+  size_t thread_count() const { return thread_count_; }
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0U, thread_count);
+    thread_count_ = thread_count;
+  }
+  // @}
+
+ private:
+  class ModuleParser;
+
+  // The size of a type record, or a reference to the type determining it.
+  struct TypeSize {
+    // The type whose size this type has, or zero.
+    uint32_t ref_type_id;
+    uint64_t size;
+  };
+
+  // @name Steps of Read, in order.
+  // @{
+  bool ReadSectionHeaders(const pdb::DbiDbgHeader& dbg_header);
+  bool ReadSectionContribs(const pdb::DbiStream& dbi_stream);
+  bool ReadFixups(const pdb::DbiDbgHeader& dbg_header);
+  bool ReadGlobalSymbols(const pdb::DbiHeader& dbi_header);
+  bool ReadModules(const pdb::DbiStream& dbi_stream);
+  bool ReadTypeSizes();
+  // @}
+
+  // Callback for VisitSymbols, collects the global and public symbols.
+  bool OnGlobalSymbol(uint16_t symbol_length,
+                      uint16_t symbol_type,
+                      common::BinaryStreamReader* symbol_reader);
+
+  // Translates the address of a symbol to a relative address in the image.
+  // @param section the section of the symbol, starting at one.
+  // @param offset the offset of the symbol in @p section.
+  // @param addr on success, returns the address.
+  // @returns true on success, false if @p section is invalid.
+  bool GetAddress(uint16_t section, uint32_t offset,
+                  RelativeAddress* addr) const;
+
+  // The PDB file being read.
+  pdb::PdbFile pdb_file_;
+
+  // The headers of the sections the symbols refer to. If the image was
+  // transformed these are the headers of the original image, and the
+  // addresses are translated through omap_from_.
+  std::vector<IMAGE_SECTION_HEADER> section_headers_;
+  std::vector<OMAP> omap_from_;
+
+  SectionContribs section_contribs_;
+  Modules modules_;
+  Symbols global_symbols_;
+  Symbols public_symbols_;
+  std::vector<pdb::PdbFixup> fixups_;
+
+  // The sizes of the types, indexed by type id less type_id_min_.
+  std::vector<TypeSize> type_sizes_;
+  uint32_t type_id_min_;
+
+  size_t thread_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(NativePdbReader);
+};
+
+}  // namespace pe
+
+#endif  // SYZYGY_PE_NATIVE_PDB_READER_H_
@@ -0,0 +1,167 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/pe/native_pdb_reader.h"
+
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/pe/cvinfo_ext.h"
+#include "syzygy/pe/unittest_util.h"
+
+namespace pe {
+
+namespace {
+
+namespace cci = Microsoft_Cci_Pdb;
+
+typedef NativePdbReader::Symbol Symbol;
+
+class NativePdbReaderTest : public testing::PELibUnitTest {
+ public:
+  void SetUp() override {
+    testing::PELibUnitTest::SetUp();
+    pdb_path_ = testing::GetExeRelativePath(testing::kTestDllPdbName);
+  }
+
+  base::FilePath pdb_path_;
+};
+
+}  // namespace
+
+TEST_F(NativePdbReaderTest, ReadFailsWithNonexistentPdb) {
+  NativePdbReader reader;
+  EXPECT_FALSE(reader.Read(base::FilePath(L"nonexistent.pdb")));
+}
+
+TEST_F(NativePdbReaderTest, ReadTestDll) {
+  NativePdbReader reader;
+  ASSERT_TRUE(reader.Read(pdb_path_));
+
+  EXPECT_FALSE(reader.section_contribs().empty());
+  EXPECT_FALSE(reader.modules().empty());
+  EXPECT_FALSE(reader.global_symbols().empty());
+  EXPECT_FALSE(reader.public_symbols().empty());
+  EXPECT_FALSE(reader.fixups().empty());
+
+  for (const auto& section_contrib : reader.section_contribs())
+    EXPECT_LT(section_contrib.module, reader.modules().size());
+
+  // The functions and thunks of every module should be closed, and test_dll
+  // is built with a supported compiler.
+  size_t function_count = 0;
+  size_t compiled_module_count = 0;
+  for (const auto& module : reader.modules()) {
+    if (!module.compiler_name.empty())
+      ++compiled_module_count;
+
+    bool in_function = false;
+    for (const auto& symbol : module.symbols) {
+      switch (symbol.kind) {
+        case Symbol::kFunction:
+        case Symbol::kThunk:
+          EXPECT_FALSE(in_function);
+          EXPECT_NE(0U, symbol.addr.value());
+          in_function = true;
+          ++function_count;
+          break;
+
+        case Symbol::kFunctionEnd:
+          EXPECT_TRUE(in_function);
+          in_function = false;
+          break;
+
+        case Symbol::kBlock:
+        case Symbol::kFuncDebugStart:
+        case Symbol::kFuncDebugEnd:
+        case Symbol::kCallSite:
+          EXPECT_TRUE(in_function);
+          break;
+
+        case Symbol::kPublic:
+          ADD_FAILURE() << "Public symbol in module \"" << module.name << "\".";
+          break;
+
+        default:
+          break;
+      }
+    }
+    EXPECT_FALSE(in_function);
+  }
+  EXPECT_LT(0U, function_count);
+  EXPECT_LT(0U, compiled_module_count);
+
+  // Data symbols should mostly have a size.
+  size_t sized_data_count = 0;
+  for (const auto& symbol : reader.global_symbols()) {
+    EXPECT_EQ(Symbol::kData, symbol.kind);
+    size_t size = 0;
+    EXPECT_TRUE(reader.GetTypeSize(symbol.type_id, &size));
+    if (size != 0)
+      ++sized_data_count;
+  }
+  EXPECT_LT(0U, sized_data_count);
+}
+
+TEST_F(NativePdbReaderTest, ResultsDoNotDependOnThreadCount) {
+  NativePdbReader serial_reader;
+  serial_reader.set_thread_count(1);
+  EXPECT_EQ(1U, serial_reader.thread_count());
+  ASSERT_TRUE(serial_reader.Read(pdb_path_));
+
+  NativePdbReader parallel_reader;
+  parallel_reader.set_thread_count(4);
+  ASSERT_TRUE(parallel_reader.Read(pdb_path_));
+
+  const NativePdbReader::Modules& serial_modules = serial_reader.modules();
+  const NativePdbReader::Modules& parallel_modules = parallel_reader.modules();
+  ASSERT_EQ(serial_modules.size(), parallel_modules.size());
+  for (size_t i = 0; i < serial_modules.size(); ++i) {
+    EXPECT_EQ(serial_modules[i].name, parallel_modules[i].name);
+    EXPECT_EQ(serial_modules[i].compiler_name,
+              parallel_modules[i].compiler_name);
+
+    const NativePdbReader::Symbols& serial_symbols =
+        serial_modules[i].symbols;
+    const NativePdbReader::Symbols& parallel_symbols =
+        parallel_modules[i].symbols;
+    ASSERT_EQ(serial_symbols.size(), parallel_symbols.size());
+    for (size_t j = 0; j < serial_symbols.size(); ++j) {
+      EXPECT_EQ(serial_symbols[j].kind, parallel_symbols[j].kind);
+      EXPECT_EQ(serial_symbols[j].flags, parallel_symbols[j].flags);
+      EXPECT_EQ(serial_symbols[j].addr, parallel_symbols[j].addr);
+      EXPECT_EQ(serial_symbols[j].length, parallel_symbols[j].length);
+      EXPECT_EQ(serial_symbols[j].type_id, parallel_symbols[j].type_id);
+      EXPECT_EQ(serial_symbols[j].name, parallel_symbols[j].name);
+    }
+  }
+}
+
+TEST_F(NativePdbReaderTest, GetTypeSize) {
+  NativePdbReader reader;
+  ASSERT_TRUE(reader.Read(pdb_path_));
+
+  size_t size = 1;
+  EXPECT_TRUE(reader.GetTypeSize(cci::T_VOID, &size));
+  EXPECT_EQ(0U, size);
+  EXPECT_TRUE(reader.GetTypeSize(cci::T_INT4, &size));
+  EXPECT_EQ(4U, size);
+  EXPECT_TRUE(reader.GetTypeSize(cci::T_32PVOID, &size));
+  EXPECT_EQ(4U, size);
+  EXPECT_TRUE(reader.GetTypeSize(cci::T_64PVOID, &size));
+  EXPECT_EQ(8U, size);
+
+  EXPECT_FALSE(reader.GetTypeSize(0xFFFFFFFF, &size));
+}
+
+}  // namespace pe
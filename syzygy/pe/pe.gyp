@@ -117,6 +117,8 @@
         'hot_patching_writer.h',
         'metadata.cc',
         'metadata.h',
+        'native_pdb_reader.cc',
+        'native_pdb_reader.h',
         'pdb_info.cc',
         'pdb_info.h',
         'pe_coff_file.h',
@@ -239,6 +241,7 @@
         'hot_patching_decomposer_unittest.cc',
         'hot_patching_writer_unittest.cc',
         'metadata_unittest.cc',
+        'native_pdb_reader_unittest.cc',
         'pdb_info_unittest.cc',
         'pe_coff_file_unittest.cc',
         'pe_coff_image_layout_builder_unittest.cc',
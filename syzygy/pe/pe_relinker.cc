@@ -15,6 +15,7 @@
 #include "syzygy/pe/pe_relinker.h"
 
 #include "base/files/file_util.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -107,7 +108,9 @@ PERelinker::PERelinker(const PETransformPolicy* pe_transform_policy)
     : PECoffRelinker(pe_transform_policy),
       pe_transform_policy_(pe_transform_policy),
       add_metadata_(true), augment_pdb_(true),
-      compress_pdb_(false), strip_strings_(false),
+      compress_pdb_(false),
+      pdb_compression_level_(core::ZOutStream::kZBestSpeed),
+      strip_strings_(false),
       padding_(0), code_alignment_(1), output_guid_(GUID_NULL) {
   DCHECK(pe_transform_policy != NULL);
 }
@@ -224,14 +227,19 @@ bool PERelinker::Relink() {
   GetOmapRange(input_image_layout_.sections, &input_range);
   if (!FinalizePdbFile(input_path_, output_path_, input_range,
                        output_image_layout, output_guid_, augment_pdb_,
-                       strip_strings_, compress_pdb_, &pdb_file)) {
+                       strip_strings_, compress_pdb_, pdb_compression_level_,
+                       &pdb_file)) {
     return false;
   }
 
-  // Write the PDB file.
+  // Write the PDB file. The input PDB is copied as a whole, and only the few
+  // streams that have been modified are appended to the copy. The pages of
+  // the streams they replace are left unused, so the output is larger than
+  // the input by the size of those streams.
   LOG(INFO) << "Writing the PDB.";
   pdb::PdbWriter pdb_writer;
-  if (!pdb_writer.Write(output_pdb_path_, pdb_file)) {
+  if (!pdb_writer.WriteIncremental(input_pdb_path_, output_pdb_path_,
+                                   pdb_file)) {
     LOG(ERROR) << "Failed to write PDB file \"" << output_pdb_path_.value()
                << "\".";
     return false;
@@ -118,6 +118,7 @@ class PERelinker : public PECoffRelinker {
   bool add_metadata() const { return add_metadata_; }
   bool augment_pdb() const { return augment_pdb_; }
   bool compress_pdb() const { return compress_pdb_; }
+  int pdb_compression_level() const { return pdb_compression_level_; }
   bool strip_strings() const { return strip_strings_; }
   size_t padding() const { return padding_; }
   size_t code_alignment() const { return code_alignment_; }
@@ -140,6 +141,9 @@ class PERelinker : public PECoffRelinker {
   void set_compress_pdb(bool compress_pdb) {
     compress_pdb_ = compress_pdb;
   }
+  void set_pdb_compression_level(int pdb_compression_level) {
+    pdb_compression_level_ = pdb_compression_level;
+  }
   void set_strip_strings(bool strip_strings) {
     strip_strings_ = strip_strings;
   }
@@ -206,6 +210,9 @@ class PERelinker : public PECoffRelinker {
   // If true, then the augmented PDB stream will be compressed as it is written.
   // Defaults to false.
   bool compress_pdb_;
+  // The zlib compression level of the augmented PDB stream, when compressed.
+  // Defaults to core::ZOutStream::kZBestSpeed.
+  int pdb_compression_level_;
   // If true, strings associated with a block-graph will not be serialized into
   // the PDB. Defaults to false.
   bool strip_strings_;
@@ -20,6 +20,7 @@
 #include "syzygy/common/defs.h"
 #include "syzygy/core/serialization.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -145,6 +146,11 @@ TEST_F(PERelinkerTest, Properties) {
   relinker.set_compress_pdb(false);
   EXPECT_FALSE(relinker.compress_pdb());
 
+  EXPECT_EQ(core::ZOutStream::kZBestSpeed, relinker.pdb_compression_level());
+  relinker.set_pdb_compression_level(core::ZOutStream::kZBestCompression);
+  EXPECT_EQ(core::ZOutStream::kZBestCompression,
+            relinker.pdb_compression_level());
+
   EXPECT_FALSE(relinker.strip_strings());
   relinker.set_strip_strings(true);
   EXPECT_TRUE(relinker.strip_strings());
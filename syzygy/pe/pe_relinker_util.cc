@@ -14,10 +14,12 @@
 
 #include "syzygy/pe/pe_relinker_util.h"
 
+#include <iterator>
+
 #include "base/files/file_util.h"
 #include "syzygy/block_graph/transform.h"
+#include "syzygy/core/chunked_compression.h"
 #include "syzygy/core/file_util.h"
-#include "syzygy/core/zstream.h"
 #include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/find.h"
@@ -237,6 +239,10 @@ bool WriteSyzygyHistoryStream(const base::FilePath& input_path,
 // This writes the serialized block-graph and the image layout in a PDB stream
 // named /Syzygy/BlockGraph. If the format is changed, be sure to update this
 // documentation and pdb::kSyzygyBlockGraphStreamVersion (in pdb_constants.h).
+// The stream consists of its version, followed by the serialized data
+// compressed in chunks as described in core/chunked_compression.h. The chunks
+// are compressed concurrently, with zlib if the compress flag is set and
+// stored as they are otherwise.
 // The block graph stream will not include the data from the blocks of the
 // block-graph. If the strip-strings flag is set to true the strings contained
 // in the block-graph won't be saved.
@@ -244,6 +250,7 @@ bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
                                  const ImageLayout& image_layout,
                                  bool strip_strings,
                                  bool compress,
+                                 int compression_level,
                                  NameStreamMap* name_stream_map,
                                  PdbFile* pdb_file) {
   // Get the redecomposition data stream.
@@ -263,30 +270,12 @@ bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
       block_graph_reader->GetWritableStream();
   DCHECK(block_graph_writer.get() != NULL);
 
-  // Write the version of the BlockGraph stream, and whether or not its
-  // contents are compressed.
-  if (!block_graph_writer->Write(pdb::kSyzygyBlockGraphStreamVersion) ||
-      !block_graph_writer->Write(static_cast<unsigned char>(compress))) {
-    LOG(ERROR) << "Failed to write Syzygy BlockGraph stream header.";
-    return false;
-  }
-
-  // Set up the output stream.
-  PdbOutStream pdb_out_stream(block_graph_writer.get());
-  core::OutStream* out_stream = &pdb_out_stream;
-
-  // If requested, compress the output.
-  std::unique_ptr<core::ZOutStream> zip_stream;
-  if (compress) {
-    zip_stream.reset(new core::ZOutStream(&pdb_out_stream));
-    out_stream = zip_stream.get();
-    if (!zip_stream->Init(core::ZOutStream::kZBestCompression)) {
-      LOG(ERROR) << "Failed to initialize zlib compressor.";
-      return false;
-    }
-  }
-
-  core::OutArchive out_archive(out_stream);
+  // Serialize to memory first, so that the result can be compressed in
+  // parallel.
+  std::vector<uint8_t> serialized;
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(serialized)));
+  core::OutArchive out_archive(out_stream.get());
 
   // Set up the serialization properties.
   block_graph::BlockGraphSerializer::Attributes attributes = 0;
@@ -300,8 +289,21 @@ bool WriteSyzygyBlockGraphStream(const PEFile& pe_file,
     return false;
   }
 
-  // We have to flush the stream in case it's a zstream.
-  out_stream->Flush();
+  core::ChunkedCompressionOptions options;
+  options.codec = compress ? core::kZlibCodec : core::kStoreCodec;
+  options.level = compression_level;
+  std::vector<uint8_t> compressed;
+  if (!core::CompressChunks(serialized.data(), serialized.size(), options,
+                            &compressed)) {
+    LOG(ERROR) << "Failed to compress the serialized block-graph.";
+    return false;
+  }
+
+  if (!block_graph_writer->Write(pdb::kSyzygyBlockGraphStreamVersion) ||
+      !block_graph_writer->Write(compressed.size(), compressed.data())) {
+    LOG(ERROR) << "Failed to write Syzygy BlockGraph stream.";
+    return false;
+  }
 
   return true;
 }
@@ -504,6 +506,7 @@ bool FinalizePdbFile(const base::FilePath input_module,
                      bool augment_pdb,
                      bool strip_strings,
                      bool compress_pdb,
+                     int compression_level,
                      pdb::PdbFile* pdb_file) {
   DCHECK(pdb_file != NULL);
 
@@ -553,6 +556,7 @@ bool FinalizePdbFile(const base::FilePath input_module,
                                      image_layout,
                                      strip_strings,
                                      compress_pdb,
+                                     compression_level,
                                      &name_stream_map,
                                      pdb_file)) {
       return false;
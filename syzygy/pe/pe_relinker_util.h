@@ -125,6 +125,8 @@ void GetOmapRange(const std::vector<ImageLayout::SectionInfo>& sections,
 //     @p augment_pdb is true.
 // @param compress_pdb If true then the serialized block-graph will be
 //     compressed. Has no effect unless @p augment_pdb is true.
+// @param compression_level The zlib compression level of the serialized
+//     block-graph. Has no effect unless @p compress_pdb is true.
 // @param pdb_file The decomposed original PDB file to be updated.
 // @returns true on success, false otherwise.
 // @pre The transformed PE file must already have been written and finalized
@@ -137,6 +139,7 @@ bool FinalizePdbFile(const base::FilePath input_module,
                      bool augment_pdb,
                      bool strip_strings,
                      bool compress_pdb,
+                     int compression_level,
                      pdb::PdbFile* pdb_file);
 
 }  // namespace pe
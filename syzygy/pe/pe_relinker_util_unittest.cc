@@ -20,6 +20,7 @@
 #include "syzygy/block_graph/typed_block.h"
 #include "syzygy/common/defs.h"
 #include "syzygy/core/unittest_util.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_util.h"
 #include "syzygy/pe/decomposer.h"
@@ -311,6 +312,7 @@ TEST_F(PERelinkerUtilTest, GetOmapRangeAndFinalizePdb) {
                               true,   // augment_pdb.
                               false,  // strip_strings.
                               true,   // compress_pdb.
+                              core::ZOutStream::kZBestSpeed,
                               &pdb_file));
 
   pdb::PdbInfoHeader70 pdb_header;
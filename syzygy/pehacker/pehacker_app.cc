@@ -23,6 +23,7 @@
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
+#include "syzygy/core/zstream.h"
 #include "syzygy/pdb/pdb_reader.h"
 #include "syzygy/pdb/pdb_writer.h"
 #include "syzygy/pe/decomposer.h"
@@ -563,6 +564,7 @@ bool PEHackerApp::WriteImages() {
                              false,
                              false,
                              false,
+                             core::ZOutStream::kZDefaultCompression,
                              &pdb_file)) {
       return false;
     }
@@ -14,11 +14,203 @@
 
 #include "syzygy/refinery/analyzers/analysis_runner.h"
 
+#include <algorithm>
+#include <deque>
+
 #include "base/stl_util.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
 
 namespace refinery {
 
-AnalysisRunner::AnalysisRunner() {
+namespace {
+
+// @returns true if @p layers, terminated by ProcessState::UnknownLayer,
+//     contains @p layer.
+bool HasLayer(const ProcessState::LayerEnum* layers,
+              ProcessState::LayerEnum layer) {
+  DCHECK(layers);
+  for (; *layers != ProcessState::UnknownLayer; ++layers) {
+    if (*layers == layer)
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+// Schedules the analyzers of a runner over the invoking thread and a pool of
+// worker threads, as per their layer dependencies.
+class AnalysisRunner::Scheduler
+    : public base::DelegateSimpleThread::Delegate {
+ public:
+  Scheduler(const std::vector<Analyzer*>& analyzers,
+            const minidump::Minidump& minidump,
+            const Analyzer::ProcessAnalysis& process_analysis,
+            std::vector<AnalyzerTiming>* timings);
+
+  // Runs analyzers on the invoking thread until the analysis is done.
+  // @returns the result of the analysis.
+  Analyzer::AnalysisResult RunOnInvokingThread();
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // Runs analyzers on a worker thread until the analysis is done.
+  // @{
+  void Run() override;
+  // @}
+
+ private:
+  // Runs ready analyzers until the analysis is done.
+  // @param invoking_thread true if running on the invoking thread, which is
+  //     the only thread that may run the analyzers that use symbols.
+  void RunAnalyzers(bool invoking_thread);
+
+  // Queues the analyzer at @p index for running.
+  // @pre lock_ must be held.
+  void QueueAnalyzer(size_t index);
+
+  // @returns true once no more analyzers will run.
+  // @pre lock_ must be held.
+  bool IsDone() const;
+
+  const std::vector<Analyzer*>& analyzers_;
+  const minidump::Minidump& minidump_;
+  const Analyzer::ProcessAnalysis& process_analysis_;
+
+  // For each analyzer, the analyzers that depend on it.
+  std::vector<std::vector<size_t>> dependents_;
+
+  // Protects the members below.
+  base::Lock lock_;
+  // Signaled when an analyzer completes.
+  base::ConditionVariable analyzer_completed_;
+
+  // For each analyzer, the number of analyzers it waits on.
+  std::vector<size_t> pending_dependencies_;
+  // The analyzers ready to run on any thread.
+  std::deque<size_t> ready_;
+  // The analyzers ready to run on the invoking thread.
+  std::deque<size_t> ready_on_invoking_thread_;
+  size_t running_count_;
+  size_t completed_count_;
+  bool failed_;
+  std::vector<AnalyzerTiming>* timings_;
+
+  DISALLOW_COPY_AND_ASSIGN(Scheduler);
+};
+
+AnalysisRunner::Scheduler::Scheduler(
+    const std::vector<Analyzer*>& analyzers,
+    const minidump::Minidump& minidump,
+    const Analyzer::ProcessAnalysis& process_analysis,
+    std::vector<AnalyzerTiming>* timings)
+    : analyzers_(analyzers),
+      minidump_(minidump),
+      process_analysis_(process_analysis),
+      dependents_(analyzers.size()),
+      analyzer_completed_(&lock_),
+      pending_dependencies_(analyzers.size(), 0U),
+      running_count_(0U),
+      completed_count_(0U),
+      failed_(false),
+      timings_(timings) {
+  DCHECK(timings);
+
+  // An analyzer depends on the conflicting analyzers added before it.
+  for (size_t i = 0; i < analyzers_.size(); ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      if (Conflict(analyzers_[j], analyzers_[i])) {
+        dependents_[j].push_back(i);
+        ++pending_dependencies_[i];
+      }
+    }
+  }
+
+  base::AutoLock lock(lock_);
+  for (size_t i = 0; i < analyzers_.size(); ++i) {
+    if (pending_dependencies_[i] == 0U)
+      QueueAnalyzer(i);
+  }
+}
+
+Analyzer::AnalysisResult AnalysisRunner::Scheduler::RunOnInvokingThread() {
+  RunAnalyzers(true);
+
+  base::AutoLock lock(lock_);
+  DCHECK(IsDone());
+  return failed_ ? Analyzer::ANALYSIS_ERROR : Analyzer::ANALYSIS_COMPLETE;
+}
+
+void AnalysisRunner::Scheduler::Run() {
+  RunAnalyzers(false);
+}
+
+void AnalysisRunner::Scheduler::RunAnalyzers(bool invoking_thread) {
+  base::AutoLock lock(lock_);
+  while (!IsDone()) {
+    size_t index = 0;
+    if (invoking_thread && !ready_on_invoking_thread_.empty()) {
+      index = ready_on_invoking_thread_.front();
+      ready_on_invoking_thread_.pop_front();
+    } else if (!ready_.empty()) {
+      index = ready_.front();
+      ready_.pop_front();
+    } else {
+      analyzer_completed_.Wait();
+      continue;
+    }
+
+    Analyzer* analyzer = analyzers_[index];
+    AnalyzerTiming timing = {};
+    Analyzer::AnalysisResult result = Analyzer::ANALYSIS_ERROR;
+    ++running_count_;
+    {
+      base::AutoUnlock unlock(lock_);
+      result = RunAnalyzer(analyzer, minidump_, process_analysis_, &timing);
+    }
+    --running_count_;
+    timings_->push_back(timing);
+
+    if (result == Analyzer::ANALYSIS_COMPLETE) {
+      ++completed_count_;
+      for (size_t dependent : dependents_[index]) {
+        DCHECK_LT(0U, pending_dependencies_[dependent]);
+        if (--pending_dependencies_[dependent] == 0U && !failed_)
+          QueueAnalyzer(dependent);
+      }
+    } else {
+      // Let the running analyzers complete, but don't start any more.
+      LOG(ERROR) << analyzer->name() << " analysis failed";
+      failed_ = true;
+      ready_.clear();
+      ready_on_invoking_thread_.clear();
+    }
+
+    analyzer_completed_.Broadcast();
+  }
+}
+
+void AnalysisRunner::Scheduler::QueueAnalyzer(size_t index) {
+  lock_.AssertAcquired();
+  if (analyzers_[index]->uses_symbols())
+    ready_on_invoking_thread_.push_back(index);
+  else
+    ready_.push_back(index);
+}
+
+bool AnalysisRunner::Scheduler::IsDone() const {
+  lock_.AssertAcquired();
+  if (failed_)
+    return running_count_ == 0U;
+  return completed_count_ == analyzers_.size();
+}
+
+AnalysisRunner::AnalysisRunner() : worker_count_(0U) {
+}
+
+AnalysisRunner::AnalysisRunner(size_t worker_count)
+    : worker_count_(worker_count) {
 }
 
 AnalysisRunner::~AnalysisRunner() {
@@ -33,17 +225,82 @@ void AnalysisRunner::AddAnalyzer(std::unique_ptr<Analyzer> analyzer) {
 Analyzer::AnalysisResult AnalysisRunner::Analyze(
     const minidump::Minidump& minidump,
     const Analyzer::ProcessAnalysis& process_analysis) {
-  for (Analyzer* analyzer : analyzers_) {
-    Analyzer::AnalysisResult result =
-        analyzer->Analyze(minidump, process_analysis);
-    CHECK(result != Analyzer::ANALYSIS_ITERATE)
-        << "Iterative analysis is not supported.";
-    if (result != Analyzer::ANALYSIS_COMPLETE) {
-      LOG(ERROR) << analyzer->name() << " analysis failed";
-      return Analyzer::ANALYSIS_ERROR;
+  timings_.clear();
+
+  if (worker_count_ == 0U || analyzers_.size() < 2U) {
+    for (Analyzer* analyzer : analyzers_) {
+      AnalyzerTiming timing = {};
+      Analyzer::AnalysisResult result =
+          RunAnalyzer(analyzer, minidump, process_analysis, &timing);
+      timings_.push_back(timing);
+      if (result != Analyzer::ANALYSIS_COMPLETE) {
+        LOG(ERROR) << analyzer->name() << " analysis failed";
+        return Analyzer::ANALYSIS_ERROR;
+      }
+    }
+    return Analyzer::ANALYSIS_COMPLETE;
+  }
+
+  Scheduler scheduler(analyzers_, minidump, process_analysis, &timings_);
+  int thread_count =
+      static_cast<int>(std::min(worker_count_, analyzers_.size() - 1));
+  base::DelegateSimpleThreadPool pool("AnalysisRunner", thread_count);
+  pool.Start();
+  pool.AddWork(&scheduler, thread_count);
+  Analyzer::AnalysisResult result = scheduler.RunOnInvokingThread();
+  pool.JoinAll();
+
+  return result;
+}
+
+// static
+Analyzer::AnalysisResult AnalysisRunner::RunAnalyzer(
+    Analyzer* analyzer,
+    const minidump::Minidump& minidump,
+    const Analyzer::ProcessAnalysis& process_analysis,
+    AnalyzerTiming* timing) {
+  DCHECK(analyzer);
+  DCHECK(timing);
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  Analyzer::AnalysisResult result =
+      analyzer->Analyze(minidump, process_analysis);
+  timing->name = analyzer->name();
+  timing->wall_time = base::TimeTicks::Now() - start;
+
+  CHECK(result != Analyzer::ANALYSIS_ITERATE)
+      << "Iterative analysis is not supported.";
+  return result;
+}
+
+// static
+bool AnalysisRunner::Conflict(const Analyzer* first, const Analyzer* second) {
+  DCHECK(first);
+  DCHECK(second);
+
+  const ProcessState::LayerEnum* first_layers[] = {first->input_layers(),
+                                                   first->output_layers()};
+  const ProcessState::LayerEnum* second_layers[] = {second->input_layers(),
+                                                    second->output_layers()};
+  for (const ProcessState::LayerEnum* layers : first_layers) {
+    if (layers == nullptr)
+      return true;
+  }
+  for (const ProcessState::LayerEnum* layers : second_layers) {
+    if (layers == nullptr)
+      return true;
+  }
+
+  for (const ProcessState::LayerEnum* layers : first_layers) {
+    for (; *layers != ProcessState::UnknownLayer; ++layers) {
+      for (const ProcessState::LayerEnum* other_layers : second_layers) {
+        if (HasLayer(other_layers, *layers))
+          return true;
+      }
     }
   }
-  return Analyzer::ANALYSIS_COMPLETE;
+
+  return false;
 }
 
 }  // namespace refinery
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include "base/macros.h"
+#include "base/time/time.h"
 #include "syzygy/minidump/minidump.h"
 #include "syzygy/refinery/analyzers/analyzer.h"
 #include "syzygy/refinery/process_state/process_state.h"
@@ -27,11 +28,28 @@ namespace refinery {
 
 // The analysis runner runs analyzers over a minidump to populate a process
 // state.
+// Analyzers run in the order they're added. With worker threads, analyzers
+// that touch disjoint sets of layers may run concurrently: an analyzer only
+// runs once all the analyzers added before it that share one of its layers
+// have completed. As the records of a layer aren't thread safe, this holds
+// for layers that are only read too. Analyzers that don't declare their
+// layers run alone, and analyzers that use symbols run on the invoking thread.
 // TODO(manzagop): support iterative analysis (analyzers returning
 // ANALYSIS_ITERATE).
 class AnalysisRunner {
  public:
+  // The wall time spent in an analyzer during the last analysis.
+  struct AnalyzerTiming {
+    const char* name;
+    base::TimeDelta wall_time;
+  };
+
+  // Creates a runner that runs all analyzers on the invoking thread.
   AnalysisRunner();
+  // Creates a runner that runs analyzers concurrently.
+  // @param worker_count the number of worker threads to use in addition to
+  //     the invoking thread. With 0, analyzers run one after the other.
+  explicit AnalysisRunner(size_t worker_count);
   ~AnalysisRunner();
 
   // Adds @p analyzer to the runner.
@@ -50,8 +68,28 @@ class AnalysisRunner {
       const minidump::Minidump& minidump,
       const Analyzer::ProcessAnalysis& process_analysis);
 
+  // @returns the wall time spent in each of the analyzers that ran during the
+  //     last analysis, in the order they completed.
+  const std::vector<AnalyzerTiming>& timings() const { return timings_; }
+
  private:
+  class Scheduler;
+
+  // Runs @p analyzer, and times it.
+  // @returns the result of the analysis.
+  static Analyzer::AnalysisResult RunAnalyzer(
+      Analyzer* analyzer,
+      const minidump::Minidump& minidump,
+      const Analyzer::ProcessAnalysis& process_analysis,
+      AnalyzerTiming* timing);
+
+  // @returns true if the analyzers @p first and @p second can't run
+  //     concurrently.
+  static bool Conflict(const Analyzer* first, const Analyzer* second);
+
+  size_t worker_count_;
   std::vector<Analyzer*> analyzers_;  // Owned.
+  std::vector<AnalyzerTiming> timings_;
 
   DISALLOW_COPY_AND_ASSIGN(AnalysisRunner);
 };
@@ -14,6 +14,11 @@
 
 #include "syzygy/refinery/analyzers/analysis_runner.h"
 
+#include <vector>
+
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/time/time.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "syzygy/minidump/minidump.h"
@@ -26,6 +31,7 @@ namespace refinery {
 namespace {
 
 using testing::_;
+using testing::Invoke;
 using testing::Return;
 
 static const char kMockAnalyzerName[] = "MockAnalyzer";
@@ -46,6 +52,46 @@ MockAnalyzer* CreateMockAnalyzer(Analyzer::AnalysisResult result) {
   return analyzer;
 }
 
+// A mock analyzer that declares its layers and doesn't use symbols, so that
+// it may run concurrently with other analyzers.
+class MockLayeredAnalyzer : public MockAnalyzer {
+ public:
+  MockLayeredAnalyzer(ProcessState::LayerEnum input_layer,
+                      ProcessState::LayerEnum output_layer) {
+    input_layers_[0] = input_layer;
+    input_layers_[1] = ProcessState::UnknownLayer;
+    output_layers_[0] = output_layer;
+    output_layers_[1] = ProcessState::UnknownLayer;
+  }
+
+  const ProcessState::LayerEnum* input_layers() const override {
+    return input_layers_;
+  }
+  const ProcessState::LayerEnum* output_layers() const override {
+    return output_layers_;
+  }
+  bool uses_symbols() const override { return false; }
+
+ private:
+  ProcessState::LayerEnum input_layers_[2];
+  ProcessState::LayerEnum output_layers_[2];
+};
+
+// Records the order in which analyzers run.
+class AnalysisLog {
+ public:
+  void Append(int id) {
+    base::AutoLock lock(lock_);
+    ids_.push_back(id);
+  }
+
+  const std::vector<int>& ids() const { return ids_; }
+
+ private:
+  base::Lock lock_;
+  std::vector<int> ids_;
+};
+
 }  // namespace
 
 TEST(AnalysisRunnerTest, BasicSuccessTest) {
@@ -79,4 +125,122 @@ TEST(AnalysisRunnerTest, BasicErrorTest) {
   ASSERT_EQ(Analyzer::ANALYSIS_ERROR, runner.Analyze(minidump, analysis));
 }
 
+TEST(AnalysisRunnerTest, RecordsTimings) {
+  AnalysisRunner runner;
+  for (size_t i = 0; i < 2; ++i) {
+    std::unique_ptr<Analyzer> analyzer(
+        CreateMockAnalyzer(Analyzer::ANALYSIS_COMPLETE));
+    runner.AddAnalyzer(std::move(analyzer));
+  }
+
+  ProcessState process_state;
+  SimpleProcessAnalysis analysis(&process_state);
+  minidump::FileMinidump minidump;
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE, runner.Analyze(minidump, analysis));
+
+  ASSERT_EQ(2U, runner.timings().size());
+  for (const auto& timing : runner.timings()) {
+    EXPECT_STREQ(kMockAnalyzerName, timing.name);
+    EXPECT_LE(0, timing.wall_time.InMicroseconds());
+  }
+}
+
+TEST(AnalysisRunnerTest, IndependentAnalyzersRunConcurrently) {
+  // Each analyzer waits for the other to have started, which only completes
+  // if they run concurrently.
+  base::WaitableEvent first_started(true, false);
+  base::WaitableEvent second_started(true, false);
+  const base::TimeDelta kTimeout = base::TimeDelta::FromSeconds(10);
+
+  AnalysisRunner runner(2U);
+  MockLayeredAnalyzer* first = new MockLayeredAnalyzer(
+      ProcessState::ModuleLayer, ProcessState::ModuleLayer);
+  EXPECT_CALL(*first, Analyze(_, _))
+      .WillOnce(Invoke([&](const minidump::Minidump& minidump,
+                           const Analyzer::ProcessAnalysis& analysis) {
+        first_started.Signal();
+        return second_started.TimedWait(kTimeout)
+                   ? Analyzer::ANALYSIS_COMPLETE
+                   : Analyzer::ANALYSIS_ERROR;
+      }));
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(first));
+
+  MockLayeredAnalyzer* second = new MockLayeredAnalyzer(
+      ProcessState::StackLayer, ProcessState::StackLayer);
+  EXPECT_CALL(*second, Analyze(_, _))
+      .WillOnce(Invoke([&](const minidump::Minidump& minidump,
+                           const Analyzer::ProcessAnalysis& analysis) {
+        second_started.Signal();
+        return first_started.TimedWait(kTimeout)
+                   ? Analyzer::ANALYSIS_COMPLETE
+                   : Analyzer::ANALYSIS_ERROR;
+      }));
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(second));
+
+  ProcessState process_state;
+  SimpleProcessAnalysis analysis(&process_state);
+  minidump::FileMinidump minidump;
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE, runner.Analyze(minidump, analysis));
+  EXPECT_EQ(2U, runner.timings().size());
+}
+
+TEST(AnalysisRunnerTest, DependentAnalyzersRunInOrder) {
+  // A chain of analyzers where each reads the layer written by the previous
+  // one, along with independent analyzers.
+  AnalysisLog log;
+  AnalysisRunner runner(4U);
+  const ProcessState::LayerEnum kChain[][2] = {
+      {ProcessState::ModuleLayer, ProcessState::BytesLayer},
+      {ProcessState::BytesLayer, ProcessState::StackLayer},
+      {ProcessState::StackLayer, ProcessState::StackFrameLayer},
+      {ProcessState::HeapMetadataLayer, ProcessState::HeapMetadataLayer},
+      {ProcessState::StackFrameLayer, ProcessState::TypedBlockLayer},
+      {ProcessState::HeapAllocationLayer, ProcessState::HeapAllocationLayer},
+  };
+  for (int i = 0; i < static_cast<int>(arraysize(kChain)); ++i) {
+    MockLayeredAnalyzer* analyzer =
+        new MockLayeredAnalyzer(kChain[i][0], kChain[i][1]);
+    EXPECT_CALL(*analyzer, Analyze(_, _))
+        .WillOnce(Invoke([&log, i](const minidump::Minidump& minidump,
+                                   const Analyzer::ProcessAnalysis& analysis) {
+          log.Append(i);
+          return Analyzer::ANALYSIS_COMPLETE;
+        }));
+    runner.AddAnalyzer(std::unique_ptr<Analyzer>(analyzer));
+  }
+
+  ProcessState process_state;
+  SimpleProcessAnalysis analysis(&process_state);
+  minidump::FileMinidump minidump;
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE, runner.Analyze(minidump, analysis));
+
+  // The chained analyzers ran in order.
+  ASSERT_EQ(arraysize(kChain), log.ids().size());
+  std::vector<int> chain;
+  for (int id : log.ids()) {
+    if (id != 3 && id != 5)
+      chain.push_back(id);
+  }
+  EXPECT_THAT(chain, testing::ElementsAre(0, 1, 2, 4));
+}
+
+TEST(AnalysisRunnerTest, ErrorSkipsDependentAnalyzers) {
+  AnalysisRunner runner(2U);
+  MockLayeredAnalyzer* failing = new MockLayeredAnalyzer(
+      ProcessState::ModuleLayer, ProcessState::BytesLayer);
+  EXPECT_CALL(*failing, Analyze(_, _))
+      .WillOnce(Return(Analyzer::ANALYSIS_ERROR));
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(failing));
+
+  MockLayeredAnalyzer* dependent = new MockLayeredAnalyzer(
+      ProcessState::BytesLayer, ProcessState::StackLayer);
+  EXPECT_CALL(*dependent, Analyze(_, _)).Times(0);
+  runner.AddAnalyzer(std::unique_ptr<Analyzer>(dependent));
+
+  ProcessState process_state;
+  SimpleProcessAnalysis analysis(&process_state);
+  minidump::FileMinidump minidump;
+  ASSERT_EQ(Analyzer::ANALYSIS_ERROR, runner.Analyze(minidump, analysis));
+}
+
 }  // namespace refinery
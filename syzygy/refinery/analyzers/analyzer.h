@@ -45,6 +45,25 @@ class Analyzer {
   // @returns the analyzer's name.
   virtual const char* name() const = 0;
 
+  // @returns the layers the analyzer reads, terminated by
+  //     ProcessState::UnknownLayer, or nullptr if they aren't known. These are
+  //     provided by ANALYZER_INPUT_LAYERS and ANALYZER_NO_INPUT_LAYERS.
+  virtual const ProcessState::LayerEnum* input_layers() const {
+    return nullptr;
+  }
+
+  // @returns the layers the analyzer writes, terminated by
+  //     ProcessState::UnknownLayer, or nullptr if they aren't known. These are
+  //     provided by ANALYZER_OUTPUT_LAYERS and ANALYZER_NO_OUTPUT_LAYERS.
+  virtual const ProcessState::LayerEnum* output_layers() const {
+    return nullptr;
+  }
+
+  // @returns true if the analyzer uses the symbol providers of the process
+  //     analysis. The symbol providers aren't thread safe, so analyzers that
+  //     use them are run one at a time on the thread invoking the analysis.
+  virtual bool uses_symbols() const { return true; }
+
   // Analyze @p minidump and update the ProcessState provided through
   //     @p process_analysis. Analysis may involve examining the ProcessState,
   //     and may be an iterative process.
@@ -77,32 +96,44 @@ class Analyzer::ProcessAnalysis {
 // @name Utility macros to allow declaring analyzer input and output layer
 //     dependencies.
 // @{
-#define ANALYZER_INPUT_LAYERS(...)                          \
-  static const ProcessState::LayerEnum* InputLayers() {     \
-    static const ProcessState::LayerEnum kInputLayers[] = { \
-        __VA_ARGS__, ProcessState::UnknownLayer};           \
-    return kInputLayers;                                    \
+#define ANALYZER_INPUT_LAYERS(...)                                \
+  static const ProcessState::LayerEnum* InputLayers() {           \
+    static const ProcessState::LayerEnum kInputLayers[] = {       \
+        __VA_ARGS__, ProcessState::UnknownLayer};                 \
+    return kInputLayers;                                          \
+  }                                                               \
+  const ProcessState::LayerEnum* input_layers() const override {  \
+    return InputLayers();                                         \
   }
 
-#define ANALYZER_NO_INPUT_LAYERS()                      \
-  static const ProcessState::LayerEnum* InputLayers() { \
-    static const ProcessState::LayerEnum kSentinel =    \
-        ProcessState::UnknownLayer;                     \
-    return &kSentinel;                                  \
+#define ANALYZER_NO_INPUT_LAYERS()                                \
+  static const ProcessState::LayerEnum* InputLayers() {           \
+    static const ProcessState::LayerEnum kSentinel =              \
+        ProcessState::UnknownLayer;                               \
+    return &kSentinel;                                            \
+  }                                                               \
+  const ProcessState::LayerEnum* input_layers() const override {  \
+    return InputLayers();                                         \
   }
 
-#define ANALYZER_OUTPUT_LAYERS(...)                          \
-  static const ProcessState::LayerEnum* OutputLayers() {     \
-    static const ProcessState::LayerEnum kOutputLayers[] = { \
-        __VA_ARGS__, ProcessState::UnknownLayer};            \
-    return kOutputLayers;                                    \
+#define ANALYZER_OUTPUT_LAYERS(...)                               \
+  static const ProcessState::LayerEnum* OutputLayers() {          \
+    static const ProcessState::LayerEnum kOutputLayers[] = {      \
+        __VA_ARGS__, ProcessState::UnknownLayer};                 \
+    return kOutputLayers;                                         \
+  }                                                               \
+  const ProcessState::LayerEnum* output_layers() const override { \
+    return OutputLayers();                                        \
   }
 
-#define ANALYZER_NO_OUTPUT_LAYERS()                      \
-  static const ProcessState::LayerEnum* OutputLayers() { \
-    static const ProcessState::LayerEnum kSentinel =     \
-        ProcessState::UnknownLayer;                      \
-    return &kSentinel;                                   \
+#define ANALYZER_NO_OUTPUT_LAYERS()                               \
+  static const ProcessState::LayerEnum* OutputLayers() {          \
+    static const ProcessState::LayerEnum kSentinel =              \
+        ProcessState::UnknownLayer;                               \
+    return &kSentinel;                                            \
+  }                                                               \
+  const ProcessState::LayerEnum* output_layers() const override { \
+    return OutputLayers();                                        \
   }
 
 // @}
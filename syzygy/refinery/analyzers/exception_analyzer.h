@@ -28,6 +28,7 @@ class ExceptionAnalyzer : public Analyzer {
  public:
   ExceptionAnalyzer() {}
   const char* name() const override { return kExceptionAnalyzerName; }
+  bool uses_symbols() const override { return false; }
 
   AnalysisResult Analyze(const minidump::Minidump& minidump,
                          const ProcessAnalysis& process_analysis) override;
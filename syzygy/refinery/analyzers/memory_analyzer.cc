@@ -17,6 +17,8 @@
 #include <dbghelp.h>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "syzygy/core/address_space.h"
 #include "syzygy/refinery/process_state/process_state_util.h"
@@ -98,27 +100,43 @@ Analyzer::AnalysisResult MemoryAnalyzer::Analyze(
     minidump::Minidump::Stream bytes_stream =
         minidump.GetStreamFor(descriptor.Memory);
 
+    // Copy the bytes straight out of the minidump when they're directly
+    // addressable, which avoids reading them through an intermediate buffer.
     std::string bytes;
-    if (!bytes_stream.ReadAndAdvanceBytes(range_size, &bytes))
+    const void* view = bytes_stream.GetView(range_size);
+    if (view != nullptr) {
+      bytes.assign(reinterpret_cast<const char*>(view), range_size);
+    } else if (!bytes_stream.ReadAndAdvanceBytes(range_size, &bytes)) {
       return ANALYSIS_ERROR;
+    }
 
     AddressRange new_range(range_addr, range_size);
     if (!new_range.IsValid())
       return ANALYSIS_ERROR;
 
     // Record the new range and consolidate it with any overlaps.
-    if (!RecordMemoryContents(new_range, bytes, &memory_temp))
+    if (!RecordMemoryContents(new_range, std::move(bytes), &memory_temp))
       return ANALYSIS_ERROR;
   }
 
-  // Now transfer the temp address space to the bytes layer.
-  for (const auto& entry : memory_temp) {
-    // Create the memory record.
-    AddressRange new_range(entry.first.start(), entry.first.size());
-    BytesRecordPtr bytes_record;
-    bytes_layer->CreateRecord(new_range, &bytes_record);
-    Bytes* bytes_proto = bytes_record->mutable_data();
-    bytes_proto->mutable_data()->assign(entry.second);
+  // Now transfer the temp address space to the bytes layer. Its ranges are
+  // sorted, so the records are created in bulk.
+  std::vector<AddressRange> new_ranges;
+  new_ranges.reserve(memory_temp.size());
+  for (const auto& entry : memory_temp)
+    new_ranges.push_back(AddressRange(entry.first.start(), entry.first.size()));
+
+  std::vector<BytesRecordPtr> bytes_records;
+  bytes_layer->CreateRecords(new_ranges, &bytes_records);
+  DCHECK_EQ(new_ranges.size(), bytes_records.size());
+
+  // The temp address space is discarded, so its bytes are moved rather than
+  // copied into the records.
+  auto record_it = bytes_records.begin();
+  for (auto& entry : memory_temp) {
+    Bytes* bytes_proto = (*record_it)->mutable_data();
+    bytes_proto->mutable_data()->swap(entry.second);
+    ++record_it;
   }
 
   return ANALYSIS_COMPLETE;
@@ -27,6 +27,7 @@ class MemoryAnalyzer : public Analyzer {
  public:
   MemoryAnalyzer() {}
   const char* name() const override { return kMemoryAnalyzerName; }
+  bool uses_symbols() const override { return false; }
 
   AnalysisResult Analyze(const minidump::Minidump& minidump,
                          const ProcessAnalysis& process_analysis) override;
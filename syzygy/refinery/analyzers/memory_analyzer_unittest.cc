@@ -44,6 +44,39 @@ TEST(MemoryAnalyzerTest, AnalyzeMinidump) {
   ASSERT_LE(1, bytes_layer->size());
 }
 
+TEST(MemoryAnalyzerTest, MappedMinidumpYieldsSameBytes) {
+  minidump::FileMinidump file_minidump;
+  ASSERT_TRUE(file_minidump.Open(testing::TestMinidumps::GetNotepad32Dump()));
+  minidump::MappedMinidump mapped_minidump;
+  ASSERT_TRUE(
+      mapped_minidump.Open(testing::TestMinidumps::GetNotepad32Dump()));
+
+  ProcessState file_process_state;
+  SimpleProcessAnalysis file_analysis(&file_process_state);
+  MemoryAnalyzer analyzer;
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE,
+            analyzer.Analyze(file_minidump, file_analysis));
+
+  ProcessState mapped_process_state;
+  SimpleProcessAnalysis mapped_analysis(&mapped_process_state);
+  ASSERT_EQ(Analyzer::ANALYSIS_COMPLETE,
+            analyzer.Analyze(mapped_minidump, mapped_analysis));
+
+  BytesLayerPtr file_layer;
+  ASSERT_TRUE(file_process_state.FindLayer(&file_layer));
+  BytesLayerPtr mapped_layer;
+  ASSERT_TRUE(mapped_process_state.FindLayer(&mapped_layer));
+  ASSERT_EQ(file_layer->size(), mapped_layer->size());
+
+  for (BytesRecordPtr record : *file_layer) {
+    std::vector<BytesRecordPtr> matching_records;
+    mapped_layer->GetRecordsAt(record->range().start(), &matching_records);
+    ASSERT_EQ(1U, matching_records.size());
+    EXPECT_EQ(record->range().size(), matching_records[0]->range().size());
+    EXPECT_EQ(record->data().data(), matching_records[0]->data().data());
+  }
+}
+
 class MemoryAnalyzerSyntheticTest : public testing::SyntheticMinidumpTest {
  protected:
   using MemorySpecification =
@@ -26,6 +26,7 @@ class ModuleAnalyzer : public Analyzer {
  public:
   ModuleAnalyzer() {}
   const char* name() const override { return kModuleAnalyzerName; }
+  bool uses_symbols() const override { return false; }
 
   AnalysisResult Analyze(const minidump::Minidump& minidump,
                          const ProcessAnalysis& process_analysis) override;
@@ -25,6 +25,7 @@
 #include "base/macros.h"
 #include "base/files/file_path.h"
 #include "base/strings/string16.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
@@ -72,6 +73,7 @@ class RunAnalyzerApplication : public application::AppImplBase {
   std::string analyzer_names_;
   bool resolve_dependencies_;
   std::string output_layers_;
+  size_t analysis_threads_;
 
   DISALLOW_COPY_AND_ASSIGN(RunAnalyzerApplication);
 };
@@ -125,7 +127,11 @@ const char kUsageFormatStr[] =
     "     Default value: %s\n"
     "  --no-dependencies\n"
     "     If provided, the layer dependencies of the requested analyzers\n"
-    "     won't be used to supplement the analyzer list.\n";
+    "     won't be used to supplement the analyzer list.\n"
+    "  --analysis-threads=<number of threads>\n"
+    "     The number of worker threads running the analyzers that don't\n"
+    "     depend on each other concurrently.\n"
+    "     Default value: 0\n";
 
 const char kDefaultAnalyzers[] = "HeapAnalyzer,StackFrameAnalyzer,TebAnalyzer";
 const char kDefaultOutputLayers[] = "TypedDataLayer";
@@ -232,7 +238,9 @@ void RunAnalyzerApplication::PrintUsage(const base::FilePath& program,
 }
 
 RunAnalyzerApplication::RunAnalyzerApplication()
-    : AppImplBase("RunAnalyzerApplication"), resolve_dependencies_(true) {
+    : AppImplBase("RunAnalyzerApplication"),
+      resolve_dependencies_(true),
+      analysis_threads_(0U) {
 }
 
 bool RunAnalyzerApplication::ParseCommandLine(
@@ -256,6 +264,16 @@ bool RunAnalyzerApplication::ParseCommandLine(
     }
   }
 
+  static const char kAnalysisThreads[] = "analysis-threads";
+  if (cmd_line->HasSwitch(kAnalysisThreads)) {
+    if (!base::StringToSizeT(cmd_line->GetSwitchValueASCII(kAnalysisThreads),
+                             &analysis_threads_)) {
+      PrintUsage(cmd_line->GetProgram(),
+                 "Must provide a number of threads with this flag.");
+      return false;
+    }
+  }
+
   static const char kOutputLayers[] = "output-layers";
   if (cmd_line->HasSwitch(kOutputLayers)) {
     output_layers_ = cmd_line->GetSwitchValueASCII(kOutputLayers);
@@ -335,7 +353,7 @@ int RunAnalyzerApplication::Run() {
   for (const auto& minidump_path : mindump_paths_) {
     ::fprintf(out(), "Processing \"%ls\"\n", minidump_path.value().c_str());
 
-    minidump::FileMinidump minidump;
+    minidump::MappedMinidump minidump;
     if (!minidump.Open(minidump_path)) {
       LOG(ERROR) << "Unable to open dump file.";
       return 1;
@@ -422,12 +440,18 @@ bool RunAnalyzerApplication::Analyze(
       "    AMDExtendedCpuFeatures 0x%08X",
       system_info.Cpu.X86CpuInfo.AMDExtendedCpuFeatures);
 
-  refinery::AnalysisRunner runner;
+  refinery::AnalysisRunner runner(analysis_threads_);
   if (!AddAnalyzers(factory, &runner))
     return false;
 
-  return runner.Analyze(minidump, process_analysis) ==
-         refinery::Analyzer::ANALYSIS_COMPLETE;
+  refinery::Analyzer::AnalysisResult result =
+      runner.Analyze(minidump, process_analysis);
+  for (const auto& timing : runner.timings()) {
+    LOG(INFO) << timing.name << " ran in "
+              << timing.wall_time.InMilliseconds() << " ms.";
+  }
+
+  return result == refinery::Analyzer::ANALYSIS_COMPLETE;
 }
 
 AnalyzerOrderer::AnalyzerOrderer(const refinery::AnalyzerFactory& factory)
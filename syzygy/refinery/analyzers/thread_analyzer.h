@@ -26,6 +26,7 @@ class ThreadAnalyzer : public Analyzer {
  public:
   ThreadAnalyzer() {}
   const char* name() const override { return kThreadAnalyzerName; }
+  bool uses_symbols() const override { return false; }
 
   AnalysisResult Analyze(const minidump::Minidump& minidump,
                          const ProcessAnalysis& process_analysis) override;
@@ -26,6 +26,7 @@ class UnloadedModuleAnalyzer : public Analyzer {
  public:
   UnloadedModuleAnalyzer() {}
   const char* name() const override { return kUnloadedModuleAnalyzerName; }
+  bool uses_symbols() const override { return false; }
 
   AnalysisResult Analyze(const minidump::Minidump& minidump,
                          const ProcessAnalysis& process_state) override;
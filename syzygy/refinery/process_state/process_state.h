@@ -15,13 +15,16 @@
 #ifndef SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
 #define SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
 
+#include <algorithm>
 #include <iterator>
 #include <map>
 #include <vector>
 
+#include "base/bits.h"
 #include "base/logging.h"
 #include "base/macros.h"
 #include "base/memory/ref_counted.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/refinery/core/address.h"
 #include "syzygy/refinery/core/bit_source.h"
 #include "syzygy/refinery/process_state/layer_traits.h"
@@ -51,6 +54,9 @@ namespace refinery {
 // process' virtual memory space, and contains data specific to that layer and
 // range. Each layer and the data associated with a record is a protobuf of
 // a type appropriate to the layer.
+// Layers may be found and created from multiple threads. Layers themselves
+// aren't thread safe however, so a layer must only be accessed by a single
+// thread at a time.
 class ProcessState : public BitSource {
  public:
   template <typename RecordType> class Layer;
@@ -129,9 +135,16 @@ class ProcessState : public BitSource {
  private:
   class LayerBase;
 
+  // @pre layers_lock_ must be held.
+  // @{
+  template <typename RecordType>
+  bool FindLayerUnlocked(scoped_refptr<Layer<RecordType>>* layer);
   template<typename RecordType>
   void CreateLayer(scoped_refptr<Layer<RecordType>>* layer);
+  // @}
 
+  // Protects layers_.
+  base::Lock layers_lock_;
   std::map<RecordId, scoped_refptr<LayerBase>> layers_;
 
   bool has_exception;
@@ -184,6 +197,13 @@ class ProcessState::Record : public base::RefCounted<Record<RecordType>> {
 
 template <typename RecordType> class Iterator;
 
+// In addition to the records ordered by address, a layer maintains an index
+// of its records binned by size class, where the records of class c have a
+// size in [2^c, 2^(c+1)). A record of class c that intersects a range can't
+// start more than 2^(c+1) bytes before it, so queries are answered with a
+// bounded lookup in each non-empty class rather than with a scan of the whole
+// layer. This is O(log n + k) per class for layers whose records don't pile
+// up over each other, as is the case of all the layers in practice.
 template <typename RecordType>
 class ProcessState::Layer : public ProcessState::LayerBase {
  public:
@@ -193,6 +213,14 @@ class ProcessState::Layer : public ProcessState::LayerBase {
   // @pre @p range must be a valid.
   void CreateRecord(AddressRange range, RecordPtr* record);
 
+  // Creates a record for each of @p ranges. This is faster than creating the
+  // records one by one when @p ranges is sorted by address.
+  // @pre the ranges must be valid.
+  // @param ranges the ranges of the records to create.
+  // @param records on return, the created records, in the order of @p ranges.
+  void CreateRecords(const std::vector<AddressRange>& ranges,
+                     std::vector<RecordPtr>* records);
+
   // Gets records located at |addr|.
   // @param addr the address records should must be located at.
   // @param records contains the matching records.
@@ -201,14 +229,14 @@ class ProcessState::Layer : public ProcessState::LayerBase {
   // Gets records that fully span |range|.
   // @pre @p range must be a valid.
   // @param range the address range the region records should span.
-  // @param records contains the matching records.
+  // @param records contains the matching records, ordered by address.
   void GetRecordsSpanning(const AddressRange& range,
                           std::vector<RecordPtr>* records) const;
 
   // Gets records that intersect |range|.
   // @pre @p range must be a valid.
   // @param range the address range the region records should intersect.
-  // @param records contains the matching records.
+  // @param records contains the matching records, ordered by address.
   void GetRecordsIntersecting(const AddressRange& range,
                               std::vector<RecordPtr>* records) const;
 
@@ -227,8 +255,48 @@ class ProcessState::Layer : public ProcessState::LayerBase {
   typename LayerTraits<RecordType>::DataType* mutable_data() { return &data_; }
 
  private:
+  typedef std::multimap<Address, RecordPtr> RecordMap;
+
+  // Record sizes are 32 bit, hence there are 32 size classes.
+  static const size_t kSizeClassCount = 32;
+
+  // @param size the size of a record.
+  // @returns the size class of a record of size @p size.
+  static size_t GetSizeClass(Size size) {
+    DCHECK_NE(0U, size);
+    return static_cast<size_t>(base::bits::Log2Floor(size));
+  }
+
+  // @param size_class a size class.
+  // @returns the largest size of a record of class @p size_class.
+  static uint64_t GetMaxSize(size_t size_class) {
+    return (2ULL << size_class) - 1;
+  }
+
+  // Adds @p record to the index of its size class.
+  // @param hint the position after which @p record should be inserted, as
+  //     for std::multimap::insert. Set to the position of @p record on return.
+  void IndexRecord(const RecordPtr& record,
+                   typename RecordMap::iterator* hint);
+
+  // Gets the records of @p size_class that start in [@p start, @p end] and
+  // satisfy @p predicate.
+  template <typename Predicate>
+  void GetIndexedRecords(size_t size_class,
+                         Address start,
+                         Address end,
+                         Predicate predicate,
+                         std::vector<RecordPtr>* records) const;
+
+  // Sorts @p records by address, leaving records at the same address in
+  // the order they were found.
+  static void SortRecords(std::vector<RecordPtr>* records);
+
   typename LayerTraits<RecordType>::DataType data_;
-  std::multimap<Address, RecordPtr> records_;
+  RecordMap records_;
+
+  // The records binned by size class.
+  RecordMap size_classes_[kSizeClassCount];
 };
 
 #define DECL_LAYER_TYPES(layer_name)                                           \
@@ -275,16 +343,8 @@ class Iterator : public std::iterator<
 // ProcessState
 template<typename RecordType>
 bool ProcessState::FindLayer(scoped_refptr<Layer<RecordType>>* layer) {
-  DCHECK(layer != nullptr);
-
-  RecordId id = RecordTraits<RecordType>::ID;
-  auto it = layers_.find(id);
-  if (it != layers_.end()) {
-    *layer = static_cast<Layer<RecordType>*>(it->second.get());
-    return true;
-  }
-
-  return false;
+  base::AutoLock lock(layers_lock_);
+  return FindLayerUnlocked(layer);
 }
 
 template <typename RecordType>
@@ -292,12 +352,29 @@ void ProcessState::FindOrCreateLayer(
     scoped_refptr<Layer<RecordType>>* layer) {
   DCHECK(layer != nullptr);
 
-  if (FindLayer(layer))
+  base::AutoLock lock(layers_lock_);
+  if (FindLayerUnlocked(layer))
     return;
 
   CreateLayer(layer);
 }
 
+template <typename RecordType>
+bool ProcessState::FindLayerUnlocked(
+    scoped_refptr<Layer<RecordType>>* layer) {
+  DCHECK(layer != nullptr);
+  layers_lock_.AssertAcquired();
+
+  RecordId id = RecordTraits<RecordType>::ID;
+  auto it = layers_.find(id);
+  if (it != layers_.end()) {
+    *layer = static_cast<Layer<RecordType>*>(it->second.get());
+    return true;
+  }
+
+  return false;
+}
+
 template <typename RecordType>
 bool ProcessState::FindSingleRecord(Address addr,
                                     scoped_refptr<Record<RecordType>>* record) {
@@ -319,6 +396,7 @@ bool ProcessState::FindSingleRecord(Address addr,
 template<typename RecordType>
 void ProcessState::CreateLayer(scoped_refptr<Layer<RecordType>>* layer) {
   DCHECK(layer != nullptr);
+  layers_lock_.AssertAcquired();
 
   scoped_refptr<Layer<RecordType>> new_layer = new Layer<RecordType>();
   DCHECK(new_layer.get() != nullptr);
@@ -340,10 +418,41 @@ void ProcessState::Layer<RecordType>::CreateRecord(
 
   RecordPtr new_record = new Record<RecordType>(range);
   records_.insert(std::make_pair(range.start(), new_record));
+  typename RecordMap::iterator hint =
+      size_classes_[GetSizeClass(range.size())].end();
+  IndexRecord(new_record, &hint);
 
   record->swap(new_record);
 }
 
+template <typename RecordType>
+void ProcessState::Layer<RecordType>::CreateRecords(
+    const std::vector<AddressRange>& ranges, std::vector<RecordPtr>* records) {
+  DCHECK(records != nullptr);
+
+  records->clear();
+  records->reserve(ranges.size());
+
+  // Insert each record right after the previous one, which is constant time
+  // for sorted ranges.
+  typename RecordMap::iterator hint = records_.end();
+  typename RecordMap::iterator size_class_hints[kSizeClassCount];
+  for (size_t i = 0; i < kSizeClassCount; ++i)
+    size_class_hints[i] = size_classes_[i].end();
+
+  for (const AddressRange& range : ranges) {
+    DCHECK(range.IsValid());
+
+    RecordPtr new_record = new Record<RecordType>(range);
+    if (hint != records_.end())
+      ++hint;
+    hint = records_.insert(hint, std::make_pair(range.start(), new_record));
+    IndexRecord(new_record, &size_class_hints[GetSizeClass(range.size())]);
+
+    records->push_back(new_record);
+  }
+}
+
 template <typename RecordType>
 void ProcessState::Layer<RecordType>::GetRecordsAt(
     Address addr, std::vector<RecordPtr>* records) const {
@@ -365,16 +474,21 @@ void ProcessState::Layer<RecordType>::GetRecordsSpanning(
 
   records->clear();
 
-  for (const auto& entry : records_) {
-    AddressRange record_range = entry.second->range();
-    DCHECK(record_range.IsValid());
-    if (record_range.Contains(range))
-      records->push_back(entry.second);
-
-    if (record_range.start() > range.start())
-      // Records that start after the range, or any after, cannot span it.
-      return;
+  // A record of class c that spans the range starts at most 2^(c+1) - 1 bytes
+  // before the range's end, and no later than the range's start.
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    uint64_t max_size = GetMaxSize(i);
+    if (max_size < range.size())
+      continue;
+    Address start = range.end() > max_size ? range.end() - max_size : 0;
+    GetIndexedRecords(i, start, range.start(),
+                      [&range](const AddressRange& record_range) {
+                        return record_range.Contains(range);
+                      },
+                      records);
   }
+
+  SortRecords(records);
 }
 
 template <typename RecordType>
@@ -385,12 +499,19 @@ void ProcessState::Layer<RecordType>::GetRecordsIntersecting(
 
   records->clear();
 
-  for (const auto& entry : records_) {
-    AddressRange record_range = entry.second->range();
-    DCHECK(record_range.IsValid());
-    if (record_range.Intersects(range))
-      records->push_back(entry.second);
+  // A record of class c that intersects the range starts at most 2^(c+1) - 1
+  // bytes before the range's start, and before the range's end.
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    uint64_t max_size = GetMaxSize(i);
+    Address start = range.start() > max_size ? range.start() - max_size : 0;
+    GetIndexedRecords(i, start, range.end() - 1,
+                      [&range](const AddressRange& record_range) {
+                        return record_range.Intersects(range);
+                      },
+                      records);
   }
+
+  SortRecords(records);
 }
 
 template <typename RecordType>
@@ -403,6 +524,17 @@ bool ProcessState::Layer<RecordType>::RemoveRecord(const RecordPtr& record) {
   for (auto it = matches.first; it != matches.second; ++it) {
     if (it->second.get() == record.get()) {
       records_.erase(it);
+
+      RecordMap& size_class =
+          size_classes_[GetSizeClass(record->range().size())];
+      auto indexed = size_class.equal_range(record->range().start());
+      for (auto jt = indexed.first; jt != indexed.second; ++jt) {
+        if (jt->second.get() == record.get()) {
+          size_class.erase(jt);
+          return true;
+        }
+      }
+      NOTREACHED() << "Record missing from its size class.";
       return true;
     }
   }
@@ -410,6 +542,56 @@ bool ProcessState::Layer<RecordType>::RemoveRecord(const RecordPtr& record) {
   return false;
 }
 
+template <typename RecordType>
+void ProcessState::Layer<RecordType>::IndexRecord(
+    const RecordPtr& record, typename RecordMap::iterator* hint) {
+  DCHECK(hint != nullptr);
+
+  RecordMap& size_class = size_classes_[GetSizeClass(record->range().size())];
+  typename RecordMap::iterator position = *hint;
+  if (position != size_class.end())
+    ++position;
+  *hint = size_class.insert(position,
+                            std::make_pair(record->range().start(), record));
+}
+
+template <typename RecordType>
+template <typename Predicate>
+void ProcessState::Layer<RecordType>::GetIndexedRecords(
+    size_t size_class,
+    Address start,
+    Address end,
+    Predicate predicate,
+    std::vector<RecordPtr>* records) const {
+  DCHECK_GT(kSizeClassCount, size_class);
+  DCHECK_LE(start, end);
+  DCHECK(records != nullptr);
+
+  const RecordMap& records_by_start = size_classes_[size_class];
+  if (records_by_start.empty())
+    return;
+
+  auto it = records_by_start.lower_bound(start);
+  for (; it != records_by_start.end() && it->first <= end; ++it) {
+    AddressRange record_range = it->second->range();
+    DCHECK(record_range.IsValid());
+    if (predicate(record_range))
+      records->push_back(it->second);
+  }
+}
+
+// static
+template <typename RecordType>
+void ProcessState::Layer<RecordType>::SortRecords(
+    std::vector<RecordPtr>* records) {
+  DCHECK(records != nullptr);
+
+  std::stable_sort(records->begin(), records->end(),
+                   [](const RecordPtr& a, const RecordPtr& b) {
+                     return a->range().start() < b->range().start();
+                   });
+}
+
 }  // namespace refinery
 
 #endif  // SYZYGY_REFINERY_PROCESS_STATE_PROCESS_STATE_H_
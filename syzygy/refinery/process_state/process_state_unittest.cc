@@ -14,11 +14,14 @@
 
 #include "syzygy/refinery/process_state/process_state.h"
 
+#include <algorithm>
 #include <limits>
 #include <memory>
 #include <string>
 
+#include "base/rand_util.h"
 #include "base/strings/string_piece.h"
+#include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/refinery/process_state/process_state_util.h"
 #include "syzygy/refinery/process_state/refinery.pb.h"
@@ -403,6 +406,161 @@ TEST(ProcessStateTest, RemoveRecord) {
   ASSERT_FALSE(bytes_layer->RemoveRecord(record));
 }
 
+TEST(ProcessStateTest, CreateRecords) {
+  ProcessState report;
+  BytesLayerPtr bytes_layer;
+  report.FindOrCreateLayer(&bytes_layer);
+  ASSERT_TRUE(bytes_layer != nullptr);
+
+  BytesRecordPtr record;
+  bytes_layer->CreateRecord(AddressRange(100ULL, 4U), &record);
+
+  // Sorted ranges, followed by one that isn't.
+  std::vector<AddressRange> ranges;
+  ranges.push_back(AddressRange(80ULL, 4U));
+  ranges.push_back(AddressRange(84ULL, 64U));
+  ranges.push_back(AddressRange(84ULL, 4U));
+  ranges.push_back(AddressRange(120ULL, 1U));
+  ranges.push_back(AddressRange(60ULL, 8U));
+  std::vector<BytesRecordPtr> records;
+  bytes_layer->CreateRecords(ranges, &records);
+  ASSERT_EQ(ranges.size(), records.size());
+  for (size_t i = 0; i < ranges.size(); ++i)
+    EXPECT_EQ(ranges[i], records[i]->range());
+  ASSERT_EQ(6, bytes_layer->size());
+
+  // The records are found by every query.
+  std::vector<BytesRecordPtr> matching_records;
+  bytes_layer->GetRecordsAt(84ULL, &matching_records);
+  EXPECT_EQ(2, matching_records.size());
+  bytes_layer->GetRecordsSpanning(AddressRange(101ULL, 2U), &matching_records);
+  ASSERT_EQ(2, matching_records.size());
+  EXPECT_EQ(84ULL, matching_records[0]->range().start());
+  EXPECT_EQ(100ULL, matching_records[1]->range().start());
+  bytes_layer->GetRecordsIntersecting(AddressRange(60ULL, 61U),
+                                      &matching_records);
+  ASSERT_EQ(6, matching_records.size());
+  for (size_t i = 1; i < matching_records.size(); ++i) {
+    EXPECT_LE(matching_records[i - 1]->range().start(),
+              matching_records[i]->range().start());
+  }
+
+  ASSERT_TRUE(bytes_layer->RemoveRecord(records[1]));
+  bytes_layer->GetRecordsSpanning(AddressRange(101ULL, 2U), &matching_records);
+  ValidateSingleRecordMatch(AddressRange(100ULL, 4U), matching_records,
+                            "Case: Spanning record was removed");
+}
+
+TEST(ProcessStateTest, GetRecordsMatchesBruteForce) {
+  // Populate a layer with records of very different sizes, some of which
+  // overlap, and check queries against a scan of the whole layer.
+  ProcessState report;
+  BytesLayerPtr bytes_layer;
+  report.FindOrCreateLayer(&bytes_layer);
+  ASSERT_TRUE(bytes_layer != nullptr);
+
+  const int kMaxAddress = 100000;
+  std::vector<BytesRecordPtr> records;
+  for (size_t i = 0; i < 2000; ++i) {
+    Size size = 1U << base::RandInt(0, 16);
+    size += base::RandInt(0, size - 1);
+    BytesRecordPtr record;
+    bytes_layer->CreateRecord(
+        AddressRange(base::RandInt(0, kMaxAddress), size), &record);
+    records.push_back(record);
+  }
+  for (size_t i = 0; i < 500; ++i) {
+    size_t index = base::RandInt(0, static_cast<int>(records.size()) - 1);
+    ASSERT_TRUE(bytes_layer->RemoveRecord(records[index]));
+    records.erase(records.begin() + index);
+  }
+  ASSERT_EQ(records.size(), bytes_layer->size());
+
+  for (size_t i = 0; i < 1000; ++i) {
+    AddressRange range(base::RandInt(0, kMaxAddress),
+                       1U << base::RandInt(0, 12));
+    std::vector<BytesRecordPtr> expected_intersecting;
+    std::vector<BytesRecordPtr> expected_spanning;
+    for (BytesRecordPtr record : *bytes_layer) {
+      if (record->range().Intersects(range))
+        expected_intersecting.push_back(record);
+      if (record->range().Contains(range))
+        expected_spanning.push_back(record);
+    }
+
+    std::vector<BytesRecordPtr> intersecting;
+    bytes_layer->GetRecordsIntersecting(range, &intersecting);
+    std::vector<BytesRecordPtr> spanning;
+    bytes_layer->GetRecordsSpanning(range, &spanning);
+
+    // Records are returned by address, but the order of the records at a
+    // same address isn't specified.
+    ASSERT_EQ(expected_intersecting.size(), intersecting.size());
+    for (size_t j = 0; j < intersecting.size(); ++j) {
+      ASSERT_EQ(expected_intersecting[j]->range().start(),
+                intersecting[j]->range().start());
+      ASSERT_NE(expected_intersecting.end(),
+                std::find(expected_intersecting.begin(),
+                          expected_intersecting.end(), intersecting[j]));
+    }
+    ASSERT_EQ(expected_spanning.size(), spanning.size());
+    for (size_t j = 0; j < spanning.size(); ++j) {
+      ASSERT_EQ(expected_spanning[j]->range().start(),
+                spanning[j]->range().start());
+      ASSERT_NE(expected_spanning.end(),
+                std::find(expected_spanning.begin(), expected_spanning.end(),
+                          spanning[j]));
+    }
+  }
+}
+
+// Measures the cost of queries as the number of records grows, which should
+// be logarithmic. This is disabled as it takes a while to run.
+TEST(ProcessStateTest, DISABLED_GetRecordsScaling) {
+  const size_t kQueryCount = 100000;
+
+  for (size_t record_count = 1000; record_count <= 10000000;
+       record_count *= 10) {
+    ProcessState report;
+    BytesLayerPtr bytes_layer;
+    report.FindOrCreateLayer(&bytes_layer);
+
+    // Lay out records like heap allocations: mostly small, with some large.
+    std::vector<AddressRange> ranges;
+    ranges.reserve(record_count);
+    Address address = 0x10000000ULL;
+    for (size_t i = 0; i < record_count; ++i) {
+      Size size = i % 64 == 0 ? 64 * 1024 : 16U * (1 + i % 8);
+      ranges.push_back(AddressRange(address, size));
+      address += size + 16;
+    }
+
+    base::TimeTicks start = base::TimeTicks::Now();
+    std::vector<BytesRecordPtr> records;
+    bytes_layer->CreateRecords(ranges, &records);
+    base::TimeDelta insertion_time = base::TimeTicks::Now() - start;
+
+    start = base::TimeTicks::Now();
+    std::vector<BytesRecordPtr> matching_records;
+    size_t match_count = 0;
+    for (size_t i = 0; i < kQueryCount; ++i) {
+      const AddressRange& range = ranges[(i * 7919) % record_count];
+      bytes_layer->GetRecordsIntersecting(
+          AddressRange(range.start() + 8, 64U), &matching_records);
+      match_count += matching_records.size();
+      bytes_layer->GetRecordsSpanning(AddressRange(range.start(), 1U),
+                                      &matching_records);
+      match_count += matching_records.size();
+    }
+    base::TimeDelta query_time = base::TimeTicks::Now() - start;
+
+    LOG(INFO) << record_count << " records: "
+              << insertion_time.InMilliseconds() << " ms to insert, "
+              << query_time.InMicroseconds() * 1000 / (2 * kQueryCount)
+              << " ns per query (" << match_count << " matches).";
+  }
+}
+
 TEST(ProcessStateTest, LayerIteration) {
   // Create a report that has a Bytes layer with few records.
   ProcessState report;
@@ -68,6 +68,7 @@
         'types/typed_data_unittest.cc',
         'types/dia_crawler_unittest.cc',
         'types/pdb_crawler_unittest.cc',
+        'types/serialized_type_repository_unittest.cc',
         'types/type_namer_unittest.cc',
         'validators/exception_handler_validator_unittest.cc',
         'validators/vftable_ptr_validator_unittest.cc',
@@ -138,9 +139,11 @@
         'analyzers/analyzers.gyp:analyzers_lib',
         'core/core.gyp:refinery_core_lib',
         'process_state/process_state.gyp:process_state_lib',
+        'symbols/symbols.gyp:symbols_lib',
         'types/types.gyp:types_lib',
         'validators/validators.gyp:validators_lib',
         '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/core/core.gyp:core_lib',
         '<(src)/syzygy/minidump/minidump.gyp:minidump_lib',
       ],
     },
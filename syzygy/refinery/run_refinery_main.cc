@@ -12,15 +12,29 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-// Runs the refinery over a minidump and outputs the validation report.
+// Runs the refinery over minidumps and outputs the validation reports.
 
+#include <stdio.h>
+
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include "base/command_line.h"
 #include "base/logging.h"
+#include "base/files/file_enumerator.h"
 #include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
+#include "base/time/time.h"
+#include "base/win/scoped_com_initializer.h"
+#include "syzygy/core/json_file_writer.h"
 #include "syzygy/minidump/minidump.h"
 #include "syzygy/refinery/analyzers/analysis_runner.h"
 #include "syzygy/refinery/analyzers/analyzer_util.h"
@@ -48,23 +62,99 @@ using refinery::Validator;
 
 const char kUsage[] =
   "Usage: %ls --dump=<dump file>\n"
+  "       %ls [options] <dump files or directories>\n"
   "\n"
   "  Runs the refinery analysis and validation, then prints the validation \n"
-  "  report.\n";
-
-bool ParseCommandLine(const base::CommandLine* cmd,
-                      base::FilePath* dump_path) {
-  *dump_path = cmd->GetSwitchValuePath("dump");
-  if (dump_path->empty()) {
-    LOG(ERROR) << "Missing dump file.";
-    LOG(ERROR) << base::StringPrintf(kUsage, cmd->GetProgram().value().c_str());
-    return false;
+  "  report.\n"
+  "  Given dump files or directories of dump files, runs in batch mode. The\n"
+  "  dumps are processed concurrently, sharing their symbol caches, and the\n"
+  "  reports are streamed out as JSON along with latency and cache\n"
+  "  statistics.\n"
+  "\n"
+  "  --jobs=<number>\n"
+  "     The number of dumps to process concurrently in batch mode.\n"
+  "     Default value: the number of processors.\n"
+  "  --max-cached-types=<number>\n"
+  "     The number of types above which the symbol caches evict their least\n"
+  "     recently used modules in batch mode.\n"
+  "     Default value: 0, for unbounded caches.\n"
+  "  --type-cache-dir=<directory>\n"
+  "     The directory where the types of the modules are persisted across\n"
+  "     runs, which saves crawling their PDBs again.\n";
+
+struct Options {
+  Options() : jobs(0U), max_cached_types(0U) {}
+
+  // The dump to process, in single dump mode.
+  base::FilePath dump_path;
+  // The dumps to process, in batch mode.
+  std::vector<base::FilePath> batch_paths;
+  // The directory where types are persisted, if any.
+  base::FilePath type_cache_dir;
+  size_t jobs;
+  size_t max_cached_types;
+};
+
+bool PrintUsage(const base::CommandLine* cmd, const char* message) {
+  LOG(ERROR) << message;
+  LOG(ERROR) << base::StringPrintf(kUsage, cmd->GetProgram().value().c_str(),
+                                   cmd->GetProgram().value().c_str());
+  return false;
+}
+
+bool ParseSizeSwitch(const base::CommandLine* cmd,
+                     const char* name,
+                     size_t* value) {
+  DCHECK(value);
+  if (!cmd->HasSwitch(name))
+    return true;
+  return base::StringToSizeT(cmd->GetSwitchValueASCII(name), value);
+}
+
+bool ParseCommandLine(const base::CommandLine* cmd, Options* options) {
+  DCHECK(options);
+
+  options->dump_path = cmd->GetSwitchValuePath("dump");
+
+  // Collect the batch mode dumps.
+  for (const auto& arg : cmd->GetArgs()) {
+    base::FilePath path(arg);
+    if (!base::DirectoryExists(path)) {
+      options->batch_paths.push_back(path);
+      continue;
+    }
+
+    base::FileEnumerator enumerator(path, false, base::FileEnumerator::FILES,
+                                    L"*.dmp");
+    for (base::FilePath dump = enumerator.Next(); !dump.empty();
+         dump = enumerator.Next()) {
+      options->batch_paths.push_back(dump);
+    }
+  }
+  std::sort(options->batch_paths.begin(), options->batch_paths.end());
+
+  if (options->dump_path.empty() == options->batch_paths.empty())
+    return PrintUsage(cmd, "Expected either a dump file or batch mode dumps.");
+
+  options->jobs = base::SysInfo::NumberOfProcessors();
+  if (!ParseSizeSwitch(cmd, "jobs", &options->jobs) || options->jobs == 0U)
+    return PrintUsage(cmd, "Invalid number of jobs.");
+  if (!ParseSizeSwitch(cmd, "max-cached-types", &options->max_cached_types))
+    return PrintUsage(cmd, "Invalid number of cached types.");
+
+  options->type_cache_dir = cmd->GetSwitchValuePath("type-cache-dir");
+  if (!options->type_cache_dir.empty() &&
+      !base::CreateDirectory(options->type_cache_dir)) {
+    return PrintUsage(cmd, "Unable to create the type cache directory.");
   }
 
   return true;
 }
 
-bool Analyze(const Minidump& minidump, ProcessState* process_state) {
+bool Analyze(const Minidump& minidump,
+             scoped_refptr<refinery::SymbolProvider> symbol_provider,
+             scoped_refptr<refinery::DiaSymbolProvider> dia_symbol_provider,
+             ProcessState* process_state) {
   AnalysisRunner runner;
 
   std::unique_ptr<Analyzer> analyzer(new refinery::MemoryAnalyzer());
@@ -80,11 +170,6 @@ bool Analyze(const Minidump& minidump, ProcessState* process_state) {
   analyzer.reset(new refinery::StackAnalyzer());
   runner.AddAnalyzer(std::move(analyzer));
 
-  scoped_refptr<refinery::SymbolProvider> symbol_provider(
-      new refinery::SymbolProvider());
-  scoped_refptr<refinery::DiaSymbolProvider> dia_symbol_provider(
-      new refinery::DiaSymbolProvider());
-
   refinery::SimpleProcessAnalysis analysis(process_state, dia_symbol_provider,
                                            symbol_provider);
 
@@ -102,31 +187,241 @@ bool Validate(ProcessState* process_state, ValidationReport* report) {
   return true;
 }
 
+bool ProcessDump(
+    const base::FilePath& dump_path,
+    scoped_refptr<refinery::SymbolProvider> symbol_provider,
+    scoped_refptr<refinery::DiaSymbolProvider> dia_symbol_provider,
+    ValidationReport* report) {
+  minidump::MappedMinidump minidump;
+  if (!minidump.Open(dump_path)) {
+    LOG(ERROR) << "Unable to open dump file " << dump_path.value();
+    return false;
+  }
+
+  ProcessState process_state;
+  return Analyze(minidump, symbol_provider, dia_symbol_provider,
+                 &process_state) &&
+         Validate(&process_state, report);
+}
+
+// Processes minidumps concurrently and streams their validation reports out
+// as a JSON document. The type repositories are shared by all the dumps,
+// while each worker thread has its own DIA symbol provider, as DIA sessions
+// aren't shared across threads.
+class BatchProcessor : public base::DelegateSimpleThread::Delegate {
+ public:
+  BatchProcessor(const std::vector<base::FilePath>& dump_paths,
+                 size_t max_cached_types,
+                 const base::FilePath& type_cache_dir,
+                 FILE* output);
+
+  // Processes the dumps.
+  // @param jobs the number of dumps to process concurrently.
+  // @returns true if all the dumps were processed successfully.
+  bool Process(size_t jobs);
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // Processes dumps until there are none left.
+  // @{
+  void Run() override;
+  // @}
+
+ private:
+  // Gets the next dump to process.
+  // @returns false if there are none left.
+  bool GetNextDump(base::FilePath* dump_path);
+
+  // Outputs the result of processing a dump.
+  void OutputResult(const base::FilePath& dump_path,
+                    bool success,
+                    base::TimeDelta latency,
+                    const ValidationReport& report);
+
+  // Outputs the statistics of a symbol cache, under @p name.
+  void OutputCacheStatistics(
+      const char* name,
+      const refinery::SymbolProvider::CacheStatistics& statistics);
+
+  // Outputs the latency and cache statistics of the batch.
+  void OutputSummary();
+
+  const std::vector<base::FilePath>& dump_paths_;
+  scoped_refptr<refinery::SymbolProvider> symbol_provider_;
+
+  // Protects the members below.
+  base::Lock lock_;
+  size_t next_dump_;
+  size_t failure_count_;
+  base::TimeDelta total_latency_;
+  base::TimeDelta max_latency_;
+  core::JSONFileWriter writer_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchProcessor);
+};
+
+BatchProcessor::BatchProcessor(const std::vector<base::FilePath>& dump_paths,
+                               size_t max_cached_types,
+                               const base::FilePath& type_cache_dir,
+                               FILE* output)
+    : dump_paths_(dump_paths),
+      next_dump_(0U),
+      failure_count_(0U),
+      writer_(output, false) {
+  if (max_cached_types != 0U)
+    symbol_provider_ = new refinery::SymbolProvider(max_cached_types);
+  else
+    symbol_provider_ = new refinery::SymbolProvider();
+  symbol_provider_->set_type_repository_dir(type_cache_dir);
+}
+
+bool BatchProcessor::Process(size_t jobs) {
+  DCHECK_LT(0U, jobs);
+
+  writer_.OpenDict();
+  writer_.OutputKey("results");
+  writer_.OpenList();
+  writer_.Flush();
+
+  int thread_count = static_cast<int>(std::min(jobs, dump_paths_.size()));
+  base::DelegateSimpleThreadPool pool("BatchProcessor", thread_count);
+  pool.Start();
+  pool.AddWork(this, thread_count);
+  pool.JoinAll();
+
+  writer_.CloseList();
+  OutputSummary();
+  writer_.CloseDict();
+  writer_.Flush();
+
+  return failure_count_ == 0U;
+}
+
+void BatchProcessor::Run() {
+  base::win::ScopedCOMInitializer com_initializer;
+  scoped_refptr<refinery::DiaSymbolProvider> dia_symbol_provider(
+      new refinery::DiaSymbolProvider());
+
+  base::FilePath dump_path;
+  while (GetNextDump(&dump_path)) {
+    base::TimeTicks start = base::TimeTicks::Now();
+    ValidationReport report;
+    bool success = ProcessDump(dump_path, symbol_provider_,
+                               dia_symbol_provider, &report);
+    OutputResult(dump_path, success, base::TimeTicks::Now() - start, report);
+  }
+}
+
+bool BatchProcessor::GetNextDump(base::FilePath* dump_path) {
+  DCHECK(dump_path);
+
+  base::AutoLock lock(lock_);
+  if (next_dump_ == dump_paths_.size())
+    return false;
+
+  *dump_path = dump_paths_[next_dump_++];
+  return true;
+}
+
+void BatchProcessor::OutputResult(const base::FilePath& dump_path,
+                                  bool success,
+                                  base::TimeDelta latency,
+                                  const ValidationReport& report) {
+  base::AutoLock lock(lock_);
+
+  if (!success)
+    ++failure_count_;
+  total_latency_ += latency;
+  max_latency_ = std::max(max_latency_, latency);
+
+  writer_.OpenDict();
+  writer_.OutputKey("dump");
+  writer_.OutputString(dump_path.value());
+  writer_.OutputKey("success");
+  writer_.OutputBoolean(success);
+  writer_.OutputKey("latency_ms");
+  writer_.OutputDouble(latency.InMillisecondsF());
+  writer_.OutputKey("violations");
+  writer_.OpenList();
+  for (const auto& violation : report.error()) {
+    writer_.OpenDict();
+    writer_.OutputKey("type");
+    writer_.OutputString(refinery::ViolationType_Name(violation.type()));
+    writer_.OutputKey("description");
+    writer_.OutputString(violation.description());
+    writer_.CloseDict();
+  }
+  writer_.CloseList();
+  writer_.CloseDict();
+  writer_.Flush();
+}
+
+void BatchProcessor::OutputCacheStatistics(
+    const char* name,
+    const refinery::SymbolProvider::CacheStatistics& statistics) {
+  size_t lookups = statistics.hits + statistics.misses;
+
+  writer_.OutputKey(name);
+  writer_.OpenDict();
+  writer_.OutputKey("hits");
+  writer_.OutputInteger(static_cast<int>(statistics.hits));
+  writer_.OutputKey("misses");
+  writer_.OutputInteger(static_cast<int>(statistics.misses));
+  writer_.OutputKey("hit_rate");
+  writer_.OutputDouble(lookups == 0U ? 0.0 : static_cast<double>(
+                                                 statistics.hits) / lookups);
+  writer_.OutputKey("evictions");
+  writer_.OutputInteger(static_cast<int>(statistics.evictions));
+  writer_.OutputKey("cached_types");
+  writer_.OutputInteger(static_cast<int>(statistics.cost));
+  writer_.CloseDict();
+}
+
+void BatchProcessor::OutputSummary() {
+  base::AutoLock lock(lock_);
+
+  writer_.OutputKey("summary");
+  writer_.OpenDict();
+  writer_.OutputKey("dumps");
+  writer_.OutputInteger(static_cast<int>(dump_paths_.size()));
+  writer_.OutputKey("failures");
+  writer_.OutputInteger(static_cast<int>(failure_count_));
+  writer_.OutputKey("mean_latency_ms");
+  writer_.OutputDouble(total_latency_.InMillisecondsF() / dump_paths_.size());
+  writer_.OutputKey("max_latency_ms");
+  writer_.OutputDouble(max_latency_.InMillisecondsF());
+  OutputCacheStatistics("type_repository_cache",
+                        symbol_provider_->GetTypeRepositoryCacheStatistics());
+  OutputCacheStatistics("type_name_index_cache",
+                        symbol_provider_->GetTypeNameIndexCacheStatistics());
+  writer_.CloseDict();
+}
+
 }  // namespace
 
 int main(int argc, const char* const* argv) {
   base::CommandLine::Init(argc, argv);
 
-  // Get the dump.
-  base::FilePath dump_path;
-  if (!ParseCommandLine(base::CommandLine::ForCurrentProcess(), &dump_path))
+  Options options;
+  if (!ParseCommandLine(base::CommandLine::ForCurrentProcess(), &options))
     return 1;
 
-  minidump::FileMinidump minidump;
-  if (!minidump.Open(dump_path)) {
-    LOG(ERROR) << "Unable to open dump file.";
-    return 1;
+  if (!options.batch_paths.empty()) {
+    BatchProcessor processor(options.batch_paths, options.max_cached_types,
+                             options.type_cache_dir, stdout);
+    return processor.Process(options.jobs) ? 0 : 1;
   }
 
-  // Analyze.
-  ProcessState process_state;
-  if (!Analyze(minidump, &process_state))
-    return 1;
-
-  // Validate and output.
+  // Analyze and validate the dump.
+  scoped_refptr<refinery::SymbolProvider> symbol_provider(
+      new refinery::SymbolProvider());
+  symbol_provider->set_type_repository_dir(options.type_cache_dir);
+  scoped_refptr<refinery::DiaSymbolProvider> dia_symbol_provider(
+      new refinery::DiaSymbolProvider());
   ValidationReport report;
-  if (!Validate(&process_state, &report))
+  if (!ProcessDump(options.dump_path, symbol_provider, dia_symbol_provider,
+                   &report)) {
     return 1;
+  }
 
   std::cout << "Validation report:";
   std::cout << report.DebugString();
@@ -15,22 +15,58 @@
 #ifndef SYZYGY_REFINERY_SYMBOLS_SIMPLE_CACHE_H_
 #define SYZYGY_REFINERY_SYMBOLS_SIMPLE_CACHE_H_
 
+#include <list>
+#include <unordered_map>
+
 #include "base/callback.h"
 #include "base/logging.h"
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
 #include "base/strings/string16.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/platform_thread.h"
 
 namespace refinery {
 
+// The statistics of a SimpleCache.
+struct SimpleCacheStatistics {
+  // The number of lookups that found an entry, negative or not.
+  size_t hits;
+  // The number of lookups that didn't find an entry.
+  size_t misses;
+  // The number of entries evicted to honor the bound.
+  size_t evictions;
+  // The total cost of the entries in the cache.
+  size_t cost;
+};
+
 // A simple cache which uses negative entries in the form of null pointers.
+// The cache is thread safe. Concurrent requests for an entry that is being
+// loaded wait for the load to complete rather than loading it again.
+// The cache may be bounded, in which case its least recently used entries are
+// evicted once the total cost of its entries exceeds the bound.
 template <typename EntryType>
 class SimpleCache {
  public:
   typedef base::Callback<bool(scoped_refptr<EntryType>*)> LoadingCallback;
+  // Returns the cost of an entry, in units of the cache's bound.
+  typedef base::Callback<size_t(const EntryType&)> CostCallback;
+
+  typedef SimpleCacheStatistics Statistics;
+
+  // Creates an unbounded cache.
+  SimpleCache();
+
+  // Creates a bounded cache.
+  // @param max_cost the total cost of the entries above which the least
+  //     recently used entries are evicted. The most recently used entry is
+  //     never evicted.
+  // @param cost_cb the callback computing the cost of an entry. Negative
+  //     entries are free.
+  SimpleCache(size_t max_cost, const CostCallback& cost_cb);
 
-  SimpleCache() {}
   ~SimpleCache() {}
 
   // Retrieves a cache entry.
@@ -38,9 +74,12 @@ class SimpleCache {
   // @param entry on success, returns the desired entry or nullptr to indicate a
   //     negative entry.
   // @returns true if the cache contains an entry for @p key, false otherwise.
+  //     Entries being loaded aren't in the cache yet.
   bool Get(const base::string16& key, scoped_refptr<EntryType>* entry) const;
 
   // Retrieves a cache entry, loading it if required.
+  // @note if @p load_cb requests the entry being loaded, it gets a negative
+  //     entry.
   // @param key the desired entry's cache key.
   // @param load_cb a LoadingCallback for use if the entry is not in cache.
   // @param entry on success, returns the desired entry or nullptr to indicate a
@@ -55,23 +94,101 @@ class SimpleCache {
   // @param entry the entry to store at @p key.
   void Store(const base::string16& key, scoped_refptr<EntryType> entry);
 
+  // @returns the statistics of the cache.
+  Statistics GetStatistics() const;
+
  private:
-  std::unordered_map<base::string16, scoped_refptr<EntryType>> entries_;
+  typedef std::list<base::string16> KeyList;
+
+  struct CacheEntry {
+    CacheEntry() : cost(0U), loading(false), loading_thread(0) {}
+
+    scoped_refptr<EntryType> entry;
+    size_t cost;
+    // True while the entry is being loaded, by |loading_thread|.
+    bool loading;
+    base::PlatformThreadId loading_thread;
+    // The position of the entry's key in |lru_keys_|.
+    typename KeyList::iterator lru_position;
+  };
+  typedef std::unordered_map<base::string16, CacheEntry> EntryMap;
+
+  // @returns the cost of @p entry.
+  size_t GetCost(const scoped_refptr<EntryType>& entry) const;
+
+  // Marks @p it as the most recently used entry.
+  // @pre lock_ must be held.
+  void Touch(typename EntryMap::const_iterator it) const;
+
+  // Sets the entry of @p it, and evicts entries as required by the bound.
+  // @pre lock_ must be held.
+  void SetEntry(typename EntryMap::iterator it,
+                scoped_refptr<EntryType> entry,
+                size_t cost);
+
+  // @returns an iterator to the entry at @p key, created if required.
+  // @pre lock_ must be held.
+  typename EntryMap::iterator FindOrCreateEntry(const base::string16& key);
+
+  const size_t max_cost_;
+  const CostCallback cost_cb_;
+
+  // Protects the members below.
+  mutable base::Lock lock_;
+  // Signaled when an entry is done loading.
+  base::ConditionVariable entry_loaded_;
+
+  EntryMap entries_;
+  // The keys of the entries, from most to least recently used.
+  mutable KeyList lru_keys_;
+
+  size_t cost_;
+  mutable size_t hits_;
+  mutable size_t misses_;
+  size_t evictions_;
 
   DISALLOW_COPY_AND_ASSIGN(SimpleCache);
 };
 
+template <typename EntryType>
+SimpleCache<EntryType>::SimpleCache()
+    : max_cost_(0U),
+      entry_loaded_(&lock_),
+      cost_(0U),
+      hits_(0U),
+      misses_(0U),
+      evictions_(0U) {
+}
+
+template <typename EntryType>
+SimpleCache<EntryType>::SimpleCache(size_t max_cost,
+                                    const CostCallback& cost_cb)
+    : max_cost_(max_cost),
+      cost_cb_(cost_cb),
+      entry_loaded_(&lock_),
+      cost_(0U),
+      hits_(0U),
+      misses_(0U),
+      evictions_(0U) {
+  DCHECK(!cost_cb.is_null());
+}
+
 template <typename EntryType>
 bool SimpleCache<EntryType>::Get(const base::string16& key,
                                  scoped_refptr<EntryType>* entry) const {
   DCHECK(entry);
   *entry = nullptr;
 
+  base::AutoLock lock(lock_);
   auto it = entries_.find(key);
-  if (it == entries_.end())
+  if (it == entries_.end() || it->second.loading) {
+    ++misses_;
     return false;  // Not present in the cache.
+  }
 
-  *entry = it->second;
+  ++hits_;
+  Touch(it);
+  *entry = it->second.entry;
   return true;
 }
 
@@ -82,23 +199,141 @@ void SimpleCache<EntryType>::GetOrLoad(const base::string16& key,
   DCHECK(entry);
   *entry = nullptr;
 
-  if (Get(key, entry))
-    return;  // There's a pre-existing entry.
+  base::PlatformThreadId thread_id = base::PlatformThread::CurrentId();
+  base::AutoLock lock(lock_);
+  while (true) {
+    auto it = entries_.find(key);
+    if (it == entries_.end())
+      break;
+
+    if (!it->second.loading) {
+      // There's a pre-existing entry.
+      ++hits_;
+      Touch(it);
+      *entry = it->second.entry;
+      return;
+    }
+
+    // A recursive request from the loading thread gets a negative entry.
+    if (it->second.loading_thread == thread_id) {
+      ++hits_;
+      return;
+    }
+
+    // Wait for the other thread to load the entry.
+    entry_loaded_.Wait();
+  }
 
   // No entry in the cache. Create a negative cache entry, which will be
   // replaced on success.
-  Store(key, *entry);
+  ++misses_;
+  auto it = FindOrCreateEntry(key);
+  it->second.loading = true;
+  it->second.loading_thread = thread_id;
+
+  bool loaded = false;
+  size_t cost = 0U;
+  {
+    base::AutoUnlock unlock(lock_);
+    loaded = load_cb.Run(entry);
+    if (loaded)
+      cost = GetCost(*entry);
+  }
 
-  if (!load_cb.Run(entry))
-    return;  // Load failed. Keep the negative entry.
+  // The entry may have been stored while loading, but not evicted.
+  it = entries_.find(key);
+  DCHECK(it != entries_.end());
+  it->second.loading = false;
+  if (loaded) {
+    // Load succeeded, replace the negative entry.
+    SetEntry(it, *entry, cost);
+  } else {
+    // Load failed. Keep the negative entry.
+    *entry = it->second.entry;
+  }
 
-  Store(key, *entry);
+  entry_loaded_.Broadcast();
 }
 
 template <typename EntryType>
 void SimpleCache<EntryType>::Store(const base::string16& key,
                                    scoped_refptr<EntryType> entry) {
-  entries_[key] = entry;
+  size_t cost = GetCost(entry);
+
+  base::AutoLock lock(lock_);
+  SetEntry(FindOrCreateEntry(key), entry, cost);
+}
+
+template <typename EntryType>
+SimpleCacheStatistics SimpleCache<EntryType>::GetStatistics() const {
+  base::AutoLock lock(lock_);
+  Statistics statistics = {hits_, misses_, evictions_, cost_};
+  return statistics;
+}
+
+template <typename EntryType>
+size_t SimpleCache<EntryType>::GetCost(
+    const scoped_refptr<EntryType>& entry) const {
+  if (cost_cb_.is_null() || entry.get() == nullptr)
+    return 0U;
+  return cost_cb_.Run(*entry);
+}
+
+template <typename EntryType>
+void SimpleCache<EntryType>::Touch(
+    typename EntryMap::const_iterator it) const {
+  lock_.AssertAcquired();
+  lru_keys_.splice(lru_keys_.begin(), lru_keys_, it->second.lru_position);
+}
+
+template <typename EntryType>
+void SimpleCache<EntryType>::SetEntry(typename EntryMap::iterator it,
+                                      scoped_refptr<EntryType> entry,
+                                      size_t cost) {
+  lock_.AssertAcquired();
+
+  cost_ -= it->second.cost;
+  it->second.entry = entry;
+  it->second.cost = cost;
+  cost_ += cost;
+  Touch(it);
+
+  if (cost_cb_.is_null())
+    return;
+
+  // Evict the least recently used entries, sparing the entry just set.
+  // Negative entries are free, so they're never evicted, and neither are the
+  // entries being loaded.
+  auto key_it = lru_keys_.end();
+  --key_it;
+  while (cost_ > max_cost_ && key_it != lru_keys_.begin()) {
+    auto victim = entries_.find(*key_it);
+    DCHECK(victim != entries_.end());
+    if (victim->second.cost == 0U || victim->second.loading) {
+      --key_it;
+      continue;
+    }
+
+    cost_ -= victim->second.cost;
+    ++evictions_;
+    entries_.erase(victim);
+    key_it = lru_keys_.erase(key_it);
+    --key_it;
+  }
+}
+
+template <typename EntryType>
+typename SimpleCache<EntryType>::EntryMap::iterator
+SimpleCache<EntryType>::FindOrCreateEntry(const base::string16& key) {
+  lock_.AssertAcquired();
+
+  auto it = entries_.find(key);
+  if (it != entries_.end())
+    return it;
+
+  it = entries_.insert(std::make_pair(key, CacheEntry())).first;
+  it->second.lru_position = lru_keys_.insert(lru_keys_.begin(), key);
+  return it;
 }
 
 }  // namespace refinery
@@ -24,11 +24,15 @@ namespace refinery {
 namespace {
 
 const wchar_t kCacheKeyOne[] = L"cache-key-one";
+const wchar_t kCacheKeyTwo[] = L"cache-key-two";
+const wchar_t kCacheKeyThree[] = L"cache-key-three";
 
 class SimpleEntry : public base::RefCounted<SimpleEntry> {
  public:
   explicit SimpleEntry(int value) : value_(value) {}
 
+  int value() const { return value_; }
+
   bool operator==(const SimpleEntry& other) const {
     return value_ == other.value_;
   }
@@ -68,6 +72,10 @@ class SimpleCacheLoadingTest : public testing::Test {
   int load_cnt_;
 };
 
+size_t GetCost(const SimpleEntry& entry) {
+  return entry.value();
+}
+
 }  // namespace
 
 TEST(SimpleCacheTest, BasicTest) {
@@ -140,5 +148,55 @@ TEST_F(SimpleCacheLoadingTest, LoadingSucceedsTest) {
   ASSERT_EQ(1, load_cnt());
 }
 
+TEST(SimpleCacheTest, BoundedCacheEvictsLeastRecentlyUsed) {
+  SimpleCache<SimpleEntry> cache(5U, base::Bind(&GetCost));
+
+  cache.Store(kCacheKeyOne, new SimpleEntry(2));
+  cache.Store(kCacheKeyTwo, new SimpleEntry(2));
+  EXPECT_EQ(4U, cache.GetStatistics().cost);
+
+  // Use the first entry, such that the second one is the least recently used.
+  scoped_refptr<SimpleEntry> retrieved;
+  ASSERT_TRUE(cache.Get(kCacheKeyOne, &retrieved));
+
+  // Exceeding the bound evicts the second entry.
+  cache.Store(kCacheKeyThree, new SimpleEntry(2));
+  EXPECT_TRUE(cache.Get(kCacheKeyOne, &retrieved));
+  EXPECT_FALSE(cache.Get(kCacheKeyTwo, &retrieved));
+  EXPECT_TRUE(cache.Get(kCacheKeyThree, &retrieved));
+
+  SimpleCache<SimpleEntry>::Statistics statistics = cache.GetStatistics();
+  EXPECT_EQ(1U, statistics.evictions);
+  EXPECT_EQ(4U, statistics.cost);
+
+  // Negative entries are free.
+  cache.Store(kCacheKeyTwo, nullptr);
+  EXPECT_EQ(4U, cache.GetStatistics().cost);
+
+  // The most recently used entry is kept even when it exceeds the bound.
+  cache.Store(kCacheKeyOne, new SimpleEntry(10));
+  EXPECT_TRUE(cache.Get(kCacheKeyOne, &retrieved));
+  EXPECT_EQ(10, retrieved->value());
+  EXPECT_FALSE(cache.Get(kCacheKeyThree, &retrieved));
+  EXPECT_EQ(10U, cache.GetStatistics().cost);
+}
+
+TEST_F(SimpleCacheLoadingTest, Statistics) {
+  SimpleCache<SimpleEntry> cache;
+  SimpleCache<SimpleEntry>::LoadingCallback load_cb =
+      base::Bind(&SimpleCacheLoadingTest::Load, base::Unretained(this));
+
+  scoped_refptr<SimpleEntry> retrieved;
+  cache.GetOrLoad(kCacheKeyOne, load_cb, &retrieved);
+  cache.GetOrLoad(kCacheKeyOne, load_cb, &retrieved);
+  cache.Get(kCacheKeyOne, &retrieved);
+  cache.Get(kCacheKeyTwo, &retrieved);
+
+  SimpleCache<SimpleEntry>::Statistics statistics = cache.GetStatistics();
+  EXPECT_EQ(2U, statistics.hits);
+  EXPECT_EQ(2U, statistics.misses);
+  EXPECT_EQ(0U, statistics.evictions);
+  EXPECT_EQ(0U, statistics.cost);
+}
 
 }  // namespace refinery
@@ -15,15 +15,25 @@
 #include "syzygy/refinery/symbols/symbol_provider.h"
 
 #include "base/bind.h"
+#include "base/logging.h"
 #include "base/strings/stringprintf.h"
 #include "syzygy/refinery/symbols/symbol_provider_util.h"
 #include "syzygy/refinery/types/pdb_crawler.h"
+#include "syzygy/refinery/types/serialized_type_repository.h"
 
 namespace refinery {
 
 SymbolProvider::SymbolProvider() {
 }
 
+SymbolProvider::SymbolProvider(size_t max_cached_types)
+    : type_repos_(max_cached_types,
+                  base::Bind(&SymbolProvider::GetCacheCost<TypeRepository>)),
+      typename_indices_(
+          max_cached_types,
+          base::Bind(&SymbolProvider::GetCacheCost<TypeNameIndex>)) {
+}
+
 SymbolProvider::~SymbolProvider() {
 }
 
@@ -76,6 +86,16 @@ bool SymbolProvider::GetVFTableRVAs(
   return crawler.GetVFTableRVAs(vftable_rvas);
 }
 
+SymbolProvider::CacheStatistics
+SymbolProvider::GetTypeRepositoryCacheStatistics() const {
+  return type_repos_.GetStatistics();
+}
+
+SymbolProvider::CacheStatistics
+SymbolProvider::GetTypeNameIndexCacheStatistics() const {
+  return typename_indices_.GetStatistics();
+}
+
 void SymbolProvider::GetCacheKey(const pe::PEFile::Signature& signature,
                                  base::string16* cache_key) {
   DCHECK(cache_key);
@@ -86,23 +106,54 @@ void SymbolProvider::GetCacheKey(const pe::PEFile::Signature& signature,
                       signature.module_time_date_stamp);
 }
 
+base::FilePath SymbolProvider::GetTypeRepositoryPath(
+    const pe::PEFile::Signature& signature) const {
+  DCHECK(!type_repository_dir_.empty());
+  return type_repository_dir_.Append(base::StringPrintf(
+      L"%ls-%08X-%08X-%08X.types",
+      base::FilePath(signature.path).BaseName().value().c_str(),
+      signature.module_size, signature.module_checksum,
+      signature.module_time_date_stamp));
+}
+
+// static
+template <typename EntryType>
+size_t SymbolProvider::GetCacheCost(const EntryType& entry) {
+  return entry.size();
+}
+
 bool SymbolProvider::CreateTypeRepository(
     const pe::PEFile::Signature& signature,
     scoped_refptr<TypeRepository>* type_repo) {
   DCHECK(type_repo);
   *type_repo = nullptr;
 
+  // Try the persisted type repository first.
+  base::FilePath persisted_path;
+  if (!type_repository_dir_.empty()) {
+    persisted_path = GetTypeRepositoryPath(signature);
+    if (LoadTypeRepository(signature, persisted_path, type_repo))
+      return true;
+  }
+
   base::FilePath pdb_path;
   if (!GetPdbPath(signature, &pdb_path))
     return false;
 
-  scoped_refptr<TypeRepository> repository = new TypeRepository();
+  scoped_refptr<TypeRepository> repository = new TypeRepository(signature);
   PdbCrawler crawler;
   if (!crawler.InitializeForFile(pdb_path) ||
       !crawler.GetTypes(repository.get())) {
     return false;
   }
 
+  // Failing to persist the repository only costs future runs a crawl.
+  if (!persisted_path.empty() &&
+      !SaveTypeRepository(signature, *repository, persisted_path)) {
+    LOG(WARNING) << "Unable to persist the types of "
+                 << signature.path << ".";
+  }
+
   *type_repo = repository;
   return true;
 }
@@ -19,6 +19,7 @@
 
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
+#include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
 #include "base/strings/string16.h"
 #include "syzygy/pe/pe_file.h"
@@ -29,10 +30,19 @@
 namespace refinery {
 
 // The SymbolProvider provides symbol information. See DiaSymbolProvider for an
-// alternative.
-class SymbolProvider : public base::RefCounted<SymbolProvider> {
+// alternative. A symbol provider may be shared across threads, for instance to
+// share its caches across the analyses of multiple minidumps.
+class SymbolProvider : public base::RefCountedThreadSafe<SymbolProvider> {
  public:
+  typedef SimpleCacheStatistics CacheStatistics;
+
+  // Creates a symbol provider with unbounded caches.
   SymbolProvider();
+  // Creates a symbol provider with bounded caches.
+  // @param max_cached_types the number of types above which each of the caches
+  //     evicts its least recently used entries. The memory used by the caches
+  //     is roughly proportional to their number of types.
+  explicit SymbolProvider(size_t max_cached_types);
   // @note virtual to enable mocking.
   virtual ~SymbolProvider();
 
@@ -66,10 +76,36 @@ class SymbolProvider : public base::RefCounted<SymbolProvider> {
   virtual bool GetVFTableRVAs(const pe::PEFile::Signature& signature,
                               base::hash_set<RelativeAddress>* vftable_rvas);
 
+  // Sets the directory where type repositories are persisted across runs.
+  // Type repositories are then loaded from this directory when possible, and
+  // written to it after crawling a PDB otherwise. Persistence is disabled by
+  // default.
+  // @note this must be set before the symbol provider is used.
+  // @param dir the directory, which must exist, or an empty path to disable
+  //     persistence.
+  void set_type_repository_dir(const base::FilePath& dir) {
+    type_repository_dir_ = dir;
+  }
+
+  // @returns the statistics of the type repository cache.
+  CacheStatistics GetTypeRepositoryCacheStatistics() const;
+
+  // @returns the statistics of the type name index cache.
+  CacheStatistics GetTypeNameIndexCacheStatistics() const;
+
  private:
   static void GetCacheKey(const pe::PEFile::Signature& signature,
                           base::string16* cache_key);
 
+  // @returns the path of the persisted type repository for the module
+  //     corresponding to @p signature.
+  base::FilePath GetTypeRepositoryPath(
+      const pe::PEFile::Signature& signature) const;
+
+  // @returns the cost of an entry of the caches.
+  template <typename EntryType>
+  static size_t GetCacheCost(const EntryType& entry);
+
   // Creates a type repository (without caching it).
   bool CreateTypeRepository(const pe::PEFile::Signature& signature,
                             scoped_refptr<TypeRepository>* type_repo);
@@ -85,6 +121,9 @@ class SymbolProvider : public base::RefCounted<SymbolProvider> {
   SimpleCache<TypeRepository> type_repos_;
   SimpleCache<TypeNameIndex> typename_indices_;
 
+  // The directory where type repositories are persisted, if any.
+  base::FilePath type_repository_dir_;
+
   DISALLOW_COPY_AND_ASSIGN(SymbolProvider);
 };
 
@@ -17,7 +17,9 @@
 #include <string>
 #include <vector>
 
+#include "base/files/file_enumerator.h"
 #include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
 #include "base/strings/utf_string_conversions.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
@@ -86,4 +88,40 @@ TEST(SymbolProviderTest, FindOrCreateTypeNameIndex) {
   ASSERT_EQ(1, matching_types.size());
 }
 
+TEST(SymbolProviderTest, PersistedTypeRepository) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+
+  const base::FilePath module_path(testing::GetSrcRelativePath(
+      L"syzygy\\refinery\\test_data\\test_types.dll"));
+  pe::PEFile pe_file;
+  ASSERT_TRUE(pe_file.Init(module_path));
+  pe::PEFile::Signature module_signature;
+  pe_file.GetSignature(&module_signature);
+
+  // The first provider crawls the PDB and persists the types.
+  scoped_refptr<SymbolProvider> provider = new SymbolProvider();
+  provider->set_type_repository_dir(temp_dir.path());
+  scoped_refptr<TypeRepository> crawled;
+  ASSERT_TRUE(provider->FindOrCreateTypeRepository(module_signature, &crawled));
+  base::FileEnumerator enumerator(temp_dir.path(), false,
+                                  base::FileEnumerator::FILES);
+  ASSERT_FALSE(enumerator.Next().empty());
+
+  // A second provider loads the persisted types.
+  provider = new SymbolProvider();
+  provider->set_type_repository_dir(temp_dir.path());
+  scoped_refptr<TypeRepository> loaded;
+  ASSERT_TRUE(provider->FindOrCreateTypeRepository(module_signature, &loaded));
+  EXPECT_NE(crawled.get(), loaded.get());
+  EXPECT_EQ(crawled->size(), loaded->size());
+
+  scoped_refptr<TypeNameIndex> index;
+  ASSERT_TRUE(provider->FindOrCreateTypeNameIndex(module_signature, &index));
+  std::vector<TypePtr> matching_types;
+  index->GetTypes(L"testing::TestSimpleUDT", &matching_types);
+  ASSERT_EQ(1, matching_types.size());
+  EXPECT_EQ(loaded.get(), matching_types[0]->repository());
+}
+
 }  // namespace refinery
@@ -17,15 +17,20 @@
 #include <string>
 
 #include "base/environment.h"
+#include "base/lazy_instance.h"
 #include "base/numerics/safe_conversions.h"
 #include "base/strings/string16.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/pe/find.h"
 
 namespace refinery {
 
 namespace {
 
+// Serializes the module and PDB lookups, as DbgHelp isn't thread safe.
+base::LazyInstance<base::Lock>::Leaky dbghelp_lock = LAZY_INSTANCE_INITIALIZER;
+
 // TODO(manzagop): this probably exists somewhere?
 bool GetEnvVar(const char* name, base::string16* value) {
   DCHECK(name != NULL);
@@ -57,6 +62,8 @@ bool GetPdbPath(const pe::PEFile::Signature& signature,
                 base::FilePath* pdb_path) {
   DCHECK(pdb_path);
 
+  base::AutoLock lock(dbghelp_lock.Get());
+
   // Get the module's path.
   base::string16 symbol_paths;
   GetEnvVar("_NT_SYMBOL_PATH", &symbol_paths);
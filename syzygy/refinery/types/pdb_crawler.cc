@@ -14,6 +14,10 @@
 
 #include "syzygy/refinery/types/pdb_crawler.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -22,9 +26,13 @@
 #include "base/strings/pattern.h"
 #include "base/strings/string16.h"
 #include "base/strings/stringprintf.h"
+#include "base/synchronization/lock.h"
+#include "base/sys_info.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/common/align.h"
 #include "syzygy/core/address.h"
 #include "syzygy/pdb/omap.h"
+#include "syzygy/pdb/pdb_byte_stream.h"
 #include "syzygy/pdb/pdb_dbi_stream.h"
 #include "syzygy/pdb/pdb_file.h"
 #include "syzygy/pdb/pdb_reader.h"
@@ -45,9 +53,108 @@ namespace cci = Microsoft_Cci_Pdb;
 
 const uint16_t kNoLeafType = static_cast<uint16_t>(-1);
 
+// The number of type records decoded by a thread at once.
+const size_t kRecordsPerDecodeChunk = 1024;
+
+// A field of a field list record. Only the fields that get translated to the
+// type repository are kept.
+struct FieldRecord {
+  // LF_MEMBER, LF_BCLASS, LF_METHOD, LF_ONEMETHOD, LF_VFUNCTAB, LF_VFUNCOFF or
+  // LF_INDEX.
+  uint16_t leaf_type;
+  // The type of the field, the method list of a LF_METHOD, or the continuation
+  // field list of a LF_INDEX.
+  TypeId type_id;
+  // The offset of the field, for LF_MEMBER, LF_BCLASS and LF_VFUNCOFF.
+  ptrdiff_t offset;
+  // The number of methods of a LF_METHOD.
+  uint16_t count;
+  // The name of a LF_MEMBER, LF_METHOD or LF_ONEMETHOD.
+  base::string16 name;
+};
+
+// The variable size parts of a decoded type record.
+struct TypeRecordDetails {
+  // The names of a LF_CLASS, LF_STRUCTURE or LF_UNION.
+  base::string16 name;
+  base::string16 decorated_name;
+  // The fields of a LF_FIELDLIST.
+  std::vector<FieldRecord> fields;
+  // The argument types of a LF_ARGLIST, or the method types of a
+  // LF_METHODLIST.
+  std::vector<TypeId> type_ids;
+};
+
+// A type record decoded from the type info stream, holding what the type
+// creation needs from it. Only the records the type creation reads are decoded,
+// for the other ones only the leaf type is retained.
+struct TypeRecord {
+  // LF_CLASS, LF_STRUCTURE and LF_UNION.
+  struct UserDefinedTypeRecord {
+    LeafPropertyField property;
+    TypeId fieldlist_id;
+    uint64_t size;
+  };
+  // LF_POINTER.
+  struct PointerRecord {
+    size_t size;
+    PointerType::Mode ptr_mode;
+    Type::Flags flags;
+    TypeId pointee_id;
+  };
+  // LF_MODIFIER.
+  struct ModifierRecord {
+    Type::Flags flags;
+    TypeId type_id;
+  };
+  // LF_ARRAY.
+  struct ArrayRecord {
+    uint64_t size;
+    TypeId index_id;
+    TypeId element_id;
+  };
+  // LF_PROCEDURE and LF_MFUNCTION.
+  struct FunctionRecord {
+    FunctionType::CallConvention call_convention;
+    TypeId return_type_id;
+    TypeId arglist_id;
+    TypeId containing_class_id;
+  };
+  // LF_BITFIELD.
+  struct BitfieldRecord {
+    uint8_t bit_pos;
+    uint8_t bit_len;
+    TypeId type_id;
+  };
+
+  TypeRecord() : leaf_type(kNoLeafType), valid(false) {}
+
+  // The leaf type of the record.
+  uint16_t leaf_type;
+  // False if the record failed to decode.
+  bool valid;
+  // The fixed size part of the record, depending on its leaf type.
+  union {
+    UserDefinedTypeRecord udt;
+    PointerRecord pointer;
+    ModifierRecord modifier;
+    ArrayRecord array;
+    FunctionRecord function;
+    BitfieldRecord bitfield;
+  };
+  // The variable size part of the record, if any.
+  std::unique_ptr<TypeRecordDetails> details;
+};
+
 class TypeCreator {
  public:
-  TypeCreator(TypeRepository* repository, pdb::PdbStream* stream);
+  // @param repository the repository to populate.
+  // @param stream the type info stream to crawl.
+  // @param thread_count the number of threads to decode type records with,
+  //     including the calling thread.
+  TypeCreator(TypeRepository* repository,
+              pdb::PdbByteStream* stream,
+              size_t thread_count);
   ~TypeCreator();
 
   // Crawls @p stream_, creates all types and assigns names to pointers.
@@ -65,6 +172,12 @@ class TypeCreator {
   TypePtr CreateBasicType(TypeId type_id);
   TypePtr CreateWildcardType(TypeId type_id);
 
+  // Retrieves a decoded type record.
+  // @param type_id type index of the record.
+  // @returns the record, or nullptr if there is no such record or if it failed
+  //     to decode.
+  const TypeRecord* GetTypeRecord(TypeId type_id);
+
   // The following functions parse records but do not save them in the type
   // repository. Instead they just pass out the flags (and bit field values)
   // to the caller. However they ensure parsing of the underlying types.
@@ -77,31 +190,33 @@ class TypeCreator {
                        size_t* bit_len);
 
   // Processes a base class field and inserts it into given field list.
-  // @param bclass pointer to the (non-virtual) base class field record.
+  // @param bclass the (non-virtual) base class field record.
   // @param fields pointer to the field list.
   // @returns true on success, false on failure.
-  bool ProcessBClass(pdb::LeafBClass* bclass, UserDefinedType::Fields* fields);
+  bool ProcessBClass(const FieldRecord& bclass,
+                     UserDefinedType::Fields* fields);
 
   // Processes a member field and inserts it into given field list.
-  // @param member pointer to the member type record.
+  // @param member the member field record.
   // @param fields pointer to the field list.
   // @returns true on success, false on failure.
-  bool ProcessMember(pdb::LeafMember* member, UserDefinedType::Fields* fields);
+  bool ProcessMember(const FieldRecord& member,
+                     UserDefinedType::Fields* fields);
 
   // Processes one method field and adds it as a member function in the member
   // function list.
-  // @param method pointer to the one method type record.
+  // @param method the one method field record.
   // @param functions pointer to the member function list.
   // @returns true on success, false on failure.
-  bool ProcessOneMethod(pdb::LeafOneMethod* method,
+  bool ProcessOneMethod(const FieldRecord& method,
                         UserDefinedType::Functions* functions);
 
   // Processes overloaded method field and add the member functions to the given
   // list.
-  // @param method pointer to the method type record.
+  // @param method the method field record.
   // @param functions pointer to the member function list.
   // @returns true on success, false on failure.
-  bool ProcessMethod(pdb::LeafMethod* method,
+  bool ProcessMethod(const FieldRecord& method,
                      UserDefinedType::Functions* functions);
 
   // Helper function for processesing a virtual function field and inserting it
@@ -114,23 +229,7 @@ class TypeCreator {
                     ptrdiff_t offset,
                     UserDefinedType::Fields* fields);
 
-  // Processes a virtual function at offset field and inserts it into given
-  // field list.
-  // @param vfunc pointer to the virtual function at offset field record.
-  // @param fields pointer to the field list.
-  // @returns true on success, false on failure.
-  bool ProcessVFuncOff(pdb::LeafVFuncOff* vfunc,
-                       UserDefinedType::Fields* fields);
-
-  // Processes a virtual function field and inserts it into given field list.
-  // @param vfunc pointer to the virtual function field record.
-  // @param fields pointer to the field list.
-  // @returns true on success, false on failure.
-  bool ProcessVFuncTab(pdb::LeafVFuncTab* vfunc,
-                       UserDefinedType::Fields* fields);
-
-  // Parses field list from the data stream and populates the UDT with fields
-  // and member functions.
+  // Populates the UDT with the fields and member functions of a field list.
   // @param fields pointer to the field list.
   // @param functions pointer to the member function list.
   // @returns true on success, false on failure.
@@ -138,8 +237,7 @@ class TypeCreator {
                      UserDefinedType::Fields* fields,
                      UserDefinedType::Functions* functions);
 
-  // Parses arglist from the data stream and populates the given list of
-  // argument types.
+  // Populates the given list of argument types from an arglist.
   // @param args pointer to the the argument list.
   // @returns true on success, false on failure.
   bool ReadArglist(TypeId type_id, FunctionType::Arguments* args);
@@ -155,12 +253,34 @@ class TypeCreator {
   // TODO(manzagop): Add a typedef for the leaf type.
   uint16_t GetLeafType(TypeId type_id);
 
-  // Does a first pass through the stream making the map of type indices for
-  // UDT and saves indices of all types that will get translated to the type
-  // repo.
+  // Decodes all the type records, then does a pass through them making the
+  // map of type indices for UDT and saves indices of all types that will get
+  // translated to the type repo.
   // @returns true on success, false on failure.
   bool PrepareData();
 
+  // Decodes the type records with thread_count_ threads.
+  // @returns true on success, false on failure.
+  bool DecodeRecords();
+
+  // Decodes the body of a type record.
+  // @param leaf_type the leaf type of the record.
+  // @param data the body of the record, past its length and leaf type.
+  // @param length the length of the body of the record.
+  // @param record the record to populate.
+  // @returns true on success, false on failure.
+  static bool DecodeRecord(uint16_t leaf_type,
+                           const uint8_t* data,
+                           size_t length,
+                           TypeRecord* record);
+
+  // Decodes the fields of a field list record.
+  // @param reader the reader over the body of the record.
+  // @param details the details of the record to populate.
+  // @returns true on success, false on failure.
+  static bool DecodeFieldlist(common::BinaryBufferStreamReader* reader,
+                              TypeRecordDetails* details);
+
   // Checks if type object exists and constructs one if it does not.
   // @param type_id type index of the type.
   // @returns pointer to the type object.
@@ -239,19 +359,29 @@ class TypeCreator {
   // @returns true if the record is pointer.
   bool IsBasicPointerType(TypeId type_id);
 
+  // A delegate that decodes chunks of type records on a thread.
+  class RecordDecoder;
+
   // Pointer to the type info repository.
   TypeRepository* repository_;
 
-  // Type info enumerator used to traverse the stream.
+  // The type info stream, held in memory so that it can be decoded in
+  // parallel.
+  scoped_refptr<pdb::PdbByteStream> stream_;
+
+  // Type info enumerator used to locate the records in the stream.
   pdb::TypeInfoEnumerator type_info_enum_;
 
+  // The number of threads to decode type records with.
+  size_t thread_count_;
+
   // Hash to map forward references to the right UDT records. For each unique
   // decorated name of an UDT, it contains type index of the class definition.
   std::unordered_map<base::string16, TypeId> udt_map_;
 
-  // Hash to store the pdb leaf types of the individual records. Indexed by type
-  // indices.
-  std::unordered_map<TypeId, uint16_t> types_map_;
+  // The decoded type records. Indexed by type indices less the smallest type
+  // index.
+  std::vector<TypeRecord> records_;
 
   // Hash which stores for each forward declaration the type index of the
   // actual class type.
@@ -264,30 +394,19 @@ class TypeCreator {
 TypePtr TypeCreator::CreatePointerType(TypeId type_id) {
   DCHECK_EQ(GetLeafType(type_id), cci::LF_POINTER);
 
-  if (!type_info_enum_.SeekRecord(type_id))
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr)
     return nullptr;
-
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-  pdb::LeafPointer type_info;
-  if (!type_info.Initialize(&parser)) {
-    LOG(ERROR) << "Unable to read type info record.";
-    return nullptr;
-  }
+  const TypeRecord::PointerRecord& type_info = record->pointer;
 
   // Save type information.
-  size_t size = PointerSize(type_info);
-  PointerType::Mode ptr_mode = PointerType::PTR_MODE_PTR;
-  if (type_info.attr().ptrmode == cci::CV_PTR_MODE_REF)
-    ptr_mode = PointerType::PTR_MODE_REF;
-
-  PointerTypePtr created = new PointerType(size, ptr_mode);
+  PointerTypePtr created =
+      new PointerType(type_info.size, type_info.ptr_mode);
   if (!repository_->AddTypeWithId(created, type_id))
     return nullptr;
 
   // Try to find the object in the repository.
-  TypeId pointee_id = type_info.body().utype;
+  TypeId pointee_id = type_info.pointee_id;
   Type::Flags pointee_flags = kNoTypeFlags;
   TypePtr pointee_type = FindOrCreatePointableType(pointee_id, &pointee_flags);
   if (pointee_type == nullptr)
@@ -339,46 +458,29 @@ TypePtr TypeCreator::ReadPointer(TypeId type_id, Type::Flags* flags) {
   DCHECK(flags);
   DCHECK_EQ(GetLeafType(type_id), cci::LF_POINTER);
 
-  if (!type_info_enum_.SeekRecord(type_id))
-    return nullptr;
-
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-  pdb::LeafPointer type_info;
-  if (!type_info.Initialize(&parser)) {
-    LOG(ERROR) << "Unable to read type info record.";
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr)
     return nullptr;
-  }
 
-  *flags =
-      CreateTypeFlags(type_info.attr().isconst, type_info.attr().isvolatile);
+  *flags = record->pointer.flags;
 
-  return FindOrCreateSpecificType(type_info_enum_.type_id(), cci::LF_POINTER);
+  return FindOrCreateSpecificType(type_id, cci::LF_POINTER);
 }
 
 TypePtr TypeCreator::ReadModifier(TypeId type_id, Type::Flags* flags) {
   DCHECK(flags);
   DCHECK_EQ(GetLeafType(type_id), cci::LF_MODIFIER);
 
-  if (!type_info_enum_.SeekRecord(type_id))
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr)
     return nullptr;
 
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-  pdb::LeafModifier type_info;
-  if (!type_info.Initialize(&parser)) {
-    LOG(ERROR) << "Unable to read type info record.";
-    return nullptr;
-  }
-
-  TypePtr underlying_type = FindOrCreateModifiableType(type_info.body().type);
+  TypePtr underlying_type =
+      FindOrCreateModifiableType(record->modifier.type_id);
   if (underlying_type == nullptr)
     return nullptr;
 
-  *flags = CreateTypeFlags(type_info.attr().mod_const,
-                           type_info.attr().mod_volatile);
+  *flags = record->modifier.flags;
   return underlying_type;
 }
 
@@ -389,125 +491,52 @@ bool TypeCreator::ReadFieldlist(TypeId type_id,
   DCHECK(functions);
   DCHECK_EQ(GetLeafType(type_id), cci::LF_FIELDLIST);
 
-  if (!type_info_enum_.SeekRecord(type_id))
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr || record->leaf_type != cci::LF_FIELDLIST)
     return false;
 
-  // Grab the leaf size, as sub-parsing moves the enumerator.
-  size_t leaf_size = type_info_enum_.len();
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader local_reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser local_parser(&local_reader);
-  while (local_reader.Position() < leaf_size) {
-    uint16_t leaf_type = 0;
-    if (!local_parser.Read(&leaf_type)) {
-      LOG(ERROR) << "Unable to read the type of a list field.";
-      return false;
-    }
-
-    switch (leaf_type) {
+  for (const FieldRecord& field : record->details->fields) {
+    switch (field.leaf_type) {
       case cci::LF_MEMBER: {
-        pdb::LeafMember type_info;
-        if (!type_info.Initialize(&local_parser) ||
-            !ProcessMember(&type_info, fields)) {
+        if (!ProcessMember(field, fields))
           return false;
-        }
         break;
       }
       case cci::LF_BCLASS: {
-        pdb::LeafBClass type_info;
-        if (!type_info.Initialize(&local_parser) ||
-            !ProcessBClass(&type_info, fields)) {
-          return false;
-        }
-        break;
-      }
-      case cci::LF_VBCLASS:
-      case cci::LF_IVBCLASS: {
-        pdb::LeafVBClass type_info;
-        if (!type_info.Initialize(&local_parser))
-          return false;
-        break;
-      }
-      case cci::LF_ENUMERATE: {
-        pdb::LeafEnumerate type_info;
-        if (!type_info.Initialize(&local_parser))
-          return false;
-        break;
-      }
-      case cci::LF_FRIENDFCN: {
-        pdb::LeafFriendFcn type_info;
-        if (!type_info.Initialize(&local_parser))
-          return false;
-        break;
-      }
-      case cci::LF_STMEMBER: {
-        pdb::LeafSTMember type_info;
-        if (!type_info.Initialize(&local_parser))
+        if (!ProcessBClass(field, fields))
           return false;
         break;
       }
       case cci::LF_METHOD: {
-        pdb::LeafMethod type_info;
-        if (!type_info.Initialize(&local_parser) ||
-            !ProcessMethod(&type_info, functions)) {
-          return false;
-        }
-        break;
-      }
-      case cci::LF_NESTTYPE: {
-        pdb::LeafNestType type_info;
-        if (!type_info.Initialize(&local_parser))
+        if (!ProcessMethod(field, functions))
           return false;
         break;
       }
       case cci::LF_VFUNCTAB: {
-        pdb::LeafVFuncTab type_info;
-        if (!type_info.Initialize(&local_parser) ||
-            !ProcessVFuncTab(&type_info, fields))
-          return false;
-        break;
-      }
-      case cci::LF_FRIENDCLS: {
-        pdb::LeafFriendCls type_info;
-        if (!type_info.Initialize(&local_parser))
+        if (!ProcessVFunc(field.type_id, 0, fields))
           return false;
         break;
       }
       case cci::LF_ONEMETHOD: {
-        pdb::LeafOneMethod type_info;
-        if (!type_info.Initialize(&local_parser) ||
-            !ProcessOneMethod(&type_info, functions)) {
+        if (!ProcessOneMethod(field, functions))
           return false;
-        }
         break;
       }
       case cci::LF_VFUNCOFF: {
-        pdb::LeafVFuncOff type_info;
-        if (!type_info.Initialize(&local_parser) ||
-            !ProcessVFuncOff(&type_info, fields))
+        if (!ProcessVFunc(field.type_id, field.offset, fields))
           return false;
         break;
       }
       case cci::LF_INDEX: {
-        pdb::LeafIndex type_info;
-        if (!type_info.Initialize(&local_parser))
-          return false;
         // This is always the last record of the fieldlist.
         // TODO(manzagop): ask siggi@ if he thinks this optimization is wise.
-        return ReadFieldlist(type_info.body().index, fields, functions);
+        return ReadFieldlist(field.type_id, fields, functions);
       }
       default: {
         NOTREACHED();
         break;
       }
     }
-    // The records are aligned to a 4 byte boundary.
-    const size_t kRecordAlignment = 4;
-    size_t align = local_reader.Position() % kRecordAlignment;
-    if (align > 0)
-      local_reader.Consume(kRecordAlignment - align);
-
-    DCHECK_EQ(0U, local_reader.Position() % kRecordAlignment);
   }
   return true;
 }
@@ -517,24 +546,11 @@ bool TypeCreator::ReadArglist(TypeId type_id,
   DCHECK(arglist);
   DCHECK_EQ(GetLeafType(type_id), cci::LF_ARGLIST);
 
-  if (!type_info_enum_.SeekRecord(type_id))
-    return false;
-
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-
-  uint32_t num_args = 0;
-  if (!parser.Read(&num_args))
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr || record->leaf_type != cci::LF_ARGLIST)
     return false;
 
-  while (arglist->size() < num_args) {
-    uint32_t arg_type_id = 0;
-    if (!parser.Read(&arg_type_id)) {
-      LOG(ERROR) << "Unable to read the type index of an argument.";
-      return false;
-    }
-
+  for (TypeId arg_type_id : record->details->type_ids) {
     Type::Flags flags = kNoTypeFlags;
     TypePtr arg_type = FindOrCreateOptionallyModifiedType(arg_type_id, &flags);
     if (arg_type == nullptr)
@@ -550,47 +566,20 @@ TypePtr TypeCreator::CreateUserDefinedType(TypeId type_id) {
          GetLeafType(type_id) == cci::LF_STRUCTURE ||
          GetLeafType(type_id) == cci::LF_UNION);
 
-  if (!type_info_enum_.SeekRecord(type_id))
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr)
     return nullptr;
 
-  // Read the values from the PDB records.
-  LeafPropertyField property = {};
-  TypeId fieldlist_id = kNoTypeId;
-  uint64_t size = 0;
-  base::string16 name;
-  base::string16 decorated_name;
-
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-  if (type_info_enum_.type() == cci::LF_CLASS ||
-      type_info_enum_.type() == cci::LF_STRUCTURE) {
-    pdb::LeafClass type_info;
-    if (!type_info.Initialize(&parser)) {
-      LOG(ERROR) << "Unable to read type info record.";
-      return nullptr;
-    }
-    property = type_info.property();
-    fieldlist_id = type_info.body().field;
-    size = type_info.size();
-    name = type_info.name();
-    decorated_name = type_info.decorated_name();
-  } else if (type_info_enum_.type() == cci::LF_UNION) {
-    pdb::LeafUnion type_info;
-    if (!type_info.Initialize(&parser)) {
-      LOG(ERROR) << "Unable to read type info record.";
-      return nullptr;
-    }
-    property = type_info.property();
-    fieldlist_id = type_info.body().field;
-    size = type_info.size();
-    name = type_info.name();
-    decorated_name = type_info.decorated_name();
-  }
+  // Read the values from the decoded record.
+  LeafPropertyField property = record->udt.property;
+  TypeId fieldlist_id = record->udt.fieldlist_id;
+  uint64_t size = record->udt.size;
+  const base::string16& name = record->details->name;
+  const base::string16& decorated_name = record->details->decorated_name;
 
   // Set the correct UDT kind.
   UserDefinedType::UdtKind udt_kind = UserDefinedType::UDT_CLASS;
-  switch (type_info_enum_.type()) {
+  switch (record->leaf_type) {
     case cci::LF_CLASS: {
       udt_kind = UserDefinedType::UDT_CLASS;
       break;
@@ -623,8 +612,7 @@ TypePtr TypeCreator::CreateUserDefinedType(TypeId type_id) {
       return nullptr;
 
     // Force parsing of the UDT.
-    return FindOrCreateSpecificType(real_class_id->second,
-                                    type_info_enum_.type());
+    return FindOrCreateSpecificType(real_class_id->second, record->leaf_type);
   } else {
     // Create UDT of the class and find its fieldlist.
     UserDefinedTypePtr udt =
@@ -645,26 +633,19 @@ TypePtr TypeCreator::CreateUserDefinedType(TypeId type_id) {
 TypePtr TypeCreator::CreateArrayType(TypeId type_id) {
   DCHECK_EQ(GetLeafType(type_id), cci::LF_ARRAY);
 
-  if (!type_info_enum_.SeekRecord(type_id))
-    return nullptr;
-
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-  pdb::LeafArray type_info;
-  if (!type_info.Initialize(&parser)) {
-    LOG(ERROR) << "Unable to read type info record.";
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr)
     return nullptr;
-  }
+  const TypeRecord::ArrayRecord& type_info = record->array;
 
-  ArrayTypePtr array_type = new ArrayType(type_info.size());
+  ArrayTypePtr array_type = new ArrayType(type_info.size);
   if (!repository_->AddTypeWithId(array_type, type_id))
     return nullptr;
 
   // Find the types in the repository.
   Type::Flags flags = kNoTypeFlags;
-  TypeId index_id = type_info.body().idxtype;
-  TypeId elem_id = type_info.body().elemtype;
+  TypeId index_id = type_info.index_id;
+  TypeId elem_id = type_info.element_id;
   TypePtr index_type = FindOrCreateIndexingType(index_id);
   TypePtr elem_type = FindOrCreateOptionallyModifiedType(elem_id, &flags);
   if (index_type == nullptr || elem_type == nullptr)
@@ -673,7 +654,7 @@ TypePtr TypeCreator::CreateArrayType(TypeId type_id) {
   size_t num_elements = 0;
   // TODO(mopler): Once we load everything test against the size not being zero.
   if (elem_type->size() != 0)
-    num_elements = type_info.size() / elem_type->size();
+    num_elements = type_info.size / elem_type->size();
   array_type->Finalize(flags, index_type->type_id(), num_elements,
                        elem_type->type_id());
   return array_type;
@@ -683,45 +664,15 @@ TypePtr TypeCreator::CreateFunctionType(TypeId type_id) {
   DCHECK(GetLeafType(type_id) == cci::LF_PROCEDURE ||
          GetLeafType(type_id) == cci::LF_MFUNCTION);
 
-  if (!type_info_enum_.SeekRecord(type_id))
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr)
     return nullptr;
 
-  FunctionType::CallConvention call_convention;
-  TypeId return_type_id = kNoTypeId;
-  TypeId containing_class_id = kNoTypeId;
-  TypeId arglist_id = kNoTypeId;
-
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-  if (type_info_enum_.type() == cci::LF_PROCEDURE) {
-    // Load the procedure record.
-    pdb::LeafProcedure type_info;
-    if (!type_info.Initialize(&parser)) {
-      LOG(ERROR) << "Unable to read type info record.";
-      return nullptr;
-    }
-
-    call_convention =
-        static_cast<FunctionType::CallConvention>(type_info.body().calltype);
-    return_type_id = type_info.body().rvtype;
-    arglist_id = type_info.body().arglist;
-  } else if (type_info_enum_.type() == cci::LF_MFUNCTION) {
-    // Load the member function record.
-    pdb::LeafMFunction type_info;
-    if (!type_info.Initialize(&parser)) {
-      LOG(ERROR) << "Unable to read type info record.";
-      return nullptr;
-    }
-
-    call_convention =
-        static_cast<FunctionType::CallConvention>(type_info.body().calltype);
-    return_type_id = type_info.body().rvtype;
-    arglist_id = type_info.body().arglist;
-    containing_class_id = type_info.body().classtype;
-  } else {
-    return nullptr;
-  }
+  FunctionType::CallConvention call_convention =
+      record->function.call_convention;
+  TypeId return_type_id = record->function.return_type_id;
+  TypeId containing_class_id = record->function.containing_class_id;
+  TypeId arglist_id = record->function.arglist_id;
 
   FunctionTypePtr function_type = new FunctionType(call_convention);
   if (!repository_->AddTypeWithId(function_type, type_id))
@@ -763,68 +714,67 @@ TypePtr TypeCreator::ReadBitfield(TypeId type_id,
   DCHECK(bit_len);
   DCHECK(GetLeafType(type_id) == cci::LF_BITFIELD);
 
-  if (!type_info_enum_.SeekRecord(type_id))
-    return nullptr;
-
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-  pdb::LeafBitfield type_info;
-  if (!type_info.Initialize(&parser)) {
-    LOG(ERROR) << "Unable to read type info record.";
+  const TypeRecord* record = GetTypeRecord(type_id);
+  if (record == nullptr)
     return nullptr;
-  }
+  const TypeRecord::BitfieldRecord& type_info = record->bitfield;
 
   const size_t kMaxBitfieldValue = 63;
-  if (type_info.body().position > kMaxBitfieldValue ||
-      type_info.body().length > kMaxBitfieldValue) {
+  if (type_info.bit_pos > kMaxBitfieldValue ||
+      type_info.bit_len > kMaxBitfieldValue) {
     LOG(ERROR) << "The bit position or length of bitfield is too large.";
     return nullptr;
   }
 
-  *bit_pos = type_info.body().position;
-  *bit_len = type_info.body().length;
+  *bit_pos = type_info.bit_pos;
+  *bit_len = type_info.bit_len;
 
-  TypeId underlying_id = type_info.body().type;
+  TypeId underlying_id = type_info.type_id;
   *flags = kNoTypeFlags;
 
   return FindOrCreateBitfieldType(underlying_id, flags);
 }
 
-TypeCreator::TypeCreator(TypeRepository* repository, pdb::PdbStream* stream)
-    : type_info_enum_(stream), repository_(repository) {
+TypeCreator::TypeCreator(TypeRepository* repository,
+                         pdb::PdbByteStream* stream,
+                         size_t thread_count)
+    : repository_(repository),
+      stream_(stream),
+      type_info_enum_(stream),
+      thread_count_(thread_count) {
   DCHECK(repository);
   DCHECK(stream);
+  DCHECK_LT(0U, thread_count);
 }
 
 TypeCreator::~TypeCreator() {
 }
 
-bool TypeCreator::ProcessBClass(pdb::LeafBClass* bclass,
+bool TypeCreator::ProcessBClass(const FieldRecord& bclass,
                                 UserDefinedType::Fields* fields) {
-  DCHECK(bclass);
+  DCHECK_EQ(cci::LF_BCLASS, bclass.leaf_type);
   DCHECK(fields);
 
   // Ensure the base class' type is created.
-  TypeId bclass_id = bclass->body().index;
+  TypeId bclass_id = bclass.type_id;
   TypePtr bclass_type = FindOrCreateInheritableType(bclass_id);
   if (bclass_type == nullptr)
     return false;
 
   fields->push_back(new UserDefinedType::BaseClassField(
-      bclass->offset(), bclass_type->type_id(), repository_));
+      bclass.offset, bclass_type->type_id(), repository_));
 
   return true;
 }
 
-bool TypeCreator::ProcessMember(pdb::LeafMember* member,
+bool TypeCreator::ProcessMember(const FieldRecord& member,
                                 UserDefinedType::Fields* fields) {
-  DCHECK(member);
+  DCHECK_EQ(cci::LF_MEMBER, member.leaf_type);
   DCHECK(fields);
 
   // TODO(mopler): Should we store the access protection and other info?
   // Get the member info.
-  TypeId member_id = member->body().index;
+  TypeId member_id = member.type_id;
   Type::Flags flags = kNoTypeFlags;
   size_t bit_pos = 0;
   size_t bit_len = 0;
@@ -834,57 +784,48 @@ bool TypeCreator::ProcessMember(pdb::LeafMember* member,
     return false;
 
   fields->push_back(new UserDefinedType::MemberField(
-      member->name(), member->offset(), flags, bit_pos, bit_len,
+      member.name, member.offset, flags, bit_pos, bit_len,
       member_type->type_id(), repository_));
   return true;
 }
 
-bool TypeCreator::ProcessOneMethod(pdb::LeafOneMethod* method,
+bool TypeCreator::ProcessOneMethod(const FieldRecord& method,
                                    UserDefinedType::Functions* functions) {
-  DCHECK(method);
+  DCHECK_EQ(cci::LF_ONEMETHOD, method.leaf_type);
   DCHECK(functions);
 
   // Parse the function type.
-  TypeId function_id = method->body().index;
+  TypeId function_id = method.type_id;
   if (FindOrCreateSpecificType(function_id, cci::LF_MFUNCTION) == nullptr)
     return false;
 
-  functions->push_back(UserDefinedType::Function(method->name(), function_id));
+  functions->push_back(UserDefinedType::Function(method.name, function_id));
   return true;
 }
 
-bool TypeCreator::ProcessMethod(pdb::LeafMethod* method,
+bool TypeCreator::ProcessMethod(const FieldRecord& method,
                                 UserDefinedType::Functions* functions) {
-  DCHECK(method);
+  DCHECK_EQ(cci::LF_METHOD, method.leaf_type);
   DCHECK(functions);
 
-  // Seek the method list record.
-  if (!type_info_enum_.SeekRecord(method->body().mList) ||
-      type_info_enum_.type() != cci::LF_METHODLIST) {
+  // Get the method list record.
+  const TypeRecord* method_list = GetTypeRecord(method.type_id);
+  if (method_list == nullptr || method_list->leaf_type != cci::LF_METHODLIST)
     return false;
-  }
 
-  pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-      type_info_enum_.CreateRecordReader());
-  common::BinaryStreamParser parser(&reader);
-
-  uint16_t count = method->body().count;
-  while (count > 0) {
-    pdb::MethodListRecord method_record;
-    if (!method_record.Initialize(&parser)) {
-      LOG(ERROR) << "Unable to read method list record.";
-      return false;
-    }
+  const std::vector<TypeId>& function_ids = method_list->details->type_ids;
+  if (function_ids.size() < method.count) {
+    LOG(ERROR) << "Unable to read method list record.";
+    return false;
+  }
 
+  for (size_t i = 0; i < method.count; ++i) {
     // Parse the function type.
-    TypeId function_id = method_record.body().index;
+    TypeId function_id = function_ids[i];
     if (FindOrCreateSpecificType(function_id, cci::LF_MFUNCTION) == nullptr)
       return false;
 
-    functions->push_back(
-        UserDefinedType::Function(method->name(), function_id));
-
-    count--;
+    functions->push_back(UserDefinedType::Function(method.name, function_id));
   }
   return true;
 }
@@ -916,20 +857,6 @@ bool TypeCreator::ProcessVFunc(
   return true;
 }
 
-bool TypeCreator::ProcessVFuncOff(pdb::LeafVFuncOff* vfunc,
-                                  UserDefinedType::Fields* fields) {
-  DCHECK(vfunc);
-  DCHECK(fields);
-  return ProcessVFunc(vfunc->body().type, vfunc->body().offset, fields);
-}
-
-bool TypeCreator::ProcessVFuncTab(pdb::LeafVFuncTab* vfunc,
-                                  UserDefinedType::Fields* fields) {
-  DCHECK(vfunc);
-  DCHECK(fields);
-  return ProcessVFunc(vfunc->body().type, 0, fields);
-}
-
 base::string16 TypeCreator::BasicTypeName(size_t type) {
   switch (type) {
 // Just return the name of the type.
@@ -1077,14 +1004,27 @@ uint16_t TypeCreator::GetLeafType(TypeId type_id) {
   if (type_id < cci::CV_PRIMITIVE_TYPE::CV_FIRST_NONPRIM)
     return static_cast<uint16_t>(type_id);
 
-  auto it = types_map_.find(type_id);
-  if (it == types_map_.end()) {
+  uint32_t type_min = type_info_enum_.type_info_header().type_min;
+  if (type_id < type_min || type_id - type_min >= records_.size()) {
     LOG(ERROR) << "Couldn't find record with type index " << type_id
                << " in the types map.";
     return kNoLeafType;
   } else {
-    return it->second;
+    return records_[type_id - type_min].leaf_type;
+  }
+}
+
+const TypeRecord* TypeCreator::GetTypeRecord(TypeId type_id) {
+  uint32_t type_min = type_info_enum_.type_info_header().type_min;
+  if (type_id < type_min || type_id - type_min >= records_.size())
+    return nullptr;
+
+  const TypeRecord& record = records_[type_id - type_min];
+  if (!record.valid) {
+    LOG(ERROR) << "Unable to read type info record.";
+    return nullptr;
   }
+  return &record;
 }
 
 bool TypeCreator::CacheUserDefinedTypeForwardDeclaration(TypeId fwd_id,
@@ -1332,27 +1272,417 @@ TypePtr TypeCreator::CreateType(TypeId type_id) {
   }
 }
 
-bool TypeCreator::PrepareData() {
-  size_t unexpected_duplicate_types = 0;
+class TypeCreator::RecordDecoder : public base::DelegateSimpleThread::Delegate {
+ public:
+  // @param data the type info stream.
+  // @param size the size of @p data.
+  // @param offsets the stream positions of the type records.
+  // @param records the records to decode into, sized like @p offsets.
+  RecordDecoder(const uint8_t* data,
+                size_t size,
+                const std::vector<uint32_t>& offsets,
+                std::vector<TypeRecord>* records);
+
+  // Decodes chunks of records until all of them are claimed. This is invoked
+  // concurrently by all the decoding threads.
+  void Run() override;
+
+ private:
+  // Claims the next chunk of records to decode.
+  // @param begin on success, returns the index of the first record.
+  // @param end on success, returns the index past the last record.
+  // @returns false if there are no records left to decode.
+  bool ClaimChunk(size_t* begin, size_t* end);
+
+  const uint8_t* data_;
+  size_t size_;
+  const std::vector<uint32_t>& offsets_;
+  std::vector<TypeRecord>* records_;
+
+  // Protects next_record_.
+  base::Lock lock_;
+  // The index of the first record not claimed yet.
+  size_t next_record_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordDecoder);
+};
+
+TypeCreator::RecordDecoder::RecordDecoder(const uint8_t* data,
+                                          size_t size,
+                                          const std::vector<uint32_t>& offsets,
+                                          std::vector<TypeRecord>* records)
+    : data_(data),
+      size_(size),
+      offsets_(offsets),
+      records_(records),
+      next_record_(0) {
+  DCHECK(data);
+  DCHECK(records);
+  DCHECK_EQ(offsets.size(), records->size());
+}
+
+void TypeCreator::RecordDecoder::Run() {
+  size_t begin = 0;
+  size_t end = 0;
+  while (ClaimChunk(&begin, &end)) {
+    for (size_t i = begin; i < end; ++i) {
+      // The record index guarantees the record headers are within the
+      // stream. Each record starts with its length, which includes its leaf
+      // type.
+      const uint8_t* data = data_ + offsets_[i];
+      uint16_t length = 0;
+      uint16_t leaf_type = 0;
+      ::memcpy(&length, data, sizeof(length));
+      ::memcpy(&leaf_type, data + sizeof(length), sizeof(leaf_type));
+
+      TypeRecord* record = &records_->at(i);
+      record->leaf_type = leaf_type;
+      if (length < sizeof(leaf_type) ||
+          offsets_[i] + sizeof(length) + length > size_) {
+        continue;
+      }
+      record->valid =
+          DecodeRecord(leaf_type, data + sizeof(length) + sizeof(leaf_type),
+                       length - sizeof(leaf_type), record);
+    }
+  }
+}
+
+bool TypeCreator::RecordDecoder::ClaimChunk(size_t* begin, size_t* end) {
+  DCHECK(begin);
+  DCHECK(end);
+
+  base::AutoLock auto_lock(lock_);
+  if (next_record_ == offsets_.size())
+    return false;
 
-  while (!type_info_enum_.EndOfStream()) {
-    if (!type_info_enum_.NextTypeInfoRecord())
+  *begin = next_record_;
+  *end = std::min(next_record_ + kRecordsPerDecodeChunk, offsets_.size());
+  next_record_ = *end;
+  return true;
+}
+
+bool TypeCreator::DecodeRecord(uint16_t leaf_type,
+                               const uint8_t* data,
+                               size_t length,
+                               TypeRecord* record) {
+  DCHECK(data);
+  DCHECK(record);
+
+  common::BinaryBufferStreamReader reader(data, length);
+  common::BinaryStreamParser parser(&reader);
+  switch (leaf_type) {
+    case cci::LF_CLASS:
+    case cci::LF_STRUCTURE: {
+      pdb::LeafClass type_info;
+      if (!type_info.Initialize(&parser))
+        return false;
+      record->udt.property = type_info.property();
+      record->udt.fieldlist_id = type_info.body().field;
+      record->udt.size = type_info.size();
+      record->details.reset(new TypeRecordDetails());
+      record->details->name = type_info.name();
+      record->details->decorated_name = type_info.decorated_name();
+      return true;
+    }
+    case cci::LF_UNION: {
+      pdb::LeafUnion type_info;
+      if (!type_info.Initialize(&parser))
+        return false;
+      record->udt.property = type_info.property();
+      record->udt.fieldlist_id = type_info.body().field;
+      record->udt.size = type_info.size();
+      record->details.reset(new TypeRecordDetails());
+      record->details->name = type_info.name();
+      record->details->decorated_name = type_info.decorated_name();
+      return true;
+    }
+    case cci::LF_POINTER: {
+      pdb::LeafPointer type_info;
+      if (!type_info.Initialize(&parser))
+        return false;
+      record->pointer.size = PointerSize(type_info);
+      record->pointer.ptr_mode = PointerType::PTR_MODE_PTR;
+      if (type_info.attr().ptrmode == cci::CV_PTR_MODE_REF)
+        record->pointer.ptr_mode = PointerType::PTR_MODE_REF;
+      record->pointer.flags = CreateTypeFlags(type_info.attr().isconst,
+                                              type_info.attr().isvolatile);
+      record->pointer.pointee_id = type_info.body().utype;
+      return true;
+    }
+    case cci::LF_MODIFIER: {
+      pdb::LeafModifier type_info;
+      if (!type_info.Initialize(&parser))
+        return false;
+      record->modifier.flags = CreateTypeFlags(type_info.attr().mod_const,
+                                               type_info.attr().mod_volatile);
+      record->modifier.type_id = type_info.body().type;
+      return true;
+    }
+    case cci::LF_ARRAY: {
+      pdb::LeafArray type_info;
+      if (!type_info.Initialize(&parser))
+        return false;
+      record->array.size = type_info.size();
+      record->array.index_id = type_info.body().idxtype;
+      record->array.element_id = type_info.body().elemtype;
+      return true;
+    }
+    case cci::LF_PROCEDURE: {
+      pdb::LeafProcedure type_info;
+      if (!type_info.Initialize(&parser))
+        return false;
+      record->function.call_convention =
+          static_cast<FunctionType::CallConvention>(type_info.body().calltype);
+      record->function.return_type_id = type_info.body().rvtype;
+      record->function.arglist_id = type_info.body().arglist;
+      record->function.containing_class_id = kNoTypeId;
+      return true;
+    }
+    case cci::LF_MFUNCTION: {
+      pdb::LeafMFunction type_info;
+      if (!type_info.Initialize(&parser))
+        return false;
+      record->function.call_convention =
+          static_cast<FunctionType::CallConvention>(type_info.body().calltype);
+      record->function.return_type_id = type_info.body().rvtype;
+      record->function.arglist_id = type_info.body().arglist;
+      record->function.containing_class_id = type_info.body().classtype;
+      return true;
+    }
+    case cci::LF_BITFIELD: {
+      pdb::LeafBitfield type_info;
+      if (!type_info.Initialize(&parser))
+        return false;
+      record->bitfield.bit_pos = type_info.body().position;
+      record->bitfield.bit_len = type_info.body().length;
+      record->bitfield.type_id = type_info.body().type;
+      return true;
+    }
+    case cci::LF_ARGLIST: {
+      uint32_t num_args = 0;
+      if (!parser.Read(&num_args))
+        return false;
+
+      record->details.reset(new TypeRecordDetails());
+      std::vector<TypeId>* args = &record->details->type_ids;
+      while (args->size() < num_args) {
+        uint32_t arg_type_id = 0;
+        if (!parser.Read(&arg_type_id)) {
+          LOG(ERROR) << "Unable to read the type index of an argument.";
+          return false;
+        }
+        args->push_back(arg_type_id);
+      }
+      return true;
+    }
+    case cci::LF_METHODLIST: {
+      // The number of methods is given by the fields referring to the list, so
+      // decode all of them.
+      record->details.reset(new TypeRecordDetails());
+      while (!reader.AtEnd()) {
+        pdb::MethodListRecord method_record;
+        if (!method_record.Initialize(&parser))
+          break;
+        record->details->type_ids.push_back(method_record.body().index);
+      }
+      return true;
+    }
+    case cci::LF_FIELDLIST: {
+      record->details.reset(new TypeRecordDetails());
+      return DecodeFieldlist(&reader, record->details.get());
+    }
+    default: {
+      // The other records don't get read.
+      return true;
+    }
+  }
+}
+
+bool TypeCreator::DecodeFieldlist(common::BinaryBufferStreamReader* reader,
+                                  TypeRecordDetails* details) {
+  DCHECK(reader);
+  DCHECK(details);
+
+  common::BinaryStreamParser parser(reader);
+  while (!reader->AtEnd()) {
+    uint16_t leaf_type = 0;
+    if (!parser.Read(&leaf_type)) {
+      LOG(ERROR) << "Unable to read the type of a list field.";
       return false;
+    }
+
+    FieldRecord field = {};
+    field.leaf_type = leaf_type;
+    bool keep_field = true;
+    switch (leaf_type) {
+      case cci::LF_MEMBER: {
+        pdb::LeafMember type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        field.type_id = type_info.body().index;
+        field.offset = static_cast<ptrdiff_t>(type_info.offset());
+        field.name = type_info.name();
+        break;
+      }
+      case cci::LF_BCLASS: {
+        pdb::LeafBClass type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        field.type_id = type_info.body().index;
+        field.offset = static_cast<ptrdiff_t>(type_info.offset());
+        break;
+      }
+      case cci::LF_VBCLASS:
+      case cci::LF_IVBCLASS: {
+        pdb::LeafVBClass type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        keep_field = false;
+        break;
+      }
+      case cci::LF_ENUMERATE: {
+        pdb::LeafEnumerate type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        keep_field = false;
+        break;
+      }
+      case cci::LF_FRIENDFCN: {
+        pdb::LeafFriendFcn type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        keep_field = false;
+        break;
+      }
+      case cci::LF_STMEMBER: {
+        pdb::LeafSTMember type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        keep_field = false;
+        break;
+      }
+      case cci::LF_METHOD: {
+        pdb::LeafMethod type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        field.type_id = type_info.body().mList;
+        field.count = type_info.body().count;
+        field.name = type_info.name();
+        break;
+      }
+      case cci::LF_NESTTYPE: {
+        pdb::LeafNestType type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        keep_field = false;
+        break;
+      }
+      case cci::LF_VFUNCTAB: {
+        pdb::LeafVFuncTab type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        field.type_id = type_info.body().type;
+        break;
+      }
+      case cci::LF_FRIENDCLS: {
+        pdb::LeafFriendCls type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        keep_field = false;
+        break;
+      }
+      case cci::LF_ONEMETHOD: {
+        pdb::LeafOneMethod type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        field.type_id = type_info.body().index;
+        field.name = type_info.name();
+        break;
+      }
+      case cci::LF_VFUNCOFF: {
+        pdb::LeafVFuncOff type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        field.type_id = type_info.body().type;
+        field.offset = type_info.body().offset;
+        break;
+      }
+      case cci::LF_INDEX: {
+        pdb::LeafIndex type_info;
+        if (!type_info.Initialize(&parser))
+          return false;
+        // This is always the last record of the fieldlist.
+        field.type_id = type_info.body().index;
+        details->fields.push_back(field);
+        return true;
+      }
+      default: {
+        LOG(ERROR) << "Unexpected field list leaf type " << leaf_type << ".";
+        return false;
+      }
+    }
+    if (keep_field)
+      details->fields.push_back(field);
+
+    // The records are aligned to a 4 byte boundary.
+    const size_t kRecordAlignment = 4;
+    if (!parser.AlignTo(kRecordAlignment))
+      break;
+
+    DCHECK_EQ(0U, reader->Position() % kRecordAlignment);
+  }
+  return true;
+}
+
+bool TypeCreator::DecodeRecords() {
+  std::vector<uint32_t> offsets;
+  if (!type_info_enum_.GetRecordIndex(&offsets)) {
+    LOG(ERROR) << "Unable to locate the type info records.";
+    return false;
+  }
+  DCHECK(!offsets.empty());
+
+  records_.resize(offsets.size());
+  RecordDecoder decoder(stream_->data(), stream_->length(), offsets,
+                        &records_);
+
+  // The calling thread decodes alongside the workers.
+  size_t chunk_count = (offsets.size() + kRecordsPerDecodeChunk - 1) /
+                       kRecordsPerDecodeChunk;
+  size_t worker_count = std::min(thread_count_, chunk_count) - 1;
+  if (worker_count == 0) {
+    decoder.Run();
+    return true;
+  }
+
+  base::DelegateSimpleThreadPool pool("PdbCrawler",
+                                      static_cast<int>(worker_count));
+  pool.Start();
+  pool.AddWork(&decoder, static_cast<int>(worker_count));
+  decoder.Run();
+  pool.JoinAll();
+
+  return true;
+}
 
-    types_map_.insert(
-        std::make_pair(type_info_enum_.type_id(), type_info_enum_.type()));
+bool TypeCreator::PrepareData() {
+  if (!DecodeRecords())
+    return false;
+
+  size_t unexpected_duplicate_types = 0;
+  TypeId type_min = type_info_enum_.type_info_header().type_min;
+  for (size_t i = 0; i < records_.size(); ++i) {
+    const TypeRecord& record = records_[i];
+    TypeId type_id = type_min + static_cast<TypeId>(i);
 
     // We remember ids of the types that we will later descend into.
-    if (IsImportantType(type_info_enum_.type()))
-      records_to_process_.push_back(type_info_enum_.type_id());
-
-    pdb::TypeInfoEnumerator::BinaryTypeRecordReader reader(
-        type_info_enum_.CreateRecordReader());
-    common::BinaryStreamParser parser(&reader);
-    if (type_info_enum_.type() == cci::LF_CLASS ||
-        type_info_enum_.type() == cci::LF_STRUCTURE) {
-      pdb::LeafClass type_info;
-      if (!type_info.Initialize(&parser)) {
+    if (IsImportantType(record.leaf_type))
+      records_to_process_.push_back(type_id);
+
+    if (record.leaf_type == cci::LF_CLASS ||
+        record.leaf_type == cci::LF_STRUCTURE) {
+      if (!record.valid) {
         LOG(ERROR) << "Unable to read type info record.";
         return false;
       }
@@ -1364,15 +1694,16 @@ bool TypeCreator::PrepareData() {
       //   - we've observed UDTs that are identical up to extra LF_NESTTYPE
       //     (which do not make it to our type representation).
       // TODO(manzagop): investigate more and consider folding duplicate types.
-      if (!type_info.property().fwdref) {
-        if (type_info.name().find(L'<') != 0 &&
-            udt_map_.find(type_info.decorated_name()) != udt_map_.end()) {
-          VLOG(1) << "Encountered duplicate decorated name: "
-                  << type_info.decorated_name();
+      if (!record.udt.property.fwdref) {
+        const base::string16& name = record.details->name;
+        const base::string16& decorated_name = record.details->decorated_name;
+        if (name.find(L'<') != 0 &&
+            udt_map_.find(decorated_name) != udt_map_.end()) {
+          VLOG(1) << "Encountered duplicate decorated name: " << decorated_name;
           unexpected_duplicate_types++;
         }
 
-        udt_map_[type_info.decorated_name()] = type_info_enum_.type_id();
+        udt_map_[decorated_name] = type_id;
       }
     }
   }
@@ -1382,7 +1713,7 @@ bool TypeCreator::PrepareData() {
               << " unexpected duplicate types.";
   }
 
-  return type_info_enum_.ResetStream();
+  return true;
 }
 
 bool TypeCreator::CreateTypes() {
@@ -1412,7 +1743,8 @@ bool TypeCreator::CreateTypes() {
 
 }  // namespace
 
-PdbCrawler::PdbCrawler() {
+PdbCrawler::PdbCrawler()
+    : thread_count_(base::SysInfo::NumberOfProcessors()) {
 }
 
 PdbCrawler::~PdbCrawler() {
@@ -1496,7 +1828,15 @@ bool PdbCrawler::GetTypes(TypeRepository* types) {
   DCHECK(types);
   DCHECK(tpi_stream_);
 
-  TypeCreator creator(types, tpi_stream_.get());
+  // The type records are decoded in parallel from an in-memory copy of the
+  // stream, as reading the file streams isn't thread safe.
+  scoped_refptr<pdb::PdbByteStream> stream = new pdb::PdbByteStream();
+  if (!stream->Init(tpi_stream_.get())) {
+    LOG(ERROR) << "Unable to read the type info stream.";
+    return false;
+  }
+
+  TypeCreator creator(types, stream.get(), thread_count_);
 
   return creator.CreateTypes();
 }
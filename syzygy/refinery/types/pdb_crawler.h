@@ -22,6 +22,7 @@
 
 #include "base/containers/hash_tables.h"
 #include "base/files/file_path.h"
+#include "base/logging.h"
 #include "syzygy/common/binary_stream.h"
 #include "syzygy/pdb/pdb_dbi_stream.h"
 #include "syzygy/pdb/pdb_stream.h"
@@ -38,6 +39,9 @@ class TypeRepository;
 // - UDTs that are identical up to extra LF_NESTTYPE (which do not make it to
 //   our type representation)
 // - pointers: Foo* and Foo*const will lead to the creation of 2 Foo* types.
+// Types are crawled in two phases: the type records are first decoded in
+// parallel, then the types are created from the decoded records on the calling
+// thread. The resulting types don't depend on the number of threads.
 class PdbCrawler {
  public:
   PdbCrawler();
@@ -58,6 +62,17 @@ class PdbCrawler {
   // @returns true on success, false on failure.
   bool GetVFTableRVAs(base::hash_set<RelativeAddress>* vftable_rvas);
 
+  // @name Accessors.
+  // @{
+  // The number of threads used to decode type records, including the calling
+  // thread. Defaults to the number of processors.
+  size_t thread_count() const { return thread_count_; }
+  void set_thread_count(size_t thread_count) {
+    DCHECK_LT(0U, thread_count);
+    thread_count_ = thread_count;
+  }
+  // @}
+
  private:
   bool GetVFTableRVAForSymbol(base::hash_set<RelativeAddress>* vftable_rvas,
                               uint16_t symbol_length,
@@ -76,6 +91,9 @@ class PdbCrawler {
   // OMAP data to map from original space to transformed space. Empty if there
   // is no OMAP data.
   std::vector<OMAP> omap_from_;
+
+  // The number of threads used to decode type records.
+  size_t thread_count_;
 };
 
 }  // namespace refinery
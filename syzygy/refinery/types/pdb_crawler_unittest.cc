@@ -14,6 +14,8 @@
 
 #include "syzygy/refinery/types/pdb_crawler.h"
 
+#include <stdlib.h>
+
 #include <unordered_map>
 #include <vector>
 
@@ -24,6 +26,9 @@
 #include "base/strings/string16.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
+#include "base/time/time.h"
 #include "gtest/gtest.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/pdb/pdb_dbi_stream.h"
@@ -827,12 +832,86 @@ TEST_P(PdbCrawlerTest, TestUnion) {
   ValidateBasicType(udt->GetFieldType(1), sizeof(uint32_t), L"uint32_t");
 }
 
+TEST_P(PdbCrawlerTest, TestThreadCountDoesNotAffectTypes) {
+  const size_t kThreadCounts[] = {1, 4};
+  scoped_refptr<TypeRepository> repositories[arraysize(kThreadCounts)];
+  for (size_t i = 0; i < arraysize(kThreadCounts); ++i) {
+    PdbCrawler crawler;
+    crawler.set_thread_count(kThreadCounts[i]);
+    EXPECT_EQ(kThreadCounts[i], crawler.thread_count());
+    ASSERT_TRUE(crawler.InitializeForFile(test_types_file_));
+    repositories[i] = new TypeRepository();
+    ASSERT_TRUE(crawler.GetTypes(repositories[i].get()));
+  }
+
+  TypeRepository* expected = repositories[0].get();
+  TypeRepository* actual = repositories[1].get();
+  ASSERT_EQ(expected->size(), actual->size());
+  for (auto expected_type : *expected) {
+    TypePtr actual_type = actual->GetType(expected_type->type_id());
+    ASSERT_TRUE(actual_type);
+    ASSERT_EQ(expected_type->kind(), actual_type->kind());
+    EXPECT_EQ(expected_type->size(), actual_type->size());
+    EXPECT_EQ(expected_type->GetName(), actual_type->GetName());
+    EXPECT_EQ(expected_type->GetDecoratedName(),
+              actual_type->GetDecoratedName());
+
+    UserDefinedTypePtr expected_udt;
+    if (expected_type->CastTo(&expected_udt)) {
+      UserDefinedTypePtr actual_udt;
+      ASSERT_TRUE(actual_type->CastTo(&actual_udt));
+      EXPECT_EQ(expected_udt->is_fwd_decl(), actual_udt->is_fwd_decl());
+      ASSERT_EQ(expected_udt->fields().size(), actual_udt->fields().size());
+      for (size_t i = 0; i < expected_udt->fields().size(); ++i)
+        EXPECT_TRUE(*expected_udt->fields()[i] == *actual_udt->fields()[i]);
+      EXPECT_EQ(expected_udt->functions(), actual_udt->functions());
+    }
+
+    FunctionTypePtr expected_function;
+    if (expected_type->CastTo(&expected_function)) {
+      FunctionTypePtr actual_function;
+      ASSERT_TRUE(actual_type->CastTo(&actual_function));
+      EXPECT_EQ(expected_function->argument_types(),
+                actual_function->argument_types());
+      EXPECT_EQ(expected_function->containing_class_id(),
+                actual_function->containing_class_id());
+    }
+  }
+}
+
 // Run both the 32-bit and 64-bit tests.
 INSTANTIATE_TEST_CASE_P(InstantiateFor32and64,
                         PdbCrawlerTest,
                         ::testing::Values(32, 64));
 
 
+// Measures the crawling time for various numbers of threads. Run manually with
+// a large PDB by setting the REFINERY_BENCHMARK_PDB environment variable.
+TEST(PdbCrawlerBenchmarkTest, DISABLED_ThreadScaling) {
+  base::FilePath pdb_path = testing::GetSrcRelativePath(
+      L"syzygy\\refinery\\test_data\\test_types.dll.pdb");
+  char* benchmark_pdb = getenv("REFINERY_BENCHMARK_PDB");
+  if (benchmark_pdb != nullptr)
+    pdb_path = base::FilePath(base::ASCIIToUTF16(benchmark_pdb));
+
+  const size_t kThreadCounts[] = {
+      1, 2, 4, static_cast<size_t>(base::SysInfo::NumberOfProcessors())};
+  for (size_t i = 0; i < arraysize(kThreadCounts); ++i) {
+    PdbCrawler crawler;
+    crawler.set_thread_count(kThreadCounts[i]);
+    ASSERT_TRUE(crawler.InitializeForFile(pdb_path));
+
+    base::TimeTicks start = base::TimeTicks::Now();
+    scoped_refptr<TypeRepository> types = new TypeRepository();
+    ASSERT_TRUE(crawler.GetTypes(types.get()));
+    base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+    LOG(INFO) << pdb_path.value() << ": " << types->size() << " types with "
+              << kThreadCounts[i] << " threads in "
+              << elapsed.InMillisecondsF() << " ms.";
+  }
+}
+
 class PdbCrawlerVTableTest : public testing::PdbCrawlerVTableTestBase {
  protected:
   void GetVFTableRVAs(const wchar_t* pdb_path_str,
@@ -0,0 +1,729 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/types/serialized_type_repository.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/files/file_util.h"
+#include "base/files/memory_mapped_file.h"
+#include "syzygy/common/align.h"
+#include "syzygy/common/binary_stream.h"
+#include "syzygy/refinery/types/type.h"
+
+namespace refinery {
+
+namespace {
+
+const uint32_t kMagic = 0x50595452;  // 'RTYP'.
+const uint32_t kVersion = 1;
+
+// The encoding of kNoTypeId.
+const uint32_t kNoSerializedTypeId = static_cast<uint32_t>(-1);
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  // The signature of the module the types belong to.
+  uint32_t module_size;
+  uint32_t module_checksum;
+  uint32_t module_time_date_stamp;
+  // The number of index entries, which follow the header.
+  uint32_t type_count;
+  // The location of the type records.
+  uint32_t records_offset;
+  uint32_t records_size;
+  // The location of the string table.
+  uint32_t strings_offset;
+  uint32_t strings_size;
+};
+
+struct IndexEntry {
+  uint32_t type_id;
+  // The offset of the type's name in the string table.
+  uint32_t name;
+  // The offset of the type's record.
+  uint32_t record;
+};
+
+bool operator<(const IndexEntry& entry, uint32_t type_id) {
+  return entry.type_id < type_id;
+}
+
+// Appends little-endian values to a byte buffer.
+class ByteWriter {
+ public:
+  explicit ByteWriter(std::vector<uint8_t>* data) : data_(data) {
+    DCHECK(data);
+  }
+
+  template <typename DataType>
+  void Write(DataType value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data_->insert(data_->end(), bytes, bytes + sizeof(value));
+  }
+
+  void WriteTypeId(TypeId id) {
+    DCHECK(id == kNoTypeId || id < kNoSerializedTypeId);
+    Write<uint32_t>(id == kNoTypeId ? kNoSerializedTypeId
+                                    : static_cast<uint32_t>(id));
+  }
+
+  void Align(size_t alignment) {
+    data_->resize(::common::AlignUp(data_->size(), alignment));
+  }
+
+  size_t offset() const { return data_->size(); }
+
+ private:
+  std::vector<uint8_t>* data_;
+
+  DISALLOW_COPY_AND_ASSIGN(ByteWriter);
+};
+
+// Builds a table of unique length-prefixed strings.
+class StringTableWriter {
+ public:
+  StringTableWriter() : writer_(&data_) {}
+
+  // @returns the offset of @p str in the table.
+  uint32_t Add(const base::string16& str) {
+    auto it = offsets_.find(str);
+    if (it != offsets_.end())
+      return it->second;
+
+    uint32_t offset = static_cast<uint32_t>(writer_.offset());
+    writer_.Write<uint32_t>(static_cast<uint32_t>(str.size()));
+    for (base::char16 c : str)
+      writer_.Write(c);
+    writer_.Align(sizeof(uint32_t));
+
+    offsets_.insert(std::make_pair(str, offset));
+    return offset;
+  }
+
+  const std::vector<uint8_t>& data() const { return data_; }
+
+ private:
+  std::vector<uint8_t> data_;
+  ByteWriter writer_;
+  std::map<base::string16, uint32_t> offsets_;
+
+  DISALLOW_COPY_AND_ASSIGN(StringTableWriter);
+};
+
+// Reads type records and strings out of a mapped file.
+class RecordParser {
+ public:
+  RecordParser(const uint8_t* data, size_t size)
+      : reader_(data, size), parser_(&reader_) {}
+
+  template <typename DataType>
+  bool Read(DataType* value) {
+    return parser_.Read(value);
+  }
+
+  bool ReadTypeId(TypeId* id) {
+    uint32_t value = 0;
+    if (!parser_.Read(&value))
+      return false;
+    *id = value == kNoSerializedTypeId ? kNoTypeId : value;
+    return true;
+  }
+
+ private:
+  common::BinaryBufferStreamReader reader_;
+  common::BinaryStreamParser parser_;
+
+  DISALLOW_COPY_AND_ASSIGN(RecordParser);
+};
+
+void WriteFlags(bool is_const, bool is_volatile, ByteWriter* writer) {
+  Type::Flags flags = kNoTypeFlags;
+  if (is_const)
+    flags |= Type::FLAG_CONST;
+  if (is_volatile)
+    flags |= Type::FLAG_VOLATILE;
+  writer->Write(flags);
+}
+
+void WriteNamedType(const NamedType& type,
+                    StringTableWriter* strings,
+                    ByteWriter* writer) {
+  writer->Write(strings->Add(type.GetName()));
+  writer->Write(strings->Add(type.GetDecoratedName()));
+}
+
+void WriteUserDefinedType(const UserDefinedType& udt,
+                          StringTableWriter* strings,
+                          ByteWriter* writer) {
+  WriteNamedType(udt, strings, writer);
+  writer->Write<uint8_t>(udt.udt_kind());
+  writer->Write<uint8_t>(udt.is_fwd_decl());
+  if (udt.is_fwd_decl())
+    return;
+
+  writer->Write(static_cast<uint32_t>(udt.fields().size()));
+  for (const auto& field : udt.fields()) {
+    writer->Write<uint8_t>(field->kind());
+    writer->Write(static_cast<int32_t>(field->offset()));
+    writer->WriteTypeId(field->type_id());
+
+    MemberFieldPtr member;
+    if (field->CastTo(&member)) {
+      writer->Write(strings->Add(member->name()));
+      WriteFlags(member->is_const(), member->is_volatile(), writer);
+      writer->Write(static_cast<uint8_t>(member->bit_pos()));
+      writer->Write(static_cast<uint8_t>(member->bit_len()));
+    }
+  }
+
+  writer->Write(static_cast<uint32_t>(udt.functions().size()));
+  for (const auto& function : udt.functions()) {
+    writer->Write(strings->Add(function.name()));
+    writer->WriteTypeId(function.type_id());
+  }
+}
+
+void WriteFunctionType(const FunctionType& function,
+                       ByteWriter* writer) {
+  writer->Write<uint8_t>(function.call_convention());
+  writer->WriteTypeId(function.containing_class_id());
+  WriteFlags(function.return_type().is_const(),
+             function.return_type().is_volatile(), writer);
+  writer->WriteTypeId(function.return_type().type_id());
+  writer->Write(static_cast<uint32_t>(function.argument_types().size()));
+  for (const auto& arg : function.argument_types()) {
+    WriteFlags(arg.is_const(), arg.is_volatile(), writer);
+    writer->WriteTypeId(arg.type_id());
+  }
+}
+
+// Writes the record of @p type. The records start with the kind and the size
+// of the type, followed by the kind specific data.
+void WriteTypeRecord(const Type& type,
+                     StringTableWriter* strings,
+                     ByteWriter* writer) {
+  writer->Write<uint8_t>(type.kind());
+  writer->Write(static_cast<uint32_t>(type.size()));
+
+  switch (type.kind()) {
+    case Type::BASIC_TYPE_KIND:
+      writer->Write(strings->Add(type.GetName()));
+      break;
+    case Type::USER_DEFINED_TYPE_KIND:
+      WriteUserDefinedType(static_cast<const UserDefinedType&>(type), strings,
+                           writer);
+      break;
+    case Type::POINTER_TYPE_KIND: {
+      const PointerType& ptr = static_cast<const PointerType&>(type);
+      writer->Write<uint8_t>(ptr.ptr_mode());
+      WriteFlags(ptr.is_const(), ptr.is_volatile(), writer);
+      writer->WriteTypeId(ptr.content_type_id());
+      break;
+    }
+    case Type::ARRAY_TYPE_KIND: {
+      const ArrayType& array = static_cast<const ArrayType&>(type);
+      WriteFlags(array.is_const(), array.is_volatile(), writer);
+      writer->WriteTypeId(array.index_type_id());
+      writer->Write(static_cast<uint32_t>(array.num_elements()));
+      writer->WriteTypeId(array.element_type_id());
+      break;
+    }
+    case Type::FUNCTION_TYPE_KIND:
+      WriteFunctionType(static_cast<const FunctionType&>(type), writer);
+      break;
+    case Type::GLOBAL_TYPE_KIND: {
+      const GlobalType& global = static_cast<const GlobalType&>(type);
+      writer->Write(strings->Add(global.GetName()));
+      writer->Write(global.rva());
+      writer->WriteTypeId(global.data_type_id());
+      break;
+    }
+    case Type::WILDCARD_TYPE_KIND:
+      WriteNamedType(static_cast<const NamedType&>(type), strings, writer);
+      break;
+    default:
+      NOTREACHED();
+  }
+}
+
+// Materializes the types of a repository out of a mapped file.
+class SerializedTypeLoader : public TypeRepository::Loader {
+ public:
+  SerializedTypeLoader() : header_(nullptr), index_(nullptr) {}
+
+  // Maps and validates the file at @p path.
+  // @returns true on success, false otherwise.
+  bool Initialize(const pe::PEFile::Signature& signature,
+                  const base::FilePath& path);
+
+  // @name TypeRepository::Loader implementation.
+  // @{
+  size_t size() const override;
+  void GetTypeIds(std::vector<TypeId>* ids) const override;
+  void GetTypeNames(TypeRepository::TypeNames* names) const override;
+  TypePtr LoadType(TypeId id, TypeRepository* repository) const override;
+  // @}
+
+ private:
+  bool ReadString(uint32_t offset, base::string16* str) const;
+
+  bool LoadUserDefinedType(size_t size,
+                           RecordParser* parser,
+                           TypeRepository* repository,
+                           TypePtr* type) const;
+  bool LoadFunctionType(RecordParser* parser, TypePtr* type) const;
+  bool LoadTypeRecord(RecordParser* parser,
+                      TypeRepository* repository,
+                      TypePtr* type) const;
+
+  base::MemoryMappedFile file_;
+  const FileHeader* header_;
+  const IndexEntry* index_;
+
+  DISALLOW_COPY_AND_ASSIGN(SerializedTypeLoader);
+};
+
+bool SerializedTypeLoader::Initialize(const pe::PEFile::Signature& signature,
+                                      const base::FilePath& path) {
+  if (!base::PathExists(path) || !file_.Initialize(path))
+    return false;
+
+  const uint8_t* data = file_.data();
+  size_t length = file_.length();
+  if (length < sizeof(FileHeader))
+    return false;
+  header_ = reinterpret_cast<const FileHeader*>(data);
+  index_ = reinterpret_cast<const IndexEntry*>(header_ + 1);
+
+  if (header_->magic != kMagic || header_->version != kVersion) {
+    LOG(ERROR) << "Unsupported type repository file " << path.value() << ".";
+    return false;
+  }
+  if (header_->module_size != signature.module_size ||
+      header_->module_checksum != signature.module_checksum ||
+      header_->module_time_date_stamp != signature.module_time_date_stamp) {
+    return false;
+  }
+
+  // Validate the layout of the file.
+  uint64_t index_end = sizeof(FileHeader) +
+      static_cast<uint64_t>(header_->type_count) * sizeof(IndexEntry);
+  uint64_t records_end =
+      static_cast<uint64_t>(header_->records_offset) + header_->records_size;
+  uint64_t strings_end =
+      static_cast<uint64_t>(header_->strings_offset) + header_->strings_size;
+  if (index_end > header_->records_offset ||
+      records_end > header_->strings_offset || strings_end > length ||
+      !::common::IsAligned(header_->strings_offset, sizeof(uint32_t))) {
+    LOG(ERROR) << "Corrupt type repository file " << path.value() << ".";
+    return false;
+  }
+
+  // The lookups rely on the index being sorted.
+  for (size_t i = 1; i < header_->type_count; ++i) {
+    if (index_[i - 1].type_id >= index_[i].type_id) {
+      LOG(ERROR) << "Corrupt type repository file " << path.value() << ".";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t SerializedTypeLoader::size() const {
+  return header_->type_count;
+}
+
+void SerializedTypeLoader::GetTypeIds(std::vector<TypeId>* ids) const {
+  DCHECK(ids);
+  ids->resize(header_->type_count);
+  for (size_t i = 0; i < header_->type_count; ++i)
+    (*ids)[i] = index_[i].type_id;
+}
+
+void SerializedTypeLoader::GetTypeNames(
+    TypeRepository::TypeNames* names) const {
+  DCHECK(names);
+  names->reserve(header_->type_count);
+
+  base::string16 name;
+  for (size_t i = 0; i < header_->type_count; ++i) {
+    if (!ReadString(index_[i].name, &name))
+      name = kUnknownTypeName;
+    names->push_back(std::make_pair(name, index_[i].type_id));
+  }
+}
+
+TypePtr SerializedTypeLoader::LoadType(TypeId id,
+                                       TypeRepository* repository) const {
+  DCHECK(repository);
+
+  if (id >= kNoSerializedTypeId)
+    return nullptr;
+
+  uint32_t type_id = static_cast<uint32_t>(id);
+  const IndexEntry* end = index_ + header_->type_count;
+  const IndexEntry* entry = std::lower_bound(index_, end, type_id);
+  if (entry == end || entry->type_id != type_id ||
+      entry->record >= header_->records_size) {
+    return nullptr;
+  }
+
+  RecordParser parser(
+      file_.data() + header_->records_offset + entry->record,
+      header_->records_size - entry->record);
+  TypePtr type;
+  if (!LoadTypeRecord(&parser, repository, &type)) {
+    LOG(ERROR) << "Invalid record for type " << id << ".";
+    return nullptr;
+  }
+
+  return type;
+}
+
+bool SerializedTypeLoader::ReadString(uint32_t offset,
+                                      base::string16* str) const {
+  DCHECK(str);
+
+  const uint8_t* strings = file_.data() + header_->strings_offset;
+  uint32_t length = 0;
+  if (header_->strings_size < sizeof(length) ||
+      offset > header_->strings_size - sizeof(length)) {
+    return false;
+  }
+  ::memcpy(&length, strings + offset, sizeof(length));
+
+  size_t available = header_->strings_size - offset - sizeof(length);
+  if (length > available / sizeof(base::char16))
+    return false;
+
+  str->assign(
+      reinterpret_cast<const base::char16*>(strings + offset + sizeof(length)),
+      length);
+  return true;
+}
+
+bool SerializedTypeLoader::LoadUserDefinedType(size_t size,
+                                               RecordParser* parser,
+                                               TypeRepository* repository,
+                                               TypePtr* type) const {
+  uint32_t name = 0;
+  uint32_t decorated_name = 0;
+  uint8_t udt_kind = 0;
+  uint8_t is_fwd_decl = 0;
+  base::string16 name_str;
+  base::string16 decorated_name_str;
+  if (!parser->Read(&name) || !parser->Read(&decorated_name) ||
+      !parser->Read(&udt_kind) || !parser->Read(&is_fwd_decl) ||
+      !ReadString(name, &name_str) ||
+      !ReadString(decorated_name, &decorated_name_str) ||
+      udt_kind > UserDefinedType::UDT_UNION) {
+    return false;
+  }
+
+  UserDefinedTypePtr udt = new UserDefinedType(
+      name_str, decorated_name_str, size,
+      static_cast<UserDefinedType::UdtKind>(udt_kind));
+  *type = udt;
+  if (is_fwd_decl) {
+    udt->SetIsForwardDeclaration();
+    return true;
+  }
+
+  uint32_t field_count = 0;
+  if (!parser->Read(&field_count))
+    return false;
+  UserDefinedType::Fields fields;
+  for (size_t i = 0; i < field_count; ++i) {
+    uint8_t kind = 0;
+    int32_t offset = 0;
+    TypeId field_type_id = kNoTypeId;
+    if (!parser->Read(&kind) || !parser->Read(&offset) ||
+        !parser->ReadTypeId(&field_type_id) || field_type_id == kNoTypeId) {
+      return false;
+    }
+
+    switch (kind) {
+      case UserDefinedType::Field::BASE_CLASS_KIND:
+        fields.push_back(new UserDefinedType::BaseClassField(
+            offset, field_type_id, repository));
+        break;
+      case UserDefinedType::Field::MEMBER_KIND: {
+        uint32_t member_name = 0;
+        Type::Flags flags = kNoTypeFlags;
+        uint8_t bit_pos = 0;
+        uint8_t bit_len = 0;
+        base::string16 member_name_str;
+        if (!parser->Read(&member_name) || !parser->Read(&flags) ||
+            !parser->Read(&bit_pos) || !parser->Read(&bit_len) ||
+            !ReadString(member_name, &member_name_str) || bit_pos > 63 ||
+            bit_len > 63) {
+          return false;
+        }
+        fields.push_back(new UserDefinedType::MemberField(
+            member_name_str, offset, flags, bit_pos, bit_len, field_type_id,
+            repository));
+        break;
+      }
+      case UserDefinedType::Field::VFPTR_KIND:
+        fields.push_back(new UserDefinedType::VfptrField(
+            offset, field_type_id, repository));
+        break;
+      default:
+        return false;
+    }
+  }
+
+  uint32_t function_count = 0;
+  if (!parser->Read(&function_count))
+    return false;
+  UserDefinedType::Functions functions;
+  for (size_t i = 0; i < function_count; ++i) {
+    uint32_t function_name = 0;
+    TypeId function_type_id = kNoTypeId;
+    base::string16 function_name_str;
+    if (!parser->Read(&function_name) ||
+        !parser->ReadTypeId(&function_type_id) ||
+        function_type_id == kNoTypeId ||
+        !ReadString(function_name, &function_name_str)) {
+      return false;
+    }
+    functions.push_back(
+        UserDefinedType::Function(function_name_str, function_type_id));
+  }
+
+  udt->Finalize(&fields, &functions);
+  return true;
+}
+
+bool SerializedTypeLoader::LoadFunctionType(RecordParser* parser,
+                                            TypePtr* type) const {
+  uint8_t call_convention = 0;
+  TypeId containing_class_id = kNoTypeId;
+  Type::Flags return_flags = kNoTypeFlags;
+  TypeId return_type_id = kNoTypeId;
+  uint32_t arg_count = 0;
+  if (!parser->Read(&call_convention) ||
+      !parser->ReadTypeId(&containing_class_id) ||
+      !parser->Read(&return_flags) || !parser->ReadTypeId(&return_type_id) ||
+      !parser->Read(&arg_count) ||
+      call_convention >= FunctionType::CALL_RESERVED) {
+    return false;
+  }
+
+  FunctionType::Arguments args;
+  for (size_t i = 0; i < arg_count; ++i) {
+    Type::Flags arg_flags = kNoTypeFlags;
+    TypeId arg_type_id = kNoTypeId;
+    if (!parser->Read(&arg_flags) || !parser->ReadTypeId(&arg_type_id))
+      return false;
+    args.push_back(FunctionType::ArgumentType(arg_flags, arg_type_id));
+  }
+
+  FunctionTypePtr function = new FunctionType(
+      static_cast<FunctionType::CallConvention>(call_convention));
+  function->Finalize(FunctionType::ArgumentType(return_flags, return_type_id),
+                     args, containing_class_id);
+  *type = function;
+  return true;
+}
+
+bool SerializedTypeLoader::LoadTypeRecord(RecordParser* parser,
+                                          TypeRepository* repository,
+                                          TypePtr* type) const {
+  DCHECK(parser);
+  DCHECK(type);
+
+  uint8_t kind = 0;
+  uint32_t size = 0;
+  if (!parser->Read(&kind) || !parser->Read(&size))
+    return false;
+
+  switch (kind) {
+    case Type::BASIC_TYPE_KIND: {
+      uint32_t name = 0;
+      base::string16 name_str;
+      if (!parser->Read(&name) || !ReadString(name, &name_str))
+        return false;
+      *type = new BasicType(name_str, size);
+      return true;
+    }
+    case Type::USER_DEFINED_TYPE_KIND:
+      return LoadUserDefinedType(size, parser, repository, type);
+    case Type::POINTER_TYPE_KIND: {
+      uint8_t ptr_mode = 0;
+      Type::Flags flags = kNoTypeFlags;
+      TypeId content_type_id = kNoTypeId;
+      if (!parser->Read(&ptr_mode) || !parser->Read(&flags) ||
+          !parser->ReadTypeId(&content_type_id) ||
+          ptr_mode > PointerType::PTR_MODE_REF) {
+        return false;
+      }
+      PointerTypePtr ptr =
+          new PointerType(size, static_cast<PointerType::Mode>(ptr_mode));
+      if (content_type_id != kNoTypeId)
+        ptr->Finalize(flags, content_type_id);
+      *type = ptr;
+      return true;
+    }
+    case Type::ARRAY_TYPE_KIND: {
+      Type::Flags flags = kNoTypeFlags;
+      TypeId index_type_id = kNoTypeId;
+      uint32_t num_elements = 0;
+      TypeId element_type_id = kNoTypeId;
+      if (!parser->Read(&flags) || !parser->ReadTypeId(&index_type_id) ||
+          !parser->Read(&num_elements) ||
+          !parser->ReadTypeId(&element_type_id)) {
+        return false;
+      }
+      ArrayTypePtr array = new ArrayType(size);
+      array->Finalize(flags, index_type_id, num_elements, element_type_id);
+      *type = array;
+      return true;
+    }
+    case Type::FUNCTION_TYPE_KIND:
+      return LoadFunctionType(parser, type);
+    case Type::GLOBAL_TYPE_KIND: {
+      uint32_t name = 0;
+      uint64_t rva = 0;
+      TypeId data_type_id = kNoTypeId;
+      base::string16 name_str;
+      if (!parser->Read(&name) || !parser->Read(&rva) ||
+          !parser->ReadTypeId(&data_type_id) || !ReadString(name, &name_str)) {
+        return false;
+      }
+      *type = new GlobalType(name_str, rva, data_type_id, size);
+      return true;
+    }
+    case Type::WILDCARD_TYPE_KIND: {
+      uint32_t name = 0;
+      uint32_t decorated_name = 0;
+      base::string16 name_str;
+      base::string16 decorated_name_str;
+      if (!parser->Read(&name) || !parser->Read(&decorated_name) ||
+          !ReadString(name, &name_str) ||
+          !ReadString(decorated_name, &decorated_name_str)) {
+        return false;
+      }
+      *type = new WildcardType(name_str, decorated_name_str, size);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+bool SaveTypeRepository(const pe::PEFile::Signature& signature,
+                        const TypeRepository& repository,
+                        const base::FilePath& path) {
+  // Write the records, in the order of the type ids.
+  std::vector<TypePtr> types;
+  types.reserve(repository.size());
+  for (auto type : repository)
+    types.push_back(type);
+  std::sort(types.begin(), types.end(),
+            [](const TypePtr& a, const TypePtr& b) {
+              return a->type_id() < b->type_id();
+            });
+
+  StringTableWriter strings;
+  std::vector<IndexEntry> index;
+  index.reserve(types.size());
+  std::vector<uint8_t> records;
+  ByteWriter records_writer(&records);
+  for (const auto& type : types) {
+    if (type->type_id() >= kNoSerializedTypeId ||
+        records.size() >= kNoSerializedTypeId) {
+      LOG(ERROR) << "Type repository too large to serialize.";
+      return false;
+    }
+
+    IndexEntry entry = {};
+    entry.type_id = static_cast<uint32_t>(type->type_id());
+    entry.name = strings.Add(type->GetName());
+    entry.record = static_cast<uint32_t>(records.size());
+    index.push_back(entry);
+
+    WriteTypeRecord(*type, &strings, &records_writer);
+  }
+  records_writer.Align(sizeof(uint32_t));
+
+  FileHeader header = {};
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.module_size = static_cast<uint32_t>(signature.module_size);
+  header.module_checksum = signature.module_checksum;
+  header.module_time_date_stamp = signature.module_time_date_stamp;
+  header.type_count = static_cast<uint32_t>(index.size());
+  header.records_offset = static_cast<uint32_t>(
+      sizeof(header) + index.size() * sizeof(IndexEntry));
+  header.records_size = static_cast<uint32_t>(records.size());
+  header.strings_offset = header.records_offset + header.records_size;
+  header.strings_size = static_cast<uint32_t>(strings.data().size());
+
+  std::vector<uint8_t> data;
+  data.reserve(header.strings_offset + header.strings_size);
+  ByteWriter writer(&data);
+  writer.Write(header);
+  for (const auto& entry : index)
+    writer.Write(entry);
+  data.insert(data.end(), records.begin(), records.end());
+  data.insert(data.end(), strings.data().begin(), strings.data().end());
+
+  // Write to a temporary file that then replaces the destination, such that
+  // concurrent readers never see a partial file.
+  base::FilePath temp_path;
+  if (!base::CreateTemporaryFileInDir(path.DirName(), &temp_path)) {
+    LOG(ERROR) << "Unable to create a temporary file in "
+               << path.DirName().value() << ".";
+    return false;
+  }
+  int size = static_cast<int>(data.size());
+  if (base::WriteFile(temp_path, reinterpret_cast<const char*>(data.data()),
+                      size) != size ||
+      !base::ReplaceFile(temp_path, path, nullptr)) {
+    LOG(ERROR) << "Unable to write " << path.value() << ".";
+    base::DeleteFile(temp_path, false);
+    return false;
+  }
+
+  return true;
+}
+
+bool LoadTypeRepository(const pe::PEFile::Signature& signature,
+                        const base::FilePath& path,
+                        scoped_refptr<TypeRepository>* repository) {
+  DCHECK(repository);
+  *repository = nullptr;
+
+  std::unique_ptr<SerializedTypeLoader> loader(new SerializedTypeLoader());
+  if (!loader->Initialize(signature, path))
+    return false;
+
+  *repository = new TypeRepository(signature, std::move(loader));
+  return true;
+}
+
+}  // namespace refinery
@@ -0,0 +1,59 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares the functions for persisting type repositories to a compact binary
+// file, which allows skipping the crawling of a module's PDB on subsequent
+// analyses. The file is made up of:
+//   - a header, identifying the module the types belong to,
+//   - an index of the types, sorted by id, with the offsets of their names
+//     and records,
+//   - the type records,
+//   - a table of the strings referred to by the index and the type records.
+// The file is memory mapped on load, and each type is materialized from its
+// record on first use.
+
+#ifndef SYZYGY_REFINERY_TYPES_SERIALIZED_TYPE_REPOSITORY_H_
+#define SYZYGY_REFINERY_TYPES_SERIALIZED_TYPE_REPOSITORY_H_
+
+#include "base/files/file_path.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/pe/pe_file.h"
+#include "syzygy/refinery/types/type_repository.h"
+
+namespace refinery {
+
+// Serializes a type repository to a file.
+// @param signature the signature of the module the types belong to.
+// @param repository the repository to serialize.
+// @param path the file to write.
+// @returns true on success, false on failure.
+bool SaveTypeRepository(const pe::PEFile::Signature& signature,
+                        const TypeRepository& repository,
+                        const base::FilePath& path);
+
+// Loads a type repository serialized by SaveTypeRepository. The types are
+// materialized from the file on demand, and the file remains mapped for the
+// lifetime of the repository.
+// @param signature the signature of the module whose types to load.
+// @param path the file to load.
+// @param repository on success, returns the type repository.
+// @returns true on success, false if the file doesn't exist, is invalid or
+//     belongs to a different module.
+bool LoadTypeRepository(const pe::PEFile::Signature& signature,
+                        const base::FilePath& path,
+                        scoped_refptr<TypeRepository>* repository);
+
+}  // namespace refinery
+
+#endif  // SYZYGY_REFINERY_TYPES_SERIALIZED_TYPE_REPOSITORY_H_
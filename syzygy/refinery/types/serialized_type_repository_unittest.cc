@@ -0,0 +1,261 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/refinery/types/serialized_type_repository.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/memory/ref_counted.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/unittest_util.h"
+#include "syzygy/refinery/types/pdb_crawler.h"
+#include "syzygy/refinery/types/type.h"
+#include "syzygy/refinery/types/type_repository.h"
+
+namespace refinery {
+
+namespace {
+
+void ExpectEqualUserDefinedTypes(const UserDefinedType& expected,
+                                 const UserDefinedType& actual) {
+  EXPECT_EQ(expected.udt_kind(), actual.udt_kind());
+  EXPECT_EQ(expected.is_fwd_decl(), actual.is_fwd_decl());
+  EXPECT_EQ(expected.functions(), actual.functions());
+
+  ASSERT_EQ(expected.fields().size(), actual.fields().size());
+  for (size_t i = 0; i < expected.fields().size(); ++i)
+    EXPECT_TRUE(*expected.fields()[i] == *actual.fields()[i]);
+}
+
+void ExpectEqualTypes(const Type& expected, const Type& actual) {
+  ASSERT_EQ(expected.kind(), actual.kind());
+  EXPECT_EQ(expected.type_id(), actual.type_id());
+  EXPECT_EQ(expected.size(), actual.size());
+  EXPECT_EQ(expected.GetName(), actual.GetName());
+  EXPECT_EQ(expected.GetDecoratedName(), actual.GetDecoratedName());
+
+  switch (expected.kind()) {
+    case Type::USER_DEFINED_TYPE_KIND:
+      ExpectEqualUserDefinedTypes(
+          static_cast<const UserDefinedType&>(expected),
+          static_cast<const UserDefinedType&>(actual));
+      break;
+    case Type::POINTER_TYPE_KIND: {
+      const PointerType& expected_ptr =
+          static_cast<const PointerType&>(expected);
+      const PointerType& actual_ptr = static_cast<const PointerType&>(actual);
+      EXPECT_EQ(expected_ptr.ptr_mode(), actual_ptr.ptr_mode());
+      EXPECT_EQ(expected_ptr.is_const(), actual_ptr.is_const());
+      EXPECT_EQ(expected_ptr.is_volatile(), actual_ptr.is_volatile());
+      EXPECT_EQ(expected_ptr.content_type_id(), actual_ptr.content_type_id());
+      break;
+    }
+    case Type::ARRAY_TYPE_KIND: {
+      const ArrayType& expected_array = static_cast<const ArrayType&>(expected);
+      const ArrayType& actual_array = static_cast<const ArrayType&>(actual);
+      EXPECT_EQ(expected_array.is_const(), actual_array.is_const());
+      EXPECT_EQ(expected_array.is_volatile(), actual_array.is_volatile());
+      EXPECT_EQ(expected_array.index_type_id(), actual_array.index_type_id());
+      EXPECT_EQ(expected_array.num_elements(), actual_array.num_elements());
+      EXPECT_EQ(expected_array.element_type_id(),
+                actual_array.element_type_id());
+      break;
+    }
+    case Type::FUNCTION_TYPE_KIND: {
+      const FunctionType& expected_function =
+          static_cast<const FunctionType&>(expected);
+      const FunctionType& actual_function =
+          static_cast<const FunctionType&>(actual);
+      EXPECT_EQ(expected_function.call_convention(),
+                actual_function.call_convention());
+      EXPECT_EQ(expected_function.containing_class_id(),
+                actual_function.containing_class_id());
+      EXPECT_TRUE(expected_function.return_type() ==
+                  actual_function.return_type());
+      EXPECT_EQ(expected_function.argument_types(),
+                actual_function.argument_types());
+      break;
+    }
+    case Type::GLOBAL_TYPE_KIND: {
+      const GlobalType& expected_global =
+          static_cast<const GlobalType&>(expected);
+      const GlobalType& actual_global = static_cast<const GlobalType&>(actual);
+      EXPECT_EQ(expected_global.rva(), actual_global.rva());
+      EXPECT_EQ(expected_global.data_type_id(), actual_global.data_type_id());
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+class SerializedTypeRepositoryTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    Test::SetUp();
+
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.path().Append(L"test_types.types");
+    signature_ = pe::PEFile::Signature(L"test_types.dll",
+                                       core::AbsoluteAddress(0x10000000U),
+                                       0x1000, 0xCAFEBABE, 0xDEADBEEF);
+
+    PdbCrawler crawler;
+    ASSERT_TRUE(crawler.InitializeForFile(testing::GetSrcRelativePath(
+        L"syzygy\\refinery\\test_data\\test_types.dll.pdb")));
+    repository_ = new TypeRepository(signature_);
+    ASSERT_TRUE(crawler.GetTypes(repository_.get()));
+    ASSERT_LT(0U, repository_->size());
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+  pe::PEFile::Signature signature_;
+  scoped_refptr<TypeRepository> repository_;
+};
+
+}  // namespace
+
+TEST_F(SerializedTypeRepositoryTest, RoundTrip) {
+  ASSERT_TRUE(SaveTypeRepository(signature_, *repository_, path_));
+
+  scoped_refptr<TypeRepository> loaded;
+  ASSERT_TRUE(LoadTypeRepository(signature_, path_, &loaded));
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(repository_->size(), loaded->size());
+
+  pe::PEFile::Signature loaded_signature;
+  ASSERT_TRUE(loaded->GetModuleSignature(&loaded_signature));
+  EXPECT_EQ(signature_, loaded_signature);
+
+  for (auto type : *repository_) {
+    TypePtr loaded_type = loaded->GetType(type->type_id());
+    ASSERT_TRUE(loaded_type);
+    EXPECT_EQ(loaded.get(), loaded_type->repository());
+    ExpectEqualTypes(*type, *loaded_type);
+
+    // Types are materialized once.
+    EXPECT_EQ(loaded_type, loaded->GetType(type->type_id()));
+  }
+  EXPECT_FALSE(loaded->GetType(kNoTypeId - 1));
+}
+
+TEST_F(SerializedTypeRepositoryTest, NameIndex) {
+  ASSERT_TRUE(SaveTypeRepository(signature_, *repository_, path_));
+  scoped_refptr<TypeRepository> loaded;
+  ASSERT_TRUE(LoadTypeRepository(signature_, path_, &loaded));
+
+  TypeRepository::TypeNames expected_names;
+  repository_->GetTypeNames(&expected_names);
+  TypeRepository::TypeNames names;
+  loaded->GetTypeNames(&names);
+  std::sort(expected_names.begin(), expected_names.end());
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ(expected_names, names);
+
+  scoped_refptr<TypeNameIndex> index = new TypeNameIndex(loaded);
+  EXPECT_EQ(repository_->size(), index->size());
+
+  std::vector<TypePtr> matching_types;
+  index->GetTypes(L"testing::TestSimpleUDT", &matching_types);
+  ASSERT_EQ(1U, matching_types.size());
+  EXPECT_EQ(Type::USER_DEFINED_TYPE_KIND, matching_types[0]->kind());
+  EXPECT_EQ(loaded.get(), matching_types[0]->repository());
+}
+
+TEST_F(SerializedTypeRepositoryTest, RejectsOtherModules) {
+  ASSERT_TRUE(SaveTypeRepository(signature_, *repository_, path_));
+
+  pe::PEFile::Signature other_signature(signature_);
+  other_signature.module_time_date_stamp += 1;
+  scoped_refptr<TypeRepository> loaded;
+  EXPECT_FALSE(LoadTypeRepository(other_signature, path_, &loaded));
+  EXPECT_FALSE(loaded);
+}
+
+TEST_F(SerializedTypeRepositoryTest, RejectsInvalidFiles) {
+  scoped_refptr<TypeRepository> loaded;
+  EXPECT_FALSE(LoadTypeRepository(signature_, path_, &loaded));
+
+  // A truncated file is rejected.
+  ASSERT_TRUE(SaveTypeRepository(signature_, *repository_, path_));
+  int64_t size = 0;
+  ASSERT_TRUE(base::GetFileSize(path_, &size));
+  std::vector<char> data(static_cast<size_t>(size));
+  ASSERT_EQ(size, base::ReadFile(path_, data.data(), static_cast<int>(size)));
+  ASSERT_EQ(size / 2, base::WriteFile(path_, data.data(),
+                                      static_cast<int>(size / 2)));
+  EXPECT_FALSE(LoadTypeRepository(signature_, path_, &loaded));
+
+  // So is a file with a bad header.
+  data[0] ^= 0xFF;
+  ASSERT_EQ(size, base::WriteFile(path_, data.data(), static_cast<int>(size)));
+  EXPECT_FALSE(LoadTypeRepository(signature_, path_, &loaded));
+}
+
+// Compares crawling a PDB for types with loading its persisted types, which
+// includes materializing all of them. Run manually with a large PDB by
+// setting the REFINERY_BENCHMARK_PDB environment variable.
+TEST_F(SerializedTypeRepositoryTest, DISABLED_ColdVersusWarmBenchmark) {
+  base::FilePath pdb_path = testing::GetSrcRelativePath(
+      L"syzygy\\refinery\\test_data\\test_types.dll.pdb");
+  char* benchmark_pdb = getenv("REFINERY_BENCHMARK_PDB");
+  if (benchmark_pdb != nullptr)
+    pdb_path = base::FilePath(base::ASCIIToUTF16(benchmark_pdb));
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  PdbCrawler crawler;
+  ASSERT_TRUE(crawler.InitializeForFile(pdb_path));
+  scoped_refptr<TypeRepository> crawled = new TypeRepository(signature_);
+  ASSERT_TRUE(crawler.GetTypes(crawled.get()));
+  base::TimeDelta cold = base::TimeTicks::Now() - start;
+
+  start = base::TimeTicks::Now();
+  ASSERT_TRUE(SaveTypeRepository(signature_, *crawled, path_));
+  base::TimeDelta save = base::TimeTicks::Now() - start;
+
+  start = base::TimeTicks::Now();
+  scoped_refptr<TypeRepository> loaded;
+  ASSERT_TRUE(LoadTypeRepository(signature_, path_, &loaded));
+  scoped_refptr<TypeNameIndex> index = new TypeNameIndex(loaded);
+  base::TimeDelta warm_startup = base::TimeTicks::Now() - start;
+
+  start = base::TimeTicks::Now();
+  size_t materialized = 0;
+  for (auto type : *loaded)
+    ++materialized;
+  base::TimeDelta warm_full = base::TimeTicks::Now() - start + warm_startup;
+  ASSERT_EQ(crawled->size(), materialized);
+
+  int64_t file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(path_, &file_size));
+  LOG(INFO) << pdb_path.value() << ": " << crawled->size() << " types, "
+            << file_size << " bytes persisted.";
+  LOG(INFO) << "Cold crawl: " << cold.InMillisecondsF() << " ms, save: "
+            << save.InMillisecondsF() << " ms.";
+  LOG(INFO) << "Warm startup with name index: "
+            << warm_startup.InMillisecondsF() << " ms, with all types "
+            << "materialized: " << warm_full.InMillisecondsF() << " ms.";
+}
+
+}  // namespace refinery
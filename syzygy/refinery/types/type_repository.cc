@@ -26,14 +26,39 @@ TypeRepository::TypeRepository(const pe::PEFile::Signature& signature)
     : is_signature_set_(true), signature_(signature) {
 }
 
+TypeRepository::TypeRepository(const pe::PEFile::Signature& signature,
+                               std::unique_ptr<Loader> loader)
+    : is_signature_set_(true),
+      signature_(signature),
+      loader_(std::move(loader)) {
+  DCHECK(loader_);
+}
+
 TypeRepository::~TypeRepository() {
 }
 
 TypePtr TypeRepository::GetType(TypeId id) const {
+  if (!loader_) {
+    auto it = types_.find(id);
+    if (it == types_.end())
+      return nullptr;
+    return it->second;
+  }
+
+  base::AutoLock lock(lock_);
   auto it = types_.find(id);
-  if (it == types_.end())
+  if (it != types_.end())
+    return it->second;
+
+  // Materialize the type. The types refer to their repository, which is only
+  // modified through the materialization of its types.
+  TypeRepository* repository = const_cast<TypeRepository*>(this);
+  TypePtr type = loader_->LoadType(id, repository);
+  if (!type)
     return nullptr;
-  return it->second;
+  bool result = repository->AddTypeWithIdImpl(type, id);
+  DCHECK(result);
+  return type;
 }
 
 TypeId TypeRepository::AddType(TypePtr type) {
@@ -49,19 +74,26 @@ TypeId TypeRepository::AddType(TypePtr type) {
 }
 
 bool TypeRepository::AddTypeWithId(TypePtr type, TypeId id) {
-  DCHECK(type);
+  DCHECK(!loader_);
+  return AddTypeWithIdImpl(type, id);
+}
 
-  // Check that the ID is unassigned.
-  if (types_.find(id) != types_.end())
-    return false;
+void TypeRepository::GetTypeNames(TypeNames* names) const {
+  DCHECK(names);
+  names->clear();
 
-  type->SetRepository(this, id);
-  types_[id] = type;
+  if (loader_) {
+    loader_->GetTypeNames(names);
+    return;
+  }
 
-  return true;
+  names->reserve(types_.size());
+  for (const auto& entry : types_)
+    names->push_back(std::make_pair(entry.second->GetName(), entry.first));
 }
 
-bool TypeRepository::GetModuleSignature(pe::PEFile::Signature* signature) {
+bool TypeRepository::GetModuleSignature(
+    pe::PEFile::Signature* signature) const {
   DCHECK(signature);
 
   if (!is_signature_set_)
@@ -71,21 +103,62 @@ bool TypeRepository::GetModuleSignature(pe::PEFile::Signature* signature) {
 }
 
 size_t TypeRepository::size() const {
+  if (loader_)
+    return loader_->size();
   return types_.size();
 }
 
 TypeRepository::Iterator TypeRepository::begin() const {
+  LoadAllTypes();
   return Iterator(types_.begin());
 }
 
 TypeRepository::Iterator TypeRepository::end() const {
+  LoadAllTypes();
   return Iterator(types_.end());
 }
 
-TypeNameIndex::TypeNameIndex(scoped_refptr<TypeRepository> repository) {
+bool TypeRepository::AddTypeWithIdImpl(TypePtr type, TypeId id) {
+  DCHECK(type);
+  if (loader_)
+    lock_.AssertAcquired();
+
+  // Check that the ID is unassigned.
+  if (types_.find(id) != types_.end())
+    return false;
+
+  type->SetRepository(this, id);
+  types_[id] = type;
+
+  return true;
+}
+
+void TypeRepository::LoadAllTypes() const {
+  if (!loader_)
+    return;
+
+  // Once all types are materialized, the map is no longer modified and its
+  // iterators remain valid.
+  {
+    base::AutoLock lock(lock_);
+    if (types_.size() == loader_->size())
+      return;
+  }
+
+  std::vector<TypeId> ids;
+  loader_->GetTypeIds(&ids);
+  for (TypeId id : ids)
+    GetType(id);
+}
+
+TypeNameIndex::TypeNameIndex(scoped_refptr<TypeRepository> repository)
+    : repository_(repository) {
   DCHECK(repository);
-  for (auto type : *repository)
-    name_index_.insert(std::make_pair(type->GetName(), type));
+
+  TypeRepository::TypeNames names;
+  repository->GetTypeNames(&names);
+  for (const auto& name : names)
+    name_index_.insert(name);
 }
 
 TypeNameIndex::~TypeNameIndex() {
@@ -97,8 +170,11 @@ void TypeNameIndex::GetTypes(const base::string16& name,
   types->clear();
 
   auto match = name_index_.equal_range(name);
-  for (auto it = match.first; it != match.second; ++it)
-    types->push_back(it->second);
+  for (auto it = match.first; it != match.second; ++it) {
+    TypePtr type = repository_->GetType(it->second);
+    if (type)
+      types->push_back(type);
+  }
 }
 
 }  // namespace refinery
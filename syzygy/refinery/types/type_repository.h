@@ -17,11 +17,15 @@
 
 #include <iterator>
 #include <map>
+#include <memory>
+#include <utility>
 #include <vector>
 
 #include "base/macros.h"
 #include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
+#include "base/strings/string16.h"
+#include "base/synchronization/lock.h"
 #include "syzygy/pe/pe_file.h"
 
 namespace refinery {
@@ -31,33 +35,52 @@ class Type;
 using TypePtr = scoped_refptr<Type>;
 
 // Keeps type instances, assigns them an ID and vends them out by ID on demand.
+// Once populated, a repository and its types may be shared across threads, as
+// long as they're no longer modified.
+// A repository may also be backed by a Loader, in which case its types are
+// materialized on first use. Such a repository is read-only.
 // TODO(manzagop): cleave the interface so as to obtain something immutable.
 // TODO(manzagop): abstract the module id away from a pe file signature.
-class TypeRepository : public base::RefCounted<TypeRepository> {
+class TypeRepository : public base::RefCountedThreadSafe<TypeRepository> {
  public:
   class Iterator;
+  class Loader;
+
+  // A list of type names and the ids of the corresponding types.
+  typedef std::vector<std::pair<base::string16, TypeId>> TypeNames;
 
   // TODO(manzagop): make it mandatory to provide a module signature.
   TypeRepository();
   explicit TypeRepository(const pe::PEFile::Signature& signature);
+  // Creates a read-only repository whose types are materialized by @p loader.
+  TypeRepository(const pe::PEFile::Signature& signature,
+                 std::unique_ptr<Loader> loader);
 
   // Retrieve a type by @p id.
   TypePtr GetType(TypeId id) const;
 
   // Add @p type and get its assigned id.
   // @pre @p type must not be in any repository.
+  // @pre this repository must not be backed by a loader.
   TypeId AddType(TypePtr type);
 
   // Add @p type and with @p id if the give id is free.
   // @pre @p type must not be in any repository and @p id must be free.
+  // @pre this repository must not be backed by a loader.
   // @returns true on success, failure typically means id is already taken.
   bool AddTypeWithId(TypePtr type, TypeId id);
 
+  // Retrieves the names of all the types. This doesn't materialize the types
+  // of a repository backed by a loader.
+  // @param names on return, contains the names of the types and their ids.
+  void GetTypeNames(TypeNames* names) const;
 
   // Get the signature for the module this type represents.
-  bool GetModuleSignature(pe::PEFile::Signature* signature);
+  bool GetModuleSignature(pe::PEFile::Signature* signature) const;
 
   // @name Accessors.
+  // @note iterating over a repository backed by a loader materializes all of
+  //     its types.
   // @{
   size_t size() const;
   Iterator begin() const;
@@ -65,16 +88,52 @@ class TypeRepository : public base::RefCounted<TypeRepository> {
   // @}
 
  private:
-  friend class base::RefCounted<TypeRepository>;
+  friend class base::RefCountedThreadSafe<TypeRepository>;
   ~TypeRepository();
 
+  // Adds @p type with @p id, under the lock if this is backed by a loader.
+  bool AddTypeWithIdImpl(TypePtr type, TypeId id);
+
+  // Materializes all the types of a repository backed by a loader.
+  void LoadAllTypes() const;
+
   bool is_signature_set_;
   pe::PEFile::Signature signature_;
-  std::unordered_map<TypeId, TypePtr> types_;
+
+  // Materializes the types on demand, if set.
+  std::unique_ptr<Loader> loader_;
+
+  // Protects the types of a repository backed by a loader, which are
+  // materialized by const accessors.
+  mutable base::Lock lock_;
+  mutable std::unordered_map<TypeId, TypePtr> types_;
 
   DISALLOW_COPY_AND_ASSIGN(TypeRepository);
 };
 
+// The interface for materializing the types of a repository on demand.
+class TypeRepository::Loader {
+ public:
+  virtual ~Loader() {}
+
+  // @returns the number of types.
+  virtual size_t size() const = 0;
+
+  // Retrieves the ids of all the types.
+  // @param ids on return, contains the ids of the types.
+  virtual void GetTypeIds(std::vector<TypeId>* ids) const = 0;
+
+  // Retrieves the names of all the types, without materializing them.
+  // @param names on return, contains the names of the types and their ids.
+  virtual void GetTypeNames(TypeNames* names) const = 0;
+
+  // Materializes a type.
+  // @param id the id of the type to materialize.
+  // @param repository the repository the type will belong to.
+  // @returns the type, or nullptr if there is no type @p id or it's invalid.
+  virtual TypePtr LoadType(TypeId id, TypeRepository* repository) const = 0;
+};
+
 class TypeRepository::Iterator
     : public std::iterator<std::input_iterator_tag, TypePtr> {
  public:
@@ -100,7 +159,9 @@ class TypeRepository::Iterator
   std::unordered_map<TypeId, TypePtr>::const_iterator it_;
 };
 
-// The TypeNameIndex provides name-based indexing for types.
+// The TypeNameIndex provides name-based indexing for types. The types are
+// retrieved from the repository on lookup, such that indexing a repository
+// backed by a loader doesn't materialize its types.
 // @note The underlying TypeRepository should not be modified.
 // @note Name-based indexing, as well as support for name collisions (using a
 //     multimap) are necessary as long as we rely on DIA. DIA does not expose
@@ -108,18 +169,23 @@ class TypeRepository::Iterator
 //     (DIA ids are not stable as they're based on the parse order).
 // TODO(manzagop): relocate to where this is used once it exists.
 // TODO(manzagop): remove once DIA is no-longer used.
-class TypeNameIndex : public base::RefCounted<TypeNameIndex> {
+class TypeNameIndex : public base::RefCountedThreadSafe<TypeNameIndex> {
  public:
   explicit TypeNameIndex(scoped_refptr<TypeRepository> repository);
 
   // Retrieve matching @p types by @p name.
   void GetTypes(const base::string16& name, std::vector<TypePtr>* types) const;
 
+  // @returns the number of indexed types.
+  size_t size() const { return name_index_.size(); }
+
  private:
-  friend class base::RefCounted<TypeNameIndex>;
+  friend class base::RefCountedThreadSafe<TypeNameIndex>;
   ~TypeNameIndex();
 
-  std::multimap<base::string16, TypePtr> name_index_;
+  // The repository of the indexed types.
+  scoped_refptr<TypeRepository> repository_;
+  std::multimap<base::string16, TypeId> name_index_;
 };
 
 }  // namespace refinery
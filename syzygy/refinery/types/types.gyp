@@ -25,6 +25,8 @@
         'dia_crawler.h',
         'pdb_crawler.cc',
         'pdb_crawler.h',
+        'serialized_type_repository.cc',
+        'serialized_type_repository.h',
         'type.cc',
         'type.h',
         'type_namer.cc',
@@ -15,6 +15,7 @@
 #include "syzygy/relink/relink_app.h"
 
 #include "base/strings/string_number_conversions.h"
+#include "syzygy/block_graph/block_util.h"
 #include "syzygy/block_graph/orderers/original_orderer.h"
 #include "syzygy/block_graph/orderers/random_orderer.h"
 #include "syzygy/block_graph/transforms/fuzzing_transform.h"
@@ -57,6 +58,9 @@ const char kUsageFormatStr[] =
     "                          Default is inferred from output-image.\n"
     "    --overwrite           Allow output files to be overwritten.\n"
     "    --padding=<integer>   Add bytes of padding between blocks.\n"
+    "    --pdb-compression-level=<integer>\n"
+    "                          The zlib compression level of the augmented\n"
+    "                          PDB stream, from 0 to 9. Default value is 1.\n"
     "    --verbose             Log verbosely.\n"
     "\n"
     "  Testing Options:\n"
@@ -72,6 +76,8 @@ const char kUsageFormatStr[] =
     "    * If --order-file is specified, --input-image is optional.\n"
     "    * The --compress-pdb and --no-strip-strings options are only\n"
     "      effective if --no-augment-pdb is not specified.\n"
+    "    * The --pdb-compression-level option is only effective if\n"
+    "      --compress-pdb is specified.\n"
     "    * The --exclude-bb-padding option is only effective if\n"
     "      --basic-blocks is specified.\n";
 
@@ -172,6 +178,18 @@ bool RelinkApp::ParseCommandLine(const base::CommandLine* cmd_line) {
       return Usage(cmd_line, "Code-alignment value cannot be zero.");
   }
 
+  // Parse the PDB compression level argument.
+  if (cmd_line->HasSwitch("pdb-compression-level")) {
+    std::wstring level_str(
+        cmd_line->GetSwitchValueNative("pdb-compression-level"));
+    uint32_t level = 0;
+    if (!ParseUInt32(level_str, &level) ||
+        level > static_cast<uint32_t>(core::ZOutStream::kZBestCompression)) {
+      return Usage(cmd_line, "Invalid pdb-compression-level value.");
+    }
+    pdb_compression_level_ = static_cast<int>(level);
+  }
+
   return true;
 }
 
@@ -208,6 +226,7 @@ int RelinkApp::Run() {
   relinker.set_allow_overwrite(overwrite_);
   relinker.set_augment_pdb(!no_augment_pdb_);
   relinker.set_compress_pdb(compress_pdb_);
+  relinker.set_pdb_compression_level(pdb_compression_level_);
   relinker.set_strip_strings(!no_strip_strings_);
 
   // Initialize the relinker. This does the decomposition, etc.
@@ -215,6 +234,8 @@ int RelinkApp::Run() {
     LOG(ERROR) << "Failed to initialize relinker.";
     return 1;
   }
+  block_graph::LogBlockGraphMemoryUsage("Decomposed image",
+                                        relinker.block_graph());
 
   // Transforms that may be used.
   std::unique_ptr<pe::transforms::ExplodeBasicBlocksTransform> bb_explode;
@@ -280,6 +301,8 @@ int RelinkApp::Run() {
     LOG(ERROR) << "Unable to relink input image.";
     return 1;
   }
+  block_graph::LogBlockGraphMemoryUsage("Relinked image",
+                                        relinker.block_graph());
 
   return 0;
 }
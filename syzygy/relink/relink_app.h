@@ -22,6 +22,7 @@
 #include "base/strings/string_piece.h"
 #include "base/time/time.h"
 #include "syzygy/application/application.h"
+#include "syzygy/core/zstream.h"
 
 namespace relink {
 
@@ -35,6 +36,7 @@ class RelinkApp : public application::AppImplBase {
         code_alignment_(1),
         no_augment_pdb_(false),
         compress_pdb_(false),
+        pdb_compression_level_(core::ZOutStream::kZBestSpeed),
         no_strip_strings_(false),
         output_metadata_(false),
         overwrite_(false),
@@ -69,6 +71,7 @@ class RelinkApp : public application::AppImplBase {
   size_t code_alignment_;
   bool no_augment_pdb_;
   bool compress_pdb_;
+  int pdb_compression_level_;
   bool no_strip_strings_;
   bool output_metadata_;
   bool overwrite_;
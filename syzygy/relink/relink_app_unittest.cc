@@ -48,6 +48,7 @@ class TestRelinkApp : public RelinkApp {
   using RelinkApp::code_alignment_;
   using RelinkApp::no_augment_pdb_;
   using RelinkApp::compress_pdb_;
+  using RelinkApp::pdb_compression_level_;
   using RelinkApp::no_strip_strings_;
   using RelinkApp::output_metadata_;
   using RelinkApp::overwrite_;
@@ -237,6 +238,7 @@ TEST_F(RelinkAppTest, ParseMinimalCommandLineWithOrderFile) {
   EXPECT_EQ(1, test_impl_.code_alignment_);
   EXPECT_FALSE(test_impl_.no_augment_pdb_);
   EXPECT_FALSE(test_impl_.compress_pdb_);
+  EXPECT_EQ(core::ZOutStream::kZBestSpeed, test_impl_.pdb_compression_level_);
   EXPECT_FALSE(test_impl_.no_strip_strings_);
   EXPECT_TRUE(test_impl_.output_metadata_);
   EXPECT_FALSE(test_impl_.overwrite_);
@@ -245,6 +247,26 @@ TEST_F(RelinkAppTest, ParseMinimalCommandLineWithOrderFile) {
   EXPECT_FALSE(test_impl_.SetUp());
 }
 
+TEST_F(RelinkAppTest, ParsePdbCompressionLevel) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitch("compress-pdb");
+  cmd_line_.AppendSwitchASCII("pdb-compression-level", "9");
+
+  EXPECT_TRUE(test_impl_.ParseCommandLine(&cmd_line_));
+  EXPECT_TRUE(test_impl_.compress_pdb_);
+  EXPECT_EQ(core::ZOutStream::kZBestCompression,
+            test_impl_.pdb_compression_level_);
+}
+
+TEST_F(RelinkAppTest, ParseInvalidPdbCompressionLevel) {
+  cmd_line_.AppendSwitchPath("input-image", input_image_path_);
+  cmd_line_.AppendSwitchPath("output-image", output_image_path_);
+  cmd_line_.AppendSwitchASCII("pdb-compression-level", "10");
+
+  EXPECT_FALSE(test_impl_.ParseCommandLine(&cmd_line_));
+}
+
 TEST_F(RelinkAppTest, ParseFullCommandLineWithOrderFile) {
   // Note that we specify the no-metadata flag, so we expect false below
   // for the output_metadata_ member. Also note that neither seed nor padding
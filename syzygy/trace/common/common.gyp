@@ -45,17 +45,31 @@
         '<(src)/syzygy/common/common.gyp:common_lib',
       ],
     },
+    {
+      'target_name': 'trace_compression_lib',
+      'type': 'static_library',
+      'sources': [
+        'segment_compression.cc',
+        'segment_compression.h',
+      ],
+      'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/core/core.gyp:core_lib',
+      ],
+    },
     {
       'target_name': 'trace_common_unittests',
       'type': 'executable',
       'sources': [
         'clock_unittest.cc',
+        'segment_compression_unittest.cc',
         'service_unittest.cc',
         'service_util_unittest.cc',
         '<(src)/syzygy/testing/run_all_unittests.cc',
       ],
       'dependencies': [
         'trace_common_lib',
+        'trace_compression_lib',
         '<(src)/base/base.gyp:test_support_base',
         '<(src)/testing/gmock.gyp:gmock',
         '<(src)/testing/gtest.gyp:gtest',
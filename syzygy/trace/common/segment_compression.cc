@@ -0,0 +1,94 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/common/segment_compression.h"
+
+#include <iterator>
+#include <memory>
+
+#include "base/logging.h"
+#include "syzygy/core/serialization.h"
+#include "syzygy/core/zstream.h"
+
+namespace trace {
+namespace common {
+
+const int kSegmentCompressionLevel = core::ZOutStream::kZBestSpeed;
+
+bool CompressSegmentData(const uint8_t* data,
+                         size_t length,
+                         int level,
+                         std::vector<uint8_t>* compressed) {
+  DCHECK(data != NULL);
+  DCHECK(compressed != NULL);
+
+  core::ScopedOutStreamPtr out_stream(
+      core::CreateByteOutStream(std::back_inserter(*compressed)));
+  core::ZOutStream zout_stream(out_stream.get());
+  if (!zout_stream.Init(level) ||
+      !zout_stream.Write(length, data) ||
+      !zout_stream.Flush()) {
+    LOG(ERROR) << "Failed to compress segment data.";
+    return false;
+  }
+
+  return true;
+}
+
+bool DecompressSegmentData(const uint8_t* data,
+                           size_t length,
+                           size_t uncompressed_length,
+                           std::vector<uint8_t>* uncompressed) {
+  DCHECK(data != NULL);
+  DCHECK(uncompressed != NULL);
+
+  // Deflate can't do better than about 1032:1, which catches corrupt lengths
+  // before anything is allocated for them.
+  const size_t kMaxCompressionRatio = 1032;
+  if (uncompressed_length / kMaxCompressionRatio > length) {
+    LOG(ERROR) << "Segment data of " << length << " bytes can't decompress to "
+               << uncompressed_length << " bytes.";
+    return false;
+  }
+
+  core::ScopedInStreamPtr in_stream(
+      core::CreateByteInStream(data, data + length));
+  core::ZInStream zin_stream(in_stream.get());
+  if (!zin_stream.Init()) {
+    LOG(ERROR) << "Failed to initialize segment decompression.";
+    return false;
+  }
+
+  size_t offset = uncompressed->size();
+  uncompressed->resize(offset + uncompressed_length);
+  if (uncompressed_length != 0 &&
+      !zin_stream.Read(uncompressed_length, &uncompressed->at(offset))) {
+    LOG(ERROR) << "Failed to decompress segment data.";
+    return false;
+  }
+
+  // The stream must end exactly where the segment does.
+  uint8_t extra = 0;
+  size_t bytes_read = 0;
+  if (!zin_stream.Read(1, &extra, &bytes_read) || bytes_read != 0) {
+    LOG(ERROR) << "Segment data decompresses to more than "
+               << uncompressed_length << " bytes.";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace common
+}  // namespace trace
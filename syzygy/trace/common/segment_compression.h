@@ -0,0 +1,60 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Helper functions for compressing and decompressing the data of trace file
+// segments. See TraceFileCompressedSegmentHeader.
+
+#ifndef SYZYGY_TRACE_COMMON_SEGMENT_COMPRESSION_H_
+#define SYZYGY_TRACE_COMMON_SEGMENT_COMPRESSION_H_
+
+#include <stdint.h>
+#include <vector>
+
+namespace trace {
+namespace common {
+
+// The compression level used by the call trace service. Trace data compresses
+// well even at the fastest level, and the service must keep up with its
+// clients.
+extern const int kSegmentCompressionLevel;
+
+// Compresses the data of a trace file segment.
+// @param data the segment data to compress.
+// @param length the length of the segment data.
+// @param level the zlib compression level, in the range 0 to 9.
+// @param compressed will receive the compressed data. This is appended to,
+//     so that the caller can reserve room for headers.
+// @returns true on success, false otherwise.
+bool CompressSegmentData(const uint8_t* data,
+                         size_t length,
+                         int level,
+                         std::vector<uint8_t>* compressed);
+
+// Decompresses the data of a trace file segment.
+// @param data the compressed segment data.
+// @param length the length of the compressed segment data.
+// @param uncompressed_length the expected length of the decompressed data.
+// @param uncompressed will receive the decompressed data. This is appended
+//     to, so that the caller can reserve room for headers.
+// @returns true on success, false if the data is invalid or does not inflate
+//     to exactly @p uncompressed_length bytes.
+bool DecompressSegmentData(const uint8_t* data,
+                           size_t length,
+                           size_t uncompressed_length,
+                           std::vector<uint8_t>* uncompressed);
+
+}  // namespace common
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_COMMON_SEGMENT_COMPRESSION_H_
@@ -0,0 +1,102 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/common/segment_compression.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+namespace trace {
+namespace common {
+
+namespace {
+
+// Generates somewhat compressible data, looking vaguely like trace records.
+std::vector<uint8_t> MakeSegmentData(size_t length) {
+  std::vector<uint8_t> data(length);
+  for (size_t i = 0; i < length; ++i)
+    data[i] = static_cast<uint8_t>((i % 16 < 8) ? i / 16 : ::rand());
+  return data;
+}
+
+}  // namespace
+
+TEST(SegmentCompressionTest, RoundTrip) {
+  std::vector<uint8_t> data = MakeSegmentData(100000);
+
+  // Data is appended after whatever the vectors already hold.
+  std::vector<uint8_t> compressed(4, 0xAB);
+  ASSERT_TRUE(CompressSegmentData(data.data(), data.size(),
+                                  kSegmentCompressionLevel, &compressed));
+  EXPECT_LT(compressed.size(), data.size());
+  EXPECT_EQ(0xAB, compressed[3]);
+
+  std::vector<uint8_t> uncompressed(2, 0xCD);
+  ASSERT_TRUE(DecompressSegmentData(compressed.data() + 4,
+                                    compressed.size() - 4,
+                                    data.size(),
+                                    &uncompressed));
+  ASSERT_EQ(data.size() + 2, uncompressed.size());
+  EXPECT_EQ(0xCD, uncompressed[1]);
+  EXPECT_TRUE(std::equal(data.begin(), data.end(), uncompressed.begin() + 2));
+}
+
+TEST(SegmentCompressionTest, EmptySegment) {
+  std::vector<uint8_t> compressed;
+  uint8_t dummy = 0;
+  ASSERT_TRUE(CompressSegmentData(&dummy, 0, kSegmentCompressionLevel,
+                                  &compressed));
+
+  std::vector<uint8_t> uncompressed;
+  ASSERT_TRUE(DecompressSegmentData(compressed.data(), compressed.size(), 0,
+                                    &uncompressed));
+  EXPECT_TRUE(uncompressed.empty());
+}
+
+TEST(SegmentCompressionTest, DecompressFailsForWrongLength) {
+  std::vector<uint8_t> data = MakeSegmentData(10000);
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(CompressSegmentData(data.data(), data.size(),
+                                  kSegmentCompressionLevel, &compressed));
+
+  std::vector<uint8_t> uncompressed;
+  EXPECT_FALSE(DecompressSegmentData(compressed.data(), compressed.size(),
+                                     data.size() - 1, &uncompressed));
+  uncompressed.clear();
+  EXPECT_FALSE(DecompressSegmentData(compressed.data(), compressed.size(),
+                                     data.size() + 1, &uncompressed));
+}
+
+TEST(SegmentCompressionTest, DecompressFailsForCorruptData) {
+  std::vector<uint8_t> data = MakeSegmentData(10000);
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(CompressSegmentData(data.data(), data.size(),
+                                  kSegmentCompressionLevel, &compressed));
+
+  // Truncated.
+  std::vector<uint8_t> uncompressed;
+  EXPECT_FALSE(DecompressSegmentData(compressed.data(), compressed.size() / 2,
+                                     data.size(), &uncompressed));
+
+  // Garbage.
+  std::vector<uint8_t> garbage(compressed.size(), 0xCC);
+  uncompressed.clear();
+  EXPECT_FALSE(DecompressSegmentData(garbage.data(), garbage.size(),
+                                     data.size(), &uncompressed));
+}
+
+}  // namespace common
+}  // namespace trace
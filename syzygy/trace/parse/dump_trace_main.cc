@@ -27,11 +27,13 @@
 #include "base/win/scoped_handle.h"
 #include "base/win/windows_version.h"
 #include "syzygy/common/indexed_frequency_data.h"
+#include "syzygy/trace/parse/parse_engine_rpc.h"
 #include "syzygy/trace/parse/parser.h"
 #include "syzygy/trace/service/service.h"
 
 namespace {
 
+using trace::parser::ParseEngineRpc;
 using trace::parser::Parser;
 using trace::parser::ParseEventHandler;
 using trace::parser::ModuleInformation;
@@ -496,8 +498,16 @@ class TraceFileDumper : public ParseEventHandler {
 };
 
 bool DumpTraceFiles(FILE* out_file,
-                    const std::vector<base::FilePath>& file_paths) {
+                    const std::vector<base::FilePath>& file_paths,
+                    bool merge) {
   Parser parser;
+  if (merge) {
+    // This engine takes precedence over the default one created by Init.
+    ParseEngineRpc* engine = new ParseEngineRpc();
+    engine->set_read_mode(ParseEngineRpc::kMergedReadMode);
+    parser.AddParseEngine(engine);
+  }
+
   TraceFileDumper dumper(out_file);
   if (!parser.Init(&dumper))
     return false;
@@ -535,7 +545,9 @@ int main(int argc, const char** argv) {
     LOG(ERROR) << "No trace file paths specified.";
 
     ::fprintf(stderr,
-              "Usage: %ls [--out=OUTPUT] TRACE_FILE(s)...\n\n",
+              "Usage: %ls [--out=OUTPUT] [--merge] TRACE_FILE(s)...\n\n"
+              "  --merge  Dump the events of all trace files in timestamp\n"
+              "           order rather than one trace file after the other.\n",
               cmd_line->GetProgram().value().c_str());
     return 1;
   }
@@ -551,7 +563,8 @@ int main(int argc, const char** argv) {
     }
   }
 
-  if (!DumpTraceFiles(out_file.get(), trace_file_paths)) {
+  bool merge = cmd_line->HasSwitch("merge");
+  if (!DumpTraceFiles(out_file.get(), trace_file_paths, merge)) {
     LOG(ERROR) << "Failed to dump trace files.";
     return 1;
   }
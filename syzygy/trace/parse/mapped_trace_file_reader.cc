@@ -0,0 +1,307 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/mapped_trace_file_reader.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/logging.h"
+#include "base/files/file.h"
+#include "base/files/file_util.h"
+#include "syzygy/common/align.h"
+#include "syzygy/trace/common/segment_compression.h"
+
+namespace trace {
+namespace parser {
+
+namespace {
+
+using ::common::AlignUp64;
+
+// The layout of WIN32_MEMORY_RANGE_ENTRY, which older SDKs do not declare.
+struct MemoryRangeEntry {
+  PVOID virtual_address;
+  SIZE_T number_of_bytes;
+};
+
+typedef BOOL (WINAPI *PrefetchVirtualMemoryPtr)(HANDLE process,
+                                                ULONG_PTR number_of_entries,
+                                                MemoryRangeEntry* entries,
+                                                ULONG flags);
+
+// @returns a pointer to PrefetchVirtualMemory, or NULL if it is not available.
+PrefetchVirtualMemoryPtr GetPrefetchVirtualMemory() {
+  // PrefetchVirtualMemory only exists as of Windows 8, so it is looked up
+  // dynamically. This is racy but safe, as every thread doing the lookup
+  // writes the same value.
+  const PrefetchVirtualMemoryPtr kUninitialized =
+      reinterpret_cast<PrefetchVirtualMemoryPtr>(1);
+  static PrefetchVirtualMemoryPtr prefetch_virtual_memory = kUninitialized;
+
+  if (prefetch_virtual_memory == kUninitialized) {
+    HMODULE kernel32 = ::GetModuleHandleA("kernel32.dll");
+    DCHECK(kernel32 != NULL);
+
+    prefetch_virtual_memory = reinterpret_cast<PrefetchVirtualMemoryPtr>(
+        ::GetProcAddress(kernel32, "PrefetchVirtualMemory"));
+  }
+  DCHECK(prefetch_virtual_memory != kUninitialized);
+
+  return prefetch_virtual_memory;
+}
+
+}  // namespace
+
+bool TraceFileWindow::Initialize(const base::FilePath& path,
+                                 uint64_t offset,
+                                 size_t length) {
+  DCHECK(!mapped_file_.IsValid());
+  DCHECK_LT(0u, length);
+
+  base::File file(path, base::File::FLAG_OPEN | base::File::FLAG_READ |
+                            base::File::FLAG_SEQUENTIAL_SCAN);
+  if (!file.IsValid()) {
+    LOG(ERROR) << "Unable to open '" << path.value() << "'.";
+    return false;
+  }
+
+  base::MemoryMappedFile::Region region = {
+      static_cast<int64_t>(offset), static_cast<int64_t>(length)};
+  if (!mapped_file_.Initialize(std::move(file), region)) {
+    LOG(ERROR) << "Unable to map " << length << " bytes at offset " << offset
+               << " of '" << path.value() << "'.";
+    return false;
+  }
+
+  offset_ = offset;
+  return true;
+}
+
+void TraceFileWindow::Prefetch() const {
+  PrefetchVirtualMemoryPtr prefetch_virtual_memory =
+      GetPrefetchVirtualMemory();
+  if (prefetch_virtual_memory == NULL || length() == 0)
+    return;
+
+  MemoryRangeEntry entry = {const_cast<uint8_t*>(data()), length()};
+  if (!(*prefetch_virtual_memory)(::GetCurrentProcess(), 1, &entry, 0)) {
+    // This is only a hint, so failure is not an error.
+    VLOG(1) << "PrefetchVirtualMemory failed.";
+  }
+}
+
+MappedTraceFileReader::MappedTraceFileReader()
+    : file_length_(0), next_segment_(0) {
+}
+
+MappedTraceFileReader::~MappedTraceFileReader() {
+}
+
+bool MappedTraceFileReader::Open(const base::FilePath& path) {
+  DCHECK(header_buffer_.empty());
+
+  int64_t file_length = 0;
+  if (!base::GetFileSize(path, &file_length)) {
+    LOG(ERROR) << "Unable to get the size of '" << path.value() << "'.";
+    return false;
+  }
+  if (file_length < static_cast<int64_t>(sizeof(TraceFileHeader))) {
+    LOG(ERROR) << "'" << path.value() << "' is too short to be a trace file.";
+    return false;
+  }
+
+  path_ = path;
+  file_length_ = static_cast<uint64_t>(file_length);
+
+  if (!EnsureMapped(0, sizeof(TraceFileHeader)))
+    return false;
+
+  const TraceFileHeader* file_header =
+      reinterpret_cast<const TraceFileHeader*>(window_->data());
+  if (::memcmp(&file_header->signature,
+               &TraceFileHeader::kSignatureValue,
+               sizeof(file_header->signature)) != 0) {
+    LOG(ERROR) << "Not a valid RPC call-trace file.";
+    return false;
+  }
+
+  if (file_header->header_size < sizeof(TraceFileHeader) ||
+      file_header->block_size == 0) {
+    LOG(ERROR) << "Invalid trace file header.";
+    return false;
+  }
+
+  // Copy out the entire header, including its variable length part.
+  size_t header_size = file_header->header_size;
+  if (header_size > file_length_ || !EnsureMapped(0, header_size)) {
+    LOG(ERROR) << "Failed to read trace file header.";
+    return false;
+  }
+  header_buffer_.assign(window_->data(), window_->data() + header_size);
+
+  next_segment_ = AlignUp64(header_size, header()->block_size);
+  return true;
+}
+
+bool MappedTraceFileReader::ReadNextSegment(Segment* segment,
+                                            bool* end_of_file) {
+  DCHECK(segment != NULL);
+  DCHECK(end_of_file != NULL);
+  DCHECK(!header_buffer_.empty());
+
+  *end_of_file = false;
+
+  // Like the buffered parser, we treat a partial segment header at the end of
+  // the file as the end of the file.
+  if (next_segment_ + sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) >
+          file_length_) {
+    *end_of_file = true;
+    return true;
+  }
+
+  if (!EnsureMapped(next_segment_, sizeof(RecordPrefix)))
+    return false;
+
+  const uint8_t* record =
+      window_->data() + static_cast<size_t>(next_segment_ - window_->offset());
+  const RecordPrefix* segment_prefix =
+      reinterpret_cast<const RecordPrefix*>(record);
+  bool compressed =
+      segment_prefix->type == TraceFileCompressedSegmentHeader::kTypeId &&
+      segment_prefix->size == sizeof(TraceFileCompressedSegmentHeader);
+  if ((!compressed &&
+       (segment_prefix->type != TraceFileSegmentHeader::kTypeId ||
+        segment_prefix->size != sizeof(TraceFileSegmentHeader))) ||
+      segment_prefix->version.hi != TRACE_VERSION_HI ||
+      segment_prefix->version.lo != TRACE_VERSION_LO) {
+    LOG(ERROR) << "Unrecognized record prefix for segment header.";
+    return false;
+  }
+
+  size_t header_size = sizeof(RecordPrefix) + segment_prefix->size;
+  if (next_segment_ + header_size > file_length_) {
+    LOG(ERROR) << "Failed to read segment header.";
+    return false;
+  }
+
+  // Mapping a new window invalidates |record| if this is the last reference
+  // to the old one, so the pointers are recomputed after each mapping.
+  if (!EnsureMapped(next_segment_, header_size))
+    return false;
+  record =
+      window_->data() + static_cast<size_t>(next_segment_ - window_->offset());
+
+  uint64_t segment_length = 0;
+  if (compressed) {
+    segment_length = reinterpret_cast<const TraceFileCompressedSegmentHeader*>(
+        record + sizeof(RecordPrefix))->segment_length;
+  } else {
+    segment_length = reinterpret_cast<const TraceFileSegmentHeader*>(
+        record + sizeof(RecordPrefix))->segment_length;
+  }
+  uint64_t segment_size = header_size + segment_length;
+  if (next_segment_ + segment_size > file_length_) {
+    LOG(ERROR) << "Failed to read segment.";
+    return false;
+  }
+
+  if (!EnsureMapped(next_segment_, segment_size))
+    return false;
+  record =
+      window_->data() + static_cast<size_t>(next_segment_ - window_->offset());
+
+  if (compressed) {
+    if (!DecompressSegment(
+            reinterpret_cast<const TraceFileCompressedSegmentHeader*>(
+                record + sizeof(RecordPrefix)),
+            record + header_size,
+            segment)) {
+      return false;
+    }
+  } else {
+    segment->window = window_;
+    segment->decompressed = static_cast<DecompressedTraceSegment*>(NULL);
+    segment->header = reinterpret_cast<const TraceFileSegmentHeader*>(
+        record + sizeof(RecordPrefix));
+    segment->data = record + header_size;
+  }
+
+  next_segment_ = AlignUp64(next_segment_ + segment_size,
+                            header()->block_size);
+  return true;
+}
+
+bool MappedTraceFileReader::DecompressSegment(
+    const TraceFileCompressedSegmentHeader* header,
+    const uint8_t* data,
+    Segment* segment) {
+  DCHECK(header != NULL);
+  DCHECK(data != NULL);
+  DCHECK(segment != NULL);
+
+  // The decompressed segment gets a header of its own, describing the
+  // decompressed data.
+  scoped_refptr<DecompressedTraceSegment> decompressed(
+      new DecompressedTraceSegment());
+  std::vector<uint8_t>* buffer = decompressed->buffer();
+  TraceFileSegmentHeader segment_header = {};
+  segment_header.thread_id = header->thread_id;
+  segment_header.segment_length = header->uncompressed_length;
+  buffer->resize(sizeof(segment_header));
+  ::memcpy(buffer->data(), &segment_header, sizeof(segment_header));
+
+  if (!trace::common::DecompressSegmentData(data,
+                                            header->segment_length,
+                                            header->uncompressed_length,
+                                            buffer)) {
+    LOG(ERROR) << "Failed to decompress segment at offset " << next_segment_
+               << " of '" << path_.value() << "'.";
+    return false;
+  }
+
+  segment->window = static_cast<TraceFileWindow*>(NULL);
+  segment->decompressed = decompressed;
+  segment->header =
+      reinterpret_cast<const TraceFileSegmentHeader*>(buffer->data());
+  segment->data = buffer->data() + sizeof(segment_header);
+  return true;
+}
+
+bool MappedTraceFileReader::EnsureMapped(uint64_t offset, uint64_t length) {
+  DCHECK_LE(offset + length, file_length_);
+
+  if (window_.get() != NULL && window_->Contains(offset, length))
+    return true;
+
+  uint64_t window_length = std::max<uint64_t>(length, kWindowSize);
+  window_length = std::min(window_length, file_length_ - offset);
+  if (window_length > static_cast<size_t>(-1)) {
+    LOG(ERROR) << "Segment at offset " << offset << " is too large to map.";
+    return false;
+  }
+
+  scoped_refptr<TraceFileWindow> window(new TraceFileWindow());
+  if (!window->Initialize(path_, offset, static_cast<size_t>(window_length)))
+    return false;
+  window->Prefetch();
+
+  window_ = window;
+  return true;
+}
+
+}  // namespace parser
+}  // namespace trace
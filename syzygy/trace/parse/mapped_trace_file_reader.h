@@ -0,0 +1,214 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Declares MappedTraceFileReader, which walks the segments of an RPC trace
+// file in place through a read-only memory mapping. Segments are returned as
+// pointers into the mapping, so no segment is copied and no per-segment
+// buffer is allocated.
+//
+// Trace files can be many gigabytes in size, which would not fit in the
+// address space of a 32-bit process, so the file is mapped through a sliding
+// window. A window is reference counted and each returned segment holds a
+// reference to the window containing it, so segments remain valid after the
+// reader has moved on. As windows are mapped the OS is asked to read them
+// ahead, and the file is opened for sequential access.
+//
+// Segments compressed by the call trace service are decompressed into a
+// buffer of their own, so callers need not tell them apart.
+//
+// Intended use:
+//
+//   MappedTraceFileReader reader;
+//   if (!reader.Open(path))
+//     ...
+//   const TraceFileHeader* header = reader.header();
+//   MappedTraceFileReader::Segment segment;
+//   bool end_of_file = false;
+//   while (reader.ReadNextSegment(&segment, &end_of_file) && !end_of_file) {
+//     ... segment.data[0 .. segment.header->segment_length) ...
+//   }
+
+#ifndef SYZYGY_TRACE_PARSE_MAPPED_TRACE_FILE_READER_H_
+#define SYZYGY_TRACE_PARSE_MAPPED_TRACE_FILE_READER_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/memory/ref_counted.h"
+#include "syzygy/trace/protocol/call_trace_defs.h"
+
+namespace trace {
+namespace parser {
+
+// A reference counted read-only mapping of a region of a trace file.
+class TraceFileWindow : public base::RefCountedThreadSafe<TraceFileWindow> {
+ public:
+  TraceFileWindow() : offset_(0) {}
+
+  // Maps a region of a file.
+  // @param path the path of the file.
+  // @param offset the offset of the region in the file. This need not be
+  //     aligned to the allocation granularity.
+  // @param length the length of the region.
+  // @returns true on success, false otherwise.
+  bool Initialize(const base::FilePath& path, uint64_t offset, size_t length);
+
+  // Asks the OS to read the mapped region ahead of its use. This is only a
+  // hint, and is a no-op on versions of Windows that do not support it.
+  void Prefetch() const;
+
+  // @returns the offset in the file of the start of the mapping.
+  uint64_t offset() const { return offset_; }
+
+  // @returns a pointer to the start of the mapping.
+  const uint8_t* data() const { return mapped_file_.data(); }
+
+  // @returns the length of the mapping, in bytes.
+  size_t length() const { return mapped_file_.length(); }
+
+  // @returns true if the range [@p offset, @p offset + @p length) of the file
+  //     is entirely contained in this window.
+  bool Contains(uint64_t offset, uint64_t length) const {
+    return offset >= offset_ && offset + length <= offset_ + this->length();
+  }
+
+ private:
+  friend base::RefCountedThreadSafe<TraceFileWindow>;
+
+  // We disallow access to the destructor to enforce the use of reference
+  // counting pointers.
+  ~TraceFileWindow() {}
+
+  uint64_t offset_;
+  base::MemoryMappedFile mapped_file_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileWindow);
+};
+
+// A reference counted buffer holding a decompressed segment.
+class DecompressedTraceSegment
+    : public base::RefCountedThreadSafe<DecompressedTraceSegment> {
+ public:
+  DecompressedTraceSegment() {}
+
+  // @returns the buffer holding the segment.
+  std::vector<uint8_t>* buffer() { return &buffer_; }
+
+ private:
+  friend base::RefCountedThreadSafe<DecompressedTraceSegment>;
+
+  // We disallow access to the destructor to enforce the use of reference
+  // counting pointers.
+  ~DecompressedTraceSegment() {
+#ifndef NDEBUG
+    // Scribble over the segment so that records used after their segment has
+    // been released are caught, rather than read from stale memory.
+    std::fill(buffer_.begin(), buffer_.end(), 0xCD);
+#endif
+  }
+
+  std::vector<uint8_t> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(DecompressedTraceSegment);
+};
+
+// Reads the header and segments of a trace file through a sliding memory
+// mapped window. This is not thread-safe, but the segments it returns may be
+// handed to and consumed on other threads.
+class MappedTraceFileReader {
+ public:
+  // The size of the mapped windows. Segments larger than this get a window of
+  // their own.
+  static const size_t kWindowSize = 32 * 1024 * 1024;
+
+  // A segment of the trace file. Compressed segments are decompressed, and
+  // are described exactly like segments stored as is.
+  struct Segment {
+    // The window housing the segment. This keeps the pointers below valid.
+    // This is NULL for compressed segments.
+    scoped_refptr<TraceFileWindow> window;
+    // The decompressed segment, starting with its TraceFileSegmentHeader.
+    // This keeps the pointers below valid. This is NULL for segments stored
+    // as is.
+    scoped_refptr<DecompressedTraceSegment> decompressed;
+    // The header of the segment.
+    const TraceFileSegmentHeader* header;
+    // The data of the segment. This is header->segment_length bytes long.
+    const uint8_t* data;
+  };
+
+  MappedTraceFileReader();
+  ~MappedTraceFileReader();
+
+  // Opens a trace file and validates its header.
+  // @param path the path of the trace file.
+  // @returns true on success, false otherwise.
+  bool Open(const base::FilePath& path);
+
+  // @returns the header of the trace file. This is a copy, and remains valid
+  //     for the lifetime of the reader.
+  const TraceFileHeader* header() const {
+    return reinterpret_cast<const TraceFileHeader*>(header_buffer_.data());
+  }
+
+  // @returns the path of the trace file.
+  const base::FilePath& path() const { return path_; }
+
+  // Reads the next segment of the trace file.
+  // @param segment will receive the segment.
+  // @param end_of_file will be set to true if there are no more segments, in
+  //     which case @p segment is left untouched.
+  // @returns true on success, false if the file is malformed or can not be
+  //     mapped.
+  bool ReadNextSegment(Segment* segment, bool* end_of_file);
+
+ private:
+  // Ensures that the current window contains the range [@p offset,
+  // @p offset + @p length) of the file, mapping a new window if required.
+  // @returns true on success, false otherwise.
+  bool EnsureMapped(uint64_t offset, uint64_t length);
+
+  // Decompresses a compressed segment.
+  // @param header the header of the compressed segment.
+  // @param data the compressed data of the segment.
+  // @param segment will receive the decompressed segment.
+  // @returns true on success, false otherwise.
+  bool DecompressSegment(const TraceFileCompressedSegmentHeader* header,
+                         const uint8_t* data,
+                         Segment* segment);
+
+  // The path of the trace file.
+  base::FilePath path_;
+
+  // The length of the trace file.
+  uint64_t file_length_;
+
+  // A copy of the trace file header, including its variable length part.
+  std::vector<uint8_t> header_buffer_;
+
+  // The window most recently mapped.
+  scoped_refptr<TraceFileWindow> window_;
+
+  // The offset in the file of the next segment.
+  uint64_t next_segment_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedTraceFileReader);
+};
+
+}  // namespace parser
+}  // namespace trace
+
+#endif  // SYZYGY_TRACE_PARSE_MAPPED_TRACE_FILE_READER_H_
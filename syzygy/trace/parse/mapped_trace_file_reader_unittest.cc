@@ -0,0 +1,256 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "syzygy/trace/parse/mapped_trace_file_reader.h"
+
+#include <vector>
+
+#include "base/files/file.h"
+#include "base/files/file_util.h"
+#include "base/time/time.h"
+#include "gtest/gtest.h"
+#include "syzygy/core/zstream.h"
+#include "syzygy/pe/unittest_util.h"
+#include "syzygy/trace/common/segment_compression.h"
+#include "syzygy/trace/parse/unittest_util.h"
+
+namespace trace {
+namespace parser {
+
+namespace {
+
+class MappedTraceFileReaderTest : public testing::PELibUnitTest {
+ public:
+  void SetUp() override {
+    testing::PELibUnitTest::SetUp();
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_));
+    trace_path_ = temp_dir_.AppendASCII("trace.bin");
+  }
+
+ protected:
+  base::FilePath temp_dir_;
+  base::FilePath trace_path_;
+};
+
+testing::TestTraceSegment MakeSegment(uint32_t thread_id, size_t count) {
+  testing::TestTraceSegment segment;
+  segment.thread_id = thread_id;
+  for (size_t i = 0; i < count; ++i)
+    segment.timestamps.push_back(1000 * (i + 1));
+  return segment;
+}
+
+// Reads the data of all the segments of a trace file.
+// @param path the path of the trace file.
+// @param segments will receive the data of each segment.
+// @returns true on success, false otherwise.
+bool ReadSegmentData(const base::FilePath& path,
+                     std::vector<std::vector<uint8_t>>* segments) {
+  MappedTraceFileReader reader;
+  if (!reader.Open(path))
+    return false;
+  while (true) {
+    MappedTraceFileReader::Segment segment;
+    bool end_of_file = true;
+    if (!reader.ReadNextSegment(&segment, &end_of_file))
+      return false;
+    if (end_of_file)
+      return true;
+    segments->push_back(std::vector<uint8_t>(
+        segment.data, segment.data + segment.header->segment_length));
+  }
+}
+
+}  // namespace
+
+TEST_F(MappedTraceFileReaderTest, OpenFailsForMissingFile) {
+  MappedTraceFileReader reader;
+  EXPECT_FALSE(reader.Open(trace_path_));
+}
+
+TEST_F(MappedTraceFileReaderTest, OpenFailsForInvalidFile) {
+  std::vector<uint8_t> garbage(4096, 0xCC);
+  ASSERT_EQ(static_cast<int>(garbage.size()),
+            base::WriteFile(trace_path_,
+                            reinterpret_cast<const char*>(garbage.data()),
+                            garbage.size()));
+
+  MappedTraceFileReader reader;
+  EXPECT_FALSE(reader.Open(trace_path_));
+}
+
+TEST_F(MappedTraceFileReaderTest, ReadsSegmentsInPlace) {
+  std::vector<testing::TestTraceSegment> segments;
+  segments.push_back(MakeSegment(1, 3));
+  segments.push_back(MakeSegment(2, 1000));
+  segments.push_back(MakeSegment(3, 1));
+  ASSERT_TRUE(testing::WriteTestTraceFile(trace_path_, segments));
+
+  MappedTraceFileReader reader;
+  ASSERT_TRUE(reader.Open(trace_path_));
+  EXPECT_EQ(::GetCurrentProcessId(), reader.header()->process_id);
+
+  std::vector<MappedTraceFileReader::Segment> read_segments;
+  while (true) {
+    MappedTraceFileReader::Segment segment;
+    bool end_of_file = true;
+    ASSERT_TRUE(reader.ReadNextSegment(&segment, &end_of_file));
+    if (end_of_file)
+      break;
+    read_segments.push_back(segment);
+  }
+  ASSERT_EQ(segments.size(), read_segments.size());
+
+  // The segments remain valid after the reader has moved past them.
+  const size_t kRecordSize = sizeof(RecordPrefix) + sizeof(TraceEnterEventData);
+  for (size_t i = 0; i < segments.size(); ++i) {
+    const MappedTraceFileReader::Segment& segment = read_segments[i];
+    EXPECT_TRUE(segment.window.get() != NULL);
+    EXPECT_EQ(segments[i].thread_id, segment.header->thread_id);
+    ASSERT_EQ(segments[i].timestamps.size() * kRecordSize,
+              segment.header->segment_length);
+
+    for (size_t j = 0; j < segments[i].timestamps.size(); ++j) {
+      const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(
+          segment.data + j * kRecordSize);
+      EXPECT_EQ(TRACE_ENTER_EVENT, prefix->type);
+      EXPECT_EQ(segments[i].timestamps[j], prefix->timestamp);
+    }
+  }
+
+  // Reading past the end of the file keeps reporting the end of the file.
+  MappedTraceFileReader::Segment segment;
+  bool end_of_file = false;
+  EXPECT_TRUE(reader.ReadNextSegment(&segment, &end_of_file));
+  EXPECT_TRUE(end_of_file);
+}
+
+TEST_F(MappedTraceFileReaderTest, DecompressesCompressedSegments) {
+  std::vector<testing::TestTraceSegment> segments;
+  segments.push_back(MakeSegment(1, 1000));
+  segments.push_back(MakeSegment(2, 10));
+  segments.push_back(MakeSegment(3, 5000));
+  segments[0].compressed = true;
+  segments[2].compressed = true;
+  ASSERT_TRUE(testing::WriteTestTraceFile(trace_path_, segments));
+
+  MappedTraceFileReader reader;
+  ASSERT_TRUE(reader.Open(trace_path_));
+
+  const size_t kRecordSize = sizeof(RecordPrefix) + sizeof(TraceEnterEventData);
+  for (size_t i = 0; i < segments.size(); ++i) {
+    MappedTraceFileReader::Segment segment;
+    bool end_of_file = true;
+    ASSERT_TRUE(reader.ReadNextSegment(&segment, &end_of_file));
+    ASSERT_FALSE(end_of_file);
+
+    EXPECT_EQ(segments[i].compressed, segment.decompressed.get() != NULL);
+    EXPECT_EQ(segments[i].compressed, segment.window.get() == NULL);
+    EXPECT_EQ(segments[i].thread_id, segment.header->thread_id);
+    ASSERT_EQ(segments[i].timestamps.size() * kRecordSize,
+              segment.header->segment_length);
+
+    for (size_t j = 0; j < segments[i].timestamps.size(); ++j) {
+      const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(
+          segment.data + j * kRecordSize);
+      EXPECT_EQ(TRACE_ENTER_EVENT, prefix->type);
+      EXPECT_EQ(segments[i].timestamps[j], prefix->timestamp);
+    }
+  }
+
+  MappedTraceFileReader::Segment segment;
+  bool end_of_file = false;
+  EXPECT_TRUE(reader.ReadNextSegment(&segment, &end_of_file));
+  EXPECT_TRUE(end_of_file);
+}
+
+TEST_F(MappedTraceFileReaderTest, ReadNextSegmentFailsForTruncatedFile) {
+  std::vector<testing::TestTraceSegment> segments;
+  segments.push_back(MakeSegment(1, 10000));
+  ASSERT_TRUE(testing::WriteTestTraceFile(trace_path_, segments));
+
+  // Chop off the end of the segment.
+  int64_t file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path_, &file_size));
+  base::File file(trace_path_, base::File::FLAG_OPEN | base::File::FLAG_WRITE);
+  ASSERT_TRUE(file.IsValid());
+  ASSERT_TRUE(file.SetLength(file_size - 4096));
+  file.Close();
+
+  MappedTraceFileReader reader;
+  ASSERT_TRUE(reader.Open(trace_path_));
+  MappedTraceFileReader::Segment segment;
+  bool end_of_file = false;
+  EXPECT_FALSE(reader.ReadNextSegment(&segment, &end_of_file));
+}
+
+// Measures the compression ratio and throughput of segment compression on
+// the recorded traces, at several compression levels. This is disabled by
+// default; run with --gtest_also_run_disabled_tests.
+TEST_F(MappedTraceFileReaderTest, DISABLED_BenchmarkSegmentCompression) {
+  std::vector<const wchar_t*> trace_files;
+  for (size_t i = 0; i < arraysize(testing::kCallTraceTraceFiles); ++i)
+    trace_files.push_back(testing::kCallTraceTraceFiles[i]);
+  for (size_t i = 0; i < arraysize(testing::kProfileTraceFiles); ++i)
+    trace_files.push_back(testing::kProfileTraceFiles[i]);
+  trace_files.push_back(testing::kMemProfTraceFile);
+
+  std::vector<std::vector<uint8_t>> segments;
+  size_t uncompressed_bytes = 0;
+  for (size_t i = 0; i < trace_files.size(); ++i) {
+    ASSERT_TRUE(ReadSegmentData(
+        testing::GetExeTestDataRelativePath(trace_files[i]), &segments));
+  }
+  for (size_t i = 0; i < segments.size(); ++i)
+    uncompressed_bytes += segments[i].size();
+  ASSERT_LT(0u, uncompressed_bytes);
+
+  const int kLevels[] = {core::ZOutStream::kZBestSpeed,
+                         core::ZOutStream::kZDefaultCompression,
+                         core::ZOutStream::kZBestCompression};
+  for (size_t i = 0; i < arraysize(kLevels); ++i) {
+    std::vector<std::vector<uint8_t>> compressed(segments.size());
+    base::TimeTicks start = base::TimeTicks::Now();
+    for (size_t j = 0; j < segments.size(); ++j) {
+      ASSERT_TRUE(trace::common::CompressSegmentData(
+          segments[j].data(), segments[j].size(), kLevels[i],
+          &compressed[j]));
+    }
+    base::TimeDelta compression_time = base::TimeTicks::Now() - start;
+
+    size_t compressed_bytes = 0;
+    start = base::TimeTicks::Now();
+    for (size_t j = 0; j < segments.size(); ++j) {
+      std::vector<uint8_t> uncompressed;
+      ASSERT_TRUE(trace::common::DecompressSegmentData(
+          compressed[j].data(), compressed[j].size(), segments[j].size(),
+          &uncompressed));
+      compressed_bytes += compressed[j].size();
+    }
+    base::TimeDelta decompression_time = base::TimeTicks::Now() - start;
+
+    double megabytes = uncompressed_bytes / (1024.0 * 1024.0);
+    LOG(INFO) << "Level " << kLevels[i] << ": " << segments.size()
+              << " segments, " << uncompressed_bytes << " -> "
+              << compressed_bytes << " bytes (ratio "
+              << static_cast<double>(uncompressed_bytes) / compressed_bytes
+              << "), compression "
+              << megabytes / compression_time.InSecondsF()
+              << " MB/s, decompression "
+              << megabytes / decompression_time.InSecondsF() << " MB/s.";
+  }
+}
+
+}  // namespace parser
+}  // namespace trace
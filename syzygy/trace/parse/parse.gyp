@@ -21,6 +21,8 @@
       'target_name': 'parse_lib',
       'type': 'static_library',
       'sources': [
+        'mapped_trace_file_reader.cc',
+        'mapped_trace_file_reader.h',
         'parse_engine.cc',
         'parse_engine.h',
         'parse_engine_rpc.cc',
@@ -33,6 +35,7 @@
       'dependencies': [
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
+        '<(src)/syzygy/trace/common/common.gyp:trace_compression_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
       ],
     },
@@ -59,6 +62,9 @@
         'unittest_util.h',
       ],
       'dependencies': [
+        '<(src)/base/base.gyp:base',
+        '<(src)/syzygy/trace/common/common.gyp:trace_compression_lib',
+        '<(src)/syzygy/trace/service/service.gyp:rpc_service_lib',
         '<(src)/testing/gtest.gyp:gtest',
         '<(src)/testing/gmock.gyp:gmock',
       ],
@@ -67,6 +73,7 @@
       'target_name': 'parse_unittests',
       'type': 'executable',
       'sources': [
+        'mapped_trace_file_reader_unittest.cc',
         'parse_engine_rpc_unittest.cc',
         'parse_engine_unittest.cc',
         'parse_utils_unittest.cc',
@@ -84,6 +91,7 @@
         '<(src)/syzygy/core/core.gyp:core_unittest_utils',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
+        '<(src)/syzygy/trace/common/common.gyp:trace_compression_lib',
         '<(src)/syzygy/trace/common/common.gyp:trace_unittest_utils',
         '<(src)/syzygy/trace/service/service.gyp:rpc_service_lib',
         '<(src)/testing/gtest.gyp:gtest',
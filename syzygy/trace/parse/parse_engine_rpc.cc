@@ -16,10 +16,22 @@
 
 #include "syzygy/trace/parse/parse_engine_rpc.h"
 
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
 #include "base/logging.h"
 #include "base/files/file_util.h"
+#include "base/synchronization/condition_variable.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/simple_thread.h"
 #include "syzygy/common/align.h"
 #include "syzygy/common/com_utils.h"
+#include "syzygy/trace/common/segment_compression.h"
+#include "syzygy/trace/parse/mapped_trace_file_reader.h"
 #include "syzygy/trace/parse/parse_utils.h"
 
 using common::AlignUp;
@@ -28,7 +40,250 @@ using common::AlignUp64;
 namespace trace {
 namespace parser {
 
-ParseEngineRpc::ParseEngineRpc() : ParseEngine("RPC", true) {
+namespace {
+
+// The maximum number of segments a producer thread reads ahead of the
+// dispatching thread in kMergedReadMode.
+const size_t kMaxQueuedBatches = 16;
+
+// Steps over the next record of a segment.
+// @param cursor the position of the next record. This is advanced past it.
+// @param end the end of the segment.
+// @returns the record, or NULL if there are no more complete records.
+const RecordPrefix* NextRecord(const uint8_t** cursor, const uint8_t* end) {
+  DCHECK(cursor != NULL);
+
+  if (*cursor + sizeof(RecordPrefix) > end)
+    return NULL;
+
+  const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(*cursor);
+  *cursor += sizeof(RecordPrefix) + prefix->size;
+  if (*cursor > end) {
+    // For batch-oriented records (where the record size is updated after
+    // the record is initially written) there's a race condition between
+    // updating the size of the segment and updating the number of items
+    // in the batch record wherein the client process could be terminated
+    // leaving a truncated batch record.
+    LOG(WARNING) << "Encountered truncated record at end of segment.";
+    return NULL;
+  }
+
+  return prefix;
+}
+
+// Converts the timestamp of a record to a FILETIME.
+// @param clock_info the clock information of the trace file.
+// @param prefix the record.
+// @returns the timestamp, or zero if it can not be converted.
+uint64_t GetRecordFileTime(const trace::common::ClockInfo& clock_info,
+                           const RecordPrefix* prefix) {
+  FILETIME file_time = {};
+  trace::common::TscToFileTime(clock_info, prefix->timestamp, &file_time);
+  return (static_cast<uint64_t>(file_time.dwHighDateTime) << 32) |
+         file_time.dwLowDateTime;
+}
+
+// A record, along with its timestamp as a FILETIME.
+struct TimedRecord {
+  uint64_t file_time;
+  const RecordPrefix* prefix;
+};
+
+// The records of a segment. The window, or the decompressed segment for
+// compressed segments, keeps the records valid.
+struct RecordBatch {
+  scoped_refptr<TraceFileWindow> window;
+  scoped_refptr<DecompressedTraceSegment> decompressed;
+  DWORD thread_id;
+  std::vector<TimedRecord> records;
+};
+
+// Reads the segments of a trace file on a thread of its own, and hands them
+// to the dispatching thread as batches of timestamped records through a
+// bounded queue.
+class TraceFileProducer : public base::DelegateSimpleThread::Delegate {
+ public:
+  TraceFileProducer()
+      : queue_changed_(&lock_), done_(false), cancelled_(false),
+        succeeded_(true) {
+  }
+
+  ~TraceFileProducer() override {
+    Stop();
+  }
+
+  // @returns the reader of the trace file.
+  MappedTraceFileReader* reader() { return &reader_; }
+
+  // Starts the producer thread. The reader must have been opened.
+  void Start() {
+    DCHECK(thread_.get() == NULL);
+    thread_.reset(new base::DelegateSimpleThread(this, "TraceFileProducer"));
+    thread_->Start();
+  }
+
+  // Cancels the producer thread and waits for it to finish. This is a no-op
+  // if the thread is not running.
+  void Stop() {
+    if (thread_.get() == NULL)
+      return;
+
+    {
+      base::AutoLock auto_lock(lock_);
+      cancelled_ = true;
+      queue_changed_.Broadcast();
+    }
+    thread_->Join();
+    thread_.reset();
+  }
+
+  // Retrieves the next batch of records, waiting for it if necessary.
+  // @param batch will receive the batch.
+  // @returns false if there are no more batches. Check succeeded() to
+  //     distinguish the end of the trace file from an error.
+  bool PopBatch(std::unique_ptr<RecordBatch>* batch) {
+    DCHECK(batch != NULL);
+
+    base::AutoLock auto_lock(lock_);
+    while (queue_.empty() && !done_)
+      queue_changed_.Wait();
+    if (queue_.empty())
+      return false;
+
+    *batch = std::move(queue_.front());
+    queue_.pop_front();
+    queue_changed_.Broadcast();
+    return true;
+  }
+
+  // @returns true unless reading the trace file failed.
+  bool succeeded() {
+    base::AutoLock auto_lock(lock_);
+    return succeeded_;
+  }
+
+  // @name base::DelegateSimpleThread::Delegate implementation.
+  // @{
+  void Run() override {
+    const TraceFileHeader* file_header = reader_.header();
+    bool succeeded = true;
+
+    while (true) {
+      MappedTraceFileReader::Segment segment;
+      bool end_of_file = false;
+      if (!reader_.ReadNextSegment(&segment, &end_of_file)) {
+        LOG(ERROR) << "Failed to read '" << reader_.path().value() << "'.";
+        succeeded = false;
+        break;
+      }
+      if (end_of_file)
+        break;
+
+      std::unique_ptr<RecordBatch> batch(new RecordBatch());
+      batch->window = segment.window;
+      batch->decompressed = segment.decompressed;
+      batch->thread_id = segment.header->thread_id;
+
+      const uint8_t* cursor = segment.data;
+      const uint8_t* end = cursor + segment.header->segment_length;
+      while (const RecordPrefix* prefix = NextRecord(&cursor, end)) {
+        TimedRecord record = {
+            GetRecordFileTime(file_header->clock_info, prefix), prefix};
+        batch->records.push_back(record);
+      }
+      if (batch->records.empty())
+        continue;
+
+      if (!PushBatch(std::move(batch)))
+        break;
+    }
+
+    base::AutoLock auto_lock(lock_);
+    done_ = true;
+    succeeded_ = succeeded;
+    queue_changed_.Broadcast();
+  }
+  // @}
+
+ private:
+  // Queues a batch of records, waiting for room in the queue if necessary.
+  // @param batch the batch to queue.
+  // @returns false if the producer was cancelled.
+  bool PushBatch(std::unique_ptr<RecordBatch> batch) {
+    base::AutoLock auto_lock(lock_);
+    while (queue_.size() >= kMaxQueuedBatches && !cancelled_)
+      queue_changed_.Wait();
+    if (cancelled_)
+      return false;
+
+    queue_.push_back(std::move(batch));
+    queue_changed_.Broadcast();
+    return true;
+  }
+
+  MappedTraceFileReader reader_;
+  std::unique_ptr<base::DelegateSimpleThread> thread_;
+
+  // @name State shared with the producer thread. Protected by lock_.
+  // @{
+  base::Lock lock_;
+  base::ConditionVariable queue_changed_;
+  // The queued batches.
+  std::deque<std::unique_ptr<RecordBatch>> queue_;
+  // Set when the producer thread has queued its last batch.
+  bool done_;
+  // Set to ask the producer thread to stop.
+  bool cancelled_;
+  // Cleared if the trace file is malformed.
+  bool succeeded_;
+  // @}
+
+  DISALLOW_COPY_AND_ASSIGN(TraceFileProducer);
+};
+
+// The position of the dispatching thread in a trace file, in
+// kMergedReadMode.
+struct MergeCursor {
+  MergeCursor() : next_record(0) {}
+
+  // The batch being dispatched, and the index of its next record.
+  std::unique_ptr<RecordBatch> batch;
+  size_t next_record;
+};
+
+// The next record to dispatch from a trace file, ordered by timestamp and then
+// by trace file so that the merge is deterministic.
+struct MergeHead {
+  uint64_t file_time;
+  size_t file_index;
+
+  bool operator>(const MergeHead& other) const {
+    if (file_time != other.file_time)
+      return file_time > other.file_time;
+    return file_index > other.file_index;
+  }
+};
+
+// Moves @p cursor to the next record of @p producer, fetching the next batch
+// if the current one is exhausted.
+// @returns false if there are no more records.
+bool AdvanceMergeCursor(TraceFileProducer* producer, MergeCursor* cursor) {
+  DCHECK(producer != NULL);
+  DCHECK(cursor != NULL);
+
+  if (cursor->batch.get() != NULL &&
+      cursor->next_record < cursor->batch->records.size()) {
+    return true;
+  }
+
+  cursor->next_record = 0;
+  return producer->PopBatch(&cursor->batch);
+}
+
+}  // namespace
+
+ParseEngineRpc::ParseEngineRpc()
+    : ParseEngine("RPC", true), read_mode_(kMappedReadMode) {
 }
 
 ParseEngineRpc::~ParseEngineRpc() {
@@ -70,9 +325,14 @@ bool ParseEngineRpc::CloseAllTraceFiles() {
 }
 
 bool ParseEngineRpc::ConsumeAllEvents() {
+  if (read_mode_ == kMergedReadMode)
+    return ConsumeMergedTraceFiles();
+
   TraceFileIter it = trace_file_set_.begin();
   for (; it != trace_file_set_.end(); ++it) {
-    if (!ConsumeTraceFile(*it)) {
+    bool consumed = read_mode_ == kBufferedReadMode ?
+        ConsumeBufferedTraceFile(*it) : ConsumeMappedTraceFile(*it);
+    if (!consumed) {
       LOG(ERROR) << "Failed to consume '" << it->value() << "'.";
       return false;
     }
@@ -81,7 +341,8 @@ bool ParseEngineRpc::ConsumeAllEvents() {
   return true;
 }
 
-bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
+bool ParseEngineRpc::ConsumeBufferedTraceFile(
+    const base::FilePath& trace_file_path) {
   DCHECK(!trace_file_path.empty());
 
   LOG(INFO) << "Processing '" << trace_file_path.BaseName().value() << "'.";
@@ -138,46 +399,15 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
     return false;
   }
 
-  // Populate the system information which will be fed to the OnProcessStarted
-  // event.
-  TraceSystemInfo system_info = {};
-  system_info.os_version_info = file_header->os_version_info;
-  system_info.system_info = file_header->system_info;
-  system_info.memory_status = file_header->memory_status;
-  system_info.clock_info = file_header->clock_info;
-
-  // Parse the header blob. This fails if there is any extra data, enforcing
-  // a valid header size as a side effect.
-  std::wstring module_path;
-  std::wstring command_line;
-  if (!ParseTraceFileHeaderBlob(*file_header, &module_path, &command_line,
-                                &system_info.environment_strings)) {
-    LOG(ERROR) << "Unable to parse trace file header blob.";
+  if (!ConsumeTraceFileHeader(*file_header))
     return false;
-  }
-
-  // Add the executable's module information to the process map. This is in
-  // case the executable itself is instrumented, so that trace events will map
-  // to a module in the process map.
-  ModuleInformation module_info;
-  module_info.base_address.set_value(file_header->module_base_address);
-  module_info.path = module_path;
-  module_info.module_size = file_header->module_size;
-  module_info.module_checksum = file_header->module_checksum;
-  module_info.module_time_date_stamp = file_header->module_time_date_stamp;
-  AddModuleInformation(file_header->process_id, module_info);
-
-  // Notify the event handler that a process has started.
-  base::Time start_time(base::Time::FromFileTime(
-      file_header->clock_info.file_time));
-  event_handler_->OnProcessStarted(start_time, file_header->process_id,
-                                   &system_info);
 
   // Consume the body of the trace file.
   uint64_t next_segment =
       AlignUp64(file_header->header_size, file_header->block_size);
   std::unique_ptr<uint8_t[]> buffer;
   size_t buffer_size = 0;
+  std::vector<uint8_t> uncompressed_buffer;
   while (true) {
     if (::_fseeki64(trace_file.get(), next_segment, SEEK_SET) != 0) {
       LOG(ERROR) << "Failed to seek segment boundary " << next_segment << ".";
@@ -196,102 +426,274 @@ bool ParseEngineRpc::ConsumeTraceFile(const base::FilePath& trace_file_path) {
       return false;
     }
 
-    if (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
-        segment_prefix.size != sizeof(TraceFileSegmentHeader) ||
+    bool compressed =
+        segment_prefix.type == TraceFileCompressedSegmentHeader::kTypeId &&
+        segment_prefix.size == sizeof(TraceFileCompressedSegmentHeader);
+    if ((!compressed &&
+         (segment_prefix.type != TraceFileSegmentHeader::kTypeId ||
+          segment_prefix.size != sizeof(TraceFileSegmentHeader))) ||
         segment_prefix.version.hi != TRACE_VERSION_HI ||
         segment_prefix.version.lo != TRACE_VERSION_LO) {
       LOG(ERROR) << "Unrecognized record prefix for segment header.";
       return false;
     }
 
-    TraceFileSegmentHeader segment_header;
-    if (::fread(&segment_header,
-                sizeof(segment_header),
-                1,
-                trace_file.get()) != 1) {
-      LOG(ERROR) << "Failed to read segment header.";
-      return false;
+    // Compressed segments are decompressed, and then handled exactly like
+    // segments stored as is.
+    TraceFileSegmentHeader segment_header = {};
+    TraceFileCompressedSegmentHeader compressed_header = {};
+    size_t stored_length = 0;
+    if (compressed) {
+      if (::fread(&compressed_header,
+                  sizeof(compressed_header),
+                  1,
+                  trace_file.get()) != 1) {
+        LOG(ERROR) << "Failed to read segment header.";
+        return false;
+      }
+      stored_length = compressed_header.segment_length;
+    } else {
+      if (::fread(&segment_header,
+                  sizeof(segment_header),
+                  1,
+                  trace_file.get()) != 1) {
+        LOG(ERROR) << "Failed to read segment header.";
+        return false;
+      }
+      stored_length = segment_header.segment_length;
     }
 
-    size_t aligned_size = AlignUp(segment_header.segment_length,
-                                  file_header->block_size);
+    size_t aligned_size = AlignUp(stored_length, file_header->block_size);
 
     if (aligned_size > buffer_size) {
       buffer.reset(new uint8_t[aligned_size]);
       buffer_size = aligned_size;
     }
 
-    if (::fread(buffer.get(), segment_header.segment_length, 1,
-                trace_file.get()) != 1) {
+    if (::fread(buffer.get(), stored_length, 1, trace_file.get()) != 1) {
       LOG(ERROR) << "Failed to read segment.";
       return false;
     }
 
+    const uint8_t* segment_data = buffer.get();
+    if (compressed) {
+      uncompressed_buffer.clear();
+      if (!trace::common::DecompressSegmentData(
+              buffer.get(), stored_length,
+              compressed_header.uncompressed_length, &uncompressed_buffer)) {
+        LOG(ERROR) << "Failed to decompress segment.";
+        return false;
+      }
+      segment_header.thread_id = compressed_header.thread_id;
+      segment_header.segment_length = compressed_header.uncompressed_length;
+      segment_data = uncompressed_buffer.data();
+    }
+
     if (!ConsumeSegmentEvents(*file_header,
                               segment_header,
-                              buffer.get(),
+                              segment_data,
                               segment_header.segment_length)) {
       return false;
     }
 
     next_segment = AlignUp64(
-        next_segment + sizeof(segment_prefix) + sizeof(segment_header) +
-            segment_header.segment_length,
+        next_segment + sizeof(segment_prefix) + segment_prefix.size +
+            stored_length,
         file_header->block_size);
   }
 
   return true;
 }
 
+bool ParseEngineRpc::ConsumeMappedTraceFile(
+    const base::FilePath& trace_file_path) {
+  DCHECK(!trace_file_path.empty());
+
+  LOG(INFO) << "Processing '" << trace_file_path.BaseName().value() << "'.";
+
+  MappedTraceFileReader reader;
+  if (!reader.Open(trace_file_path))
+    return false;
+
+  const TraceFileHeader* file_header = reader.header();
+  if (!ConsumeTraceFileHeader(*file_header))
+    return false;
+
+  // Consume the body of the trace file.
+  while (true) {
+    MappedTraceFileReader::Segment segment;
+    bool end_of_file = false;
+    if (!reader.ReadNextSegment(&segment, &end_of_file))
+      return false;
+    if (end_of_file)
+      break;
+
+    if (!ConsumeSegmentEvents(*file_header,
+                              *segment.header,
+                              segment.data,
+                              segment.header->segment_length)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ParseEngineRpc::ConsumeMergedTraceFiles() {
+  // Open all of the trace files, and dispatch their process started events
+  // ahead of any of their other events.
+  std::vector<std::unique_ptr<TraceFileProducer>> producers;
+  TraceFileIter it = trace_file_set_.begin();
+  for (; it != trace_file_set_.end(); ++it) {
+    LOG(INFO) << "Processing '" << it->BaseName().value() << "'.";
+
+    std::unique_ptr<TraceFileProducer> producer(new TraceFileProducer());
+    if (!producer->reader()->Open(*it) ||
+        !ConsumeTraceFileHeader(*producer->reader()->header())) {
+      LOG(ERROR) << "Failed to consume '" << it->value() << "'.";
+      return false;
+    }
+    producers.push_back(std::move(producer));
+  }
+
+  for (size_t i = 0; i < producers.size(); ++i)
+    producers[i]->Start();
+
+  // Merge the records of all of the trace files. The producer threads are
+  // stopped when |producers| goes out of scope, whichever way we leave.
+  std::vector<MergeCursor> cursors(producers.size());
+  std::priority_queue<MergeHead, std::vector<MergeHead>,
+                      std::greater<MergeHead>> heads;
+  for (size_t i = 0; i < producers.size(); ++i) {
+    if (AdvanceMergeCursor(producers[i].get(), &cursors[i])) {
+      MergeHead head = {
+          cursors[i].batch->records[cursors[i].next_record].file_time, i};
+      heads.push(head);
+    }
+  }
+
+  while (!heads.empty()) {
+    size_t file_index = heads.top().file_index;
+    heads.pop();
+
+    MergeCursor& cursor = cursors[file_index];
+    const TimedRecord& record = cursor.batch->records[cursor.next_record];
+    if (!DispatchRecord(producers[file_index]->reader()->header()->process_id,
+                        cursor.batch->thread_id,
+                        record.file_time,
+                        record.prefix)) {
+      return false;
+    }
+    ++cursor.next_record;
+
+    if (AdvanceMergeCursor(producers[file_index].get(), &cursor)) {
+      MergeHead head = {
+          cursor.batch->records[cursor.next_record].file_time, file_index};
+      heads.push(head);
+    }
+  }
+
+  for (size_t i = 0; i < producers.size(); ++i) {
+    if (!producers[i]->succeeded()) {
+      LOG(ERROR) << "Failed to consume '"
+                 << producers[i]->reader()->path().value() << "'.";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ParseEngineRpc::ConsumeTraceFileHeader(
+    const TraceFileHeader& file_header) {
+  DCHECK(event_handler_ != NULL);
+
+  // Populate the system information which will be fed to the OnProcessStarted
+  // event.
+  TraceSystemInfo system_info = {};
+  system_info.os_version_info = file_header.os_version_info;
+  system_info.system_info = file_header.system_info;
+  system_info.memory_status = file_header.memory_status;
+  system_info.clock_info = file_header.clock_info;
+
+  // Parse the header blob. This fails if there is any extra data, enforcing
+  // a valid header size as a side effect.
+  std::wstring module_path;
+  std::wstring command_line;
+  if (!ParseTraceFileHeaderBlob(file_header, &module_path, &command_line,
+                                &system_info.environment_strings)) {
+    LOG(ERROR) << "Unable to parse trace file header blob.";
+    return false;
+  }
+
+  // Add the executable's module information to the process map. This is in
+  // case the executable itself is instrumented, so that trace events will map
+  // to a module in the process map.
+  ModuleInformation module_info;
+  module_info.base_address.set_value(file_header.module_base_address);
+  module_info.path = module_path;
+  module_info.module_size = file_header.module_size;
+  module_info.module_checksum = file_header.module_checksum;
+  module_info.module_time_date_stamp = file_header.module_time_date_stamp;
+  AddModuleInformation(file_header.process_id, module_info);
+
+  // Notify the event handler that a process has started.
+  base::Time start_time(base::Time::FromFileTime(
+      file_header.clock_info.file_time));
+  event_handler_->OnProcessStarted(start_time, file_header.process_id,
+                                   &system_info);
+
+  return true;
+}
+
 bool ParseEngineRpc::ConsumeSegmentEvents(
     const TraceFileHeader& file_header,
     const TraceFileSegmentHeader& segment_header,
-    uint8_t* buffer,
+    const uint8_t* buffer,
     size_t buffer_length) {
   DCHECK(buffer != NULL);
+
+  const uint8_t* read_ptr = buffer;
+  const uint8_t* end_ptr = read_ptr + buffer_length;
+
+  while (const RecordPrefix* prefix = NextRecord(&read_ptr, end_ptr)) {
+    if (!DispatchRecord(file_header.process_id,
+                        segment_header.thread_id,
+                        GetRecordFileTime(file_header.clock_info, prefix),
+                        prefix)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ParseEngineRpc::DispatchRecord(DWORD process_id,
+                                    DWORD thread_id,
+                                    uint64_t file_time,
+                                    const RecordPrefix* prefix) {
+  DCHECK(prefix != NULL);
   DCHECK(event_handler_ != NULL);
 
   EVENT_TRACE event_record = {};
 
-  event_record.Header.ProcessId = file_header.process_id;
-  event_record.Header.ThreadId = segment_header.thread_id;
+  event_record.Header.ProcessId = process_id;
+  event_record.Header.ThreadId = thread_id;
   event_record.Header.Guid = kCallTraceEventClass;
+  event_record.Header.Class.Type = prefix->type;
 
-  uint8_t* read_ptr = buffer;
-  uint8_t* end_ptr = read_ptr + buffer_length;
-
-  while (read_ptr < end_ptr) {
-    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(read_ptr);
-    read_ptr += sizeof(RecordPrefix) + prefix->size;
-    if (read_ptr > end_ptr) {
-      // For batch-oriented records (where the record size is updated after
-      // the record is initially written) there's a race condition between
-      // updating the size of the segment and updating the number of items
-      // in the batch record wherein the client process could be terminated
-      // leaving a truncated batch record.
-      LOG(WARNING) << "Encountered truncated record at end of segment.";
-      continue;
-    }
-
-    event_record.Header.Class.Type = prefix->type;
-
-    // The TimeStamp is interpreted as a FILETIME, so we convert the timer
-    // value to that.
-    trace::common::TscToFileTime(
-        file_header.clock_info,
-        prefix->timestamp,
-        reinterpret_cast<FILETIME*>(&event_record.Header.TimeStamp));
+  // The TimeStamp is interpreted as a FILETIME.
+  event_record.Header.TimeStamp.QuadPart = file_time;
 
-    event_record.MofData = prefix + 1;
-    event_record.MofLength = prefix->size;
-    if (!DispatchEvent(&event_record)) {
-      LOG(ERROR) << "Failed to process event of type " << prefix->type << ".";
-      return false;
-    }
+  event_record.MofData = const_cast<RecordPrefix*>(prefix + 1);
+  event_record.MofLength = prefix->size;
+  if (!DispatchEvent(&event_record)) {
+    LOG(ERROR) << "Failed to process event of type " << prefix->type << ".";
+    return false;
+  }
 
-    if (error_occurred()) {
-      return false;
-    }
+  if (error_occurred()) {
+    return false;
   }
 
   return true;
@@ -27,9 +27,31 @@ namespace parser {
 
 class ParseEngineRpc : public ParseEngine {
  public:
+  // The ways in which trace files can be consumed.
+  enum ReadMode {
+    // Each segment is read into a buffer, and the trace files are consumed
+    // one after the other.
+    kBufferedReadMode,
+    // Segments are consumed in place from a memory mapping of the trace file,
+    // and the trace files are consumed one after the other.
+    kMappedReadMode,
+    // Every trace file is read through a memory mapping on a thread of its
+    // own, and the events of all trace files are dispatched in timestamp
+    // order. Events within a trace file are dispatched in file order, as
+    // segments of different threads are not ordered with respect to each
+    // other.
+    kMergedReadMode,
+  };
+
   ParseEngineRpc();
   virtual ~ParseEngineRpc();
 
+  // @name Accessors and mutators.
+  // @{
+  ReadMode read_mode() const { return read_mode_; }
+  void set_read_mode(ReadMode read_mode) { read_mode_ = read_mode; }
+  // @}
+
   // @name ParseEngine implementation
   // @{
   virtual bool IsRecognizedTraceFile(
@@ -46,12 +68,35 @@ class ParseEngineRpc : public ParseEngine {
   // An iterator over a set of trace file paths.
   typedef TraceFileSet::iterator TraceFileIter;
 
-  // Dispatches all of the events contained in the given trace file.
+  // Dispatches all of the events contained in the given trace file, reading
+  // its segments into a buffer.
+  //
+  // For each segment in the trace file calls ConsumeSegmentEvents().
+  //
+  // @returns true on success
+  bool ConsumeBufferedTraceFile(const base::FilePath& trace_file_path);
+
+  // Dispatches all of the events contained in the given trace file, consuming
+  // its segments in place from a memory mapping.
   //
   // For each segment in the trace file calls ConsumeSegmentEvents().
   //
   // @returns true on success
-  bool ConsumeTraceFile(const base::FilePath& trace_file_path);
+  bool ConsumeMappedTraceFile(const base::FilePath& trace_file_path);
+
+  // Dispatches all of the events contained in all of the trace files, in
+  // timestamp order. See kMergedReadMode.
+  //
+  // @returns true on success
+  bool ConsumeMergedTraceFiles();
+
+  // Registers the module and dispatches the process started event described
+  // by a trace file header.
+  //
+  // @param file_header the header of the trace file, including its variable
+  //     length part.
+  // @returns true on success.
+  bool ConsumeTraceFileHeader(const TraceFileHeader& file_header);
 
   // Dispatches all of the events in the given segment buffer.
   //
@@ -62,12 +107,27 @@ class ParseEngineRpc : public ParseEngine {
   // @return true on success.
   bool ConsumeSegmentEvents(const TraceFileHeader& file_header,
                             const TraceFileSegmentHeader& segment_header,
-                            uint8_t* buffer,
+                            const uint8_t* buffer,
                             size_t buffer_length);
 
+  // Dispatches a single trace record.
+  //
+  // @param process_id the process that produced the record.
+  // @param thread_id the thread that produced the record.
+  // @param file_time the timestamp of the record, as a FILETIME.
+  // @param prefix the record, which is followed by its payload.
+  // @return true on success.
+  bool DispatchRecord(DWORD process_id,
+                      DWORD thread_id,
+                      uint64_t file_time,
+                      const RecordPrefix* prefix);
+
   // The set of trace files to consume when ConsumeAllEvents() is called.
   TraceFileSet trace_file_set_;
 
+  // The way in which the trace files are consumed.
+  ReadMode read_mode_;
+
   DISALLOW_COPY_AND_ASSIGN(ParseEngineRpc);
 };
 
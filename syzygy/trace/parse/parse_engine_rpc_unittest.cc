@@ -16,8 +16,10 @@
 
 #include <windows.h>
 
+#include <algorithm>
 #include <list>
 #include <map>
+#include <vector>
 
 #include "base/environment.h"
 #include "base/lazy_instance.h"
@@ -38,6 +40,7 @@
 #include "syzygy/pe/unittest_util.h"
 #include "syzygy/trace/common/unittest_util.h"
 #include "syzygy/trace/parse/parser.h"
+#include "syzygy/trace/parse/unittest_util.h"
 #include "syzygy/trace/service/process_info.h"
 
 namespace trace {
@@ -802,5 +805,198 @@ TEST_F(ParseEngineRpcTest, MultiThreadWithStopCallTrace) {
   ASSERT_EQ(77, entered_addresses_.count(IndirectFunctionB));
 }
 
+namespace {
+
+using ::trace::parser::ParseEngineRpc;
+
+// Records the function entry events dispatched by a parse engine.
+class FunctionEntryRecorder : public ParseEventHandlerImpl {
+ public:
+  FunctionEntryRecorder() : processes_started_(0) {}
+
+  void OnProcessStarted(base::Time time,
+                        DWORD process_id,
+                        const TraceSystemInfo* data) override {
+    ++processes_started_;
+  }
+
+  void OnFunctionEntry(base::Time time,
+                       DWORD process_id,
+                       DWORD thread_id,
+                       const TraceEnterExitEventData* data) override {
+    functions_.push_back(reinterpret_cast<uintptr_t>(data->function));
+    thread_ids_.push_back(thread_id);
+  }
+
+  size_t processes_started() const { return processes_started_; }
+  const std::vector<uint64_t>& functions() const { return functions_; }
+  const std::vector<DWORD>& thread_ids() const { return thread_ids_; }
+
+ private:
+  size_t processes_started_;
+  std::vector<uint64_t> functions_;
+  std::vector<DWORD> thread_ids_;
+};
+
+class ParseEngineRpcReadModeTest : public testing::PELibUnitTest {
+ public:
+  void SetUp() override {
+    testing::PELibUnitTest::SetUp();
+    ASSERT_NO_FATAL_FAILURE(CreateTemporaryDir(&temp_dir_));
+  }
+
+  // Writes a test trace file with the given segments.
+  // @returns the path of the trace file.
+  base::FilePath WriteTraceFile(
+      const std::vector<testing::TestTraceSegment>& segments) {
+    base::FilePath path = temp_dir_.AppendASCII(
+        base::StringPrintf("trace-%d.bin", static_cast<int>(paths_.size())));
+    EXPECT_TRUE(testing::WriteTestTraceFile(path, segments));
+    paths_.push_back(path);
+    return path;
+  }
+
+  // Consumes all of the trace files written so far in the given read mode.
+  void Consume(ParseEngineRpc::ReadMode read_mode,
+               FunctionEntryRecorder* recorder) {
+    ParseEngineRpc* engine = new ParseEngineRpc();
+    engine->set_read_mode(read_mode);
+    Parser parser;
+    parser.AddParseEngine(engine);
+    ASSERT_TRUE(parser.Init(recorder));
+    for (size_t i = 0; i < paths_.size(); ++i)
+      ASSERT_TRUE(parser.OpenTraceFile(paths_[i]));
+    ASSERT_TRUE(parser.Consume());
+    EXPECT_FALSE(parser.error_occurred());
+  }
+
+ protected:
+  base::FilePath temp_dir_;
+  std::vector<base::FilePath> paths_;
+};
+
+// Builds a segment whose timestamps are @p count multiples of @p step, starting
+// at @p first. Timestamps are spaced widely enough to survive the conversion
+// to FILETIME, which goes through a double.
+testing::TestTraceSegment MakeSegment(uint32_t thread_id,
+                                      uint64_t first,
+                                      uint64_t step,
+                                      size_t count) {
+  testing::TestTraceSegment segment;
+  segment.thread_id = thread_id;
+  for (size_t i = 0; i < count; ++i)
+    segment.timestamps.push_back(first + i * step);
+  return segment;
+}
+
+}  // namespace
+
+TEST_F(ParseEngineRpcReadModeTest, ReadModesAgree) {
+  std::vector<testing::TestTraceSegment> segments;
+  segments.push_back(MakeSegment(1, 1000, 1000, 10));
+  segments.push_back(MakeSegment(2, 500, 1000, 100));
+  segments.push_back(MakeSegment(1, 20000, 1000, 1));
+  WriteTraceFile(segments);
+
+  FunctionEntryRecorder buffered;
+  ASSERT_NO_FATAL_FAILURE(
+      Consume(ParseEngineRpc::kBufferedReadMode, &buffered));
+  EXPECT_EQ(1u, buffered.processes_started());
+  EXPECT_EQ(111u, buffered.functions().size());
+
+  FunctionEntryRecorder mapped;
+  ASSERT_NO_FATAL_FAILURE(Consume(ParseEngineRpc::kMappedReadMode, &mapped));
+  EXPECT_EQ(1u, mapped.processes_started());
+  EXPECT_EQ(buffered.functions(), mapped.functions());
+  EXPECT_EQ(buffered.thread_ids(), mapped.thread_ids());
+
+  // With a single trace file, merging preserves the file order.
+  FunctionEntryRecorder merged;
+  ASSERT_NO_FATAL_FAILURE(Consume(ParseEngineRpc::kMergedReadMode, &merged));
+  EXPECT_EQ(1u, merged.processes_started());
+  EXPECT_EQ(buffered.functions(), merged.functions());
+  EXPECT_EQ(buffered.thread_ids(), merged.thread_ids());
+}
+
+TEST_F(ParseEngineRpcReadModeTest, ReadModesAgreeOnCompressedSegments) {
+  // Released decompressed segments are scribbled over in debug builds, so the
+  // merged read mode fails here if its queued records don't hold on to their
+  // segment. Many small segments make it likely that records are dispatched
+  // after the reader has moved on.
+  std::vector<testing::TestTraceSegment> segments;
+  segments.push_back(MakeSegment(1, 1000, 1000, 10));
+  segments.push_back(MakeSegment(2, 500, 1000, 1000));
+  segments.push_back(MakeSegment(1, 2000000, 1000, 100));
+  for (size_t i = 0; i < 64; ++i)
+    segments.push_back(MakeSegment(3, 3000000 + 100 * i, 1, 10));
+  for (size_t i = 1; i < segments.size(); ++i)
+    segments[i].compressed = true;
+  WriteTraceFile(segments);
+
+  FunctionEntryRecorder buffered;
+  ASSERT_NO_FATAL_FAILURE(
+      Consume(ParseEngineRpc::kBufferedReadMode, &buffered));
+  EXPECT_EQ(1u, buffered.processes_started());
+  EXPECT_EQ(1750u, buffered.functions().size());
+
+  FunctionEntryRecorder mapped;
+  ASSERT_NO_FATAL_FAILURE(Consume(ParseEngineRpc::kMappedReadMode, &mapped));
+  EXPECT_EQ(buffered.functions(), mapped.functions());
+  EXPECT_EQ(buffered.thread_ids(), mapped.thread_ids());
+
+  FunctionEntryRecorder merged;
+  ASSERT_NO_FATAL_FAILURE(Consume(ParseEngineRpc::kMergedReadMode, &merged));
+  EXPECT_EQ(buffered.functions(), merged.functions());
+  EXPECT_EQ(buffered.thread_ids(), merged.thread_ids());
+}
+
+TEST_F(ParseEngineRpcReadModeTest, MergedReadModeOrdersByTimestamp) {
+  // Three trace files whose events interleave.
+  for (size_t i = 0; i < 3; ++i) {
+    std::vector<testing::TestTraceSegment> segments;
+    uint32_t thread_id = static_cast<uint32_t>(i);
+    segments.push_back(MakeSegment(thread_id, 1000 * (i + 1), 3000, 50));
+    segments.push_back(
+        MakeSegment(thread_id, 1000 * (i + 1) + 150000, 3000, 50));
+    WriteTraceFile(segments);
+  }
+
+  FunctionEntryRecorder mapped;
+  ASSERT_NO_FATAL_FAILURE(Consume(ParseEngineRpc::kMappedReadMode, &mapped));
+  FunctionEntryRecorder merged;
+  ASSERT_NO_FATAL_FAILURE(Consume(ParseEngineRpc::kMergedReadMode, &merged));
+
+  EXPECT_EQ(3u, merged.processes_started());
+  ASSERT_EQ(300u, merged.functions().size());
+
+  // The merged events are the same events, in timestamp order.
+  std::vector<uint64_t> expected(mapped.functions());
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(expected, merged.functions());
+  EXPECT_NE(mapped.functions(), merged.functions());
+}
+
+TEST_F(ParseEngineRpcReadModeTest, MergedReadModeFailsOnInvalidFile) {
+  std::vector<testing::TestTraceSegment> segments;
+  segments.push_back(MakeSegment(1, 1000, 1000, 10));
+  WriteTraceFile(segments);
+
+  base::FilePath invalid_path = temp_dir_.AppendASCII("invalid.bin");
+  const char kGarbage[] = "this is not a trace file";
+  ASSERT_EQ(static_cast<int>(sizeof(kGarbage)),
+            base::WriteFile(invalid_path, kGarbage, sizeof(kGarbage)));
+  paths_.push_back(invalid_path);
+
+  ParseEngineRpc* engine = new ParseEngineRpc();
+  engine->set_read_mode(ParseEngineRpc::kMergedReadMode);
+  FunctionEntryRecorder recorder;
+  Parser parser;
+  parser.AddParseEngine(engine);
+  ASSERT_TRUE(parser.Init(&recorder));
+  for (size_t i = 0; i < paths_.size(); ++i)
+    ASSERT_TRUE(parser.OpenTraceFile(paths_[i]));
+  EXPECT_FALSE(parser.Consume());
+}
+
 }  // namespace service
 }  // namespace trace
@@ -14,9 +14,115 @@
 
 #include "syzygy/trace/parse/unittest_util.h"
 
+#include "base/files/file_util.h"
+#include "syzygy/common/align.h"
+#include "syzygy/trace/common/segment_compression.h"
+#include "syzygy/trace/service/process_info.h"
+#include "syzygy/trace/service/trace_file_writer.h"
+
 namespace testing {
 
-// NOTE: Although this file is empty, it shouldn't be removed. It is required
-// to make sure that a library gets compiled for this target.
+// 2016-01-01 00:00:00 UTC.
+const uint64_t kTestTraceFileTimeBase = 130960800000000000ULL;
+
+bool WriteTestTraceFile(const base::FilePath& path,
+                        const std::vector<TestTraceSegment>& segments) {
+  trace::service::ProcessInfo process_info;
+  if (!process_info.Initialize(::GetCurrentProcessId()))
+    return false;
+
+  trace::service::TraceFileWriter writer;
+  if (!writer.Open(path) || !writer.WriteHeader(process_info))
+    return false;
+
+  for (size_t i = 0; i < segments.size(); ++i) {
+    const std::vector<uint64_t>& timestamps = segments[i].timestamps;
+    size_t record_size = sizeof(RecordPrefix) + sizeof(TraceEnterEventData);
+    size_t segment_length = timestamps.size() * record_size;
+
+    std::vector<uint8_t> buffer(::common::AlignUp(
+        sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader) + segment_length,
+        writer.block_size()));
+    RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(buffer.data());
+    prefix->type = TraceFileSegmentHeader::kTypeId;
+    prefix->size = sizeof(TraceFileSegmentHeader);
+    prefix->version.hi = TRACE_VERSION_HI;
+    prefix->version.lo = TRACE_VERSION_LO;
+    TraceFileSegmentHeader* header =
+        reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+    header->thread_id = segments[i].thread_id;
+    header->segment_length = segment_length;
+
+    uint8_t* cursor = reinterpret_cast<uint8_t*>(header + 1);
+    for (size_t j = 0; j < timestamps.size(); ++j) {
+      prefix = reinterpret_cast<RecordPrefix*>(cursor);
+      prefix->timestamp = timestamps[j];
+      prefix->type = TRACE_ENTER_EVENT;
+      prefix->size = sizeof(TraceEnterEventData);
+      prefix->version.hi = TRACE_VERSION_HI;
+      prefix->version.lo = TRACE_VERSION_LO;
+      TraceEnterEventData* data =
+          reinterpret_cast<TraceEnterEventData*>(prefix + 1);
+      data->retaddr = NULL;
+      data->function =
+          reinterpret_cast<FuncAddr>(static_cast<uintptr_t>(timestamps[j]));
+      cursor += record_size;
+    }
+
+    if (segments[i].compressed) {
+      // Replace the segment header and data by their compressed version.
+      std::vector<uint8_t> compressed(
+          sizeof(RecordPrefix) + sizeof(TraceFileCompressedSegmentHeader));
+      if (!trace::common::CompressSegmentData(
+              reinterpret_cast<const uint8_t*>(header + 1), segment_length,
+              trace::common::kSegmentCompressionLevel, &compressed)) {
+        return false;
+      }
+      RecordPrefix* compressed_prefix =
+          reinterpret_cast<RecordPrefix*>(compressed.data());
+      *compressed_prefix = *reinterpret_cast<RecordPrefix*>(buffer.data());
+      compressed_prefix->type = TraceFileCompressedSegmentHeader::kTypeId;
+      compressed_prefix->size = sizeof(TraceFileCompressedSegmentHeader);
+      TraceFileCompressedSegmentHeader* compressed_header =
+          reinterpret_cast<TraceFileCompressedSegmentHeader*>(
+              compressed_prefix + 1);
+      compressed_header->thread_id = segments[i].thread_id;
+      compressed_header->segment_length = compressed.size() -
+          sizeof(RecordPrefix) - sizeof(TraceFileCompressedSegmentHeader);
+      compressed_header->uncompressed_length = segment_length;
+      compressed.resize(::common::AlignUp(compressed.size(),
+                                          writer.block_size()));
+      buffer.swap(compressed);
+    }
+
+    if (!writer.WriteRecord(buffer.data(), buffer.size()))
+      return false;
+  }
+
+  if (!writer.Close())
+    return false;
+
+  // Replace the clock information with one where a TSC tick is a FILETIME
+  // unit, so that timestamps are reproducible.
+  base::ScopedFILE file(base::OpenFile(path, "r+b"));
+  if (!file.get())
+    return false;
+  TraceFileHeader file_header = {};
+  if (::fread(&file_header, sizeof(file_header), 1, file.get()) != 1)
+    return false;
+  file_header.clock_info.file_time.dwLowDateTime =
+      static_cast<DWORD>(kTestTraceFileTimeBase);
+  file_header.clock_info.file_time.dwHighDateTime =
+      static_cast<DWORD>(kTestTraceFileTimeBase >> 32);
+  file_header.clock_info.tsc_reference = 0;
+  file_header.clock_info.tsc_info.frequency = 10 * 1000 * 1000;
+  file_header.clock_info.tsc_info.resolution = 1;
+  if (::fseek(file.get(), 0, SEEK_SET) != 0 ||
+      ::fwrite(&file_header, sizeof(file_header), 1, file.get()) != 1) {
+    return false;
+  }
+
+  return true;
+}
 
 }  // namespace testing
@@ -17,11 +17,39 @@
 #ifndef SYZYGY_TRACE_PARSE_UNITTEST_UTIL_H_
 #define SYZYGY_TRACE_PARSE_UNITTEST_UTIL_H_
 
+#include <vector>
+
+#include "base/files/file_path.h"
 #include "gmock/gmock.h"
 #include "syzygy/trace/parse/parser.h"
 
 namespace testing {
 
+// The FILETIME corresponding to a timestamp of zero in the trace files written
+// by WriteTestTraceFile. Their timestamps are in FILETIME units (100ns).
+extern const uint64_t kTestTraceFileTimeBase;
+
+// Describes a segment of a test trace file.
+struct TestTraceSegment {
+  TestTraceSegment() : thread_id(0), compressed(false) {}
+
+  // The thread that produced the segment.
+  uint32_t thread_id;
+  // Whether the segment is compressed, as the call trace service does.
+  bool compressed;
+  // A function entry event is written for each of these timestamps. The
+  // function address of each event is its timestamp, so that tests can
+  // identify the events.
+  std::vector<uint64_t> timestamps;
+};
+
+// Writes a trace file for the current process, with a deterministic clock.
+// @param path the path of the trace file to write.
+// @param segments the segments to write, in order.
+// @returns true on success, false otherwise.
+bool WriteTestTraceFile(const base::FilePath& path,
+                        const std::vector<TestTraceSegment>& segments);
+
 class MockParseEventHandler : public trace::parser::ParseEventHandler {
  public:
   MOCK_METHOD3(OnProcessStarted, void(base::Time time,
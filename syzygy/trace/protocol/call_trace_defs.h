@@ -72,6 +72,9 @@ enum {
 enum TraceEventType {
   // Header prefix for a "page" of call trace events.
   TRACE_PAGE_HEADER,
+  // Header prefix for a "page" of call trace events that has been compressed
+  // by the call trace service.
+  TRACE_COMPRESSED_PAGE_HEADER,
   // The actual events are below.
   TRACE_PROCESS_STARTED = 10,
   TRACE_PROCESS_ENDED,
@@ -251,6 +254,29 @@ struct TraceFileSegmentHeader {
 };
 COMPILE_ASSERT_IS_POD(TraceFileSegmentHeader);
 
+// Written by the call trace service in place of a TraceFileSegmentHeader when
+// it compresses a segment on its way to disk. Clients never write this. The
+// segment data is a zlib stream which inflates to exactly the records that
+// would have followed the TraceFileSegmentHeader. Like any other segment, the
+// segment is rounded up to the block_size on disk.
+struct TraceFileCompressedSegmentHeader {
+  // Type identifiers used for these headers.
+  enum { kTypeId = TRACE_COMPRESSED_PAGE_HEADER };
+
+  // The identity of the thread that is reporting in this segment
+  // of the trace file.
+  uint32_t thread_id;
+
+  // The number of compressed data bytes in this segment of the trace file.
+  // This value does not include the size of the record prefix nor the size of
+  // the segment header.
+  uint32_t segment_length;
+
+  // The number of data bytes in this segment once decompressed.
+  uint32_t uncompressed_length;
+};
+COMPILE_ASSERT_IS_POD(TraceFileCompressedSegmentHeader);
+
 // The structure traced on function entry or exit.
 template<int TypeId>
 struct TraceEnterExitEventDataTempl {
@@ -44,6 +44,7 @@
       'dependencies': [
         '<(src)/base/base.gyp:base',
         '<(src)/syzygy/trace/common/common.gyp:trace_common_lib',
+        '<(src)/syzygy/trace/common/common.gyp:trace_compression_lib',
         '<(src)/syzygy/trace/rpc/rpc.gyp:call_trace_rpc_lib',
       ],
     },
@@ -66,6 +67,7 @@
         '<(src)/syzygy/core/core.gyp:core_unittest_utils',
         '<(src)/syzygy/trace/parse/parse.gyp:parse_lib',
         '<(src)/syzygy/trace/client/client.gyp:rpc_client_lib',
+        '<(src)/syzygy/trace/common/common.gyp:trace_compression_lib',
         '<(src)/syzygy/trace/service/service.gyp:rpc_service_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_lib',
         '<(src)/syzygy/pe/pe.gyp:pe_unittest_utils',
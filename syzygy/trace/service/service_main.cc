@@ -89,6 +89,9 @@ const char kUsage[] =
     "                     The number of buffers by which to grow the buffer\n"
     "                     pool each time the client exhausts its available\n"
     "                     buffer space.\n"
+    "  --compress         Compress trace file segments as they are written.\n"
+    "                     Trace files written this way are read transparently\n"
+    "                     by the trace parser.\n"
     "  --enable-exits     Enable exit tracing (off by default).\n"
     "  --verbose          Increase the logging verbosity to also include\n"
     "                     debug-level information.\n"
@@ -187,6 +190,10 @@ bool RunService(const base::CommandLine* cmd_line,
   if (!session_trace_file_writer_factory.SetTraceFileDirectory(trace_directory))
     return false;
 
+  // Set up trace file compression.
+  session_trace_file_writer_factory.set_compress_segments(
+      cmd_line->HasSwitch("compress"));
+
   // Setup the buffer size.
   std::wstring buffer_size_str(cmd_line->GetSwitchValueNative("buffer-size"));
   if (!buffer_size_str.empty()) {
@@ -17,6 +17,7 @@
 #include <psapi.h>
 #include <userenv.h>
 #include <memory>
+#include <vector>
 
 #include "base/command_line.h"
 #include "base/environment.h"
@@ -34,6 +35,7 @@
 #include "syzygy/common/rpc/helpers.h"
 #include "syzygy/core/unittest_util.h"
 #include "syzygy/trace/client/client_utils.h"
+#include "syzygy/trace/common/segment_compression.h"
 #include "syzygy/trace/parse/parse_utils.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/service_rpc_impl.h"
@@ -811,5 +813,81 @@ TEST_F(CallTraceServiceTest, SendBuffer) {
             RawPtrDiff(prefix + 1, segment_header + 1));
 }
 
+TEST_F(CallTraceServiceTest, SendCompressedBuffer) {
+  SessionHandle session_handle = NULL;
+  TraceFileSegment segment;
+
+  const size_t kNumRecords = 100;
+  const char kMessage[] = "This message compresses well when repeated.";
+
+  session_trace_file_writer_factory_.set_compress_segments(true);
+  ASSERT_TRUE(call_trace_service_.Start(true));
+  ASSERT_NO_FATAL_FAILURE(CreateSession(&session_handle, &segment));
+
+  // Write a segment spanning several blocks of highly redundant records.
+  segment.WriteSegmentHeader(session_handle);
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    MyRecordType* record = segment.AllocateTraceRecord<MyRecordType>();
+    base::strlcpy(record->message, kMessage, arraysize(record->message));
+  }
+  size_t segment_length = segment.header->segment_length;
+  ASSERT_NO_FATAL_FAILURE(ReturnBuffer(session_handle, &segment));
+  ASSERT_NO_FATAL_FAILURE(CloseSession(&session_handle));
+  ASSERT_TRUE(call_trace_service_.Stop());
+
+  std::string trace_file_contents;
+  ASSERT_NO_FATAL_FAILURE(ReadTraceFile(&trace_file_contents));
+  TraceFileHeader* header =
+      reinterpret_cast<TraceFileHeader*>(&trace_file_contents[0]);
+  ASSERT_NO_FATAL_FAILURE(ValidateTraceFileHeader(*header));
+  ASSERT_LT(header->block_size, segment_length);
+
+  // The segment was stored compressed, in fewer blocks than it spans.
+  size_t segment_offset = AlignUp(header->header_size, header->block_size);
+  RecordPrefix* prefix = reinterpret_cast<RecordPrefix*>(
+      &trace_file_contents[0] + segment_offset);
+  ASSERT_EQ(TraceFileCompressedSegmentHeader::kTypeId, prefix->type);
+  ASSERT_EQ(sizeof(TraceFileCompressedSegmentHeader), prefix->size);
+  TraceFileCompressedSegmentHeader* compressed_header =
+      reinterpret_cast<TraceFileCompressedSegmentHeader*>(prefix + 1);
+  ASSERT_EQ(::GetCurrentThreadId(), compressed_header->thread_id);
+  ASSERT_EQ(segment_length, compressed_header->uncompressed_length);
+  ASSERT_LT(compressed_header->segment_length, segment_length);
+
+  std::vector<uint8_t> uncompressed;
+  ASSERT_TRUE(trace::common::DecompressSegmentData(
+      reinterpret_cast<const uint8_t*>(compressed_header + 1),
+      compressed_header->segment_length,
+      compressed_header->uncompressed_length,
+      &uncompressed));
+  ASSERT_EQ(segment_length, uncompressed.size());
+
+  prefix = reinterpret_cast<RecordPrefix*>(uncompressed.data());
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    ASSERT_EQ(MyRecordType::kTypeId, prefix->type);
+    ASSERT_EQ(sizeof(MyRecordType), prefix->size);
+    MyRecordType* record = reinterpret_cast<MyRecordType*>(prefix + 1);
+    ASSERT_STREQ(kMessage, record->message);
+    prefix = reinterpret_cast<RecordPrefix*>(record + 1);
+  }
+
+  // The process ended event is too small to gain from compression, and
+  // follows as is.
+  segment_offset = AlignUp(segment_offset + sizeof(RecordPrefix) +
+                               sizeof(TraceFileCompressedSegmentHeader) +
+                               compressed_header->segment_length,
+                           header->block_size);
+  ASSERT_LT(segment_offset, trace_file_contents.length());
+  prefix = reinterpret_cast<RecordPrefix*>(
+      &trace_file_contents[0] + segment_offset);
+  ASSERT_EQ(TraceFileSegmentHeader::kTypeId, prefix->type);
+  TraceFileSegmentHeader* segment_header =
+      reinterpret_cast<TraceFileSegmentHeader*>(prefix + 1);
+  prefix = reinterpret_cast<RecordPrefix*>(segment_header + 1);
+  ASSERT_EQ(TRACE_PROCESS_ENDED, prefix->type);
+  EXPECT_EQ(trace_file_contents.length(),
+            segment_offset + header->block_size);
+}
+
 }  // namespace service
 }  // namespace trace
@@ -59,6 +59,7 @@ Session::Session(Service* call_trace_service)
       buffer_requests_waiting_for_recycle_(0),
       buffer_is_available_(&lock_),
       buffer_id_(0),
+      client_waits_(0),
       input_error_already_logged_(false) {
   DCHECK(call_trace_service != NULL);
   ::memset(buffer_state_counts_, 0, sizeof(buffer_state_counts_));
@@ -270,6 +271,15 @@ bool Session::RecycleBuffer(Buffer* buffer) {
   return true;
 }
 
+void Session::GetClientWaitStats(size_t* waits, base::TimeDelta* wait_time) {
+  DCHECK(waits != NULL);
+  DCHECK(wait_time != NULL);
+
+  base::AutoLock lock(lock_);
+  *waits = client_waits_;
+  *wait_time = client_wait_time_;
+}
+
 void Session::ChangeBufferState(BufferState new_state, Buffer* buffer) {
   DCHECK(buffer != NULL);
   DCHECK(buffer->session == this);
@@ -477,7 +487,10 @@ bool Session::GetNextBufferUnlocked(Buffer** out_buffer) {
     if (buffer_requests_waiting_for_recycle_ < buffers_force_recyclable) {
       ++buffer_requests_waiting_for_recycle_;
       OnWaitingForBufferToBeRecycled();  // Unittest hook.
+      base::TimeTicks wait_start = base::TimeTicks::Now();
       buffer_is_available_.Wait();
+      ++client_waits_;
+      client_wait_time_ += base::TimeTicks::Now() - wait_start;
       --buffer_requests_waiting_for_recycle_;
     } else {
       // Otherwise, force an allocation.
@@ -26,6 +26,7 @@
 #include "base/process/process.h"
 #include "base/synchronization/condition_variable.h"
 #include "base/synchronization/lock.h"
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/buffer_pool.h"
@@ -102,6 +103,12 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // Returns the process information about this session's client.
   const ProcessInfo& client_info() const { return client_; }
 
+  // Gets the number of times, and the total time, that requests for buffers
+  // have been blocked waiting for a buffer to be written and recycled.
+  // @param waits will receive the number of waits.
+  // @param wait_time will receive the total time spent waiting.
+  void GetClientWaitStats(size_t* waits, base::TimeDelta* wait_time);
+
   // Get the buffer consumer for this session.
   BufferConsumer* buffer_consumer() { return buffer_consumer_.get(); }
 
@@ -254,6 +261,11 @@ class Session : public base::RefCountedThreadSafe<Session> {
   // TODO(rogerm): extend this to all buffers.
   size_t buffer_id_;  // Under lock_.
 
+  // The number of times, and the total time, GetNextBuffer requests have
+  // waited for a buffer to be recycled.
+  size_t client_waits_;  // Under lock_.
+  base::TimeDelta client_wait_time_;  // Under lock_.
+
   // This lock protects any access to the internals related to buffers and their
   // state.
   base::Lock lock_;
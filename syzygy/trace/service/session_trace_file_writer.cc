@@ -19,8 +19,14 @@
 
 #include "syzygy/trace/service/session_trace_file_writer.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "base/bind.h"
 #include "base/files/file_util.h"
+#include "syzygy/common/align.h"
+#include "syzygy/common/com_utils.h"
+#include "syzygy/trace/common/segment_compression.h"
 #include "syzygy/trace/protocol/call_trace_defs.h"
 #include "syzygy/trace/service/buffer_pool.h"
 #include "syzygy/trace/service/mapped_buffer.h"
@@ -29,12 +35,63 @@
 namespace trace {
 namespace service {
 
+struct SessionTraceFileWriter::WriteSlot {
+  WriteSlot() : data(NULL), length(0) {
+    ::memset(&overlapped, 0, sizeof(overlapped));
+  }
+
+  ~WriteSlot() {
+    if (data != NULL)
+      ::VirtualFree(data, 0, MEM_RELEASE);
+  }
+
+  // The staging buffer. This is page aligned, and hence block aligned.
+  uint8_t* data;
+  // The number of bytes staged in the buffer.
+  size_t length;
+  // The state of the write issued from this buffer, and its event.
+  OVERLAPPED overlapped;
+  base::win::ScopedHandle event;
+};
+
+double SessionTraceFileWriter::Stats::bytes_per_second() const {
+  double seconds = write_time.InSecondsF();
+  if (seconds <= 0.0)
+    return 0.0;
+  return static_cast<double>(bytes_written) / seconds;
+}
+
 SessionTraceFileWriter::SessionTraceFileWriter(
     base::MessageLoop* message_loop, const base::FilePath& trace_directory)
     : message_loop_(message_loop),
-      trace_file_path_(trace_directory) {
+      trace_file_path_(trace_directory),
+      compress_segments_(false),
+      flush_is_pending_(false),
+      current_write_slot_(NULL) {
   DCHECK(message_loop != NULL);
   DCHECK(!trace_directory.empty());
+  ::memset(&stats_, 0, sizeof(stats_));
+}
+
+SessionTraceFileWriter::~SessionTraceFileWriter() {
+  // Every flush issues its staged data, so there is nothing left to issue.
+  DCHECK(current_write_slot_ == NULL || current_write_slot_->length == 0);
+  DCHECK(pending_buffers_.empty());
+
+  // The writes in flight refer to the staging buffers, so they must complete
+  // before the staging buffers are released.
+  WaitForAllWrites();
+
+  if (stats_.writes != 0) {
+    LOG(INFO) << "Wrote " << stats_.buffers_written << " buffers ("
+              << stats_.bytes_consumed << " bytes, written as "
+              << stats_.bytes_written << " bytes in " << stats_.writes
+              << " writes, " << stats_.bytes_per_second() / (1024 * 1024)
+              << " MB/s) to '" << trace_file_path_.value() << "'. Peak queue "
+              << "depth was " << stats_.max_queue_depth << " buffers, and "
+              << "clients waited " << stats_.client_waits << " times for "
+              << stats_.client_wait_time.InMilliseconds() << " ms.";
+  }
 }
 
 bool SessionTraceFileWriter::Open(Session* session) {
@@ -57,11 +114,22 @@ bool SessionTraceFileWriter::Open(Session* session) {
       !writer_.WriteHeader(session->client_info())) {
     return false;
   }
+  DCHECK_EQ(0u, kWriteBatchSize % writer_.block_size());
 
   return true;
 }
 
-bool SessionTraceFileWriter::Close(Session* /* session */) {
+bool SessionTraceFileWriter::Close(Session* session) {
+  DCHECK(session != NULL);
+
+  size_t client_waits = 0;
+  base::TimeDelta client_wait_time;
+  session->GetClientWaitStats(&client_waits, &client_wait_time);
+
+  base::AutoLock auto_lock(lock_);
+  stats_.client_waits = client_waits;
+  stats_.client_wait_time = client_wait_time;
+
   return true;
 }
 
@@ -70,11 +138,22 @@ bool SessionTraceFileWriter::ConsumeBuffer(Buffer* buffer) {
   DCHECK(buffer->session != NULL);
   DCHECK(message_loop_ != NULL);
 
-  message_loop_->PostTask(FROM_HERE,
-                          base::Bind(&SessionTraceFileWriter::WriteBuffer,
-                                     this,
-                                     scoped_refptr<Session>(buffer->session),
-                                     base::Unretained(buffer)));
+  QueuedBuffer queued_buffer = { buffer->session, buffer };
+
+  base::AutoLock auto_lock(lock_);
+  pending_buffers_.push_back(queued_buffer);
+  ++stats_.queue_depth;
+  stats_.max_queue_depth = std::max(stats_.max_queue_depth,
+                                    stats_.queue_depth);
+
+  // Buffers consumed while a flush is pending are picked up by that flush, so
+  // that they are coalesced with the buffers before them.
+  if (!flush_is_pending_) {
+    flush_is_pending_ = true;
+    message_loop_->PostTask(
+        FROM_HERE,
+        base::Bind(&SessionTraceFileWriter::FlushPendingBuffers, this));
+  }
 
   return true;
 }
@@ -83,6 +162,33 @@ size_t SessionTraceFileWriter::block_size() const {
   return writer_.block_size();
 }
 
+void SessionTraceFileWriter::GetStats(Stats* stats) {
+  DCHECK(stats != NULL);
+
+  base::AutoLock auto_lock(lock_);
+  *stats = stats_;
+}
+
+void SessionTraceFileWriter::FlushPendingBuffers() {
+  DCHECK_EQ(base::MessageLoop::current(), message_loop_);
+
+  BufferQueue buffers;
+  {
+    base::AutoLock auto_lock(lock_);
+    DCHECK(flush_is_pending_);
+    buffers.swap(pending_buffers_);
+    flush_is_pending_ = false;
+  }
+
+  for (size_t i = 0; i < buffers.size(); ++i)
+    WriteBuffer(buffers[i].session, buffers[i].buffer);
+
+  // Don't hold on to a partially filled staging buffer, as there's no telling
+  // when more buffers will come in.
+  IssueCurrentWrite();
+  ReapWrites(false);
+}
+
 void SessionTraceFileWriter::WriteBuffer(scoped_refptr<Session> session,
                                          Buffer* buffer) {
   DCHECK(session != NULL);
@@ -91,13 +197,63 @@ void SessionTraceFileWriter::WriteBuffer(scoped_refptr<Session> session,
   DCHECK_EQ(Buffer::kPendingWrite, buffer->state);
   DCHECK_EQ(base::MessageLoop::current(), message_loop_);
 
+  {
+    base::AutoLock auto_lock(lock_);
+    DCHECK_LT(0u, stats_.queue_depth);
+    --stats_.queue_depth;
+  }
+
   MappedBuffer mapped_buffer(buffer);
   if (!mapped_buffer.Map())
     return;
 
-  // We deliberately ignore the return status. However, this will log if
+  // We deliberately ignore invalid records. However, this will log if
   // anything goes wrong.
-  writer_.WriteRecord(mapped_buffer.data(), buffer->buffer_size);
+  size_t length = 0;
+  if (writer_.GetRecordWriteLength(mapped_buffer.data(), buffer->buffer_size,
+                                   &length) && length != 0) {
+    {
+      base::AutoLock auto_lock(lock_);
+      stats_.bytes_consumed += length;
+    }
+
+    // Segments that don't compress well are written as is.
+    const uint8_t* record = mapped_buffer.data();
+    if (compress_segments_ && CompressRecord(record, &length))
+      record = compressed_record_.data();
+
+    if (length > kWriteBatchSize) {
+      // This doesn't fit in a staging buffer, so it's written directly. The
+      // data staged so far has to go first, and is waited for so that the
+      // time spent writing is accounted for correctly. Compressed records
+      // always fit in a staging buffer.
+      DCHECK_EQ(mapped_buffer.data(), record);
+      WaitForAllWrites();
+      base::TimeTicks start_time = base::TimeTicks::Now();
+      bool written = writer_.WriteRecord(mapped_buffer.data(), length);
+      base::TimeDelta write_time = base::TimeTicks::Now() - start_time;
+
+      base::AutoLock auto_lock(lock_);
+      stats_.write_time += write_time;
+      if (written) {
+        ++stats_.writes;
+        stats_.bytes_written += length;
+      }
+    } else {
+      if (current_write_slot_ != NULL &&
+          current_write_slot_->length + length > kWriteBatchSize) {
+        IssueCurrentWrite();
+      }
+      if (current_write_slot_ == NULL)
+        current_write_slot_ = AcquireWriteSlot();
+
+      if (current_write_slot_ != NULL) {
+        ::memcpy(current_write_slot_->data + current_write_slot_->length,
+                 record, length);
+        current_write_slot_->length += length;
+      }
+    }
+  }
 
   // It's entirely possible for this buffer to be handed out to another client
   // and for the service to be forcibly shutdown before the client has had a
@@ -107,8 +263,155 @@ void SessionTraceFileWriter::WriteBuffer(scoped_refptr<Session> session,
   ::memset(mapped_buffer.data(), 0,
            sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader));
 
+  // The contents of the buffer are now staged, so the buffer can be handed
+  // back out before they hit the disk.
   mapped_buffer.Unmap();
   session->RecycleBuffer(buffer);
+
+  base::AutoLock auto_lock(lock_);
+  ++stats_.buffers_written;
+}
+
+bool SessionTraceFileWriter::CompressRecord(const uint8_t* record,
+                                            size_t* length) {
+  DCHECK(record != NULL);
+  DCHECK(length != NULL);
+
+  const size_t kSegmentHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
+  const size_t kCompressedSegmentHeaderLength =
+      sizeof(RecordPrefix) + sizeof(TraceFileCompressedSegmentHeader);
+
+  // Only segments as written by clients are compressed.
+  const RecordPrefix* prefix = reinterpret_cast<const RecordPrefix*>(record);
+  if (prefix->type != TraceFileSegmentHeader::kTypeId)
+    return false;
+
+  // The client may still be scribbling on the buffer, so the segment header
+  // is read once and validated against the length that is being written.
+  TraceFileSegmentHeader header =
+      *reinterpret_cast<const TraceFileSegmentHeader*>(prefix + 1);
+  if (kSegmentHeaderLength + header.segment_length > *length)
+    return false;
+
+  compressed_record_.resize(kCompressedSegmentHeaderLength);
+  if (!trace::common::CompressSegmentData(
+          record + kSegmentHeaderLength, header.segment_length,
+          trace::common::kSegmentCompressionLevel, &compressed_record_)) {
+    return false;
+  }
+
+  // Keep the segment as is if compressing it doesn't save any blocks, or if
+  // it would no longer fit in a staging buffer.
+  size_t compressed_length = ::common::AlignUp(compressed_record_.size(),
+                                               writer_.block_size());
+  if (compressed_length >= *length || compressed_length > kWriteBatchSize)
+    return false;
+
+  RecordPrefix* compressed_prefix =
+      reinterpret_cast<RecordPrefix*>(compressed_record_.data());
+  *compressed_prefix = *prefix;
+  compressed_prefix->type = TraceFileCompressedSegmentHeader::kTypeId;
+  compressed_prefix->size = sizeof(TraceFileCompressedSegmentHeader);
+
+  TraceFileCompressedSegmentHeader* compressed_header =
+      reinterpret_cast<TraceFileCompressedSegmentHeader*>(
+          compressed_prefix + 1);
+  compressed_header->thread_id = header.thread_id;
+  compressed_header->segment_length =
+      compressed_record_.size() - kCompressedSegmentHeaderLength;
+  compressed_header->uncompressed_length = header.segment_length;
+
+  compressed_record_.resize(compressed_length, 0);
+  *length = compressed_length;
+  return true;
+}
+
+SessionTraceFileWriter::WriteSlot* SessionTraceFileWriter::AcquireWriteSlot() {
+  ReapWrites(false);
+
+  // Staging buffers are allocated lazily, so that light sessions only ever
+  // use one.
+  if (free_write_slots_.empty() && write_slots_.size() < kMaxWritesInFlight) {
+    std::unique_ptr<WriteSlot> slot(new WriteSlot());
+    slot->data = reinterpret_cast<uint8_t*>(::VirtualAlloc(
+        NULL, kWriteBatchSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    slot->event.Set(::CreateEvent(NULL, TRUE, FALSE, NULL));
+    if (slot->data == NULL || !slot->event.IsValid()) {
+      DWORD error = ::GetLastError();
+      LOG(ERROR) << "Failed to allocate a staging buffer: "
+                 << ::common::LogWe(error) << ".";
+      return NULL;
+    }
+    slot->overlapped.hEvent = slot->event.Get();
+    free_write_slots_.push_back(slot.get());
+    write_slots_.push_back(std::move(slot));
+  }
+
+  // If all staging buffers are in flight, wait for the oldest write.
+  if (free_write_slots_.empty())
+    ReapWrites(true);
+  DCHECK(!free_write_slots_.empty());
+
+  WriteSlot* slot = free_write_slots_.back();
+  free_write_slots_.pop_back();
+  DCHECK_EQ(0u, slot->length);
+  return slot;
+}
+
+void SessionTraceFileWriter::IssueCurrentWrite() {
+  if (current_write_slot_ == NULL)
+    return;
+
+  WriteSlot* slot = current_write_slot_;
+  current_write_slot_ = NULL;
+  if (slot->length == 0) {
+    free_write_slots_.push_back(slot);
+    return;
+  }
+
+  if (writes_in_flight_.empty())
+    write_start_time_ = base::TimeTicks::Now();
+
+  if (!writer_.BeginWrite(slot->data, slot->length, &slot->overlapped)) {
+    LOG(ERROR) << "Dropped " << slot->length << " bytes of trace data.";
+    slot->length = 0;
+    free_write_slots_.push_back(slot);
+    return;
+  }
+
+  writes_in_flight_.push_back(slot);
+}
+
+void SessionTraceFileWriter::ReapWrites(bool wait_for_one) {
+  while (!writes_in_flight_.empty()) {
+    WriteSlot* slot = writes_in_flight_.front();
+    if (!wait_for_one && !HasOverlappedIoCompleted(&slot->overlapped))
+      break;
+    wait_for_one = false;
+
+    writes_in_flight_.pop_front();
+    bool written = writer_.EndWrite(&slot->overlapped, slot->length);
+
+    {
+      base::AutoLock auto_lock(lock_);
+      if (written) {
+        ++stats_.writes;
+        stats_.bytes_written += slot->length;
+      }
+      if (writes_in_flight_.empty())
+        stats_.write_time += base::TimeTicks::Now() - write_start_time_;
+    }
+
+    slot->length = 0;
+    free_write_slots_.push_back(slot);
+  }
+}
+
+void SessionTraceFileWriter::WaitForAllWrites() {
+  IssueCurrentWrite();
+  while (!writes_in_flight_.empty())
+    ReapWrites(true);
 }
 
 }  // namespace service
@@ -19,8 +19,14 @@
 #ifndef SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_SESSION_TRACE_FILE_WRITER_H_
 
+#include <deque>
+#include <memory>
+#include <vector>
+
 #include "base/files/file_path.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/thread.h"
+#include "base/time/time.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/buffer_consumer.h"
 #include "syzygy/trace/service/trace_file_writer.h"
@@ -34,8 +40,49 @@ class SessionTraceFileWriterFactory;
 
 // This class implements the interface the buffer consumer thread uses to
 // process incoming buffers.
+//
+// Buffers are queued as they are consumed, and the queue is drained on the
+// message loop. Each queued buffer is copied into a large aligned staging
+// buffer and immediately recycled to its session, so clients are not held
+// up by the disk. Full staging buffers are written with overlapped I/O, with
+// up to kMaxWritesInFlight writes outstanding at once.
 class SessionTraceFileWriter : public BufferConsumer {
  public:
+  // The size of the staging buffers into which consumed buffers are
+  // coalesced. Buffers larger than this are written directly.
+  static const size_t kWriteBatchSize = 8 * 1024 * 1024;
+
+  // The maximum number of writes that are in flight at once. This is also
+  // the maximum number of staging buffers.
+  static const size_t kMaxWritesInFlight = 4;
+
+  // Statistics about the writer, meant for sizing the buffer pool.
+  struct Stats {
+    // The number of buffers consumed but not yet copied out.
+    size_t queue_depth;
+    // The peak value of queue_depth.
+    size_t max_queue_depth;
+    // The number of buffers that have been consumed and recycled.
+    uint64_t buffers_written;
+    // The number of bytes of trace data consumed. This differs from
+    // bytes_written when segments are compressed.
+    uint64_t bytes_consumed;
+    // The number of writes that have completed, and the number of bytes they
+    // wrote.
+    uint64_t writes;
+    uint64_t bytes_written;
+    // The time during which at least one write was in flight.
+    base::TimeDelta write_time;
+    // The number of times, and the total time, that clients of the session
+    // have waited for a buffer to be recycled. These are only available once
+    // the session has been closed.
+    size_t client_waits;
+    base::TimeDelta client_wait_time;
+
+    // @returns the rate at which bytes have been written while writing.
+    double bytes_per_second() const;
+  };
+
   // Construct a SessionTraceFileWriter instance.
   // @param message_loop The message loop on which this writer instance will
   //     consume buffers. The writer instance does NOT take ownership of the
@@ -54,10 +101,65 @@ class SessionTraceFileWriter : public BufferConsumer {
   size_t block_size() const override;
   // @}
 
+  // Enables or disables the compression of segments on their way to disk.
+  // This must be called before the writer is opened.
+  // @param compress_segments true to compress segments.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
+  // @returns true if segments are compressed on their way to disk.
+  bool compress_segments() const { return compress_segments_; }
+
+  // Gets the current statistics of this writer.
+  // @param stats will receive the statistics.
+  void GetStats(Stats* stats);
+
  protected:
-  // Commit a trace buffer to disk. This will be called on message_loop_.
+  // A staging buffer, and the state of the write issued from it.
+  struct WriteSlot;
+
+  // A buffer waiting to be written.
+  struct QueuedBuffer {
+    scoped_refptr<Session> session;
+    Buffer* buffer;
+  };
+  typedef std::deque<QueuedBuffer> BufferQueue;
+
+  ~SessionTraceFileWriter() override;
+
+  // Writes out all queued buffers. This will be called on message_loop_.
+  void FlushPendingBuffers();
+
+  // Commit a trace buffer to disk. This copies the buffer to the current
+  // staging buffer, and recycles it. This will be called on message_loop_.
   void WriteBuffer(scoped_refptr<Session>, Buffer* buffer);
 
+  // Compresses a record into compressed_record_, as a segment headed by a
+  // TraceFileCompressedSegmentHeader.
+  // @param record the record to compress. This must have been validated by
+  //     TraceFileWriter::GetRecordWriteLength.
+  // @param length the number of bytes of the record to write. This will be
+  //     updated to the number of bytes of compressed_record_ to write.
+  // @returns true if the record was compressed, false if it should be written
+  //     as is.
+  bool CompressRecord(const uint8_t* record, size_t* length);
+
+  // @returns a free staging buffer, waiting for a write to complete if
+  //     necessary, or NULL on failure.
+  WriteSlot* AcquireWriteSlot();
+
+  // Issues the write of the current staging buffer, if it is not empty.
+  void IssueCurrentWrite();
+
+  // Completes writes that are in flight, in the order they were issued.
+  // @param wait_for_one if true, waits for at least one write to complete.
+  //     Otherwise only writes that have already completed are reaped.
+  void ReapWrites(bool wait_for_one);
+
+  // Waits for all writes in flight to complete.
+  void WaitForAllWrites();
+
   // The message loop on which this trace file writer will do IO.
   base::MessageLoop* const message_loop_;
 
@@ -69,6 +171,33 @@ class SessionTraceFileWriter : public BufferConsumer {
   // This is used for committing actual buffers to disk.
   TraceFileWriter writer_;
 
+  // Whether segments are compressed, and the buffer receiving the compressed
+  // record. The buffer is only used on message_loop_.
+  bool compress_segments_;
+  std::vector<uint8_t> compressed_record_;
+
+  // The buffers waiting to be written, and whether a task to write them has
+  // been posted.
+  BufferQueue pending_buffers_;  // Under lock_.
+  bool flush_is_pending_;  // Under lock_.
+
+  // The statistics of this writer.
+  Stats stats_;  // Under lock_.
+
+  // Protects the members above.
+  base::Lock lock_;
+
+  // @name The staging buffers. These are only accessed on message_loop_, or
+  //     on destruction.
+  // @{
+  std::vector<std::unique_ptr<WriteSlot>> write_slots_;
+  std::vector<WriteSlot*> free_write_slots_;
+  std::deque<WriteSlot*> writes_in_flight_;
+  WriteSlot* current_write_slot_;
+  // The time at which the current run of writes in flight started.
+  base::TimeTicks write_start_time_;
+  // @}
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SessionTraceFileWriter);
 };
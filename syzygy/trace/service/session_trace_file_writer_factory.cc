@@ -23,7 +23,9 @@ namespace service {
 
 SessionTraceFileWriterFactory::SessionTraceFileWriterFactory(
     base::MessageLoop* message_loop)
-    : message_loop_(message_loop), trace_file_directory_(L".") {
+    : message_loop_(message_loop),
+      trace_file_directory_(L"."),
+      compress_segments_(false) {
   DCHECK(message_loop != NULL);
   DCHECK_EQ(base::MessageLoop::TYPE_IO, message_loop->type());
 }
@@ -47,7 +49,10 @@ bool SessionTraceFileWriterFactory::CreateConsumer(
   DCHECK(message_loop_ != NULL);
 
   // Allocate a new trace file writer.
-  *consumer = new SessionTraceFileWriter(message_loop_, trace_file_directory_);
+  SessionTraceFileWriter* writer =
+      new SessionTraceFileWriter(message_loop_, trace_file_directory_);
+  writer->set_compress_segments(compress_segments_);
+  *consumer = writer;
   return true;
 }
 
@@ -53,6 +53,12 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   // file writers will output trace files.
   bool SetTraceFileDirectory(const base::FilePath& path);
 
+  // Sets whether subsequently created trace file writers compress the
+  // segments they write.
+  void set_compress_segments(bool compress_segments) {
+    compress_segments_ = compress_segments;
+  }
+
   // Get the message loop the trace file writers should use for IO.
   base::MessageLoop* message_loop() { return message_loop_; }
 
@@ -63,6 +69,9 @@ class SessionTraceFileWriterFactory : public BufferConsumerFactory {
   // The directory into which trace file writers will write.
   base::FilePath trace_file_directory_;
 
+  // Whether trace file writers compress the segments they write.
+  bool compress_segments_;
+
   // The set of currently active buffer consumer objects. Protected by lock_.
   std::set<scoped_refptr<BufferConsumer>> active_consumers_;
 
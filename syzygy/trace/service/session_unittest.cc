@@ -457,6 +457,12 @@ TEST_F(SessionTest, BackPressureWorks) {
   ASSERT_TRUE(result3);
   ASSERT_EQ(buffer1, buffer3);
 
+  // The wait was accounted for.
+  size_t client_waits = 0;
+  base::TimeDelta client_wait_time;
+  session->GetClientWaitStats(&client_waits, &client_wait_time);
+  EXPECT_EQ(1u, client_waits);
+
   // Return the last buffer and allow everything to be written.
   ASSERT_TRUE(session->ReturnBuffer(buffer3));
   session->AllowBuffersToBeRecycled(9999);
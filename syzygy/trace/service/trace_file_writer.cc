@@ -40,7 +40,8 @@ bool OpenTraceFile(const base::FilePath& file_path,
                    FILE_SHARE_DELETE | FILE_SHARE_READ,
                    NULL, /* lpSecurityAttributes */
                    CREATE_ALWAYS,
-                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING,
+                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING |
+                       FILE_FLAG_OVERLAPPED,
                    NULL /* hTemplateFile */));
   if (!new_file_handle.IsValid()) {
     DWORD error = ::GetLastError();
@@ -83,7 +84,7 @@ bool GetBlockSize(const base::FilePath& path, size_t* block_size) {
 
 }  // namespace
 
-TraceFileWriter::TraceFileWriter() : block_size_(0) {
+TraceFileWriter::TraceFileWriter() : block_size_(0), next_write_offset_(0) {
 }
 
 TraceFileWriter::~TraceFileWriter() {
@@ -130,6 +131,7 @@ bool TraceFileWriter::Open(const base::FilePath& path) {
   path_ = path;
   handle_.Set(temp_handle.Take());
   block_size_ = block_size;
+  next_write_offset_ = 0;
 
   return true;
 }
@@ -181,80 +183,158 @@ bool TraceFileWriter::WriteHeader(const ProcessInfo& process_info) {
   writer.Align(block_size_);
 
   // Commit the header page to disk.
-  DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(), &buffer[0], buffer.size(), &bytes_written,
-                   NULL) || bytes_written != buffer.size() ) {
-    DWORD error = ::GetLastError();
-    LOG(ERROR) << "Failed writing trace file header: " << ::common::LogWe(error)
-               << ".";
+  if (!WriteSynchronously(&buffer[0], buffer.size())) {
+    LOG(ERROR) << "Failed writing trace file header.";
     return false;
   }
 
   return true;
 }
 
-bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
+bool TraceFileWriter::GetRecordWriteLength(const void* data,
+                                           size_t length,
+                                           size_t* bytes_to_write) const {
   DCHECK(data != NULL);
+  DCHECK(bytes_to_write != NULL);
 
-  const size_t kHeaderLength =
-      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader);
-
-  if (length < kHeaderLength) {
+  if (length < sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader)) {
     LOG(ERROR) << "Dropped buffer: too short.";
     return false;
   }
 
-  // We currently can only handle records that contain a TraceFileSegmentHeader.
+  // We currently can only handle records that contain a TraceFileSegmentHeader
+  // or a TraceFileCompressedSegmentHeader.
   const RecordPrefix* record = reinterpret_cast<const RecordPrefix*>(data);
-  if (record->type != TraceFileSegmentHeader::kTypeId ||
-      record->size != sizeof(TraceFileSegmentHeader) ||
+  bool compressed =
+      record->type == TraceFileCompressedSegmentHeader::kTypeId &&
+      record->size == sizeof(TraceFileCompressedSegmentHeader);
+  if ((!compressed &&
+       (record->type != TraceFileSegmentHeader::kTypeId ||
+        record->size != sizeof(TraceFileSegmentHeader))) ||
       record->version.hi != TRACE_VERSION_HI ||
       record->version.lo != TRACE_VERSION_LO) {
     LOG(ERROR) << "Dropped buffer: invalid RecordPrefix.";
     return false;
   }
 
+  const size_t kHeaderLength = sizeof(RecordPrefix) +
+      (compressed ? sizeof(TraceFileCompressedSegmentHeader)
+                  : sizeof(TraceFileSegmentHeader));
+  if (length < kHeaderLength) {
+    LOG(ERROR) << "Dropped buffer: too short.";
+    return false;
+  }
+
   // Let's not trust the client to stop playing with the buffer while
   // we're writing. Whatever the length is now, is what we'll use. If the
   // segment itself is empty we simply skip writing the buffer.
-  const TraceFileSegmentHeader* header =
-      reinterpret_cast<const TraceFileSegmentHeader*>(record + 1);
-  size_t segment_length = header->segment_length;
+  size_t segment_length = 0;
+  if (compressed) {
+    segment_length = reinterpret_cast<const TraceFileCompressedSegmentHeader*>(
+        record + 1)->segment_length;
+  } else {
+    segment_length = reinterpret_cast<const TraceFileSegmentHeader*>(
+        record + 1)->segment_length;
+  }
   if (segment_length == 0) {
-    LOG(INFO) << "Not writing empty buffer.";
+    *bytes_to_write = 0;
     return true;
   }
 
   // Figure out the total size that we'll write to disk.
-  size_t bytes_to_write = ::common::AlignUp(kHeaderLength + segment_length,
-                                            block_size_);
+  *bytes_to_write = ::common::AlignUp(kHeaderLength + segment_length,
+                                      block_size_);
 
   // Ensure that the total number of bytes to write does not exceed the
   // maximum record length.
-  if (bytes_to_write > length) {
+  if (*bytes_to_write > length) {
     LOG(ERROR) << "Dropped buffer: bytes written exceeds buffer size.";
     return false;
   }
 
+  return true;
+}
+
+bool TraceFileWriter::WriteRecord(const void* data, size_t length) {
+  DCHECK(data != NULL);
+
+  size_t bytes_to_write = 0;
+  if (!GetRecordWriteLength(data, length, &bytes_to_write))
+    return false;
+
+  if (bytes_to_write == 0) {
+    LOG(INFO) << "Not writing empty buffer.";
+    return true;
+  }
+
   // Commit the buffer to disk.
-  // TODO(rogerm): Use overlapped I/O.
-  DCHECK_LT(0u, bytes_to_write);
+  return WriteSynchronously(data, bytes_to_write);
+}
+
+bool TraceFileWriter::BeginWrite(const void* data,
+                                 size_t length,
+                                 OVERLAPPED* overlapped) {
+  DCHECK(data != NULL);
+  DCHECK(overlapped != NULL);
+  DCHECK_LT(0u, length);
+  DCHECK_EQ(0u, length % block_size_);
+
+  overlapped->Internal = 0;
+  overlapped->InternalHigh = 0;
+  overlapped->Offset = static_cast<DWORD>(next_write_offset_);
+  overlapped->OffsetHigh = static_cast<DWORD>(next_write_offset_ >> 32);
+  if (overlapped->hEvent != NULL)
+    ::ResetEvent(overlapped->hEvent);
+
+  if (!::WriteFile(handle_.Get(), data, length, NULL, overlapped)) {
+    DWORD error = ::GetLastError();
+    if (error != ERROR_IO_PENDING) {
+      LOG(ERROR) << "Failed writing to '" << path_.value()
+                 << "': " << ::common::LogWe(error) << ".";
+      return false;
+    }
+  }
+
+  // The file offset advances as soon as the write is issued, so that several
+  // writes may be in flight at once.
+  next_write_offset_ += length;
+  return true;
+}
+
+bool TraceFileWriter::EndWrite(OVERLAPPED* overlapped, size_t length) {
+  DCHECK(overlapped != NULL);
+
   DWORD bytes_written = 0;
-  if (!::WriteFile(handle_.Get(),
-                   record,
-                   bytes_to_write,
-                   &bytes_written,
-                   NULL) ||
-      bytes_written != bytes_to_write) {
+  if (!::GetOverlappedResult(handle_.Get(), overlapped, &bytes_written,
+                             TRUE)) {
     DWORD error = ::GetLastError();
     LOG(ERROR) << "Failed writing to '" << path_.value()
                << "': " << ::common::LogWe(error) << ".";
     return false;
   }
 
+  if (bytes_written != length) {
+    LOG(ERROR) << "Short write to '" << path_.value() << "'.";
+    return false;
+  }
+
   return true;
 }
 
+bool TraceFileWriter::WriteSynchronously(const void* data, size_t length) {
+  base::win::ScopedHandle event(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  if (!event.IsValid()) {
+    DWORD error = ::GetLastError();
+    LOG(ERROR) << "CreateEvent failed: " << ::common::LogWe(error) << ".";
+    return false;
+  }
+
+  OVERLAPPED overlapped = {};
+  overlapped.hEvent = event.Get();
+  return BeginWrite(data, length, &overlapped) &&
+         EndWrite(&overlapped, length);
+}
+
 bool TraceFileWriter::Close() {
   if (::CloseHandle(handle_.Take()) == 0) {
     DWORD error = ::GetLastError();
@@ -39,6 +39,8 @@
 #ifndef SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 #define SYZYGY_TRACE_SERVICE_TRACE_FILE_WRITER_H_
 
+#include <windows.h>
+
 #include "base/files/file_path.h"
 #include "base/win/scoped_handle.h"
 #include "syzygy/trace/service/process_info.h"
@@ -79,13 +81,42 @@ class TraceFileWriter {
   // Writes a record of data to disk.
   // @param data The record to be written. This must contain a RecordPrefix.
   //     This currently only supports records that contain a
-  //     TraceFileSegmenHeader.
+  //     TraceFileSegmentHeader or a TraceFileCompressedSegmentHeader.
   // @param length The maximum length of continuous data that may be
   //     contained in the record. The actual length is stored in the header, but
   //     this is necessary to ensure that the header is valid.
   // @returns true on success, false otherwise.
   bool WriteRecord(const void* data, size_t length);
 
+  // Validates a record and determines how many bytes of it need to be
+  // written. This is the validation performed by WriteRecord, exposed so that
+  // callers may coalesce records before writing them.
+  // @param data The record to be validated. See WriteRecord.
+  // @param length The maximum length of the record. See WriteRecord.
+  // @param bytes_to_write Will receive the number of bytes to write. This is a
+  //     multiple of block_size(), and is zero if the record is empty.
+  // @returns true on success, false if the record is invalid.
+  bool GetRecordWriteLength(const void* data,
+                            size_t length,
+                            size_t* bytes_to_write) const;
+
+  // @name Asynchronous writing.
+  // Issues an overlapped write of @p length bytes at the current end of the
+  // trace file, and completes it. Several writes may be in flight at once;
+  // they land in the file in the order in which they were issued.
+  // @param data The data to write. This must remain valid and unmodified
+  //     until EndWrite has returned, and must be aligned to block_size().
+  // @param length The number of bytes to write. This must be a multiple of
+  //     block_size().
+  // @param overlapped The overlapped structure tracking the write. Its hEvent
+  //     member should be set to a manual-reset event if several writes are
+  //     to be in flight at once.
+  // @returns true on success, false otherwise.
+  // @{
+  bool BeginWrite(const void* data, size_t length, OVERLAPPED* overlapped);
+  bool EndWrite(OVERLAPPED* overlapped, size_t length);
+  // @}
+
   // Closes the trace file.
   // @returns true on success, false otherwise.
   // @note If this is not called manually the trace-file will close itself when
@@ -110,7 +141,14 @@ class TraceFileWriter {
   // The block size being used by the trace file writer.
   size_t block_size_;
 
+  // The offset in the file at which the next write will be issued.
+  uint64_t next_write_offset_;
+
  private:
+  // Writes @p length bytes of @p data at the end of the file, and waits for
+  // the write to complete.
+  bool WriteSynchronously(const void* data, size_t length);
+
   DISALLOW_COPY_AND_ASSIGN(TraceFileWriter);
 };
 
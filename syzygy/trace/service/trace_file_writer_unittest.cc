@@ -14,6 +14,9 @@
 
 #include "syzygy/trace/service/trace_file_writer.h"
 
+#include <string>
+#include <vector>
+
 #include "base/files/file_util.h"
 #include "gtest/gtest.h"
 #include "syzygy/common/align.h"
@@ -180,5 +183,76 @@ TEST_F(TraceFileWriterTest, WriteRecordSucceeds) {
   EXPECT_EQ(0, trace_file_size % w.block_size());
 }
 
+TEST_F(TraceFileWriterTest, GetRecordWriteLength) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  std::vector<uint8_t> data;
+  data.resize(::common::AlignUp(
+      sizeof(RecordPrefix) + sizeof(TraceFileSegmentHeader), w.block_size()));
+  RecordPrefix* record = reinterpret_cast<RecordPrefix*>(data.data());
+  TraceFileSegmentHeader* header = reinterpret_cast<TraceFileSegmentHeader*>(
+      record + 1);
+  record->size = sizeof(TraceFileSegmentHeader);
+  record->type = TraceFileSegmentHeader::kTypeId;
+  record->version.hi = TRACE_VERSION_HI;
+  record->version.lo = TRACE_VERSION_LO;
+
+  // An empty segment needs no writing.
+  size_t bytes_to_write = 1;
+  EXPECT_TRUE(w.GetRecordWriteLength(data.data(), data.size(),
+                                     &bytes_to_write));
+  EXPECT_EQ(0u, bytes_to_write);
+
+  header->segment_length = 1;
+  EXPECT_TRUE(w.GetRecordWriteLength(data.data(), data.size(),
+                                     &bytes_to_write));
+  EXPECT_EQ(data.size(), bytes_to_write);
+
+  header->segment_length = data.size();
+  EXPECT_FALSE(w.GetRecordWriteLength(data.data(), data.size(),
+                                      &bytes_to_write));
+}
+
+TEST_F(TraceFileWriterTest, OverlappedWritesSucceed) {
+  TestTraceFileWriter w;
+  ASSERT_TRUE(w.Open(trace_path));
+
+  ProcessInfo pi;
+  ASSERT_TRUE(pi.Initialize(::GetCurrentProcessId()));
+  ASSERT_TRUE(w.WriteHeader(pi));
+
+  int64_t file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(trace_path, &file_size));
+  size_t header_size = static_cast<size_t>(file_size);
+
+  // Issue two writes before completing either of them.
+  std::vector<uint8_t> data1(4 * w.block_size(), 0xAA);
+  std::vector<uint8_t> data2(2 * w.block_size(), 0xBB);
+  base::win::ScopedHandle event1(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  base::win::ScopedHandle event2(::CreateEvent(NULL, TRUE, FALSE, NULL));
+  ASSERT_TRUE(event1.IsValid());
+  ASSERT_TRUE(event2.IsValid());
+  OVERLAPPED overlapped1 = {};
+  OVERLAPPED overlapped2 = {};
+  overlapped1.hEvent = event1.Get();
+  overlapped2.hEvent = event2.Get();
+  ASSERT_TRUE(w.BeginWrite(data1.data(), data1.size(), &overlapped1));
+  ASSERT_TRUE(w.BeginWrite(data2.data(), data2.size(), &overlapped2));
+  EXPECT_TRUE(w.EndWrite(&overlapped2, data2.size()));
+  EXPECT_TRUE(w.EndWrite(&overlapped1, data1.size()));
+  ASSERT_TRUE(w.Close());
+
+  // The writes land one after the other, following the header.
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(trace_path, &contents));
+  ASSERT_EQ(header_size + data1.size() + data2.size(), contents.size());
+  EXPECT_EQ(0, ::memcmp(data1.data(), contents.data() + header_size,
+                        data1.size()));
+  EXPECT_EQ(0, ::memcmp(data2.data(),
+                        contents.data() + header_size + data1.size(),
+                        data2.size()));
+}
+
 }  // namespace service
 }  // namespace trace